@@ -33,43 +33,120 @@
 #define CONFIG_MENDER_CLIENT_CONFIGURE_REFRESH_INTERVAL (28800)
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_REFRESH_INTERVAL */
 
+#ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
 /**
- * @brief Mender configure instance
+ * @brief Delimiter of the artifact name and of the configuration saved in the storage, ASCII unit separator which is always escaped in JSON strings
  */
-const mender_addon_instance_t mender_configure_addon_instance
-    = { .init = mender_configure_init, .activate = mender_configure_activate, .deactivate = mender_configure_deactivate, .exit = mender_configure_exit };
+#define MENDER_CONFIGURE_STORAGE_DELIMITER '\x1F'
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
 /**
- * @brief Mender configure configuration
+ * @brief Trigger the configure work depending of the reasons of the client trigger
+ * @param reasons Reasons of the trigger, combination of mender_client_trigger_t
+ * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_configure_config_t mender_configure_config;
+static mender_err_t mender_configure_trigger(uint32_t reasons);
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
 
 /**
- * @brief Mender configure callbacks
+ * @brief Select the context of the configure of the calling thread
+ * @param ctx Context, NULL to select the context of the device of mender_client_init
+ * @return Context previously selected
  */
-static mender_configure_callbacks_t mender_configure_callbacks;
+static void *mender_configure_select_ctx(void *ctx);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
 /**
- * @brief Mender configure keystore
+ * @brief Context of the configure of a device
  */
-static mender_keystore_t *mender_configure_keystore = NULL;
-static void              *mender_configure_mutex    = NULL;
+typedef struct {
+    mender_configure_config_t    config;        /**< Mender configure configuration */
+    mender_configure_callbacks_t callbacks;     /**< Mender configure callbacks */
+    mender_keystore_t           *keystore;      /**< Mender configure keystore */
+    void                        *mutex;         /**< Mutex protecting the keystore */
+    char                        *artifact_name; /**< Mender configure artifact name */
+#ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+    char *device_config; /**< Device configuration read from the storage, parsed to the key-store when the configuration is used for the first time */
+    bool  storage;       /**< Flag indicating the device configuration is recorded in the storage, it is not for the additional devices */
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+    void                  *work_handle; /**< Mender configure work handle */
+    mender_utils_backoff_t backoff;     /**< Mender configure work backoff policy */
+} mender_configure_ctx_t;
+
+/**
+ * @brief Context of the configure of the device of mender_client_init
+ */
+static mender_configure_ctx_t mender_configure_default_ctx;
 
 /**
- * @brief Mender configure artifact name
+ * @brief Context of the configure of the device of the calling thread, it is selected with the context of the client
  */
-static char *mender_configure_artifact_name = NULL;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+static __thread mender_configure_ctx_t *mender_configure_ctx = &mender_configure_default_ctx;
+#else
+static mender_configure_ctx_t *const mender_configure_ctx = &mender_configure_default_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
 /**
- * @brief Mender configure work handle
+ * @brief Mender configure instance
  */
-static void *mender_configure_work_handle = NULL;
+const mender_addon_instance_t mender_configure_addon_instance = { .init       = mender_configure_init,
+                                                                  .activate   = mender_configure_activate,
+                                                                  .deactivate = mender_configure_deactivate,
+                                                                  .exit       = mender_configure_exit,
+                                                                  .trigger    = mender_configure_trigger,
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+                                                                  .ctx_size   = sizeof(mender_configure_ctx_t),
+                                                                  .select_ctx = mender_configure_select_ctx
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+};
 
 /**
  * @brief Mender configure work function
+ * @param arg Context of the device of the work, with CONFIG_MENDER_CLIENT_CONTEXTS only
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_configure_work_function(MENDER_SCHEDULER_WORK_ARG);
+
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+/**
+ * @brief Compute the changes between two configurations, the items of the changes reference the strings of the configurations
+ * @param previous Previous configuration, NULL if not defined
+ * @param current Current configuration, NULL if not defined
+ * @param updated Items added or modified, to be released with mender_utils_free
+ * @param removed Items removed, with their previous values, to be released with mender_utils_free
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_configure_diff(mender_keystore_t *previous, mender_keystore_t *current, mender_keystore_t **updated, mender_keystore_t **removed);
+
+/**
+ * @brief Search an item of a configuration
+ * @param configuration Configuration, NULL if not defined
+ * @param name Name of the item
+ * @return Value of the item, NULL if it is not found
+ */
+static char *mender_configure_find(mender_keystore_t *configuration, char *name);
+
+#else
+
+/**
+ * @brief Parse the device configuration read from the storage if it has not been parsed yet, the configure mutex is held by the caller
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_configure_work_function(void);
+static mender_err_t mender_configure_load(void);
+
+/**
+ * @brief Save the device configuration to the storage, the artifact name is followed by the configuration printed
+ * @param artifact_name Artifact name, NULL if not defined
+ * @param json_config Configuration
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_configure_save(char *artifact_name, cJSON *json_config);
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
 /**
  * @brief Callback function to be invoked to perform the treatment of the data from the artifact type "mender-configure"
@@ -98,36 +175,56 @@ mender_configure_init(void *config, void *callbacks) {
 
     /* Save configuration */
     if (0 != ((mender_configure_config_t *)config)->refresh_interval) {
-        mender_configure_config.refresh_interval = ((mender_configure_config_t *)config)->refresh_interval;
+        mender_configure_ctx->config.refresh_interval = ((mender_configure_config_t *)config)->refresh_interval;
     } else {
-        mender_configure_config.refresh_interval = CONFIG_MENDER_CLIENT_CONFIGURE_REFRESH_INTERVAL;
+        mender_configure_ctx->config.refresh_interval = CONFIG_MENDER_CLIENT_CONFIGURE_REFRESH_INTERVAL;
     }
 
     /* Save callbacks */
     if (NULL != callbacks) {
-        memcpy(&mender_configure_callbacks, callbacks, sizeof(mender_configure_callbacks_t));
+        memcpy(&mender_configure_ctx->callbacks, callbacks, sizeof(mender_configure_callbacks_t));
     }
 
     /* Create configure mutex */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_configure_mutex))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_configure_ctx->mutex))) {
         mender_log_error("Unable to create configure mutex");
         goto END;
     }
 
 #ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
-    /* Initialize configuration from storage (if it is not empty) */
-    if (MENDER_OK != (ret = mender_storage_get_device_config(&device_config))) {
+    /* Initialize configuration from storage (if it is not empty), the device configuration of the additional devices is not recorded */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    mender_configure_ctx->storage = (NULL == mender_client_get_ctx());
+#else
+    mender_configure_ctx->storage = true;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    if ((true == mender_configure_ctx->storage) && (MENDER_OK != (ret = mender_storage_get_device_config(&device_config)))) {
         if (MENDER_NOT_FOUND != ret) {
             mender_log_error("Unable to get device configuration");
             goto END;
         }
     }
 
-    /* Check if configuration is available */
-    if (NULL != device_config) {
+    /* Check if configuration is available, it is parsed when it is used for the first time */
+    char *delimiter;
+    if ((NULL != device_config) && (NULL != (delimiter = strchr(device_config, MENDER_CONFIGURE_STORAGE_DELIMITER)))) {
 
-        /* Parse configuration */
+        /* Retrieve artifact name if it is available */
+        *delimiter = '\0';
+        if ('\0' != device_config[0]) {
+            if (NULL == (mender_configure_ctx->artifact_name = mender_utils_strdup(device_config))) {
+                mender_log_error("Unable to allocate memory");
+                ret = MENDER_FAIL;
+                goto END;
+            }
+        }
+        mender_configure_ctx->device_config = device_config;
+        device_config                       = NULL;
+
+    } else if (NULL != device_config) {
+
+        /* Parse configuration saved as a JSON object by the previous versions */
         if (NULL == (json_device_config = cJSON_Parse(device_config))) {
             mender_log_error("Unable to set device configuration");
             ret = MENDER_FAIL;
@@ -135,14 +232,16 @@ mender_configure_init(void *config, void *callbacks) {
         }
 
         /* Set device configuration */
-        if (MENDER_OK != (ret = mender_utils_keystore_from_json(&mender_configure_keystore, cJSON_GetObjectItemCaseSensitive(json_device_config, "config")))) {
+        if (MENDER_OK
+            != (ret = mender_utils_keystore_from_json(&mender_configure_ctx->keystore,
+                                                      cJSON_GetObjectItemCaseSensitive(json_device_config, "config")))) {
             mender_log_error("Unable to set device configuration");
             goto END;
         }
 
         /* Retrieve artifact name if it is available */
         if (NULL != (artifact_name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json_device_config, "artifact_name")))) {
-            if (NULL == (mender_configure_artifact_name = strdup(artifact_name))) {
+            if (NULL == (mender_configure_ctx->artifact_name = mender_utils_strdup(artifact_name))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto END;
@@ -152,8 +251,8 @@ mender_configure_init(void *config, void *callbacks) {
 
     /* Register mender-configure artifact type */
     if (MENDER_OK
-        != (ret
-            = mender_client_register_artifact_type("mender-configure", &mender_configure_download_artifact_callback, true, mender_configure_artifact_name))) {
+        != (ret = mender_client_register_artifact_type(
+                "mender-configure", &mender_configure_download_artifact_callback, true, mender_configure_ctx->artifact_name))) {
         mender_log_error("Unable to register 'mender-configure' artifact type");
         goto END;
     }
@@ -163,18 +262,24 @@ mender_configure_init(void *config, void *callbacks) {
     /* Create mender configure work */
     mender_scheduler_work_params_t configure_work_params;
     configure_work_params.function = mender_configure_work_function;
-    configure_work_params.period   = mender_configure_config.refresh_interval;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    configure_work_params.arg = mender_client_get_ctx();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    configure_work_params.period   = mender_configure_ctx->config.refresh_interval;
     configure_work_params.name     = "mender_configure";
-    if (MENDER_OK != (ret = mender_scheduler_work_create(&configure_work_params, &mender_configure_work_handle))) {
+    configure_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_LOW;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&configure_work_params, &mender_configure_ctx->work_handle))) {
         mender_log_error("Unable to create configure work");
         goto END;
     }
+    mender_utils_backoff_init(&mender_configure_ctx->backoff,
+                              (mender_configure_ctx->config.refresh_interval > 0) ? (uint32_t)mender_configure_ctx->config.refresh_interval : 0);
 
 END:
 
     /* Release memory */
     if (NULL != device_config) {
-        free(device_config);
+        mender_utils_free(device_config);
     }
     if (NULL != json_device_config) {
         cJSON_Delete(json_device_config);
@@ -189,10 +294,20 @@ mender_configure_activate(void) {
     mender_err_t ret;
 
     /* Activate configure work */
-    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_configure_work_handle))) {
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_configure_ctx->work_handle))) {
         mender_log_error("Unable to activate configure work");
         return ret;
     }
+#ifdef CONFIG_MENDER_API_BATCH
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+    /* Download the device configuration with the deployment checks, the work is triggered when it is available */
+    if (MENDER_OK != (ret = mender_api_batch_register(MENDER_API_BATCH_CONFIGURATION, &mender_configure_execute))) {
+        mender_log_error("Unable to register configure request");
+        return ret;
+    }
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_API_BATCH */
 
     return ret;
 }
@@ -200,8 +315,15 @@ mender_configure_activate(void) {
 mender_err_t
 mender_configure_deactivate(void) {
 
+#ifdef CONFIG_MENDER_API_BATCH
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+    /* Stop downloading the device configuration with the deployment checks */
+    mender_api_batch_register(MENDER_API_BATCH_CONFIGURATION, NULL);
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_API_BATCH */
     /* Deactivate mender configure work */
-    mender_scheduler_work_deactivate(mender_configure_work_handle);
+    mender_scheduler_work_deactivate(mender_configure_ctx->work_handle);
 
     return MENDER_OK;
 }
@@ -213,13 +335,22 @@ mender_configure_get(mender_keystore_t **configuration) {
     mender_err_t ret;
 
     /* Take mutex used to protect access to the configuration key-store */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_configure_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_configure_ctx->mutex, -1))) {
         mender_log_error("Unable to take mutex");
         return ret;
     }
 
+#ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+    /* Parse the device configuration if it has not been parsed yet */
+    if (MENDER_OK != (ret = mender_configure_load())) {
+        goto END;
+    }
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+
     /* Copy the configuration */
-    if (MENDER_OK != (ret = mender_utils_keystore_copy(configuration, mender_configure_keystore))) {
+    if (MENDER_OK != (ret = mender_utils_keystore_copy(configuration, mender_configure_ctx->keystore))) {
         mender_log_error("Unable to copy configuration");
         goto END;
     }
@@ -227,7 +358,7 @@ mender_configure_get(mender_keystore_t **configuration) {
 END:
 
     /* Release mutex used to protect access to the configuration key-store */
-    mender_scheduler_mutex_give(mender_configure_mutex);
+    mender_scheduler_mutex_give(mender_configure_ctx->mutex);
 
     return ret;
 }
@@ -235,25 +366,31 @@ END:
 mender_err_t
 mender_configure_set(mender_keystore_t *configuration) {
 
-    cJSON       *json_device_config = NULL;
-    cJSON       *json_config        = NULL;
-    char        *device_config      = NULL;
+    cJSON       *json_config = NULL;
     mender_err_t ret;
 
     /* Take mutex used to protect access to the configuration key-store */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_configure_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_configure_ctx->mutex, -1))) {
         mender_log_error("Unable to take mutex");
         return ret;
     }
 
+#ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+    /* The device configuration read from the storage is replaced */
+    mender_utils_free(mender_configure_ctx->device_config);
+    mender_configure_ctx->device_config = NULL;
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+
     /* Release previous configuration */
-    if (MENDER_OK != (ret = mender_utils_keystore_delete(mender_configure_keystore))) {
+    if (MENDER_OK != (ret = mender_utils_keystore_delete(mender_configure_ctx->keystore))) {
         mender_log_error("Unable to delete device configuration");
         goto END;
     }
 
     /* Copy the new configuration */
-    if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_configure_keystore, configuration))) {
+    if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_configure_ctx->keystore, configuration))) {
         mender_log_error("Unable to copy configuration");
         goto END;
     }
@@ -261,12 +398,7 @@ mender_configure_set(mender_keystore_t *configuration) {
 #ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
     /* Save the device configuration */
-    if (NULL == (json_device_config = cJSON_CreateObject())) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    if (MENDER_OK != (ret = mender_utils_keystore_to_json(mender_configure_keystore, &json_config))) {
+    if (MENDER_OK != (ret = mender_utils_keystore_to_json(mender_configure_ctx->keystore, &json_config))) {
         mender_log_error("Unable to format configuration");
         goto END;
     }
@@ -275,14 +407,7 @@ mender_configure_set(mender_keystore_t *configuration) {
         ret = MENDER_FAIL;
         goto END;
     }
-    cJSON_AddItemToObject(json_device_config, "config", json_config);
-    if (NULL == (device_config = cJSON_PrintUnformatted(json_device_config))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    if (MENDER_OK != (ret = mender_storage_set_device_config(device_config))) {
-        mender_log_error("Unable to record configuration");
+    if (MENDER_OK != (ret = mender_configure_save(NULL, json_config))) {
         goto END;
     }
 
@@ -291,15 +416,12 @@ mender_configure_set(mender_keystore_t *configuration) {
 END:
 
     /* Release memory */
-    if (NULL != json_device_config) {
-        cJSON_Delete(json_device_config);
-    }
-    if (NULL != device_config) {
-        free(device_config);
+    if (NULL != json_config) {
+        cJSON_Delete(json_config);
     }
 
     /* Release mutex used to protect access to the configuration key-store */
-    mender_scheduler_mutex_give(mender_configure_mutex);
+    mender_scheduler_mutex_give(mender_configure_ctx->mutex);
 
     return ret;
 }
@@ -310,7 +432,7 @@ mender_configure_execute(void) {
     mender_err_t ret;
 
     /* Trigger execution of the work */
-    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_configure_work_handle))) {
+    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_configure_ctx->work_handle))) {
         mender_log_error("Unable to trigger configure work");
         return ret;
     }
@@ -324,39 +446,78 @@ mender_configure_exit(void) {
     mender_err_t ret;
 
     /* Delete mender configure work */
-    mender_scheduler_work_delete(mender_configure_work_handle);
-    mender_configure_work_handle = NULL;
+    mender_scheduler_work_delete(mender_configure_ctx->work_handle);
+    mender_configure_ctx->work_handle = NULL;
 
     /* Take mutex used to protect access to the configure key-store */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_configure_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_configure_ctx->mutex, -1))) {
         mender_log_error("Unable to take mutex");
         return ret;
     }
 
     /* Release memory */
-    mender_configure_config.refresh_interval = 0;
-    mender_utils_keystore_delete(mender_configure_keystore);
-    mender_configure_keystore = NULL;
-    mender_scheduler_mutex_give(mender_configure_mutex);
-    mender_scheduler_mutex_delete(mender_configure_mutex);
-    mender_configure_mutex = NULL;
-    if (NULL != mender_configure_artifact_name) {
-        free(mender_configure_artifact_name);
-        mender_configure_artifact_name = NULL;
+    mender_configure_ctx->config.refresh_interval = 0;
+    mender_utils_keystore_delete(mender_configure_ctx->keystore);
+    mender_configure_ctx->keystore = NULL;
+    mender_scheduler_mutex_give(mender_configure_ctx->mutex);
+    mender_scheduler_mutex_delete(mender_configure_ctx->mutex);
+    mender_configure_ctx->mutex = NULL;
+    if (NULL != mender_configure_ctx->artifact_name) {
+        mender_utils_free(mender_configure_ctx->artifact_name);
+        mender_configure_ctx->artifact_name = NULL;
     }
+#ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+    mender_utils_free(mender_configure_ctx->device_config);
+    mender_configure_ctx->device_config = NULL;
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
     return ret;
 }
 
 static mender_err_t
-mender_configure_work_function(void) {
+mender_configure_trigger(uint32_t reasons) {
+
+    /* Synchronize the configuration which could not be synchronized while the network was not available */
+    if ((0 == (reasons & MENDER_CLIENT_TRIGGER_NETWORK_AVAILABLE)) || (NULL == mender_configure_ctx->work_handle)) {
+        return MENDER_OK;
+    }
+
+    return mender_configure_execute();
+}
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+static void *
+mender_configure_select_ctx(void *ctx) {
+
+    mender_configure_ctx_t *previous = mender_configure_ctx;
+
+    /* Select the context of the configure, the calling thread uses it until another context is selected */
+    mender_configure_ctx = (NULL != ctx) ? (mender_configure_ctx_t *)ctx : &mender_configure_default_ctx;
+
+    return previous;
+}
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+static mender_err_t
+mender_configure_work_function(MENDER_SCHEDULER_WORK_ARG) {
 
     mender_err_t ret;
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+    mender_keystore_t *configuration = NULL;
+    mender_keystore_t *previous      = NULL;
+    mender_keystore_t *updated       = NULL;
+    mender_keystore_t *removed       = NULL;
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select the context of the device of the work */
+    mender_client_ctx_t *previous_ctx = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
     /* Take mutex used to protect access to the configuration key-store */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_configure_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_configure_ctx->mutex, -1))) {
         mender_log_error("Unable to take mutex");
-        return ret;
+        goto RESTORE;
     }
 
     /* Request access to the network */
@@ -368,42 +529,58 @@ mender_configure_work_function(void) {
 #ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
     /* Download configuration */
-    mender_keystore_t *configuration = NULL;
     if (MENDER_OK != (ret = mender_api_download_configuration_data(&configuration))) {
         mender_log_error("Unable to get configuration data");
         goto RELEASE;
     }
 
-    /* Release previous configuration */
-    if (MENDER_OK != (ret = mender_utils_keystore_delete(mender_configure_keystore))) {
-        mender_log_error("Unable to delete device configuration");
-        goto RELEASE;
-    }
+    /* Nothing to update if the configuration has not been modified since the last download */
+    if (NULL != configuration) {
 
-    /* Update device configuration */
-    if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_configure_keystore, configuration))) {
-        mender_log_error("Unable to update device configuration");
-        goto RELEASE;
+        /* Compute the changes since the previous configuration */
+        if (MENDER_OK != (ret = mender_configure_diff(mender_configure_ctx->keystore, configuration, &updated, &removed))) {
+            mender_log_error("Unable to compare device configuration");
+            goto RELEASE;
+        }
+
+        /* Nothing to apply if no item has been added, modified or removed */
+        if ((0 != mender_utils_keystore_length(updated)) || (0 != mender_utils_keystore_length(removed))) {
+
+            /* Update device configuration, the previous one is kept until the changes have been applied */
+            previous = mender_configure_ctx->keystore;
+            if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_configure_ctx->keystore, configuration))) {
+                mender_log_error("Unable to update device configuration");
+                mender_configure_ctx->keystore = previous;
+                previous                       = NULL;
+                goto RELEASE;
+            }
+
+            /* Invoke the update callback with the changes */
+            if (NULL != mender_configure_ctx->callbacks.config_updated) {
+                mender_configure_ctx->callbacks.config_updated(updated, removed);
+            }
+
+        } else {
+            mender_log_debug("Configuration has not changed");
+        }
     }
 
-    /* Invoke the update callback */
-    if (NULL != mender_configure_callbacks.config_updated) {
-        mender_configure_callbacks.config_updated(mender_configure_keystore);
+#else
+
+    /* Parse the device configuration if it has not been parsed yet */
+    if (MENDER_OK != (ret = mender_configure_load())) {
+        goto RELEASE;
     }
 
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
     /* Publish configuration */
-    if (MENDER_OK != (ret = mender_api_publish_configuration_data(mender_configure_keystore))) {
+    if (MENDER_OK != (ret = mender_api_publish_configuration_data(mender_configure_ctx->keystore))) {
         mender_log_error("Unable to publish configuration data");
     }
 
-#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
-
 RELEASE:
 
-#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
-
     /* Release access to the network */
     mender_client_network_release();
 
@@ -411,18 +588,100 @@ END:
 
 #ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
-    /* Release memeory */
+    /* Release memeory, the items of the changes are references */
+    mender_utils_free(updated);
+    mender_utils_free(removed);
+    mender_utils_keystore_delete(previous);
     mender_utils_keystore_delete(configuration);
 
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 
     /* Release mutex used to protect access to the configuration key-store */
-    mender_scheduler_mutex_give(mender_configure_mutex);
+    mender_scheduler_mutex_give(mender_configure_ctx->mutex);
+
+    /* Apply the backoff policy, the period of the work grows after consecutive failures and is restored on success */
+    if (MENDER_OK != ret) {
+        uint32_t period = mender_utils_backoff_failure(&mender_configure_ctx->backoff);
+        if (0 != period) {
+            mender_scheduler_work_set_period(mender_configure_ctx->work_handle, period);
+        }
+    } else if (true == mender_utils_backoff_success(&mender_configure_ctx->backoff)) {
+        mender_scheduler_work_set_period(mender_configure_ctx->work_handle, mender_configure_ctx->backoff.base);
+    }
+
+RESTORE:
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous_ctx);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
     return ret;
 }
 
-#ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+static mender_err_t
+mender_configure_diff(mender_keystore_t *previous, mender_keystore_t *current, mender_keystore_t **updated, mender_keystore_t **removed) {
+
+    assert(NULL != updated);
+    assert(NULL != removed);
+    size_t previous_length = mender_utils_keystore_length(previous);
+    size_t current_length  = mender_utils_keystore_length(current);
+    size_t count;
+
+    /* Allocate the changes, the items are references to the configurations */
+    *updated = mender_utils_keystore_new(current_length);
+    *removed = mender_utils_keystore_new(previous_length);
+    if ((NULL == *updated) || (NULL == *removed)) {
+        mender_utils_free(*updated);
+        mender_utils_free(*removed);
+        *updated = NULL;
+        *removed = NULL;
+        return MENDER_FAIL;
+    }
+
+    /* Items added or modified */
+    count = 0;
+    for (size_t index = 0; index < current_length; index++) {
+        char *value = mender_configure_find(previous, current[index].name);
+        if ((NULL == value) || (0 != strcmp(value, current[index].value))) {
+            (*updated)[count].name  = current[index].name;
+            (*updated)[count].value = current[index].value;
+            count++;
+        }
+    }
+
+    /* Items removed */
+    count = 0;
+    for (size_t index = 0; index < previous_length; index++) {
+        if (NULL == mender_configure_find(current, previous[index].name)) {
+            (*removed)[count].name  = previous[index].name;
+            (*removed)[count].value = previous[index].value;
+            count++;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static char *
+mender_configure_find(mender_keystore_t *configuration, char *name) {
+
+    assert(NULL != name);
+
+    /* Search the item, configurations are small and a linear search is sufficient */
+    size_t length = mender_utils_keystore_length(configuration);
+    for (size_t index = 0; index < length; index++) {
+        if (0 == strcmp(configuration[index].name, name)) {
+            return configuration[index].value;
+        }
+    }
+
+    return NULL;
+}
+
+#else
 
 static mender_err_t
 mender_configure_download_artifact_callback(
@@ -435,48 +694,107 @@ mender_configure_download_artifact_callback(
     (void)data;
     (void)index;
     (void)length;
-    cJSON       *json_device_config = NULL;
-    char        *device_config      = NULL;
-    mender_err_t ret                = MENDER_OK;
+    mender_err_t ret = MENDER_OK;
 
     /* Check meta-data */
     if (NULL != meta_data) {
 
-        /* Save the device configuration */
-        if (NULL == (json_device_config = cJSON_CreateObject())) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto END;
-        }
-        cJSON_AddStringToObject(json_device_config, "artifact_name", artifact_name);
-        cJSON_AddItemToObject(json_device_config, "config", cJSON_Duplicate(meta_data, true));
-        if (NULL == (device_config = cJSON_PrintUnformatted(json_device_config))) {
-            mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto END;
-        }
-        if (MENDER_OK != (ret = mender_storage_set_device_config(device_config))) {
-            mender_log_error("Unable to record configuration");
-            goto END;
-        }
+        /* Save the device configuration, the meta-data are printed as is */
+        ret = mender_configure_save(artifact_name, meta_data);
 
     } else {
 
         /* Delete the configuration */
-        if (MENDER_OK != (ret = mender_storage_delete_device_config())) {
+        if ((true == mender_configure_ctx->storage) && (MENDER_OK != (ret = mender_storage_delete_device_config()))) {
             mender_log_error("Unable to delete configuration");
         }
     }
 
+    return ret;
+}
+
+static mender_err_t
+mender_configure_load(void) {
+
+    cJSON       *json_config = NULL;
+    mender_err_t ret         = MENDER_OK;
+
+    /* Nothing to do if the configuration has already been parsed */
+    if (NULL == mender_configure_ctx->device_config) {
+        return MENDER_OK;
+    }
+
+    /* Parse configuration, it follows the artifact name */
+    char *config = mender_configure_ctx->device_config + strlen(mender_configure_ctx->device_config) + 1;
+    if (NULL == (json_config = cJSON_Parse(config))) {
+        mender_log_error("Unable to parse device configuration");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Set device configuration */
+    if (MENDER_OK != (ret = mender_utils_keystore_from_json(&mender_configure_ctx->keystore, json_config))) {
+        mender_log_error("Unable to set device configuration");
+        goto END;
+    }
+
 END:
 
-    /* Release memory */
-    if (NULL != json_device_config) {
-        cJSON_Delete(json_device_config);
+    /* Release memory, the device configuration is not parsed again if it is invalid */
+    if (NULL != json_config) {
+        cJSON_Delete(json_config);
     }
-    if (NULL != device_config) {
-        free(device_config);
+    mender_utils_free(mender_configure_ctx->device_config);
+    mender_configure_ctx->device_config = NULL;
+
+    return ret;
+}
+
+static mender_err_t
+mender_configure_save(char *artifact_name, cJSON *json_config) {
+
+    assert(NULL != json_config);
+    size_t       name_length = (NULL != artifact_name) ? strlen(artifact_name) : 0;
+    char        *device_config;
+    char        *tmp;
+    mender_err_t ret;
+
+    /* Nothing to save for the additional devices */
+    if (false == mender_configure_ctx->storage) {
+        return MENDER_OK;
+    }
+
+    /* Print the configuration */
+    if (NULL == (device_config = cJSON_PrintUnformatted(json_config))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    /* Insert the artifact name before the configuration, the buffer is extended so that the configuration is not printed twice */
+    size_t length = strlen(device_config);
+    if (NULL == (tmp = (char *)mender_utils_realloc(device_config, name_length + 1 + length + 1))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
     }
+    device_config = tmp;
+    memmove(&device_config[name_length + 1], device_config, length + 1);
+    if (0 != name_length) {
+        memcpy(device_config, artifact_name, name_length);
+    }
+    device_config[name_length] = MENDER_CONFIGURE_STORAGE_DELIMITER;
+
+    /* Save the device configuration */
+    if (MENDER_OK != (ret = mender_storage_set_device_config(device_config))) {
+        mender_log_error("Unable to record configuration");
+        goto END;
+    }
+
+END:
+
+    /* Release memory */
+    mender_utils_free(device_config);
+
     return ret;
 }
 
@@ -32,33 +32,177 @@
 #define CONFIG_MENDER_CLIENT_INVENTORY_REFRESH_INTERVAL (28800)
 #endif /* CONFIG_MENDER_CLIENT_INVENTORY_REFRESH_INTERVAL */
 
+/**
+ * @brief Default maximum age of the inventory published (seconds), it is published again after this delay even if it has not changed
+ */
+#ifndef CONFIG_MENDER_CLIENT_INVENTORY_MAX_AGE
+#define CONFIG_MENDER_CLIENT_INVENTORY_MAX_AGE (86400)
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_MAX_AGE */
+
+/**
+ * @brief Default maximum number of inventory providers
+ */
+#ifndef CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS
+#define CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS (4)
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS */
+
+/**
+ * @brief Default size of the buffer receiving the value of an inventory provider, including the null terminator (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_SIZE
+#define CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_SIZE (64)
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_SIZE */
+
+/**
+ * @brief Trigger the inventory work depending of the reasons of the client trigger
+ * @param reasons Reasons of the trigger, combination of mender_client_trigger_t
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_inventory_trigger(uint32_t reasons);
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+/**
+ * @brief Select the context of the inventory of the calling thread
+ * @param ctx Context, NULL to select the context of the device of mender_client_init
+ * @return Context previously selected
+ */
+static void *mender_inventory_select_ctx(void *ctx);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+/**
+ * @brief Mender inventory provider entry
+ */
+typedef struct {
+    const char                 *name;     /**< Name of the item, NULL if the entry is free */
+    mender_inventory_provider_t provider; /**< Provider of the value of the item */
+    void                       *arg;      /**< Argument of the provider */
+} mender_inventory_provider_entry_t;
+
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_STATS
+
+/**
+ * @brief Number of inventory items holding the statistics of the client
+ */
+#define MENDER_INVENTORY_STATS_ITEMS (9)
+
+/**
+ * @brief Names of the inventory items holding the statistics of the client
+ */
+static const char *mender_inventory_stats_names[MENDER_INVENTORY_STATS_ITEMS] = { "mender_stats_http_requests",
+                                                                                  "mender_stats_http_errors",
+                                                                                  "mender_stats_http_4xx",
+                                                                                  "mender_stats_http_5xx",
+                                                                                  "mender_stats_authentication_failures",
+                                                                                  "mender_stats_download_received",
+                                                                                  "mender_stats_download_resumes",
+                                                                                  "mender_stats_download_throughput",
+                                                                                  "mender_stats_work_failures" };
+
+/**
+ * @brief Format the values of the inventory items holding the statistics of the client
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_inventory_stats_format(void);
+
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_STATS */
+
+/**
+ * @brief Context of the inventory of a device
+ */
+typedef struct {
+    mender_inventory_config_t         config;                                              /**< Mender inventory configuration */
+    mender_keystore_t                *keystore;                                            /**< Mender inventory keystore */
+    void                             *mutex;                                               /**< Mutex protecting the keystore and the providers */
+    mender_inventory_provider_entry_t providers[CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS]; /**< Mender inventory providers, protected by the mutex */
+    void                             *work_handle;                                         /**< Mender inventory work handle */
+    mender_utils_backoff_t            backoff;                                             /**< Mender inventory work backoff policy */
+    struct {
+        bool      valid;     /**< An inventory has been published since the add-on has been activated */
+        uint32_t *digests;   /**< Digests of the names and of the values of the items published, two per item */
+        size_t    length;    /**< Number of items published */
+        uint64_t  timestamp; /**< Uptime of the last publication of all the items (milliseconds) */
+    } published;             /**< Last inventory published */
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_STATS
+    char stats_values[MENDER_INVENTORY_STATS_ITEMS][21]; /**< Values of the inventory items holding the statistics of the client, formatted when published */
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_STATS */
+} mender_inventory_ctx_t;
+
+/**
+ * @brief Context of the inventory of the device of mender_client_init
+ */
+static mender_inventory_ctx_t mender_inventory_default_ctx;
+
+/**
+ * @brief Context of the inventory of the device of the calling thread, it is selected with the context of the client
+ */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+static __thread mender_inventory_ctx_t *mender_inventory_ctx = &mender_inventory_default_ctx;
+#else
+static mender_inventory_ctx_t *const mender_inventory_ctx = &mender_inventory_default_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
 /**
  * @brief Mender inventory instance
  */
-const mender_addon_instance_t mender_inventory_addon_instance
-    = { .init = mender_inventory_init, .activate = mender_inventory_activate, .deactivate = mender_inventory_deactivate, .exit = mender_inventory_exit };
+const mender_addon_instance_t mender_inventory_addon_instance = { .init       = mender_inventory_init,
+                                                                  .activate   = mender_inventory_activate,
+                                                                  .deactivate = mender_inventory_deactivate,
+                                                                  .exit       = mender_inventory_exit,
+                                                                  .trigger    = mender_inventory_trigger,
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+                                                                  .ctx_size   = sizeof(mender_inventory_ctx_t),
+                                                                  .select_ctx = mender_inventory_select_ctx
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+};
+
+/**
+ * @brief Update a digest with a string, FNV-1a hash including the null terminator so that consecutive strings can not be confused
+ * @param digest Digest
+ * @param str String
+ * @return Updated digest
+ */
+static uint32_t mender_inventory_digest_update(uint32_t digest, const char *str);
+
+/**
+ * @brief Compute the digests of the names and of the values of the items of a key-store, used to detect changes of the inventory
+ * @param keystore Key-store
+ * @param length Length of the key-store
+ * @return Digests, two per item, to be released with mender_utils_free, NULL if an error occurred
+ */
+static uint32_t *mender_inventory_digest(mender_keystore_t *keystore, size_t length);
 
 /**
- * @brief Mender inventory configuration
+ * @brief Compare an inventory with the last one published, the items which have changed are referenced in the patch
+ * @param inventory Inventory
+ * @param digests Digests of the inventory
+ * @param length Length of the inventory
+ * @param patch Items of the inventory added or modified since the last publication
+ * @return true if items have been removed since the last publication, false otherwise
  */
-static mender_inventory_config_t mender_inventory_config;
+static bool mender_inventory_compare(mender_keystore_t *inventory, uint32_t *digests, size_t length, mender_keystore_t *patch);
 
 /**
- * @brief Mender inventory keystore
+ * @brief Invoke the inventory providers, the providers are copied under the inventory mutex and invoked without holding it
+ * @param values Values of the providers, one buffer per provider, to be released with mender_utils_free
+ * @param names Names of the providers whose value has been retrieved, NULL for the others
+ * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_keystore_t *mender_inventory_keystore = NULL;
-static void              *mender_inventory_mutex    = NULL;
+static mender_err_t mender_inventory_invoke_providers(char **values, const char *names[CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS]);
 
 /**
- * @brief Mender inventory work handle
+ * @brief Build the inventory published, items set with mender_inventory_set and values of the providers are referenced without copy
+ * @param values Values of the providers
+ * @param names Names of the providers whose value has been retrieved, NULL for the others
+ * @return Inventory, to be released with mender_utils_free, NULL if an error occurred
  */
-static void *mender_inventory_work_handle = NULL;
+static mender_keystore_t *mender_inventory_build(char *values, const char *names[CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS]);
 
 /**
  * @brief Mender inventory work function
+ * @param arg Context of the device of the work, with CONFIG_MENDER_CLIENT_CONTEXTS only
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_inventory_work_function(void);
+static mender_err_t mender_inventory_work_function(MENDER_SCHEDULER_WORK_ARG);
 
 mender_err_t
 mender_inventory_init(void *config, void *callbacks) {
@@ -69,13 +213,13 @@ mender_inventory_init(void *config, void *callbacks) {
 
     /* Save configuration */
     if (0 != ((mender_inventory_config_t *)config)->refresh_interval) {
-        mender_inventory_config.refresh_interval = ((mender_inventory_config_t *)config)->refresh_interval;
+        mender_inventory_ctx->config.refresh_interval = ((mender_inventory_config_t *)config)->refresh_interval;
     } else {
-        mender_inventory_config.refresh_interval = CONFIG_MENDER_CLIENT_INVENTORY_REFRESH_INTERVAL;
+        mender_inventory_ctx->config.refresh_interval = CONFIG_MENDER_CLIENT_INVENTORY_REFRESH_INTERVAL;
     }
 
     /* Create inventory mutex */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_inventory_mutex))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_inventory_ctx->mutex))) {
         mender_log_error("Unable to create inventory mutex");
         return ret;
     }
@@ -83,12 +227,18 @@ mender_inventory_init(void *config, void *callbacks) {
     /* Create mender inventory work */
     mender_scheduler_work_params_t inventory_work_params;
     inventory_work_params.function = mender_inventory_work_function;
-    inventory_work_params.period   = mender_inventory_config.refresh_interval;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    inventory_work_params.arg = mender_client_get_ctx();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    inventory_work_params.period   = mender_inventory_ctx->config.refresh_interval;
     inventory_work_params.name     = "mender_inventory";
-    if (MENDER_OK != (ret = mender_scheduler_work_create(&inventory_work_params, &mender_inventory_work_handle))) {
+    inventory_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_LOW;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&inventory_work_params, &mender_inventory_ctx->work_handle))) {
         mender_log_error("Unable to create inventory work");
         return ret;
     }
+    mender_utils_backoff_init(&mender_inventory_ctx->backoff,
+                              (mender_inventory_ctx->config.refresh_interval > 0) ? (uint32_t)mender_inventory_ctx->config.refresh_interval : 0);
 
     return ret;
 }
@@ -98,8 +248,11 @@ mender_inventory_activate(void) {
 
     mender_err_t ret;
 
+    /* The inventory is published at least once after the client is authenticated */
+    mender_inventory_ctx->published.valid = false;
+
     /* Activate inventory work */
-    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_inventory_work_handle))) {
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_inventory_ctx->work_handle))) {
         mender_log_error("Unable to activate inventory work");
         return ret;
     }
@@ -111,7 +264,7 @@ mender_err_t
 mender_inventory_deactivate(void) {
 
     /* Deactivate mender inventory work */
-    mender_scheduler_work_deactivate(mender_inventory_work_handle);
+    mender_scheduler_work_deactivate(mender_inventory_ctx->work_handle);
 
     return MENDER_OK;
 }
@@ -122,19 +275,19 @@ mender_inventory_set(mender_keystore_t *inventory) {
     mender_err_t ret;
 
     /* Take mutex used to protect access to the inventory key-store */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_ctx->mutex, -1))) {
         mender_log_error("Unable to take mutex");
         return ret;
     }
 
     /* Release previous inventory */
-    if (MENDER_OK != (ret = mender_utils_keystore_delete(mender_inventory_keystore))) {
+    if (MENDER_OK != (ret = mender_utils_keystore_delete(mender_inventory_ctx->keystore))) {
         mender_log_error("Unable to delete inventory");
         goto END;
     }
 
     /* Copy the new inventory */
-    if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_inventory_keystore, inventory))) {
+    if (MENDER_OK != (ret = mender_utils_keystore_copy(&mender_inventory_ctx->keystore, inventory))) {
         mender_log_error("Unable to copy inventory");
         goto END;
     }
@@ -142,7 +295,76 @@ mender_inventory_set(mender_keystore_t *inventory) {
 END:
 
     /* Release mutex used to protect access to the inventory key-store */
-    mender_scheduler_mutex_give(mender_inventory_mutex);
+    mender_scheduler_mutex_give(mender_inventory_ctx->mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_inventory_add_provider(const char *name, mender_inventory_provider_t provider, void *arg) {
+
+    assert(NULL != name);
+    assert(NULL != provider);
+    mender_err_t ret;
+
+    /* Take mutex used to protect access to the inventory key-store */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_ctx->mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Search the entry of the item, or a free entry, the provider of an item is replaced */
+    size_t entry = CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS;
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS; index++) {
+        if ((NULL != mender_inventory_ctx->providers[index].name) && (!strcmp(mender_inventory_ctx->providers[index].name, name))) {
+            entry = index;
+            break;
+        }
+        if ((NULL == mender_inventory_ctx->providers[index].name) && (CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS == entry)) {
+            entry = index;
+        }
+    }
+    if (CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS == entry) {
+        mender_log_error("Too many inventory providers");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    mender_inventory_ctx->providers[entry].name     = name;
+    mender_inventory_ctx->providers[entry].provider = provider;
+    mender_inventory_ctx->providers[entry].arg      = arg;
+
+END:
+
+    /* Release mutex used to protect access to the inventory key-store */
+    mender_scheduler_mutex_give(mender_inventory_ctx->mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_inventory_remove_provider(const char *name) {
+
+    assert(NULL != name);
+    mender_err_t ret;
+
+    /* Take mutex used to protect access to the inventory key-store */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_ctx->mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Release the entry of the item */
+    ret = MENDER_NOT_FOUND;
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS; index++) {
+        if ((NULL != mender_inventory_ctx->providers[index].name) && (!strcmp(mender_inventory_ctx->providers[index].name, name))) {
+            memset(&mender_inventory_ctx->providers[index], 0, sizeof(mender_inventory_ctx->providers[index]));
+            ret = MENDER_OK;
+            break;
+        }
+    }
+
+    /* Release mutex used to protect access to the inventory key-store */
+    mender_scheduler_mutex_give(mender_inventory_ctx->mutex);
 
     return ret;
 }
@@ -153,7 +375,7 @@ mender_inventory_execute(void) {
     mender_err_t ret;
 
     /* Trigger execution of the work */
-    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_inventory_work_handle))) {
+    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_inventory_ctx->work_handle))) {
         mender_log_error("Unable to trigger inventory work");
         return ret;
     }
@@ -167,35 +389,105 @@ mender_inventory_exit(void) {
     mender_err_t ret;
 
     /* Delete mender inventory work */
-    mender_scheduler_work_delete(mender_inventory_work_handle);
-    mender_inventory_work_handle = NULL;
+    mender_scheduler_work_delete(mender_inventory_ctx->work_handle);
+    mender_inventory_ctx->work_handle = NULL;
 
     /* Take mutex used to protect access to the inventory key-store */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_ctx->mutex, -1))) {
         mender_log_error("Unable to take mutex");
         return ret;
     }
 
     /* Release memory */
-    mender_inventory_config.refresh_interval = 0;
-    mender_utils_keystore_delete(mender_inventory_keystore);
-    mender_inventory_keystore = NULL;
-    mender_scheduler_mutex_give(mender_inventory_mutex);
-    mender_scheduler_mutex_delete(mender_inventory_mutex);
-    mender_inventory_mutex = NULL;
+    mender_inventory_ctx->config.refresh_interval = 0;
+    mender_utils_keystore_delete(mender_inventory_ctx->keystore);
+    mender_inventory_ctx->keystore = NULL;
+    memset(mender_inventory_ctx->providers, 0, sizeof(mender_inventory_ctx->providers));
+    mender_utils_free(mender_inventory_ctx->published.digests);
+    memset(&mender_inventory_ctx->published, 0, sizeof(mender_inventory_ctx->published));
+    mender_scheduler_mutex_give(mender_inventory_ctx->mutex);
+    mender_scheduler_mutex_delete(mender_inventory_ctx->mutex);
+    mender_inventory_ctx->mutex = NULL;
 
     return ret;
 }
 
 static mender_err_t
-mender_inventory_work_function(void) {
+mender_inventory_trigger(uint32_t reasons) {
 
-    mender_err_t ret;
+    /* Publish the inventory if it has been requested or if it could not be published while the network was not available */
+    if ((0 == (reasons & (MENDER_CLIENT_TRIGGER_INVENTORY_REFRESH | MENDER_CLIENT_TRIGGER_NETWORK_AVAILABLE))) || (NULL == mender_inventory_ctx->work_handle)) {
+        return MENDER_OK;
+    }
+
+    return mender_inventory_execute();
+}
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+static void *
+mender_inventory_select_ctx(void *ctx) {
+
+    mender_inventory_ctx_t *previous = mender_inventory_ctx;
+
+    /* Select the context of the inventory, the calling thread uses it until another context is selected */
+    mender_inventory_ctx = (NULL != ctx) ? (mender_inventory_ctx_t *)ctx : &mender_inventory_default_ctx;
+
+    return previous;
+}
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+static mender_err_t
+mender_inventory_work_function(MENDER_SCHEDULER_WORK_ARG) {
+
+    mender_err_t       ret;
+    uint32_t          *digests   = NULL;
+    uint64_t           now       = 0;
+    char              *values    = NULL;
+    mender_keystore_t *inventory = NULL;
+    mender_keystore_t *patch     = NULL;
+    const char        *names[CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS];
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select the context of the device of the work */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Retrieve the values of the providers, they are invoked only when the inventory is about to be published */
+    if (MENDER_OK != (ret = mender_inventory_invoke_providers(&values, names))) {
+        goto RESTORE;
+    }
 
     /* Take mutex used to protect access to the inventory key-store */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_ctx->mutex, -1))) {
         mender_log_error("Unable to take mutex");
-        return ret;
+        mender_utils_free(values);
+        goto RESTORE;
+    }
+
+    /* Build the inventory */
+    if (NULL == (inventory = mender_inventory_build(values, names))) {
+        mender_log_error("Unable to build inventory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Compute the digests of the items */
+    size_t length = mender_utils_keystore_length(inventory);
+    if ((NULL == (digests = mender_inventory_digest(inventory, length))) || (NULL == (patch = mender_utils_keystore_new(length)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Publish all the items if the last full publication is too old or if items have been removed, only those which have changed otherwise */
+    bool full = ((0 == CONFIG_MENDER_CLIENT_INVENTORY_MAX_AGE) || (false == mender_inventory_ctx->published.valid)
+                 || (MENDER_OK != mender_scheduler_get_uptime(&now))
+                 || (now - mender_inventory_ctx->published.timestamp >= (uint64_t)CONFIG_MENDER_CLIENT_INVENTORY_MAX_AGE * 1000));
+    if ((true == mender_inventory_compare(inventory, digests, length, patch)) || (true == full)) {
+        full = true;
+    } else if (0 == mender_utils_keystore_length(patch)) {
+        mender_log_debug("Inventory has not changed, skipping publication");
+        goto END;
     }
 
     /* Request access to the network */
@@ -205,8 +497,18 @@ mender_inventory_work_function(void) {
     }
 
     /* Publish inventory */
-    if (MENDER_OK != (ret = mender_api_publish_inventory_data(mender_inventory_keystore))) {
+    if (MENDER_OK != (ret = mender_api_publish_inventory_data((true == full) ? inventory : patch, (false == full)))) {
         mender_log_error("Unable to publish inventory data");
+    } else {
+        /* Save the inventory published, the server holds the whole inventory after a partial update because no item has been removed */
+        mender_utils_free(mender_inventory_ctx->published.digests);
+        mender_inventory_ctx->published.valid   = true;
+        mender_inventory_ctx->published.digests = digests;
+        mender_inventory_ctx->published.length  = length;
+        digests                                 = NULL;
+        if ((true == full) && (MENDER_OK == mender_scheduler_get_uptime(&now))) {
+            mender_inventory_ctx->published.timestamp = now;
+        }
     }
 
     /* Release access to the network */
@@ -215,9 +517,233 @@ mender_inventory_work_function(void) {
 END:
 
     /* Release mutex used to protect access to the inventory key-store */
-    mender_scheduler_mutex_give(mender_inventory_mutex);
+    mender_scheduler_mutex_give(mender_inventory_ctx->mutex);
+
+    /* Release memory, the items of the inventory and of the patch are references */
+    mender_utils_free(patch);
+    mender_utils_free(digests);
+    mender_utils_free(inventory);
+    mender_utils_free(values);
+
+    /* Apply the backoff policy, the period of the work grows after consecutive failures and is restored on success */
+    if (MENDER_OK != ret) {
+        uint32_t period = mender_utils_backoff_failure(&mender_inventory_ctx->backoff);
+        if (0 != period) {
+            mender_scheduler_work_set_period(mender_inventory_ctx->work_handle, period);
+        }
+    } else if (true == mender_utils_backoff_success(&mender_inventory_ctx->backoff)) {
+        mender_scheduler_work_set_period(mender_inventory_ctx->work_handle, mender_inventory_ctx->backoff.base);
+    }
+
+RESTORE:
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
     return ret;
 }
 
+static mender_err_t
+mender_inventory_invoke_providers(char **values, const char *names[CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS]) {
+
+    assert(NULL != values);
+    assert(NULL != names);
+    mender_err_t ret;
+
+    /* Copy the providers, they may add or remove providers or set the inventory while they are invoked */
+    mender_inventory_provider_entry_t providers[CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS];
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_inventory_ctx->mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+    memcpy(providers, mender_inventory_ctx->providers, sizeof(providers));
+    mender_scheduler_mutex_give(mender_inventory_ctx->mutex);
+
+    /* Allocate the values, nothing is allocated if there is no provider */
+    size_t count = 0;
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS; index++) {
+        names[index] = NULL;
+        if (NULL != providers[index].name) {
+            count++;
+        }
+    }
+    *values = NULL;
+    if (0 == count) {
+        return MENDER_OK;
+    }
+    if (NULL == (*values = (char *)mender_utils_malloc(CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS * CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_SIZE))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    /* Invoke the providers, an item whose value is not available is not published */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS; index++) {
+        if (NULL != providers[index].name) {
+            char *value = *values + index * CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_SIZE;
+            value[0]    = '\0';
+            if (MENDER_OK != providers[index].provider(value, CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_SIZE, providers[index].arg)) {
+                mender_log_warning("Unable to get inventory item '%s'", providers[index].name);
+                continue;
+            }
+            value[CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_SIZE - 1] = '\0';
+            names[index]                                                  = providers[index].name;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static mender_keystore_t *
+mender_inventory_build(char *values, const char *names[CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS]) {
+
+    assert(NULL != names);
+
+    /* Allocate the items */
+    size_t length = mender_utils_keystore_length(mender_inventory_ctx->keystore);
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS; index++) {
+        if (NULL != names[index]) {
+            length++;
+        }
+    }
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_STATS
+    length += MENDER_INVENTORY_STATS_ITEMS;
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_STATS */
+    mender_keystore_t *inventory = (mender_keystore_t *)mender_utils_calloc(length + 1, sizeof(mender_item_t));
+    if (NULL == inventory) {
+        mender_log_error("Unable to allocate memory");
+        return NULL;
+    }
+
+    /* Reference the items set by the application, unless a provider has been added for them */
+    size_t count = 0;
+    for (size_t index = 0; (NULL != mender_inventory_ctx->keystore) && (NULL != mender_inventory_ctx->keystore[index].name)
+                           && (NULL != mender_inventory_ctx->keystore[index].value);
+         index++) {
+        bool provided = false;
+        for (size_t provider = 0; (provider < CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS) && (false == provided); provider++) {
+            provided = (NULL != names[provider]) && (!strcmp(names[provider], mender_inventory_ctx->keystore[index].name));
+        }
+        if (false == provided) {
+            inventory[count].name  = mender_inventory_ctx->keystore[index].name;
+            inventory[count].value = mender_inventory_ctx->keystore[index].value;
+            count++;
+        }
+    }
+
+    /* Reference the values of the providers */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_INVENTORY_PROVIDERS; index++) {
+        if (NULL != names[index]) {
+            inventory[count].name  = (char *)names[index];
+            inventory[count].value = values + index * CONFIG_MENDER_CLIENT_INVENTORY_PROVIDER_VALUE_SIZE;
+            count++;
+        }
+    }
+
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_STATS
+    /* Reference the statistics of the client, they are not published if they are not available */
+    if (MENDER_OK == mender_inventory_stats_format()) {
+        for (size_t index = 0; index < MENDER_INVENTORY_STATS_ITEMS; index++) {
+            inventory[count].name  = (char *)mender_inventory_stats_names[index];
+            inventory[count].value = mender_inventory_ctx->stats_values[index];
+            count++;
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_STATS */
+
+    return inventory;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_INVENTORY_STATS
+
+static mender_err_t
+mender_inventory_stats_format(void) {
+
+    mender_client_stats_t stats;
+    mender_err_t          ret;
+
+    /* Retrieve the statistics of the client */
+    if (MENDER_OK != (ret = mender_client_get_stats(&stats))) {
+        return ret;
+    }
+
+    /* Format the values, in the order of the names */
+    const unsigned long values[MENDER_INVENTORY_STATS_ITEMS] = { (unsigned long)stats.api.http.requests,
+                                                                 (unsigned long)stats.api.http.errors,
+                                                                 (unsigned long)stats.api.http.status[3],
+                                                                 (unsigned long)stats.api.http.status[4],
+                                                                 (unsigned long)stats.api.authentication.failures,
+                                                                 (unsigned long)stats.api.download.received,
+                                                                 (unsigned long)stats.api.download.resumes,
+                                                                 (unsigned long)stats.api.download.throughput,
+                                                                 (unsigned long)stats.failures };
+    for (size_t index = 0; index < MENDER_INVENTORY_STATS_ITEMS; index++) {
+        snprintf(mender_inventory_ctx->stats_values[index], sizeof(mender_inventory_ctx->stats_values[index]), "%lu", values[index]);
+    }
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_INVENTORY_STATS */
+
+static uint32_t
+mender_inventory_digest_update(uint32_t digest, const char *str) {
+
+    assert(NULL != str);
+
+    /* Hash the string including the null terminator */
+    do {
+        digest = (digest ^ (uint8_t)*str) * 16777619u;
+    } while ('\0' != *str++);
+
+    return digest;
+}
+
+static uint32_t *
+mender_inventory_digest(mender_keystore_t *keystore, size_t length) {
+
+    /* Allocate the digests, at least one is allocated so that an empty inventory has digests too */
+    uint32_t *digests = (uint32_t *)mender_utils_malloc(((0 != length) ? 2 * length : 1) * sizeof(uint32_t));
+    if (NULL == digests) {
+        return NULL;
+    }
+
+    /* Hash the names and values */
+    for (size_t index = 0; index < length; index++) {
+        digests[2 * index]     = mender_inventory_digest_update(2166136261u, keystore[index].name);
+        digests[2 * index + 1] = mender_inventory_digest_update(2166136261u, keystore[index].value);
+    }
+
+    return digests;
+}
+
+static bool
+mender_inventory_compare(mender_keystore_t *inventory, uint32_t *digests, size_t length, mender_keystore_t *patch) {
+
+    assert(NULL != digests);
+    assert(NULL != patch);
+    size_t found = 0;
+    size_t count = 0;
+
+    /* Search the items in the last inventory published, names are unique */
+    for (size_t index = 0; index < length; index++) {
+        bool changed = true;
+        for (size_t published = 0; published < mender_inventory_ctx->published.length; published++) {
+            if (digests[2 * index] == mender_inventory_ctx->published.digests[2 * published]) {
+                changed = (digests[2 * index + 1] != mender_inventory_ctx->published.digests[2 * published + 1]);
+                found++;
+                break;
+            }
+        }
+        if (true == changed) {
+            patch[count].name  = inventory[index].name;
+            patch[count].value = inventory[index].value;
+            count++;
+        }
+    }
+
+    return found < mender_inventory_ctx->published.length;
+}
+
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
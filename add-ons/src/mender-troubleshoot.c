@@ -17,8 +17,14 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_TROUBLESHOOT
+
 #include "mender-api.h"
 #include "mender-client.h"
+#include "mender-configure.h"
 #include "mender-inventory.h"
 #include "mender-troubleshoot.h"
 #include "mender-log.h"
@@ -35,6 +41,47 @@
 #define CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_INTERVAL (30)
 #endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_INTERVAL */
 
+/**
+ * @brief Default troubleshoot healthcheck maximum interval (seconds)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_MAX_INTERVAL
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_MAX_INTERVAL (240)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_MAX_INTERVAL */
+
+/**
+ * @brief Default troubleshoot file transfer chunk size (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE (1024)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE */
+
+/**
+ * @brief Default troubleshoot file transfer window (chunks)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW (8)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW */
+
+/**
+ * @brief Number of chunks received before acknowledgment when a file is uploaded, the sender is never blocked waiting for the acknowledgment
+ */
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_ACK_INTERVAL \
+    ((CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW > 1) ? (CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW / 2) : 1)
+
+/**
+ * @brief Default troubleshoot port forward maximum number of sessions
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_MAX_SESSIONS
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_MAX_SESSIONS (2)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_MAX_SESSIONS */
+
+/**
+ * @brief Default troubleshoot port forward buffer size (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_BUFFER_SIZE (1024)
+#endif /* CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_BUFFER_SIZE */
+
 /**
  * msgpack zone chunk initialization size
  */
@@ -46,10 +93,39 @@
 #define MENDER_TROUBLESHOOT_SBUFFER_INIT_SIZE (256)
 
 /**
- * @brief Mender troubleshoot instance
+ * Port forward sbuffer size, the data frame and its header
+ */
+#define MENDER_TROUBLESHOOT_PORT_FORWARD_SBUFFER_SIZE (CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_BUFFER_SIZE + MENDER_TROUBLESHOOT_SBUFFER_INIT_SIZE)
+
+/**
+ * Interval at which the outbox is flushed while the send queue is full (milliseconds)
+ */
+#define MENDER_TROUBLESHOOT_OUTBOX_RETRY_INTERVAL (50)
+
+/**
+ * Maximum duration of a flush of the outbox, the messages remaining are sent at the next flush (milliseconds)
+ */
+#define MENDER_TROUBLESHOOT_OUTBOX_RETRY_TIMEOUT (10000)
+
+/**
+ * Room taken in the send queue by a file transfer chunk besides its data, header of the message and length of the message in the queue (bytes)
+ */
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_OVERHEAD (128)
+
+/**
+ * Room taken in the send queue by a full window of file transfer chunks (bytes)
+ */
+#define MENDER_TROUBLESHOOT_FILE_TRANSFER_WINDOW_SIZE \
+    (CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW                \
+     * (CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE + MENDER_TROUBLESHOOT_FILE_TRANSFER_CHUNK_OVERHEAD))
+
+/**
+ * @brief Check send queue length, the downloads are throttled by the send queue if it can't hold a full window of chunks
  */
-const mender_addon_instance_t mender_troubleshoot_addon_instance
-    = { .init = mender_troubleshoot_init, .activate = NULL, .deactivate = mender_troubleshoot_deactivate, .exit = mender_troubleshoot_exit };
+#if defined(CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH) && (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0) \
+    && (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH < MENDER_TROUBLESHOOT_FILE_TRANSFER_WINDOW_SIZE)
+#warning "CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH is smaller than a full window of file transfer chunks, the file downloads are throttled"
+#endif
 
 /**
  * Proto type
@@ -72,8 +148,21 @@ typedef enum {
 #define MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_SHELL                  "shell"
 #define MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_SPAWN                  "new"
 #define MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_STOP                   "stop"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_GET_FILE       "get_file"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_PUT_FILE       "put_file"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_STAT           "stat"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_FILE_INFO      "file_info"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_CHUNK          "file_chunk"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_ACK            "ack"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_CONTINUE       "continue"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_ERROR          "error"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_NEW             "new"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_STOP            "stop"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_FORWARD         "forward"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_ACK             "ack"
 #define MENDER_TROUBLESHOOT_MESSAGE_TYPE_MENDER_CLIENT_CHECK_UPDATE   "check-update"
 #define MENDER_TROUBLESHOOT_MESSAGE_TYPE_MENDER_CLIENT_SEND_INVENTORY "send-inventory"
+#define MENDER_TROUBLESHOOT_MESSAGE_TYPE_MENDER_CLIENT_UPLOAD_LOGS    "upload-logs"
 
 /**
  * Status type
@@ -93,6 +182,8 @@ typedef struct {
     char                                    *user_id;         /**< User ID */
     uint32_t                                *timeout;         /**< Timeout */
     mender_troubleshoot_properties_status_t *status;          /**< Status */
+    int64_t                                 *offset;          /**< File transfer offset */
+    char                                    *connection_id;   /**< Port forward connection ID */
 } mender_troubleshoot_protohdr_properties_t;
 
 /**
@@ -109,48 +200,168 @@ typedef struct {
  * Proto message
  */
 typedef struct {
-    mender_troubleshoot_protohdr_t *protohdr; /**< Header */
-    char                           *body;     /**< Body */
+    mender_troubleshoot_protohdr_t *protohdr;    /**< Header */
+    char                           *body;        /**< Body, not null-terminated, it references the message received when the protomsg is decoded */
+    size_t                          body_length; /**< Body length, the body of the file transfer chunks is binary data */
 } mender_troubleshoot_protomsg_t;
 
 /**
- * @brief Mender troubleshoot configuration
+ * File transfer
+ */
+typedef struct {
+    char    *sid;     /**< Session ID */
+    void    *handle;  /**< File handle */
+    bool     upload;  /**< Upload of the file to the device if set, download of the file from the device otherwise */
+    int64_t  offset;  /**< Offset of the next chunk to be sent or received */
+    int64_t  acked;   /**< Offset acknowledged by the server when downloading the file */
+    uint32_t chunks;  /**< Chunks received and not acknowledged yet when uploading the file */
+    uint8_t *chunk;   /**< Chunk buffer when downloading the file */
+    size_t   length;  /**< Length of the chunk read in the chunk buffer when downloading the file */
+    bool     pending; /**< The chunk read has not been sent yet because the send queue was full when downloading the file */
+} mender_troubleshoot_file_transfer_t;
+
+/**
+ * Port forward session
+ */
+typedef struct {
+    char           *sid;           /**< Session ID, NULL if the session is free */
+    char           *connection_id; /**< Connection ID */
+    void           *handle;        /**< Local connection handle */
+    msgpack_sbuffer sbuffer;       /**< Buffer preallocated to pack the messages of the session */
+} mender_troubleshoot_port_forward_t;
+
+/**
+ * Message of the outbox, waiting for room in the send queue
+ */
+typedef struct mender_troubleshoot_outbox_message {
+    uint8_t                                   *data;   /**< Message, the segments are merged, allocated with the message */
+    size_t                                     length; /**< Length of the message */
+    struct mender_troubleshoot_outbox_message *next;   /**< Next message of the outbox */
+} mender_troubleshoot_outbox_message_t;
+
+/**
+ * @brief Context of the troubleshoot of a device
  */
-static mender_troubleshoot_config_t mender_troubleshoot_config;
+typedef struct {
+    mender_troubleshoot_config_t          config;                  /**< Mender troubleshoot configuration */
+    mender_troubleshoot_callbacks_t       callbacks;               /**< Mender troubleshoot callbacks */
+    void                                 *healthcheck_work_handle; /**< Mender troubleshoot healthcheck work handle */
+    void                                 *outbox_work_handle;      /**< Mender troubleshoot outbox work handle */
+    uint64_t                              healthcheck_activity;    /**< Uptime of the last data exchanged (milliseconds) */
+    uint64_t                              healthcheck_ping;        /**< Uptime of the last healthcheck ping (milliseconds) */
+    int32_t                               healthcheck_interval;    /**< Current healthcheck interval (seconds) */
+    void                                 *handle;                  /**< Mender troubleshoot connection handle */
+    char                                 *shell_sid;               /**< Mender troubleshoot shell session ID */
+    msgpack_sbuffer                       shell_sbuffer;           /**< Shell output sbuffer, reused by all the messages */
+    void                                 *shell_mutex;             /**< Mutex protecting the shell output sbuffer */
+    mender_troubleshoot_file_transfer_t   file_transfer;           /**< Mender troubleshoot file transfer, only one file is transferred at a time */
+    void                                 *file_transfer_mutex;     /**< Mutex protecting the file transfer */
+    msgpack_sbuffer                       file_transfer_sbuffer;   /**< File transfer sbuffer, reused by all the messages of the file transfer */
+    mender_troubleshoot_outbox_message_t *outbox_head;             /**< Outbox, messages which must not be lost and that could not be sent, sent in order */
+    mender_troubleshoot_outbox_message_t *outbox_tail;             /**< Last message of the outbox */
+    void                                 *outbox_mutex;            /**< Mutex protecting the outbox */
+    msgpack_zone                          zone;                    /**< msgpack zone used to decode the received messages, cleared after each message */
+    mender_troubleshoot_port_forward_t port_forwards[CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_MAX_SESSIONS]; /**< Port forward sessions */
+    void                              *port_forward_mutex;                                                         /**< Mutex of the sessions */
+} mender_troubleshoot_ctx_t;
 
 /**
- * @brief Mender troubleshoot callbacks
+ * @brief Context of the troubleshoot of the device of mender_client_init
  */
-static mender_troubleshoot_callbacks_t mender_troubleshoot_callbacks;
+static mender_troubleshoot_ctx_t mender_troubleshoot_default_ctx;
 
 /**
- * @brief Mender troubleshoot work handle
+ * @brief Context of the troubleshoot of the device of the calling thread, it is selected with the context of the client
  */
-static void *mender_troubleshoot_healthcheck_work_handle = NULL;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+static __thread mender_troubleshoot_ctx_t *mender_troubleshoot_ctx = &mender_troubleshoot_default_ctx;
+#else
+static mender_troubleshoot_ctx_t *const mender_troubleshoot_ctx = &mender_troubleshoot_default_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
 
 /**
- * @brief Mender troubleshoot connection handle
+ * @brief Select the context of the troubleshoot of the calling thread
+ * @param ctx Context, NULL to select the context of the device of mender_client_init
+ * @return Context previously selected
  */
-static void *mender_troubleshoot_handle = NULL;
+static void *mender_troubleshoot_select_ctx(void *ctx);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
 /**
- * @brief Mender troubleshoot shell session ID
+ * @brief Mender troubleshoot instance
  */
-static char *mender_troubleshoot_shell_sid = NULL;
+const mender_addon_instance_t mender_troubleshoot_addon_instance = { .init       = mender_troubleshoot_init,
+                                                                     .activate   = NULL,
+                                                                     .deactivate = mender_troubleshoot_deactivate,
+                                                                     .exit       = mender_troubleshoot_exit,
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+                                                                     .ctx_size   = sizeof(mender_troubleshoot_ctx_t),
+                                                                     .select_ctx = mender_troubleshoot_select_ctx
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+};
 
 /**
  * @brief Mender troubleshoot healthcheck work function
+ * @param arg Context of the device of the work, with CONFIG_MENDER_CLIENT_CONTEXTS only
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_troubleshoot_healthcheck_work_function(MENDER_SCHEDULER_WORK_ARG);
+
+/**
+ * @brief Function called to check if the healthcheck ping is required
+ * @note Pings are suppressed while data is exchanged, the interval is doubled after each ping sent while the session is idle
+ * @param timeout Timeout to be sent to the server with the ping (seconds)
+ * @return true if the ping is required, false otherwise
+ */
+static bool mender_troubleshoot_healthcheck_is_required(uint32_t *timeout);
+
+/**
+ * @brief Function called when data is exchanged with the server, the healthcheck interval is reset
+ */
+static void mender_troubleshoot_healthcheck_activity_update(void);
+
+/**
+ * @brief Mender troubleshoot outbox work function, send the messages of the outbox and resume the file download stalled by the full send queue
+ * @note The work retries while the send queue is full, up to MENDER_TROUBLESHOOT_OUTBOX_RETRY_TIMEOUT, it is executed again by the healthcheck work
+ * @param arg Context of the device of the work, with CONFIG_MENDER_CLIENT_CONTEXTS only
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_troubleshoot_healthcheck_work_function(void);
+static mender_err_t mender_troubleshoot_outbox_work_function(MENDER_SCHEDULER_WORK_ARG);
+
+/**
+ * @brief Send the messages of the outbox, the outbox mutex must be taken
+ * @note The messages that can't be sent for another reason than the full send queue are dropped
+ * @return MENDER_OK if the outbox is empty, MENDER_BUSY if the send queue is full and messages remain in the outbox
+ */
+static mender_err_t mender_troubleshoot_outbox_flush(void);
+
+/**
+ * @brief Release the messages of the outbox, invoked when the connection is closed
+ */
+static void mender_troubleshoot_outbox_release(void);
+
+/**
+ * @brief Send a message made of several segments to the server, after the messages of the outbox
+ * @param segments Segments of the message
+ * @param count Number of segments
+ * @param keep Copy the message to the outbox if the send queue is full, so that it is sent later and never lost
+ * @return MENDER_OK if the message is sent or kept in the outbox, MENDER_BUSY if the send queue is full and the message is not kept, error code otherwise
+ */
+static mender_err_t mender_troubleshoot_send_v(mender_websocket_segment_t *segments, size_t count, bool keep);
 
 /**
  * @brief Callback function to be invoked to perform the treatment of the data from the websocket
  * @param data Received data
  * @param length Received data length
+ * @param arg Context of the device of the connection, with CONFIG_MENDER_CLIENT_CONTEXTS only
  * @return MENDER_OK if the function succeeds, error code if an error occured
  */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+static mender_err_t mender_troubleshoot_data_received_callback(void *data, size_t length, void *arg);
+#else
 static mender_err_t mender_troubleshoot_data_received_callback(void *data, size_t length);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
 /**
  * @brief Function called to perform the treatment of the shell messages
@@ -168,6 +379,144 @@ static mender_err_t mender_troubleshoot_shell_message_handler(mender_troubleshoo
  */
 static mender_err_t mender_troubleshoot_mender_client_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
 
+/**
+ * @brief Function called to perform the treatment of the file transfer messages
+ * @note The messages of the file transfer are sent by the function itself because downloading a file sends several chunks at once
+ * @param protomsg Received proto message
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_message_handler(mender_troubleshoot_protomsg_t *protomsg);
+
+/**
+ * @brief Function called to open the file of a new file transfer
+ * @param sid Session ID
+ * @param path Path of the file
+ * @param upload Upload of the file to the device if set, download of the file from the device otherwise
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_open(char *sid, char *path, bool upload);
+
+/**
+ * @brief Function called to send the chunks of the downloaded file until the window is full, the send queue is full or the end of the file
+ * @note The chunk that can't be sent because the send queue is full is sent first at the next call, by the outbox work or at the next acknowledgment
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_send_chunks(void);
+
+/**
+ * @brief Function called to write a chunk of the uploaded file and to acknowledge it when required
+ * @param protomsg Received proto message
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_write_chunk(mender_troubleshoot_protomsg_t *protomsg);
+
+/**
+ * @brief Function called to release the current file transfer
+ */
+static void mender_troubleshoot_file_transfer_release(void);
+
+/**
+ * @brief Decode the request of a file transfer, the body is a map containing the path of the file
+ * @param protomsg Received proto message
+ * @param path Path of the file
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_decode_request(mender_troubleshoot_protomsg_t *protomsg, char **path);
+
+/**
+ * @brief Function called to send a file transfer message
+ * @param typ Message type
+ * @param sid Session ID
+ * @param offset Offset property, NULL if the property is not sent
+ * @param data Binary body, NULL if the body is not sent
+ * @param length Length of the binary body
+ * @param keep Keep the message in the outbox if the send queue is full
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue is full and the message is not kept, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_send(const char *typ, char *sid, int64_t *offset, uint8_t *data, size_t length, bool keep);
+
+/**
+ * @brief Function called to send a file information message
+ * @param sid Session ID
+ * @param path Path of the file
+ * @param size Size of the file
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_send_file_info(char *sid, char *path, size_t size);
+
+/**
+ * @brief Function called to send a file transfer error message
+ * @param sid Session ID
+ * @param typ Type of the message which failed
+ * @param err Error description
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_file_transfer_send_error(char *sid, char *typ, const char *err);
+
+/**
+ * @brief Pack the header of a file transfer message
+ * @param packer msgpack packer
+ * @param typ Message type
+ * @param sid Session ID
+ * @param offset Offset property, NULL if the property is not sent
+ * @param body Body of the message following the header if set
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_troubleshoot_file_transfer_pack_header(msgpack_packer *packer, const char *typ, char *sid, int64_t *offset, bool body);
+
+/**
+ * @brief Function called to perform the treatment of the port forward messages
+ * @param protomsg Received proto message
+ * @param response Response to be sent back to the server, NULL if no response to send
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_port_forward_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response);
+
+/**
+ * @brief Decode the request of a new port forward session
+ * @param protomsg Received proto message
+ * @param host Remote host
+ * @param port Remote port
+ * @param udp Remote protocol is UDP if set, TCP otherwise
+ * @return MENDER_OK if the function succeeds, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_port_forward_decode_request(mender_troubleshoot_protomsg_t *protomsg, char **host, uint16_t *port, bool *udp);
+
+/**
+ * @brief Search port forward session
+ * @param sid Session ID
+ * @param connection_id Connection ID
+ * @param handle Local connection handle, the session is searched with the handle if it is not NULL
+ * @return Port forward session if found, a free session if sid and handle are NULL, NULL otherwise
+ */
+static mender_troubleshoot_port_forward_t *mender_troubleshoot_port_forward_find(char *sid, char *connection_id, void *handle);
+
+/**
+ * @brief Function called to send port forward protomsg, the message is packed in the preallocated buffer of the session
+ * @param port_forward Port forward session
+ * @param typ Message type
+ * @param data Binary body, NULL if the body is not sent
+ * @param length Length of the binary body
+ * @param keep Keep the message in the outbox if the send queue is full
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue is full and the message is not kept, error code if an error occured
+ */
+static mender_err_t mender_troubleshoot_port_forward_send_protomsg(mender_troubleshoot_port_forward_t *port_forward,
+                                                                   const char                         *typ,
+                                                                   uint8_t                            *data,
+                                                                   size_t                              length,
+                                                                   bool                                keep);
+
+/**
+ * @brief Release port forward session
+ * @param port_forward Port forward session
+ */
+static void mender_troubleshoot_port_forward_release(mender_troubleshoot_port_forward_t *port_forward);
+
+/**
+ * @brief Disconnect from the local services and release all the port forward sessions
+ */
+static void mender_troubleshoot_port_forward_close_all(void);
+
 /**
  * @brief Function used to format acknowledgment messages
  * @param protomsg Received proto message
@@ -183,9 +532,10 @@ static mender_err_t mender_troubleshoot_format_acknowledgment(mender_troubleshoo
 
 /**
  * @brief Function called to send shell ping protomsg
+ * @param timeout Time during which the server waits for the next ping (seconds)
  * @return MENDER_OK if the function succeeds, error code if an error occured
  */
-static mender_err_t mender_troubleshoot_send_shell_ping_protomsg(void);
+static mender_err_t mender_troubleshoot_send_shell_ping_protomsg(uint32_t timeout);
 
 /**
  * @brief Function called to send shell stop protomsg
@@ -195,6 +545,7 @@ static mender_err_t mender_troubleshoot_send_shell_stop_protomsg(void);
 
 /**
  * @brief Unpack and decode Proto message
+ * @note The Proto message is allocated in the msgpack zone, it is valid until the zone is cleared at the end of the treatment of the message
  * @param data Packed data to be decoded
  * @param length Length of the data to be decoded
  * @return Proto message if the function succeeds, NULL otherwise
@@ -223,12 +574,26 @@ static mender_troubleshoot_protohdr_t *mender_troubleshoot_decode_protohdr(msgpa
 static mender_troubleshoot_protohdr_properties_t *mender_troubleshoot_decode_protohdr_properties(msgpack_object *object);
 
 /**
- * @brief Decode body object
+ * @brief Decode body object, the body is not copied and references the message received
  * @param object Body object
  * @return Body if the function succeeds, NULL otherwise
  */
 static char *mender_troubleshoot_decode_body(msgpack_object *object);
 
+/**
+ * @brief Decode string object
+ * @param object String object
+ * @return Null-terminated string allocated in the msgpack zone if the function succeeds, NULL otherwise
+ */
+static char *mender_troubleshoot_decode_string(msgpack_object *object);
+
+/**
+ * @brief Allocate zeroed memory in the msgpack zone
+ * @param size Size of the memory
+ * @return Memory allocated if the function succeeds, NULL otherwise
+ */
+static void *mender_troubleshoot_zone_calloc(size_t size);
+
 /**
  * @brief Encode and pack Proto message
  * @param protomsg Proto message
@@ -238,6 +603,32 @@ static char *mender_troubleshoot_decode_body(msgpack_object *object);
  */
 static mender_err_t mender_troubleshoot_pack_protomsg(mender_troubleshoot_protomsg_t *protomsg, void **data, size_t *length);
 
+/**
+ * @brief Pack shell output message up to the header of the body, the shell output is sent after it without being copied
+ * @param packer msgpack packer
+ * @param sid Session ID
+ * @param length Length of the shell output
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_troubleshoot_pack_shell_output(msgpack_packer *packer, char *sid, size_t length);
+
+/**
+ * @brief Pack a string
+ * @param packer msgpack packer
+ * @param str String
+ * @return 0 if the function succeeds, -1 otherwise
+ */
+static int mender_troubleshoot_pack_string(msgpack_packer *packer, const char *str);
+
+/**
+ * @brief Write data to the msgpack sbuffer, the sbuffer grows with the client allocator instead of the one of msgpack
+ * @param data msgpack sbuffer
+ * @param buf Data to be written
+ * @param len Length of the data
+ * @return 0 if the function succeeds, -1 otherwise
+ */
+static int mender_troubleshoot_sbuffer_write(void *data, const char *buf, size_t len);
+
 /**
  * @brief Encode Proto message
  * @param protomsg Proto message
@@ -302,26 +693,85 @@ mender_troubleshoot_init(void *config, void *callbacks) {
 
     /* Save configuration */
     if (0 != ((mender_troubleshoot_config_t *)config)->healthcheck_interval) {
-        mender_troubleshoot_config.healthcheck_interval = ((mender_troubleshoot_config_t *)config)->healthcheck_interval;
+        mender_troubleshoot_ctx->config.healthcheck_interval = ((mender_troubleshoot_config_t *)config)->healthcheck_interval;
     } else {
-        mender_troubleshoot_config.healthcheck_interval = CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_INTERVAL;
+        mender_troubleshoot_ctx->config.healthcheck_interval = CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_INTERVAL;
     }
+    if (0 != ((mender_troubleshoot_config_t *)config)->healthcheck_max_interval) {
+        mender_troubleshoot_ctx->config.healthcheck_max_interval = ((mender_troubleshoot_config_t *)config)->healthcheck_max_interval;
+    } else {
+        mender_troubleshoot_ctx->config.healthcheck_max_interval = CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_MAX_INTERVAL;
+    }
+    if (mender_troubleshoot_ctx->config.healthcheck_max_interval < mender_troubleshoot_ctx->config.healthcheck_interval) {
+        mender_troubleshoot_ctx->config.healthcheck_max_interval = mender_troubleshoot_ctx->config.healthcheck_interval;
+    }
+    mender_troubleshoot_ctx->healthcheck_interval = mender_troubleshoot_ctx->config.healthcheck_interval;
 
     /* Save callbacks */
     if (NULL != callbacks) {
-        memcpy(&mender_troubleshoot_callbacks, callbacks, sizeof(mender_troubleshoot_callbacks_t));
+        memcpy(&mender_troubleshoot_ctx->callbacks, callbacks, sizeof(mender_troubleshoot_callbacks_t));
+    }
+
+    /* Create shell output mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_troubleshoot_ctx->shell_mutex))) {
+        mender_log_error("Unable to create shell output mutex");
+        return ret;
+    }
+    msgpack_sbuffer_init(&mender_troubleshoot_ctx->shell_sbuffer);
+    msgpack_sbuffer_init(&mender_troubleshoot_ctx->file_transfer_sbuffer);
+
+    /* Create file transfer mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_troubleshoot_ctx->file_transfer_mutex))) {
+        mender_log_error("Unable to create file transfer mutex");
+        return ret;
+    }
+
+    /* Create port forward mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_troubleshoot_ctx->port_forward_mutex))) {
+        mender_log_error("Unable to create port forward mutex");
+        return ret;
+    }
+
+    /* Create outbox mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_troubleshoot_ctx->outbox_mutex))) {
+        mender_log_error("Unable to create outbox mutex");
+        return ret;
+    }
+
+    /* Initialize msgpack zone */
+    if (true != msgpack_zone_init(&mender_troubleshoot_ctx->zone, MENDER_TROUBLESHOOT_ZONE_CHUNK_INIT_SIZE)) {
+        mender_log_error("Unable to initialize msgpack zone");
+        return MENDER_FAIL;
     }
 
     /* Create troubleshoot healthcheck work */
     mender_scheduler_work_params_t healthcheck_work_params;
     healthcheck_work_params.function = mender_troubleshoot_healthcheck_work_function;
-    healthcheck_work_params.period   = mender_troubleshoot_config.healthcheck_interval;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    healthcheck_work_params.arg = mender_client_get_ctx();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    healthcheck_work_params.period   = mender_troubleshoot_ctx->config.healthcheck_interval;
     healthcheck_work_params.name     = "mender_troubleshoot_healthcheck";
-    if (MENDER_OK != (ret = mender_scheduler_work_create(&healthcheck_work_params, &mender_troubleshoot_healthcheck_work_handle))) {
+    healthcheck_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_HIGH;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&healthcheck_work_params, &mender_troubleshoot_ctx->healthcheck_work_handle))) {
         mender_log_error("Unable to create healthcheck work");
         return ret;
     }
 
+    /* Create troubleshoot outbox work, executed when the send queue is full */
+    mender_scheduler_work_params_t outbox_work_params;
+    outbox_work_params.function = mender_troubleshoot_outbox_work_function;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    outbox_work_params.arg = mender_client_get_ctx();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    outbox_work_params.period   = 0;
+    outbox_work_params.name     = "mender_troubleshoot_outbox";
+    outbox_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_HIGH;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&outbox_work_params, &mender_troubleshoot_ctx->outbox_work_handle))) {
+        mender_log_error("Unable to create outbox work");
+        return ret;
+    }
+
     return ret;
 }
 
@@ -331,11 +781,17 @@ mender_troubleshoot_activate(void) {
     mender_err_t ret;
 
     /* Activate troubleshoot healthcheck work */
-    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_troubleshoot_healthcheck_work_handle))) {
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_troubleshoot_ctx->healthcheck_work_handle))) {
         mender_log_error("Unable to activate troubleshoot healthcheck work");
         return ret;
     }
 
+    /* Activate troubleshoot outbox work */
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_troubleshoot_ctx->outbox_work_handle))) {
+        mender_log_error("Unable to activate troubleshoot outbox work");
+        return ret;
+    }
+
     return ret;
 }
 
@@ -344,25 +800,26 @@ mender_troubleshoot_deactivate(void) {
 
     mender_err_t ret = MENDER_OK;
 
-    /* Deactivate troubleshoot healthcheck work */
-    mender_scheduler_work_deactivate(mender_troubleshoot_healthcheck_work_handle);
+    /* Deactivate troubleshoot healthcheck and outbox works */
+    mender_scheduler_work_deactivate(mender_troubleshoot_ctx->healthcheck_work_handle);
+    mender_scheduler_work_deactivate(mender_troubleshoot_ctx->outbox_work_handle);
 
     /* Check if a session is already opened */
-    if (NULL != mender_troubleshoot_shell_sid) {
+    if (NULL != mender_troubleshoot_ctx->shell_sid) {
 
         /* Invoke shell end callback */
-        if (NULL != mender_troubleshoot_callbacks.shell_end) {
-            if (MENDER_OK != (ret = mender_troubleshoot_callbacks.shell_end())) {
+        if (NULL != mender_troubleshoot_ctx->callbacks.shell_end) {
+            if (MENDER_OK != (ret = mender_troubleshoot_ctx->callbacks.shell_end())) {
                 mender_log_error("An error occured");
             }
         }
     }
 
     /* Check if connection is established */
-    if (NULL != mender_troubleshoot_handle) {
+    if (NULL != mender_troubleshoot_ctx->handle) {
 
         /* Check if a session is already opened */
-        if (NULL != mender_troubleshoot_shell_sid) {
+        if (NULL != mender_troubleshoot_ctx->shell_sid) {
 
             /* Send stop message to the server */
             if (MENDER_OK != (ret = mender_troubleshoot_send_shell_stop_protomsg())) {
@@ -371,20 +828,30 @@ mender_troubleshoot_deactivate(void) {
         }
 
         /* Disconnect the device of the server */
-        if (MENDER_OK != (ret = mender_api_troubleshoot_disconnect(mender_troubleshoot_handle))) {
+        if (MENDER_OK != (ret = mender_api_troubleshoot_disconnect(mender_troubleshoot_ctx->handle))) {
             mender_log_error("Unable to disconnect the device of the server");
         }
-        mender_troubleshoot_handle = NULL;
+        mender_troubleshoot_ctx->handle = NULL;
 
         /* Release access to the network */
         mender_client_network_release();
     }
 
+    /* Release the messages of the outbox, they can't be sent anymore */
+    mender_troubleshoot_outbox_release();
+
     /* Release session ID */
-    if (NULL != mender_troubleshoot_shell_sid) {
-        free(mender_troubleshoot_shell_sid);
-        mender_troubleshoot_shell_sid = NULL;
+    if (NULL != mender_troubleshoot_ctx->shell_sid) {
+        mender_utils_free(mender_troubleshoot_ctx->shell_sid);
+        mender_troubleshoot_ctx->shell_sid = NULL;
+    }
+
+    /* Release file transfer and port forward sessions */
+    if (MENDER_OK == mender_scheduler_mutex_take(mender_troubleshoot_ctx->file_transfer_mutex, -1)) {
+        mender_troubleshoot_file_transfer_release();
+        mender_scheduler_mutex_give(mender_troubleshoot_ctx->file_transfer_mutex);
     }
+    mender_troubleshoot_port_forward_close_all();
 
     return ret;
 }
@@ -393,117 +860,216 @@ mender_err_t
 mender_troubleshoot_shell_print(uint8_t *data, size_t length) {
 
     assert(NULL != data);
-    mender_troubleshoot_protomsg_t *protomsg = NULL;
-    mender_err_t                    ret      = MENDER_OK;
-    void                           *payload  = NULL;
+    mender_err_t   ret;
+    msgpack_packer packer;
+
+    /* Take mutex used to protect access to the shell output sbuffer */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_ctx->shell_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
 
     /* Check if a session is already opened */
-    if (NULL == mender_troubleshoot_shell_sid) {
+    if (NULL == mender_troubleshoot_ctx->shell_sid) {
         mender_log_error("No shell session opened");
         ret = MENDER_FAIL;
-        goto FAIL;
+        goto END;
     }
 
-    /* Send shell body */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == (protomsg->protohdr = (mender_troubleshoot_protohdr_t *)malloc(sizeof(mender_troubleshoot_protohdr_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    memset(protomsg->protohdr, 0, sizeof(mender_troubleshoot_protohdr_t));
-    protomsg->protohdr->proto = MENDER_TROUBLESHOOT_PROTO_TYPE_SHELL;
-    if (NULL == (protomsg->protohdr->typ = strdup(MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_SHELL))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    if (NULL == (protomsg->protohdr->sid = strdup(mender_troubleshoot_shell_sid))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    if (NULL == (protomsg->protohdr->properties = (mender_troubleshoot_protohdr_properties_t *)malloc(sizeof(mender_troubleshoot_protohdr_properties_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    memset(protomsg->protohdr->properties, 0, sizeof(mender_troubleshoot_protohdr_properties_t));
-    if (NULL == (protomsg->protohdr->properties->status = (mender_troubleshoot_properties_status_t *)malloc(sizeof(mender_troubleshoot_properties_status_t)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
-    *(protomsg->protohdr->properties->status) = MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL;
-    if (NULL == (protomsg->body = strndup((char *)data, length))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto FAIL;
-    }
+    /* Data is exchanged, the healthcheck is not required meanwhile */
+    mender_troubleshoot_healthcheck_activity_update();
 
-    /* Encode and pack the message */
-    if (MENDER_OK != (ret = mender_troubleshoot_pack_protomsg(protomsg, &payload, &length))) {
+    /* Pack the message, the sbuffer keeps the memory of the previous messages */
+    mender_troubleshoot_ctx->shell_sbuffer.size = 0;
+    msgpack_packer_init(&packer, &mender_troubleshoot_ctx->shell_sbuffer, mender_troubleshoot_sbuffer_write);
+    if (MENDER_OK != (ret = mender_troubleshoot_pack_shell_output(&packer, mender_troubleshoot_ctx->shell_sid, length))) {
         mender_log_error("Unable to encode message");
-        goto FAIL;
+        goto END;
     }
 
-    /* Send message */
-    if (MENDER_OK != (ret = mender_api_troubleshoot_send(mender_troubleshoot_handle, payload, length))) {
-        mender_log_error("Unable to send message");
-        goto FAIL;
+    /* Send message, the shell output follows the header */
+    mender_websocket_segment_t segments[] = { { .data = mender_troubleshoot_ctx->shell_sbuffer.data, .length = mender_troubleshoot_ctx->shell_sbuffer.size },
+                                              { .data = data, .length = length } };
+    if (MENDER_OK != (ret = mender_troubleshoot_send_v(segments, 2, false))) {
+        if (MENDER_BUSY != ret) {
+            mender_log_error("Unable to send message");
+        }
+        goto END;
     }
 
-FAIL:
+END:
 
-    /* Release memory */
-    mender_troubleshoot_release_protomsg(protomsg);
-    if (NULL != payload) {
-        free(payload);
-    }
+    /* Release mutex used to protect access to the shell output sbuffer */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->shell_mutex);
 
     return ret;
 }
 
 mender_err_t
-mender_troubleshoot_exit(void) {
+mender_troubleshoot_port_forward_send(void *handle, uint8_t *data, size_t length) {
 
-    /* Delete troubleshoot healthcheck work */
-    mender_scheduler_work_delete(mender_troubleshoot_healthcheck_work_handle);
-    mender_troubleshoot_healthcheck_work_handle = NULL;
+    assert(NULL != handle);
+    assert(NULL != data);
+    mender_err_t                        ret;
+    mender_troubleshoot_port_forward_t *port_forward;
 
-    /* Release memory */
-    if (NULL != mender_troubleshoot_shell_sid) {
-        free(mender_troubleshoot_shell_sid);
-        mender_troubleshoot_shell_sid = NULL;
+    /* Take mutex used to protect access to the port forward sessions */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_ctx->port_forward_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
     }
-    mender_troubleshoot_config.healthcheck_interval = 0;
 
-    return MENDER_OK;
-}
+    /* Retrieve the port forward session */
+    if (NULL == (port_forward = mender_troubleshoot_port_forward_find(NULL, NULL, handle))) {
+        mender_log_error("No port forward session opened");
+        ret = MENDER_FAIL;
+        goto END;
+    }
 
-static mender_err_t
-mender_troubleshoot_healthcheck_work_function(void) {
+    /* Data is exchanged, the healthcheck is not required meanwhile */
+    mender_troubleshoot_healthcheck_activity_update();
 
-    mender_err_t ret = MENDER_OK;
+    /* Send the data in frames fitting in the preallocated buffer of the session, the data is sent entirely or not at all if the send queue is full */
+    for (bool keep = false; length > 0; keep = true) {
+        size_t frame_length
+            = (length < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_BUFFER_SIZE) ? length : CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_BUFFER_SIZE;
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_port_forward_send_protomsg(
+                    port_forward, MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_FORWARD, data, frame_length, keep))) {
+            if (MENDER_BUSY != ret) {
+                mender_log_error("Unable to send data");
+            }
+            goto END;
+        }
+        data += frame_length;
+        length -= frame_length;
+    }
 
-    /* Check if connection is established */
-    if (NULL != mender_troubleshoot_handle) {
+END:
 
-        /* Check if a session is already opened */
-        if (NULL != mender_troubleshoot_shell_sid) {
+    /* Release mutex used to protect access to the port forward sessions */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->port_forward_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_troubleshoot_port_forward_stop(void *handle) {
+
+    assert(NULL != handle);
+    mender_err_t                        ret;
+    mender_troubleshoot_port_forward_t *port_forward;
+
+    /* Take mutex used to protect access to the port forward sessions */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_ctx->port_forward_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Retrieve the port forward session */
+    if (NULL == (port_forward = mender_troubleshoot_port_forward_find(NULL, NULL, handle))) {
+        mender_log_error("No port forward session opened");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Notify the server and release the session */
+    mender_log_info("Stopping port forward session");
+    if (MENDER_OK != (ret = mender_troubleshoot_port_forward_send_protomsg(port_forward, MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_STOP, NULL, 0, true))) {
+        mender_log_error("Unable to send message");
+    }
+    mender_troubleshoot_port_forward_release(port_forward);
+
+END:
+
+    /* Release mutex used to protect access to the port forward sessions */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->port_forward_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_troubleshoot_exit(void) {
+
+    /* Delete troubleshoot healthcheck and outbox works */
+    mender_scheduler_work_delete(mender_troubleshoot_ctx->healthcheck_work_handle);
+    mender_troubleshoot_ctx->healthcheck_work_handle = NULL;
+    mender_scheduler_work_delete(mender_troubleshoot_ctx->outbox_work_handle);
+    mender_troubleshoot_ctx->outbox_work_handle = NULL;
+
+    /* Release memory */
+    if (NULL != mender_troubleshoot_ctx->shell_sid) {
+        mender_utils_free(mender_troubleshoot_ctx->shell_sid);
+        mender_troubleshoot_ctx->shell_sid = NULL;
+    }
+    mender_troubleshoot_ctx->config.healthcheck_interval     = 0;
+    mender_troubleshoot_ctx->config.healthcheck_max_interval = 0;
+    mender_troubleshoot_ctx->healthcheck_activity            = 0;
+    mender_troubleshoot_ctx->healthcheck_ping                = 0;
+    mender_troubleshoot_ctx->healthcheck_interval            = 0;
+    mender_utils_free(mender_troubleshoot_ctx->shell_sbuffer.data);
+    msgpack_sbuffer_init(&mender_troubleshoot_ctx->shell_sbuffer);
+    mender_scheduler_mutex_delete(mender_troubleshoot_ctx->shell_mutex);
+    mender_troubleshoot_ctx->shell_mutex = NULL;
+    mender_troubleshoot_file_transfer_release();
+    mender_utils_free(mender_troubleshoot_ctx->file_transfer_sbuffer.data);
+    msgpack_sbuffer_init(&mender_troubleshoot_ctx->file_transfer_sbuffer);
+    mender_scheduler_mutex_delete(mender_troubleshoot_ctx->file_transfer_mutex);
+    mender_troubleshoot_ctx->file_transfer_mutex = NULL;
+    mender_troubleshoot_port_forward_close_all();
+    mender_scheduler_mutex_delete(mender_troubleshoot_ctx->port_forward_mutex);
+    mender_troubleshoot_ctx->port_forward_mutex = NULL;
+    mender_troubleshoot_outbox_release();
+    mender_scheduler_mutex_delete(mender_troubleshoot_ctx->outbox_mutex);
+    mender_troubleshoot_ctx->outbox_mutex = NULL;
+    msgpack_zone_destroy(&mender_troubleshoot_ctx->zone);
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+static void *
+mender_troubleshoot_select_ctx(void *ctx) {
+
+    mender_troubleshoot_ctx_t *previous = mender_troubleshoot_ctx;
+
+    /* Select the context of the troubleshoot, the calling thread uses it until another context is selected */
+    mender_troubleshoot_ctx = (NULL != ctx) ? (mender_troubleshoot_ctx_t *)ctx : &mender_troubleshoot_default_ctx;
+
+    return previous;
+}
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+static mender_err_t
+mender_troubleshoot_healthcheck_work_function(MENDER_SCHEDULER_WORK_ARG) {
+
+    mender_err_t ret = MENDER_OK;
+    uint32_t     timeout;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select the context of the device of the work */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Check if connection is established */
+    if (NULL != mender_troubleshoot_ctx->handle) {
+
+        /* Check if a session is already opened and if the healthcheck is required */
+        if ((NULL != mender_troubleshoot_ctx->shell_sid) && (true == mender_troubleshoot_healthcheck_is_required(&timeout))) {
 
             /* Send healthcheck ping message over websocket connection */
-            if (MENDER_OK != (ret = mender_troubleshoot_send_shell_ping_protomsg())) {
+            if (MENDER_OK != (ret = mender_troubleshoot_send_shell_ping_protomsg(timeout))) {
                 mender_log_error("Unable to send healthcheck message to the server");
                 goto FAIL;
             }
         }
 
+        /* Flush the outbox, the previous flush may have stopped while the send queue was full */
+        if (NULL != mender_troubleshoot_ctx->outbox_head) {
+            mender_scheduler_work_execute(mender_troubleshoot_ctx->outbox_work_handle);
+        }
+
     } else {
 
         /* Request access to the network */
@@ -513,7 +1079,11 @@ mender_troubleshoot_healthcheck_work_function(void) {
         }
 
         /* Connect the device to the server */
-        if (MENDER_OK != (ret = mender_api_troubleshoot_connect(&mender_troubleshoot_data_received_callback, &mender_troubleshoot_handle))) {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+        if (MENDER_OK != (ret = mender_api_troubleshoot_connect(&mender_troubleshoot_data_received_callback, arg, &mender_troubleshoot_ctx->handle))) {
+#else
+        if (MENDER_OK != (ret = mender_api_troubleshoot_connect(&mender_troubleshoot_data_received_callback, &mender_troubleshoot_ctx->handle))) {
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
             mender_log_error("Unable to connect the device to the server");
             goto END;
         }
@@ -524,48 +1094,294 @@ mender_troubleshoot_healthcheck_work_function(void) {
 FAIL:
 
     /* Check if a session is already opened */
-    if (NULL != mender_troubleshoot_shell_sid) {
+    if (NULL != mender_troubleshoot_ctx->shell_sid) {
 
         /* Invoke shell end callback */
-        if (NULL != mender_troubleshoot_callbacks.shell_end) {
-            if (MENDER_OK != (ret = mender_troubleshoot_callbacks.shell_end())) {
+        if (NULL != mender_troubleshoot_ctx->callbacks.shell_end) {
+            if (MENDER_OK != (ret = mender_troubleshoot_ctx->callbacks.shell_end())) {
                 mender_log_error("An error occured");
             }
         }
     }
 
     /* Check if connection is established */
-    if (NULL != mender_troubleshoot_handle) {
+    if (NULL != mender_troubleshoot_ctx->handle) {
 
         /* Disconnect the device of the server */
-        if (MENDER_OK != (ret = mender_api_troubleshoot_disconnect(mender_troubleshoot_handle))) {
+        if (MENDER_OK != (ret = mender_api_troubleshoot_disconnect(mender_troubleshoot_ctx->handle))) {
             mender_log_error("Unable to disconnect the device of the server");
         }
-        mender_troubleshoot_handle = NULL;
+        mender_troubleshoot_ctx->handle = NULL;
 
         /* Release access to the network */
         mender_client_network_release();
     }
 
+    /* Release the messages of the outbox, they can't be sent anymore */
+    mender_troubleshoot_outbox_release();
+
     /* Release session ID */
-    if (NULL != mender_troubleshoot_shell_sid) {
-        free(mender_troubleshoot_shell_sid);
-        mender_troubleshoot_shell_sid = NULL;
+    if (NULL != mender_troubleshoot_ctx->shell_sid) {
+        mender_utils_free(mender_troubleshoot_ctx->shell_sid);
+        mender_troubleshoot_ctx->shell_sid = NULL;
+    }
+
+    /* Release file transfer and port forward sessions */
+    if (MENDER_OK == mender_scheduler_mutex_take(mender_troubleshoot_ctx->file_transfer_mutex, -1)) {
+        mender_troubleshoot_file_transfer_release();
+        mender_scheduler_mutex_give(mender_troubleshoot_ctx->file_transfer_mutex);
+    }
+    mender_troubleshoot_port_forward_close_all();
+
+END:
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    return ret;
+}
+
+static bool
+mender_troubleshoot_healthcheck_is_required(uint32_t *timeout) {
+
+    assert(NULL != timeout);
+    uint64_t now;
+
+    /* Ping at each interval if the uptime is not available */
+    if (MENDER_OK != mender_scheduler_get_uptime(&now)) {
+        *timeout = 2 * mender_troubleshoot_ctx->config.healthcheck_interval;
+        return true;
+    }
+
+    /* Suppress the ping while data is exchanged */
+    if (now - mender_troubleshoot_ctx->healthcheck_activity < (uint64_t)mender_troubleshoot_ctx->config.healthcheck_interval * 1000) {
+        return false;
+    }
+
+    /* Wait for the current interval since the previous ping */
+    if (now - mender_troubleshoot_ctx->healthcheck_ping < (uint64_t)mender_troubleshoot_ctx->healthcheck_interval * 1000) {
+        return false;
+    }
+
+    /* Stretch the interval while the session is idle, the server is told to wait twice the next interval */
+    mender_troubleshoot_ctx->healthcheck_ping = now;
+    if ((mender_troubleshoot_ctx->healthcheck_interval *= 2) > mender_troubleshoot_ctx->config.healthcheck_max_interval) {
+        mender_troubleshoot_ctx->healthcheck_interval = mender_troubleshoot_ctx->config.healthcheck_max_interval;
+    }
+    *timeout = 2 * mender_troubleshoot_ctx->healthcheck_interval;
+
+    return true;
+}
+
+static void
+mender_troubleshoot_healthcheck_activity_update(void) {
+
+    uint64_t now;
+
+    /* Save the uptime and reset the healthcheck interval */
+    if (MENDER_OK == mender_scheduler_get_uptime(&now)) {
+        mender_troubleshoot_ctx->healthcheck_activity = now;
+    }
+    mender_troubleshoot_ctx->healthcheck_interval = mender_troubleshoot_ctx->config.healthcheck_interval;
+}
+
+static mender_err_t
+mender_troubleshoot_outbox_work_function(MENDER_SCHEDULER_WORK_ARG) {
+
+    mender_err_t ret     = MENDER_OK;
+    bool         busy;
+    uint32_t     retries = 0;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select the context of the device of the work */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Send the messages of the outbox and resume the download while the send queue is full, until the timeout */
+    do {
+
+        /* Send the messages of the outbox */
+        if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_ctx->outbox_mutex, -1)) {
+            mender_log_error("Unable to take mutex");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        busy = (MENDER_OK != mender_troubleshoot_outbox_flush());
+        mender_scheduler_mutex_give(mender_troubleshoot_ctx->outbox_mutex);
+
+        /* Resume the download stalled by the full send queue, the server is notified if the file can't be read anymore */
+        if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_ctx->file_transfer_mutex, -1)) {
+            mender_log_error("Unable to take mutex");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        if ((NULL != mender_troubleshoot_ctx->file_transfer.sid) && (true != mender_troubleshoot_ctx->file_transfer.upload)
+            && (true == mender_troubleshoot_ctx->file_transfer.pending)) {
+            if (MENDER_OK != mender_troubleshoot_file_transfer_send_chunks()) {
+                if (MENDER_OK
+                    != mender_troubleshoot_file_transfer_send_error(
+                        mender_troubleshoot_ctx->file_transfer.sid, MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_GET_FILE, "Unable to read the file")) {
+                    mender_log_error("Unable to send error message");
+                }
+                mender_troubleshoot_file_transfer_release();
+            }
+            busy |= mender_troubleshoot_ctx->file_transfer.pending;
+        }
+        mender_scheduler_mutex_give(mender_troubleshoot_ctx->file_transfer_mutex);
+
+        /* Wait for the send queue to be flushed */
+        if (true == busy) {
+            mender_scheduler_delay(MENDER_TROUBLESHOOT_OUTBOX_RETRY_INTERVAL);
+        }
+    } while ((true == busy) && (++retries < MENDER_TROUBLESHOOT_OUTBOX_RETRY_TIMEOUT / MENDER_TROUBLESHOOT_OUTBOX_RETRY_INTERVAL));
+
+    /* The remaining messages are sent at the next flush, the healthcheck work executes it again */
+    if (true == busy) {
+        mender_log_warning("Send queue still full, the remaining messages are sent later");
+    }
+
+END:
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_outbox_flush(void) {
+
+    mender_troubleshoot_outbox_message_t *message;
+    mender_err_t                          ret;
+
+    /* Send the messages in order until the send queue is full */
+    while (NULL != (message = mender_troubleshoot_ctx->outbox_head)) {
+        if (MENDER_BUSY == (ret = mender_api_troubleshoot_send(mender_troubleshoot_ctx->handle, message->data, message->length))) {
+            return MENDER_BUSY;
+        }
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to send message, it is dropped");
+        }
+        if (NULL == (mender_troubleshoot_ctx->outbox_head = message->next)) {
+            mender_troubleshoot_ctx->outbox_tail = NULL;
+        }
+        mender_utils_free(message);
+    }
+
+    return MENDER_OK;
+}
+
+static void
+mender_troubleshoot_outbox_release(void) {
+
+    mender_troubleshoot_outbox_message_t *message;
+    size_t                                count = 0;
+
+    /* Take mutex used to protect access to the outbox */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_ctx->outbox_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return;
+    }
+
+    /* Release the messages */
+    while (NULL != (message = mender_troubleshoot_ctx->outbox_head)) {
+        mender_troubleshoot_ctx->outbox_head = message->next;
+        mender_utils_free(message);
+        count++;
+    }
+    mender_troubleshoot_ctx->outbox_tail = NULL;
+    if (0 != count) {
+        mender_log_warning("%zu messages of the outbox dropped", count);
+    }
+
+    /* Release mutex used to protect access to the outbox */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->outbox_mutex);
+}
+
+static mender_err_t
+mender_troubleshoot_send_v(mender_websocket_segment_t *segments, size_t count, bool keep) {
+
+    assert(NULL != segments);
+    mender_err_t                          ret;
+    mender_troubleshoot_outbox_message_t *message;
+    size_t                                length = 0;
+
+    /* Take mutex used to protect access to the outbox */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_ctx->outbox_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Send the messages of the outbox first, so that the server receives the messages in order */
+    if ((MENDER_OK == (ret = mender_troubleshoot_outbox_flush()))
+        && (MENDER_BUSY != (ret = mender_api_troubleshoot_send_v(mender_troubleshoot_ctx->handle, segments, count)))) {
+        goto END;
+    }
+
+    /* The send queue is full, the message is copied to the outbox if it must not be lost, the caller sends it again later otherwise */
+    if (true != keep) {
+        goto END;
+    }
+    for (size_t index = 0; index < count; index++) {
+        length += segments[index].length;
+    }
+    if (NULL == (message = (mender_troubleshoot_outbox_message_t *)mender_utils_malloc(sizeof(mender_troubleshoot_outbox_message_t) + length))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    message->data   = (uint8_t *)(message + 1);
+    message->length = 0;
+    message->next   = NULL;
+    for (size_t index = 0; index < count; index++) {
+        if (0 != segments[index].length) {
+            memcpy(&message->data[message->length], segments[index].data, segments[index].length);
+            message->length += segments[index].length;
+        }
+    }
+    if (NULL == mender_troubleshoot_ctx->outbox_tail) {
+        mender_troubleshoot_ctx->outbox_head = message;
+    } else {
+        mender_troubleshoot_ctx->outbox_tail->next = message;
     }
+    mender_troubleshoot_ctx->outbox_tail = message;
+    ret                                  = MENDER_OK;
+
+    /* Send the outbox as soon as the send queue is flushed */
+    mender_scheduler_work_execute(mender_troubleshoot_ctx->outbox_work_handle);
 
 END:
 
+    /* Release mutex used to protect access to the outbox */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->outbox_mutex);
+
     return ret;
 }
 
 static mender_err_t
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+mender_troubleshoot_data_received_callback(void *data, size_t length, void *arg) {
+#else
 mender_troubleshoot_data_received_callback(void *data, size_t length) {
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
     assert(NULL != data);
     mender_err_t                    ret = MENDER_OK;
     mender_troubleshoot_protomsg_t *protomsg;
     mender_troubleshoot_protomsg_t *response = NULL;
     void                           *payload  = NULL;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select the context of the device of the connection, the callback is invoked by the thread of the websocket */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Data is exchanged, the healthcheck is not required meanwhile */
+    mender_troubleshoot_healthcheck_activity_update();
 
     /* Unpack and decode message */
     if (NULL == (protomsg = mender_troubleshoot_unpack_protomsg(data, length))) {
@@ -594,7 +1410,11 @@ mender_troubleshoot_data_received_callback(void *data, size_t length) {
             ret = mender_troubleshoot_mender_client_message_handler(protomsg, &response);
             break;
         case MENDER_TROUBLESHOOT_PROTO_TYPE_FILE_TRANSFER:
+            ret = mender_troubleshoot_file_transfer_message_handler(protomsg);
+            break;
         case MENDER_TROUBLESHOOT_PROTO_TYPE_PORT_FORWARD:
+            ret = mender_troubleshoot_port_forward_message_handler(protomsg, &response);
+            break;
         case MENDER_TROUBLESHOOT_PROTO_TYPE_CONTROL:
         default:
             mender_log_error("Unsupported message received with proto type 0x%04x", protomsg->protohdr->proto);
@@ -611,8 +1431,9 @@ mender_troubleshoot_data_received_callback(void *data, size_t length) {
             goto END;
         }
 
-        /* Send response */
-        if (MENDER_OK != (ret = mender_api_troubleshoot_send(mender_troubleshoot_handle, payload, length))) {
+        /* Send response, it is kept in the outbox if the send queue is full */
+        mender_websocket_segment_t segment = { .data = payload, .length = length };
+        if (MENDER_OK != (ret = mender_troubleshoot_send_v(&segment, 1, true))) {
             mender_log_error("Unable to send response");
             goto END;
         }
@@ -620,12 +1441,17 @@ mender_troubleshoot_data_received_callback(void *data, size_t length) {
 
 END:
 
-    /* Release memory */
-    mender_troubleshoot_release_protomsg(protomsg);
+    /* Release memory, the zone keeps its first chunk for the next messages */
+    msgpack_zone_clear(&mender_troubleshoot_ctx->zone);
     mender_troubleshoot_release_protomsg(response);
     if (NULL != payload) {
-        free(payload);
+        mender_utils_free(payload);
     }
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
     return ret;
 }
@@ -664,9 +1490,9 @@ mender_troubleshoot_shell_message_handler(mender_troubleshoot_protomsg_t *protom
         }
 
         /* Invoke shell resize callback */
-        if (NULL != mender_troubleshoot_callbacks.shell_resize) {
+        if (NULL != mender_troubleshoot_ctx->callbacks.shell_resize) {
             if (MENDER_OK
-                != (ret = mender_troubleshoot_callbacks.shell_resize(*protomsg->protohdr->properties->terminal_width,
+                != (ret = mender_troubleshoot_ctx->callbacks.shell_resize(*protomsg->protohdr->properties->terminal_width,
                                                                      *protomsg->protohdr->properties->terminal_height))) {
                 mender_log_error("An error occured");
                 goto FAIL;
@@ -683,8 +1509,8 @@ mender_troubleshoot_shell_message_handler(mender_troubleshoot_protomsg_t *protom
         }
 
         /* Invoke shell data write callback */
-        if (NULL != mender_troubleshoot_callbacks.shell_write) {
-            if (MENDER_OK != (ret = mender_troubleshoot_callbacks.shell_write((uint8_t *)protomsg->body, strlen(protomsg->body)))) {
+        if (NULL != mender_troubleshoot_ctx->callbacks.shell_write) {
+            if (MENDER_OK != (ret = mender_troubleshoot_ctx->callbacks.shell_write((uint8_t *)protomsg->body, protomsg->body_length))) {
                 mender_log_error("An error occured");
                 goto FAIL;
             }
@@ -693,80 +1519,862 @@ mender_troubleshoot_shell_message_handler(mender_troubleshoot_protomsg_t *protom
     } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_SPAWN)) {
 
         /* Check is a session is already opened */
-        if (NULL != mender_troubleshoot_shell_sid) {
+        if (NULL != mender_troubleshoot_ctx->shell_sid) {
             mender_log_warning("A shell session is already opened");
             goto END;
         }
 
-        /* Start shell session */
-        mender_log_info("Starting a new shell session");
-
-        /* Save the session ID */
-        if (NULL == (mender_troubleshoot_shell_sid = strdup(protomsg->protohdr->sid))) {
+        /* Start shell session */
+        mender_log_info("Starting a new shell session");
+
+        /* Save the session ID */
+        if (NULL == (mender_troubleshoot_ctx->shell_sid = mender_utils_strdup(protomsg->protohdr->sid))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto FAIL;
+        }
+
+        /* Format acknowledgment */
+        if (MENDER_OK
+            != (ret
+                = mender_troubleshoot_format_acknowledgment(protomsg,
+                                                            mender_troubleshoot_ctx->shell_sid,
+                                                            (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL : MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR,
+                                                            response))) {
+            mender_log_error("Unable to format response");
+            goto FAIL;
+        }
+
+        /* Invoke shell begin callback */
+        if (NULL != mender_troubleshoot_ctx->callbacks.shell_begin) {
+            if ((NULL != protomsg->protohdr->properties) && (NULL != protomsg->protohdr->properties->terminal_width)
+                && (NULL != protomsg->protohdr->properties->terminal_height)) {
+                ret = mender_troubleshoot_ctx->callbacks.shell_begin(*protomsg->protohdr->properties->terminal_width,
+                                                                *protomsg->protohdr->properties->terminal_height);
+            } else {
+                ret = mender_troubleshoot_ctx->callbacks.shell_begin(0, 0);
+            }
+            if (MENDER_OK != ret) {
+                mender_log_error("An error occured");
+                goto FAIL;
+            }
+        }
+
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_STOP)) {
+
+        /* Check is a session is already opened */
+        if (NULL == mender_troubleshoot_ctx->shell_sid) {
+            mender_log_warning("No shell session opened");
+            goto END;
+        }
+
+        /* Stop shell session */
+        mender_log_info("Stopping current shell session");
+
+        /* Invoke shell end callback */
+        if (NULL != mender_troubleshoot_ctx->callbacks.shell_end) {
+            if (MENDER_OK != (ret = mender_troubleshoot_ctx->callbacks.shell_end())) {
+                mender_log_error("An error occured");
+            }
+        }
+
+        /* Format acknowledgment */
+        if (MENDER_OK
+            != (ret
+                = mender_troubleshoot_format_acknowledgment(protomsg,
+                                                            mender_troubleshoot_ctx->shell_sid,
+                                                            (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL : MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR,
+                                                            response))) {
+            mender_log_error("Unable to format response");
+        }
+
+        /* Release session ID */
+        if (NULL != mender_troubleshoot_ctx->shell_sid) {
+            mender_utils_free(mender_troubleshoot_ctx->shell_sid);
+            mender_troubleshoot_ctx->shell_sid = NULL;
+        }
+
+    } else {
+
+        mender_log_error("Unsupported message received with message type '%s'", protomsg->protohdr->typ);
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
+END:
+
+    return ret;
+
+FAIL:
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_mender_client_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
+
+    assert(NULL != protomsg);
+    assert(NULL != protomsg->protohdr);
+    mender_err_t ret = MENDER_OK;
+
+    /* Verify integrity of the message */
+    if (NULL == protomsg->protohdr->typ) {
+        mender_log_error("Invalid message received");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Treatment of the message depending of the message type */
+    if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_MENDER_CLIENT_CHECK_UPDATE)) {
+
+        /* Trigger execution of the mender-client update work */
+        ret = mender_client_execute();
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+        /* Trigger execution of the mender-configure work, the server announces configuration changes with the same message */
+        if (MENDER_OK == ret) {
+            ret = mender_configure_execute();
+        }
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+
+        /* Format acknowledgment */
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_format_acknowledgment(
+                    protomsg, NULL, (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL : MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR, response))) {
+            mender_log_error("Unable to format response");
+            goto FAIL;
+        }
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY
+
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_MENDER_CLIENT_SEND_INVENTORY)) {
+
+        /* Trigger execution of the mender-inventory work */
+        ret = mender_inventory_execute();
+
+        /* Format acknowledgment */
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_format_acknowledgment(
+                    protomsg, NULL, (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL : MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR, response))) {
+            mender_log_error("Unable to format response");
+            goto FAIL;
+        }
+
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
+
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_MENDER_CLIENT_UPLOAD_LOGS)) {
+
+        /* Trigger the upload of the log buffer, the body of the message is the ID of the deployment to which the logs are attached */
+        char *id = NULL;
+        if ((NULL == protomsg->body) || (0 == protomsg->body_length)) {
+            mender_log_error("Invalid message received");
+            ret = MENDER_FAIL;
+        } else if (NULL == (id = mender_utils_strndup(protomsg->body, protomsg->body_length))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+        } else {
+            ret = mender_client_publish_deployment_logs(id);
+            mender_utils_free(id);
+        }
+
+        /* Format acknowledgment */
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_format_acknowledgment(
+                    protomsg, NULL, (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL : MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR, response))) {
+            mender_log_error("Unable to format response");
+            goto FAIL;
+        }
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
+    } else {
+
+        mender_log_error("Unsupported message received with message type '%s'", protomsg->protohdr->typ);
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
+END:
+
+    return ret;
+
+FAIL:
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_message_handler(mender_troubleshoot_protomsg_t *protomsg) {
+
+    assert(NULL != protomsg);
+    assert(NULL != protomsg->protohdr);
+    mender_err_t ret  = MENDER_OK;
+    const char  *err  = NULL;
+    char        *path = NULL;
+    size_t       size = 0;
+
+    /* Verify integrity of the message */
+    if ((NULL == protomsg->protohdr->typ) || (NULL == protomsg->protohdr->sid)) {
+        mender_log_error("Invalid message received");
+        return MENDER_FAIL;
+    }
+
+    /* Take mutex used to protect access to the file transfer, the outbox work resumes the download meanwhile */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_ctx->file_transfer_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Treatment of the message depending of the message type */
+    if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_STAT)) {
+
+        /* Decode the request */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_decode_request(protomsg, &path))) {
+            err = "Invalid request";
+            goto FAIL;
+        }
+
+        /* Retrieve the size of the file */
+        if (NULL == mender_troubleshoot_ctx->callbacks.file_stat) {
+            mender_log_error("File transfer is not supported");
+            err = "Not supported";
+            ret = MENDER_NOT_IMPLEMENTED;
+            goto FAIL;
+        }
+        if (MENDER_OK != (ret = mender_troubleshoot_ctx->callbacks.file_stat(path, &size))) {
+            mender_log_error("Unable to get information of file '%s'", path);
+            err = "Unable to get information of the file";
+            goto FAIL;
+        }
+
+        /* Send file information */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_send_file_info(protomsg->protohdr->sid, path, size))) {
+            mender_log_error("Unable to send file information");
+            goto END;
+        }
+
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_GET_FILE)) {
+
+        /* Decode the request */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_decode_request(protomsg, &path))) {
+            err = "Invalid request";
+            goto FAIL;
+        }
+
+        /* Open the file */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_open(protomsg->protohdr->sid, path, false))) {
+            err = "Unable to open the file";
+            goto FAIL;
+        }
+        mender_log_info("Downloading file '%s'", path);
+
+        /* Send the first chunks, the next ones are sent when the server acknowledges them */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_send_chunks())) {
+            err = "Unable to read the file";
+            goto FAIL;
+        }
+
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_PUT_FILE)) {
+
+        /* Decode the request */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_decode_request(protomsg, &path))) {
+            err = "Invalid request";
+            goto FAIL;
+        }
+
+        /* Open the file */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_open(protomsg->protohdr->sid, path, true))) {
+            err = "Unable to open the file";
+            goto FAIL;
+        }
+        mender_log_info("Uploading file '%s'", path);
+
+        /* Indicate the server to start sending the chunks */
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_file_transfer_send(
+                    MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_CONTINUE, protomsg->protohdr->sid, NULL, NULL, 0, true))) {
+            mender_log_error("Unable to send message");
+            mender_troubleshoot_file_transfer_release();
+            goto END;
+        }
+
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_CHUNK)) {
+
+        /* Check if an upload is in progress for this session */
+        if ((NULL == mender_troubleshoot_ctx->file_transfer.sid) || (strcmp(mender_troubleshoot_ctx->file_transfer.sid, protomsg->protohdr->sid))
+            || (true != mender_troubleshoot_ctx->file_transfer.upload)) {
+            mender_log_error("No file upload in progress");
+            err = "No file upload in progress";
+            ret = MENDER_FAIL;
+            goto FAIL;
+        }
+
+        /* Write the chunk */
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_write_chunk(protomsg))) {
+            err = "Unable to write the file";
+            goto FAIL;
+        }
+
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_ACK)) {
+
+        /* Check if a download is in progress for this session, acknowledgments may be received after the end of the file */
+        if ((NULL == mender_troubleshoot_ctx->file_transfer.sid) || (strcmp(mender_troubleshoot_ctx->file_transfer.sid, protomsg->protohdr->sid))
+            || (true == mender_troubleshoot_ctx->file_transfer.upload)) {
+            goto END;
+        }
+
+        /* Verify integrity of the message */
+        if ((NULL == protomsg->protohdr->properties) || (NULL == protomsg->protohdr->properties->offset)) {
+            mender_log_error("Invalid message received");
+            err = "Invalid acknowledgment";
+            ret = MENDER_FAIL;
+            goto FAIL;
+        }
+
+        /* Send the next chunks */
+        if (*protomsg->protohdr->properties->offset > mender_troubleshoot_ctx->file_transfer.acked) {
+            mender_troubleshoot_ctx->file_transfer.acked = *protomsg->protohdr->properties->offset;
+        }
+        if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_send_chunks())) {
+            err = "Unable to read the file";
+            goto FAIL;
+        }
+
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_ERROR)) {
+
+        /* Abort the file transfer of this session */
+        if ((NULL != mender_troubleshoot_ctx->file_transfer.sid) && (!strcmp(mender_troubleshoot_ctx->file_transfer.sid, protomsg->protohdr->sid))) {
+            mender_log_error("File transfer aborted by the server");
+            mender_troubleshoot_file_transfer_release();
+        }
+
+    } else {
+
+        mender_log_error("Unsupported message received with message type '%s'", protomsg->protohdr->typ);
+        err = "Unsupported message type";
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
+END:
+
+    /* Release mutex used to protect access to the file transfer */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->file_transfer_mutex);
+
+    /* Release memory */
+    if (NULL != path) {
+        mender_utils_free(path);
+    }
+
+    return ret;
+
+FAIL:
+
+    /* Notify the server */
+    if (MENDER_OK != mender_troubleshoot_file_transfer_send_error(protomsg->protohdr->sid, protomsg->protohdr->typ, err)) {
+        mender_log_error("Unable to send error message");
+    }
+
+    /* Release the file transfer of this session */
+    if ((NULL != mender_troubleshoot_ctx->file_transfer.sid) && (!strcmp(mender_troubleshoot_ctx->file_transfer.sid, protomsg->protohdr->sid))) {
+        mender_troubleshoot_file_transfer_release();
+    }
+
+    /* Release mutex used to protect access to the file transfer */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->file_transfer_mutex);
+
+    /* Release memory */
+    if (NULL != path) {
+        mender_utils_free(path);
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_open(char *sid, char *path, bool upload) {
+
+    assert(NULL != sid);
+    assert(NULL != path);
+    mender_err_t ret;
+    void        *handle;
+
+    /* Check if a file transfer is already in progress */
+    if (NULL != mender_troubleshoot_ctx->file_transfer.sid) {
+        mender_log_error("A file transfer is already in progress");
+        return MENDER_FAIL;
+    }
+
+    /* Check if the file transfer is supported */
+    if ((NULL == mender_troubleshoot_ctx->callbacks.file_open) || (NULL == mender_troubleshoot_ctx->callbacks.file_close)
+        || ((true == upload) ? (NULL == mender_troubleshoot_ctx->callbacks.file_write) : (NULL == mender_troubleshoot_ctx->callbacks.file_read))) {
+        mender_log_error("File transfer is not supported");
+        return MENDER_NOT_IMPLEMENTED;
+    }
+
+    /* Open the file */
+    if (MENDER_OK != (ret = mender_troubleshoot_ctx->callbacks.file_open(path, upload, &handle))) {
+        mender_log_error("Unable to open file '%s'", path);
+        return ret;
+    }
+    mender_troubleshoot_ctx->file_transfer.handle = handle;
+    mender_troubleshoot_ctx->file_transfer.upload = upload;
+
+    /* Save the session ID and allocate the chunk buffer */
+    if (NULL == (mender_troubleshoot_ctx->file_transfer.sid = mender_utils_strdup(sid))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+    if ((true != upload)
+        && (NULL
+            == (mender_troubleshoot_ctx->file_transfer.chunk = (uint8_t *)mender_utils_malloc(CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE)))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release the file transfer */
+    mender_troubleshoot_file_transfer_release();
+
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_send_chunks(void) {
+
+    mender_err_t ret = MENDER_OK;
+    size_t       length;
+
+    /* Send the chunks while the window is not full, the server acknowledges them while the next ones are in flight */
+    while (mender_troubleshoot_ctx->file_transfer.offset - mender_troubleshoot_ctx->file_transfer.acked
+           < (int64_t)CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_WINDOW * CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE) {
+
+        /* Read the next chunk, unless the previous one has not been sent yet */
+        if (true != mender_troubleshoot_ctx->file_transfer.pending) {
+            if (MENDER_OK
+                != (ret = mender_troubleshoot_ctx->callbacks.file_read(mender_troubleshoot_ctx->file_transfer.handle,
+                                                                  mender_troubleshoot_ctx->file_transfer.chunk,
+                                                                  CONFIG_MENDER_CLIENT_TROUBLESHOOT_FILE_TRANSFER_CHUNK_SIZE,
+                                                                  &mender_troubleshoot_ctx->file_transfer.length))) {
+                mender_log_error("Unable to read file");
+                break;
+            }
+        }
+        length = mender_troubleshoot_ctx->file_transfer.length;
+
+        /* Send the chunk, an empty chunk indicates the end of the file */
+        ret = mender_troubleshoot_file_transfer_send(MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_CHUNK,
+                                                     mender_troubleshoot_ctx->file_transfer.sid,
+                                                     &mender_troubleshoot_ctx->file_transfer.offset,
+                                                     (0 != length) ? mender_troubleshoot_ctx->file_transfer.chunk : NULL,
+                                                     length,
+                                                     false);
+        if (MENDER_BUSY == ret) {
+            /* The send queue is full, the chunk is kept and sent again from the same offset by the outbox work or at the next acknowledgment */
+            mender_troubleshoot_ctx->file_transfer.pending = true;
+            mender_scheduler_work_execute(mender_troubleshoot_ctx->outbox_work_handle);
+            ret = MENDER_OK;
+            break;
+        }
+        mender_troubleshoot_ctx->file_transfer.pending = false;
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to send chunk");
+            break;
+        }
+        if (0 == length) {
+            mender_log_info("File downloaded");
+            mender_troubleshoot_file_transfer_release();
+            break;
+        }
+        mender_troubleshoot_ctx->file_transfer.offset += length;
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_write_chunk(mender_troubleshoot_protomsg_t *protomsg) {
+
+    assert(NULL != protomsg);
+    assert(NULL != protomsg->protohdr);
+    mender_err_t ret = MENDER_OK;
+
+    /* Verify the chunk is the expected one */
+    if ((NULL != protomsg->protohdr->properties) && (NULL != protomsg->protohdr->properties->offset)
+        && (*protomsg->protohdr->properties->offset != mender_troubleshoot_ctx->file_transfer.offset)) {
+        mender_log_error("Unexpected chunk received at offset %lld", (long long)*protomsg->protohdr->properties->offset);
+        return MENDER_FAIL;
+    }
+
+    /* Check if the end of the file is reached */
+    if (NULL == protomsg->body) {
+
+        /* Close the file before acknowledging the end of the file, so that the server is notified if the last data can't be written */
+        ret = mender_troubleshoot_ctx->callbacks.file_close(mender_troubleshoot_ctx->file_transfer.handle);
+        mender_troubleshoot_ctx->file_transfer.handle = NULL;
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to close file");
+            return ret;
+        }
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_file_transfer_send(MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_ACK,
+                                                             mender_troubleshoot_ctx->file_transfer.sid,
+                                                             &mender_troubleshoot_ctx->file_transfer.offset,
+                                                             NULL,
+                                                             0,
+                                                             true))) {
+            mender_log_error("Unable to send acknowledgment");
+        } else {
+            mender_log_info("File uploaded");
+        }
+        mender_troubleshoot_file_transfer_release();
+
+        return ret;
+    }
+
+    /* Write the chunk */
+    if (MENDER_OK
+        != (ret = mender_troubleshoot_ctx->callbacks.file_write(
+                mender_troubleshoot_ctx->file_transfer.handle, (uint8_t *)protomsg->body, protomsg->body_length))) {
+        mender_log_error("Unable to write file");
+        return ret;
+    }
+    mender_troubleshoot_ctx->file_transfer.offset += protomsg->body_length;
+
+    /* Acknowledge the chunks received, the server keeps on sending the next ones of its window meanwhile */
+    if (++mender_troubleshoot_ctx->file_transfer.chunks >= MENDER_TROUBLESHOOT_FILE_TRANSFER_ACK_INTERVAL) {
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_file_transfer_send(MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_ACK,
+                                                             mender_troubleshoot_ctx->file_transfer.sid,
+                                                             &mender_troubleshoot_ctx->file_transfer.offset,
+                                                             NULL,
+                                                             0,
+                                                             true))) {
+            mender_log_error("Unable to send acknowledgment");
+            return ret;
+        }
+        mender_troubleshoot_ctx->file_transfer.chunks = 0;
+    }
+
+    return ret;
+}
+
+static void
+mender_troubleshoot_file_transfer_release(void) {
+
+    /* Close the file */
+    if (NULL != mender_troubleshoot_ctx->file_transfer.handle) {
+        if (MENDER_OK != mender_troubleshoot_ctx->callbacks.file_close(mender_troubleshoot_ctx->file_transfer.handle)) {
+            mender_log_error("Unable to close file");
+        }
+    }
+
+    /* Release memory */
+    if (NULL != mender_troubleshoot_ctx->file_transfer.sid) {
+        mender_utils_free(mender_troubleshoot_ctx->file_transfer.sid);
+    }
+    if (NULL != mender_troubleshoot_ctx->file_transfer.chunk) {
+        mender_utils_free(mender_troubleshoot_ctx->file_transfer.chunk);
+    }
+    memset(&mender_troubleshoot_ctx->file_transfer, 0, sizeof(mender_troubleshoot_file_transfer_t));
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_decode_request(mender_troubleshoot_protomsg_t *protomsg, char **path) {
+
+    assert(NULL != protomsg);
+    assert(NULL != path);
+    mender_err_t   ret = MENDER_FAIL;
+    msgpack_object object;
+
+    /* Verify integrity of the message */
+    if (NULL == protomsg->body) {
+        mender_log_error("Invalid message received");
+        return MENDER_FAIL;
+    }
+
+    /* Unpack the request */
+    if ((MSGPACK_UNPACK_SUCCESS != msgpack_unpack(protomsg->body, protomsg->body_length, NULL, &mender_troubleshoot_ctx->zone, &object))
+        || (MSGPACK_OBJECT_MAP != object.type)) {
+        mender_log_error("Unable to unpack the request");
+        goto END;
+    }
+
+    /* Retrieve the path of the file */
+    for (msgpack_object_kv *p = object.via.map.ptr; p < object.via.map.ptr + object.via.map.size; ++p) {
+        if ((MSGPACK_OBJECT_STR == p->key.type) && (strlen("path") == p->key.via.str.size)
+            && (!strncmp(p->key.via.str.ptr, "path", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type) && (0 != p->val.via.str.size)) {
+            if (NULL == (*path = (char *)mender_utils_malloc(p->val.via.str.size + 1))) {
+                mender_log_error("Unable to allocate memory");
+                goto END;
+            }
+            memcpy(*path, p->val.via.str.ptr, p->val.via.str.size);
+            (*path)[p->val.via.str.size] = '\0';
+            ret                          = MENDER_OK;
+            break;
+        }
+    }
+    if (NULL == *path) {
+        mender_log_error("Invalid request, path of the file not found");
+    }
+
+END:
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_send(const char *typ, char *sid, int64_t *offset, uint8_t *data, size_t length, bool keep) {
+
+    assert(NULL != typ);
+    assert(NULL != sid);
+    mender_err_t   ret;
+    msgpack_packer packer;
+
+    /* Pack the message, the sbuffer keeps the memory of the previous messages */
+    mender_troubleshoot_ctx->file_transfer_sbuffer.size = 0;
+    msgpack_packer_init(&packer, &mender_troubleshoot_ctx->file_transfer_sbuffer, mender_troubleshoot_sbuffer_write);
+    if (MENDER_OK != (ret = mender_troubleshoot_file_transfer_pack_header(&packer, typ, sid, offset, (NULL != data)))) {
+        mender_log_error("Unable to encode message");
+        return ret;
+    }
+    if ((NULL != data) && ((0 != mender_troubleshoot_pack_string(&packer, "body")) || (0 != msgpack_pack_bin(&packer, length)))) {
+        mender_log_error("Unable to pack the body");
+        return MENDER_FAIL;
+    }
+
+    /* Send message, the data of the chunk follows the header */
+    msgpack_sbuffer           *sbuffer    = &mender_troubleshoot_ctx->file_transfer_sbuffer;
+    mender_websocket_segment_t segments[] = { { .data = sbuffer->data, .length = sbuffer->size }, { .data = data, .length = length } };
+    if ((MENDER_OK != (ret = mender_troubleshoot_send_v(segments, ((NULL != data) && (0 != length)) ? 2 : 1, keep))) && (MENDER_BUSY != ret)) {
+        mender_log_error("Unable to send message");
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_send_file_info(char *sid, char *path, size_t size) {
+
+    assert(NULL != sid);
+    assert(NULL != path);
+    mender_err_t    ret = MENDER_OK;
+    msgpack_sbuffer sbuffer;
+    msgpack_packer  packer;
+
+    /* Pack the file information, it is the body of the message */
+    msgpack_sbuffer_init(&sbuffer);
+    msgpack_packer_init(&packer, &sbuffer, mender_troubleshoot_sbuffer_write);
+    if ((0 != msgpack_pack_map(&packer, 2)) || (0 != mender_troubleshoot_pack_string(&packer, "path")) || (0 != mender_troubleshoot_pack_string(&packer, path))
+        || (0 != mender_troubleshoot_pack_string(&packer, "size")) || (0 != msgpack_pack_int64(&packer, (int64_t)size))) {
+        mender_log_error("Unable to pack the file information");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Send message */
+    ret = mender_troubleshoot_file_transfer_send(
+        MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_FILE_INFO, sid, NULL, (uint8_t *)sbuffer.data, sbuffer.size, true);
+
+END:
+
+    /* Release memory */
+    mender_utils_free(sbuffer.data);
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_send_error(char *sid, char *typ, const char *err) {
+
+    assert(NULL != sid);
+    assert(NULL != typ);
+    mender_err_t    ret = MENDER_OK;
+    msgpack_sbuffer sbuffer;
+    msgpack_packer  packer;
+
+    /* Pack the error, it is the body of the message */
+    msgpack_sbuffer_init(&sbuffer);
+    msgpack_packer_init(&packer, &sbuffer, mender_troubleshoot_sbuffer_write);
+    if ((0 != msgpack_pack_map(&packer, 2)) || (0 != mender_troubleshoot_pack_string(&packer, "err"))
+        || (0 != mender_troubleshoot_pack_string(&packer, (NULL != err) ? err : "Internal error")) || (0 != mender_troubleshoot_pack_string(&packer, "msgtype"))
+        || (0 != mender_troubleshoot_pack_string(&packer, typ))) {
+        mender_log_error("Unable to pack the error");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Send message */
+    ret = mender_troubleshoot_file_transfer_send(MENDER_TROUBLESHOOT_MESSAGE_TYPE_FILE_TRANSFER_ERROR, sid, NULL, (uint8_t *)sbuffer.data, sbuffer.size, true);
+
+END:
+
+    /* Release memory */
+    mender_utils_free(sbuffer.data);
+
+    return ret;
+}
+
+static mender_err_t
+mender_troubleshoot_file_transfer_pack_header(msgpack_packer *packer, const char *typ, char *sid, int64_t *offset, bool body) {
+
+    assert(NULL != packer);
+    assert(NULL != typ);
+    assert(NULL != sid);
+
+    /* Pack the header, same layout as the Proto messages encoded */
+    if ((0 != msgpack_pack_map(packer, (true == body) ? 2 : 1)) || (0 != mender_troubleshoot_pack_string(packer, "hdr"))
+        || (0 != msgpack_pack_map(packer, (NULL != offset) ? 4 : 3)) || (0 != mender_troubleshoot_pack_string(packer, "proto"))
+        || (0 != msgpack_pack_uint16(packer, MENDER_TROUBLESHOOT_PROTO_TYPE_FILE_TRANSFER)) || (0 != mender_troubleshoot_pack_string(packer, "typ"))
+        || (0 != mender_troubleshoot_pack_string(packer, typ)) || (0 != mender_troubleshoot_pack_string(packer, "sid"))
+        || (0 != mender_troubleshoot_pack_string(packer, sid))) {
+        mender_log_error("Unable to pack the header");
+        return MENDER_FAIL;
+    }
+
+    /* Pack the offset property */
+    if ((NULL != offset)
+        && ((0 != mender_troubleshoot_pack_string(packer, "props")) || (0 != msgpack_pack_map(packer, 1))
+            || (0 != mender_troubleshoot_pack_string(packer, "offset")) || (0 != msgpack_pack_int64(packer, *offset)))) {
+        mender_log_error("Unable to pack the header");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_troubleshoot_port_forward_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
+
+    assert(NULL != protomsg);
+    assert(NULL != protomsg->protohdr);
+    mender_err_t                        ret          = MENDER_OK;
+    mender_troubleshoot_port_forward_t *port_forward = NULL;
+    char                               *host         = NULL;
+    uint16_t                            port         = 0;
+    bool                                udp          = false;
+    void                               *handle;
+
+    /* Verify integrity of the message */
+    if ((NULL == protomsg->protohdr->typ) || (NULL == protomsg->protohdr->sid) || (NULL == protomsg->protohdr->properties)
+        || (NULL == protomsg->protohdr->properties->connection_id)) {
+        mender_log_error("Invalid message received");
+        return MENDER_FAIL;
+    }
+
+    /* Take mutex used to protect access to the port forward sessions */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_troubleshoot_ctx->port_forward_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Treatment of the message depending of the message type */
+    if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_NEW)) {
+
+        /* Decode the request */
+        if (MENDER_OK != (ret = mender_troubleshoot_port_forward_decode_request(protomsg, &host, &port, &udp))) {
+            mender_log_error("Invalid message received");
+            goto FAIL;
+        }
+
+        /* Check if the port forward is supported */
+        if ((NULL == mender_troubleshoot_ctx->callbacks.port_forward_connect) || (NULL == mender_troubleshoot_ctx->callbacks.port_forward_write)
+            || (NULL == mender_troubleshoot_ctx->callbacks.port_forward_close)) {
+            mender_log_error("Port forward is not supported");
+            ret = MENDER_NOT_IMPLEMENTED;
+            goto FAIL;
+        }
+
+        /* Retrieve a free port forward session */
+        if (NULL == (port_forward = mender_troubleshoot_port_forward_find(NULL, NULL, NULL))) {
+            mender_log_error("Too many port forward sessions opened");
+            ret = MENDER_FAIL;
+            goto FAIL;
+        }
+
+        /* Save the session and preallocate the buffer used to pack the messages */
+        if ((NULL == (port_forward->sid = mender_utils_strdup(protomsg->protohdr->sid)))
+            || (NULL == (port_forward->connection_id = mender_utils_strdup(protomsg->protohdr->properties->connection_id)))
+            || (NULL == (port_forward->sbuffer.data = (char *)mender_utils_malloc(MENDER_TROUBLESHOOT_PORT_FORWARD_SBUFFER_SIZE)))) {
             mender_log_error("Unable to allocate memory");
+            mender_troubleshoot_port_forward_release(port_forward);
             ret = MENDER_FAIL;
             goto FAIL;
         }
+        port_forward->sbuffer.alloc = MENDER_TROUBLESHOOT_PORT_FORWARD_SBUFFER_SIZE;
 
-        /* Format acknowledgment */
-        if (MENDER_OK
-            != (ret
-                = mender_troubleshoot_format_acknowledgment(protomsg,
-                                                            mender_troubleshoot_shell_sid,
-                                                            (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL : MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR,
-                                                            response))) {
-            mender_log_error("Unable to format response");
+        /* Connect to the local service */
+        mender_log_info("Starting a new port forward session to %s:%u/%s", host, port, (true == udp) ? "udp" : "tcp");
+        if (MENDER_OK != (ret = mender_troubleshoot_ctx->callbacks.port_forward_connect(host, port, udp, &handle))) {
+            mender_log_error("Unable to connect to the local service");
+            mender_troubleshoot_port_forward_release(port_forward);
             goto FAIL;
         }
+        port_forward->handle = handle;
 
-        /* Invoke shell begin callback */
-        if (NULL != mender_troubleshoot_callbacks.shell_begin) {
-            if ((NULL != protomsg->protohdr->properties) && (NULL != protomsg->protohdr->properties->terminal_width)
-                && (NULL != protomsg->protohdr->properties->terminal_height)) {
-                ret = mender_troubleshoot_callbacks.shell_begin(*protomsg->protohdr->properties->terminal_width,
-                                                                *protomsg->protohdr->properties->terminal_height);
-            } else {
-                ret = mender_troubleshoot_callbacks.shell_begin(0, 0);
-            }
-            if (MENDER_OK != ret) {
-                mender_log_error("An error occured");
-                goto FAIL;
-            }
+        /* Acknowledge the new session */
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_port_forward_send_protomsg(port_forward, MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_NEW, NULL, 0, true))) {
+            mender_log_error("Unable to send message");
+            mender_troubleshoot_ctx->callbacks.port_forward_close(port_forward->handle);
+            mender_troubleshoot_port_forward_release(port_forward);
+            goto END;
         }
 
-    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_STOP)) {
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_STOP)) {
 
-        /* Check is a session is already opened */
-        if (NULL == mender_troubleshoot_shell_sid) {
-            mender_log_warning("No shell session opened");
+        /* Retrieve the port forward session */
+        if (NULL == (port_forward = mender_troubleshoot_port_forward_find(protomsg->protohdr->sid, protomsg->protohdr->properties->connection_id, NULL))) {
+            mender_log_warning("No port forward session opened");
             goto END;
         }
 
-        /* Stop shell session */
-        mender_log_info("Stopping current shell session");
+        /* Stop port forward session */
+        mender_log_info("Stopping port forward session");
+        if (MENDER_OK != mender_troubleshoot_ctx->callbacks.port_forward_close(port_forward->handle)) {
+            mender_log_error("Unable to disconnect from the local service");
+        }
+        if (MENDER_OK
+            != (ret = mender_troubleshoot_port_forward_send_protomsg(port_forward, MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_STOP, NULL, 0, true))) {
+            mender_log_error("Unable to send message");
+        }
+        mender_troubleshoot_port_forward_release(port_forward);
 
-        /* Invoke shell end callback */
-        if (NULL != mender_troubleshoot_callbacks.shell_end) {
-            if (MENDER_OK != (ret = mender_troubleshoot_callbacks.shell_end())) {
-                mender_log_error("An error occured");
-            }
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_FORWARD)) {
+
+        /* Retrieve the port forward session */
+        if (NULL == (port_forward = mender_troubleshoot_port_forward_find(protomsg->protohdr->sid, protomsg->protohdr->properties->connection_id, NULL))) {
+            mender_log_error("No port forward session opened");
+            ret = MENDER_FAIL;
+            goto FAIL;
         }
 
-        /* Format acknowledgment */
+        /* Invoke port forward write callback, then acknowledge the data */
+        if (NULL != protomsg->body) {
+            if (MENDER_OK
+                != (ret = mender_troubleshoot_ctx->callbacks.port_forward_write(port_forward->handle, (uint8_t *)protomsg->body, protomsg->body_length))) {
+                mender_log_error("Unable to write data to the local service");
+                goto FAIL;
+            }
+        }
         if (MENDER_OK
-            != (ret
-                = mender_troubleshoot_format_acknowledgment(protomsg,
-                                                            mender_troubleshoot_shell_sid,
-                                                            (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL : MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR,
-                                                            response))) {
-            mender_log_error("Unable to format response");
+            != (ret = mender_troubleshoot_port_forward_send_protomsg(port_forward, MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_ACK, NULL, 0, true))) {
+            mender_log_error("Unable to send message");
+            goto END;
         }
 
-        /* Release session ID */
-        if (NULL != mender_troubleshoot_shell_sid) {
-            free(mender_troubleshoot_shell_sid);
-            mender_troubleshoot_shell_sid = NULL;
-        }
+    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_PORT_FORWARD_ACK)) {
+
+        /* Nothing to do */
 
     } else {
 
@@ -777,72 +2385,191 @@ mender_troubleshoot_shell_message_handler(mender_troubleshoot_protomsg_t *protom
 
 END:
 
+    /* Release mutex used to protect access to the port forward sessions */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->port_forward_mutex);
+
+    /* Release memory */
+    if (NULL != host) {
+        mender_utils_free(host);
+    }
+
     return ret;
 
 FAIL:
 
+    /* Release mutex used to protect access to the port forward sessions */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->port_forward_mutex);
+
+    /* Format acknowledgment, the server is notified of the failure */
+    if (MENDER_OK == mender_troubleshoot_format_acknowledgment(protomsg, protomsg->protohdr->sid, MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR, response)) {
+        if (NULL == ((*response)->protohdr->properties->connection_id = mender_utils_strdup(protomsg->protohdr->properties->connection_id))) {
+            mender_log_error("Unable to allocate memory");
+            mender_troubleshoot_release_protomsg(*response);
+            *response = NULL;
+        }
+    }
+
+    /* Release memory */
+    if (NULL != host) {
+        mender_utils_free(host);
+    }
+
     return ret;
 }
 
 static mender_err_t
-mender_troubleshoot_mender_client_message_handler(mender_troubleshoot_protomsg_t *protomsg, mender_troubleshoot_protomsg_t **response) {
+mender_troubleshoot_port_forward_decode_request(mender_troubleshoot_protomsg_t *protomsg, char **host, uint16_t *port, bool *udp) {
 
     assert(NULL != protomsg);
-    assert(NULL != protomsg->protohdr);
-    mender_err_t ret = MENDER_OK;
+    assert(NULL != host);
+    assert(NULL != port);
+    assert(NULL != udp);
+    mender_err_t   ret = MENDER_OK;
+    msgpack_object object;
 
     /* Verify integrity of the message */
-    if (NULL == protomsg->protohdr->typ) {
+    if (NULL == protomsg->body) {
         mender_log_error("Invalid message received");
+        return MENDER_FAIL;
+    }
+
+    /* Unpack the request */
+    if ((MSGPACK_UNPACK_SUCCESS != msgpack_unpack(protomsg->body, protomsg->body_length, NULL, &mender_troubleshoot_ctx->zone, &object))
+        || (MSGPACK_OBJECT_MAP != object.type)) {
+        mender_log_error("Unable to unpack the request");
         ret = MENDER_FAIL;
         goto END;
     }
 
-    /* Treatment of the message depending of the message type */
-    if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_MENDER_CLIENT_CHECK_UPDATE)) {
-
-        /* Trigger execution of the mender-client update work */
-        ret = mender_client_execute();
-
-        /* Format acknowledgment */
-        if (MENDER_OK
-            != (ret = mender_troubleshoot_format_acknowledgment(
-                    protomsg, NULL, (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL : MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR, response))) {
-            mender_log_error("Unable to format response");
-            goto FAIL;
+    /* Retrieve the remote host, port and protocol */
+    for (msgpack_object_kv *p = object.via.map.ptr; p < object.via.map.ptr + object.via.map.size; ++p) {
+        if (MSGPACK_OBJECT_STR != p->key.type) {
+            continue;
+        }
+        if ((strlen("remote_host") == p->key.via.str.size) && (!strncmp(p->key.via.str.ptr, "remote_host", p->key.via.str.size))
+            && (MSGPACK_OBJECT_STR == p->val.type) && (NULL == *host)) {
+            if (NULL == (*host = (char *)mender_utils_malloc(p->val.via.str.size + 1))) {
+                mender_log_error("Unable to allocate memory");
+                ret = MENDER_FAIL;
+                goto END;
+            }
+            memcpy(*host, p->val.via.str.ptr, p->val.via.str.size);
+            (*host)[p->val.via.str.size] = '\0';
+        } else if ((strlen("remote_port") == p->key.via.str.size) && (!strncmp(p->key.via.str.ptr, "remote_port", p->key.via.str.size))
+                   && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type) && (p->val.via.u64 <= UINT16_MAX)) {
+            *port = (uint16_t)p->val.via.u64;
+        } else if ((strlen("protocol") == p->key.via.str.size) && (!strncmp(p->key.via.str.ptr, "protocol", p->key.via.str.size))
+                   && (MSGPACK_OBJECT_STR == p->val.type)) {
+            *udp = ((strlen("udp") == p->val.via.str.size) && (!strncmp(p->val.via.str.ptr, "udp", p->val.via.str.size)));
         }
+    }
+    if ((NULL == *host) || (0 == *port)) {
+        mender_log_error("Invalid request, remote host or port not found");
+        ret = MENDER_FAIL;
+    }
 
-#ifdef CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY
+END:
 
-    } else if (!strcmp(protomsg->protohdr->typ, MENDER_TROUBLESHOOT_MESSAGE_TYPE_MENDER_CLIENT_SEND_INVENTORY)) {
+    return ret;
+}
 
-        /* Trigger execution of the mender-inventory work */
-        ret = mender_inventory_execute();
+static mender_troubleshoot_port_forward_t *
+mender_troubleshoot_port_forward_find(char *sid, char *connection_id, void *handle) {
 
-        /* Format acknowledgment */
-        if (MENDER_OK
-            != (ret = mender_troubleshoot_format_acknowledgment(
-                    protomsg, NULL, (MENDER_OK == ret) ? MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL : MENDER_TROUBLESHOOT_STATUS_TYPE_ERROR, response))) {
-            mender_log_error("Unable to format response");
-            goto FAIL;
+    /* Search the port forward session, a free session is returned if no session ID and no handle are given */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_MAX_SESSIONS; index++) {
+        mender_troubleshoot_port_forward_t *port_forward = &mender_troubleshoot_ctx->port_forwards[index];
+        if (NULL != handle) {
+            if ((NULL != port_forward->sid) && (handle == port_forward->handle)) {
+                return port_forward;
+            }
+        } else if (NULL != sid) {
+            if ((NULL != port_forward->sid) && (!strcmp(sid, port_forward->sid)) && (!strcmp(connection_id, port_forward->connection_id))) {
+                return port_forward;
+            }
+        } else if (NULL == port_forward->sid) {
+            return port_forward;
         }
+    }
 
-#endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
+    return NULL;
+}
 
-    } else {
+static mender_err_t
+mender_troubleshoot_port_forward_send_protomsg(mender_troubleshoot_port_forward_t *port_forward, const char *typ, uint8_t *data, size_t length, bool keep) {
+
+    assert(NULL != port_forward);
+    assert(NULL != typ);
+    mender_err_t   ret;
+    msgpack_packer packer;
+
+    /* Pack the message in the preallocated buffer of the session */
+    port_forward->sbuffer.size = 0;
+    msgpack_packer_init(&packer, &port_forward->sbuffer, mender_troubleshoot_sbuffer_write);
+    if ((0 != msgpack_pack_map(&packer, (NULL != data) ? 2 : 1)) || (0 != mender_troubleshoot_pack_string(&packer, "hdr"))
+        || (0 != msgpack_pack_map(&packer, 4)) || (0 != mender_troubleshoot_pack_string(&packer, "proto"))
+        || (0 != msgpack_pack_uint16(&packer, MENDER_TROUBLESHOOT_PROTO_TYPE_PORT_FORWARD)) || (0 != mender_troubleshoot_pack_string(&packer, "typ"))
+        || (0 != mender_troubleshoot_pack_string(&packer, typ)) || (0 != mender_troubleshoot_pack_string(&packer, "sid"))
+        || (0 != mender_troubleshoot_pack_string(&packer, port_forward->sid)) || (0 != mender_troubleshoot_pack_string(&packer, "props"))
+        || (0 != msgpack_pack_map(&packer, 1)) || (0 != mender_troubleshoot_pack_string(&packer, "connection_id"))
+        || (0 != mender_troubleshoot_pack_string(&packer, port_forward->connection_id))) {
+        mender_log_error("Unable to pack the header");
+        return MENDER_FAIL;
+    }
+    if ((NULL != data) && ((0 != mender_troubleshoot_pack_string(&packer, "body")) || (0 != msgpack_pack_bin(&packer, length)))) {
+        mender_log_error("Unable to pack the body");
+        return MENDER_FAIL;
+    }
+
+    /* Send message, the data follows the header */
+    mender_websocket_segment_t segments[]
+        = { { .data = port_forward->sbuffer.data, .length = port_forward->sbuffer.size }, { .data = data, .length = length } };
+    if ((MENDER_OK != (ret = mender_troubleshoot_send_v(segments, ((NULL != data) && (0 != length)) ? 2 : 1, keep))) && (MENDER_BUSY != ret)) {
+        mender_log_error("Unable to send message");
+    }
 
-        mender_log_error("Unsupported message received with message type '%s'", protomsg->protohdr->typ);
-        ret = MENDER_FAIL;
-        goto FAIL;
+    return ret;
+}
+
+static void
+mender_troubleshoot_port_forward_release(mender_troubleshoot_port_forward_t *port_forward) {
+
+    assert(NULL != port_forward);
+
+    /* Release memory */
+    if (NULL != port_forward->sid) {
+        mender_utils_free(port_forward->sid);
+    }
+    if (NULL != port_forward->connection_id) {
+        mender_utils_free(port_forward->connection_id);
     }
+    if (NULL != port_forward->sbuffer.data) {
+        mender_utils_free(port_forward->sbuffer.data);
+    }
+    memset(port_forward, 0, sizeof(mender_troubleshoot_port_forward_t));
+}
 
-END:
+static void
+mender_troubleshoot_port_forward_close_all(void) {
 
-    return ret;
+    /* Take mutex used to protect access to the port forward sessions */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_troubleshoot_ctx->port_forward_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return;
+    }
 
-FAIL:
+    /* Disconnect from the local services and release the sessions */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_TROUBLESHOOT_PORT_FORWARD_MAX_SESSIONS; index++) {
+        if (NULL != mender_troubleshoot_ctx->port_forwards[index].sid) {
+            if (MENDER_OK != mender_troubleshoot_ctx->callbacks.port_forward_close(mender_troubleshoot_ctx->port_forwards[index].handle)) {
+                mender_log_error("Unable to disconnect from the local service");
+            }
+            mender_troubleshoot_port_forward_release(&mender_troubleshoot_ctx->port_forwards[index]);
+        }
+    }
 
-    return ret;
+    /* Release mutex used to protect access to the port forward sessions */
+    mender_scheduler_mutex_give(mender_troubleshoot_ctx->port_forward_mutex);
 }
 
 static mender_err_t
@@ -856,39 +2583,42 @@ mender_troubleshoot_format_acknowledgment(mender_troubleshoot_protomsg_t
     mender_err_t ret = MENDER_OK;
 
     /* Format acknowledgment message */
-    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (*response = (mender_troubleshoot_protomsg_t *)mender_utils_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(*response, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == ((*response)->protohdr = (mender_troubleshoot_protohdr_t *)malloc(sizeof(mender_troubleshoot_protohdr_t)))) {
+    if (NULL == ((*response)->protohdr = (mender_troubleshoot_protohdr_t *)mender_utils_malloc(sizeof(mender_troubleshoot_protohdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->protohdr, 0, sizeof(mender_troubleshoot_protohdr_t));
     (*response)->protohdr->proto = protomsg->protohdr->proto;
-    if (NULL == ((*response)->protohdr->typ = strdup(protomsg->protohdr->typ))) {
+    if (NULL == ((*response)->protohdr->typ = mender_utils_strdup(protomsg->protohdr->typ))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     if (NULL != sid) {
-        if (NULL == ((*response)->protohdr->sid = strdup(sid))) {
+        if (NULL == ((*response)->protohdr->sid = mender_utils_strdup(sid))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
         }
     }
-    if (NULL == ((*response)->protohdr->properties = (mender_troubleshoot_protohdr_properties_t *)malloc(sizeof(mender_troubleshoot_protohdr_properties_t)))) {
+    if (NULL
+        == ((*response)->protohdr->properties
+            = (mender_troubleshoot_protohdr_properties_t *)mender_utils_malloc(sizeof(mender_troubleshoot_protohdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset((*response)->protohdr->properties, 0, sizeof(mender_troubleshoot_protohdr_properties_t));
     if (NULL
-        == ((*response)->protohdr->properties->status = (mender_troubleshoot_properties_status_t *)malloc(sizeof(mender_troubleshoot_properties_status_t)))) {
+        == ((*response)->protohdr->properties->status
+            = (mender_troubleshoot_properties_status_t *)mender_utils_malloc(sizeof(mender_troubleshoot_properties_status_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -907,7 +2637,7 @@ FAIL:
 }
 
 static mender_err_t
-mender_troubleshoot_send_shell_ping_protomsg(void) {
+mender_troubleshoot_send_shell_ping_protomsg(uint32_t timeout) {
 
     mender_troubleshoot_protomsg_t *protomsg = NULL;
     mender_err_t                    ret      = MENDER_OK;
@@ -915,42 +2645,46 @@ mender_troubleshoot_send_shell_ping_protomsg(void) {
     size_t                          length   = 0;
 
     /* Send shell ping message */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)mender_utils_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == (protomsg->protohdr = (mender_troubleshoot_protohdr_t *)malloc(sizeof(mender_troubleshoot_protohdr_t)))) {
+    if (NULL == (protomsg->protohdr = (mender_troubleshoot_protohdr_t *)mender_utils_malloc(sizeof(mender_troubleshoot_protohdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg->protohdr, 0, sizeof(mender_troubleshoot_protohdr_t));
     protomsg->protohdr->proto = MENDER_TROUBLESHOOT_PROTO_TYPE_SHELL;
-    if (NULL == (protomsg->protohdr->typ = strdup(MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_PING))) {
+    if (NULL == (protomsg->protohdr->typ = mender_utils_strdup(MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_PING))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL == (protomsg->protohdr->sid = strdup(mender_troubleshoot_shell_sid))) {
+    if (NULL == (protomsg->protohdr->sid = mender_utils_strdup(mender_troubleshoot_ctx->shell_sid))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL == (protomsg->protohdr->properties = (mender_troubleshoot_protohdr_properties_t *)malloc(sizeof(mender_troubleshoot_protohdr_properties_t)))) {
+    if (NULL
+        == (protomsg->protohdr->properties
+            = (mender_troubleshoot_protohdr_properties_t *)mender_utils_malloc(sizeof(mender_troubleshoot_protohdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg->protohdr->properties, 0, sizeof(mender_troubleshoot_protohdr_properties_t));
-    if (NULL == (protomsg->protohdr->properties->timeout = (uint32_t *)malloc(sizeof(uint32_t)))) {
+    if (NULL == (protomsg->protohdr->properties->timeout = (uint32_t *)mender_utils_malloc(sizeof(uint32_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    *protomsg->protohdr->properties->timeout = 2 * CONFIG_MENDER_CLIENT_TROUBLESHOOT_HEALTHCHECK_INTERVAL;
-    if (NULL == (protomsg->protohdr->properties->status = (mender_troubleshoot_properties_status_t *)malloc(sizeof(mender_troubleshoot_properties_status_t)))) {
+    *protomsg->protohdr->properties->timeout = timeout;
+    if (NULL
+        == (protomsg->protohdr->properties->status
+            = (mender_troubleshoot_properties_status_t *)mender_utils_malloc(sizeof(mender_troubleshoot_properties_status_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -963,8 +2697,9 @@ mender_troubleshoot_send_shell_ping_protomsg(void) {
         goto FAIL;
     }
 
-    /* Send message */
-    if (MENDER_OK != (ret = mender_api_troubleshoot_send(mender_troubleshoot_handle, payload, length))) {
+    /* Send message, it is kept in the outbox if the send queue is full */
+    mender_websocket_segment_t segment = { .data = payload, .length = length };
+    if (MENDER_OK != (ret = mender_troubleshoot_send_v(&segment, 1, true))) {
         mender_log_error("Unable to send message");
         goto FAIL;
     }
@@ -974,7 +2709,7 @@ FAIL:
     /* Release memory */
     mender_troubleshoot_release_protomsg(protomsg);
     if (NULL != payload) {
-        free(payload);
+        mender_utils_free(payload);
     }
 
     return ret;
@@ -989,36 +2724,40 @@ mender_troubleshoot_send_shell_stop_protomsg(void) {
     size_t                          length   = 0;
 
     /* Send shell stop message */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)mender_utils_malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
-    if (NULL == (protomsg->protohdr = (mender_troubleshoot_protohdr_t *)malloc(sizeof(mender_troubleshoot_protohdr_t)))) {
+    if (NULL == (protomsg->protohdr = (mender_troubleshoot_protohdr_t *)mender_utils_malloc(sizeof(mender_troubleshoot_protohdr_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg->protohdr, 0, sizeof(mender_troubleshoot_protohdr_t));
     protomsg->protohdr->proto = MENDER_TROUBLESHOOT_PROTO_TYPE_SHELL;
-    if (NULL == (protomsg->protohdr->typ = strdup(MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_STOP))) {
+    if (NULL == (protomsg->protohdr->typ = mender_utils_strdup(MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_STOP))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL == (protomsg->protohdr->sid = strdup(mender_troubleshoot_shell_sid))) {
+    if (NULL == (protomsg->protohdr->sid = mender_utils_strdup(mender_troubleshoot_ctx->shell_sid))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
-    if (NULL == (protomsg->protohdr->properties = (mender_troubleshoot_protohdr_properties_t *)malloc(sizeof(mender_troubleshoot_protohdr_properties_t)))) {
+    if (NULL
+        == (protomsg->protohdr->properties
+            = (mender_troubleshoot_protohdr_properties_t *)mender_utils_malloc(sizeof(mender_troubleshoot_protohdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
     memset(protomsg->protohdr->properties, 0, sizeof(mender_troubleshoot_protohdr_properties_t));
-    if (NULL == (protomsg->protohdr->properties->status = (mender_troubleshoot_properties_status_t *)malloc(sizeof(mender_troubleshoot_properties_status_t)))) {
+    if (NULL
+        == (protomsg->protohdr->properties->status
+            = (mender_troubleshoot_properties_status_t *)mender_utils_malloc(sizeof(mender_troubleshoot_properties_status_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -1031,8 +2770,9 @@ mender_troubleshoot_send_shell_stop_protomsg(void) {
         goto FAIL;
     }
 
-    /* Send message */
-    if (MENDER_OK != (ret = mender_api_troubleshoot_send(mender_troubleshoot_handle, payload, length))) {
+    /* Send message, it is kept in the outbox if the send queue is full */
+    mender_websocket_segment_t segment = { .data = payload, .length = length };
+    if (MENDER_OK != (ret = mender_troubleshoot_send_v(&segment, 1, true))) {
         mender_log_error("Unable to send message");
         goto FAIL;
     }
@@ -1042,7 +2782,7 @@ FAIL:
     /* Release memory */
     mender_troubleshoot_release_protomsg(protomsg);
     if (NULL != payload) {
-        free(payload);
+        mender_utils_free(payload);
     }
 
     return ret;
@@ -1053,44 +2793,27 @@ mender_troubleshoot_unpack_protomsg(void *data, size_t length) {
 
     assert(NULL != data);
     mender_troubleshoot_protomsg_t *protomsg;
-    msgpack_zone                    zone;
     msgpack_object                  object;
 
-    /* Initialize msgpack zone */
-    if (true != msgpack_zone_init(&zone, MENDER_TROUBLESHOOT_ZONE_CHUNK_INIT_SIZE)) {
-        mender_log_error("Unable to initialize msgpack zone");
-        return NULL;
-    }
-
     /* Unpack the message */
-    if (MSGPACK_UNPACK_SUCCESS != msgpack_unpack((const char *)data, length, NULL, &zone, &object)) {
+    if (MSGPACK_UNPACK_SUCCESS != msgpack_unpack((const char *)data, length, NULL, &mender_troubleshoot_ctx->zone, &object)) {
         mender_log_error("Unable to unpack the message");
-        goto FAIL;
+        return NULL;
     }
 
     /* Check object type */
     if ((MSGPACK_OBJECT_MAP != object.type) || (0 == object.via.map.size)) {
         mender_log_error("Invalid protomsg object");
-        goto FAIL;
+        return NULL;
     }
 
     /* Decode protomsg */
     if (NULL == (protomsg = mender_troubleshoot_decode_protomsg(&object))) {
         mender_log_error("Invalid protomsg object");
-        goto FAIL;
+        return NULL;
     }
 
-    /* Release memory */
-    msgpack_zone_destroy(&zone);
-
     return protomsg;
-
-FAIL:
-
-    /* Release memory */
-    msgpack_zone_destroy(&zone);
-
-    return NULL;
 }
 
 static mender_troubleshoot_protomsg_t *
@@ -1100,11 +2823,10 @@ mender_troubleshoot_decode_protomsg(msgpack_object *object) {
     mender_troubleshoot_protomsg_t *protomsg;
 
     /* Create protomsg */
-    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)malloc(sizeof(mender_troubleshoot_protomsg_t)))) {
+    if (NULL == (protomsg = (mender_troubleshoot_protomsg_t *)mender_troubleshoot_zone_calloc(sizeof(mender_troubleshoot_protomsg_t)))) {
         mender_log_error("Unable to allocate memory");
         return NULL;
     }
-    memset(protomsg, 0, sizeof(mender_troubleshoot_protomsg_t));
 
     /* Parse protomsg */
     msgpack_object_kv *p = object->via.map.ptr;
@@ -1113,40 +2835,33 @@ mender_troubleshoot_decode_protomsg(msgpack_object *object) {
             && (0 != p->val.via.map.size)) {
             if (NULL == (protomsg->protohdr = mender_troubleshoot_decode_protohdr(&p->val))) {
                 mender_log_error("Invalid protomsg object");
-                goto FAIL;
+                return NULL;
             }
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "body", p->key.via.str.size)) && (MSGPACK_OBJECT_BIN == p->val.type)
                    && (0 != p->val.via.bin.size)) {
             if (NULL == (protomsg->body = mender_troubleshoot_decode_body(&p->val))) {
                 mender_log_error("Invalid protomsg object");
-                goto FAIL;
+                return NULL;
             }
+            protomsg->body_length = p->val.via.bin.size;
         }
         ++p;
     } while (p < object->via.map.ptr + object->via.map.size);
 
     return protomsg;
-
-FAIL:
-
-    /* Release memory */
-    mender_troubleshoot_release_protomsg(protomsg);
-
-    return NULL;
 }
 
 static mender_troubleshoot_protohdr_t *
 mender_troubleshoot_decode_protohdr(msgpack_object *object) {
 
     assert(NULL != object);
-    mender_troubleshoot_protohdr_t *protohdr = NULL;
+    mender_troubleshoot_protohdr_t *protohdr;
 
     /* Create protohdr */
-    if (NULL == (protohdr = (mender_troubleshoot_protohdr_t *)malloc(sizeof(mender_troubleshoot_protohdr_t)))) {
+    if (NULL == (protohdr = (mender_troubleshoot_protohdr_t *)mender_troubleshoot_zone_calloc(sizeof(mender_troubleshoot_protohdr_t)))) {
         mender_log_error("Unable to allocate memory");
         return NULL;
     }
-    memset(protohdr, 0, sizeof(mender_troubleshoot_protohdr_t));
 
     /* Parse protohdr */
     msgpack_object_kv *p = object->via.map.ptr;
@@ -1155,124 +2870,136 @@ mender_troubleshoot_decode_protohdr(msgpack_object *object) {
             && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
             protohdr->proto = (mender_troubleshoot_protohdr_type_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "typ", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (protohdr->typ = (char *)malloc(p->val.via.str.size + 1))) {
+            if (NULL == (protohdr->typ = mender_troubleshoot_decode_string(&p->val))) {
                 mender_log_error("Unable to allocate memory");
-                goto FAIL;
+                return NULL;
             }
-            memcpy(protohdr->typ, p->val.via.str.ptr, p->val.via.str.size);
-            protohdr->typ[p->val.via.str.size] = '\0';
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "sid", p->key.via.str.size)) && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (protohdr->sid = (char *)malloc(p->val.via.str.size + 1))) {
+            if (NULL == (protohdr->sid = mender_troubleshoot_decode_string(&p->val))) {
                 mender_log_error("Unable to allocate memory");
-                goto FAIL;
+                return NULL;
             }
-            memcpy(protohdr->sid, p->val.via.str.ptr, p->val.via.str.size);
-            protohdr->sid[p->val.via.str.size] = '\0';
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "props", p->key.via.str.size)) && (MSGPACK_OBJECT_MAP == p->val.type)
                    && (0 != p->val.via.map.size)) {
             if (NULL == (protohdr->properties = mender_troubleshoot_decode_protohdr_properties(&p->val))) {
                 mender_log_error("Invalid protohdr properties object");
-                goto FAIL;
+                return NULL;
             }
         }
         ++p;
     } while (p < object->via.map.ptr + object->via.map.size);
 
     return protohdr;
-
-FAIL:
-
-    /* Release memory */
-    mender_troubleshoot_release_protohdr(protohdr);
-
-    return NULL;
 }
 
 static mender_troubleshoot_protohdr_properties_t *
 mender_troubleshoot_decode_protohdr_properties(msgpack_object *object) {
 
     assert(NULL != object);
-    mender_troubleshoot_protohdr_properties_t *properties = NULL;
+    mender_troubleshoot_protohdr_properties_t *properties;
 
     /* Create protohdr properties */
-    if (NULL == (properties = (mender_troubleshoot_protohdr_properties_t *)malloc(sizeof(mender_troubleshoot_protohdr_properties_t)))) {
+    if (NULL
+        == (properties = (mender_troubleshoot_protohdr_properties_t *)mender_troubleshoot_zone_calloc(sizeof(mender_troubleshoot_protohdr_properties_t)))) {
         mender_log_error("Unable to allocate memory");
         return NULL;
     }
-    memset(properties, 0, sizeof(mender_troubleshoot_protohdr_properties_t));
 
     /* Parse protohdr properties */
     msgpack_object_kv *p = object->via.map.ptr;
     do {
         if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "terminal_width", p->key.via.str.size))
             && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
-            if (NULL == (properties->terminal_width = (uint16_t *)malloc(sizeof(uint16_t)))) {
+            if (NULL == (properties->terminal_width = (uint16_t *)mender_troubleshoot_zone_calloc(sizeof(uint16_t)))) {
                 mender_log_error("Unable to allocate memory");
-                goto FAIL;
+                return NULL;
             }
             *properties->terminal_width = (uint16_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "terminal_height", p->key.via.str.size))
                    && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
-            if (NULL == (properties->terminal_height = (uint16_t *)malloc(sizeof(uint16_t)))) {
+            if (NULL == (properties->terminal_height = (uint16_t *)mender_troubleshoot_zone_calloc(sizeof(uint16_t)))) {
                 mender_log_error("Unable to allocate memory");
-                goto FAIL;
+                return NULL;
             }
             *properties->terminal_height = (uint16_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "user_id", p->key.via.str.size))
                    && (MSGPACK_OBJECT_STR == p->val.type)) {
-            if (NULL == (properties->user_id = (char *)malloc(p->val.via.str.size + 1))) {
+            if (NULL == (properties->user_id = mender_troubleshoot_decode_string(&p->val))) {
                 mender_log_error("Unable to allocate memory");
-                goto FAIL;
+                return NULL;
             }
-            memcpy(properties->user_id, p->val.via.str.ptr, p->val.via.str.size);
-            properties->user_id[p->val.via.str.size] = '\0';
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "timeout", p->key.via.str.size))
                    && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
-            if (NULL == (properties->timeout = (uint32_t *)malloc(sizeof(uint32_t)))) {
+            if (NULL == (properties->timeout = (uint32_t *)mender_troubleshoot_zone_calloc(sizeof(uint32_t)))) {
                 mender_log_error("Unable to allocate memory");
-                goto FAIL;
+                return NULL;
             }
             *properties->timeout = (uint32_t)p->val.via.u64;
         } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "status", p->key.via.str.size))
                    && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
-            if (NULL == (properties->status = (mender_troubleshoot_properties_status_t *)malloc(sizeof(mender_troubleshoot_properties_status_t)))) {
+            if (NULL
+                == (properties->status
+                    = (mender_troubleshoot_properties_status_t *)mender_troubleshoot_zone_calloc(sizeof(mender_troubleshoot_properties_status_t)))) {
                 mender_log_error("Unable to allocate memory");
-                goto FAIL;
+                return NULL;
             }
             *properties->status = (mender_troubleshoot_properties_status_t)p->val.via.u64;
+        } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "offset", p->key.via.str.size))
+                   && (MSGPACK_OBJECT_POSITIVE_INTEGER == p->val.type)) {
+            if (NULL == (properties->offset = (int64_t *)mender_troubleshoot_zone_calloc(sizeof(int64_t)))) {
+                mender_log_error("Unable to allocate memory");
+                return NULL;
+            }
+            *properties->offset = (int64_t)p->val.via.u64;
+        } else if ((MSGPACK_OBJECT_STR == p->key.type) && (!strncmp(p->key.via.str.ptr, "connection_id", p->key.via.str.size))
+                   && (MSGPACK_OBJECT_STR == p->val.type)) {
+            if (NULL == (properties->connection_id = mender_troubleshoot_decode_string(&p->val))) {
+                mender_log_error("Unable to allocate memory");
+                return NULL;
+            }
         }
         ++p;
     } while (p < object->via.map.ptr + object->via.map.size);
 
     return properties;
+}
 
-FAIL:
+static char *
+mender_troubleshoot_decode_body(msgpack_object *object) {
 
-    /* Release memory */
-    mender_troubleshoot_release_protohdr_properties(properties);
+    assert(NULL != object);
 
-    return NULL;
+    /* Reference the body, the message received remains available until the protomsg has been handled */
+    return (char *)object->via.bin.ptr;
 }
 
 static char *
-mender_troubleshoot_decode_body(msgpack_object *object) {
+mender_troubleshoot_decode_string(msgpack_object *object) {
 
     assert(NULL != object);
-    char *body;
+    char *str;
 
-    /* Create body */
-    if (NULL == (body = (char *)malloc(object->via.bin.size + 1))) {
-        mender_log_error("Unable to allocate memory");
-        goto FAIL;
+    /* Create null-terminated string */
+    if (NULL == (str = (char *)msgpack_zone_malloc_no_align(&mender_troubleshoot_ctx->zone, object->via.str.size + 1))) {
+        return NULL;
     }
-    memcpy(body, object->via.bin.ptr, object->via.bin.size);
-    body[object->via.bin.size] = '\0';
+    memcpy(str, object->via.str.ptr, object->via.str.size);
+    str[object->via.str.size] = '\0';
 
-    return body;
+    return str;
+}
 
-FAIL:
+static void *
+mender_troubleshoot_zone_calloc(size_t size) {
 
-    return NULL;
+    void *ptr;
+
+    /* Allocate zeroed memory in the zone */
+    if (NULL != (ptr = msgpack_zone_malloc(&mender_troubleshoot_ctx->zone, size))) {
+        memset(ptr, 0, size);
+    }
+
+    return ptr;
 }
 
 static mender_err_t
@@ -1289,14 +3016,14 @@ mender_troubleshoot_pack_protomsg(mender_troubleshoot_protomsg_t *protomsg, void
     /* Initialize msgpack sbuffer */
     msgpack_sbuffer_init(&sbuffer);
     sbuffer.alloc = MENDER_TROUBLESHOOT_SBUFFER_INIT_SIZE;
-    if (NULL == (sbuffer.data = (char *)malloc(sbuffer.alloc))) {
+    if (NULL == (sbuffer.data = (char *)mender_utils_malloc(sbuffer.alloc))) {
         mender_log_error("Unable  to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
     }
 
     /* Initialize msgpack packer */
-    msgpack_packer_init(&packer, &sbuffer, msgpack_sbuffer_write);
+    msgpack_packer_init(&packer, &sbuffer, mender_troubleshoot_sbuffer_write);
 
     /* Encode protomsg */
     if (MENDER_OK != (ret = mender_troubleshoot_encode_protomsg(protomsg, &object))) {
@@ -1323,11 +3050,73 @@ mender_troubleshoot_pack_protomsg(mender_troubleshoot_protomsg_t *protomsg, void
 FAIL:
 
     /* Release memory */
-    msgpack_sbuffer_destroy(&sbuffer);
+    mender_utils_free(sbuffer.data);
 
     return ret;
 }
 
+static mender_err_t
+mender_troubleshoot_pack_shell_output(msgpack_packer *packer, char *sid, size_t length) {
+
+    assert(NULL != packer);
+    assert(NULL != sid);
+
+    /* Pack the header, same layout as the Proto messages encoded */
+    if ((0 != msgpack_pack_map(packer, 2)) || (0 != mender_troubleshoot_pack_string(packer, "hdr")) || (0 != msgpack_pack_map(packer, 4))
+        || (0 != mender_troubleshoot_pack_string(packer, "proto")) || (0 != msgpack_pack_uint16(packer, MENDER_TROUBLESHOOT_PROTO_TYPE_SHELL))
+        || (0 != mender_troubleshoot_pack_string(packer, "typ")) || (0 != mender_troubleshoot_pack_string(packer, MENDER_TROUBLESHOOT_MESSAGE_TYPE_SHELL_SHELL))
+        || (0 != mender_troubleshoot_pack_string(packer, "sid")) || (0 != mender_troubleshoot_pack_string(packer, sid))
+        || (0 != mender_troubleshoot_pack_string(packer, "props")) || (0 != msgpack_pack_map(packer, 1))
+        || (0 != mender_troubleshoot_pack_string(packer, "status")) || (0 != msgpack_pack_uint16(packer, MENDER_TROUBLESHOOT_STATUS_TYPE_NORMAL))) {
+        mender_log_error("Unable to pack the header");
+        return MENDER_FAIL;
+    }
+
+    /* Pack the header of the body */
+    if ((0 != mender_troubleshoot_pack_string(packer, "body")) || (0 != msgpack_pack_bin(packer, length))) {
+        mender_log_error("Unable to pack the body");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static int
+mender_troubleshoot_pack_string(msgpack_packer *packer, const char *str) {
+
+    assert(NULL != packer);
+    assert(NULL != str);
+
+    return msgpack_pack_str_with_body(packer, str, strlen(str));
+}
+
+static int
+mender_troubleshoot_sbuffer_write(void *data, const char *buf, size_t len) {
+
+    assert(NULL != data);
+    msgpack_sbuffer *sbuffer = (msgpack_sbuffer *)data;
+
+    /* Grow the sbuffer if needed */
+    if (sbuffer->alloc - sbuffer->size < len) {
+        size_t alloc = (0 != sbuffer->alloc) ? sbuffer->alloc * 2 : MENDER_TROUBLESHOOT_SBUFFER_INIT_SIZE;
+        while (alloc < sbuffer->size + len) {
+            alloc *= 2;
+        }
+        char *tmp;
+        if (NULL == (tmp = (char *)mender_utils_realloc(sbuffer->data, alloc))) {
+            return -1;
+        }
+        sbuffer->data  = tmp;
+        sbuffer->alloc = alloc;
+    }
+
+    /* Copy data */
+    memcpy(sbuffer->data + sbuffer->size, buf, len);
+    sbuffer->size += len;
+
+    return 0;
+}
+
 static mender_err_t
 mender_troubleshoot_encode_protomsg(mender_troubleshoot_protomsg_t *protomsg, msgpack_object *object) {
 
@@ -1341,7 +3130,7 @@ mender_troubleshoot_encode_protomsg(mender_troubleshoot_protomsg_t *protomsg, ms
     if (0 == (object->via.map.size = ((NULL != protomsg->protohdr) ? 1 : 0) + ((NULL != protomsg->body) ? 1 : 0))) {
         goto END;
     }
-    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
+    if (NULL == (object->via.map.ptr = (msgpack_object_kv *)mender_utils_malloc(object->via.map.size * sizeof(struct msgpack_object_kv)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -1377,7 +3166,7 @@ mender_troubleshoot_encode_protohdr(mender_troubleshoot_protohdr_t *protohdr, ms
 
     /* Create protohdr */
     p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("hdr"))) {
+    if (NULL == (p->key.via.str.ptr = mender_utils_strdup("hdr"))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -1387,7 +3176,7 @@ mender_troubleshoot_encode_protohdr(mender_troubleshoot_protohdr_t *protohdr, ms
     if (0 == (p->val.via.map.size = 1 + ((NULL != protohdr->typ) ? 1 : 0) + ((NULL != protohdr->sid) ? 1 : 0) + ((NULL != protohdr->properties) ? 1 : 0))) {
         goto END;
     }
-    if (NULL == (p->val.via.map.ptr = (msgpack_object_kv *)malloc(p->val.via.map.size * sizeof(struct msgpack_object_kv)))) {
+    if (NULL == (p->val.via.map.ptr = (msgpack_object_kv *)mender_utils_malloc(p->val.via.map.size * sizeof(struct msgpack_object_kv)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -1396,7 +3185,7 @@ mender_troubleshoot_encode_protohdr(mender_troubleshoot_protohdr_t *protohdr, ms
     /* Parse protohdr */
     p           = p->val.via.map.ptr;
     p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("proto"))) {
+    if (NULL == (p->key.via.str.ptr = mender_utils_strdup("proto"))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -1407,7 +3196,7 @@ mender_troubleshoot_encode_protohdr(mender_troubleshoot_protohdr_t *protohdr, ms
     ++p;
     if (NULL != protohdr->typ) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("typ"))) {
+        if (NULL == (p->key.via.str.ptr = mender_utils_strdup("typ"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1415,7 +3204,7 @@ mender_troubleshoot_encode_protohdr(mender_troubleshoot_protohdr_t *protohdr, ms
         p->key.via.str.size = strlen("typ");
         p->val.type         = MSGPACK_OBJECT_STR;
         p->val.via.str.size = strlen(protohdr->typ);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
+        if (NULL == (p->val.via.str.ptr = (char *)mender_utils_malloc(p->val.via.str.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1425,7 +3214,7 @@ mender_troubleshoot_encode_protohdr(mender_troubleshoot_protohdr_t *protohdr, ms
     }
     if (NULL != protohdr->sid) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("sid"))) {
+        if (NULL == (p->key.via.str.ptr = mender_utils_strdup("sid"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1433,7 +3222,7 @@ mender_troubleshoot_encode_protohdr(mender_troubleshoot_protohdr_t *protohdr, ms
         p->key.via.str.size = strlen("sid");
         p->val.type         = MSGPACK_OBJECT_STR;
         p->val.via.str.size = strlen(protohdr->sid);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
+        if (NULL == (p->val.via.str.ptr = (char *)mender_utils_malloc(p->val.via.str.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1462,7 +3251,7 @@ mender_troubleshoot_encode_protohdr_properties(mender_troubleshoot_protohdr_prop
 
     /* Create properties */
     p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("props"))) {
+    if (NULL == (p->key.via.str.ptr = mender_utils_strdup("props"))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -1472,10 +3261,11 @@ mender_troubleshoot_encode_protohdr_properties(mender_troubleshoot_protohdr_prop
     if (0
         == (p->val.via.map.size = ((NULL != properties->terminal_width) ? 1 : 0) + ((NULL != properties->terminal_height) ? 1 : 0)
                                   + ((NULL != properties->user_id) ? 1 : 0) + ((NULL != properties->timeout) ? 1 : 0)
-                                  + ((NULL != properties->status) ? 1 : 0))) {
+                                  + ((NULL != properties->status) ? 1 : 0) + ((NULL != properties->offset) ? 1 : 0)
+                                  + ((NULL != properties->connection_id) ? 1 : 0))) {
         goto END;
     }
-    if (NULL == (p->val.via.map.ptr = (msgpack_object_kv *)malloc(p->val.via.map.size * sizeof(struct msgpack_object_kv)))) {
+    if (NULL == (p->val.via.map.ptr = (msgpack_object_kv *)mender_utils_malloc(p->val.via.map.size * sizeof(struct msgpack_object_kv)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -1485,7 +3275,7 @@ mender_troubleshoot_encode_protohdr_properties(mender_troubleshoot_protohdr_prop
     p = p->val.via.map.ptr;
     if (NULL != properties->terminal_width) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("terminal_width"))) {
+        if (NULL == (p->key.via.str.ptr = mender_utils_strdup("terminal_width"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1497,7 +3287,7 @@ mender_troubleshoot_encode_protohdr_properties(mender_troubleshoot_protohdr_prop
     }
     if (NULL != properties->terminal_height) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("terminal_height"))) {
+        if (NULL == (p->key.via.str.ptr = mender_utils_strdup("terminal_height"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1509,7 +3299,7 @@ mender_troubleshoot_encode_protohdr_properties(mender_troubleshoot_protohdr_prop
     }
     if (NULL != properties->user_id) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("user_id"))) {
+        if (NULL == (p->key.via.str.ptr = mender_utils_strdup("user_id"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1517,7 +3307,7 @@ mender_troubleshoot_encode_protohdr_properties(mender_troubleshoot_protohdr_prop
         p->key.via.str.size = strlen("user_id");
         p->val.type         = MSGPACK_OBJECT_STR;
         p->val.via.str.size = strlen(properties->user_id);
-        if (NULL == (p->val.via.str.ptr = (char *)malloc(p->val.via.str.size))) {
+        if (NULL == (p->val.via.str.ptr = (char *)mender_utils_malloc(p->val.via.str.size))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1527,7 +3317,7 @@ mender_troubleshoot_encode_protohdr_properties(mender_troubleshoot_protohdr_prop
     }
     if (NULL != properties->timeout) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("timeout"))) {
+        if (NULL == (p->key.via.str.ptr = mender_utils_strdup("timeout"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1539,7 +3329,7 @@ mender_troubleshoot_encode_protohdr_properties(mender_troubleshoot_protohdr_prop
     }
     if (NULL != properties->status) {
         p->key.type = MSGPACK_OBJECT_STR;
-        if (NULL == (p->key.via.str.ptr = strdup("status"))) {
+        if (NULL == (p->key.via.str.ptr = mender_utils_strdup("status"))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -1547,6 +3337,36 @@ mender_troubleshoot_encode_protohdr_properties(mender_troubleshoot_protohdr_prop
         p->key.via.str.size = strlen("status");
         p->val.type         = MSGPACK_OBJECT_POSITIVE_INTEGER;
         p->val.via.u64      = *properties->status;
+        ++p;
+    }
+    if (NULL != properties->offset) {
+        p->key.type = MSGPACK_OBJECT_STR;
+        if (NULL == (p->key.via.str.ptr = mender_utils_strdup("offset"))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        p->key.via.str.size = strlen("offset");
+        p->val.type         = MSGPACK_OBJECT_POSITIVE_INTEGER;
+        p->val.via.u64      = (uint64_t)*properties->offset;
+        ++p;
+    }
+    if (NULL != properties->connection_id) {
+        p->key.type = MSGPACK_OBJECT_STR;
+        if (NULL == (p->key.via.str.ptr = mender_utils_strdup("connection_id"))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        p->key.via.str.size = strlen("connection_id");
+        p->val.type         = MSGPACK_OBJECT_STR;
+        p->val.via.str.size = strlen(properties->connection_id);
+        if (NULL == (p->val.via.str.ptr = (char *)mender_utils_malloc(p->val.via.str.size))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        memcpy((void *)p->val.via.str.ptr, properties->connection_id, p->val.via.str.size);
     }
 
 END:
@@ -1563,7 +3383,7 @@ mender_troubleshoot_encode_body(char *body, msgpack_object_kv *p) {
 
     /* Create body */
     p->key.type = MSGPACK_OBJECT_STR;
-    if (NULL == (p->key.via.str.ptr = strdup("body"))) {
+    if (NULL == (p->key.via.str.ptr = mender_utils_strdup("body"))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -1571,7 +3391,7 @@ mender_troubleshoot_encode_body(char *body, msgpack_object_kv *p) {
     p->key.via.str.size = strlen("body");
     p->val.type         = MSGPACK_OBJECT_BIN;
     p->val.via.bin.size = strlen(body);
-    if (NULL == (p->val.via.bin.ptr = (char *)malloc(p->val.via.bin.size * sizeof(uint8_t)))) {
+    if (NULL == (p->val.via.bin.ptr = (char *)mender_utils_malloc(p->val.via.bin.size * sizeof(uint8_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -1599,17 +3419,17 @@ mender_troubleshoot_msgpack_object_release(msgpack_object *object) {
                 break;
             case MSGPACK_OBJECT_STR:
                 if (NULL != object->via.str.ptr) {
-                    free((void *)object->via.str.ptr);
+                    mender_utils_free((void *)object->via.str.ptr);
                 }
                 break;
             case MSGPACK_OBJECT_BIN:
                 if (NULL != object->via.ext.ptr) {
-                    free((void *)object->via.bin.ptr);
+                    mender_utils_free((void *)object->via.bin.ptr);
                 }
                 break;
             case MSGPACK_OBJECT_EXT:
                 if (NULL != object->via.ext.ptr) {
-                    free((void *)object->via.ext.ptr);
+                    mender_utils_free((void *)object->via.ext.ptr);
                 }
                 break;
             case MSGPACK_OBJECT_ARRAY:
@@ -1619,7 +3439,7 @@ mender_troubleshoot_msgpack_object_release(msgpack_object *object) {
                         mender_troubleshoot_msgpack_object_release(p);
                         ++p;
                     } while (p < object->via.array.ptr + object->via.array.size);
-                    free(object->via.array.ptr);
+                    mender_utils_free(object->via.array.ptr);
                 }
                 break;
             case MSGPACK_OBJECT_MAP:
@@ -1630,7 +3450,7 @@ mender_troubleshoot_msgpack_object_release(msgpack_object *object) {
                         mender_troubleshoot_msgpack_object_release(&(p->val));
                         ++p;
                     } while (p < object->via.map.ptr + object->via.map.size);
-                    free(object->via.map.ptr);
+                    mender_utils_free(object->via.map.ptr);
                 }
                 break;
             default:
@@ -1647,9 +3467,9 @@ mender_troubleshoot_release_protomsg(mender_troubleshoot_protomsg_t *protomsg) {
     if (NULL != protomsg) {
         mender_troubleshoot_release_protohdr(protomsg->protohdr);
         if (NULL != protomsg->body) {
-            free(protomsg->body);
+            mender_utils_free(protomsg->body);
         }
-        free(protomsg);
+        mender_utils_free(protomsg);
     }
 }
 
@@ -1659,13 +3479,13 @@ mender_troubleshoot_release_protohdr(mender_troubleshoot_protohdr_t *protohdr) {
     /* Release memory */
     if (NULL != protohdr) {
         if (NULL != protohdr->typ) {
-            free(protohdr->typ);
+            mender_utils_free(protohdr->typ);
         }
         if (NULL != protohdr->sid) {
-            free(protohdr->sid);
+            mender_utils_free(protohdr->sid);
         }
         mender_troubleshoot_release_protohdr_properties(protohdr->properties);
-        free(protohdr);
+        mender_utils_free(protohdr);
     }
 }
 
@@ -1675,21 +3495,27 @@ mender_troubleshoot_release_protohdr_properties(mender_troubleshoot_protohdr_pro
     /* Release memory */
     if (NULL != properties) {
         if (NULL != properties->terminal_width) {
-            free(properties->terminal_width);
+            mender_utils_free(properties->terminal_width);
         }
         if (NULL != properties->terminal_height) {
-            free(properties->terminal_height);
+            mender_utils_free(properties->terminal_height);
         }
         if (NULL != properties->user_id) {
-            free(properties->user_id);
+            mender_utils_free(properties->user_id);
         }
         if (NULL != properties->timeout) {
-            free(properties->timeout);
+            mender_utils_free(properties->timeout);
         }
         if (NULL != properties->status) {
-            free(properties->status);
+            mender_utils_free(properties->status);
+        }
+        if (NULL != properties->offset) {
+            mender_utils_free(properties->offset);
+        }
+        if (NULL != properties->connection_id) {
+            mender_utils_free(properties->connection_id);
         }
-        free(properties);
+        mender_utils_free(properties);
     }
 }
 
@@ -18,10 +18,18 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_API
+
 #include "mender-api.h"
 #include "mender-artifact.h"
 #include "mender-http.h"
+#include "mender-json.h"
 #include "mender-log.h"
+#include "mender-log-buffer.h"
+#include "mender-scheduler.h"
 #include "mender-tls.h"
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
 #include "mender-websocket.h"
@@ -33,20 +41,404 @@
 #define MENDER_API_PATH_POST_AUTHENTICATION_REQUESTS "/api/devices/v1/authentication/auth_requests"
 #define MENDER_API_PATH_GET_NEXT_DEPLOYMENT          "/api/devices/v1/deployments/device/deployments/next"
 #define MENDER_API_PATH_PUT_DEPLOYMENT_STATUS        "/api/devices/v1/deployments/device/deployments/%s/status"
+#define MENDER_API_PATH_PUT_DEPLOYMENT_LOGS          "/api/devices/v1/deployments/device/deployments/%s/log"
 #define MENDER_API_PATH_GET_DEVICE_CONFIGURATION     "/api/devices/v1/deviceconfig/configuration"
 #define MENDER_API_PATH_PUT_DEVICE_CONFIGURATION     "/api/devices/v1/deviceconfig/configuration"
 #define MENDER_API_PATH_GET_DEVICE_CONNECT           "/api/devices/v1/deviceconnect/connect"
 #define MENDER_API_PATH_PUT_DEVICE_ATTRIBUTES        "/api/devices/v1/inventory/device/attributes"
 
 /**
- * @brief Mender API configuration
+ * @brief Maximum number of attempts to resume the download of an artifact after the connection is lost
+ */
+#ifndef CONFIG_MENDER_API_DOWNLOAD_RESUME_ATTEMPTS
+#define CONFIG_MENDER_API_DOWNLOAD_RESUME_ATTEMPTS (3)
+#endif /* CONFIG_MENDER_API_DOWNLOAD_RESUME_ATTEMPTS */
+
+/**
+ * @brief Default rate of the artifact downloads, it is modified at runtime with mender_api_set_download_rate (bytes per second), 0 if not limited
+ */
+#ifndef CONFIG_MENDER_API_DOWNLOAD_RATE
+#define CONFIG_MENDER_API_DOWNLOAD_RATE (0)
+#endif /* CONFIG_MENDER_API_DOWNLOAD_RATE */
+
+/**
+ * @brief Burst allowed by the artifact download rate limiter, the bucket holds the data received during this duration at the configured rate (milliseconds)
+ */
+#define MENDER_API_DOWNLOAD_RATE_BURST (100)
+
+/**
+ * @brief Delay after which a server host which has failed is selected again if it is the best one (seconds)
+ */
+#ifndef CONFIG_MENDER_API_HOST_RETRY_INTERVAL
+#define CONFIG_MENDER_API_HOST_RETRY_INTERVAL (300)
+#endif /* CONFIG_MENDER_API_HOST_RETRY_INTERVAL */
+
+/**
+ * @brief Path of the request used to probe the server hosts, it is not authenticated so that the server answers it immediately
+ */
+#define MENDER_API_PATH_PROBE MENDER_API_PATH_GET_NEXT_DEPLOYMENT
+
+/**
+ * @brief Check tiny build, the responses are parsed without cJSON and the features which need it or the heap are not available
+ */
+#if defined(CONFIG_MENDER_TINY) && !defined(CONFIG_MENDER_API_JSON_TOKENIZER)
+#error "CONFIG_MENDER_TINY requires CONFIG_MENDER_API_JSON_TOKENIZER"
+#endif
+#if defined(CONFIG_MENDER_TINY) \
+    && (defined(CONFIG_MENDER_API_BATCH) || defined(CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE) || defined(CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT))
+#error "CONFIG_MENDER_TINY is not compatible with CONFIG_MENDER_API_BATCH and with the configure and troubleshoot add-ons"
+#endif
+
+/**
+ * @brief Maximum length of the entity tags cached to perform conditional requests, longer entity tags are not cached
+ */
+#define MENDER_API_ETAG_LENGTH (64)
+
+/**
+ * @brief Length of the buffer holding the deployment status payload, it holds the longest status and substate (bytes)
+ */
+#define MENDER_API_DEPLOYMENT_STATUS_PAYLOAD_LENGTH (128)
+
+/**
+ * @brief Minimum capacity of the response buffers allocated from the heap (bytes)
+ */
+#define MENDER_API_RESPONSE_MIN_CAPACITY (256)
+
+/**
+ * @brief Length of the buffer provided by the requests for which no response is expected, it holds typical error descriptions (bytes)
+ */
+#define MENDER_API_RESPONSE_STATIC_LENGTH (256)
+
+#ifdef CONFIG_MENDER_TINY
+
+/**
+ * @brief Size of the buffer shared by the responses of the tiny build, it holds the authentication token and the deployment (bytes)
+ */
+#ifndef CONFIG_MENDER_API_RESPONSE_BUFFER_SIZE
+#define CONFIG_MENDER_API_RESPONSE_BUFFER_SIZE (2048)
+#endif /* CONFIG_MENDER_API_RESPONSE_BUFFER_SIZE */
+
+/**
+ * @brief Size of the buffer shared by the payloads of the tiny build, it holds the authentication request and the inventory (bytes)
+ */
+#ifndef CONFIG_MENDER_API_PAYLOAD_BUFFER_SIZE
+#define CONFIG_MENDER_API_PAYLOAD_BUFFER_SIZE (1536)
+#endif /* CONFIG_MENDER_API_PAYLOAD_BUFFER_SIZE */
+
+/**
+ * @brief Length of the buffer holding the identity of the authentication request, it is formatted before being added to the payload (bytes)
+ */
+#define MENDER_API_IDENTITY_LENGTH (128)
+
+#endif /* CONFIG_MENDER_TINY */
+
+/**
+ * @brief Server host, the requests are routed to the best one when several hosts are configured
+ */
+typedef struct {
+    char    *url;       /**< URL of the host */
+    uint32_t rtt;       /**< Smoothed round-trip time of the probes (milliseconds), 0 if the host has not answered a probe yet */
+    uint32_t failures;  /**< Number of consecutive failures of the requests sent to the host */
+    uint64_t timestamp; /**< Uptime of the last failure (milliseconds) */
+} mender_api_host_t;
+
+/**
+ * @brief Route of a request to a server host
+ */
+typedef struct {
+    char  *path;  /**< Path of the request */
+    char  *url;   /**< URL of the request, it is the path if a single host is configured */
+    size_t index; /**< Index of the host */
+} mender_api_route_t;
+
+/**
+ * @brief Response buffer used by the HTTP callback handling text content
+ */
+typedef struct {
+    char  *data;      /**< Response, null terminated, NULL if nothing has been received and no buffer has been provided */
+    size_t length;    /**< Length of the response (bytes) */
+    size_t capacity;  /**< Capacity of the buffer, including the null terminator (bytes) */
+    bool   allocated; /**< Buffer has been allocated from the heap and must be released */
+} mender_api_response_t;
+
+/**
+ * @brief Parameters of the HTTP callback used to handle artifact content
+ */
+typedef struct {
+    mender_artifact_ctx_t *ctx; /**< Artifact context */
+    mender_err_t (*callback)(
+        char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t); /**< Callback function to perform the treatment of the data */
+    size_t   offset;    /**< Number of bytes of the artifact already processed, the download is resumed from this offset */
+    bool     failed;    /**< Processing of the data failed, the download must not be resumed */
+    int64_t  tokens;    /**< Tokens of the rate limiter bucket, negative when the data received exceed the rate (bytes) */
+    uint64_t timestamp; /**< Uptime when the bucket has been refilled, 0 if the rate is not limited (milliseconds) */
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+    void (*capture)(mender_api_download_fragment_t *, void *); /**< Callback invoked with each fragment received, NULL if the download is not captured */
+    void                                 *capture_params; /**< Parameters of the capture callback */
+    uint64_t                              received;  /**< Uptime of the previous fragment received, or of the request (milliseconds) */
+    const mender_api_download_fragment_t *fragments; /**< Fragments replayed, NULL if the data received is processed as is */
+    size_t                                count;     /**< Number of fragments replayed */
+    size_t                                index;     /**< Index of the next fragment replayed */
+    uint8_t                              *buffer;    /**< Buffer holding the data of the next fragment replayed until it is complete */
+    size_t                                length;    /**< Length of the data held in the buffer */
+    uint64_t                              delivered; /**< Uptime of the previous fragment delivered, or of the request (milliseconds) */
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+} mender_api_artifact_params_t;
+
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+/**
+ * @brief Parameters of the log buffer callback used to format the deployment logs payload
+ */
+typedef struct {
+    mender_json_writer_t *writer; /**< JSON writer of the payload */
+    size_t                count;  /**< Number of messages formatted */
+} mender_api_logs_params_t;
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
+#ifdef CONFIG_MENDER_API_BATCH
+
+/**
+ * @brief Request of the batches and its response kept until it is consumed
+ */
+typedef struct {
+    mender_err_t (*callback)(void);                         /**< Callback invoked when the response is available, NULL if the request is not registered */
+    bool                  available;                        /**< The response is available and has not been consumed yet */
+    mender_err_t          ret;                              /**< Result of the request */
+    int                   status;                           /**< Status code of the response */
+    mender_api_response_t response;                         /**< Response */
+    char                  etag[MENDER_API_ETAG_LENGTH + 1]; /**< Entity tag of the response, empty if the server does not send it */
+} mender_api_batch_t;
+
+#endif /* CONFIG_MENDER_API_BATCH */
+
+/**
+ * @brief Context of a device, it holds the state of the API which is specific to the device
+ */
+struct mender_api_ctx_s {
+    mender_api_config_t config; /**< Mender API configuration */
+    char               *jwt;    /**< Authentication token */
+    struct {
+        uint32_t lifetime;  /**< Lifetime of the token (seconds), 0 if it is not known */
+        uint64_t timestamp; /**< Uptime when the token has been received (milliseconds) */
+    } jwt_validity;         /**< Validity of the authentication token, computed from its "iat" and "exp" claims */
+    struct {
+        char *payload;        /**< Payload of the authentication request, NULL if not available */
+        char *signature;      /**< Signature of the payload */
+    } authentication_request; /**< Last authentication request, the signature is reused while identity, key and tenant token are not modified */
+    char deployment_etag[MENDER_API_ETAG_LENGTH + 1]; /**< Entity tag of the last deployment check which returned no deployment, empty if not available */
+    bool mirror_bypass;                               /**< Flag set when the mirror has served an invalid response, the next download is from the server */
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+    char configuration_etag[MENDER_API_ETAG_LENGTH + 1]; /**< Entity tag of the last device configuration downloaded, empty if not available */
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+#ifdef CONFIG_MENDER_API_BATCH
+    mender_api_batch_t batch[MENDER_API_BATCH_COUNT]; /**< Requests of the batches, they are registered by the add-ons of the device */
+#endif /* CONFIG_MENDER_API_BATCH */
+#if defined(CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT) && defined(CONFIG_MENDER_CLIENT_CONTEXTS)
+    struct {
+        mender_err_t (*callback)(void *, size_t, void *); /**< Callback invoked with the data received */
+        void *arg;                                        /**< Argument of the callback */
+    } troubleshoot;                                       /**< Troubleshoot connection of the device, the context is the parameter of the websocket callback */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT && CONFIG_MENDER_CLIENT_CONTEXTS */
+};
+
+/**
+ * @brief Context of the device of mender_api_init, used by the client and the add-ons
+ */
+static mender_api_ctx_t mender_api_default_ctx;
+
+/**
+ * @brief Context of the device of the requests, it is selected per thread so that the works of the client always use the default context
+ */
+#ifdef CONFIG_MENDER_API_CONTEXTS
+static __thread mender_api_ctx_t *mender_api_ctx = &mender_api_default_ctx;
+#else
+static mender_api_ctx_t *const mender_api_ctx = &mender_api_default_ctx;
+#endif /* CONFIG_MENDER_API_CONTEXTS */
+
+/**
+ * @brief Rate of the artifact downloads (bytes per second), 0 if not limited, it is read for each data received so that it is applied immediately
+ */
+static volatile uint32_t mender_api_download_rate = CONFIG_MENDER_API_DOWNLOAD_RATE;
+
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+
+/**
+ * @brief Capture and replay of the artifact downloads, they are copied to the artifact parameters when a download begins
+ */
+static struct {
+    void (*callback)(mender_api_download_fragment_t *, void *); /**< Capture callback, NULL if the downloads are not captured */
+    void                                 *params;    /**< Parameters of the capture callback */
+    const mender_api_download_fragment_t *fragments; /**< Fragments replayed, NULL if the downloads are not replayed */
+    size_t                                count;     /**< Number of fragments replayed */
+    size_t                                maximum;   /**< Length of the longest fragment replayed (bytes) */
+} mender_api_download_pattern = { .callback = NULL, .params = NULL, .fragments = NULL, .count = 0, .maximum = 0 };
+
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+/**
+ * @brief Statistics of the API, the counters are updated with relaxed atomic operations so that the requests never wait on the readers
+ */
+static mender_api_stats_t mender_api_stats;
+
+/**
+ * @brief Server hosts, the counters are updated with relaxed atomic operations because the requests are performed from several works
+ */
+static mender_api_host_t *mender_api_hosts       = NULL;
+static size_t             mender_api_hosts_count = 0;
+
+/**
+ * @brief Index of the server host of the last request, it is used to log the failovers
+ */
+static size_t mender_api_host_current = 0;
+
+#ifdef CONFIG_MENDER_API_BATCH
+
+/**
+ * @brief Mutex used to protect access to the batches from the work checking for deployments and the works consuming them
+ */
+static void *mender_api_batch_mutex = NULL;
+
+#endif /* CONFIG_MENDER_API_BATCH */
+
+#ifdef CONFIG_MENDER_TINY
+
+/**
+ * @brief Buffers shared by the requests of the tiny build, each one is taken by a single request at a time
+ */
+static char mender_api_response_buffer[CONFIG_MENDER_API_RESPONSE_BUFFER_SIZE];
+static bool mender_api_response_buffer_taken = false;
+static char mender_api_payload_buffer[CONFIG_MENDER_API_PAYLOAD_BUFFER_SIZE];
+static bool mender_api_payload_buffer_taken = false;
+
+#endif /* CONFIG_MENDER_TINY */
+
+/**
+ * @brief Parse the server hosts, they are separated by spaces or commas
+ * @param hosts Server hosts
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_hosts_parse(char *hosts);
+
+/**
+ * @brief Release the server hosts
+ */
+static void mender_api_hosts_release(void);
+
+/**
+ * @brief Probe the server hosts with a cheap request to measure their round-trip time, nothing is done if a single host is configured
+ */
+static void mender_api_hosts_probe(void);
+
+/**
+ * @brief Select the best server host, the ones which have failed recently are avoided and the one with the lowest round-trip time is preferred
+ * @return Index of the host
+ */
+static size_t mender_api_host_select(void);
+
+/**
+ * @brief Update the health of a server host following a request
+ * @param index Index of the host
+ * @param ret Result of the request
+ * @param status HTTP status, 0 if no response has been received
+ */
+static void mender_api_host_update(size_t index, mender_err_t ret, int status);
+
+/**
+ * @brief Route a request to the best server host
+ * @param route Route of the request, to be ended with mender_api_route_end
+ * @param path Path of the request
+ * @param websocket Request opens a websocket connection, the scheme of the host is converted
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_route_begin(mender_api_route_t *route, char *path, bool websocket);
+
+/**
+ * @brief End the route of a request, the health of the server host is updated
+ * @param route Route of the request
+ * @param ret Result of the request
+ * @param status HTTP status, 0 if no response has been received
+ */
+static void mender_api_route_end(mender_api_route_t *route, mender_err_t ret, int status);
+
+/**
+ * @brief Update the statistics of the API following a HTTP request
+ * @param ret Result of the HTTP request
+ * @param status HTTP status, 0 if no response has been received
+ */
+static void mender_api_stats_request(mender_err_t ret, int status);
+
+/**
+ * @brief Update the statistics of the API following an artifact download
+ * @param ret Result of the artifact download
+ * @param ctx Artifact context used to parse the artifact
+ * @param resumes Number of times the download has been resumed
+ * @param begin Uptime at the beginning of the download (milliseconds), 0 if not available
+ */
+static void mender_api_stats_download(mender_err_t ret, mender_artifact_ctx_t *ctx, size_t resumes, uint64_t begin);
+
+/**
+ * @brief Release the memory of a context and forget its token and entity tags, the configuration is kept
+ * @param ctx Context
+ */
+static void mender_api_ctx_clear(mender_api_ctx_t *ctx);
+
+/**
+ * @brief Release the last authentication request payload and its signature
+ */
+static void mender_api_release_authentication_request(void);
+
+/**
+ * @brief Decode the claims of the authentication token and save its lifetime, the lifetime is not known if the claims are not available
+ * @param jwt Authentication token
+ */
+static void mender_api_jwt_save_validity(char *jwt);
+
+/**
+ * @brief Decode data encoded with base64url, the padding is optional
+ * @param data Data to decode
+ * @param length Length of the data
+ * @return Decoded data, null terminated, if the function succeeds, NULL otherwise
+ */
+static char *mender_api_base64url_decode(const char *data, size_t length);
+
+/**
+ * @brief Initialize a response buffer
+ * @param response Response buffer
+ * @param buffer Buffer provided by the caller, NULL to allocate it from the heap when data is received, or to use the shared buffer of the tiny build
+ * @param size Size of the buffer provided by the caller
+ */
+static void mender_api_response_init(mender_api_response_t *response, char *buffer, size_t size);
+
+/**
+ * @brief Append data to a response buffer, the capacity grows geometrically
+ * @param response Response buffer
+ * @param data Data to append
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_response_append(mender_api_response_t *response, void *data, size_t length);
+
+/**
+ * @brief Release a response buffer
+ * @param response Response buffer
+ */
+static void mender_api_response_release(mender_api_response_t *response);
+
+/**
+ * @brief Initialize the JSON writer of a payload, it is written in the shared buffer of the tiny build or allocated from the heap
+ * @param writer JSON writer
  */
-static mender_api_config_t mender_api_config;
+static void mender_api_payload_init(mender_json_writer_t *writer);
 
 /**
- * @brief Authentication token
+ * @brief Release the JSON writer of a payload, the shared buffer of the tiny build is given back
+ * @param writer JSON writer
  */
-static char *mender_api_jwt = NULL;
+static void mender_api_payload_release(mender_json_writer_t *writer);
 
 /**
  * @brief HTTP callback used to handle text content
@@ -68,6 +460,85 @@ static mender_err_t mender_api_http_text_callback(mender_http_client_event_t eve
  */
 static mender_err_t mender_api_http_artifact_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params);
 
+/**
+ * @brief Pace the artifact download with a token bucket, the thread is suspended when the data received exceed the rate
+ * @note The connection is not read while the thread is suspended, the server is throttled by the flow control of the transport
+ * @param artifact_params Artifact parameters holding the bucket
+ * @param data_length Data length
+ */
+static void mender_api_download_pace(mender_api_artifact_params_t *artifact_params, size_t data_length);
+
+/**
+ * @brief Process the data of the artifact downloaded, the offset of the download is advanced and the download is paced
+ * @param artifact_params Artifact parameters
+ * @param data Data
+ * @param data_length Data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_download_process(mender_api_artifact_params_t *artifact_params, void *data, size_t data_length);
+
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+
+/**
+ * @brief Record the fragment received with the capture callback
+ * @param artifact_params Artifact parameters
+ * @param data_length Data length
+ */
+static void mender_api_download_capture(mender_api_artifact_params_t *artifact_params, size_t data_length);
+
+/**
+ * @brief Replay the fragments recorded, the data received is cut as the fragments and held in the buffer until the next fragment is complete
+ * @note The data held is dropped if the connection is lost, the download is resumed at the offset of the data processed so that it is downloaded again
+ * @param artifact_params Artifact parameters
+ * @param data Data
+ * @param data_length Data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_download_replay(mender_api_artifact_params_t *artifact_params, uint8_t *data, size_t data_length);
+
+/**
+ * @brief Deliver the next fragment replayed once its delay has elapsed since the previous fragment has been delivered
+ * @param artifact_params Artifact parameters
+ * @param data Data of the fragment
+ * @param data_length Data length, shorter than the fragment at the end of the artifact
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_download_deliver(mender_api_artifact_params_t *artifact_params, void *data, size_t data_length);
+
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+/**
+ * @brief Rewrite the URI of an artifact to download it from a mirror, the scheme of the URI is replaced by the base URL of the mirror
+ * @note The artifact "https://s3.example.com/artifacts/id?X-Amz-Signature=..." is downloaded from "<mirror>/s3.example.com/artifacts/id?X-Amz-Signature=..."
+ * @param uri URI of the artifact
+ * @param mirror Base URL of the mirror
+ * @return URI of the artifact on the mirror if the function succeeds, NULL otherwise, to be released with mender_utils_free
+ */
+static char *mender_api_mirror_uri(char *uri, char *mirror);
+
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+/**
+ * @brief Log buffer callback used to format the messages of the deployment logs payload
+ * @param level Log level
+ * @param uptime Uptime when the message has been logged (seconds)
+ * @param message Message
+ * @param length Length of the message
+ * @param params Callback parameters
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+/**
+ * @brief Format the uptime as a RFC 3339 timestamp, the device has no wall clock so that the uptime is counted from the epoch
+ * @param uptime Uptime (seconds)
+ * @param timestamp Timestamp
+ * @param size Size of the timestamp buffer
+ */
+static void mender_api_format_timestamp(uint32_t uptime, char *timestamp, size_t size);
+
+static mender_err_t mender_api_log_buffer_callback(uint8_t level, uint32_t uptime, const char *message, size_t length, void *params);
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
 
 /**
@@ -75,13 +546,59 @@ static mender_err_t mender_api_http_artifact_callback(mender_http_client_event_t
  * @param event Websocket client event
  * @param data Data received
  * @param data_length Data length
- * @param params Callback parameters
+ * @param params Context of the device of the connection with CONFIG_MENDER_CLIENT_CONTEXTS, callback of the data received otherwise
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t mender_api_websocket_callback(mender_websocket_client_event_t event, void *data, size_t data_length, void *params);
 
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
 
+#ifdef CONFIG_MENDER_API_JSON_TOKENIZER
+
+/**
+ * @brief Tokenize a JSON response in place, the tokens are counted first to be allocated at once
+ * @param response JSON response
+ * @param length Length of the JSON response
+ * @param tokens Tokens, the first one is the root of the document, to be released with mender_utils_free
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_tokenize_response(char *response, size_t length, mender_json_token_t **tokens);
+
+/**
+ * @brief Duplicate the value of a string token of a JSON response
+ * @param response JSON response, the string is decoded in place
+ * @param token String token, NULL if the value is not available
+ * @param value Duplicated value, to be released with mender_utils_free
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_token_strdup(char *response, mender_json_token_t *token, char **value);
+
+/**
+ * @brief Parse the deployment data of a JSON response in place
+ * @param response JSON response
+ * @param length Length of the JSON response
+ * @param deployment Deployment data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_parse_deployment(char *response, size_t length, mender_api_deployment_data_t *deployment);
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+/**
+ * @brief Parse the device configuration of a JSON response in place
+ * @param response JSON response
+ * @param length Length of the JSON response
+ * @param configuration Device configuration, the previous one is released
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_parse_configuration(char *response, size_t length, mender_keystore_t **configuration);
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+
+#endif /* CONFIG_MENDER_API_JSON_TOKENIZER */
+
 /**
  * @brief Print response error
  * @param response HTTP response, NULL if not available
@@ -89,6 +606,47 @@ static mender_err_t mender_api_websocket_callback(mender_websocket_client_event_
  */
 static void mender_api_print_response_error(char *response, int status);
 
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+/**
+ * @brief Perform the request downloading the device configuration, the server answers 304 if it has not changed since the last download
+ * @param response Response buffer
+ * @param etag Buffer used to return the entity tag of the response
+ * @param etag_size Size of the etag buffer
+ * @param status Status code
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_api_configuration_request(mender_api_response_t *response, char *etag, size_t etag_size, int *status);
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+
+#ifdef CONFIG_MENDER_API_BATCH
+
+/**
+ * @brief Perform the requests registered back-to-back with the deployment check, the callbacks are invoked once the responses are available
+ */
+static void mender_api_batch_perform(void);
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+/**
+ * @brief Consume the response of a request of the batches
+ * @param request Request
+ * @param response Response buffer, it is replaced by the response of the batch
+ * @param etag Buffer used to return the entity tag of the response, its size is MENDER_API_ETAG_LENGTH + 1
+ * @param status Status code
+ * @param ret Result of the request
+ * @return true if the response was available, false otherwise
+ */
+static bool mender_api_batch_consume(mender_api_batch_request_t request, mender_api_response_t *response, char *etag, int *status, mender_err_t *ret);
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+#endif /* CONFIG_MENDER_API_BATCH */
+
 mender_err_t
 mender_api_init(mender_api_config_t *config) {
 
@@ -99,16 +657,32 @@ mender_api_init(mender_api_config_t *config) {
     mender_err_t ret;
 
     /* Save configuration */
-    memcpy(&mender_api_config, config, sizeof(mender_api_config_t));
+    memcpy(&mender_api_ctx->config, config, sizeof(mender_api_config_t));
+    if (MENDER_OK != (ret = mender_api_hosts_parse(mender_api_ctx->config.host))) {
+        mender_log_error("Invalid server host configuration");
+        return ret;
+    }
+
+#ifdef CONFIG_MENDER_API_BATCH
+    /* Create the mutex of the batches */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_api_batch_mutex))) {
+        mender_log_error("Unable to create mutex");
+        return ret;
+    }
+    for (size_t index = 0; index < MENDER_API_BATCH_COUNT; index++) {
+        mender_api_response_init(&mender_api_ctx->batch[index].response, NULL, 0);
+    }
+#endif /* CONFIG_MENDER_API_BATCH */
 
-    /* Initializations */
-    mender_http_config_t mender_http_config = { .host = mender_api_config.host };
+    /* Initializations, the first host is the default of the HTTP and websocket clients, the requests are routed with absolute URLs otherwise */
+    mender_http_config_t mender_http_config = { .host = mender_api_hosts[0].url, .recv_buf_length = mender_api_ctx->config.http_recv_buf_length };
     if (MENDER_OK != (ret = mender_http_init(&mender_http_config))) {
         mender_log_error("Unable to initialize HTTP");
         return ret;
     }
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
-    mender_websocket_config_t mender_websocket_config = { .host = mender_api_config.host };
+    mender_websocket_config_t mender_websocket_config
+        = { .host = mender_api_hosts[0].url, .recv_buf_length = mender_api_ctx->config.websocket_recv_buf_length };
     if (MENDER_OK != (ret = mender_websocket_init(&mender_websocket_config))) {
         mender_log_error("Unable to initialize websocket");
         return ret;
@@ -122,17 +696,33 @@ mender_err_t
 mender_api_perform_authentication(mender_err_t (*get_identity)(mender_identity_t **identity)) {
 
     assert(NULL != get_identity);
-    mender_err_t       ret;
-    char              *public_key_pem       = NULL;
-    cJSON             *json_identity        = NULL;
-    mender_identity_t *identity             = NULL;
-    char              *unformatted_identity = NULL;
-    cJSON             *json_payload         = NULL;
-    char              *payload              = NULL;
-    char              *response             = NULL;
-    char              *signature            = NULL;
-    size_t             signature_length     = 0;
-    int                status               = 0;
+    mender_err_t          ret;
+    char                 *public_key_pem = NULL;
+    mender_identity_t    *identity       = NULL;
+#ifdef CONFIG_MENDER_TINY
+    char                 identity_buffer[MENDER_API_IDENTITY_LENGTH];
+    mender_json_writer_t identity_writer;
+    mender_json_writer_t writer;
+#else
+    cJSON *json_identity        = NULL;
+    char  *unformatted_identity = NULL;
+    cJSON *json_payload         = NULL;
+#endif /* CONFIG_MENDER_TINY */
+    char                 *payload          = NULL;
+    char                 *signature        = NULL;
+    size_t                signature_length = 0;
+    int                   status           = 0;
+    mender_api_route_t    route;
+    mender_api_response_t response;
+
+    /* Begin of the authentication */
+    mender_log_trace_begin(MENDER_LOG_TRACE_AUTHENTICATION);
+
+    /* Initialize payload and response buffers */
+#ifdef CONFIG_MENDER_TINY
+    mender_api_payload_init(&writer);
+#endif /* CONFIG_MENDER_TINY */
+    mender_api_response_init(&response, NULL, 0);
 
     /* Get public key in PEM format */
     if (MENDER_OK != (ret = mender_tls_get_public_key_pem(&public_key_pem))) {
@@ -147,15 +737,45 @@ mender_api_perform_authentication(mender_err_t (*get_identity)(mender_identity_t
     }
 
     /* Format identity */
-    if (MENDER_OK != (ret = mender_utils_identity_to_json(identity, &json_identity))) {
+#ifdef CONFIG_MENDER_TINY
+    mender_json_writer_init(&identity_writer, identity_buffer, sizeof(identity_buffer));
+    mender_json_writer_begin_object(&identity_writer, NULL);
+    mender_json_writer_add_string(&identity_writer, identity->name, identity->value);
+    mender_json_writer_end_object(&identity_writer);
+    if (MENDER_OK != (ret = mender_json_writer_end(&identity_writer))) {
         mender_log_error("Unable to format identity");
         goto END;
     }
-    if (NULL == (unformatted_identity = cJSON_PrintUnformatted(json_identity))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
+
+    /* Format payload, it is copied out of the shared buffer only if it must be signed */
+    mender_json_writer_begin_object(&writer, NULL);
+    mender_json_writer_add_string(&writer, "id_data", identity_writer.data);
+    mender_json_writer_add_string(&writer, "pubkey", public_key_pem);
+    if (NULL != mender_api_ctx->config.tenant_token) {
+        mender_json_writer_add_string(&writer, "tenant_token", mender_api_ctx->config.tenant_token);
+    }
+    mender_json_writer_end_object(&writer);
+    if (MENDER_OK != (ret = mender_json_writer_end(&writer))) {
+        mender_log_error("Unable to format payload");
+        goto END;
+    }
+    if ((NULL == mender_api_ctx->authentication_request.payload) || (0 != strcmp(mender_api_ctx->authentication_request.payload, writer.data))) {
+        if (NULL == (payload = mender_utils_strdup(writer.data))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+    }
+#else
+    if (MENDER_OK != (ret = mender_utils_identity_to_json(identity, &json_identity))) {
+        mender_log_error("Unable to format identity");
+        goto END;
+    }
+    if (NULL == (unformatted_identity = cJSON_PrintUnformatted(json_identity))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
 
     /* Format payload */
     if (NULL == (json_payload = cJSON_CreateObject())) {
@@ -165,95 +785,150 @@ mender_api_perform_authentication(mender_err_t (*get_identity)(mender_identity_t
     }
     cJSON_AddStringToObject(json_payload, "id_data", unformatted_identity);
     cJSON_AddStringToObject(json_payload, "pubkey", public_key_pem);
-    if (NULL != mender_api_config.tenant_token) {
-        cJSON_AddStringToObject(json_payload, "tenant_token", mender_api_config.tenant_token);
+    if (NULL != mender_api_ctx->config.tenant_token) {
+        cJSON_AddStringToObject(json_payload, "tenant_token", mender_api_ctx->config.tenant_token);
     }
     if (NULL == (payload = cJSON_PrintUnformatted(json_payload))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
+#endif /* CONFIG_MENDER_TINY */
+
+    /* Sign payload, the signature of the previous request is reused if the payload has not been modified */
+    if ((NULL != payload)
+        && ((NULL == mender_api_ctx->authentication_request.payload) || (0 != strcmp(mender_api_ctx->authentication_request.payload, payload)))) {
+        mender_log_trace_begin(MENDER_LOG_TRACE_SIGN);
+        ret = mender_tls_sign_payload(payload, &signature, &signature_length);
+        mender_log_trace_end(MENDER_LOG_TRACE_SIGN);
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to sign payload");
+            goto END;
+        }
+        mender_api_release_authentication_request();
+        mender_api_ctx->authentication_request.payload   = payload;
+        mender_api_ctx->authentication_request.signature = signature;
+        payload                                     = NULL;
+        signature                                   = NULL;
+    }
+
+    /* Probe the server hosts, the authentication and the following requests are routed to the best one */
+    mender_api_hosts_probe();
 
-    /* Sign payload */
-    if (MENDER_OK != (ret = mender_tls_sign_payload(payload, &signature, &signature_length))) {
-        mender_log_error("Unable to sign payload");
+    /* Route the request to the best server host */
+    if (MENDER_OK != (ret = mender_api_route_begin(&route, MENDER_API_PATH_POST_AUTHENTICATION_REQUESTS, false))) {
+        mender_log_error("Unable to route HTTP request");
         goto END;
     }
 
     /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(NULL,
-                                      MENDER_API_PATH_POST_AUTHENTICATION_REQUESTS,
-                                      MENDER_HTTP_POST,
-                                      payload,
-                                      signature,
-                                      &mender_api_http_text_callback,
-                                      (void *)&response,
-                                      &status))) {
+    ret = mender_http_perform(NULL,
+                              route.url,
+                              MENDER_HTTP_POST,
+                              mender_api_ctx->authentication_request.payload,
+                              mender_api_ctx->authentication_request.signature,
+                              &mender_api_http_text_callback,
+                              (void *)&response,
+                              &status);
+    mender_api_route_end(&route, ret, status);
+    mender_api_stats_request(ret, status);
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
 
     /* Treatment depending of the status */
     if (200 == status) {
-        if (NULL == response) {
+        if (0 == response.length) {
             mender_log_error("Response is empty");
             ret = MENDER_FAIL;
             goto END;
         }
-        if (NULL != mender_api_jwt) {
-            free(mender_api_jwt);
+        if (NULL != mender_api_ctx->jwt) {
+            mender_utils_free(mender_api_ctx->jwt);
         }
-        if (NULL == (mender_api_jwt = strdup(response))) {
+        if (NULL == (mender_api_ctx->jwt = mender_utils_strdup(response.data))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
         }
+        mender_api_jwt_save_validity(mender_api_ctx->jwt);
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.data, status);
         ret = MENDER_FAIL;
     }
 
 END:
 
+    /* Update statistics */
+    __atomic_add_fetch((MENDER_OK == ret) ? &mender_api_stats.authentication.successes : &mender_api_stats.authentication.failures, 1, __ATOMIC_RELAXED);
+    mender_log_trace_end(MENDER_LOG_TRACE_AUTHENTICATION);
+
     /* Release memory */
-    free(unformatted_identity);
-    if (NULL != response) {
-        free(response);
-    }
+#ifdef CONFIG_MENDER_TINY
+    mender_api_payload_release(&writer);
+#else
+    mender_utils_free(unformatted_identity);
+#endif /* CONFIG_MENDER_TINY */
+    mender_api_response_release(&response);
     if (NULL != signature) {
-        free(signature);
+        mender_utils_free(signature);
     }
     if (NULL != payload) {
-        free(payload);
+        mender_utils_free(payload);
     }
+#ifndef CONFIG_MENDER_TINY
     if (NULL != json_payload) {
         cJSON_Delete(json_payload);
     }
     if (NULL != json_identity) {
         cJSON_Delete(json_identity);
     }
+#endif /* CONFIG_MENDER_TINY */
     if (NULL != public_key_pem) {
-        free(public_key_pem);
+        mender_utils_free(public_key_pem);
     }
 
     return ret;
 }
 
+mender_err_t
+mender_api_get_authentication_validity(uint32_t *validity) {
+
+    assert(NULL != validity);
+    uint64_t now;
+
+    /* Check if the lifetime of the token is known */
+    if ((NULL == mender_api_ctx->jwt) || (0 == mender_api_ctx->jwt_validity.lifetime) || (MENDER_OK != mender_scheduler_get_uptime(&now))) {
+        return MENDER_NOT_FOUND;
+    }
+
+    /* Compute the remaining validity */
+    uint64_t elapsed = (now - mender_api_ctx->jwt_validity.timestamp) / 1000;
+    *validity        = (elapsed < mender_api_ctx->jwt_validity.lifetime) ? (uint32_t)(mender_api_ctx->jwt_validity.lifetime - elapsed) : 0;
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_api_check_for_deployment(mender_api_deployment_data_t *deployment) {
 
     assert(NULL != deployment);
-    mender_err_t ret;
-    char        *path     = NULL;
-    char        *response = NULL;
-    int          status   = 0;
+    mender_err_t          ret;
+    char                 *path   = NULL;
+    int                   status = 0;
+    mender_api_route_t    route;
+    char                  etag[MENDER_API_ETAG_LENGTH + 1];
+    mender_api_response_t response;
+
+    /* Initialize response buffer */
+    mender_api_response_init(&response, NULL, 0);
 
     /* Compute path */
-    size_t str_length = strlen("?artifact_name=&device_type=") + strlen(MENDER_API_PATH_GET_NEXT_DEPLOYMENT) + strlen(mender_api_config.artifact_name)
-                        + strlen(mender_api_config.device_type) + 1;
-    if (NULL == (path = (char *)malloc(str_length))) {
+    size_t str_length = strlen("?artifact_name=&device_type=") + strlen(MENDER_API_PATH_GET_NEXT_DEPLOYMENT) + strlen(mender_api_ctx->config.artifact_name)
+                        + strlen(mender_api_ctx->config.device_type) + 1;
+    if (NULL == (path = (char *)mender_utils_malloc(str_length))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -262,23 +937,56 @@ mender_api_check_for_deployment(mender_api_deployment_data_t *deployment) {
              str_length,
              "%s?artifact_name=%s&device_type=%s",
              MENDER_API_PATH_GET_NEXT_DEPLOYMENT,
-             mender_api_config.artifact_name,
-             mender_api_config.device_type);
+             mender_api_ctx->config.artifact_name,
+             mender_api_ctx->config.device_type);
 
-    /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_jwt, path, MENDER_HTTP_GET, NULL, NULL, &mender_api_http_text_callback, (void *)&response, &status))) {
+    /* Route the request to the best server host */
+    if (MENDER_OK != (ret = mender_api_route_begin(&route, path, false))) {
+        mender_log_error("Unable to route HTTP request");
+        goto END;
+    }
+
+    /* Perform HTTP request, the server answers 304 if there is still no deployment since the last check */
+    ret = mender_http_perform_conditional(mender_api_ctx->jwt,
+                                          route.url,
+                                          MENDER_HTTP_GET,
+                                          NULL,
+                                          NULL,
+                                          mender_api_ctx->deployment_etag,
+                                          etag,
+                                          sizeof(etag),
+                                          &mender_api_http_text_callback,
+                                          (void *)&response,
+                                          &status);
+    mender_api_route_end(&route, ret, status);
+    mender_api_stats_request(ret, status);
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
 
+    /* Only the entity tag of a response without deployment is cached, so that a deployment is never skipped */
+    if (204 == status) {
+        strcpy(mender_api_ctx->deployment_etag, etag);
+    } else if (304 != status) {
+        mender_api_ctx->deployment_etag[0] = '\0';
+    }
+#ifdef CONFIG_MENDER_API_BATCH
+
+    /* Perform the requests registered back-to-back, the connection of the deployment check is reused */
+    mender_api_batch_perform();
+#endif /* CONFIG_MENDER_API_BATCH */
+
     /* Treatment depending of the status */
     if (200 == status) {
-        cJSON *json_response = cJSON_Parse(response);
+#ifdef CONFIG_MENDER_API_JSON_TOKENIZER
+        ret = mender_api_parse_deployment(response.data, response.length, deployment);
+#else
+        cJSON *json_response = cJSON_Parse(response.data);
         if (NULL != json_response) {
             cJSON *json_id = cJSON_GetObjectItem(json_response, "id");
             if (NULL != json_id) {
-                if (NULL == (deployment->id = strdup(cJSON_GetStringValue(json_id)))) {
+                if (NULL == (deployment->id = mender_utils_strdup(cJSON_GetStringValue(json_id)))) {
                     ret = MENDER_FAIL;
                     goto END;
                 }
@@ -287,7 +995,7 @@ mender_api_check_for_deployment(mender_api_deployment_data_t *deployment) {
             if (NULL != json_artifact) {
                 cJSON *json_artifact_name = cJSON_GetObjectItem(json_artifact, "artifact_name");
                 if (NULL != json_artifact_name) {
-                    if (NULL == (deployment->artifact_name = strdup(cJSON_GetStringValue(json_artifact_name)))) {
+                    if (NULL == (deployment->artifact_name = mender_utils_strdup(cJSON_GetStringValue(json_artifact_name)))) {
                         ret = MENDER_FAIL;
                         goto END;
                     }
@@ -296,7 +1004,7 @@ mender_api_check_for_deployment(mender_api_deployment_data_t *deployment) {
                 if (NULL != json_source) {
                     cJSON *json_uri = cJSON_GetObjectItem(json_source, "uri");
                     if (NULL != json_uri) {
-                        if (NULL == (deployment->uri = strdup(cJSON_GetStringValue(json_uri)))) {
+                        if (NULL == (deployment->uri = mender_utils_strdup(cJSON_GetStringValue(json_uri)))) {
                             ret = MENDER_FAIL;
                             goto END;
                         }
@@ -312,7 +1020,7 @@ mender_api_check_for_deployment(mender_api_deployment_data_t *deployment) {
                 cJSON *json_device_types_compatible = cJSON_GetObjectItem(json_artifact, "device_types_compatible");
                 if (NULL != json_device_types_compatible && cJSON_IsArray(json_device_types_compatible)) {
                     deployment->device_types_compatible_size = cJSON_GetArraySize(json_device_types_compatible);
-                    deployment->device_types_compatible      = (char **)malloc(deployment->device_types_compatible_size * sizeof(char *));
+                    deployment->device_types_compatible      = (char **)mender_utils_malloc(deployment->device_types_compatible_size * sizeof(char *));
                     if (NULL == deployment->device_types_compatible) {
                         mender_log_error("Unable to allocate memory");
                         ret = MENDER_FAIL;
@@ -321,7 +1029,7 @@ mender_api_check_for_deployment(mender_api_deployment_data_t *deployment) {
                     for (size_t i = 0; i < deployment->device_types_compatible_size; i++) {
                         cJSON *json_device_type = cJSON_GetArrayItem(json_device_types_compatible, i);
                         if (NULL != json_device_type && cJSON_IsString(json_device_type)) {
-                            if (NULL == (deployment->device_types_compatible[i] = strdup(cJSON_GetStringValue(json_device_type)))) {
+                            if (NULL == (deployment->device_types_compatible[i] = mender_utils_strdup(cJSON_GetStringValue(json_device_type)))) {
                                 ret = MENDER_FAIL;
                                 goto END;
                             }
@@ -343,38 +1051,43 @@ mender_api_check_for_deployment(mender_api_deployment_data_t *deployment) {
             mender_log_error("Invalid response");
             ret = MENDER_FAIL;
         }
-    } else if (204 == status) {
+#endif /* CONFIG_MENDER_API_JSON_TOKENIZER */
+    } else if ((204 == status) || (304 == status)) {
         /* No response expected */
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.data, status);
         ret = MENDER_FAIL;
     }
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
-    }
+    mender_api_response_release(&response);
     if (NULL != path) {
-        free(path);
+        mender_utils_free(path);
     }
 
     return ret;
 }
 
 mender_err_t
-mender_api_publish_deployment_status(char *id, mender_deployment_status_t deployment_status) {
+mender_api_publish_deployment_status(char *id, mender_deployment_status_t deployment_status, char *substate) {
 
     assert(NULL != id);
-    mender_err_t ret;
-    char        *value        = NULL;
-    cJSON       *json_payload = NULL;
-    char        *payload      = NULL;
-    char        *path         = NULL;
-    char        *response     = NULL;
-    int          status       = 0;
+    mender_err_t          ret;
+    char                 *value  = NULL;
+    char                 *path   = NULL;
+    int                   status = 0;
+    mender_api_route_t    route;
+    char                  payload[MENDER_API_DEPLOYMENT_STATUS_PAYLOAD_LENGTH];
+    char                  buffer[MENDER_API_RESPONSE_STATIC_LENGTH];
+    mender_json_writer_t  writer;
+    mender_api_response_t response;
+
+    /* Initialize payload and response buffers, no response is expected unless an error occurs */
+    mender_json_writer_init(&writer, payload, sizeof(payload));
+    mender_api_response_init(&response, buffer, sizeof(buffer));
 
     /* Deployment status to string */
     if (NULL == (value = mender_utils_deployment_status_to_string(deployment_status))) {
@@ -384,30 +1097,37 @@ mender_api_publish_deployment_status(char *id, mender_deployment_status_t deploy
     }
 
     /* Format payload */
-    if (NULL == (json_payload = cJSON_CreateObject())) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
+    mender_json_writer_begin_object(&writer, NULL);
+    mender_json_writer_add_string(&writer, "status", value);
+    if (NULL != substate) {
+        mender_json_writer_add_string(&writer, "substate", substate);
     }
-    cJSON_AddStringToObject(json_payload, "status", value);
-    if (NULL == (payload = cJSON_PrintUnformatted(json_payload))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+    mender_json_writer_end_object(&writer);
+    if (MENDER_OK != (ret = mender_json_writer_end(&writer))) {
+        mender_log_error("Unable to format payload");
         goto END;
     }
 
     /* Compute path */
     size_t str_length = strlen(MENDER_API_PATH_PUT_DEPLOYMENT_STATUS) - strlen("%s") + strlen(id) + 1;
-    if (NULL == (path = (char *)malloc(str_length))) {
+    if (NULL == (path = (char *)mender_utils_malloc(str_length))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
     snprintf(path, str_length, MENDER_API_PATH_PUT_DEPLOYMENT_STATUS, id);
 
+    /* Route the request to the best server host */
+    if (MENDER_OK != (ret = mender_api_route_begin(&route, path, false))) {
+        mender_log_error("Unable to route HTTP request");
+        goto END;
+    }
+
     /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_jwt, path, MENDER_HTTP_PUT, payload, NULL, &mender_api_http_text_callback, (void *)&response, &status))) {
+    ret = mender_http_perform(mender_api_ctx->jwt, route.url, MENDER_HTTP_PUT, writer.data, NULL, &mender_api_http_text_callback, (void *)&response, &status);
+    mender_api_route_end(&route, ret, status);
+    mender_api_stats_request(ret, status);
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
@@ -417,54 +1137,300 @@ mender_api_publish_deployment_status(char *id, mender_deployment_status_t deploy
         /* No response expected */
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.data, status);
         ret = MENDER_FAIL;
     }
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
-    }
+    mender_api_response_release(&response);
+    mender_json_writer_release(&writer);
     if (NULL != path) {
-        free(path);
-    }
-    if (NULL != payload) {
-        free(payload);
-    }
-    if (NULL != json_payload) {
-        cJSON_Delete(json_payload);
+        mender_utils_free(path);
     }
 
     return ret;
 }
 
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
 mender_err_t
-mender_api_download_artifact(char *uri, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+mender_api_publish_deployment_logs(char *id) {
 
-    assert(NULL != uri);
-    assert(NULL != callback);
-    mender_err_t ret;
-    int          status = 0;
+    assert(NULL != id);
+    mender_err_t             ret;
+    char                    *path   = NULL;
+    int                      status = 0;
+    mender_api_route_t       route;
+    uint32_t                 end    = 0;
+    char                     buffer[MENDER_API_RESPONSE_STATIC_LENGTH];
+    mender_json_writer_t     writer;
+    mender_api_response_t    response;
+    mender_api_logs_params_t params = { .writer = &writer, .count = 0 };
+
+    /* Initialize payload and response buffers, the payload is allocated from the heap, no response is expected unless an error occurs */
+    mender_json_writer_init(&writer, NULL, 0);
+    mender_api_response_init(&response, buffer, sizeof(buffer));
+
+    /* Format payload, the messages remain in the log buffer until they have been published */
+    mender_json_writer_begin_object(&writer, NULL);
+    mender_json_writer_begin_array(&writer, "messages");
+    if (MENDER_OK != (ret = mender_log_buffer_read(&mender_api_log_buffer_callback, &params, &end))) {
+        mender_log_error("Unable to read log buffer");
+        goto END;
+    }
+    mender_json_writer_end_array(&writer);
+    mender_json_writer_end_object(&writer);
+    if (MENDER_OK != (ret = mender_json_writer_end(&writer))) {
+        mender_log_error("Unable to format payload");
+        goto END;
+    }
+
+    /* Nothing to publish if the log buffer is empty */
+    if (0 == params.count) {
+        ret = MENDER_DONE;
+        goto END;
+    }
+
+    /* Compute path */
+    size_t str_length = strlen(MENDER_API_PATH_PUT_DEPLOYMENT_LOGS) - strlen("%s") + strlen(id) + 1;
+    if (NULL == (path = (char *)mender_utils_malloc(str_length))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    snprintf(path, str_length, MENDER_API_PATH_PUT_DEPLOYMENT_LOGS, id);
+
+    /* Route the request to the best server host */
+    if (MENDER_OK != (ret = mender_api_route_begin(&route, path, false))) {
+        mender_log_error("Unable to route HTTP request");
+        goto END;
+    }
 
     /* Perform HTTP request */
-    if (MENDER_OK != (ret = mender_http_perform(NULL, uri, MENDER_HTTP_GET, NULL, NULL, &mender_api_http_artifact_callback, callback, &status))) {
+    ret = mender_http_perform(mender_api_ctx->jwt, route.url, MENDER_HTTP_PUT, writer.data, NULL, &mender_api_http_text_callback, (void *)&response, &status);
+    mender_api_route_end(&route, ret, status);
+    mender_api_stats_request(ret, status);
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
 
     /* Treatment depending of the status */
-    if (200 == status) {
-        /* Nothing to do */
+    if (204 == status) {
+        /* Remove the messages published, the ones logged meanwhile are kept */
+        mender_log_buffer_consume(end);
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(NULL, status);
+        mender_api_print_response_error(response.data, status);
         ret = MENDER_FAIL;
     }
 
 END:
 
+    /* Release memory */
+    mender_api_response_release(&response);
+    mender_json_writer_release(&writer);
+    if (NULL != path) {
+        mender_utils_free(path);
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
+mender_err_t
+mender_api_set_download_rate(uint32_t rate) {
+
+    /* Set the rate, it is applied to the download in progress (if any) */
+    mender_api_download_rate = rate;
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+
+mender_err_t
+mender_api_set_download_capture(void (*callback)(mender_api_download_fragment_t *, void *), void *params) {
+
+    /* Set the capture, it begins with the next download */
+    mender_api_download_pattern.callback = callback;
+    mender_api_download_pattern.params   = params;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_api_set_download_replay(const mender_api_download_fragment_t *fragments, size_t count) {
+
+    size_t maximum = 0;
+
+    /* Check the fragments, the longest one gives the length of the buffer used to cut the data received */
+    if (NULL != fragments) {
+        if (0 == count) {
+            mender_log_error("Invalid fragments");
+            return MENDER_FAIL;
+        }
+        for (size_t index = 0; index < count; index++) {
+            if (0 == fragments[index].length) {
+                mender_log_error("Invalid fragment %zu", index);
+                return MENDER_FAIL;
+            }
+            if (fragments[index].length > maximum) {
+                maximum = fragments[index].length;
+            }
+        }
+    }
+
+    /* Set the replay, it begins with the next download */
+    mender_api_download_pattern.fragments = fragments;
+    mender_api_download_pattern.count     = (NULL != fragments) ? count : 0;
+    mender_api_download_pattern.maximum   = maximum;
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+mender_err_t
+mender_api_get_stats(mender_api_stats_t *stats) {
+
+    assert(NULL != stats);
+
+    /* Retrieve the statistics */
+    stats->http.requests = __atomic_load_n(&mender_api_stats.http.requests, __ATOMIC_RELAXED);
+    stats->http.errors   = __atomic_load_n(&mender_api_stats.http.errors, __ATOMIC_RELAXED);
+    for (size_t index = 0; index < sizeof(stats->http.status) / sizeof(stats->http.status[0]); index++) {
+        stats->http.status[index] = __atomic_load_n(&mender_api_stats.http.status[index], __ATOMIC_RELAXED);
+    }
+    stats->http.received            = __atomic_load_n(&mender_api_stats.http.received, __ATOMIC_RELAXED);
+    stats->authentication.successes = __atomic_load_n(&mender_api_stats.authentication.successes, __ATOMIC_RELAXED);
+    stats->authentication.failures  = __atomic_load_n(&mender_api_stats.authentication.failures, __ATOMIC_RELAXED);
+    stats->download.successes       = __atomic_load_n(&mender_api_stats.download.successes, __ATOMIC_RELAXED);
+    stats->download.failures        = __atomic_load_n(&mender_api_stats.download.failures, __ATOMIC_RELAXED);
+    stats->download.resumes         = __atomic_load_n(&mender_api_stats.download.resumes, __ATOMIC_RELAXED);
+    stats->download.received        = __atomic_load_n(&mender_api_stats.download.received, __ATOMIC_RELAXED);
+    stats->download.copied          = __atomic_load_n(&mender_api_stats.download.copied, __ATOMIC_RELAXED);
+    stats->download.length          = __atomic_load_n(&mender_api_stats.download.length, __ATOMIC_RELAXED);
+    stats->download.duration        = __atomic_load_n(&mender_api_stats.download.duration, __ATOMIC_RELAXED);
+    stats->download.throughput      = __atomic_load_n(&mender_api_stats.download.throughput, __ATOMIC_RELAXED);
+    stats->websocket.connections    = __atomic_load_n(&mender_api_stats.websocket.connections, __ATOMIC_RELAXED);
+    stats->websocket.failures       = __atomic_load_n(&mender_api_stats.websocket.failures, __ATOMIC_RELAXED);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_api_download_artifact(char                  *uri,
+                             char                  *mirror,
+                             mender_artifact_ctx_t *ctx,
+                             mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t)) {
+
+    assert(NULL != uri);
+    assert(NULL != ctx);
+    assert(NULL != callback);
+    mender_err_t                 ret;
+    int                          status = 0;
+    mender_api_artifact_params_t params = { .ctx = ctx, .callback = callback, .offset = 0, .failed = false, .tokens = 0, .timestamp = 0 };
+    uint64_t                     begin  = 0;
+    char                        *source = NULL;
+
+    /* Save the beginning of the download, it is used to compute the throughput */
+    mender_scheduler_get_uptime(&begin);
+
+    /* Rewrite the URI to download the artifact from the mirror, the mirror is skipped once if it has previously served an invalid response */
+    if ((NULL != mirror) && ('\0' != mirror[0])) {
+        if (true == mender_api_ctx->mirror_bypass) {
+            mender_log_warning("Mirror has previously failed, downloading artifact from the server");
+            mender_api_ctx->mirror_bypass = false;
+        } else if (NULL == (source = mender_api_mirror_uri(uri, mirror))) {
+            mender_log_warning("Unable to rewrite artifact URI, downloading artifact from the server");
+        }
+    }
+
+    /* Perform HTTP request, the parser and the artifact context are kept so that the download is resumed where it stopped if the connection is lost */
+    size_t attempt = 0;
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+    /* Copy the capture and the replay, the fragments replayed are cut in a buffer holding the longest one */
+    params.capture        = mender_api_download_pattern.callback;
+    params.capture_params = mender_api_download_pattern.params;
+    if (NULL != mender_api_download_pattern.fragments) {
+        if (NULL == (params.buffer = (uint8_t *)mender_utils_malloc(mender_api_download_pattern.maximum))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        params.fragments = mender_api_download_pattern.fragments;
+        params.count     = mender_api_download_pattern.count;
+    }
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+    for (;;) {
+        size_t start = params.offset;
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+        /* Drop the data held, it is downloaded again from the offset, the delays of the fragments are counted from the request */
+        params.length = 0;
+        mender_scheduler_get_uptime(&params.received);
+        params.delivered = params.received;
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+        ret = mender_http_perform_range(
+            NULL, (NULL != source) ? source : uri, MENDER_HTTP_GET, NULL, NULL, params.offset, &mender_api_http_artifact_callback, &params, &status);
+        mender_api_stats_request(ret, status);
+        bool expected = ((0 == start) ? (200 == status) : (206 == status));
+        if ((MENDER_OK == ret) && (true == expected)) {
+            break;
+        }
+
+        /* Fall back to the server if the mirror fails, the download is resumed if the data already processed comes from a valid response */
+        if (NULL != source) {
+            if ((true == params.failed) || ((params.offset > start) && (false == expected) && (0 != status))) {
+                mender_log_error("Mirror has served an invalid response, it is skipped for the next download");
+                mender_api_ctx->mirror_bypass = true;
+                ret                      = MENDER_FAIL;
+                goto END;
+            }
+            mender_log_warning("Unable to download artifact from the mirror, downloading from the server at offset %zu", params.offset);
+            mender_utils_free(source);
+            source = NULL;
+            status = 0;
+            continue;
+        }
+
+        /* Treatment depending of the status, the server must return the requested range only if the download has been resumed */
+        if (MENDER_OK == ret) {
+            mender_api_print_response_error(NULL, status);
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        if ((true == params.failed) || (0 == params.offset) || (MENDER_NOT_IMPLEMENTED == ret) || (attempt >= CONFIG_MENDER_API_DOWNLOAD_RESUME_ATTEMPTS)) {
+            mender_log_error("Unable to perform HTTP request");
+            goto END;
+        }
+        attempt++;
+        mender_log_warning(
+            "Connection lost, resuming download at offset %zu (attempt %zu/%d)", params.offset, attempt, CONFIG_MENDER_API_DOWNLOAD_RESUME_ATTEMPTS);
+        status = 0;
+    }
+
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+    /* Deliver the data held, the end of the artifact is shorter than the fragment replayed */
+    if (params.length > 0) {
+        ret = mender_api_download_deliver(&params, params.buffer, params.length);
+    }
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+END:
+
+    /* Update statistics */
+    mender_api_stats_download(ret, ctx, attempt, begin);
+
+    /* Release memory */
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+    mender_utils_free(params.buffer);
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+    mender_utils_free(source);
+
     return ret;
 }
 
@@ -475,27 +1441,37 @@ mender_err_t
 mender_api_download_configuration_data(mender_keystore_t **configuration) {
 
     assert(NULL != configuration);
-    mender_err_t ret;
-    char        *response = NULL;
-    int          status   = 0;
-
-    /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_jwt,
-                                      MENDER_API_PATH_GET_DEVICE_CONFIGURATION,
-                                      MENDER_HTTP_GET,
-                                      NULL,
-                                      NULL,
-                                      &mender_api_http_text_callback,
-                                      (void *)&response,
-                                      &status))) {
+    mender_err_t          ret;
+    int                   status = 0;
+    char                  etag[MENDER_API_ETAG_LENGTH + 1];
+    mender_api_response_t response;
+
+    /* Initialize response buffer */
+    mender_api_response_init(&response, NULL, 0);
+
+    /* Perform HTTP request, the response downloaded with the last deployment check is used if it has not been consumed yet */
+#ifdef CONFIG_MENDER_API_BATCH
+    if (false == mender_api_batch_consume(MENDER_API_BATCH_CONFIGURATION, &response, etag, &status, &ret)) {
+        ret = mender_api_configuration_request(&response, etag, sizeof(etag), &status);
+    }
+#else
+    ret = mender_api_configuration_request(&response, etag, sizeof(etag), &status);
+#endif /* CONFIG_MENDER_API_BATCH */
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
 
     /* Treatment depending of the status */
     if (200 == status) {
-        cJSON *json_response = cJSON_Parse(response);
+        mender_api_ctx->configuration_etag[0] = '\0';
+#ifdef CONFIG_MENDER_API_JSON_TOKENIZER
+        if (MENDER_OK != (ret = mender_api_parse_configuration(response.data, response.length, configuration))) {
+            mender_log_error("Unable to set configuration");
+            goto END;
+        }
+#else
+        cJSON *json_response = cJSON_Parse(response.data);
         if (NULL == json_response) {
             mender_log_error("Unable to set configuration");
             goto END;
@@ -506,17 +1482,21 @@ mender_api_download_configuration_data(mender_keystore_t **configuration) {
             goto END;
         }
         cJSON_Delete(json_response);
+#endif /* CONFIG_MENDER_API_JSON_TOKENIZER */
+        strcpy(mender_api_ctx->configuration_etag, etag);
+    } else if (304 == status) {
+        /* Configuration has not changed */
+        mender_log_debug("Device configuration has not changed");
+        *configuration = NULL;
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.data, status);
         ret = MENDER_FAIL;
     }
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
-    }
+    mender_api_response_release(&response);
 
     return ret;
 }
@@ -526,33 +1506,50 @@ END:
 mender_err_t
 mender_api_publish_configuration_data(mender_keystore_t *configuration) {
 
-    mender_err_t ret;
-    cJSON       *json_configuration = NULL;
-    char        *payload            = NULL;
-    char        *response           = NULL;
-    int          status             = 0;
+    mender_err_t          ret;
+    int                   status = 0;
+    mender_api_route_t    route;
+    char                  buffer[MENDER_API_RESPONSE_STATIC_LENGTH];
+    mender_json_writer_t  writer;
+    mender_api_response_t response;
+
+    /* Initialize payload and response buffers, the payload is allocated from the heap, no response is expected unless an error occurs */
+    mender_json_writer_init(&writer, NULL, 0);
+    mender_api_response_init(&response, buffer, sizeof(buffer));
 
     /* Format payload */
-    if (MENDER_OK != (ret = mender_utils_keystore_to_json(configuration, &json_configuration))) {
+    mender_json_writer_begin_object(&writer, NULL);
+    if (NULL != configuration) {
+        size_t index = 0;
+        while ((NULL != configuration[index].name) && (NULL != configuration[index].value)) {
+            mender_json_writer_add_string(&writer, configuration[index].name, configuration[index].value);
+            index++;
+        }
+    }
+    mender_json_writer_end_object(&writer);
+    if (MENDER_OK != (ret = mender_json_writer_end(&writer))) {
         mender_log_error("Unable to format payload");
         goto END;
     }
-    if (NULL == (payload = cJSON_PrintUnformatted(json_configuration))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+
+    /* Route the request to the best server host */
+    if (MENDER_OK != (ret = mender_api_route_begin(&route, MENDER_API_PATH_PUT_DEVICE_CONFIGURATION, false))) {
+        mender_log_error("Unable to route HTTP request");
         goto END;
     }
 
     /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_jwt,
-                                      MENDER_API_PATH_PUT_DEVICE_CONFIGURATION,
-                                      MENDER_HTTP_PUT,
-                                      payload,
-                                      NULL,
-                                      &mender_api_http_text_callback,
-                                      (void *)&response,
-                                      &status))) {
+    ret = mender_http_perform(mender_api_ctx->jwt,
+                              route.url,
+                              MENDER_HTTP_PUT,
+                              writer.data,
+                              NULL,
+                              &mender_api_http_text_callback,
+                              (void *)&response,
+                              &status);
+    mender_api_route_end(&route, ret, status);
+    mender_api_stats_request(ret, status);
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
@@ -562,22 +1559,15 @@ mender_api_publish_configuration_data(mender_keystore_t *configuration) {
         /* No response expected */
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.data, status);
         ret = MENDER_FAIL;
     }
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
-    }
-    if (NULL != payload) {
-        free(payload);
-    }
-    if (NULL != json_configuration) {
-        cJSON_Delete(json_configuration);
-    }
+    mender_api_response_release(&response);
+    mender_json_writer_release(&writer);
 
     return ret;
 }
@@ -587,18 +1577,45 @@ END:
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
 
 mender_err_t
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+mender_api_troubleshoot_connect(mender_err_t (*callback)(void *, size_t, void *), void *arg, void **handle) {
+#else
 mender_api_troubleshoot_connect(mender_err_t (*callback)(void *, size_t), void **handle) {
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
-    mender_err_t ret;
+    assert(NULL != callback);
+    mender_err_t       ret;
+    mender_api_route_t route;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Save the callback, the websocket thread retrieves it from the context of the device */
+    mender_api_ctx->troubleshoot.callback = callback;
+    mender_api_ctx->troubleshoot.arg      = arg;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Route the connection to the best server host */
+    if (MENDER_OK != (ret = mender_api_route_begin(&route, MENDER_API_PATH_GET_DEVICE_CONNECT, true))) {
+        mender_log_error("Unable to route websocket connection");
+        goto END;
+    }
 
     /* Open websocket connection */
-    if (MENDER_OK != (ret = mender_websocket_connect(mender_api_jwt, MENDER_API_PATH_GET_DEVICE_CONNECT, &mender_api_websocket_callback, callback, handle))) {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    ret = mender_websocket_connect(mender_api_ctx->jwt, route.url, &mender_api_websocket_callback, mender_api_ctx, handle);
+#else
+    ret = mender_websocket_connect(mender_api_ctx->jwt, route.url, &mender_api_websocket_callback, callback, handle);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    mender_api_route_end(&route, ret, 0);
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to open websocket connection");
         goto END;
     }
 
 END:
 
+    /* Update statistics */
+    __atomic_add_fetch((MENDER_OK == ret) ? &mender_api_stats.websocket.connections : &mender_api_stats.websocket.failures, 1, __ATOMIC_RELAXED);
+
     return ret;
 }
 
@@ -609,7 +1626,27 @@ mender_api_troubleshoot_send(void *handle, void *payload, size_t length) {
 
     /* Send data over websocket connection */
     if (MENDER_OK != (ret = mender_websocket_send(handle, payload, length))) {
-        mender_log_error("Unable to send data over websocket connection");
+        if (MENDER_BUSY != ret) {
+            mender_log_error("Unable to send data over websocket connection");
+        }
+        goto END;
+    }
+
+END:
+
+    return ret;
+}
+
+mender_err_t
+mender_api_troubleshoot_send_v(void *handle, mender_websocket_segment_t *segments, size_t count) {
+
+    mender_err_t ret;
+
+    /* Send data over websocket connection */
+    if (MENDER_OK != (ret = mender_websocket_send_v(handle, segments, count))) {
+        if (MENDER_BUSY != ret) {
+            mender_log_error("Unable to send data over websocket connection");
+        }
         goto END;
     }
 
@@ -639,77 +1676,69 @@ END:
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY
 
 mender_err_t
-mender_api_publish_inventory_data(mender_keystore_t *inventory) {
-
-    mender_err_t ret;
-    char        *payload  = NULL;
-    char        *response = NULL;
-    int          status   = 0;
-
-    /* Format payload */
-    cJSON *object = cJSON_CreateArray();
-    if (NULL == object) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    cJSON *item = cJSON_CreateObject();
-    if (NULL == item) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    cJSON_AddStringToObject(item, "name", "artifact_name");
-    cJSON_AddStringToObject(item, "value", mender_api_config.artifact_name);
-    cJSON_AddItemToArray(object, item);
-    item = cJSON_CreateObject();
-    if (NULL == item) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    cJSON_AddStringToObject(item, "name", "rootfs-image.version");
-    cJSON_AddStringToObject(item, "value", mender_api_config.artifact_name);
-    cJSON_AddItemToArray(object, item);
-    item = cJSON_CreateObject();
-    if (NULL == item) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
+mender_api_publish_inventory_data(mender_keystore_t *inventory, bool patch) {
+
+    mender_err_t          ret;
+    int                   status = 0;
+    mender_api_route_t    route;
+    char                  buffer[MENDER_API_RESPONSE_STATIC_LENGTH];
+    mender_json_writer_t  writer;
+    mender_api_response_t response;
+
+    /* Initialize payload and response buffers, no response is expected unless an error occurs */
+    mender_api_payload_init(&writer);
+    mender_api_response_init(&response, buffer, sizeof(buffer));
+
+    /* Format payload, the attributes of the client are only published when all the attributes are replaced */
+    mender_json_writer_begin_array(&writer, NULL);
+    if (false == patch) {
+        mender_json_writer_begin_object(&writer, NULL);
+        mender_json_writer_add_string(&writer, "name", "artifact_name");
+        mender_json_writer_add_string(&writer, "value", mender_api_ctx->config.artifact_name);
+        mender_json_writer_end_object(&writer);
+        mender_json_writer_begin_object(&writer, NULL);
+        mender_json_writer_add_string(&writer, "name", "rootfs-image.version");
+        mender_json_writer_add_string(&writer, "value", mender_api_ctx->config.artifact_name);
+        mender_json_writer_end_object(&writer);
+        mender_json_writer_begin_object(&writer, NULL);
+        mender_json_writer_add_string(&writer, "name", "device_type");
+        mender_json_writer_add_string(&writer, "value", mender_api_ctx->config.device_type);
+        mender_json_writer_end_object(&writer);
     }
-    cJSON_AddStringToObject(item, "name", "device_type");
-    cJSON_AddStringToObject(item, "value", mender_api_config.device_type);
-    cJSON_AddItemToArray(object, item);
     if (NULL != inventory) {
         size_t index = 0;
         while ((NULL != inventory[index].name) && (NULL != inventory[index].value)) {
-            if (NULL == (item = cJSON_CreateObject())) {
-                mender_log_error("Unable to allocate memory");
-                ret = MENDER_FAIL;
-                goto END;
-            }
-            cJSON_AddStringToObject(item, "name", inventory[index].name);
-            cJSON_AddStringToObject(item, "value", inventory[index].value);
-            cJSON_AddItemToArray(object, item);
+            mender_json_writer_begin_object(&writer, NULL);
+            mender_json_writer_add_string(&writer, "name", inventory[index].name);
+            mender_json_writer_add_string(&writer, "value", inventory[index].value);
+            mender_json_writer_end_object(&writer);
             index++;
         }
     }
-    if (NULL == (payload = cJSON_PrintUnformatted(object))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
+    mender_json_writer_end_array(&writer);
+    if (MENDER_OK != (ret = mender_json_writer_end(&writer))) {
+        mender_log_error("Unable to format payload");
+        goto END;
+    }
+
+    /* Route the request to the best server host */
+    if (MENDER_OK != (ret = mender_api_route_begin(&route, MENDER_API_PATH_PUT_DEVICE_ATTRIBUTES, false))) {
+        mender_log_error("Unable to route HTTP request");
         goto END;
     }
 
     /* Perform HTTP request */
-    if (MENDER_OK
-        != (ret = mender_http_perform(mender_api_jwt,
-                                      MENDER_API_PATH_PUT_DEVICE_ATTRIBUTES,
-                                      MENDER_HTTP_PUT,
-                                      payload,
-                                      NULL,
-                                      &mender_api_http_text_callback,
-                                      (void *)&response,
-                                      &status))) {
+    ret = mender_http_perform(mender_api_ctx->jwt,
+                              route.url,
+                              (true == patch) ? MENDER_HTTP_PATCH : MENDER_HTTP_PUT,
+                              writer.data,
+                              NULL,
+                              &mender_api_http_text_callback,
+                              (void *)&response,
+                              &status);
+    mender_api_route_end(&route, ret, status);
+    mender_api_stats_request(ret, status);
+    if (MENDER_OK != ret) {
         mender_log_error("Unable to perform HTTP request");
         goto END;
     }
@@ -719,56 +1748,429 @@ mender_api_publish_inventory_data(mender_keystore_t *inventory) {
         /* No response expected */
         ret = MENDER_OK;
     } else {
-        mender_api_print_response_error(response, status);
+        mender_api_print_response_error(response.data, status);
         ret = MENDER_FAIL;
     }
 
 END:
 
     /* Release memory */
-    if (NULL != response) {
-        free(response);
-    }
-    if (NULL != payload) {
-        free(payload);
-    }
-    if (NULL != object) {
-        cJSON_Delete(object);
-    }
+    mender_api_response_release(&response);
+    mender_api_payload_release(&writer);
 
     return ret;
 }
 
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
 
+#ifdef CONFIG_MENDER_API_BATCH
+
 mender_err_t
-mender_api_exit(void) {
+mender_api_batch_register(mender_api_batch_request_t request, mender_err_t (*callback)(void)) {
 
-    /* Release all modules */
-#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
-    mender_websocket_exit();
-#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
-    mender_http_exit();
+    assert(request < MENDER_API_BATCH_COUNT);
+    mender_err_t ret;
 
-    /* Release memory */
-    if (NULL != mender_api_jwt) {
-        free(mender_api_jwt);
-        mender_api_jwt = NULL;
+    /* Take mutex used to protect access to the batches */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_api_batch_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
     }
 
-    return MENDER_OK;
+    /* Register the request, the response which has not been consumed is forgotten when it is unregistered */
+    mender_api_ctx->batch[request].callback = callback;
+    if (NULL == callback) {
+        mender_api_response_release(&mender_api_ctx->batch[request].response);
+        mender_api_ctx->batch[request].available = false;
+    }
+
+    /* Release mutex used to protect access to the batches */
+    mender_scheduler_mutex_give(mender_api_batch_mutex);
+
+    return ret;
 }
 
-static mender_err_t
-mender_api_http_text_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
+#endif /* CONFIG_MENDER_API_BATCH */
 
-    assert(NULL != params);
-    char       **response = (char **)params;
-    mender_err_t ret      = MENDER_OK;
-    char        *tmp;
+#ifdef CONFIG_MENDER_API_CONTEXTS
 
-    /* Treatment depending of the event */
-    switch (event) {
+mender_api_ctx_t *
+mender_api_create_ctx(mender_api_config_t *config) {
+
+    assert(NULL != config);
+    assert(NULL != config->artifact_name);
+    assert(NULL != config->device_type);
+    mender_api_ctx_t *ctx;
+
+    /* Create the context, the responses of the batches are empty */
+    if (NULL == (ctx = (mender_api_ctx_t *)mender_utils_calloc(1, sizeof(mender_api_ctx_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return NULL;
+    }
+
+    /* Save configuration, the server hosts and the buffers are the ones of mender_api_init */
+    memcpy(&ctx->config, config, sizeof(mender_api_config_t));
+    ctx->config.host                      = mender_api_default_ctx.config.host;
+    ctx->config.http_recv_buf_length      = mender_api_default_ctx.config.http_recv_buf_length;
+    ctx->config.websocket_recv_buf_length = mender_api_default_ctx.config.websocket_recv_buf_length;
+
+    return ctx;
+}
+
+mender_api_ctx_t *
+mender_api_select_ctx(mender_api_ctx_t *ctx) {
+
+    mender_api_ctx_t *previous = mender_api_ctx;
+
+    /* Select the context of the calling thread */
+    mender_api_ctx = (NULL != ctx) ? ctx : &mender_api_default_ctx;
+
+    return (&mender_api_default_ctx != previous) ? previous : NULL;
+}
+
+void
+mender_api_release_ctx(mender_api_ctx_t *ctx) {
+
+    /* Release memory, the context of mender_api_init is released by mender_api_exit */
+    if ((NULL != ctx) && (&mender_api_default_ctx != ctx)) {
+        assert(mender_api_ctx != ctx);
+        mender_api_ctx_clear(ctx);
+        mender_utils_free(ctx);
+    }
+}
+
+#endif /* CONFIG_MENDER_API_CONTEXTS */
+
+mender_err_t
+mender_api_exit(void) {
+
+    /* Release all modules */
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+    mender_websocket_exit();
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+    mender_http_exit();
+
+    /* Release memory */
+    mender_api_hosts_release();
+    mender_api_ctx_clear(&mender_api_default_ctx);
+#ifdef CONFIG_MENDER_API_BATCH
+    mender_scheduler_mutex_delete(mender_api_batch_mutex);
+    mender_api_batch_mutex = NULL;
+#endif /* CONFIG_MENDER_API_BATCH */
+
+    return MENDER_OK;
+}
+
+static void
+mender_api_ctx_clear(mender_api_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+
+    /* Release memory */
+    if (NULL != ctx->jwt) {
+        mender_utils_free(ctx->jwt);
+        ctx->jwt = NULL;
+    }
+    ctx->jwt_validity.lifetime = 0;
+    mender_utils_free(ctx->authentication_request.payload);
+    mender_utils_free(ctx->authentication_request.signature);
+    ctx->authentication_request.payload   = NULL;
+    ctx->authentication_request.signature = NULL;
+
+    /* Forget the entity tags */
+    ctx->deployment_etag[0] = '\0';
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+    ctx->configuration_etag[0] = '\0';
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+    ctx->mirror_bypass = false;
+#ifdef CONFIG_MENDER_API_BATCH
+
+    /* Forget the requests of the batches and their responses */
+    for (size_t index = 0; index < MENDER_API_BATCH_COUNT; index++) {
+        mender_api_response_release(&ctx->batch[index].response);
+        ctx->batch[index].callback  = NULL;
+        ctx->batch[index].available = false;
+    }
+#endif /* CONFIG_MENDER_API_BATCH */
+}
+
+static void
+mender_api_release_authentication_request(void) {
+
+    /* Release memory */
+    if (NULL != mender_api_ctx->authentication_request.payload) {
+        mender_utils_free(mender_api_ctx->authentication_request.payload);
+        mender_api_ctx->authentication_request.payload = NULL;
+    }
+    if (NULL != mender_api_ctx->authentication_request.signature) {
+        mender_utils_free(mender_api_ctx->authentication_request.signature);
+        mender_api_ctx->authentication_request.signature = NULL;
+    }
+}
+
+static void
+mender_api_jwt_save_validity(char *jwt) {
+
+    assert(NULL != jwt);
+    char  *begin, *end;
+    char  *claims = NULL;
+    double issued_at, expires_at;
+#ifdef CONFIG_MENDER_TINY
+    mender_json_token_t *tokens = NULL;
+    mender_json_token_t *json_iat, *json_exp;
+#else
+    cJSON *json_claims = NULL;
+#endif /* CONFIG_MENDER_TINY */
+
+    /* The lifetime is not known until the claims are decoded */
+    mender_api_ctx->jwt_validity.lifetime = 0;
+
+    /* Retrieve the claims, the token is composed of the header, the claims and the signature separated by dots */
+    if ((NULL == (begin = strchr(jwt, '.'))) || (NULL == (end = strchr(++begin, '.')))) {
+        mender_log_debug("Unable to find the claims of the authentication token");
+        goto END;
+    }
+    if (NULL == (claims = mender_api_base64url_decode(begin, (size_t)(end - begin)))) {
+        mender_log_debug("Unable to decode the claims of the authentication token");
+        goto END;
+    }
+
+    /* Retrieve the issue and expiration times */
+#ifdef CONFIG_MENDER_TINY
+    if (MENDER_OK != mender_api_tokenize_response(claims, strlen(claims), &tokens)) {
+        mender_log_debug("Unable to parse the claims of the authentication token");
+        goto END;
+    }
+    if ((NULL == (json_iat = mender_json_token_get(claims, tokens, "iat"))) || (NULL == (json_exp = mender_json_token_get(claims, tokens, "exp")))
+        || (MENDER_OK != mender_json_token_number(claims, json_iat, &issued_at)) || (MENDER_OK != mender_json_token_number(claims, json_exp, &expires_at))) {
+        mender_log_debug("Unable to retrieve the lifetime of the authentication token");
+        goto END;
+    }
+#else
+    if (NULL == (json_claims = cJSON_Parse(claims))) {
+        mender_log_debug("Unable to parse the claims of the authentication token");
+        goto END;
+    }
+    cJSON *json_iat = cJSON_GetObjectItemCaseSensitive(json_claims, "iat");
+    cJSON *json_exp = cJSON_GetObjectItemCaseSensitive(json_claims, "exp");
+    if ((false == cJSON_IsNumber(json_iat)) || (false == cJSON_IsNumber(json_exp))) {
+        mender_log_debug("Unable to retrieve the lifetime of the authentication token");
+        goto END;
+    }
+    issued_at  = json_iat->valuedouble;
+    expires_at = json_exp->valuedouble;
+#endif /* CONFIG_MENDER_TINY */
+
+    /* Compute the lifetime from the issue and expiration times, the clock of the device is not used because it may not be synchronized */
+    if ((expires_at <= issued_at) || (expires_at - issued_at > (double)UINT32_MAX)) {
+        mender_log_debug("Unable to retrieve the lifetime of the authentication token");
+        goto END;
+    }
+    if (MENDER_OK != mender_scheduler_get_uptime(&mender_api_ctx->jwt_validity.timestamp)) {
+        goto END;
+    }
+    mender_api_ctx->jwt_validity.lifetime = (uint32_t)(expires_at - issued_at);
+    mender_log_debug("Authentication token is valid for %u seconds", (unsigned int)mender_api_ctx->jwt_validity.lifetime);
+
+END:
+
+    /* Release memory */
+#ifdef CONFIG_MENDER_TINY
+    mender_utils_free(tokens);
+#else
+    if (NULL != json_claims) {
+        cJSON_Delete(json_claims);
+    }
+#endif /* CONFIG_MENDER_TINY */
+    if (NULL != claims) {
+        mender_utils_free(claims);
+    }
+}
+
+static char *
+mender_api_base64url_decode(const char *data, size_t length) {
+
+    assert(NULL != data);
+    char    *decoded;
+    size_t   decoded_length = 0;
+    uint32_t accumulator    = 0;
+    size_t   bits           = 0;
+
+    /* Allocate memory, 3 bytes are decoded from 4 characters */
+    if (NULL == (decoded = (char *)mender_utils_malloc((length * 3) / 4 + 1))) {
+        mender_log_error("Unable to allocate memory");
+        return NULL;
+    }
+
+    /* Decode data, the padding characters terminate the data */
+    for (size_t index = 0; (index < length) && ('=' != data[index]); index++) {
+        char    c = data[index];
+        uint8_t value;
+        if ((c >= 'A') && (c <= 'Z')) {
+            value = (uint8_t)(c - 'A');
+        } else if ((c >= 'a') && (c <= 'z')) {
+            value = (uint8_t)(c - 'a' + 26);
+        } else if ((c >= '0') && (c <= '9')) {
+            value = (uint8_t)(c - '0' + 52);
+        } else if ('-' == c) {
+            value = 62;
+        } else if ('_' == c) {
+            value = 63;
+        } else {
+            mender_utils_free(decoded);
+            return NULL;
+        }
+        accumulator = (accumulator << 6) | value;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            decoded[decoded_length++] = (char)((accumulator >> bits) & 0xFF);
+        }
+    }
+    decoded[decoded_length] = '\0';
+
+    return decoded;
+}
+
+static void
+mender_api_response_init(mender_api_response_t *response, char *buffer, size_t size) {
+
+    assert(NULL != response);
+
+#ifdef CONFIG_MENDER_TINY
+    /* Take the shared buffer if the caller does not provide one, nothing can be received if another request already holds it */
+    if ((NULL == buffer) && (false == __atomic_test_and_set(&mender_api_response_buffer_taken, __ATOMIC_ACQUIRE))) {
+        buffer = mender_api_response_buffer;
+        size   = sizeof(mender_api_response_buffer);
+    }
+#endif /* CONFIG_MENDER_TINY */
+
+    /* Use the buffer provided by the caller if any, it is always null terminated */
+    response->data      = ((NULL != buffer) && (size > 0)) ? buffer : NULL;
+    response->length    = 0;
+    response->capacity  = (NULL != response->data) ? size : 0;
+    response->allocated = false;
+    if (NULL != response->data) {
+        response->data[0] = '\0';
+    }
+}
+
+static mender_err_t
+mender_api_response_append(mender_api_response_t *response, void *data, size_t length) {
+
+    assert(NULL != response);
+    assert(NULL != data);
+#ifndef CONFIG_MENDER_TINY
+    char *tmp;
+#endif /* CONFIG_MENDER_TINY */
+
+    /* Grow the buffer if required, the capacity is doubled so that appending data is linear */
+    if (response->length + length + 1 > response->capacity) {
+#ifdef CONFIG_MENDER_TINY
+        /* Responses are never allocated from the heap in the tiny build */
+        mender_log_error("Response is too large");
+        return MENDER_FAIL;
+#else
+        size_t capacity = (response->capacity > MENDER_API_RESPONSE_MIN_CAPACITY) ? response->capacity : MENDER_API_RESPONSE_MIN_CAPACITY;
+        while (capacity < response->length + length + 1) {
+            capacity *= 2;
+        }
+        if (true == response->allocated) {
+            if (NULL == (tmp = (char *)mender_utils_realloc(response->data, capacity))) {
+                mender_log_error("Unable to allocate memory");
+                return MENDER_FAIL;
+            }
+        } else {
+            /* The buffer provided by the caller is too small, move the response to the heap */
+            if (NULL == (tmp = (char *)mender_utils_malloc(capacity))) {
+                mender_log_error("Unable to allocate memory");
+                return MENDER_FAIL;
+            }
+            if (0 != response->length) {
+                memcpy(tmp, response->data, response->length);
+            }
+        }
+        response->data      = tmp;
+        response->capacity  = capacity;
+        response->allocated = true;
+#endif /* CONFIG_MENDER_TINY */
+    }
+
+    /* Append data */
+    memcpy(response->data + response->length, data, length);
+    response->length += length;
+    response->data[response->length] = '\0';
+
+    return MENDER_OK;
+}
+
+static void
+mender_api_response_release(mender_api_response_t *response) {
+
+    assert(NULL != response);
+
+    /* Release memory */
+    if (true == response->allocated) {
+        mender_utils_free(response->data);
+    }
+#ifdef CONFIG_MENDER_TINY
+    if (mender_api_response_buffer == response->data) {
+        __atomic_clear(&mender_api_response_buffer_taken, __ATOMIC_RELEASE);
+    }
+#endif /* CONFIG_MENDER_TINY */
+    response->data      = NULL;
+    response->length    = 0;
+    response->capacity  = 0;
+    response->allocated = false;
+}
+
+static void
+mender_api_payload_init(mender_json_writer_t *writer) {
+
+    assert(NULL != writer);
+
+#ifdef CONFIG_MENDER_TINY
+    /* Take the shared buffer, the failure is reported by mender_json_writer_end if another request already holds it */
+    if (false == __atomic_test_and_set(&mender_api_payload_buffer_taken, __ATOMIC_ACQUIRE)) {
+        mender_json_writer_init(writer, mender_api_payload_buffer, sizeof(mender_api_payload_buffer));
+    } else {
+        mender_log_error("Payload buffer is already used");
+        mender_json_writer_init(writer, NULL, 0);
+        writer->failed = true;
+    }
+#else
+    /* The payload is allocated from the heap */
+    mender_json_writer_init(writer, NULL, 0);
+#endif /* CONFIG_MENDER_TINY */
+}
+
+static void
+mender_api_payload_release(mender_json_writer_t *writer) {
+
+    assert(NULL != writer);
+
+#ifdef CONFIG_MENDER_TINY
+    /* Give back the shared buffer */
+    if (mender_api_payload_buffer == writer->data) {
+        __atomic_clear(&mender_api_payload_buffer_taken, __ATOMIC_RELEASE);
+    }
+#endif /* CONFIG_MENDER_TINY */
+
+    /* Release memory */
+    mender_json_writer_release(writer);
+}
+
+static mender_err_t
+mender_api_http_text_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
+
+    assert(NULL != params);
+    mender_api_response_t *response = (mender_api_response_t *)params;
+    mender_err_t           ret      = MENDER_OK;
+
+    /* Treatment depending of the event */
+    switch (event) {
         case MENDER_HTTP_EVENT_CONNECTED:
             /* Nothing to do */
             break;
@@ -780,15 +2182,7 @@ mender_api_http_text_callback(mender_http_client_event_t event, void *data, size
                 break;
             }
             /* Concatenate data to the response */
-            size_t response_length = (NULL != *response) ? strlen(*response) : 0;
-            if (NULL == (tmp = realloc(*response, response_length + data_length + 1))) {
-                mender_log_error("Unable to allocate memory");
-                ret = MENDER_FAIL;
-                break;
-            }
-            *response = tmp;
-            memcpy((*response) + response_length, data, data_length);
-            *((*response) + response_length + data_length) = '\0';
+            ret = mender_api_response_append(response, data, data_length);
             break;
         case MENDER_HTTP_EVENT_DISCONNECTED:
             /* Nothing to do */
@@ -811,41 +2205,38 @@ static mender_err_t
 mender_api_http_artifact_callback(mender_http_client_event_t event, void *data, size_t data_length, void *params) {
 
     assert(NULL != params);
-    mender_err_t ret = MENDER_OK;
-
-    mender_artifact_ctx_t *mender_artifact_ctx = NULL;
+    mender_api_artifact_params_t *artifact_params = (mender_api_artifact_params_t *)params;
+    mender_err_t                  ret             = MENDER_OK;
 
     /* Treatment depending of the event */
     switch (event) {
         case MENDER_HTTP_EVENT_CONNECTED:
-            /* Create new artifact context */
-            if (NULL == (mender_artifact_ctx = mender_artifact_create_ctx())) {
-                mender_log_error("Unable to create artifact context");
-                ret = MENDER_FAIL;
-                break;
-            }
+            /* Nothing to do, the artifact context is provided by the caller */
             break;
         case MENDER_HTTP_EVENT_DATA_RECEIVED:
             /* Check input data */
             if ((NULL == data) || (0 == data_length)) {
                 mender_log_error("Invalid data received");
-                ret = MENDER_FAIL;
+                artifact_params->failed = true;
+                ret                     = MENDER_FAIL;
                 break;
             }
 
-            /* Check artifact context */
-            if (MENDER_OK != mender_artifact_get_ctx(&mender_artifact_ctx)) {
-                mender_log_error("Unable to get artifact context");
-                ret = MENDER_FAIL;
-                break;
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+            /* Record the fragment received */
+            if (NULL != artifact_params->capture) {
+                mender_api_download_capture(artifact_params, data_length);
             }
-            assert(NULL != mender_artifact_ctx);
 
-            /* Parse input data */
-            if (MENDER_OK != (ret = mender_artifact_process_data(mender_artifact_ctx, data, data_length, params))) {
-                mender_log_error("Unable to process data");
+            /* Replay the fragments recorded */
+            if (NULL != artifact_params->fragments) {
+                ret = mender_api_download_replay(artifact_params, (uint8_t *)data, data_length);
                 break;
             }
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+            /* Process input data */
+            ret = mender_api_download_process(artifact_params, data, data_length);
             break;
         case MENDER_HTTP_EVENT_DISCONNECTED:
             break;
@@ -863,14 +2254,483 @@ mender_api_http_artifact_callback(mender_http_client_event_t event, void *data,
     return ret;
 }
 
+static void
+mender_api_download_pace(mender_api_artifact_params_t *artifact_params, size_t data_length) {
+
+    assert(NULL != artifact_params);
+    uint32_t rate = mender_api_download_rate;
+    uint64_t now;
+
+    /* Check if the rate is limited, the bucket is filled again when the limit is set */
+    if ((0 == rate) || (MENDER_OK != mender_scheduler_get_uptime(&now))) {
+        artifact_params->timestamp = 0;
+        return;
+    }
+
+    /* Refill the bucket with the time elapsed since the last data, the bucket holds at most the burst */
+    int64_t burst = (int64_t)rate * MENDER_API_DOWNLOAD_RATE_BURST / 1000;
+    if (0 == artifact_params->timestamp) {
+        artifact_params->tokens = burst;
+    } else {
+        artifact_params->tokens += (int64_t)(now - artifact_params->timestamp) * rate / 1000;
+    }
+    if (artifact_params->tokens > burst) {
+        artifact_params->tokens = burst;
+    }
+    artifact_params->timestamp = now;
+
+    /* Consume the tokens, the thread is suspended until the missing ones have been refilled */
+    artifact_params->tokens -= (int64_t)data_length;
+    if (artifact_params->tokens < 0) {
+        mender_scheduler_delay((uint32_t)((-artifact_params->tokens * 1000 + rate - 1) / rate));
+    }
+}
+
+static mender_err_t
+mender_api_download_process(mender_api_artifact_params_t *artifact_params, void *data, size_t data_length) {
+
+    assert(NULL != artifact_params);
+    mender_err_t ret;
+
+    /* Parse input data */
+    if (MENDER_OK != (ret = mender_artifact_process_data(artifact_params->ctx, data, data_length, artifact_params->callback))) {
+        mender_log_error("Unable to process data");
+        artifact_params->failed = true;
+        return ret;
+    }
+    artifact_params->offset += data_length;
+
+    /* Pace the download */
+    mender_api_download_pace(artifact_params, data_length);
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+
+static void
+mender_api_download_capture(mender_api_artifact_params_t *artifact_params, size_t data_length) {
+
+    assert(NULL != artifact_params);
+    uint64_t now = artifact_params->received;
+
+    /* Record the delay since the previous fragment, or since the request for the first one */
+    mender_scheduler_get_uptime(&now);
+    mender_api_download_fragment_t fragment
+        = { .delay = (now > artifact_params->received) ? (uint32_t)(now - artifact_params->received) : 0, .length = data_length };
+    artifact_params->received = now;
+    artifact_params->capture(&fragment, artifact_params->capture_params);
+}
+
+static mender_err_t
+mender_api_download_replay(mender_api_artifact_params_t *artifact_params, uint8_t *data, size_t data_length) {
+
+    assert(NULL != artifact_params);
+    mender_err_t ret = MENDER_OK;
+
+    /* Cut the data received as the fragments */
+    while ((MENDER_OK == ret) && (data_length > 0)) {
+        size_t length = artifact_params->fragments[artifact_params->index].length;
+        if ((0 == artifact_params->length) && (data_length >= length)) {
+            /* The fragment is delivered directly from the data received */
+            ret = mender_api_download_deliver(artifact_params, data, length);
+            data += length;
+            data_length -= length;
+        } else {
+            /* The fragment is held in the buffer until it is complete */
+            size_t copy = ((length - artifact_params->length) < data_length) ? (length - artifact_params->length) : data_length;
+            memcpy(artifact_params->buffer + artifact_params->length, data, copy);
+            artifact_params->length += copy;
+            data += copy;
+            data_length -= copy;
+            if (artifact_params->length == length) {
+                artifact_params->length = 0;
+                ret                     = mender_api_download_deliver(artifact_params, artifact_params->buffer, length);
+            }
+        }
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_api_download_deliver(mender_api_artifact_params_t *artifact_params, void *data, size_t data_length) {
+
+    assert(NULL != artifact_params);
+    uint64_t due = artifact_params->delivered + artifact_params->fragments[artifact_params->index].delay;
+    uint64_t now = due;
+
+    /* Wait for the delay of the fragment, the time spent processing the previous fragment is included as it is when the fragments are recorded */
+    if ((MENDER_OK == mender_scheduler_get_uptime(&now)) && (due > now)) {
+        mender_scheduler_delay((uint32_t)(due - now));
+        now = due;
+    }
+    artifact_params->delivered = now;
+    artifact_params->index     = (artifact_params->index + 1) % artifact_params->count;
+
+    /* Process the fragment */
+    return mender_api_download_process(artifact_params, data, data_length);
+}
+
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+static char *
+mender_api_mirror_uri(char *uri, char *mirror) {
+
+    assert(NULL != uri);
+    assert(NULL != mirror);
+    char *scheme = strstr(uri, "://");
+    char *location;
+
+    /* Retrieve the host and the path of the URI, the trailing slashes of the mirror are ignored */
+    if ((NULL == scheme) || ('\0' == scheme[strlen("://")])) {
+        mender_log_error("Invalid artifact URI");
+        return NULL;
+    }
+    size_t mirror_length = strlen(mirror);
+    while ((mirror_length > 0) && ('/' == mirror[mirror_length - 1])) {
+        mirror_length--;
+    }
+
+    /* Format the URI of the artifact on the mirror */
+    size_t str_length = mirror_length + strlen("/") + strlen(scheme + strlen("://")) + 1;
+    if (NULL == (location = (char *)mender_utils_malloc(str_length))) {
+        mender_log_error("Unable to allocate memory");
+        return NULL;
+    }
+    snprintf(location, str_length, "%.*s/%s", (int)mirror_length, mirror, scheme + strlen("://"));
+
+    return location;
+}
+
+static mender_err_t
+mender_api_hosts_parse(char *hosts) {
+
+    assert(NULL != hosts);
+    const char *separators = " ,";
+    size_t      count      = 0;
+
+    /* Count the hosts */
+    for (const char *host = hosts + strspn(hosts, separators); '\0' != *host; host += strspn(host, separators)) {
+        host += strcspn(host, separators);
+        count++;
+    }
+    if (0 == count) {
+        return MENDER_FAIL;
+    }
+    if (NULL == (mender_api_hosts = (mender_api_host_t *)mender_utils_calloc(count, sizeof(mender_api_host_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    /* Save the hosts, the trailing slashes are ignored */
+    for (const char *host = hosts + strspn(hosts, separators); '\0' != *host; host += strspn(host, separators)) {
+        size_t length = strcspn(host, separators);
+        size_t end    = length;
+        while ((end > 0) && ('/' == host[end - 1])) {
+            end--;
+        }
+        if (NULL == (mender_api_hosts[mender_api_hosts_count].url = mender_utils_strndup(host, end))) {
+            mender_log_error("Unable to allocate memory");
+            mender_api_hosts_release();
+            return MENDER_FAIL;
+        }
+        mender_api_hosts_count++;
+        host += length;
+    }
+    mender_api_host_current = 0;
+
+    return MENDER_OK;
+}
+
+static void
+mender_api_hosts_release(void) {
+
+    /* Release memory */
+    if (NULL != mender_api_hosts) {
+        for (size_t index = 0; index < mender_api_hosts_count; index++) {
+            mender_utils_free(mender_api_hosts[index].url);
+        }
+        mender_utils_free(mender_api_hosts);
+        mender_api_hosts = NULL;
+    }
+    mender_api_hosts_count = 0;
+}
+
+static void
+mender_api_hosts_probe(void) {
+
+    /* Nothing to do if a single host is configured, the requests are always sent to it */
+    if (mender_api_hosts_count < 2) {
+        return;
+    }
+
+    /* Send the probe to each host, any response means that the host is reachable */
+    for (size_t index = 0; index < mender_api_hosts_count; index++) {
+        mender_err_t          ret;
+        int                   status = 0;
+        char                  buffer[MENDER_API_RESPONSE_STATIC_LENGTH];
+        mender_api_response_t response;
+        uint64_t              begin = 0;
+        uint64_t              end   = 0;
+        char                 *url;
+
+        /* Format the absolute URL of the probe and measure the duration of the request */
+        size_t str_length = strlen(mender_api_hosts[index].url) + strlen(MENDER_API_PATH_PROBE) + 1;
+        if (NULL == (url = (char *)mender_utils_malloc(str_length))) {
+            mender_log_error("Unable to allocate memory");
+            return;
+        }
+        snprintf(url, str_length, "%s%s", mender_api_hosts[index].url, MENDER_API_PATH_PROBE);
+        mender_api_response_init(&response, buffer, sizeof(buffer));
+        mender_scheduler_get_uptime(&begin);
+        ret = mender_http_perform(NULL, url, MENDER_HTTP_GET, NULL, NULL, &mender_api_http_text_callback, (void *)&response, &status);
+        mender_scheduler_get_uptime(&end);
+        mender_api_stats_request(ret, status);
+        mender_api_response_release(&response);
+        mender_utils_free(url);
+
+        /* Update the smoothed round-trip time, the new sample has a weight of 1/8 */
+        if (0 != status) {
+            uint32_t sample = (end > begin) ? (uint32_t)(end - begin) : 1;
+            uint32_t rtt    = __atomic_load_n(&mender_api_hosts[index].rtt, __ATOMIC_RELAXED);
+            __atomic_store_n(&mender_api_hosts[index].rtt, (0 == rtt) ? sample : (rtt * 7 + sample) / 8, __ATOMIC_RELAXED);
+            __atomic_store_n(&mender_api_hosts[index].failures, 0, __ATOMIC_RELAXED);
+            mender_log_debug("Server host '%s' answered the probe in %u ms", mender_api_hosts[index].url, (unsigned int)sample);
+        } else {
+            mender_api_host_update(index, ret, status);
+            mender_log_warning("Server host '%s' did not answer the probe", mender_api_hosts[index].url);
+        }
+    }
+}
+
+static size_t
+mender_api_host_select(void) {
+
+    uint64_t now           = 0;
+    size_t   best          = 0;
+    uint32_t best_failures = UINT32_MAX;
+    uint32_t best_rtt      = UINT32_MAX;
+
+    /* Compare the hosts, the failures are forgotten after the retry interval so that a recovered host is selected again */
+    mender_scheduler_get_uptime(&now);
+    for (size_t index = 0; index < mender_api_hosts_count; index++) {
+        uint32_t failures  = __atomic_load_n(&mender_api_hosts[index].failures, __ATOMIC_RELAXED);
+        uint32_t rtt       = __atomic_load_n(&mender_api_hosts[index].rtt, __ATOMIC_RELAXED);
+        uint64_t timestamp = __atomic_load_n(&mender_api_hosts[index].timestamp, __ATOMIC_RELAXED);
+        if ((0 != failures) && (now - timestamp >= (uint64_t)CONFIG_MENDER_API_HOST_RETRY_INTERVAL * 1000)) {
+            failures = 0;
+        }
+        if (0 == rtt) {
+            rtt = UINT32_MAX - 1;
+        }
+        if ((failures < best_failures) || ((failures == best_failures) && (rtt < best_rtt))) {
+            best          = index;
+            best_failures = failures;
+            best_rtt      = rtt;
+        }
+    }
+
+    return best;
+}
+
+static void
+mender_api_host_update(size_t index, mender_err_t ret, int status) {
+
+    uint64_t now = 0;
+
+    /* The host is healthy if it answers, the server errors and the requests without response are failures */
+    if (((MENDER_OK == ret) || (0 != status)) && (status < 500)) {
+        __atomic_store_n(&mender_api_hosts[index].failures, 0, __ATOMIC_RELAXED);
+    } else {
+        mender_scheduler_get_uptime(&now);
+        __atomic_store_n(&mender_api_hosts[index].timestamp, now, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mender_api_hosts[index].failures, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static mender_err_t
+mender_api_route_begin(mender_api_route_t *route, char *path, bool websocket) {
+
+    assert(NULL != route);
+    assert(NULL != path);
+
+    /* The path is given as is to the HTTP and websocket clients if a single host is configured, they prefix it with the host */
+    route->path  = path;
+    route->url   = path;
+    route->index = 0;
+    if (mender_api_hosts_count < 2) {
+        return MENDER_OK;
+    }
+
+    /* Select the best host, the failover is logged */
+    route->index = mender_api_host_select();
+    if (route->index != mender_api_host_current) {
+        mender_log_info("Switching to server host '%s'", mender_api_hosts[route->index].url);
+        mender_api_host_current = route->index;
+    }
+
+    /* Format the absolute URL of the request, the scheme of the host is converted for the websocket connections */
+    const char *host   = mender_api_hosts[route->index].url;
+    const char *scheme = "";
+    if (true == websocket) {
+        if (true == mender_utils_strbeginwith(host, "http://")) {
+            scheme = "ws://";
+            host += strlen("http://");
+        } else if (true == mender_utils_strbeginwith(host, "https://")) {
+            scheme = "wss://";
+            host += strlen("https://");
+        }
+    }
+    size_t str_length = strlen(scheme) + strlen(host) + strlen(path) + 1;
+    if (NULL == (route->url = (char *)mender_utils_malloc(str_length))) {
+        mender_log_error("Unable to allocate memory");
+        route->url = path;
+        return MENDER_FAIL;
+    }
+    snprintf(route->url, str_length, "%s%s%s", scheme, host, path);
+
+    return MENDER_OK;
+}
+
+static void
+mender_api_route_end(mender_api_route_t *route, mender_err_t ret, int status) {
+
+    assert(NULL != route);
+
+    /* Update the health of the host and release memory */
+    if (mender_api_hosts_count >= 2) {
+        mender_api_host_update(route->index, ret, status);
+    }
+    if (route->url != route->path) {
+        mender_utils_free(route->url);
+    }
+    route->url = route->path;
+}
+
+static void
+mender_api_stats_request(mender_err_t ret, int status) {
+
+    mender_http_stats_t http_stats;
+
+    /* Count the request and its response, the status class is not known if no response has been received */
+    __atomic_add_fetch(&mender_api_stats.http.requests, 1, __ATOMIC_RELAXED);
+    if ((status >= 100) && (status < 600)) {
+        __atomic_add_fetch(&mender_api_stats.http.status[status / 100 - 1], 1, __ATOMIC_RELAXED);
+    } else if (MENDER_OK != ret) {
+        __atomic_add_fetch(&mender_api_stats.http.errors, 1, __ATOMIC_RELAXED);
+    }
+
+    /* Accumulate the data received, the HTTP client holds the statistics of the last request */
+    if (MENDER_OK == mender_http_get_stats(&http_stats)) {
+        __atomic_add_fetch(&mender_api_stats.http.received, http_stats.length, __ATOMIC_RELAXED);
+    }
+}
+
+static void
+mender_api_stats_download(mender_err_t ret, mender_artifact_ctx_t *ctx, size_t resumes, uint64_t begin) {
+
+    assert(NULL != ctx);
+    uint64_t now;
+
+    /* Count the download and accumulate the data received and copied by the parser */
+    __atomic_add_fetch((MENDER_OK == ret) ? &mender_api_stats.download.successes : &mender_api_stats.download.failures, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mender_api_stats.download.resumes, (uint32_t)resumes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mender_api_stats.download.received, ctx->stats.received, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&mender_api_stats.download.copied, ctx->stats.copied, __ATOMIC_RELAXED);
+
+    /* Save the length, the duration and the throughput of the download */
+    uint32_t duration = ((0 != begin) && (MENDER_OK == mender_scheduler_get_uptime(&now))) ? (uint32_t)(now - begin) : 0;
+    __atomic_store_n(&mender_api_stats.download.length, ctx->stats.received, __ATOMIC_RELAXED);
+    __atomic_store_n(&mender_api_stats.download.duration, duration, __ATOMIC_RELAXED);
+    __atomic_store_n(
+        &mender_api_stats.download.throughput, (0 != duration) ? (uint32_t)((uint64_t)ctx->stats.received * 1000 / duration) : 0, __ATOMIC_RELAXED);
+}
+
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+static void
+mender_api_format_timestamp(uint32_t uptime, char *timestamp, size_t size) {
+
+    assert(NULL != timestamp);
+
+    /* Compute the date, the days are counted from March so that the leap day is the last one of the year */
+    uint32_t z   = uptime / 86400 + 719468;
+    uint32_t era = z / 146097;
+    uint32_t doe = z - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp  = (5 * doy + 2) / 153;
+    uint32_t day = doy - (153 * mp + 2) / 5 + 1;
+    uint32_t mon = (mp < 10) ? (mp + 3) : (mp - 9);
+    uint32_t yr  = yoe + era * 400 + ((mon <= 2) ? 1 : 0);
+
+    /* Format timestamp */
+    snprintf(timestamp,
+             size,
+             "%04u-%02u-%02uT%02u:%02u:%02uZ",
+             (unsigned int)yr,
+             (unsigned int)mon,
+             (unsigned int)day,
+             (unsigned int)((uptime / 3600) % 24),
+             (unsigned int)((uptime / 60) % 60),
+             (unsigned int)(uptime % 60));
+}
+
+static mender_err_t
+mender_api_log_buffer_callback(uint8_t level, uint32_t uptime, const char *message, size_t length, void *params) {
+
+    assert(NULL != message);
+    assert(NULL != params);
+    (void)length;
+    mender_api_logs_params_t *logs_params = (mender_api_logs_params_t *)params;
+    char                      timestamp[sizeof("1970-01-01T00:00:00Z")];
+    char                     *value;
+
+    /* Log level to string */
+    switch (level) {
+        case MENDER_LOG_LEVEL_ERR:
+            value = "error";
+            break;
+        case MENDER_LOG_LEVEL_WRN:
+            value = "warning";
+            break;
+        case MENDER_LOG_LEVEL_INF:
+            value = "info";
+            break;
+        default:
+            value = "debug";
+            break;
+    }
+
+    /* Format timestamp */
+    mender_api_format_timestamp(uptime, timestamp, sizeof(timestamp));
+
+    /* Format message */
+    mender_json_writer_begin_object(logs_params->writer, NULL);
+    mender_json_writer_add_string(logs_params->writer, "timestamp", timestamp);
+    mender_json_writer_add_string(logs_params->writer, "level", value);
+    mender_json_writer_add_string(logs_params->writer, "message", message);
+    mender_json_writer_end_object(logs_params->writer);
+    logs_params->count++;
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
 
 static mender_err_t
 mender_api_websocket_callback(mender_websocket_client_event_t event, void *data, size_t data_length, void *params) {
 
     assert(NULL != params);
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    mender_api_ctx_t *ctx = (mender_api_ctx_t *)params;
+#else
     mender_err_t (*callback)(void *, size_t) = params;
-    mender_err_t ret                         = MENDER_OK;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    mender_err_t ret = MENDER_OK;
 
     /* Treatment depending of the event */
     switch (event) {
@@ -886,7 +2746,11 @@ mender_api_websocket_callback(mender_websocket_client_event_t event, void *data,
                 break;
             }
             /* Process input data */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+            if (MENDER_OK != (ret = ctx->troubleshoot.callback(data, data_length, ctx->troubleshoot.arg))) {
+#else
             if (MENDER_OK != (ret = callback(data, data_length))) {
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
                 mender_log_error("Unable to process data");
                 break;
             }
@@ -919,6 +2783,19 @@ mender_api_print_response_error(char *response, int status) {
     /* Treatment depending of the status */
     if (NULL != (desc = mender_utils_http_status_to_string(status))) {
         if (NULL != response) {
+#ifdef CONFIG_MENDER_API_JSON_TOKENIZER
+            mender_json_token_t *tokens = NULL;
+            mender_json_token_t *json_error;
+            char                *error;
+            if ((MENDER_OK == mender_api_tokenize_response(response, strlen(response), &tokens))
+                && (NULL != (json_error = mender_json_token_get(response, tokens, "error")))
+                && (NULL != (error = mender_json_token_string(response, json_error)))) {
+                mender_log_error("[%d] %s: %s", status, desc, error);
+            } else {
+                mender_log_error("[%d] %s: unknown error", status, desc);
+            }
+            mender_utils_free(tokens);
+#else
             cJSON *json_response = cJSON_Parse(response);
             if (NULL != json_response) {
                 cJSON *json_error = cJSON_GetObjectItemCaseSensitive(json_response, "error");
@@ -931,6 +2808,7 @@ mender_api_print_response_error(char *response, int status) {
             } else {
                 mender_log_error("[%d] %s: unknown error", status, desc);
             }
+#endif /* CONFIG_MENDER_API_JSON_TOKENIZER */
         } else {
             mender_log_error("[%d] %s: unknown error", status, desc);
         }
@@ -938,3 +2816,308 @@ mender_api_print_response_error(char *response, int status) {
         mender_log_error("Unknown error occurred, status=%d", status);
     }
 }
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+static mender_err_t
+mender_api_configuration_request(mender_api_response_t *response, char *etag, size_t etag_size, int *status) {
+
+    assert(NULL != response);
+    assert(NULL != etag);
+    assert(NULL != status);
+    mender_err_t       ret;
+    mender_api_route_t route;
+
+    /* Route the request to the best server host */
+    if (MENDER_OK != (ret = mender_api_route_begin(&route, MENDER_API_PATH_GET_DEVICE_CONFIGURATION, false))) {
+        mender_log_error("Unable to route HTTP request");
+        return ret;
+    }
+
+    /* Perform HTTP request */
+    ret = mender_http_perform_conditional(mender_api_ctx->jwt,
+                                          route.url,
+                                          MENDER_HTTP_GET,
+                                          NULL,
+                                          NULL,
+                                          mender_api_ctx->configuration_etag,
+                                          etag,
+                                          etag_size,
+                                          &mender_api_http_text_callback,
+                                          (void *)response,
+                                          status);
+    mender_api_route_end(&route, ret, *status);
+    mender_api_stats_request(ret, *status);
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+
+#ifdef CONFIG_MENDER_API_BATCH
+
+static void
+mender_api_batch_perform(void) {
+
+    for (size_t index = 0; index < MENDER_API_BATCH_COUNT; index++) {
+        mender_api_batch_t *batch = &mender_api_ctx->batch[index];
+        mender_err_t (*callback)(void);
+
+        /* Take mutex used to protect access to the batches */
+        if (MENDER_OK != mender_scheduler_mutex_take(mender_api_batch_mutex, -1)) {
+            mender_log_error("Unable to take mutex");
+            return;
+        }
+        if (NULL == (callback = batch->callback)) {
+            mender_scheduler_mutex_give(mender_api_batch_mutex);
+            continue;
+        }
+
+        /* The response which has not been consumed is replaced */
+        mender_api_response_release(&batch->response);
+        batch->status  = 0;
+        batch->etag[0] = '\0';
+        switch (index) {
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+            case MENDER_API_BATCH_CONFIGURATION:
+                batch->ret = mender_api_configuration_request(&batch->response, batch->etag, sizeof(batch->etag), &batch->status);
+                break;
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+            default:
+                /* Request not available in this configuration */
+                batch->ret = MENDER_NOT_IMPLEMENTED;
+                break;
+        }
+        batch->available = true;
+
+        /* Release mutex used to protect access to the batches */
+        mender_scheduler_mutex_give(mender_api_batch_mutex);
+
+        /* Invoke the callback, the response is consumed by its owner */
+        if (MENDER_OK != callback()) {
+            mender_log_error("Unable to notify response of the batch");
+        }
+    }
+}
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+static bool
+mender_api_batch_consume(mender_api_batch_request_t request, mender_api_response_t *response, char *etag, int *status, mender_err_t *ret) {
+
+    assert(request < MENDER_API_BATCH_COUNT);
+    assert(NULL != response);
+    assert(NULL != etag);
+    assert(NULL != status);
+    assert(NULL != ret);
+    mender_api_batch_t *batch     = &mender_api_ctx->batch[request];
+    bool                available = false;
+
+    /* Take mutex used to protect access to the batches */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_api_batch_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        return false;
+    }
+
+    /* Move the response to the caller, the response buffer of the caller is empty */
+    if (true == (available = batch->available)) {
+        mender_api_response_release(response);
+        *response = batch->response;
+        strcpy(etag, batch->etag);
+        *status = batch->status;
+        *ret    = batch->ret;
+        mender_api_response_init(&batch->response, NULL, 0);
+        batch->available = false;
+    }
+
+    /* Release mutex used to protect access to the batches */
+    mender_scheduler_mutex_give(mender_api_batch_mutex);
+
+    return available;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+#endif /* CONFIG_MENDER_API_BATCH */
+
+#ifdef CONFIG_MENDER_API_JSON_TOKENIZER
+
+static mender_err_t
+mender_api_tokenize_response(char *response, size_t length, mender_json_token_t **tokens) {
+
+    assert(NULL != tokens);
+    mender_err_t ret;
+    size_t       count;
+
+    /* Count the tokens */
+    *tokens = NULL;
+    if (NULL == response) {
+        return MENDER_FAIL;
+    }
+    if (MENDER_OK != (ret = mender_json_tokenize(response, length, NULL, 0, &count))) {
+        return ret;
+    }
+
+    /* Tokenize the response */
+    if (NULL == (*tokens = (mender_json_token_t *)mender_utils_malloc(count * sizeof(mender_json_token_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (MENDER_OK != (ret = mender_json_tokenize(response, length, *tokens, count, &count))) {
+        mender_utils_free(*tokens);
+        *tokens = NULL;
+        return ret;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_api_token_strdup(char *response, mender_json_token_t *token, char **value) {
+
+    assert(NULL != response);
+    assert(NULL != value);
+    char *str;
+
+    /* Decode and duplicate the string */
+    if ((NULL == token) || (NULL == (str = mender_json_token_string(response, token)))) {
+        mender_log_error("Invalid response");
+        return MENDER_FAIL;
+    }
+    if (NULL == (*value = mender_utils_strdup(str))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_api_parse_deployment(char *response, size_t length, mender_api_deployment_data_t *deployment) {
+
+    assert(NULL != deployment);
+    mender_json_token_t *tokens = NULL;
+    mender_err_t         ret;
+
+    /* Tokenize the response */
+    if (MENDER_OK != (ret = mender_api_tokenize_response(response, length, &tokens))) {
+        mender_log_error("Invalid response");
+        return ret;
+    }
+
+    /* Retrieve the fields of the deployment, the strings are decoded in place without affecting the other tokens */
+    mender_json_token_t *json_id            = mender_json_token_get(response, tokens, "id");
+    mender_json_token_t *json_artifact      = mender_json_token_get(response, tokens, "artifact");
+    mender_json_token_t *json_artifact_name = NULL;
+    mender_json_token_t *json_source        = NULL;
+    mender_json_token_t *json_uri           = NULL;
+    mender_json_token_t *json_device_types  = NULL;
+    if (NULL != json_artifact) {
+        json_artifact_name = mender_json_token_get(response, json_artifact, "artifact_name");
+        if (NULL != (json_source = mender_json_token_get(response, json_artifact, "source"))) {
+            json_uri = mender_json_token_get(response, json_source, "uri");
+        }
+        json_device_types = mender_json_token_get(response, json_artifact, "device_types_compatible");
+    }
+    if ((NULL == json_uri) || (NULL == json_device_types) || (MENDER_JSON_TOKEN_ARRAY != json_device_types->type)) {
+        mender_log_error("Invalid response");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Copy the fields */
+    if ((NULL != json_id) && (MENDER_OK != (ret = mender_api_token_strdup(response, json_id, &deployment->id)))) {
+        goto END;
+    }
+    if ((NULL != json_artifact_name) && (MENDER_OK != (ret = mender_api_token_strdup(response, json_artifact_name, &deployment->artifact_name)))) {
+        goto END;
+    }
+    if (MENDER_OK != (ret = mender_api_token_strdup(response, json_uri, &deployment->uri))) {
+        goto END;
+    }
+    if (NULL == (deployment->device_types_compatible = (char **)mender_utils_calloc(json_device_types->size, sizeof(char *)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    deployment->device_types_compatible_size = json_device_types->size;
+    for (size_t index = 0; index < json_device_types->size; index++) {
+        if (MENDER_OK
+            != (ret = mender_api_token_strdup(response, mender_json_token_at(json_device_types, index), &deployment->device_types_compatible[index]))) {
+            mender_log_error("Could not get device type form device_types_compatible array");
+            goto END;
+        }
+    }
+
+END:
+
+    /* Release memory */
+    mender_utils_free(tokens);
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+static mender_err_t
+mender_api_parse_configuration(char *response, size_t length, mender_keystore_t **configuration) {
+
+    assert(NULL != configuration);
+    mender_json_token_t *tokens = NULL;
+    mender_keystore_t   *items  = NULL;
+    mender_err_t         ret;
+
+    /* Release previous configuration */
+    mender_utils_keystore_delete(*configuration);
+    *configuration = NULL;
+
+    /* Tokenize the response */
+    if (MENDER_OK != (ret = mender_api_tokenize_response(response, length, &tokens))) {
+        return ret;
+    }
+    if (MENDER_JSON_TOKEN_OBJECT != tokens->type) {
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Reference the string members decoded in place, the key-store is packed from them with one allocation */
+    if (NULL == (items = (mender_keystore_t *)mender_utils_calloc(tokens->size + 1, sizeof(mender_item_t)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    size_t               count = 0;
+    mender_json_token_t *token = tokens + 1;
+    for (uint32_t index = 0; index < tokens->size; index++) {
+        if (MENDER_JSON_TOKEN_STRING == token[1].type) {
+            items[count].name  = mender_json_token_string(response, &token[0]);
+            items[count].value = mender_json_token_string(response, &token[1]);
+            if ((NULL == items[count].name) || (NULL == items[count].value)) {
+                ret = MENDER_FAIL;
+                goto END;
+            }
+            count++;
+        }
+        token += 1 + token[1].skip;
+    }
+    ret = mender_utils_keystore_copy(configuration, items);
+
+END:
+
+    /* Release memory */
+    mender_utils_free(items);
+    mender_utils_free(tokens);
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+
+#endif /* CONFIG_MENDER_API_JSON_TOKENIZER */
@@ -17,14 +17,110 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_ARTIFACT
+
+#ifdef CONFIG_MENDER_ARTIFACT_GZIP
+#include <zlib.h>
+#endif /* CONFIG_MENDER_ARTIFACT_GZIP */
 #include "mender-artifact.h"
+#ifdef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
+#include "mender-json.h"
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
 #include "mender-log.h"
+#include "mender-tls.h"
 
 /**
  * @brief TAR block size
  */
 #define MENDER_ARTIFACT_STREAM_BLOCK_SIZE (512)
 
+/**
+ * @brief Check input ring buffer size, blocks must never wrap around the end of the buffer and end of archive requires two blocks
+ */
+#if (0 != (CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE % MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) \
+    || (CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE < 2 * MENDER_ARTIFACT_STREAM_BLOCK_SIZE)
+#error "CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE must be a multiple of the TAR block size and hold at least two blocks"
+#endif
+
+/**
+ * @brief Maximum length of payload data delivered to the artifact callback at once (bytes), must be a multiple of the TAR block size
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_DATA_CHUNK_SIZE
+#define CONFIG_MENDER_ARTIFACT_DATA_CHUNK_SIZE (4096)
+#endif /* CONFIG_MENDER_ARTIFACT_DATA_CHUNK_SIZE */
+#if (0 != (CONFIG_MENDER_ARTIFACT_DATA_CHUNK_SIZE % MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) \
+    || (CONFIG_MENDER_ARTIFACT_DATA_CHUNK_SIZE < MENDER_ARTIFACT_STREAM_BLOCK_SIZE)
+#error "CONFIG_MENDER_ARTIFACT_DATA_CHUNK_SIZE must be a multiple of the TAR block size"
+#endif
+
+/**
+ * @brief Check signature verification, the checksums of the manifest are required
+ */
+#if defined(CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE) && !defined(CONFIG_MENDER_FULL_PARSE_ARTIFACT)
+#error "CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE requires CONFIG_MENDER_FULL_PARSE_ARTIFACT"
+#endif
+
+/**
+ * @brief Check tiny build, the header-info and type-info files are parsed without cJSON
+ */
+#if defined(CONFIG_MENDER_TINY) && !defined(CONFIG_MENDER_ARTIFACT_STREAMING_JSON)
+#error "CONFIG_MENDER_TINY requires CONFIG_MENDER_ARTIFACT_STREAMING_JSON"
+#endif
+
+#ifdef CONFIG_MENDER_ARTIFACT_GZIP
+
+/**
+ * @brief Base two logarithm of the decompression window size, must not be lower than the one used to compress the artifact
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_GZIP_WINDOW_BITS
+#define CONFIG_MENDER_ARTIFACT_GZIP_WINDOW_BITS (15)
+#endif /* CONFIG_MENDER_ARTIFACT_GZIP_WINDOW_BITS */
+
+/**
+ * @brief Gzip decompression stream
+ */
+typedef struct {
+    z_stream stream;                                         /**< zlib stream */
+    bool     end;                                            /**< End of the compressed stream has been reached */
+    uint8_t  output[CONFIG_MENDER_ARTIFACT_DATA_CHUNK_SIZE]; /**< Decompressed data */
+} mender_artifact_gzip_stream_t;
+
+#endif /* CONFIG_MENDER_ARTIFACT_GZIP */
+
+#ifdef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
+
+/**
+ * @brief Keys of the members of the header-info and type-info files retrieved while streaming
+ */
+typedef enum {
+    MENDER_ARTIFACT_JSON_KEY_OTHER = 0,       /**< Member not relevant */
+    MENDER_ARTIFACT_JSON_KEY_PAYLOADS,        /**< "payloads" member of header-info */
+    MENDER_ARTIFACT_JSON_KEY_TYPE,            /**< "type" member of a payload of header-info */
+    MENDER_ARTIFACT_JSON_KEY_PROVIDES,        /**< "artifact_provides" member */
+    MENDER_ARTIFACT_JSON_KEY_DEPENDS,         /**< "artifact_depends" member */
+    MENDER_ARTIFACT_JSON_KEY_CLEARS_PROVIDES, /**< "clears_artifact_provides" member of type-info */
+} mender_artifact_json_key_t;
+
+/**
+ * @brief Streaming JSON parser of the header-info and type-info files
+ */
+typedef struct {
+    mender_json_stream_t       stream;     /**< JSON tokenizer */
+    mender_artifact_ctx_t     *ctx;        /**< Artifact context */
+    mender_artifact_json_key_t key;        /**< Key of the member of the root object currently parsed */
+    mender_artifact_json_key_t member_key; /**< Key of the member of the payload currently parsed */
+    bool                       container;  /**< The value of the member of the root object currently parsed is the expected container */
+    size_t                     capacity;   /**< Capacity of the array currently filled (payloads or clears provides) */
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+    char name[CONFIG_MENDER_JSON_TOKEN_SIZE + 1]; /**< Key of the provides or depends currently parsed */
+#endif
+} mender_artifact_json_t;
+
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
+
 /**
  * @brief Device type key
  */
@@ -60,6 +156,24 @@ typedef struct {
 #define MENDER_ARTIFACT_SUPPORTED_FORMAT  "mender"
 #define MENDER_ARTIFACT_SUPPORTED_VERSION 3
 
+#ifdef CONFIG_MENDER_TINY
+
+/**
+ * @brief Maximum number of tokens of the version file, it only holds the format and the version
+ */
+#define MENDER_ARTIFACT_VERSION_TOKENS (8)
+
+#endif /* CONFIG_MENDER_TINY */
+
+/**
+ * @brief Parse data available in the internal ring buffer
+ * @param ctx Artifact context
+ * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
+ * @return MENDER_OK if the data have been parsed and more data are expected, error code if an error occurred
+ */
+static mender_err_t mender_artifact_parse_data(mender_artifact_ctx_t *ctx,
+                                               mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t));
+
 /**
  * @brief Parse header of TAR file
  * @param ctx Artifact context
@@ -67,6 +181,13 @@ typedef struct {
  */
 static mender_err_t mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx);
 
+/**
+ * @brief Classify the file currently parsed and retrieve its payload index if relevant
+ * @param ctx Artifact context
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_classify_file(mender_artifact_ctx_t *ctx);
+
 /**
  * @brief Read version file of the artifact
  * @param ctx Artifact context
@@ -74,6 +195,39 @@ static mender_err_t mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx)
  */
 static mender_err_t mender_artifact_read_version(mender_artifact_ctx_t *ctx);
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+/**
+ * @brief Check the file currently parsed is allowed at this point of a signed artifact and begin computation of its digest if it is signed
+ * @param ctx Artifact context
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_begin_signed_file(mender_artifact_ctx_t *ctx);
+
+/**
+ * @brief Update digest of the signed file currently hashed with the data consumed and check it when the end of the file is reached
+ * @param ctx Artifact context
+ * @param data Data consumed
+ * @param length Length of the data consumed, the padding following the end of the file is ignored
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_update_signed_file(mender_artifact_ctx_t *ctx, void *data, size_t length);
+
+/**
+ * @brief Read signature of the manifest file and verify it, the digest of the version file is then verified against the manifest
+ * @param ctx Artifact context
+ * @return MENDER_DONE if the data have been parsed and signature verified, MENDER_OK if there is not enough data to parse, error code if an error occurred
+ */
+static mender_err_t mender_artifact_read_manifest_sig(mender_artifact_ctx_t *ctx);
+
+/**
+ * @brief Retrieve checksum of a file from the manifest
+ * @param ctx Artifact context
+ * @param name Name of the file
+ * @return Checksum of the file, NULL if it is not found in the manifest
+ */
+static const char *mender_artifact_get_checksum(mender_artifact_ctx_t *ctx, const char *name);
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+
 /**
  * @brief Read header-info file of the artifact
  * @param ctx Artifact context
@@ -102,7 +256,9 @@ static mender_err_t mender_artifact_read_type_info(mender_artifact_ctx_t *ctx);
  * @param provides_depends Pointer to the list of provides or depends
  * @return MENDER_SUCCESS if the function succeeds, MENDER_FAIL otherwise
  */
+#ifndef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
 static mender_err_t mender_artifact_parse_provides_depends(cJSON *json_provides_depends, mender_key_value_list_t **provides_depends);
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
 #endif
 
 /**
@@ -118,7 +274,69 @@ static mender_err_t mender_artifact_read_meta_data(mender_artifact_ctx_t *ctx);
  * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
  * @return MENDER_DONE if the data have been parsed and payloads retrieved, MENDER_OK if there is not enough data to parse, error code if an error occurred
  */
-static mender_err_t mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
+static mender_err_t mender_artifact_read_data(mender_artifact_ctx_t *ctx,
+                                              mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t));
+
+/**
+ * @brief Pass payload data directly from the input data to the callback and skip data of the files not relevant, without copying them to the ring buffer
+ * @param ctx Artifact context
+ * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
+ * @param input_data Input data from the stream, updated to the first data not processed
+ * @param input_length Length of the input data from the stream, updated to the length of the data not processed
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_pass_data(mender_artifact_ctx_t *ctx,
+                                              mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t),
+                                              void  **input_data,
+                                              size_t *input_length);
+
+/**
+ * @brief Invoke the callback with contiguous blocks of data of the current payload file and update the index of the file
+ * @param ctx Artifact context
+ * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
+ * @param data Contiguous blocks of data
+ * @param length Length of the data available, at least one block
+ * @return Length of the data consumed if the function succeeds (multiple of the block size), 0 otherwise
+ */
+static size_t mender_artifact_deliver_data(mender_artifact_ctx_t *ctx,
+                                           mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t),
+                                           void  *data,
+                                           size_t length);
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+/**
+ * @brief Format a SHA-256 digest as the checksums of the manifest
+ * @param digest Digest
+ * @param checksum Checksum, hexadecimal string
+ */
+static void mender_artifact_format_checksum(const uint8_t *digest, char *checksum);
+
+/**
+ * @brief Update checksum of the current payload file and verify it against the manifest when the end of the file is reached
+ * @param ctx Artifact context
+ * @param data Data of the payload file
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_check_checksum(mender_artifact_ctx_t *ctx, void *data, size_t length);
+#endif
+
+#ifdef CONFIG_MENDER_ARTIFACT_GZIP
+/**
+ * @brief Read compressed TAR file of the artifact, the decompressed data are parsed using an inner artifact context
+ * @param ctx Artifact context
+ * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
+ * @return MENDER_DONE if the data have been parsed, MENDER_OK if there is not enough data to parse, error code if an error occurred
+ */
+static mender_err_t mender_artifact_read_compressed_file(mender_artifact_ctx_t *ctx,
+                                                         mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t));
+
+/**
+ * @brief Release decompressor of the compressed TAR file, payloads and artifact information lent to the inner artifact context are given back
+ * @param ctx Artifact context
+ */
+static void mender_artifact_release_decompressor(mender_artifact_ctx_t *ctx);
+#endif /* CONFIG_MENDER_ARTIFACT_GZIP */
 
 /**
  * @brief Drop content of the current file of the artifact
@@ -127,6 +345,104 @@ static mender_err_t mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender
  */
 static mender_err_t mender_artifact_drop_file(mender_artifact_ctx_t *ctx);
 
+#ifdef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
+/**
+ * @brief Stream content of the current JSON file of the artifact to the tokenizer as data are received, without reading the whole file
+ * @param ctx Artifact context
+ * @param callback Callback invoked for each JSON event of the file
+ * @return MENDER_DONE if the whole file has been parsed, MENDER_OK if there is not enough data to parse, error code if an error occurred
+ */
+static mender_err_t mender_artifact_stream_json_file(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(void *, mender_json_event_t, size_t, char *));
+
+/**
+ * @brief Retrieve key of the member of the root object of the header-info and type-info files
+ * @param key Key
+ * @return Key of the member
+ */
+static mender_artifact_json_key_t mender_artifact_json_get_key(char *key);
+
+/**
+ * @brief Grow an array allocated from the arena of the artifact context, the capacity is doubled when it is reached
+ * @param ctx Artifact context
+ * @param values Array to grow
+ * @param size Number of elements of the array
+ * @param capacity Capacity of the array, updated when the array is reallocated
+ * @param element_size Size of an element of the array (bytes)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_json_grow(mender_artifact_ctx_t *ctx, void **values, size_t size, size_t *capacity, size_t element_size);
+
+/**
+ * @brief Callback invoked for each JSON event of the header-info file
+ * @param arg Streaming JSON parser
+ * @param event JSON event
+ * @param depth Depth of the event
+ * @param token Token of the event, NULL for containers
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_header_info_json_callback(void *arg, mender_json_event_t event, size_t depth, char *token);
+
+/**
+ * @brief Retrieve payloads of the header-info file from JSON events of the "payloads" member
+ * @param json Streaming JSON parser
+ * @param event JSON event
+ * @param depth Depth of the event
+ * @param token Token of the event, NULL for containers
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_json_payloads(mender_artifact_json_t *json, mender_json_event_t event, size_t depth, char *token);
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+/**
+ * @brief Callback invoked for each JSON event of the type-info file
+ * @param arg Streaming JSON parser
+ * @param event JSON event
+ * @param depth Depth of the event
+ * @param token Token of the event, NULL for containers
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_type_info_json_callback(void *arg, mender_json_event_t event, size_t depth, char *token);
+
+/**
+ * @brief Retrieve provides or depends from JSON events of the "artifact_provides" or "artifact_depends" member
+ * @param json Streaming JSON parser
+ * @param event JSON event
+ * @param depth Depth of the event
+ * @param token Token of the event, NULL for containers
+ * @param provides_depends Pointer to the list of provides or depends
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_json_provides_depends(
+    mender_artifact_json_t *json, mender_json_event_t event, size_t depth, char *token, mender_key_value_list_t **provides_depends);
+
+/**
+ * @brief Retrieve clears provides of the type-info file from JSON events of the "clears_artifact_provides" member
+ * @param json Streaming JSON parser
+ * @param event JSON event
+ * @param depth Depth of the event
+ * @param token Token of the event, NULL for containers
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_artifact_json_clears_provides(mender_artifact_json_t *json, mender_json_event_t event, size_t depth, char *token);
+#endif
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
+
+/**
+ * @brief Read content of the current file of the artifact, used for the files that must be parsed at once
+ * @param ctx Artifact context
+ * @return MENDER_DONE if the whole file has been read to ctx->file.data, MENDER_OK if there is not enough data to read, error code if an error occurred
+ */
+static mender_err_t mender_artifact_read_file(mender_artifact_ctx_t *ctx);
+
+/**
+ * @brief Copy input data to the internal ring buffer
+ * @param ctx Artifact context
+ * @param data Input data
+ * @param length Length of the input data
+ * @return Length of the data copied, limited by the free space of the ring buffer
+ */
+static size_t mender_artifact_write_data(mender_artifact_ctx_t *ctx, void *data, size_t length);
+
 /**
  * @brief Shift data after parsing
  * @param ctx Artifact context
@@ -135,6 +451,20 @@ static mender_err_t mender_artifact_drop_file(mender_artifact_ctx_t *ctx);
  */
 static mender_err_t mender_artifact_shift_data(mender_artifact_ctx_t *ctx, size_t length);
 
+/**
+ * @brief Get pointer to the first data not parsed yet in the internal ring buffer
+ * @param ctx Artifact context
+ * @return Pointer to data, the first block is always contiguous
+ */
+static void *mender_artifact_get_data(mender_artifact_ctx_t *ctx);
+
+/**
+ * @brief Get length of the data not parsed yet that are contiguous in the internal ring buffer
+ * @param ctx Artifact context
+ * @return Length of the contiguous data, starting at the pointer returned by mender_artifact_get_data
+ */
+static size_t mender_artifact_get_contiguous_length(mender_artifact_ctx_t *ctx);
+
 /**
  * @brief Compute length rounded up to increment (usually the block size)
  * @param length Length
@@ -143,62 +473,82 @@ static mender_err_t mender_artifact_shift_data(mender_artifact_ctx_t *ctx, size_
  */
 static size_t mender_artifact_round_up(size_t length, size_t incr);
 
-/**
- * @brief Artifact context
- */
-static mender_artifact_ctx_t *mender_artifact_ctx = NULL;
-
 mender_artifact_ctx_t *
 mender_artifact_create_ctx(void) {
 
     mender_artifact_ctx_t *ctx;
 
     /* Create new context */
-    if (NULL == (ctx = (mender_artifact_ctx_t *)calloc(1, sizeof(mender_artifact_ctx_t)))) {
+    if (NULL == (ctx = (mender_artifact_ctx_t *)mender_utils_calloc(1, sizeof(mender_artifact_ctx_t)))) {
         return NULL;
     }
 
-    /* Save context */
-    mender_artifact_ctx = ctx;
-
     return ctx;
 }
 
-mender_err_t
-mender_artifact_get_ctx(mender_artifact_ctx_t **ctx) {
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+void
+mender_artifact_set_verification_key(mender_artifact_ctx_t *ctx, const char *key) {
 
     assert(NULL != ctx);
 
-    if (NULL == mender_artifact_ctx) {
-        return MENDER_FAIL;
-    }
-
-    *ctx = mender_artifact_ctx;
-    return MENDER_OK;
+    /* Save the public key, the signature is verified when the manifest signature is parsed */
+    ctx->signature.key = key;
 }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
 
 mender_err_t
 mender_artifact_process_data(mender_artifact_ctx_t *ctx,
                              void                  *input_data,
                              size_t                 input_length,
-                             mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+                             mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t)) {
 
     assert(NULL != ctx);
     assert(NULL != callback);
     mender_err_t ret = MENDER_OK;
-    void        *tmp;
+    size_t       length;
 
-    /* Copy data to the end of the internal buffer */
-    if ((NULL != input_data) && (0 != input_length)) {
-        if (NULL == (tmp = realloc(ctx->input.data, ctx->input.length + input_length))) {
-            /* Unable to allocate memory */
-            return MENDER_FAIL;
-        }
-        ctx->input.data = tmp;
-        memcpy((void *)(((uint8_t *)ctx->input.data) + ctx->input.length), input_data, input_length);
-        ctx->input.length += input_length;
+    /* Update statistics */
+    if (NULL != input_data) {
+        ctx->stats.received += input_length;
     }
 
+    /* Process input data chunk by chunk, the internal ring buffer may be smaller than the input data */
+    do {
+
+        /* Pass payload data directly to the callback or skip data not relevant when nothing is pending in the internal ring buffer */
+        if ((NULL != input_data) && (0 == ctx->input.length)) {
+            if (MENDER_OK != (ret = mender_artifact_pass_data(ctx, callback, &input_data, &input_length))) {
+                return ret;
+            }
+        }
+
+        /* Copy data to the internal ring buffer */
+        if ((NULL != input_data) && (0 != input_length)) {
+            length     = mender_artifact_write_data(ctx, input_data, input_length);
+            input_data = (void *)(((uint8_t *)input_data) + length);
+            input_length -= length;
+            ctx->stats.copied += length;
+        }
+
+        /* Parse data */
+        if (MENDER_OK != (ret = mender_artifact_parse_data(ctx, callback))) {
+            return ret;
+        }
+
+        /* Data remaining in the ring buffer are always lower than two blocks at this point, so that the next copy is possible */
+    } while (0 != input_length);
+
+    return ret;
+}
+
+static mender_err_t
+mender_artifact_parse_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t)) {
+
+    assert(NULL != ctx);
+    assert(NULL != callback);
+    mender_err_t ret = MENDER_OK;
+
     /* Parse data */
     do {
 
@@ -206,68 +556,93 @@ mender_artifact_process_data(mender_artifact_ctx_t *ctx,
         if (MENDER_ARTIFACT_STREAM_STATE_PARSING_HEADER == ctx->stream_state) {
 
             /* Parse TAR header */
+            mender_log_trace_begin(MENDER_LOG_TRACE_TAR_HEADER);
             ret = mender_artifact_parse_tar_header(ctx);
+            mender_log_trace_end(MENDER_LOG_TRACE_TAR_HEADER);
 
         } else if (MENDER_ARTIFACT_STREAM_STATE_PARSING_DATA == ctx->stream_state) {
 
-            /* Treatment depending of the file name */
-            if (!strcmp(ctx->file.name, "version")) {
-
-                /* Validate artifact version */
-                ret = mender_artifact_read_version(ctx);
-
+            /* Treatment depending of the file type */
+            switch (ctx->file.type) {
+                case MENDER_ARTIFACT_FILE_TYPE_VERSION:
+                    /* Validate artifact version */
+                    ret = mender_artifact_read_version(ctx);
+                    break;
 #ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
-            } else if (!strcmp(ctx->file.name, "manifest")) {
-
-                /* Read manifest file */
-                ret = mender_artifact_read_manifest(ctx);
+                case MENDER_ARTIFACT_FILE_TYPE_MANIFEST:
+                    /* Read manifest file */
+                    ret = mender_artifact_read_manifest(ctx);
+                    break;
 #endif
-            } else if (!strcmp(ctx->file.name, "header.tar/header-info")) {
-
-                /* Read header-info file */
-                ret = mender_artifact_read_header_info(ctx);
-
-            } else if ((true == mender_utils_strbeginwith(ctx->file.name, "header.tar/headers"))
-                       && (true == mender_utils_strendwith(ctx->file.name, "meta-data"))) {
-
-                /* Read meta-data file */
-                ret = mender_artifact_read_meta_data(ctx);
-
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+                case MENDER_ARTIFACT_FILE_TYPE_MANIFEST_SIG:
+                    /* Read signature of the manifest file */
+                    ret = mender_artifact_read_manifest_sig(ctx);
+                    break;
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+                case MENDER_ARTIFACT_FILE_TYPE_HEADER_INFO:
+                    /* Read header-info file */
+                    ret = mender_artifact_read_header_info(ctx);
+                    break;
+                case MENDER_ARTIFACT_FILE_TYPE_META_DATA:
+                    /* Read meta-data file */
+                    ret = mender_artifact_read_meta_data(ctx);
+                    break;
 #ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
-            } else if (mender_utils_strbeginwith(ctx->file.name, "header.tar/headers") && mender_utils_strendwith(ctx->file.name, "type-info")) {
-
-                /* Read type-info file */
-                ret = mender_artifact_read_type_info(ctx);
+                case MENDER_ARTIFACT_FILE_TYPE_TYPE_INFO:
+                    /* Read type-info file */
+                    ret = mender_artifact_read_type_info(ctx);
+                    break;
 #endif
-            } else if (true == mender_utils_strbeginwith(ctx->file.name, "data")) {
-
-                /* Read data */
-                ret = mender_artifact_read_data(ctx, callback);
-
-            } else if (false == mender_utils_strendwith(ctx->file.name, ".tar")) {
-
-                /* Drop data, file is not relevant */
-                ret = mender_artifact_drop_file(ctx);
-
-            } else {
-
-                /* Nothing to do */
-                ret = MENDER_DONE;
+                case MENDER_ARTIFACT_FILE_TYPE_DATA_TAR:
+                case MENDER_ARTIFACT_FILE_TYPE_DATA:
+                    /* Read data */
+                    ret = mender_artifact_read_data(ctx, callback);
+                    break;
+#ifdef CONFIG_MENDER_ARTIFACT_GZIP
+                case MENDER_ARTIFACT_FILE_TYPE_DATA_TAR_GZ:
+                case MENDER_ARTIFACT_FILE_TYPE_TAR_GZ:
+                    /* Read compressed file */
+                    ret = mender_artifact_read_compressed_file(ctx, callback);
+                    break;
+#else
+                case MENDER_ARTIFACT_FILE_TYPE_DATA_TAR_GZ:
+                    /* Compressed payloads are not supported */
+                    mender_log_error("Compressed payloads are not supported");
+                    ret = MENDER_FAIL;
+                    break;
+#endif /* CONFIG_MENDER_ARTIFACT_GZIP */
+                case MENDER_ARTIFACT_FILE_TYPE_TAR:
+                    /* Nothing to do */
+                    ret = MENDER_DONE;
+                    break;
+                default:
+                    /* Drop data, file is not relevant */
+                    ret = mender_artifact_drop_file(ctx);
+                    break;
             }
 
             /* Check if file have been parsed and treatment done */
             if (MENDER_DONE == ret) {
 
-                /* Remove the previous file name */
-                char *substring = mender_utils_strrstr(ctx->file.name, ".tar");
+                /* Remove the previous file name, compressed TAR files are removed as any other file */
+                char *substring;
+                if ((MENDER_ARTIFACT_FILE_TYPE_DATA_TAR_GZ == ctx->file.type) || (MENDER_ARTIFACT_FILE_TYPE_TAR_GZ == ctx->file.type)) {
+                    *mender_utils_strrstr(ctx->file.name, ".tar.gz") = '\0';
+                }
+                substring = mender_utils_strrstr(ctx->file.name, ".tar");
                 if (NULL != substring) {
                     *(substring + strlen(".tar")) = '\0';
                 } else {
-                    free(ctx->file.name);
+                    mender_utils_free(ctx->file.name);
                     ctx->file.name = NULL;
                 }
                 ctx->file.size  = 0;
                 ctx->file.index = 0;
+                if (NULL != ctx->file.data) {
+                    mender_utils_free(ctx->file.data);
+                    ctx->file.data = NULL;
+                }
 
                 /* Update the stream state machine */
                 ctx->stream_state = MENDER_ARTIFACT_STREAM_STATE_PARSING_HEADER;
@@ -283,38 +658,50 @@ mender_artifact_release_ctx(mender_artifact_ctx_t *ctx) {
 
     /* Release memory */
     if (NULL != ctx) {
-        if (NULL != ctx->input.data) {
-            free(ctx->input.data);
-        }
         if (NULL != ctx->payloads.values) {
             for (size_t index = 0; index < ctx->payloads.size; index++) {
-                if (NULL != ctx->payloads.values[index].type) {
-                    free(ctx->payloads.values[index].type);
-                }
+#ifndef CONFIG_MENDER_TINY
                 if (NULL != ctx->payloads.values[index].meta_data) {
                     cJSON_Delete(ctx->payloads.values[index].meta_data);
                 }
+#endif /* CONFIG_MENDER_TINY */
 
 #ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
                 mender_utils_free_linked_list(ctx->payloads.values[index].provides);
                 mender_utils_free_linked_list(ctx->payloads.values[index].depends);
-                for (size_t i = 0; i < ctx->payloads.values[index].clears_provides_size; i++) {
-                    free(ctx->payloads.values[index].clears_provides[i]);
-                }
-                free(ctx->payloads.values[index].clears_provides);
 #endif
             }
-            free(ctx->payloads.values);
         }
         if (NULL != ctx->file.name) {
-            free(ctx->file.name);
+            mender_utils_free(ctx->file.name);
+        }
+        if (NULL != ctx->file.data) {
+            mender_utils_free(ctx->file.data);
+        }
+#ifdef CONFIG_MENDER_ARTIFACT_GZIP
+        mender_artifact_release_decompressor(ctx);
+#endif /* CONFIG_MENDER_ARTIFACT_GZIP */
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+        if (NULL != ctx->file.sha256) {
+            mender_tls_sha256_end(ctx->file.sha256, NULL);
+        }
+#endif
+#ifdef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
+        if (NULL != ctx->file.json) {
+            mender_utils_free(ctx->file.json);
+        }
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+        if (NULL != ctx->signature.sha256) {
+            mender_tls_sha256_end(ctx->signature.sha256, NULL);
         }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
 #ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
         mender_utils_free_linked_list(ctx->artifact_info.provides);
         mender_utils_free_linked_list(ctx->artifact_info.depends);
-        mender_utils_free_linked_list(ctx->artifact_info.checksums);
 #endif
-        free(ctx);
+        mender_utils_arena_release(&ctx->arena);
+        mender_utils_free(ctx);
     }
 }
 
@@ -323,14 +710,17 @@ mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
     char *tmp;
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    bool signed_file;
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
 
     /* Check if enough data are received (at least one block) */
-    if ((NULL == ctx->input.data) || (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+    if (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE) {
         return MENDER_OK;
     }
 
     /* Cast block to TAR header structure */
-    mender_artifact_tar_header_t *tar_header = (mender_artifact_tar_header_t *)ctx->input.data;
+    mender_artifact_tar_header_t *tar_header = (mender_artifact_tar_header_t *)mender_artifact_get_data(ctx);
 
     /* Check if file name is provided, else the end of the current TAR file is reached */
     if ('\0' == tar_header->name[0]) {
@@ -349,11 +739,11 @@ mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
                 if (NULL != substring) {
                     *(substring + strlen(".tar")) = '\0';
                 } else {
-                    free(ctx->file.name);
+                    mender_utils_free(ctx->file.name);
                     ctx->file.name = NULL;
                 }
             } else {
-                free(ctx->file.name);
+                mender_utils_free(ctx->file.name);
                 ctx->file.name = NULL;
             }
         }
@@ -374,17 +764,22 @@ mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
         return MENDER_FAIL;
     }
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    /* Only the files at the root of the artifact are checked, the content of the TAR files is covered by their checksum */
+    signed_file = ((NULL != ctx->signature.key) && (NULL == ctx->file.name));
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+
     /* Compute the new file name */
     if (NULL != ctx->file.name) {
         size_t str_length = strlen(ctx->file.name) + strlen("/") + strlen(tar_header->name) + 1;
-        if (NULL == (tmp = (char *)malloc(str_length))) {
+        if (NULL == (tmp = (char *)mender_utils_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             return MENDER_FAIL;
         }
         snprintf(tmp, str_length, "%s/%s", ctx->file.name, tar_header->name);
-        free(ctx->file.name);
+        mender_utils_free(ctx->file.name);
     } else {
-        if (NULL == (tmp = strdup(tar_header->name))) {
+        if (NULL == (tmp = mender_utils_strdup(tar_header->name))) {
             mender_log_error("Unable to allocate memory");
             return MENDER_FAIL;
         }
@@ -395,12 +790,24 @@ mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
     sscanf(tar_header->size, "%o", (unsigned int *)&(ctx->file.size));
     ctx->file.index = 0;
 
+    /* Classify the file once, so that the treatment is selected without parsing the name again */
+    if (MENDER_OK != mender_artifact_classify_file(ctx)) {
+        return MENDER_FAIL;
+    }
+
     /* Shift data in the buffer */
     if (MENDER_OK != mender_artifact_shift_data(ctx, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
         mender_log_error("Unable to shift input data");
         return MENDER_FAIL;
     }
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    /* Begin computation of the digest after the TAR header has been shifted, so that only the content of the file is hashed */
+    if ((true == signed_file) && (MENDER_OK != mender_artifact_begin_signed_file(ctx))) {
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+
     /* Update the stream state machine */
     ctx->stream_state = MENDER_ARTIFACT_STREAM_STATE_PARSING_DATA;
 
@@ -408,19 +815,113 @@ mender_artifact_parse_tar_header(mender_artifact_ctx_t *ctx) {
 }
 
 static mender_err_t
-mender_artifact_read_version(mender_artifact_ctx_t *ctx) {
+mender_artifact_classify_file(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
-    cJSON       *object = NULL;
-    mender_err_t ret    = MENDER_DONE;
+    assert(NULL != ctx->file.name);
+    unsigned int index = 0;
+
+    /* Treatment depending of the file name */
+    ctx->file.payload_index = 0;
+    if (!strcmp(ctx->file.name, "version")) {
+        ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_VERSION;
+    } else if (!strcmp(ctx->file.name, "manifest")) {
+        ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_MANIFEST;
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    } else if ((NULL != ctx->signature.key) && (!strcmp(ctx->file.name, "manifest.sig"))) {
+        ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_MANIFEST_SIG;
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+    } else if (!strcmp(ctx->file.name, "header.tar/header-info")) {
+        ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_HEADER_INFO;
+    } else if ((true == mender_utils_strbeginwith(ctx->file.name, "header.tar/headers"))
+               && (true == mender_utils_strendwith(ctx->file.name, "meta-data"))) {
+        if (1 != sscanf(ctx->file.name, "header.tar/headers/%u/meta-data", &index)) {
+            mender_log_error("Invalid artifact format");
+            return MENDER_FAIL;
+        }
+        ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_META_DATA;
+    } else if ((true == mender_utils_strbeginwith(ctx->file.name, "header.tar/headers"))
+               && (true == mender_utils_strendwith(ctx->file.name, "type-info"))) {
+        if (1 != sscanf(ctx->file.name, "header.tar/headers/%u/type-info", &index)) {
+            mender_log_error("Invalid artifact format");
+            return MENDER_FAIL;
+        }
+        ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_TYPE_INFO;
+    } else if (true == mender_utils_strendwith(ctx->file.name, ".tar.gz")) {
+        if (true == mender_utils_strbeginwith(ctx->file.name, "data")) {
+            if (1 != sscanf(ctx->file.name, "data/%u.tar.gz", &index)) {
+                mender_log_error("Invalid artifact format");
+                return MENDER_FAIL;
+            }
+            ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_DATA_TAR_GZ;
+        } else {
+            ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_TAR_GZ;
+        }
+    } else if (true == mender_utils_strbeginwith(ctx->file.name, "data")) {
+        if (1 != sscanf(ctx->file.name, "data/%u.tar", &index)) {
+            mender_log_error("Invalid artifact format");
+            return MENDER_FAIL;
+        }
+        if ((strlen("data/xxxx.tar") != strlen(ctx->file.name)) && (NULL == strstr(ctx->file.name, ".tar/"))) {
+            mender_log_error("Unsupported compression of the payload '%s'", ctx->file.name);
+            return MENDER_FAIL;
+        }
+        /* Check if a file name is provided (we don't check the extension because we don't know it) */
+        ctx->file.type = (strlen("data/xxxx.tar") == strlen(ctx->file.name)) ? MENDER_ARTIFACT_FILE_TYPE_DATA_TAR : MENDER_ARTIFACT_FILE_TYPE_DATA;
+    } else if (true == mender_utils_strendwith(ctx->file.name, ".tar")) {
+        ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_TAR;
+    } else {
+        ctx->file.type = MENDER_ARTIFACT_FILE_TYPE_DROP;
+    }
+    ctx->file.payload_index = (size_t)index;
 
-    /* Check if all data have been received */
-    if ((NULL == ctx->input.data) || (ctx->input.length < mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-        return MENDER_OK;
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_read_version(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+#ifndef CONFIG_MENDER_TINY
+    cJSON *object = NULL;
+#endif /* CONFIG_MENDER_TINY */
+    mender_err_t ret = MENDER_DONE;
+
+    /* Read file, check if all data have been received */
+    if (MENDER_DONE != (ret = mender_artifact_read_file(ctx))) {
+        return ret;
     }
 
     /* Check version file */
-    if (NULL == (object = cJSON_ParseWithLength(ctx->input.data, ctx->file.size))) {
+#ifdef CONFIG_MENDER_TINY
+    mender_json_token_t tokens[MENDER_ARTIFACT_VERSION_TOKENS];
+    size_t              count;
+    char               *format;
+    double              version;
+    if (MENDER_OK != mender_json_tokenize(ctx->file.data, ctx->file.size, tokens, sizeof(tokens) / sizeof(tokens[0]), &count)) {
+        mender_log_error("Invalid version file");
+        return MENDER_FAIL;
+    }
+    mender_json_token_t *json_format  = mender_json_token_get(ctx->file.data, tokens, "format");
+    mender_json_token_t *json_version = mender_json_token_get(ctx->file.data, tokens, "version");
+    if ((NULL == json_format) || (NULL == (format = mender_json_token_string(ctx->file.data, json_format))) || (NULL == json_version)
+        || (MENDER_OK != mender_json_token_number(ctx->file.data, json_version, &version))) {
+        mender_log_error("Invalid version file");
+        return MENDER_FAIL;
+    }
+    if (strcmp(format, MENDER_ARTIFACT_SUPPORTED_FORMAT)) {
+        mender_log_error("Invalid version format");
+        return MENDER_FAIL;
+    }
+    if (MENDER_ARTIFACT_SUPPORTED_VERSION != (int)version) {
+        mender_log_error("Invalid version value");
+        return MENDER_FAIL;
+    }
+    mender_log_info("Artifact has valid version");
+
+    return ret;
+#else
+    if (NULL == (object = cJSON_ParseWithLength(ctx->file.data, ctx->file.size))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
@@ -450,13 +951,6 @@ mender_artifact_read_version(mender_artifact_ctx_t *ctx) {
     }
     mender_log_info("Artifact has valid version");
 
-    /* Shift data in the buffer */
-    if (MENDER_OK != mender_artifact_shift_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-        mender_log_error("Unable to shift input data");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-
 END:
 
     /* Release memory */
@@ -465,6 +959,7 @@ END:
     }
 
     return ret;
+#endif /* CONFIG_MENDER_TINY */
 }
 
 #ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
@@ -491,10 +986,11 @@ static mender_err_t
 mender_artifact_read_manifest(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
+    mender_err_t ret;
 
-    /* Check if all data has been received */
-    if ((NULL == ctx->input.data) || (ctx->input.length < mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-        return MENDER_OK;
+    /* Read file, check if all data has been received */
+    if (MENDER_DONE != (ret = mender_artifact_read_file(ctx))) {
+        return ret;
     }
 
     /*  The expected format matches the output of sha256sum: sum and the name of the file separated by two spaces
@@ -504,8 +1000,8 @@ mender_artifact_read_manifest(mender_artifact_ctx_t *ctx) {
     */
 
     /* Read data line by line */
-    char *line = ctx->input.data;
-    char *end  = ctx->input.data + ctx->input.length;
+    char *line = ctx->file.data;
+    char *end  = (char *)ctx->file.data + ctx->file.size;
     while (line < end) {
         char *next = strchr(line, '\n');
         if (NULL == next) {
@@ -521,19 +1017,18 @@ mender_artifact_read_manifest(mender_artifact_ctx_t *ctx) {
         }
 
         /* Add checksum to the list */
-        mender_key_value_list_t *checksum = (mender_key_value_list_t *)calloc(1, sizeof(mender_key_value_list_t));
+        mender_key_value_list_t *checksum = (mender_key_value_list_t *)mender_utils_arena_alloc(&ctx->arena, sizeof(mender_key_value_list_t));
         if (NULL == checksum) {
             mender_log_error("Unable to allocate memory");
             return MENDER_FAIL;
         }
         *separator = '\0';
 
-        /* Allocate memory and check if allocation was succesfull */
-        checksum->key   = strdup(line);
-        checksum->value = strdup(separator + 2);
+        /* Allocate memory and check if allocation was succesfull, the checksum is released with the arena */
+        checksum->key   = mender_utils_arena_strdup(&ctx->arena, line);
+        checksum->value = mender_utils_arena_strdup(&ctx->arena, separator + 2);
         if ((NULL == checksum->key) || (NULL == checksum->value)) {
             mender_log_error("Unable to allocate memory");
-            mender_utils_free_linked_list(checksum);
             return MENDER_FAIL;
         }
         checksum->next               = ctx->artifact_info.checksums;
@@ -543,12 +1038,6 @@ mender_artifact_read_manifest(mender_artifact_ctx_t *ctx) {
         line = next + 1;
     }
 
-    /* Shift data in the buffer */
-    if (MENDER_OK != mender_artifact_shift_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-        mender_log_error("Unable to shift input data");
-        return MENDER_FAIL;
-    }
-
     return MENDER_DONE;
 }
 
@@ -559,19 +1048,19 @@ mender_create_provides_depends_node(const char *type, const char *value, mender_
     assert(NULL != value);
     assert(NULL != provides_depends);
 
-    mender_key_value_list_t *item = (mender_key_value_list_t *)calloc(1, sizeof(mender_key_value_list_t));
+    mender_key_value_list_t *item = (mender_key_value_list_t *)mender_utils_calloc(1, sizeof(mender_key_value_list_t));
     if (NULL == item) {
         mender_log_error("Unable to allocate memory for linked list node");
         return MENDER_FAIL;
     }
 
-    item->key = strdup(type);
+    item->key = mender_utils_strdup(type);
     if (NULL == item->key) {
         mender_log_error("Unable to allocate memory for type");
         goto ERROR;
     }
 
-    item->value = strdup(value);
+    item->value = mender_utils_strdup(value);
     if (NULL == item->value) {
         mender_log_error("Unable to allocate memory for value");
         goto ERROR;
@@ -583,13 +1072,15 @@ mender_create_provides_depends_node(const char *type, const char *value, mender_
     return MENDER_OK;
 
 ERROR:
-    free(item->key);
-    free(item->value);
-    free(item);
+    mender_utils_free(item->key);
+    mender_utils_free(item->value);
+    mender_utils_free(item);
 
     return MENDER_FAIL;
 }
 
+#ifndef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
+
 static mender_err_t
 mender_artifact_parse_provides_depends(cJSON *json_provides_depends, mender_key_value_list_t **provides_depends) {
 
@@ -626,29 +1117,222 @@ ERROR:
     mender_utils_free_linked_list(*provides_depends);
     return MENDER_FAIL;
 }
+
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
 #endif
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
 static mender_err_t
-mender_artifact_read_header_info(mender_artifact_ctx_t *ctx) {
+mender_artifact_begin_signed_file(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+    assert(NULL != ctx->file.name);
+    mender_err_t ret;
+
+    /* Version and manifest files are hashed before the signature is parsed, the header file after, other files are covered by the checksums */
+    switch (ctx->file.type) {
+        case MENDER_ARTIFACT_FILE_TYPE_VERSION:
+        case MENDER_ARTIFACT_FILE_TYPE_MANIFEST:
+        case MENDER_ARTIFACT_FILE_TYPE_MANIFEST_SIG:
+            if (true == ctx->signature.verified) {
+                mender_log_error("Invalid artifact format");
+                return MENDER_FAIL;
+            }
+            if (MENDER_ARTIFACT_FILE_TYPE_MANIFEST_SIG == ctx->file.type) {
+                return MENDER_OK;
+            }
+            break;
+        default:
+            if (true != ctx->signature.verified) {
+                mender_log_error("Artifact is not signed");
+                return MENDER_FAIL;
+            }
+            if (strcmp(ctx->file.name, "header.tar") && strcmp(ctx->file.name, "header.tar.gz")) {
+                return MENDER_OK;
+            }
+            break;
+    }
+
+    /* Begin computation of the digest */
+    if (NULL != ctx->signature.sha256) {
+        mender_tls_sha256_end(ctx->signature.sha256, NULL);
+        ctx->signature.sha256 = NULL;
+    }
+    if (MENDER_OK != (ret = mender_tls_sha256_begin(&ctx->signature.sha256))) {
+        mender_log_error("Unable to begin computation of the checksum");
+        return ret;
+    }
+    ctx->signature.type      = ctx->file.type;
+    ctx->signature.remaining = ctx->file.size;
+
+    /* Files may be empty, the digest is computed at once in this case */
+    return (0 == ctx->file.size) ? mender_artifact_update_signed_file(ctx, NULL, 0) : MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_update_signed_file(mender_artifact_ctx_t *ctx, void *data, size_t length) {
 
     assert(NULL != ctx);
-    cJSON       *object = NULL;
-    mender_err_t ret    = MENDER_DONE;
+    mender_err_t ret;
+
+    /* Check if a signed file is currently hashed */
+    if (NULL == ctx->signature.sha256) {
+        return MENDER_OK;
+    }
+
+    /* Update digest, padding is not hashed */
+    if (length > ctx->signature.remaining) {
+        length = ctx->signature.remaining;
+    }
+    if ((0 != length) && (MENDER_OK != (ret = mender_tls_sha256_update(ctx->signature.sha256, data, length)))) {
+        mender_log_error("Unable to update the checksum");
+        return ret;
+    }
+    ctx->signature.remaining -= length;
 
-    /* Check if all data have been received */
-    if ((NULL == ctx->input.data) || (ctx->input.length < mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
+    /* Check if the end of the file is reached */
+    if (0 != ctx->signature.remaining) {
         return MENDER_OK;
     }
 
+    /* Compute digest */
+    uint8_t digest[MENDER_TLS_SHA256_DIGEST_LENGTH];
+    ret                   = mender_tls_sha256_end(ctx->signature.sha256, digest);
+    ctx->signature.sha256 = NULL;
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to compute the checksum");
+        return ret;
+    }
+
+    /* Save digest of the version and manifest files, they are verified with the signature, header file is verified against the signed manifest */
+    if (MENDER_ARTIFACT_FILE_TYPE_VERSION == ctx->signature.type) {
+        memcpy(ctx->signature.version, digest, sizeof(digest));
+        ctx->signature.version_hashed = true;
+    } else if (MENDER_ARTIFACT_FILE_TYPE_MANIFEST == ctx->signature.type) {
+        memcpy(ctx->signature.manifest, digest, sizeof(digest));
+        ctx->signature.manifest_hashed = true;
+    } else {
+        char checksum[2 * MENDER_TLS_SHA256_DIGEST_LENGTH + 1];
+        mender_artifact_format_checksum(digest, checksum);
+        if (strcmp(checksum, ctx->signature.header)) {
+            mender_log_error("Invalid checksum of the header file");
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_read_manifest_sig(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+    const char  *checksum;
+    mender_err_t ret;
+
+    /* Read file, check if all data have been received */
+    if (MENDER_DONE != (ret = mender_artifact_read_file(ctx))) {
+        return ret;
+    }
+
+    /* Version and manifest files are expected before the signature */
+    if ((true != ctx->signature.version_hashed) || (true != ctx->signature.manifest_hashed)) {
+        mender_log_error("Invalid artifact format");
+        return MENDER_FAIL;
+    }
+
+    /* Verify signature of the manifest */
+    if (MENDER_OK != (ret = mender_tls_verify_signature(ctx->signature.key, ctx->signature.manifest, ctx->file.data, ctx->file.size))) {
+        mender_log_error("Invalid signature of the manifest");
+        return ret;
+    }
+
+    /* Verify the version file against the signed manifest */
+    char version[2 * MENDER_TLS_SHA256_DIGEST_LENGTH + 1];
+    mender_artifact_format_checksum(ctx->signature.version, version);
+    if ((NULL == (checksum = mender_artifact_get_checksum(ctx, "version"))) || (strcmp(version, checksum))) {
+        mender_log_error("Invalid checksum of file 'version'");
+        return MENDER_FAIL;
+    }
+
+    /* Retrieve checksum of the header file, it is verified when the header file is parsed */
+    if ((NULL == (checksum = mender_artifact_get_checksum(ctx, "header.tar.gz"))) && (NULL == (checksum = mender_artifact_get_checksum(ctx, "header.tar")))) {
+        mender_log_error("Checksum of the header file not found in the manifest");
+        return MENDER_FAIL;
+    }
+    if (strlen(checksum) >= sizeof(ctx->signature.header)) {
+        mender_log_error("Invalid manifest file");
+        return MENDER_FAIL;
+    }
+    strcpy(ctx->signature.header, checksum);
+    ctx->signature.verified = true;
+    mender_log_info("Artifact has valid signature");
+
+    return MENDER_DONE;
+}
+
+static const char *
+mender_artifact_get_checksum(mender_artifact_ctx_t *ctx, const char *name) {
+
+    assert(NULL != ctx);
+    assert(NULL != name);
+
+    /* Key is the checksum and value is the name of the file */
+    mender_key_value_list_t *item = ctx->artifact_info.checksums;
+    while (NULL != item) {
+        if ((NULL != item->key) && (NULL != item->value) && (0 == strcmp(name, item->value))) {
+            return item->key;
+        }
+        item = item->next;
+    }
+
+    return NULL;
+}
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+
+static mender_err_t
+mender_artifact_read_header_info(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+    mender_err_t ret = MENDER_DONE;
+
+#ifdef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
+
+    /* Parse header-info as data are received, check if all data have been received */
+    if (MENDER_DONE != (ret = mender_artifact_stream_json_file(ctx, &mender_artifact_header_info_json_callback))) {
+        return ret;
+    }
+
+    /* Check payloads */
+    if (NULL == ctx->payloads.values) {
+        mender_log_error("Invalid header-info file");
+        return MENDER_FAIL;
+    }
+    for (size_t index = 0; index < ctx->payloads.size; index++) {
+        if (NULL == ctx->payloads.values[index].type) {
+            mender_log_error("Invalid header-info file");
+            return MENDER_FAIL;
+        }
+    }
+
+#else
+    cJSON *object = NULL;
+
+    /* Read file, check if all data have been received */
+    if (MENDER_DONE != (ret = mender_artifact_read_file(ctx))) {
+        return ret;
+    }
+
     /* Read header-info */
-    if (NULL == (object = cJSON_ParseWithLength(ctx->input.data, ctx->file.size))) {
+    if (NULL == (object = cJSON_ParseWithLength(ctx->file.data, ctx->file.size))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
     cJSON *json_payloads = cJSON_GetObjectItemCaseSensitive(object, "payloads");
     if (true == cJSON_IsArray(json_payloads)) {
         ctx->payloads.size = cJSON_GetArraySize(json_payloads);
-        if (NULL == (ctx->payloads.values = (mender_artifact_payload_t *)calloc(ctx->payloads.size, sizeof(mender_artifact_payload_t)))) {
+        if (NULL == (ctx->payloads.values
+                        = (mender_artifact_payload_t *)mender_utils_arena_alloc(&ctx->arena, ctx->payloads.size * sizeof(mender_artifact_payload_t)))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -659,7 +1343,7 @@ mender_artifact_read_header_info(mender_artifact_ctx_t *ctx) {
             if (true == cJSON_IsObject(json_payload)) {
                 cJSON *json_payload_type = cJSON_GetObjectItemCaseSensitive(json_payload, "type");
                 if (cJSON_IsString(json_payload_type)) {
-                    if (NULL == (ctx->payloads.values[index].type = strdup(cJSON_GetStringValue(json_payload_type)))) {
+                    if (NULL == (ctx->payloads.values[index].type = mender_utils_arena_strdup(&ctx->arena, cJSON_GetStringValue(json_payload_type)))) {
                         mender_log_error("Unable to allocate memory");
                         ret = MENDER_FAIL;
                         goto END;
@@ -703,19 +1387,13 @@ mender_artifact_read_header_info(mender_artifact_ctx_t *ctx) {
         goto END;
     }
 
-    /* Shift data in the buffer */
-    if (MENDER_OK != mender_artifact_shift_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-        mender_log_error("Unable to shift input data");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-
 END:
 
     /* Release memory */
     if (NULL != object) {
         cJSON_Delete(object);
     }
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
 
     return ret;
 }
@@ -725,17 +1403,36 @@ static mender_err_t
 mender_artifact_read_type_info(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
-    cJSON       *object = NULL;
-    mender_err_t ret    = MENDER_DONE;
-    size_t       index  = 0;
+    mender_err_t ret   = MENDER_DONE;
+    size_t       index = ctx->file.payload_index;
 
-    /* Check if all data have been received */
-    if ((NULL == ctx->input.data) || (ctx->input.length < mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-        return MENDER_OK;
+    /* Check payload index */
+    if (index >= ctx->payloads.size) {
+        mender_log_error("Invalid artifact format");
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
+
+    /* Check if payload index is valid */
+    if (NULL == ctx->payloads.values[index].type) {
+        mender_log_error("Invalid artifact format; no payload found for index %d", index);
+        return MENDER_FAIL;
+    }
+
+    /* Parse type-info as data are received */
+    ret = mender_artifact_stream_json_file(ctx, &mender_artifact_type_info_json_callback);
+
+#else
+    cJSON *object = NULL;
+
+    /* Read file, check if all data have been received */
+    if (MENDER_DONE != (ret = mender_artifact_read_file(ctx))) {
+        return ret;
     }
 
     /* Read type-info */
-    if (NULL == (object = cJSON_ParseWithLength(ctx->input.data, ctx->file.size))) {
+    if (NULL == (object = cJSON_ParseWithLength(ctx->file.data, ctx->file.size))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
@@ -768,7 +1465,8 @@ mender_artifact_read_type_info(mender_artifact_ctx_t *ctx) {
     cJSON *json_clears_provides = cJSON_GetObjectItemCaseSensitive(object, "clears_artifact_provides");
     if (cJSON_IsArray(json_clears_provides)) {
         ctx->payloads.values[index].clears_provides_size = cJSON_GetArraySize(json_clears_provides);
-        ctx->payloads.values[index].clears_provides      = (char **)calloc(ctx->payloads.values[index].clears_provides_size, sizeof(char *));
+        ctx->payloads.values[index].clears_provides
+            = (char **)mender_utils_arena_alloc(&ctx->arena, ctx->payloads.values[index].clears_provides_size * sizeof(char *));
         if (NULL == ctx->payloads.values[index].clears_provides) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
@@ -780,7 +1478,7 @@ mender_artifact_read_type_info(mender_artifact_ctx_t *ctx) {
 
         cJSON_ArrayForEach(json_clears_provides_element, json_clears_provides) {
             if (cJSON_IsString(json_clears_provides_element)) {
-                char *clears_provides = strdup(json_clears_provides_element->valuestring);
+                char *clears_provides = mender_utils_arena_strdup(&ctx->arena, json_clears_provides_element->valuestring);
                 if (NULL == clears_provides) {
                     mender_log_error("Unable to allocate memory");
                     ret = MENDER_FAIL;
@@ -797,19 +1495,13 @@ mender_artifact_read_type_info(mender_artifact_ctx_t *ctx) {
     }
 #endif
 
-    /* Shift data in the buffer */
-    if (MENDER_OK != mender_artifact_shift_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-        mender_log_error("Unable to shift input data");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-
 END:
 
     /* Release memory */
     if (NULL != object) {
         cJSON_Delete(object);
     }
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
 
     return ret;
 }
@@ -819,13 +1511,10 @@ static mender_err_t
 mender_artifact_read_meta_data(mender_artifact_ctx_t *ctx) {
 
     assert(NULL != ctx);
-    size_t index = 0;
+    size_t       index = ctx->file.payload_index;
+    mender_err_t ret;
 
-    /* Retrieve payload index */
-    if (1 != sscanf(ctx->file.name, "header.tar/headers/%u/meta-data", (unsigned int *)&index)) {
-        mender_log_error("Invalid artifact format");
-        return MENDER_FAIL;
-    }
+    /* Check payload index */
     if (index >= ctx->payloads.size) {
         mender_log_error("Invalid artifact format");
         return MENDER_FAIL;
@@ -837,46 +1526,50 @@ mender_artifact_read_meta_data(mender_artifact_ctx_t *ctx) {
         return MENDER_DONE;
     }
 
-    /* Check if all data have been received */
-    if ((NULL == ctx->input.data) || (ctx->input.length < mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-        return MENDER_OK;
+    /* Read file, check if all data have been received */
+    if (MENDER_DONE != (ret = mender_artifact_read_file(ctx))) {
+        return ret;
     }
 
     /* Read meta-data */
-    if (NULL == (ctx->payloads.values[index].meta_data = cJSON_ParseWithLength(ctx->input.data, ctx->file.size))) {
+#ifdef CONFIG_MENDER_TINY
+    /* The document is kept as received and parsed in place by the artifact type callbacks, it is released with the arena */
+    mender_meta_data_t *meta_data = (mender_meta_data_t *)mender_utils_arena_alloc(&ctx->arena, sizeof(mender_meta_data_t) + ctx->file.size + 1);
+    if (NULL == meta_data) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
-
-    /* Shift data in the buffer */
-    if (MENDER_OK != mender_artifact_shift_data(ctx, mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-        mender_log_error("Unable to shift input data");
+    meta_data->data   = (char *)(meta_data + 1);
+    meta_data->length = ctx->file.size;
+    memcpy(meta_data->data, ctx->file.data, ctx->file.size);
+    meta_data->data[meta_data->length]    = '\0';
+    ctx->payloads.values[index].meta_data = meta_data;
+#else
+    if (NULL == (ctx->payloads.values[index].meta_data = cJSON_ParseWithLength(ctx->file.data, ctx->file.size))) {
+        mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_TINY */
 
     return MENDER_DONE;
 }
 
 static mender_err_t
-mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t)) {
+mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t)) {
 
     assert(NULL != ctx);
     assert(NULL != callback);
-    size_t       index = 0;
+    size_t       index = ctx->file.payload_index;
     mender_err_t ret;
 
-    /* Retrieve payload index */
-    if (1 != sscanf(ctx->file.name, "data/%u.tar", (unsigned int *)&index)) {
-        mender_log_error("Invalid artifact format");
-        return MENDER_FAIL;
-    }
+    /* Check payload index */
     if (index >= ctx->payloads.size) {
         mender_log_error("Invalid artifact format");
         return MENDER_FAIL;
     }
 
-    /* Check if a file name is provided (we don't check the extension because we don't know it) */
-    if (strlen("data/xxxx.tar") == strlen(ctx->file.name)) {
+    /* Check if this is the beginning of the data file */
+    if (MENDER_ARTIFACT_FILE_TYPE_DATA_TAR == ctx->file.type) {
 
         /* Beginning of the data file */
         if (MENDER_OK != (ret = callback(ctx->payloads.values[index].type, ctx->payloads.values[index].meta_data, NULL, 0, NULL, 0, 0))) {
@@ -893,103 +1586,867 @@ mender_artifact_read_data(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(c
         return MENDER_DONE;
     }
 
-    /* Parse data until the end of the file has been reached */
-    do {
+    /* Parse data until the end of the file has been reached, part of the data may already have been passed directly from the input data */
+    while (ctx->file.index < ctx->file.size) {
 
         /* Check if enough data are received (at least one block) */
-        if ((NULL == ctx->input.data) || (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+        if (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE) {
             return MENDER_OK;
         }
 
-        /* Compute length */
-        size_t length
-            = ((ctx->file.size - ctx->file.index) > MENDER_ARTIFACT_STREAM_BLOCK_SIZE) ? MENDER_ARTIFACT_STREAM_BLOCK_SIZE : (ctx->file.size - ctx->file.index);
-
-        /* Invoke callback */
-        if (MENDER_OK
-            != (ret = callback(ctx->payloads.values[index].type,
-                               ctx->payloads.values[index].meta_data,
-                               strstr(ctx->file.name, ".tar") + strlen(".tar") + 1,
-                               ctx->file.size,
-                               ctx->input.data,
-                               ctx->file.index,
-                               length))) {
-            mender_log_error("An error occurred");
-            return ret;
+        /* Invoke callback with as many contiguous blocks as possible */
+        size_t length;
+        if (0 == (length = mender_artifact_deliver_data(ctx, callback, mender_artifact_get_data(ctx), mender_artifact_get_contiguous_length(ctx)))) {
+            return MENDER_FAIL;
         }
 
-        /* Update index */
-        ctx->file.index += MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
-
         /* Shift data in the buffer */
-        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
+        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, length))) {
             mender_log_error("Unable to shift input data");
             return ret;
         }
-
-    } while (ctx->file.index < ctx->file.size);
+    }
 
     return MENDER_DONE;
 }
 
 static mender_err_t
-mender_artifact_drop_file(mender_artifact_ctx_t *ctx) {
+mender_artifact_pass_data(mender_artifact_ctx_t *ctx,
+                          mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t),
+                          void  **input_data,
+                          size_t *input_length) {
 
     assert(NULL != ctx);
-    mender_err_t ret;
+    assert(NULL != callback);
+    assert(NULL != input_data);
+    assert(NULL != input_length);
+    size_t length;
 
-    /* Check size of the data */
-    if (0 == mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
-        /* Nothing to do */
-        return MENDER_DONE;
+    /* Check if a payload file or a file not relevant is currently parsed, the beginning of the data file and the headers use the internal ring buffer */
+    if ((MENDER_ARTIFACT_STREAM_STATE_PARSING_DATA != ctx->stream_state)
+        || ((MENDER_ARTIFACT_FILE_TYPE_DATA != ctx->file.type) && (MENDER_ARTIFACT_FILE_TYPE_DROP != ctx->file.type)) || (ctx->file.index >= ctx->file.size)) {
+        return MENDER_OK;
     }
 
-    /* Parse data until the end of the file has been reached */
-    do {
+    /* Skip complete blocks of the file not relevant, they are never copied to the internal ring buffer */
+    if (MENDER_ARTIFACT_FILE_TYPE_DROP == ctx->file.type) {
+        length = mender_artifact_round_up(ctx->file.size - ctx->file.index, MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+        if (length > *input_length) {
+            length = *input_length - (*input_length % MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+        }
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+        /* Files of an uncompressed TAR file are part of the signed file currently hashed even if they are dropped */
+        if (MENDER_OK != mender_artifact_update_signed_file(ctx, *input_data, length)) {
+            return MENDER_FAIL;
+        }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+        ctx->file.index += length;
+        *input_data = (void *)(((uint8_t *)*input_data) + length);
+        *input_length -= length;
+        return MENDER_OK;
+    }
 
-        /* Check if enough data are received (at least one block) */
-        if ((NULL == ctx->input.data) || (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
-            return MENDER_OK;
+    /* Check payload index */
+    if (ctx->file.payload_index >= ctx->payloads.size) {
+        mender_log_error("Invalid artifact format");
+        return MENDER_FAIL;
+    }
+
+    /* Pass complete blocks until the end of the file has been reached, the remaining data are copied to the internal ring buffer by the caller */
+    while ((ctx->file.index < ctx->file.size) && (*input_length >= MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+
+        /* Invoke callback with as many blocks as possible */
+        if (0 == (length = mender_artifact_deliver_data(ctx, callback, *input_data, *input_length))) {
+            return MENDER_FAIL;
         }
 
-        /* Update index */
-        ctx->file.index += MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+        /* Skip the data passed */
+        *input_data = (void *)(((uint8_t *)*input_data) + length);
+        *input_length -= length;
+    }
 
-        /* Shift data in the buffer */
-        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
-            mender_log_error("Unable to shift input data");
+    return MENDER_OK;
+}
+
+static size_t
+mender_artifact_deliver_data(mender_artifact_ctx_t *ctx,
+                             mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t),
+                             void  *data,
+                             size_t length) {
+
+    assert(NULL != ctx);
+    assert(NULL != callback);
+    assert(NULL != data);
+    assert(length >= MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+
+    /* Compute length of the blocks consumed, limited to the configured chunk size and to the end of the file (including padding) */
+    length -= length % MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+    if (length > CONFIG_MENDER_ARTIFACT_DATA_CHUNK_SIZE) {
+        length = CONFIG_MENDER_ARTIFACT_DATA_CHUNK_SIZE;
+    }
+    size_t remaining = ctx->file.size - ctx->file.index;
+    if (length > mender_artifact_round_up(remaining, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+        length = mender_artifact_round_up(remaining, MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+    }
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+    /* Verify checksum before the last data are delivered, so that the payload is never committed if it is corrupted */
+    if (MENDER_OK != mender_artifact_check_checksum(ctx, data, (remaining > length) ? length : remaining)) {
+        return 0;
+    }
+#endif
+
+    /* Invoke callback, padding is not delivered */
+    mender_log_trace_begin(MENDER_LOG_TRACE_PAYLOAD_CALLBACK);
+    mender_err_t ret = callback(ctx->payloads.values[ctx->file.payload_index].type,
+                                ctx->payloads.values[ctx->file.payload_index].meta_data,
+                                strstr(ctx->file.name, ".tar") + strlen(".tar") + 1,
+                                ctx->file.size,
+                                data,
+                                ctx->file.index,
+                                (remaining > length) ? length : remaining);
+    mender_log_trace_end(MENDER_LOG_TRACE_PAYLOAD_CALLBACK);
+    if (MENDER_OK != ret) {
+        mender_log_error("An error occurred");
+        return 0;
+    }
+
+    /* Update index */
+    ctx->file.index += length;
+
+    return length;
+}
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+static void
+mender_artifact_format_checksum(const uint8_t *digest, char *checksum) {
+
+    assert(NULL != digest);
+    assert(NULL != checksum);
+
+    /* Checksums of the manifest are lowercase hexadecimal strings */
+    for (size_t i = 0; i < MENDER_TLS_SHA256_DIGEST_LENGTH; i++) {
+        sprintf(&checksum[2 * i], "%02x", digest[i]);
+    }
+}
+
+static mender_err_t
+mender_artifact_check_checksum(mender_artifact_ctx_t *ctx, void *data, size_t length) {
+
+    assert(NULL != ctx);
+    assert(NULL != data);
+    mender_err_t ret;
+
+    /* Begin computation of the digest at the beginning of the file */
+    if (0 == ctx->file.index) {
+        if (NULL != ctx->file.sha256) {
+            mender_tls_sha256_end(ctx->file.sha256, NULL);
+            ctx->file.sha256 = NULL;
+        }
+        if (MENDER_OK != (ret = mender_tls_sha256_begin(&ctx->file.sha256))) {
+            mender_log_error("Unable to begin computation of the checksum");
             return ret;
         }
+    }
 
-    } while (ctx->file.index < ctx->file.size);
+    /* Update digest */
+    if (MENDER_OK != (ret = mender_tls_sha256_update(ctx->file.sha256, data, length))) {
+        mender_log_error("Unable to update the checksum");
+        return ret;
+    }
 
-    return MENDER_DONE;
+    /* Check if the end of the file is reached */
+    if (ctx->file.index + length < ctx->file.size) {
+        return MENDER_OK;
+    }
+
+    /* Compute digest */
+    uint8_t digest[MENDER_TLS_SHA256_DIGEST_LENGTH];
+    ret              = mender_tls_sha256_end(ctx->file.sha256, digest);
+    ctx->file.sha256 = NULL;
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to compute the checksum");
+        return ret;
+    }
+    char checksum[2 * MENDER_TLS_SHA256_DIGEST_LENGTH + 1];
+    mender_artifact_format_checksum(digest, checksum);
+
+    /* Name of the file in the manifest is "data/xxxx/<filename>" */
+    const char *filename = strstr(ctx->file.name, ".tar") + strlen(".tar") + 1;
+    char       *name;
+    if (NULL == (name = (char *)mender_utils_malloc(strlen("data/xxxx/") + strlen(filename) + 1))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    sprintf(name, "data/%04u/%s", (unsigned int)ctx->file.payload_index, filename);
+
+    /* Compare with the checksum of the manifest, key is the checksum and value is the name of the file */
+    ret                           = MENDER_FAIL;
+    mender_key_value_list_t *item = ctx->artifact_info.checksums;
+    while (NULL != item) {
+        if ((NULL != item->value) && (0 == strcmp(name, item->value))) {
+            if ((NULL != item->key) && (0 == strcmp(checksum, item->key))) {
+                ret = MENDER_OK;
+            } else {
+                mender_log_error("Invalid checksum of file '%s'", name);
+            }
+            break;
+        }
+        item = item->next;
+    }
+    if (NULL == item) {
+        mender_log_error("Checksum of file '%s' not found in the manifest", name);
+    }
+    mender_utils_free(name);
+
+    return ret;
 }
+#endif
 
+#ifdef CONFIG_MENDER_ARTIFACT_GZIP
 static mender_err_t
-mender_artifact_shift_data(mender_artifact_ctx_t *ctx, size_t length) {
+mender_artifact_read_compressed_file(mender_artifact_ctx_t *ctx,
+                                     mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t)) {
 
     assert(NULL != ctx);
-    char *tmp;
+    assert(NULL != callback);
+    mender_artifact_gzip_stream_t *gzip;
+    mender_artifact_ctx_t         *inner;
+    mender_err_t                   ret;
+    int                            err;
 
-    /* Shift data */
-    if (length > 0) {
-        if (ctx->input.length > length) {
-            memcpy(ctx->input.data, (void *)(((uint8_t *)ctx->input.data) + length), ctx->input.length - length);
-            if (NULL == (tmp = realloc(ctx->input.data, ctx->input.length - length))) {
-                mender_log_error("Unable to allocate memory");
+    /* Initialize the decompressor at the beginning of the file */
+    if (NULL == ctx->decompressor.stream) {
+
+        /* Beginning of the data file */
+        if (MENDER_ARTIFACT_FILE_TYPE_DATA_TAR_GZ == ctx->file.type) {
+            if (ctx->file.payload_index >= ctx->payloads.size) {
+                mender_log_error("Invalid artifact format");
                 return MENDER_FAIL;
             }
-            ctx->input.data = tmp;
-            ctx->input.length -= length;
-        } else {
-            free(ctx->input.data);
-            ctx->input.data   = NULL;
-            ctx->input.length = 0;
+            if (MENDER_OK
+                != (ret = callback(ctx->payloads.values[ctx->file.payload_index].type,
+                                   ctx->payloads.values[ctx->file.payload_index].meta_data,
+                                   NULL,
+                                   0,
+                                   NULL,
+                                   0,
+                                   0))) {
+                mender_log_error("An error occurred");
+                return ret;
+            }
         }
-    }
 
-    return MENDER_OK;
+        /* Create the decompression stream, gzip header is expected */
+        if (NULL == (gzip = (mender_artifact_gzip_stream_t *)mender_utils_calloc(1, sizeof(mender_artifact_gzip_stream_t)))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        if (Z_OK != inflateInit2(&gzip->stream, 16 + CONFIG_MENDER_ARTIFACT_GZIP_WINDOW_BITS)) {
+            mender_log_error("Unable to initialize decompressor");
+            mender_utils_free(gzip);
+            return MENDER_FAIL;
+        }
+        ctx->decompressor.stream = gzip;
+
+        /* Create the inner context, the decompressed TAR file is parsed as if it was not compressed */
+        if (NULL == (inner = (mender_artifact_ctx_t *)mender_utils_calloc(1, sizeof(mender_artifact_ctx_t)))) {
+            mender_log_error("Unable to allocate memory");
+            mender_artifact_release_decompressor(ctx);
+            return MENDER_FAIL;
+        }
+        ctx->decompressor.ctx = inner;
+
+        /* Payloads, artifact information and arena are lent to the inner context, they are retrieved or updated while parsing the decompressed data */
+        memcpy(&inner->payloads, &ctx->payloads, sizeof(ctx->payloads));
+        memset(&ctx->payloads, 0, sizeof(ctx->payloads));
+        memcpy(&inner->arena, &ctx->arena, sizeof(ctx->arena));
+        memset(&ctx->arena, 0, sizeof(ctx->arena));
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+        memcpy(&inner->artifact_info, &ctx->artifact_info, sizeof(ctx->artifact_info));
+        memset(&ctx->artifact_info, 0, sizeof(ctx->artifact_info));
+#endif
+        if (NULL == (inner->file.name = mender_utils_strdup(ctx->file.name))) {
+            mender_log_error("Unable to allocate memory");
+            mender_artifact_release_decompressor(ctx);
+            return MENDER_FAIL;
+        }
+        *(mender_utils_strrstr(inner->file.name, ".gz")) = '\0';
+        inner->stream_state = MENDER_ARTIFACT_STREAM_STATE_PARSING_HEADER;
+    }
+    gzip  = (mender_artifact_gzip_stream_t *)ctx->decompressor.stream;
+    inner = (mender_artifact_ctx_t *)ctx->decompressor.ctx;
+
+    /* Decompress data until the end of the file has been reached */
+    while (ctx->file.index < ctx->file.size) {
+
+        /* Check if enough data are received (at least one block) */
+        if (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE) {
+            return MENDER_OK;
+        }
+
+        /* Compute length of the contiguous blocks consumed, padding is not decompressed */
+        size_t length    = mender_artifact_get_contiguous_length(ctx);
+        size_t remaining = ctx->file.size - ctx->file.index;
+        length -= length % MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+        if (length > mender_artifact_round_up(remaining, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+            length = mender_artifact_round_up(remaining, MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+        }
+        gzip->stream.next_in  = (Bytef *)mender_artifact_get_data(ctx);
+        gzip->stream.avail_in = (uInt)((remaining > length) ? length : remaining);
+
+        /* Decompress data and parse them using the inner context, data following the end of the compressed stream are ignored */
+        while ((false == gzip->end) && (0 != gzip->stream.avail_in)) {
+            gzip->stream.next_out  = gzip->output;
+            gzip->stream.avail_out = sizeof(gzip->output);
+            err                    = inflate(&gzip->stream, Z_NO_FLUSH);
+            if ((Z_OK != err) && (Z_STREAM_END != err)) {
+                mender_log_error("Unable to decompress data");
+                return MENDER_FAIL;
+            }
+            gzip->end = (Z_STREAM_END == err);
+            if (sizeof(gzip->output) != gzip->stream.avail_out) {
+                if (MENDER_OK != (ret = mender_artifact_process_data(inner, gzip->output, sizeof(gzip->output) - gzip->stream.avail_out, callback))) {
+                    return ret;
+                }
+            }
+        }
+
+        /* Update index */
+        ctx->file.index += length;
+
+        /* Shift data in the buffer */
+        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, length))) {
+            mender_log_error("Unable to shift input data");
+            return ret;
+        }
+    }
+
+    /* Check if the whole compressed TAR file has been parsed */
+    if ((false == gzip->end) || (NULL != inner->file.name)) {
+        mender_log_error("Invalid compressed file");
+        return MENDER_FAIL;
+    }
+
+    /* Release the decompressor */
+    mender_artifact_release_decompressor(ctx);
+
+    return MENDER_DONE;
+}
+
+static void
+mender_artifact_release_decompressor(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+
+    /* Release memory */
+    if (NULL != ctx->decompressor.stream) {
+        inflateEnd(&((mender_artifact_gzip_stream_t *)ctx->decompressor.stream)->stream);
+        mender_utils_free(ctx->decompressor.stream);
+        ctx->decompressor.stream = NULL;
+    }
+    if (NULL != ctx->decompressor.ctx) {
+        mender_artifact_ctx_t *inner = (mender_artifact_ctx_t *)ctx->decompressor.ctx;
+
+        /* Data copied while parsing the decompressed TAR file are accounted to the context */
+        ctx->stats.copied += inner->stats.copied;
+
+        /* Give back payloads, artifact information and arena */
+        memcpy(&ctx->payloads, &inner->payloads, sizeof(ctx->payloads));
+        memset(&inner->payloads, 0, sizeof(inner->payloads));
+        memcpy(&ctx->arena, &inner->arena, sizeof(ctx->arena));
+        memset(&inner->arena, 0, sizeof(inner->arena));
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+        memcpy(&ctx->artifact_info, &inner->artifact_info, sizeof(ctx->artifact_info));
+        memset(&inner->artifact_info, 0, sizeof(inner->artifact_info));
+#endif
+        mender_artifact_release_ctx(inner);
+        ctx->decompressor.ctx = NULL;
+    }
+}
+#endif /* CONFIG_MENDER_ARTIFACT_GZIP */
+
+static mender_err_t
+mender_artifact_drop_file(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+    mender_err_t ret;
+
+    /* Check size of the data */
+    if (0 == mender_artifact_round_up(ctx->file.size, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+        /* Nothing to do */
+        return MENDER_DONE;
+    }
+
+    /* Drop data until the end of the file has been reached, part of the data may already have been dropped directly from the input data */
+    while (ctx->file.index < ctx->file.size) {
+
+        /* Check if enough data are received (at least one block) */
+        if (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE) {
+            return MENDER_OK;
+        }
+
+        /* Drop all the blocks of the file available at once */
+        size_t length    = ctx->input.length - (ctx->input.length % MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+        size_t remaining = mender_artifact_round_up(ctx->file.size - ctx->file.index, MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+        if (length > remaining) {
+            length = remaining;
+        }
+
+        /* Update index */
+        ctx->file.index += length;
+
+        /* Shift data in the buffer */
+        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, length))) {
+            mender_log_error("Unable to shift input data");
+            return ret;
+        }
+    }
+
+    return MENDER_DONE;
+}
+
+#ifdef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
+static mender_err_t
+mender_artifact_stream_json_file(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(void *, mender_json_event_t, size_t, char *)) {
+
+    assert(NULL != ctx);
+    assert(NULL != callback);
+    mender_artifact_json_t *json;
+    mender_err_t            ret;
+
+    /* Create the streaming JSON parser at the beginning of the file */
+    if (NULL == ctx->file.json) {
+        if (NULL == (json = (mender_artifact_json_t *)mender_utils_calloc(1, sizeof(mender_artifact_json_t)))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        json->ctx = ctx;
+        mender_json_stream_init(&json->stream, callback, json);
+        ctx->file.json = json;
+    }
+    json = (mender_artifact_json_t *)ctx->file.json;
+
+    /* Parse data as soon as they are received until the end of the file has been reached */
+    while (ctx->file.index < ctx->file.size) {
+
+        /* Check if enough data are received (at least one block) */
+        if (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE) {
+            return MENDER_OK;
+        }
+
+        /* Compute length of the contiguous blocks consumed, padding is not parsed */
+        size_t length    = mender_artifact_get_contiguous_length(ctx);
+        size_t remaining = ctx->file.size - ctx->file.index;
+        length -= length % MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+        if (length > mender_artifact_round_up(remaining, MENDER_ARTIFACT_STREAM_BLOCK_SIZE)) {
+            length = mender_artifact_round_up(remaining, MENDER_ARTIFACT_STREAM_BLOCK_SIZE);
+        }
+        if (MENDER_OK != (ret = mender_json_stream_parse(&json->stream, mender_artifact_get_data(ctx), (remaining > length) ? length : remaining))) {
+            mender_log_error("Unable to parse JSON file '%s'", ctx->file.name);
+            return ret;
+        }
+
+        /* Update index */
+        ctx->file.index += length;
+
+        /* Shift data in the buffer */
+        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, length))) {
+            mender_log_error("Unable to shift input data");
+            return ret;
+        }
+    }
+
+    /* Check if the whole document has been parsed */
+    if (MENDER_OK != (ret = mender_json_stream_end(&json->stream))) {
+        mender_log_error("Unable to parse JSON file '%s'", ctx->file.name);
+        return ret;
+    }
+
+    /* Release memory */
+    mender_utils_free(ctx->file.json);
+    ctx->file.json = NULL;
+
+    return MENDER_DONE;
+}
+
+static mender_artifact_json_key_t
+mender_artifact_json_get_key(char *key) {
+
+    assert(NULL != key);
+
+    /* Definition of keys */
+    const struct {
+        char                      *str;
+        mender_artifact_json_key_t key;
+    } desc[] = { { "payloads", MENDER_ARTIFACT_JSON_KEY_PAYLOADS },
+                 { "artifact_provides", MENDER_ARTIFACT_JSON_KEY_PROVIDES },
+                 { "artifact_depends", MENDER_ARTIFACT_JSON_KEY_DEPENDS },
+                 { "clears_artifact_provides", MENDER_ARTIFACT_JSON_KEY_CLEARS_PROVIDES } };
+
+    /* Return key */
+    for (size_t index = 0; index < sizeof(desc) / sizeof(desc[0]); index++) {
+        if (!strcmp(desc[index].str, key)) {
+            return desc[index].key;
+        }
+    }
+
+    return MENDER_ARTIFACT_JSON_KEY_OTHER;
+}
+
+static mender_err_t
+mender_artifact_json_grow(mender_artifact_ctx_t *ctx, void **values, size_t size, size_t *capacity, size_t element_size) {
+
+    assert(NULL != ctx);
+    assert(NULL != values);
+    assert(NULL != capacity);
+    void *tmp;
+
+    /* Check if the capacity is reached */
+    if ((NULL != *values) && (size < *capacity)) {
+        return MENDER_OK;
+    }
+
+    /* Reallocate the array from the arena, the previous one is released with the arena */
+    size_t new_capacity = (0 == *capacity) ? 1 : (2 * *capacity);
+    if (NULL == (tmp = mender_utils_arena_alloc(&ctx->arena, new_capacity * element_size))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (NULL != *values) {
+        memcpy(tmp, *values, size * element_size);
+    }
+    *values   = tmp;
+    *capacity = new_capacity;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_header_info_json_callback(void *arg, mender_json_event_t event, size_t depth, char *token) {
+
+    assert(NULL != arg);
+    mender_artifact_json_t *json = (mender_artifact_json_t *)arg;
+
+    /* The root of the document must be an object */
+    if (0 == depth) {
+        if ((MENDER_JSON_EVENT_OBJECT_BEGIN != event) && (MENDER_JSON_EVENT_OBJECT_END != event)) {
+            mender_log_error("Invalid header-info file");
+            return MENDER_FAIL;
+        }
+        return MENDER_OK;
+    }
+
+    /* Retrieve the member of the root object currently parsed */
+    if ((1 == depth) && (MENDER_JSON_EVENT_KEY == event)) {
+        json->key       = mender_artifact_json_get_key(token);
+        json->container = false;
+        return MENDER_OK;
+    }
+
+    /* Treatment depending of the member */
+    switch (json->key) {
+        case MENDER_ARTIFACT_JSON_KEY_PAYLOADS:
+            return mender_artifact_json_payloads(json, event, depth, token);
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+        case MENDER_ARTIFACT_JSON_KEY_PROVIDES:
+            return mender_artifact_json_provides_depends(json, event, depth, token, &json->ctx->artifact_info.provides);
+        case MENDER_ARTIFACT_JSON_KEY_DEPENDS:
+            return mender_artifact_json_provides_depends(json, event, depth, token, &json->ctx->artifact_info.depends);
+#endif
+        default:
+            /* Member not relevant */
+            break;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_json_payloads(mender_artifact_json_t *json, mender_json_event_t event, size_t depth, char *token) {
+
+    assert(NULL != json);
+    mender_artifact_ctx_t *ctx = json->ctx;
+    mender_err_t           ret;
+
+    /* Treatment depending of the depth: payloads array, payload objects, members of the payloads */
+    if (1 == depth) {
+        if ((MENDER_JSON_EVENT_ARRAY_BEGIN == event) && (false == json->container)) {
+            if (NULL != ctx->payloads.values) {
+                mender_log_error("Invalid header-info file");
+                return MENDER_FAIL;
+            }
+            json->container = true;
+            json->capacity  = 0;
+            return MENDER_OK;
+        }
+        if (MENDER_JSON_EVENT_ARRAY_END == event) {
+            return MENDER_OK;
+        }
+    } else if (2 == depth) {
+        if (MENDER_JSON_EVENT_OBJECT_BEGIN == event) {
+            if (MENDER_OK
+                != (ret = mender_artifact_json_grow(
+                        ctx, (void **)&ctx->payloads.values, ctx->payloads.size, &json->capacity, sizeof(mender_artifact_payload_t)))) {
+                return ret;
+            }
+            memset(&ctx->payloads.values[ctx->payloads.size], 0, sizeof(mender_artifact_payload_t));
+            ctx->payloads.size++;
+            json->member_key = MENDER_ARTIFACT_JSON_KEY_OTHER;
+            return MENDER_OK;
+        }
+        if (MENDER_JSON_EVENT_OBJECT_END == event) {
+            return MENDER_OK;
+        }
+    } else {
+        if ((3 == depth) && (MENDER_JSON_EVENT_KEY == event)) {
+            json->member_key = (!strcmp(token, "type")) ? MENDER_ARTIFACT_JSON_KEY_TYPE : MENDER_ARTIFACT_JSON_KEY_OTHER;
+            return MENDER_OK;
+        }
+        if ((3 != depth) || (MENDER_ARTIFACT_JSON_KEY_TYPE != json->member_key)) {
+            /* Member not relevant */
+            return MENDER_OK;
+        }
+        if (MENDER_JSON_EVENT_STRING == event) {
+            if (NULL == (ctx->payloads.values[ctx->payloads.size - 1].type = mender_utils_arena_strdup(&ctx->arena, token))) {
+                mender_log_error("Unable to allocate memory");
+                return MENDER_FAIL;
+            }
+            return MENDER_OK;
+        }
+    }
+
+    mender_log_error("Invalid header-info file");
+    return MENDER_FAIL;
+}
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+static mender_err_t
+mender_artifact_type_info_json_callback(void *arg, mender_json_event_t event, size_t depth, char *token) {
+
+    assert(NULL != arg);
+    mender_artifact_json_t *json  = (mender_artifact_json_t *)arg;
+    size_t                  index = json->ctx->file.payload_index;
+
+    /* The root of the document must be an object */
+    if (0 == depth) {
+        if ((MENDER_JSON_EVENT_OBJECT_BEGIN != event) && (MENDER_JSON_EVENT_OBJECT_END != event)) {
+            mender_log_error("Invalid type-info file");
+            return MENDER_FAIL;
+        }
+        return MENDER_OK;
+    }
+
+    /* Retrieve the member of the root object currently parsed */
+    if ((1 == depth) && (MENDER_JSON_EVENT_KEY == event)) {
+        json->key       = mender_artifact_json_get_key(token);
+        json->container = false;
+        return MENDER_OK;
+    }
+
+    /* Treatment depending of the member */
+    switch (json->key) {
+        case MENDER_ARTIFACT_JSON_KEY_PROVIDES:
+            return mender_artifact_json_provides_depends(json, event, depth, token, &json->ctx->payloads.values[index].provides);
+        case MENDER_ARTIFACT_JSON_KEY_DEPENDS:
+            return mender_artifact_json_provides_depends(json, event, depth, token, &json->ctx->payloads.values[index].depends);
+        case MENDER_ARTIFACT_JSON_KEY_CLEARS_PROVIDES:
+            return mender_artifact_json_clears_provides(json, event, depth, token);
+        default:
+            /* Member not relevant */
+            break;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_artifact_json_provides_depends(
+    mender_artifact_json_t *json, mender_json_event_t event, size_t depth, char *token, mender_key_value_list_t **provides_depends) {
+
+    assert(NULL != json);
+    assert(NULL != provides_depends);
+
+    /* Provides and depends are ignored if they are not an object */
+    if (1 == depth) {
+        if ((MENDER_JSON_EVENT_OBJECT_BEGIN == event) && (NULL == *provides_depends)) {
+            json->container = true;
+        }
+        return MENDER_OK;
+    }
+    if (false == json->container) {
+        return MENDER_OK;
+    }
+
+    /* The elements can either be a string or an array of strings */
+    if ((2 == depth) && (MENDER_JSON_EVENT_KEY == event)) {
+        strcpy(json->name, token);
+        return MENDER_OK;
+    }
+    if ((2 == depth) && ((MENDER_JSON_EVENT_ARRAY_BEGIN == event) || (MENDER_JSON_EVENT_ARRAY_END == event))) {
+        return MENDER_OK;
+    }
+    if (((2 == depth) || (3 == depth)) && (MENDER_JSON_EVENT_STRING == event)) {
+        if (MENDER_OK != mender_utils_create_key_value_node(json->name, token, provides_depends)) {
+            mender_log_error("Unable to create linked list node");
+            return MENDER_FAIL;
+        }
+        return MENDER_OK;
+    }
+
+    mender_log_error("Invalid header-info file element type");
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_artifact_json_clears_provides(mender_artifact_json_t *json, mender_json_event_t event, size_t depth, char *token) {
+
+    assert(NULL != json);
+    mender_artifact_payload_t *payload = &json->ctx->payloads.values[json->ctx->file.payload_index];
+    mender_err_t               ret;
+
+    /* Clears provides are ignored if they are not an array */
+    if (1 == depth) {
+        if ((MENDER_JSON_EVENT_ARRAY_BEGIN == event) && (NULL == payload->clears_provides)) {
+            json->container = true;
+            json->capacity  = 0;
+        }
+        return MENDER_OK;
+    }
+    if (false == json->container) {
+        return MENDER_OK;
+    }
+
+    /* Clears provides is an array of strings */
+    if ((2 == depth) && (MENDER_JSON_EVENT_STRING == event)) {
+        if (MENDER_OK
+            != (ret = mender_artifact_json_grow(
+                    json->ctx, (void **)&payload->clears_provides, payload->clears_provides_size, &json->capacity, sizeof(char *)))) {
+            return ret;
+        }
+        if (NULL == (payload->clears_provides[payload->clears_provides_size] = mender_utils_arena_strdup(&json->ctx->arena, token))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        payload->clears_provides_size++;
+        return MENDER_OK;
+    }
+
+    mender_log_error("Invalid type-info file");
+    return MENDER_FAIL;
+}
+#endif
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
+
+static mender_err_t
+mender_artifact_read_file(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+    mender_err_t ret;
+
+    /* Allocate memory to store the content of the file, null terminated */
+    if (NULL == ctx->file.data) {
+        if (NULL == (ctx->file.data = mender_utils_malloc(ctx->file.size + 1))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        ((char *)ctx->file.data)[ctx->file.size] = '\0';
+    }
+
+    /* Copy data block by block until the end of the file has been reached */
+    while (ctx->file.index < ctx->file.size) {
+
+        /* Check if enough data are received (at least one block) */
+        if (ctx->input.length < MENDER_ARTIFACT_STREAM_BLOCK_SIZE) {
+            return MENDER_OK;
+        }
+
+        /* Copy data */
+        size_t length
+            = ((ctx->file.size - ctx->file.index) > MENDER_ARTIFACT_STREAM_BLOCK_SIZE) ? MENDER_ARTIFACT_STREAM_BLOCK_SIZE : (ctx->file.size - ctx->file.index);
+        memcpy((uint8_t *)ctx->file.data + ctx->file.index, mender_artifact_get_data(ctx), length);
+
+        /* Update index */
+        ctx->file.index += MENDER_ARTIFACT_STREAM_BLOCK_SIZE;
+
+        /* Shift data in the buffer */
+        if (MENDER_OK != (ret = mender_artifact_shift_data(ctx, MENDER_ARTIFACT_STREAM_BLOCK_SIZE))) {
+            mender_log_error("Unable to shift input data");
+            return ret;
+        }
+    }
+
+    return MENDER_DONE;
+}
+
+static size_t
+mender_artifact_write_data(mender_artifact_ctx_t *ctx, void *data, size_t length) {
+
+    assert(NULL != ctx);
+    assert(NULL != data);
+
+    /* Compute length of the data that can be copied, and position of the tail of the ring buffer */
+    if (length > CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE - ctx->input.length) {
+        length = CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE - ctx->input.length;
+    }
+    size_t tail  = (ctx->input.head + ctx->input.length) % CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE;
+    size_t first = (length > CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE - tail) ? (CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE - tail) : length;
+
+    /* Copy data, wrapping around the end of the ring buffer if required */
+    memcpy(&ctx->input.data[tail], data, first);
+    memcpy(&ctx->input.data[0], ((uint8_t *)data) + first, length - first);
+    ctx->input.length += length;
+
+    return length;
+}
+
+static mender_err_t
+mender_artifact_shift_data(mender_artifact_ctx_t *ctx, size_t length) {
+
+    assert(NULL != ctx);
+
+    /* Check length */
+    if (length > ctx->input.length) {
+        mender_log_error("Invalid length");
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    /* Update digest of the signed file currently hashed with the data consumed, data may wrap around the end of the ring buffer */
+    size_t first = CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE - ctx->input.head;
+    if (first > length) {
+        first = length;
+    }
+    if ((MENDER_OK != mender_artifact_update_signed_file(ctx, &ctx->input.data[ctx->input.head], first))
+        || (MENDER_OK != mender_artifact_update_signed_file(ctx, &ctx->input.data[0], length - first))) {
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+
+    /* Shift data, no copy is required */
+    ctx->input.head = (ctx->input.head + length) % CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE;
+    ctx->input.length -= length;
+
+    return MENDER_OK;
+}
+
+static void *
+mender_artifact_get_data(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+
+    /* The head is always aligned on the block size, so that the first block is contiguous */
+    return &ctx->input.data[ctx->input.head];
+}
+
+static size_t
+mender_artifact_get_contiguous_length(mender_artifact_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+
+    /* Data may wrap around the end of the ring buffer */
+    return ((ctx->input.head + ctx->input.length) > CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE) ? (CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE - ctx->input.head)
+                                                                                             : ctx->input.length;
 }
 
 static size_t
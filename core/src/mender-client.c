@@ -18,15 +18,33 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_CLIENT
+
 #include "mender-api.h"
 #include "mender-client.h"
 #include "mender-artifact.h"
+#include "mender-delta.h"
 #include "mender-flash.h"
+#include "mender-json.h"
 #include "mender-log.h"
 #include "mender-scheduler.h"
 #include "mender-storage.h"
+#include "mender-storage-cache.h"
 #include "mender-tls.h"
 
+/**
+ * @brief Check client contexts, each context holds the context of the requests of its device and the add-ons registered at compile time have a single context
+ */
+#if defined(CONFIG_MENDER_CLIENT_CONTEXTS) && !defined(CONFIG_MENDER_API_CONTEXTS)
+#error "CONFIG_MENDER_CLIENT_CONTEXTS requires CONFIG_MENDER_API_CONTEXTS"
+#endif
+#if defined(CONFIG_MENDER_CLIENT_CONTEXTS) && defined(CONFIG_MENDER_CLIENT_STATIC_REGISTRATION)
+#error "CONFIG_MENDER_CLIENT_CONTEXTS is not compatible with CONFIG_MENDER_CLIENT_STATIC_REGISTRATION"
+#endif
+
 /**
  * @brief Default host
  */
@@ -41,6 +59,13 @@
 #define CONFIG_MENDER_SERVER_TENANT_TOKEN NULL
 #endif /* CONFIG_MENDER_SERVER_TENANT_TOKEN */
 
+/**
+ * @brief Default base URL of the mirror caching the artifacts, NULL to download the artifacts from the server
+ */
+#ifndef CONFIG_MENDER_CLIENT_ARTIFACT_MIRROR
+#define CONFIG_MENDER_CLIENT_ARTIFACT_MIRROR NULL
+#endif /* CONFIG_MENDER_CLIENT_ARTIFACT_MIRROR */
+
 /**
  * @brief Default authentication poll interval (seconds)
  */
@@ -56,14 +81,155 @@
 #endif /* CONFIG_MENDER_CLIENT_UPDATE_POLL_INTERVAL */
 
 /**
- * @brief Mender client configuration
+ * @brief Default delay before the expiration of the authentication token when it is refreshed (seconds), 0 to disable the refresh
+ */
+#ifndef CONFIG_MENDER_CLIENT_AUTHENTICATION_REFRESH_MARGIN
+#define CONFIG_MENDER_CLIENT_AUTHENTICATION_REFRESH_MARGIN (3600)
+#endif /* CONFIG_MENDER_CLIENT_AUTHENTICATION_REFRESH_MARGIN */
+
+/**
+ * @brief Default delay before the network is released once it is no longer used (seconds), 0 to release it immediately
+ */
+#ifndef CONFIG_MENDER_CLIENT_NETWORK_LINGER_INTERVAL
+#define CONFIG_MENDER_CLIENT_NETWORK_LINGER_INTERVAL (0)
+#endif /* CONFIG_MENDER_CLIENT_NETWORK_LINGER_INTERVAL */
+
+/**
+ * @brief Default minimum interval between two publications of the download progress (seconds), 0 to disable this trigger
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL (0)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL */
+
+/**
+ * @brief Default minimum step between two publications of the download progress (percent), 0 to disable this trigger
+ */
+#ifndef CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP
+#define CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP (0)
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP */
+
+/**
+ * @brief The download progress is published as a substate of the deployment if at least one trigger is enabled
+ */
+#if (CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL > 0) || (CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP > 0)
+#define MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL > 0 || CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP > 0 */
+
+/**
+ * @brief Default maximum number of payload files written to the flash by a deployment
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_TARGETS
+#define CONFIG_MENDER_CLIENT_FLASH_TARGETS (2)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_TARGETS */
+
+#ifdef CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD
+
+/**
+ * @brief Key of the payload meta-data holding the size of the image when the payload is sparse
+ */
+#define MENDER_CLIENT_SPARSE_META_DATA_KEY "sparse_size"
+
+/**
+ * @brief Length of the headers of the chunks of the sparse payloads, they are 32-bit little-endian values (bytes)
+ */
+#define MENDER_CLIENT_SPARSE_HEADER_LENGTH (4)
+
+/**
+ * @brief Flag of the header of the chunks holding runs of erased bytes, their data are omitted from the payload
+ */
+#define MENDER_CLIENT_SPARSE_ERASED_FLAG (0x80000000UL)
+
+/**
+ * @brief Value of the erased bytes of the flash
+ */
+#define MENDER_CLIENT_SPARSE_ERASED_VALUE (0xFF)
+
+/**
+ * @brief Length of the block used to hash and program the runs of erased bytes (bytes)
+ */
+#define MENDER_CLIENT_SPARSE_BLOCK_LENGTH (512)
+
+#endif /* CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD */
+
+/**
+ * @brief Default length of the buffer used to read the artifacts installed from a local source (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_INSTALL_BUFFER_LENGTH
+#define CONFIG_MENDER_CLIENT_INSTALL_BUFFER_LENGTH (4096)
+#endif /* CONFIG_MENDER_CLIENT_INSTALL_BUFFER_LENGTH */
+
+/**
+ * @brief ID of the deployments installed from a local source, their statuses are not published to the mender-server
+ */
+#define MENDER_CLIENT_LOCAL_DEPLOYMENT_ID ""
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+
+/**
+ * @brief Default number of buffers of the flash pipeline
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS
+#define CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS (2)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS */
+
+/**
+ * @brief Default size of the buffers of the flash pipeline (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE */
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+
+/**
+ * @brief Default size of the buffer used to read back the image written to the flash (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE */
+
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+
+/**
+ * @brief Default size of the pool of the modules without dedicated pool (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_MEMORY_BUDGET_GENERAL_SIZE
+#define CONFIG_MENDER_CLIENT_MEMORY_BUDGET_GENERAL_SIZE (16384)
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET_GENERAL_SIZE */
+
+/**
+ * @brief Default size of the pool of the artifact parser, it holds the input buffer and the decompression context (bytes), 0 to use the general pool
+ */
+#ifndef CONFIG_MENDER_CLIENT_MEMORY_BUDGET_ARTIFACT_SIZE
+#define CONFIG_MENDER_CLIENT_MEMORY_BUDGET_ARTIFACT_SIZE (16384)
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET_ARTIFACT_SIZE */
+
+/**
+ * @brief Default size of the pool of HTTP and websocket, it holds the receive buffers (bytes), 0 to use the general pool
  */
-static mender_client_config_t mender_client_config;
+#ifndef CONFIG_MENDER_CLIENT_MEMORY_BUDGET_HTTP_SIZE
+#define CONFIG_MENDER_CLIENT_MEMORY_BUDGET_HTTP_SIZE (4096)
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET_HTTP_SIZE */
 
 /**
- * @brief Mender client callbacks
+ * @brief Default size of the pool of cJSON and of the JSON writer (bytes), 0 to use the general pool
  */
-static mender_client_callbacks_t mender_client_callbacks;
+#ifndef CONFIG_MENDER_CLIENT_MEMORY_BUDGET_JSON_SIZE
+#define CONFIG_MENDER_CLIENT_MEMORY_BUDGET_JSON_SIZE (8192)
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET_JSON_SIZE */
+
+/**
+ * @brief Default size of the pool of the arenas, it holds the keystores and the artifact metadata (bytes), 0 to use the general pool
+ */
+#ifndef CONFIG_MENDER_CLIENT_MEMORY_BUDGET_ARENA_SIZE
+#define CONFIG_MENDER_CLIENT_MEMORY_BUDGET_ARENA_SIZE (4096)
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET_ARENA_SIZE */
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
 
 /**
  * @brief Mender client states
@@ -74,85 +240,329 @@ typedef enum {
     MENDER_CLIENT_STATE_AUTHENTICATED,  /**< Perform updates */
 } mender_client_state_t;
 
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+
+/**
+ * @brief Memory budget of the client, the block is reserved once at initialization and carved into the pools
+ */
+static struct {
+    void *memory; /**< Memory block, NULL if it is not reserved */
+    void *mutex;  /**< Mutex protecting the pools */
+} mender_client_memory_budget = { NULL, NULL };
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
+/**
+ * @brief Deployment data
+ */
+typedef struct {
+    char  *id;            /**< ID of the deployment */
+    char  *artifact_name; /**< Artifact name of the deployment */
+    char **types;         /**< Types of the payloads of the artifact */
+    size_t types_count;   /**< Number of types of the payloads of the artifact */
+} mender_client_deployment_data_t;
+
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+
 /**
- * @brief Mender client state
+ * @brief Iterate the entries registered at compile time, the entries are constant and they are read without lock
  */
-static mender_client_state_t mender_client_state = MENDER_CLIENT_STATE_INITIALIZATION;
+#ifdef __ZEPHYR__
+#define MENDER_CLIENT_STATIC_FOREACH(struct_type, iterator) STRUCT_SECTION_FOREACH(struct_type, iterator)
+#else
+#define MENDER_CLIENT_STATIC_FOREACH(struct_type, iterator) \
+    for (const struct struct_type *iterator = __start_##struct_type; iterator < __stop_##struct_type; iterator++)
 
 /**
- * @brief Counter and mutex for the management of network connect/release callbacks
+ * @brief Bounds of the sections of the entries registered at compile time, weak so that they are NULL if no entry is defined
  */
-static uint8_t mender_client_network_count = 0;
-static void   *mender_client_network_mutex = NULL;
+extern const struct mender_client_artifact_type __start_mender_client_artifact_type[] __attribute__((weak));
+extern const struct mender_client_artifact_type __stop_mender_client_artifact_type[] __attribute__((weak));
+extern const struct mender_client_addon         __start_mender_client_addon[] __attribute__((weak));
+extern const struct mender_client_addon         __stop_mender_client_addon[] __attribute__((weak));
+#endif /* __ZEPHYR__ */
+
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
 
 /**
- * @brief Deployment data (ID, artifact name and payload types), used to report deployment status after rebooting
+ * @brief Boot timing, durations of the initialization stages (milliseconds), logged once the initialization of the client is done
  */
-static cJSON *mender_client_deployment_data = NULL;
+static struct {
+    uint64_t last;            /**< Uptime at the end of the last stage measured */
+    uint32_t confirm;         /**< Confirmation of the running image */
+    uint32_t scheduler;       /**< Initialization of the scheduler and of the log */
+    uint32_t storage;         /**< Initialization of the storage */
+    uint32_t tls;             /**< Initialization of TLS */
+    uint32_t api;             /**< Initialization of the API */
+    uint32_t keys;            /**< Retrieval or generation of the authentication keys, performed in the background */
+    uint32_t deployment_data; /**< Retrieval of the deployment data */
+} mender_client_boot_timing;
 
 /**
- * @brief Mender client artifact type
+ * @brief Length of the deployment status outbox
  */
-typedef struct {
-    char *type; /**< Artifact type */
-    mender_err_t (*callback)(
-        char *, char *, char *, cJSON *, char *, size_t, void *, size_t, size_t); /**< Callback to be invoked to handle the artifact type */
-    bool  needs_restart;                                                          /**< Indicate the artifact type needs a restart to be applied on the system */
-    char *artifact_name; /**< Artifact name (optional, NULL otherwise), set to validate module update after restarting */
-} mender_client_artifact_type_t;
+#define MENDER_CLIENT_STATUS_OUTBOX_LENGTH (4)
 
 /**
- * @brief Mender client artifact types list and mutex
+ * @brief Maximum number of attempts to publish a deployment status, the status is dropped after
  */
-static mender_client_artifact_type_t **mender_client_artifact_types_list  = NULL;
-static size_t                          mender_client_artifact_types_count = 0;
-static void                           *mender_client_artifact_types_mutex = NULL;
+#define MENDER_CLIENT_STATUS_OUTBOX_ATTEMPTS (3)
 
 /**
- * @brief Mender client add-ons list and mutex
+ * @brief Length of the download progress substate
  */
-static mender_addon_instance_t **mender_client_addons_list  = NULL;
-static size_t                    mender_client_addons_count = 0;
-static void                     *mender_client_addons_mutex = NULL;
+#define MENDER_CLIENT_DOWNLOAD_PROGRESS_SUBSTATE_LENGTH (32)
 
 /**
- * @brief Mender client work handle
+ * @brief Flash target, one per payload file of the deployment written to the flash
  */
-static void *mender_client_work_handle = NULL;
+typedef struct {
+    void *handle; /**< Flash handle, NULL until the flash is opened */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+    void   *sha256;                                  /**< Digest of the data downloaded, NULL if not computed */
+    size_t  size;                                    /**< Size of the image */
+    size_t  length;                                  /**< Length of the data downloaded already hashed */
+    bool    completed;                               /**< Digest of the image downloaded is available */
+    uint8_t digest[MENDER_TLS_SHA256_DIGEST_LENGTH]; /**< Digest of the image downloaded */
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+} mender_client_flash_target_t;
+
+/**
+ * @brief Flash targets of the deployment, the payload files are written one after the other and set pending together
+ */
+static mender_client_flash_target_t mender_client_flash_targets[CONFIG_MENDER_CLIENT_FLASH_TARGETS];
+static size_t                       mender_client_flash_targets_count = 0;
 
 /**
- * @brief Flash handle used to store temporary reference to write rootfs-image data
+ * @brief Flash handle used to store temporary reference to write rootfs-image data, this is the handle of the last flash target
  */
 static void *mender_client_flash_handle = NULL;
+#ifdef CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD
+
+/**
+ * @brief Sparse payload decoder, the payload is a sequence of chunks starting with a header holding their length and the erased flag
+ */
+typedef struct {
+    bool    enabled;                                    /**< Payload of the flash target being written is sparse */
+    size_t  size;                                       /**< Size of the image */
+    size_t  offset;                                     /**< Offset of the next data of the image */
+    uint8_t header[MENDER_CLIENT_SPARSE_HEADER_LENGTH]; /**< Header of the next chunk */
+    size_t  header_length;                              /**< Length of the header of the next chunk already received */
+    size_t  remaining;                                  /**< Length of the data of the current chunk not received yet */
+} mender_client_sparse_t;
+
+/**
+ * @brief Sparse payload decoder of the flash target being written
+ */
+static mender_client_sparse_t mender_client_sparse;
+
+/**
+ * @brief Block of erased bytes, used to hash and program the runs of erased bytes
+ */
+static uint8_t mender_client_sparse_block[MENDER_CLIENT_SPARSE_BLOCK_LENGTH];
+
+#endif /* CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+/**
+ * @brief Chunk of rootfs-image data written to the flash by the writer task
+ */
+typedef struct {
+    uint8_t *data;   /**< Buffer of the chunk, NULL to ask the writer task to terminate */
+    size_t   index;  /**< Index of the chunk in the image */
+    size_t   length; /**< Length of the chunk */
+} mender_client_flash_pipeline_chunk_t;
+
+/**
+ * @brief Flash pipeline, the data received are copied to preallocated buffers and written to the flash by a dedicated task while the download continues
+ */
+static struct {
+    uint8_t                             *buffers;     /**< Buffers, allocated when the pipeline is started */
+    void                                *free_queue;  /**< Queue of the buffers available */
+    void                                *write_queue; /**< Queue of the chunks to be written */
+    void                                *task;        /**< Writer task, NULL if the pipeline is not started */
+    mender_client_flash_pipeline_chunk_t current;     /**< Chunk currently filled, data is NULL if no buffer is used */
+    mender_err_t                         ret;         /**< Result of the writes, the first error is kept */
+} mender_client_flash_pipeline;
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+/**
+ * @brief Verification of the images written to the flash, the images are read back and their digests are compared with the digests of the data downloaded
+ */
+static struct {
+    void                 *task; /**< Verification task, NULL if the verification is performed by the caller */
+    volatile mender_err_t ret;  /**< Result of the verification */
+} mender_client_flash_verify;
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+/**
+ * @brief Delta handle used to store temporary reference to apply rootfs-image-delta data
+ */
+static void *mender_client_delta_handle = NULL;
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
+
+/**
+ * @brief Context of a device, it holds the configuration, the state, the works and the deployments of the client
+ */
+struct mender_client_ctx_s {
+    mender_client_config_t           config;              /**< Mender client configuration */
+    mender_client_callbacks_t        callbacks;           /**< Mender client callbacks */
+    mender_client_state_t            state;               /**< Mender client state */
+    uint8_t                          network_count;       /**< Counter for the management of network connect/release callbacks */
+    void                            *network_mutex;       /**< Mutex protecting the network management counter */
+    bool                             network_lingering;   /**< Flag indicating the network is no longer used but not released yet */
+    void                            *network_work_handle; /**< Work used to release the network after the linger interval */
+    mender_client_deployment_data_t *deployment_data;     /**< Deployment data, used to report deployment status after rebooting */
+    void                            *deployment_mutex;    /**< Mutex serializing the deployments of the update work and of the local installations */
+#ifdef CONFIG_MENDER_CLIENT_DEFERRED_INSTALL
+    mender_artifact_ctx_t *deployment_deferred;  /**< Artifact context of the deployment waiting to be committed, NULL if there is none */
+    bool                   deployment_committed; /**< Flag set by the application to commit the deployment downloaded */
+#endif /* CONFIG_MENDER_CLIENT_DEFERRED_INSTALL */
+    mender_client_artifact_type_t      **artifact_types_list;   /**< Artifact types list sorted by type, never released while the client is running */
+    size_t                               artifact_types_count;  /**< Number of artifact types */
+    void                                *artifact_types_mutex;  /**< Mutex protecting the artifact types list */
+    const mender_client_artifact_type_t *artifact_type_current; /**< Artifact type handling the payload being downloaded, read without lock */
+    mender_addon_instance_t            **addons_list;           /**< Add-ons list */
+    size_t                               addons_count;          /**< Number of add-ons */
+    void                                *addons_mutex;          /**< Mutex protecting the add-ons list */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    void            **addons_ctx; /**< Contexts of the add-ons, NULL for the context of mender_client_init */
+    bool              activated;  /**< Flag indicating the works of an additional device are activated */
+    mender_api_ctx_t *api_ctx;    /**< Context of the requests, NULL for the context of mender_client_init */
+    mender_tls_ctx_t *tls_ctx;    /**< Context of the authentication keys, NULL for the context of mender_client_init */
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    void                  *work_handle; /**< Mender client work handle */
+    mender_utils_backoff_t backoff;     /**< Mender client work backoff policy, the base period depends on the client state */
+    struct {
+        void         *task; /**< Task handle, NULL if the task is not running */
+        volatile bool done; /**< Task has completed */
+        mender_err_t  ret;  /**< Result of the task */
+    } authentication_keys;  /**< Authentication keys task, the keys are retrieved or generated in the background */
+    struct {
+        uint64_t timestamps[MENDER_CLIENT_STATE_AUTHENTICATED + 1]; /**< Uptime when each state has been entered (milliseconds) */
+        uint32_t failures;                                          /**< Number of failed executions of the client work */
+    } stats;                                                        /**< Statistics of the client, written by the client work only and read without lock */
+    void *refresh_work_handle; /**< Authentication refresh work handle, scheduled before the token expires */
+    struct {
+        char                      *id;       /**< ID of the deployment */
+        mender_deployment_status_t status;   /**< Deployment status */
+        uint8_t                    attempts; /**< Number of failed attempts to publish the status */
+    } status_outbox[MENDER_CLIENT_STATUS_OUTBOX_LENGTH]; /**< Deployment status outbox, published by the status work */
+    size_t status_outbox_count; /**< Number of deployment statuses in the outbox */
+    void  *status_outbox_mutex; /**< Mutex protecting the deployment status outbox */
+#ifdef CONFIG_MENDER_LOG_BUFFER
+    char *logs_outbox; /**< ID of the deployment to which the log buffer is attached when its upload has been requested */
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+    void *status_work_handle; /**< Deployment status work handle, executed when a status is queued in the outbox */
+    struct {
+        size_t  downloaded; /**< Payload data downloaded (bytes) */
+        size_t  total;      /**< Size of the payload files announced so far (bytes) */
+        uint8_t percent;    /**< Last progress reported to the application (percent) */
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+        uint8_t  published;                                                 /**< Last progress published (percent) */
+        uint64_t timestamp;                                                 /**< Uptime when the last progress has been published (milliseconds) */
+        char    *id;                                                        /**< ID of the deployment of the pending substate, NULL if none */
+        char     substate[MENDER_CLIENT_DOWNLOAD_PROGRESS_SUBSTATE_LENGTH]; /**< Pending substate */
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+    } download_progress;    /**< Download progress of the deployment artifact, the pending substate is protected by the outbox mutex */
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+    void *progress_work_handle; /**< Download progress work handle, executed when a substate is pending */
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+    bool deployment_needs_set_pending_image; /**< Flag to indicate if the deployment needs to set pending image status */
+    bool deployment_needs_restart;           /**< Flag to indicate if the deployment needs restart */
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+    mender_api_deployment_data_t *deployment;         /**< Deployment currently downloaded, used to check the artifact once its header is parsed */
+    mender_artifact_ctx_t        *artifact_ctx;       /**< Artifact context currently downloaded */
+    bool                          deployment_checked; /**< Flag indicating the artifact currently downloaded has been checked */
+#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
+};
+
+/**
+ * @brief Context of the device of mender_client_init
+ */
+static mender_client_ctx_t mender_client_default_ctx;
+
+/**
+ * @brief Context of the device of the calling thread, the works and the tasks of the client select the context of their device
+ */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+static __thread mender_client_ctx_t *mender_client_ctx = &mender_client_default_ctx;
+#else
+static mender_client_ctx_t *const mender_client_ctx = &mender_client_default_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+/**
+ * @brief Function used to save the configuration and the callbacks of the client in the context of the calling thread
+ * @param config Mender client configuration
+ * @param callbacks Mender client callbacks
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_ctx_configure(mender_client_config_t *config, mender_client_callbacks_t *callbacks);
 
 /**
- * @brief Flag to indicate if the deployment needs to set pending image status
+ * @brief Function used to create the mutexes and the works of the context of the calling thread
+ * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static bool mender_client_deployment_needs_set_pending_image = false;
+static mender_err_t mender_client_ctx_setup(void);
 
 /**
- * @brief Flag to indicate if the deployment needs restart
+ * @brief Function used to release the add-ons, the works and the memory of the context of the calling thread
+ * @note The members not created yet are skipped, so that a context partially set up can be cleared
+ * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static bool mender_client_deployment_needs_restart = false;
+static mender_err_t mender_client_ctx_clear(void);
 
 /**
  * @brief Mender client work function
+ * @param arg Context of the device of the work, with CONFIG_MENDER_CLIENT_CONTEXTS only
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_client_work_function(void);
+static mender_err_t mender_client_work_function(MENDER_SCHEDULER_WORK_ARG);
 
 /**
  * @brief Mender client initialization work function
- * @return MENDER_OK if the function succeeds, error code otherwise
+ * @return MENDER_DONE if the function succeeds, MENDER_OK if the authentication keys are not available yet, error code otherwise
  */
 static mender_err_t mender_client_initialization_work_function(void);
 
+/**
+ * @brief Task used to retrieve or generate the authentication keys, the work is executed again when the task completes
+ * @param arg Context of the device if invoked from the task, NULL if invoked from the work queue
+ */
+static void mender_client_authentication_keys_task(void *arg);
+
+/**
+ * @brief Function used to update the client state, the uptime is saved to compute the time spent in each state
+ * @param state Client state
+ */
+static void mender_client_state_set(mender_client_state_t state);
+
+/**
+ * @brief Function used to measure the duration of a stage of the initialization
+ * @return Duration since the end of the previous stage (milliseconds)
+ */
+static uint32_t mender_client_boot_timing_lap(void);
+
 /**
  * @brief Mender client authentication work function
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 static mender_err_t mender_client_authentication_work_function(void);
 
+/**
+ * @brief Mender client authentication refresh work function, a new token is requested before the current one expires
+ * @param arg Context of the device of the work, with CONFIG_MENDER_CLIENT_CONTEXTS only
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_refresh_work_function(MENDER_SCHEDULER_WORK_ARG);
+
+/**
+ * @brief Schedule the refresh of the authentication token according to its remaining validity
+ */
+static void mender_client_schedule_authentication_refresh(void);
+
 #ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
 /**
  * @brief Compare artifact, device and deployment device types
@@ -166,6 +576,24 @@ static mender_err_t mender_compare_device_types(const char  *device_type_artifac
                                                 const char  *device_type_device,
                                                 const char **device_type_deployment,
                                                 const size_t device_type_deployment_size);
+
+#ifdef CONFIG_MENDER_PROVIDES_DEPENDS
+/**
+ * @brief Check artifact depends against the provides of the device, a depends with several values is satisfied if one of them is provided
+ * @param depends Artifact or payload depends
+ * @param provides Provides of the device
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_check_depends(mender_key_value_list_t *depends, mender_utils_kv_table_t *provides);
+#endif /* CONFIG_MENDER_PROVIDES_DEPENDS */
+
+/**
+ * @brief Check the artifact is compatible with the device and the deployment, invoked once the header of the artifact has been parsed
+ * @param ctx Artifact context
+ * @param deployment Deployment data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_check_artifact(mender_artifact_ctx_t *ctx, mender_api_deployment_data_t *deployment);
 #endif
 
 /**
@@ -174,6 +602,58 @@ static mender_err_t mender_compare_device_types(const char  *device_type_artifac
  */
 static mender_err_t mender_client_update_work_function(void);
 
+/**
+ * @brief Check for deployment and install it, the deployment mutex must be taken
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_update_check(void);
+
+/**
+ * @brief Download and install the artifact of a deployment
+ * @param deployment Deployment data
+ * @param callback Function used to read the artifact from a local source, NULL to download it from the URI of the deployment
+ * @param params Parameters of the callback function
+ * @return MENDER_DONE if the artifact has been installed and the restart callback invoked, MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_deployment_install(mender_api_deployment_data_t *deployment,
+                                                     mender_err_t (*callback)(void *, size_t *, void *),
+                                                     void                         *params);
+
+/**
+ * @brief Install the artifact of the deployment downloaded, the boot partition is set and the device is restarted if it is required
+ * @param mender_artifact_ctx Artifact context of the deployment, it is released by the function
+ * @return MENDER_DONE if the artifact has been installed and the restart callback invoked, MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_deployment_commit(mender_artifact_ctx_t *mender_artifact_ctx);
+
+/**
+ * @brief Read the artifact from a local source and feed it to the artifact parser
+ * @param ctx Artifact context
+ * @param callback Function used to read the artifact
+ * @param params Parameters of the callback function
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_read_artifact(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(void *, size_t *, void *), void *params);
+
+/**
+ * @brief Function used to find an artifact type in the artifact types list, the artifact types mutex should be taken
+ * @param type Artifact type
+ * @param position Position of the artifact type in the list, or position where it should be inserted if it is not found (optional, NULL otherwise)
+ * @return Artifact type if found, NULL otherwise
+ */
+static mender_client_artifact_type_t *mender_client_artifact_type_find(char *type, size_t *position);
+
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+
+/**
+ * @brief Function used to find an artifact type in the artifact types registered at compile time, no mutex is required
+ * @param type Artifact type
+ * @return Artifact type if found, NULL otherwise
+ */
+static const mender_client_artifact_type_t *mender_client_artifact_type_find_static(char *type);
+
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+
 /**
  * @brief Callback function to be invoked to perform the treatment of the data from the artifact
  * @param id ID of the deployment
@@ -188,7 +668,7 @@ static mender_err_t mender_client_update_work_function(void);
  * @return MENDER_OK if the function succeeds, error code if an error occurred
  */
 static mender_err_t mender_client_download_artifact_callback(
-    char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+    char *type, mender_meta_data_t *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
 
 /**
  * @brief Callback function to be invoked to perform the treatment of the data from the artifact type "rootfs-image"
@@ -204,117 +684,387 @@ static mender_err_t mender_client_download_artifact_callback(
  * @return MENDER_OK if the function succeeds, error code if an error occurred
  */
 static mender_err_t mender_client_download_artifact_flash_callback(
-    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+    char *id, char *artifact_name, char *type, mender_meta_data_t *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
 
 /**
- * @brief Publish deployment status of the device to the mender-server and invoke deployment status callback
- * @param id ID of the deployment
- * @param deployment_status Deployment status
+ * @brief Add a flash target to the deployment
+ * @return Flash target, NULL if the maximum number of flash targets is reached
+ */
+static mender_client_flash_target_t *mender_client_flash_target_add(void);
+
+/**
+ * @brief Set the images of all the flash targets pending, the flash targets remaining are aborted on failure
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static mender_err_t mender_client_publish_deployment_status(char *id, mender_deployment_status_t deployment_status);
+static mender_err_t mender_client_flash_targets_set_pending(void);
 
-char *
-mender_client_version(void) {
+/**
+ * @brief Write data of the image to the flash target being written, the data are hashed if the image is verified
+ * @param size Size of the image
+ * @param data Data of the image
+ * @param index Offset of the data in the image
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_flash_write_image(size_t size, void *data, size_t index, size_t length);
+#ifdef CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD
 
-    /* Return version as string */
-    return MENDER_CLIENT_VERSION;
-}
+/**
+ * @brief Begin decoding a payload, it is sparse if its meta-data holds the size of the image
+ * @param meta_data Meta-data of the payload
+ * @param size Size of the payload, replaced by the size of the image if the payload is sparse
+ */
+static void mender_client_sparse_begin(mender_meta_data_t *meta_data, size_t *size);
 
-mender_err_t
-mender_client_init(mender_client_config_t *config, mender_client_callbacks_t *callbacks) {
+/**
+ * @brief Decode data of a sparse payload and write the image to the flash target being written
+ * @param data Data of the payload
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_sparse_write(uint8_t *data, size_t length);
 
-    assert(NULL != config);
-    assert(NULL != config->artifact_name);
-    assert(NULL != config->device_type);
-    assert(NULL != callbacks);
-    assert(NULL != callbacks->restart);
-    mender_err_t ret;
+/**
+ * @brief Write a run of erased bytes of the image, it is not programmed if the flash target is already erased
+ * @param index Offset of the run in the image
+ * @param length Length of the run
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_sparse_erased(size_t index, size_t length);
+#endif /* CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD */
 
-    mender_client_config.artifact_name = config->artifact_name;
-    mender_client_config.device_type   = config->device_type;
-    if ((NULL != config->host) && (strlen(config->host) > 0)) {
-        mender_client_config.host = config->host;
-    } else {
-        mender_client_config.host = CONFIG_MENDER_SERVER_HOST;
-    }
-    if ((NULL == mender_client_config.host) || (0 == strlen(mender_client_config.host))) {
-        mender_log_error("Invalid server host configuration, can't be null or empty");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    if ('/' == mender_client_config.host[strlen(mender_client_config.host) - 1]) {
-        mender_log_error("Invalid server host configuration, trailing '/' is not allowed");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    if ((NULL != config->tenant_token) && (strlen(config->tenant_token) > 0)) {
-        mender_client_config.tenant_token = config->tenant_token;
-    } else {
-        mender_client_config.tenant_token = CONFIG_MENDER_SERVER_TENANT_TOKEN;
-    }
-    if ((NULL != mender_client_config.tenant_token) && (0 == strlen(mender_client_config.tenant_token))) {
-        mender_client_config.tenant_token = NULL;
-    }
-    if (0 != config->authentication_poll_interval) {
-        mender_client_config.authentication_poll_interval = config->authentication_poll_interval;
-    } else {
-        mender_client_config.authentication_poll_interval = CONFIG_MENDER_CLIENT_AUTHENTICATION_POLL_INTERVAL;
-    }
-    if (0 != config->update_poll_interval) {
-        mender_client_config.update_poll_interval = config->update_poll_interval;
-    } else {
-        mender_client_config.update_poll_interval = CONFIG_MENDER_CLIENT_UPDATE_POLL_INTERVAL;
-    }
-    mender_client_config.recommissioning = config->recommissioning;
+/**
+ * @brief Abort the deployment of all the flash targets
+ */
+static void mender_client_flash_targets_abort(void);
 
-    /* Save callbacks */
-    memcpy(&mender_client_callbacks, callbacks, sizeof(mender_client_callbacks_t));
+/**
+ * @brief Release the flash targets of the deployment, the flash handles must be released before
+ */
+static void mender_client_flash_targets_reset(void);
 
-    /* Initializations */
-    if (MENDER_OK != (ret = mender_scheduler_init())) {
-        mender_log_error("Unable to initialize scheduler");
-        goto END;
-    }
-    if (MENDER_OK != (ret = mender_log_init())) {
-        mender_log_error("Unable to initialize log");
-        goto END;
-    }
-    if (MENDER_OK != (ret = mender_storage_init())) {
-        mender_log_error("Unable to initialize storage");
-        goto END;
-    }
-    if (MENDER_OK != (ret = mender_tls_init())) {
-        mender_log_error("Unable to initialize TLS");
-        goto END;
-    }
-    mender_api_config_t mender_api_config = {
-        .artifact_name = mender_client_config.artifact_name,
-        .device_type   = mender_client_config.device_type,
-        .host          = mender_client_config.host,
-        .tenant_token  = mender_client_config.tenant_token,
-    };
-    if (MENDER_OK != (ret = mender_api_init(&mender_api_config))) {
-        mender_log_error("Unable to initialize API");
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+/**
+ * @brief Start the flash pipeline, allocate the buffers and create the writer task
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_flash_pipeline_start(void);
+
+/**
+ * @brief Copy data to the buffers of the flash pipeline, the buffers are given to the writer task when they are full
+ * @param data Data
+ * @param index Index of the data in the image
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code if an error occurred while writing data previously given to the writer task
+ */
+static mender_err_t mender_client_flash_pipeline_write(void *data, size_t index, size_t length);
+
+/**
+ * @brief Give the buffer currently filled to the writer task and wait all the data are written to the flash
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_flash_pipeline_flush(void);
+
+/**
+ * @brief Stop the flash pipeline, terminate the writer task and release the buffers, the data not flushed are dropped
+ */
+static void mender_client_flash_pipeline_stop(void);
+
+/**
+ * @brief Writer task of the flash pipeline
+ * @param arg Not used
+ */
+static void mender_client_flash_pipeline_task(void *arg);
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+/**
+ * @brief Hash the data downloaded for the last flash target, the verification is disabled if the data are not contiguous
+ * @param size Size of the image
+ * @param data Data
+ * @param index Index of the data in the image
+ * @param length Length of the data
+ */
+static void mender_client_flash_verify_update(size_t size, void *data, size_t index, size_t length);
+
+/**
+ * @brief Start the verification of the images written to the flash, in a dedicated task if possible
+ */
+static void mender_client_flash_verify_start(void);
+
+/**
+ * @brief Wait the end of the verification of the images written to the flash, the verification is performed by the caller if there is no task
+ * @return MENDER_OK if the images are valid or if they can not be verified, error code otherwise
+ */
+static mender_err_t mender_client_flash_verify_wait(void);
+
+/**
+ * @brief Read back the image written to the flash and compare its digest with the digest of the data downloaded
+ * @param target Flash target
+ * @return MENDER_OK if the image is valid or if it can not be verified, error code otherwise
+ */
+static mender_err_t mender_client_flash_verify_image(mender_client_flash_target_t *target);
+
+/**
+ * @brief Verification task
+ * @param arg Not used
+ */
+static void mender_client_flash_verify_task(void *arg);
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+/**
+ * @brief Callback function to be invoked to perform the treatment of the data from the artifact type "rootfs-image-delta"
+ * @param id ID of the deployment
+ * @param artifact name Artifact name
+ * @param type Type from header-info payloads
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename
+ * @param size Artifact file size
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code if an error occurred
+ */
+static mender_err_t mender_client_download_artifact_delta_callback(
+    char *id, char *artifact_name, char *type, mender_meta_data_t *meta_data, char *filename, size_t size, void *data, size_t index, size_t length);
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
+
+/**
+ * @brief Create deployment data
+ * @param id ID of the deployment
+ * @param artifact_name Artifact name of the deployment
+ * @return Deployment data if the function succeeds, NULL otherwise
+ */
+static mender_client_deployment_data_t *mender_client_deployment_data_create(const char *id, const char *artifact_name);
+
+/**
+ * @brief Add type of a payload to the deployment data, nothing is done if it is already present
+ * @param deployment_data Deployment data
+ * @param type Type of the payload
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_deployment_data_add_type(mender_client_deployment_data_t *deployment_data, const char *type);
+
+/**
+ * @brief Release deployment data
+ * @param deployment_data Deployment data
+ */
+static void mender_client_deployment_data_release(mender_client_deployment_data_t *deployment_data);
+
+/**
+ * @brief Format deployment data to record, ID, artifact name and types are saved as consecutive fields
+ * @param record Record
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_deployment_data_to_record(mender_utils_record_t *record);
+
+/**
+ * @brief Restore deployment data from record
+ * @param data Record read from the storage
+ * @param length Length of the record
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_deployment_data_from_record(const void *data, size_t length);
+
+#ifdef CONFIG_MENDER_TINY
+
+/**
+ * @brief Restore deployment data from JSON text written by previous versions of the client
+ * @param data JSON text read from the storage
+ * @param length Length of the JSON text, without the null terminator
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_deployment_data_from_json(const char *data, size_t length);
+
+#endif /* CONFIG_MENDER_TINY */
+
+/**
+ * @brief Queue deployment status of the device in the outbox and invoke deployment status callback
+ * @note Intermediate statuses of a deployment not published yet are superseded by the next status of the same deployment
+ * @param id ID of the deployment
+ * @param deployment_status Deployment status
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_publish_deployment_status(char *id, mender_deployment_status_t deployment_status);
+
+/**
+ * @brief Mender client deployment status work function, the statuses queued in the outbox are published to the mender-server in order
+ * @param arg Context of the device of the work, with CONFIG_MENDER_CLIENT_CONTEXTS only
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_status_work_function(MENDER_SCHEDULER_WORK_ARG);
+
+/**
+ * @brief Mender client network work function, the network is released if it has not been used again during the linger interval
+ * @param arg Context of the device of the work, with CONFIG_MENDER_CLIENT_CONTEXTS only
+ * @return MENDER_DONE if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_network_work_function(MENDER_SCHEDULER_WORK_ARG);
+
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+/**
+ * @brief Function invoked at the beginning of a batch of works, the network of the device of the work which begins the batch is requested
+ * @param arg Context of the device of the work
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_batch_begin(void *arg);
+
+/**
+ * @brief Function invoked at the end of a batch of works, the network of the device of the work which began the batch is released
+ * @param arg Context of the device of the work
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_batch_end(void *arg);
+
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+
+/**
+ * @brief Reserve the memory budget of the client and serve the following allocations from its pools
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_memory_budget_init(void);
+
+/**
+ * @brief Take the mutex protecting the pools of the memory budget
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_memory_budget_lock(void);
+
+/**
+ * @brief Release the mutex protecting the pools of the memory budget
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_memory_budget_unlock(void);
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
+/**
+ * @brief Remove the first deployment status of the outbox, the caller must hold the outbox mutex
+ */
+static void mender_client_status_outbox_pop(void);
+
+/**
+ * @brief Resolve the mirror used to download the artifact, the mirror discovered by the application takes precedence over the configured one
+ * @return Base URL of the mirror, NULL to download the artifact from the server
+ */
+static char *mender_client_artifact_mirror(void);
+
+/**
+ * @brief Reset the download progress before downloading a new artifact
+ */
+static void mender_client_download_progress_reset(void);
+
+/**
+ * @brief Update the download progress with a block of payload data, the progress is reported to the application and published if throttling permits
+ * @param size Size of the payload file
+ * @param index Index of the block in the payload file
+ * @param length Length of the block
+ */
+static void mender_client_download_progress_update(size_t size, size_t index, size_t length);
+
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+
+/**
+ * @brief Drop the pending download progress substate, it must not be published after the next status of the deployment
+ */
+static void mender_client_download_progress_drop(void);
+
+/**
+ * @brief Mender client download progress work function, the pending substate is published to the mender-server
+ * @param arg Context of the device of the work, with CONFIG_MENDER_CLIENT_CONTEXTS only
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_client_progress_work_function(MENDER_SCHEDULER_WORK_ARG);
+
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+
+char *
+mender_client_version(void) {
+
+    /* Return version as string */
+    return MENDER_CLIENT_VERSION;
+}
+
+mender_err_t
+mender_client_init(mender_client_config_t *config, mender_client_callbacks_t *callbacks) {
+
+    assert(NULL != config);
+    assert(NULL != config->artifact_name);
+    assert(NULL != config->device_type);
+    assert(NULL != callbacks);
+    assert(NULL != callbacks->restart);
+    mender_err_t ret;
+
+    /* Set the allocator before any allocation */
+    if (MENDER_OK != (ret = mender_utils_set_allocator(config->allocator))) {
+        mender_log_error("Unable to set allocator");
         goto END;
     }
 
-    /* Create network management mutex */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_network_mutex))) {
-        mender_log_error("Unable to create network management mutex");
-        return ret;
+    /* Save configuration and callbacks */
+    if (MENDER_OK != (ret = mender_client_ctx_configure(config, callbacks))) {
+        goto END;
     }
+    memset(&mender_client_boot_timing, 0, sizeof(mender_client_boot_timing));
+    mender_client_boot_timing_lap();
+
+#ifdef CONFIG_MENDER_CLIENT_CONFIRM_IMAGE_AT_BOOT
+    /* Confirm the running image before anything else, the rollback no longer depends on the connection to the server */
+    if (false == mender_flash_is_image_confirmed()) {
+        if (MENDER_OK != mender_flash_confirm_image()) {
+            mender_log_warning("Unable to confirm the running image");
+        }
+    }
+    mender_client_boot_timing.confirm = mender_client_boot_timing_lap();
+#endif /* CONFIG_MENDER_CLIENT_CONFIRM_IMAGE_AT_BOOT */
 
-    /* Create artifact types management mutex */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_artifact_types_mutex))) {
-        mender_log_error("Unable to create artifact types management mutex");
-        return ret;
+    /* Initializations */
+    if (MENDER_OK != (ret = mender_scheduler_init())) {
+        mender_log_error("Unable to initialize scheduler");
+        goto END;
+    }
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+    if (MENDER_OK != (ret = mender_client_memory_budget_init())) {
+        mender_log_error("Unable to reserve memory budget");
+        goto END;
+    }
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+    if (MENDER_OK != (ret = mender_log_init())) {
+        mender_log_error("Unable to initialize log");
+        goto END;
+    }
+    mender_client_boot_timing.scheduler = mender_client_boot_timing_lap();
+    if (MENDER_OK != (ret = mender_storage_init())) {
+        mender_log_error("Unable to initialize storage");
+        goto END;
+    }
+    mender_client_boot_timing.storage = mender_client_boot_timing_lap();
+    if (MENDER_OK != (ret = mender_tls_init())) {
+        mender_log_error("Unable to initialize TLS");
+        goto END;
+    }
+    mender_client_boot_timing.tls = mender_client_boot_timing_lap();
+    mender_api_config_t mender_api_config = {
+        .artifact_name             = mender_client_ctx->config.artifact_name,
+        .device_type               = mender_client_ctx->config.device_type,
+        .host                      = mender_client_ctx->config.host,
+        .tenant_token              = mender_client_ctx->config.tenant_token,
+        .http_recv_buf_length      = mender_client_ctx->config.http_recv_buf_length,
+        .websocket_recv_buf_length = mender_client_ctx->config.websocket_recv_buf_length,
+    };
+    if (MENDER_OK != (ret = mender_api_init(&mender_api_config))) {
+        mender_log_error("Unable to initialize API");
+        goto END;
     }
+    mender_client_boot_timing.api = mender_client_boot_timing_lap();
 
-    /* Create add-ons management mutex */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_addons_mutex))) {
-        mender_log_error("Unable to create add-ons management mutex");
-        return ret;
+    /* Create the mutexes and the works of the client */
+    if (MENDER_OK != (ret = mender_client_ctx_setup())) {
+        goto END;
     }
 
     /* Register rootfs-image artifact type */
@@ -324,15 +1074,34 @@ mender_client_init(mender_client_config_t *config, mender_client_callbacks_t *ca
         goto END;
     }
 
-    /* Create mender client work */
-    mender_scheduler_work_params_t update_work_params;
-    update_work_params.function = mender_client_work_function;
-    update_work_params.period   = mender_client_config.authentication_poll_interval;
-    update_work_params.name     = "mender_client_update";
-    if (MENDER_OK != (ret = mender_scheduler_work_create(&update_work_params, &mender_client_work_handle))) {
-        mender_log_error("Unable to create update work");
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+    /* Register rootfs-image-delta artifact type */
+    if (MENDER_OK
+        != (ret = mender_client_register_artifact_type(
+                "rootfs-image-delta", &mender_client_download_artifact_delta_callback, true, config->artifact_name))) {
+        mender_log_error("Unable to register 'rootfs-image-delta' artifact type");
         goto END;
     }
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
+
+    /* Gather the works executed back-to-back in a single network session, the scheduler may not support it */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    mender_scheduler_set_batch_callbacks(mender_client_batch_begin, mender_client_batch_end);
+#else
+    mender_scheduler_set_batch_callbacks(mender_client_network_connect, mender_client_network_release);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+
+    /* Initialization of the add-ons registered at compile time */
+    MENDER_CLIENT_STATIC_FOREACH(mender_client_addon, entry) {
+        if (NULL != entry->addon->init) {
+            if (MENDER_OK != (ret = entry->addon->init(entry->config, entry->callbacks))) {
+                mender_log_error("Unable to initialize add-on");
+                goto END;
+            }
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
 
 END:
 
@@ -341,23 +1110,35 @@ END:
 
 mender_err_t
 mender_client_register_artifact_type(char *type,
-                                     mender_err_t (*callback)(char *, char *, char *, cJSON *, char *, size_t, void *, size_t, size_t),
+                                     mender_err_t (*callback)(char *, char *, char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t),
                                      bool  needs_restart,
                                      char *artifact_name) {
 
     assert(NULL != type);
     mender_client_artifact_type_t  *artifact_type;
     mender_client_artifact_type_t **tmp;
+    size_t                          position;
     mender_err_t                    ret;
 
     /* Take mutex used to protect access to the artifact types management list */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_artifact_types_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->artifact_types_mutex, -1))) {
         mender_log_error("Unable to take mutex");
         return ret;
     }
 
+    /* Check if the artifact type is already registered */
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+    if ((NULL != mender_client_artifact_type_find(type, &position)) || (NULL != mender_client_artifact_type_find_static(type))) {
+#else
+    if (NULL != mender_client_artifact_type_find(type, &position)) {
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+        mender_log_error("Artifact type '%s' is already registered", type);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
     /* Create mender artifact type */
-    if (NULL == (artifact_type = (mender_client_artifact_type_t *)malloc(sizeof(mender_client_artifact_type_t)))) {
+    if (NULL == (artifact_type = (mender_client_artifact_type_t *)mender_utils_malloc(sizeof(mender_client_artifact_type_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -369,21 +1150,24 @@ mender_client_register_artifact_type(char *type,
 
     /* Add mender artifact type to the list */
     if (NULL
-        == (tmp = (mender_client_artifact_type_t **)realloc(mender_client_artifact_types_list,
-                                                            (mender_client_artifact_types_count + 1) * sizeof(mender_client_artifact_type_t *)))) {
+        == (tmp = (mender_client_artifact_type_t **)mender_utils_realloc(mender_client_ctx->artifact_types_list,
+                                                            (mender_client_ctx->artifact_types_count + 1) * sizeof(mender_client_artifact_type_t *)))) {
         mender_log_error("Unable to allocate memory");
-        free(artifact_type);
+        mender_utils_free(artifact_type);
         ret = MENDER_FAIL;
         goto END;
     }
-    mender_client_artifact_types_list                                     = tmp;
-    mender_client_artifact_types_list[mender_client_artifact_types_count] = artifact_type;
-    mender_client_artifact_types_count++;
+    mender_client_ctx->artifact_types_list = tmp;
+    memmove(&mender_client_ctx->artifact_types_list[position + 1],
+            &mender_client_ctx->artifact_types_list[position],
+            (mender_client_ctx->artifact_types_count - position) * sizeof(mender_client_artifact_type_t *));
+    mender_client_ctx->artifact_types_list[position] = artifact_type;
+    mender_client_ctx->artifact_types_count++;
 
 END:
 
     /* Release mutex used to protect access to the artifact types management list */
-    mender_scheduler_mutex_give(mender_client_artifact_types_mutex);
+    mender_scheduler_mutex_give(mender_client_ctx->artifact_types_mutex);
 
     return ret;
 }
@@ -393,13 +1177,46 @@ mender_client_register_addon(mender_addon_instance_t *addon, void *config, void
 
     assert(NULL != addon);
     mender_addon_instance_t **tmp;
-    mender_err_t              ret;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    void  *ctx = NULL;
+    void **tmp_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    mender_err_t ret;
 
     /* Take mutex used to protect access to the add-ons management list */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_addons_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->addons_mutex, -1))) {
         mender_log_error("Unable to take mutex");
         return ret;
     }
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select a new context of the add-on for an additional device, the contexts are read without lock by the works once the device is activated */
+    if (&mender_client_default_ctx != mender_client_ctx) {
+        if ((0 == addon->ctx_size) || (NULL == addon->select_ctx)) {
+            mender_log_error("Add-on does not support client contexts");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        if (true == mender_client_ctx->activated) {
+            mender_log_error("Add-ons of an additional device must be registered before it is activated");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        if (NULL == (ctx = mender_utils_calloc(1, addon->ctx_size))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        if (NULL == (tmp_ctx = (void **)mender_utils_realloc(mender_client_ctx->addons_ctx, (mender_client_ctx->addons_count + 1) * sizeof(void *)))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        mender_client_ctx->addons_ctx                                  = tmp_ctx;
+        mender_client_ctx->addons_ctx[mender_client_ctx->addons_count] = ctx;
+        addon->select_ctx(ctx);
+    }
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
     /* Initialization of the add-on */
     if (NULL != addon->init) {
@@ -410,7 +1227,7 @@ mender_client_register_addon(mender_addon_instance_t *addon, void *config, void
     }
 
     /* Activate add-on if authentication is already done */
-    if (MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_state) {
+    if (MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_ctx->state) {
         if (NULL != addon->activate) {
             if (MENDER_OK != (ret = addon->activate())) {
                 mender_log_error("Unable to activate add-on");
@@ -423,7 +1240,9 @@ mender_client_register_addon(mender_addon_instance_t *addon, void *config, void
     }
 
     /* Add add-on to the list */
-    if (NULL == (tmp = (mender_addon_instance_t **)realloc(mender_client_addons_list, (mender_client_addons_count + 1) * sizeof(mender_addon_instance_t *)))) {
+    if (NULL
+        == (tmp = (mender_addon_instance_t **)mender_utils_realloc(mender_client_ctx->addons_list,
+                                                                   (mender_client_ctx->addons_count + 1) * sizeof(mender_addon_instance_t *)))) {
         mender_log_error("Unable to allocate memory");
         if (NULL != addon->exit) {
             addon->exit();
@@ -431,14 +1250,25 @@ mender_client_register_addon(mender_addon_instance_t *addon, void *config, void
         ret = MENDER_FAIL;
         goto END;
     }
-    mender_client_addons_list                             = tmp;
-    mender_client_addons_list[mender_client_addons_count] = addon;
-    mender_client_addons_count++;
+    mender_client_ctx->addons_list                                  = tmp;
+    mender_client_ctx->addons_list[mender_client_ctx->addons_count] = addon;
+    mender_client_ctx->addons_count++;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    ctx = NULL;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
 END:
 
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    /* Release the context of the add-on if it has not been registered */
+    if (NULL != ctx) {
+        addon->select_ctx(NULL);
+        mender_utils_free(ctx);
+    }
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
     /* Release mutex used to protect access to the add-ons management list */
-    mender_scheduler_mutex_give(mender_client_addons_mutex);
+    mender_scheduler_mutex_give(mender_client_ctx->addons_mutex);
 
     return ret;
 }
@@ -448,11 +1278,40 @@ mender_client_activate(void) {
 
     mender_err_t ret;
 
+    /* Activate authentication refresh work, it is executed once the client is authenticated */
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_ctx->refresh_work_handle))) {
+        mender_log_error("Unable to activate authentication refresh work");
+        goto END;
+    }
+
+    /* Activate deployment status work, it is executed when a status is queued in the outbox */
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_ctx->status_work_handle))) {
+        mender_log_error("Unable to activate deployment status work");
+        goto END;
+    }
+
+    /* Activate network work, it is executed when the network has not been used during the linger interval */
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_ctx->network_work_handle))) {
+        mender_log_error("Unable to activate network work");
+        goto END;
+    }
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+
+    /* Activate download progress work, it is executed when a substate is pending */
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_ctx->progress_work_handle))) {
+        mender_log_error("Unable to activate download progress work");
+        goto END;
+    }
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+
     /* Activate update work */
-    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_work_handle))) {
+    if (MENDER_OK != (ret = mender_scheduler_work_activate(mender_client_ctx->work_handle))) {
         mender_log_error("Unable to activate update work");
         goto END;
     }
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    mender_client_ctx->activated = true;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
 END:
 
@@ -465,25 +1324,53 @@ mender_client_deactivate(void) {
     mender_err_t ret;
 
     /* Take mutex used to protect access to the add-ons management list */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_addons_mutex, -1))) {
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->addons_mutex, -1))) {
         mender_log_error("Unable to take mutex");
         return ret;
     }
 
     /* Deactivate add-ons */
-    if (NULL != mender_client_addons_list) {
-        for (size_t index = 0; index < mender_client_addons_count; index++) {
-            if (NULL != mender_client_addons_list[index]->deactivate) {
-                mender_client_addons_list[index]->deactivate();
+    if (NULL != mender_client_ctx->addons_list) {
+        for (size_t index = 0; index < mender_client_ctx->addons_count; index++) {
+            if (NULL != mender_client_ctx->addons_list[index]->deactivate) {
+                mender_client_ctx->addons_list[index]->deactivate();
             }
         }
     }
 
     /* Release mutex used to protect access to the add-ons management list */
-    mender_scheduler_mutex_give(mender_client_addons_mutex);
+    mender_scheduler_mutex_give(mender_client_ctx->addons_mutex);
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
 
-    /* Deactivate mender client work */
-    mender_scheduler_work_deactivate(mender_client_work_handle);
+    /* Deactivate add-ons registered at compile time */
+    MENDER_CLIENT_STATIC_FOREACH(mender_client_addon, entry) {
+        if (NULL != entry->addon->deactivate) {
+            entry->addon->deactivate();
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+
+    /* Deactivate mender client works */
+    mender_scheduler_work_deactivate(mender_client_ctx->work_handle);
+    mender_scheduler_work_set_period(mender_client_ctx->refresh_work_handle, 0);
+    mender_scheduler_work_deactivate(mender_client_ctx->refresh_work_handle);
+    mender_scheduler_work_set_period(mender_client_ctx->status_work_handle, 0);
+    mender_scheduler_work_deactivate(mender_client_ctx->status_work_handle);
+    mender_scheduler_work_set_period(mender_client_ctx->network_work_handle, 0);
+    mender_scheduler_work_deactivate(mender_client_ctx->network_work_handle);
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+    mender_scheduler_work_deactivate(mender_client_ctx->progress_work_handle);
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    mender_client_ctx->activated = false;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Release the network now if it is lingering */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    mender_client_network_work_function(mender_client_ctx);
+#else
+    mender_client_network_work_function();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
     return ret;
 }
@@ -494,7 +1381,7 @@ mender_client_execute(void) {
     mender_err_t ret;
 
     /* Trigger execution of the work */
-    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_client_work_handle))) {
+    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_client_ctx->work_handle))) {
         mender_log_error("Unable to trigger update work");
         goto END;
     }
@@ -505,59 +1392,296 @@ END:
 }
 
 mender_err_t
-mender_client_network_connect(void) {
+mender_client_install_artifact_stream(char *artifact_name, mender_err_t (*callback)(void *, size_t *, void *), void *params) {
 
+    assert(NULL != artifact_name);
+    assert(NULL != callback);
     mender_err_t ret;
 
-    /* Take mutex used to protect access to the network management counter */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_network_mutex, -1))) {
-        mender_log_error("Unable to take mutex");
-        return ret;
+    /* Only one deployment is processed at a time, the artifact is not installed while the update work is processing a deployment */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_client_ctx->deployment_mutex, 0)) {
+        mender_log_error("A deployment is already in progress");
+        return MENDER_FAIL;
     }
-
-    /* Check the network management counter value */
-    if (0 == mender_client_network_count) {
-
-        /* Request network access */
-        if (NULL != mender_client_callbacks.network_connect) {
-            if (MENDER_OK != (ret = mender_client_callbacks.network_connect())) {
-                mender_log_error("Unable to connect network");
-                goto END;
-            }
-        }
+    if (NULL != mender_client_ctx->deployment_data) {
+        mender_log_error("A deployment is already in progress");
+        ret = MENDER_FAIL;
+        goto END;
     }
 
-    /* Increment network management counter */
-    mender_client_network_count++;
+    /* The device type of the client is the only one compatible, there is no deployment to restrict it */
+    char                        *device_types_compatible[] = { mender_client_ctx->config.device_type };
+    mender_api_deployment_data_t deployment                = { .id                           = MENDER_CLIENT_LOCAL_DEPLOYMENT_ID,
+                                                               .artifact_name                = artifact_name,
+                                                               .uri                          = NULL,
+                                                               .device_types_compatible      = device_types_compatible,
+                                                               .device_types_compatible_size = 1 };
+
+    /* Install the artifact, the network and the mender-server are not used */
+    mender_log_info("Installing artifact with artifact name '%s' from local source", artifact_name);
+    if (MENDER_DONE == (ret = mender_client_deployment_install(&deployment, callback, params))) {
+        ret = MENDER_OK;
+    }
 
 END:
 
-    /* Release mutex used to protect access to the network management counter */
-    mender_scheduler_mutex_give(mender_client_network_mutex);
+    /* Release deployment mutex */
+    mender_scheduler_mutex_give(mender_client_ctx->deployment_mutex);
 
     return ret;
 }
 
 mender_err_t
-mender_client_network_release(void) {
+mender_client_trigger(uint32_t reasons) {
 
-    mender_err_t ret;
+    mender_err_t ret = MENDER_OK;
+    uint32_t     validity;
 
-    /* Take mutex used to protect access to the network management counter */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_network_mutex, -1))) {
-        mender_log_error("Unable to take mutex");
-        return ret;
+    /* Refresh the authentication token first if it has expired, so that the works do not fail and restart the authentication */
+    if ((0 != (reasons & (MENDER_CLIENT_TRIGGER_NETWORK_AVAILABLE | MENDER_CLIENT_TRIGGER_DEPLOYMENT_HINT)))
+        && (MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_ctx->state) && (MENDER_OK == mender_api_get_authentication_validity(&validity))
+        && (0 == validity)) {
+        mender_scheduler_work_execute(mender_client_ctx->refresh_work_handle);
     }
 
-    /* Decrement network management counter */
-    mender_client_network_count--;
+    /* Check for deployments, the authentication is performed only if the client is not authenticated yet */
+    if (0 != (reasons & (MENDER_CLIENT_TRIGGER_NETWORK_AVAILABLE | MENDER_CLIENT_TRIGGER_DEPLOYMENT_HINT))) {
+        if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_client_ctx->work_handle))) {
+            mender_log_error("Unable to trigger update work");
+            return ret;
+        }
+    }
+
+    /* Publish the deployment status which could not be published while the network was not available */
+    if ((0 != (reasons & MENDER_CLIENT_TRIGGER_NETWORK_AVAILABLE)) && (MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_ctx->state)) {
+        mender_scheduler_work_execute(mender_client_ctx->status_work_handle);
+    }
+
+    /* Take mutex used to protect access to the add-ons management list */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->addons_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Trigger add-ons, they execute their works depending of the reasons */
+    for (size_t index = 0; index < mender_client_ctx->addons_count; index++) {
+        if (NULL != mender_client_ctx->addons_list[index]->trigger) {
+            if (MENDER_OK != mender_client_ctx->addons_list[index]->trigger(reasons)) {
+                mender_log_error("Unable to trigger add-on");
+                ret = MENDER_FAIL;
+            }
+        }
+    }
+
+    /* Release mutex used to protect access to the add-ons management list */
+    mender_scheduler_mutex_give(mender_client_ctx->addons_mutex);
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+
+    /* Trigger add-ons registered at compile time */
+    MENDER_CLIENT_STATIC_FOREACH(mender_client_addon, entry) {
+        if (NULL != entry->addon->trigger) {
+            if (MENDER_OK != entry->addon->trigger(reasons)) {
+                mender_log_error("Unable to trigger add-on");
+                ret = MENDER_FAIL;
+            }
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+mender_err_t
+mender_client_publish_deployment_logs(char *id) {
+
+    assert(NULL != id);
+    mender_err_t ret;
+    char        *value;
+
+    /* Duplicate ID */
+    if (NULL == (value = mender_utils_strdup(id))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    /* Take mutex used to protect access to the deployment status outbox */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->status_outbox_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        mender_utils_free(value);
+        return ret;
+    }
+
+    /* Request the upload of the logs, it supersedes the previous request */
+    mender_utils_free(mender_client_ctx->logs_outbox);
+    mender_client_ctx->logs_outbox = value;
+
+    /* Release mutex used to protect access to the deployment status outbox */
+    mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
+
+    /* Trigger execution of the deployment status work */
+    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_client_ctx->status_work_handle))) {
+        mender_log_error("Unable to trigger deployment status work");
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
+mender_err_t
+mender_client_set_download_rate(uint32_t rate) {
+
+    /* Set the rate of the artifact downloads */
+    return mender_api_set_download_rate(rate);
+}
+
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+
+mender_err_t
+mender_client_set_download_capture(void (*callback)(mender_api_download_fragment_t *, void *), void *params) {
+
+    /* Set the capture of the artifact downloads */
+    return mender_api_set_download_capture(callback, params);
+}
+
+mender_err_t
+mender_client_set_download_replay(const mender_api_download_fragment_t *fragments, size_t count) {
+
+    /* Set the replay of the artifact downloads */
+    return mender_api_set_download_replay(fragments, count);
+}
+
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+#ifdef CONFIG_MENDER_CLIENT_DEFERRED_INSTALL
+
+mender_err_t
+mender_client_commit_deployment(void) {
+
+    mender_err_t ret;
+
+    /* Check if a deployment has been downloaded */
+    if (NULL == __atomic_load_n(&mender_client_ctx->deployment_deferred, __ATOMIC_ACQUIRE)) {
+        mender_log_error("No deployment waiting to be committed");
+        return MENDER_NOT_FOUND;
+    }
+
+    /* Commit the deployment and trigger execution of the work, the artifact is installed by the update work */
+    __atomic_store_n(&mender_client_ctx->deployment_committed, true, __ATOMIC_RELEASE);
+    if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_client_ctx->work_handle))) {
+        mender_log_error("Unable to trigger update work");
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_DEFERRED_INSTALL */
+
+mender_err_t
+mender_client_get_stats(mender_client_stats_t *stats) {
+
+    assert(NULL != stats);
+    mender_err_t ret;
+    uint64_t     now = 0;
+
+    /* Retrieve the statistics of the API */
+    if (MENDER_OK != (ret = mender_api_get_stats(&stats->api))) {
+        return ret;
+    }
+
+    /* Compute the time spent in each state, the current state lasts until now and the next ones have not been entered yet */
+    mender_client_state_t state = mender_client_ctx->state;
+    uint64_t              durations[MENDER_CLIENT_STATE_AUTHENTICATED + 1];
+    mender_scheduler_get_uptime(&now);
+    for (size_t index = 0; index <= MENDER_CLIENT_STATE_AUTHENTICATED; index++) {
+        if (index > (size_t)state) {
+            durations[index] = 0;
+        } else {
+            durations[index] = ((index < (size_t)state) ? mender_client_ctx->stats.timestamps[index + 1] : now) - mender_client_ctx->stats.timestamps[index];
+        }
+    }
+    stats->states.initialization = durations[MENDER_CLIENT_STATE_INITIALIZATION];
+    stats->states.authentication = durations[MENDER_CLIENT_STATE_AUTHENTICATION];
+    stats->states.authenticated  = durations[MENDER_CLIENT_STATE_AUTHENTICATED];
+    stats->failures              = __atomic_load_n(&mender_client_ctx->stats.failures, __ATOMIC_RELAXED);
+
+    return ret;
+}
+
+mender_err_t
+mender_client_network_connect(void) {
+
+    mender_err_t ret;
+
+    /* Take mutex used to protect access to the network management counter */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->network_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Check the network management counter value, the network is still connected if it is lingering */
+    if ((0 == mender_client_ctx->network_count) && (true != mender_client_ctx->network_lingering)) {
+
+        /* Request network access */
+        if (NULL != mender_client_ctx->callbacks.network_connect) {
+            uint64_t start, end;
+            mender_scheduler_get_uptime(&start);
+            if (MENDER_OK != (ret = mender_client_ctx->callbacks.network_connect())) {
+                mender_log_error("Unable to connect network");
+                goto END;
+            }
+            mender_scheduler_get_uptime(&end);
+
+            /* Report the duration of the connection, so that the application can tune the linger interval */
+            mender_log_debug("Network connected in %u ms", (unsigned int)(end - start));
+            if (NULL != mender_client_ctx->callbacks.network_connected) {
+                mender_client_ctx->callbacks.network_connected((uint32_t)(end - start));
+            }
+        }
+    }
+    mender_client_ctx->network_lingering = false;
+
+    /* Increment network management counter */
+    mender_client_ctx->network_count++;
+
+END:
+
+    /* Release mutex used to protect access to the network management counter */
+    mender_scheduler_mutex_give(mender_client_ctx->network_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_client_network_release(void) {
+
+    mender_err_t ret;
+
+    /* Take mutex used to protect access to the network management counter */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->network_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Decrement network management counter */
+    mender_client_ctx->network_count--;
 
     /* Check the network management counter value */
-    if (0 == mender_client_network_count) {
+    if (0 == mender_client_ctx->network_count) {
+
+#if CONFIG_MENDER_CLIENT_NETWORK_LINGER_INTERVAL > 0
+        /* Keep the network during the linger interval, so that the works executed meanwhile share the same network session */
+        if (MENDER_OK == mender_scheduler_work_set_period(mender_client_ctx->network_work_handle, CONFIG_MENDER_CLIENT_NETWORK_LINGER_INTERVAL)) {
+            mender_client_ctx->network_lingering = true;
+            goto END;
+        }
+#endif /* CONFIG_MENDER_CLIENT_NETWORK_LINGER_INTERVAL > 0 */
 
         /* Release network access */
-        if (NULL != mender_client_callbacks.network_release) {
-            if (MENDER_OK != (ret = mender_client_callbacks.network_release())) {
+        if (NULL != mender_client_ctx->callbacks.network_release) {
+            if (MENDER_OK != (ret = mender_client_ctx->callbacks.network_release())) {
                 mender_log_error("Unable to release network");
                 goto END;
             }
@@ -566,744 +1690,2975 @@ mender_client_network_release(void) {
 
 END:
 
-    /* Release mutex used to protect access to the network management counter */
-    mender_scheduler_mutex_give(mender_client_network_mutex);
+    /* Release mutex used to protect access to the network management counter */
+    mender_scheduler_mutex_give(mender_client_ctx->network_mutex);
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+static mender_err_t
+mender_client_batch_begin(void *arg) {
+
+    /* Request the network with the context of the device of the work, the batch is executed by a work queue thread */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+    mender_err_t         ret      = mender_client_network_connect();
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_batch_end(void *arg) {
+
+    /* Release the network with the context of the device of the work which began the batch */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+    mender_err_t         ret      = mender_client_network_release();
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+
+    return ret;
+}
+
+mender_client_ctx_t *
+mender_client_create_ctx(mender_client_config_t *config, mender_client_callbacks_t *callbacks) {
+
+    assert(NULL != config);
+    assert(NULL != config->artifact_name);
+    assert(NULL != config->device_type);
+    assert(NULL != callbacks);
+    assert(NULL != callbacks->restart);
+    mender_client_ctx_t *ctx;
+    mender_client_ctx_t *previous;
+
+    /* Create context */
+    if (NULL == (ctx = (mender_client_ctx_t *)mender_utils_calloc(1, sizeof(mender_client_ctx_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return NULL;
+    }
+    previous = mender_client_select_ctx(ctx);
+
+    /* Save configuration and callbacks, the host and the buffers are shared with the context of mender_client_init */
+    mender_client_config_t ctx_config    = *config;
+    ctx_config.host                      = mender_client_default_ctx.config.host;
+    ctx_config.recommissioning           = false;
+    ctx_config.http_recv_buf_length      = mender_client_default_ctx.config.http_recv_buf_length;
+    ctx_config.websocket_recv_buf_length = mender_client_default_ctx.config.websocket_recv_buf_length;
+    if (MENDER_OK != mender_client_ctx_configure(&ctx_config, callbacks)) {
+        goto FAIL;
+    }
+
+    /* Create the contexts of the requests and of the authentication keys of the device */
+    mender_api_config_t mender_api_config = {
+        .artifact_name             = mender_client_ctx->config.artifact_name,
+        .device_type               = mender_client_ctx->config.device_type,
+        .host                      = mender_client_ctx->config.host,
+        .tenant_token              = mender_client_ctx->config.tenant_token,
+        .http_recv_buf_length      = mender_client_ctx->config.http_recv_buf_length,
+        .websocket_recv_buf_length = mender_client_ctx->config.websocket_recv_buf_length,
+    };
+    if (NULL == (ctx->api_ctx = mender_api_create_ctx(&mender_api_config))) {
+        mender_log_error("Unable to create API context");
+        goto FAIL;
+    }
+    if (NULL == (ctx->tls_ctx = mender_tls_create_ctx())) {
+        mender_log_error("Unable to create TLS context");
+        goto FAIL;
+    }
+    mender_client_select_ctx(ctx);
+
+    /* Create the mutexes and the works of the device */
+    if (MENDER_OK != mender_client_ctx_setup()) {
+        goto FAIL;
+    }
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+
+    return ctx;
+
+FAIL:
+
+    /* Release the context partially set up */
+    mender_client_ctx_clear();
+    mender_client_select_ctx(previous);
+    if (NULL != ctx->api_ctx) {
+        mender_api_release_ctx(ctx->api_ctx);
+    }
+    if (NULL != ctx->tls_ctx) {
+        mender_tls_release_ctx(ctx->tls_ctx);
+    }
+    mender_utils_free(ctx);
+
+    return NULL;
+}
+
+mender_client_ctx_t *
+mender_client_select_ctx(mender_client_ctx_t *ctx) {
+
+    mender_client_ctx_t *previous = mender_client_ctx;
+
+    /* Leave the contexts of the add-ons of the device previously selected */
+    if (NULL != previous->addons_ctx) {
+        for (size_t index = 0; index < previous->addons_count; index++) {
+            previous->addons_list[index]->select_ctx(NULL);
+        }
+    }
+
+    /* Select the context of the device, then the contexts of its requests, of its authentication keys and of its add-ons */
+    mender_client_ctx = (NULL != ctx) ? ctx : &mender_client_default_ctx;
+    mender_api_select_ctx(mender_client_ctx->api_ctx);
+    mender_tls_select_ctx(mender_client_ctx->tls_ctx);
+    if (NULL != mender_client_ctx->addons_ctx) {
+        for (size_t index = 0; index < mender_client_ctx->addons_count; index++) {
+            mender_client_ctx->addons_list[index]->select_ctx(mender_client_ctx->addons_ctx[index]);
+        }
+    }
+
+    return (&mender_client_default_ctx != previous) ? previous : NULL;
+}
+
+mender_client_ctx_t *
+mender_client_get_ctx(void) {
+
+    return (&mender_client_default_ctx != mender_client_ctx) ? mender_client_ctx : NULL;
+}
+
+void
+mender_client_release_ctx(mender_client_ctx_t *ctx) {
+
+    mender_client_ctx_t *previous;
+
+    /* Release the context, the context of mender_client_init is released by mender_client_exit */
+    if ((NULL != ctx) && (&mender_client_default_ctx != ctx)) {
+        assert(mender_client_ctx != ctx);
+        previous = mender_client_select_ctx(ctx);
+        mender_client_ctx_clear();
+        mender_client_select_ctx(previous);
+        mender_api_release_ctx(ctx->api_ctx);
+        mender_tls_release_ctx(ctx->tls_ctx);
+        mender_utils_free(ctx);
+    }
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+mender_err_t
+mender_client_exit(void) {
+
+    mender_err_t ret;
+
+    /* Release the add-ons, the works and the memory of the client */
+    if (MENDER_OK != (ret = mender_client_ctx_clear())) {
+        return ret;
+    }
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+
+    /* Release add-ons registered at compile time */
+    MENDER_CLIENT_STATIC_FOREACH(mender_client_addon, entry) {
+        if (NULL != entry->addon->exit) {
+            entry->addon->exit();
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+
+    /* Release all modules */
+    mender_api_exit();
+    mender_tls_exit();
+    mender_storage_cache_exit();
+    mender_storage_exit();
+    mender_log_exit();
+    mender_scheduler_exit();
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+    mender_utils_heap_set_budget(NULL);
+    mender_utils_free(mender_client_memory_budget.memory);
+    mender_client_memory_budget.memory = NULL;
+    mender_scheduler_mutex_delete(mender_client_memory_budget.mutex);
+    mender_client_memory_budget.mutex = NULL;
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
+    /* Restore the standard library allocator, everything has been released */
+    mender_utils_set_allocator(NULL);
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_ctx_configure(mender_client_config_t *config, mender_client_callbacks_t *callbacks) {
+
+    assert(NULL != config);
+    assert(NULL != callbacks);
+
+    /* Save configuration */
+    mender_client_ctx->config.artifact_name = config->artifact_name;
+    mender_client_ctx->config.device_type   = config->device_type;
+    if ((NULL != config->host) && (strlen(config->host) > 0)) {
+        mender_client_ctx->config.host = config->host;
+    } else {
+        mender_client_ctx->config.host = CONFIG_MENDER_SERVER_HOST;
+    }
+    if ((NULL == mender_client_ctx->config.host) || (0 == strlen(mender_client_ctx->config.host))) {
+        mender_log_error("Invalid server host configuration, can't be null or empty");
+        return MENDER_FAIL;
+    }
+    if ('/' == mender_client_ctx->config.host[strlen(mender_client_ctx->config.host) - 1]) {
+        mender_log_error("Invalid server host configuration, trailing '/' is not allowed");
+        return MENDER_FAIL;
+    }
+    if ((NULL != config->tenant_token) && (strlen(config->tenant_token) > 0)) {
+        mender_client_ctx->config.tenant_token = config->tenant_token;
+    } else {
+        mender_client_ctx->config.tenant_token = CONFIG_MENDER_SERVER_TENANT_TOKEN;
+    }
+    if ((NULL != mender_client_ctx->config.tenant_token) && (0 == strlen(mender_client_ctx->config.tenant_token))) {
+        mender_client_ctx->config.tenant_token = NULL;
+    }
+    if (0 != config->authentication_poll_interval) {
+        mender_client_ctx->config.authentication_poll_interval = config->authentication_poll_interval;
+    } else {
+        mender_client_ctx->config.authentication_poll_interval = CONFIG_MENDER_CLIENT_AUTHENTICATION_POLL_INTERVAL;
+    }
+    if (0 != config->update_poll_interval) {
+        mender_client_ctx->config.update_poll_interval = config->update_poll_interval;
+    } else {
+        mender_client_ctx->config.update_poll_interval = CONFIG_MENDER_CLIENT_UPDATE_POLL_INTERVAL;
+    }
+    mender_client_ctx->config.recommissioning           = config->recommissioning;
+    mender_client_ctx->config.http_recv_buf_length      = config->http_recv_buf_length;
+    mender_client_ctx->config.websocket_recv_buf_length = config->websocket_recv_buf_length;
+    mender_client_ctx->config.artifact_verify_key       = config->artifact_verify_key;
+#ifndef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    if (NULL != mender_client_ctx->config.artifact_verify_key) {
+        mender_log_warning("Artifact signature verification is not enabled, the verification key is ignored");
+    }
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+    if ((NULL != config->artifact_mirror) && (strlen(config->artifact_mirror) > 0)) {
+        mender_client_ctx->config.artifact_mirror = config->artifact_mirror;
+    } else {
+        mender_client_ctx->config.artifact_mirror = CONFIG_MENDER_CLIENT_ARTIFACT_MIRROR;
+    }
+    if ((NULL != mender_client_ctx->config.artifact_mirror) && (0 == strlen(mender_client_ctx->config.artifact_mirror))) {
+        mender_client_ctx->config.artifact_mirror = NULL;
+    }
+
+    /* Save callbacks */
+    memcpy(&mender_client_ctx->callbacks, callbacks, sizeof(mender_client_callbacks_t));
+    memset(&mender_client_ctx->stats, 0, sizeof(mender_client_ctx->stats));
+    mender_client_state_set(MENDER_CLIENT_STATE_INITIALIZATION);
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_client_ctx_setup(void) {
+
+    mender_err_t ret;
+
+    /* Create network management mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_ctx->network_mutex))) {
+        mender_log_error("Unable to create network management mutex");
+        return ret;
+    }
+
+    /* Create artifact types management mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_ctx->artifact_types_mutex))) {
+        mender_log_error("Unable to create artifact types management mutex");
+        return ret;
+    }
+
+    /* Create add-ons management mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_ctx->addons_mutex))) {
+        mender_log_error("Unable to create add-ons management mutex");
+        return ret;
+    }
+
+    /* Create deployment status outbox mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_ctx->status_outbox_mutex))) {
+        mender_log_error("Unable to create deployment status outbox mutex");
+        return ret;
+    }
+
+    /* Create deployment mutex */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_ctx->deployment_mutex))) {
+        mender_log_error("Unable to create deployment mutex");
+        return ret;
+    }
+
+    /* Create mender client work */
+    mender_scheduler_work_params_t update_work_params;
+    update_work_params.function = mender_client_work_function;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    update_work_params.arg = mender_client_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    update_work_params.period   = mender_client_ctx->config.authentication_poll_interval;
+    update_work_params.name     = "mender_client_update";
+    update_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_NORMAL;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&update_work_params, &mender_client_ctx->work_handle))) {
+        mender_log_error("Unable to create update work");
+        return ret;
+    }
+    mender_utils_backoff_init(
+        &mender_client_ctx->backoff,
+        (mender_client_ctx->config.authentication_poll_interval > 0) ? (uint32_t)mender_client_ctx->config.authentication_poll_interval : 0);
+
+    /* Create mender client authentication refresh work, its period is set when the client is authenticated */
+    mender_scheduler_work_params_t refresh_work_params;
+    refresh_work_params.function = mender_client_refresh_work_function;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    refresh_work_params.arg = mender_client_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    refresh_work_params.period   = 0;
+    refresh_work_params.name     = "mender_client_refresh";
+    refresh_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_HIGH;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&refresh_work_params, &mender_client_ctx->refresh_work_handle))) {
+        mender_log_error("Unable to create authentication refresh work");
+        return ret;
+    }
+
+    /* Create mender client deployment status work, it is executed when a status is queued in the outbox */
+    mender_scheduler_work_params_t status_work_params;
+    status_work_params.function = mender_client_status_work_function;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    status_work_params.arg = mender_client_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    status_work_params.period   = 0;
+    status_work_params.name     = "mender_client_status";
+    status_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_NORMAL;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&status_work_params, &mender_client_ctx->status_work_handle))) {
+        mender_log_error("Unable to create deployment status work");
+        return ret;
+    }
+
+    /* Create mender client network work, it is executed when the network has not been used during the linger interval */
+    mender_scheduler_work_params_t network_work_params;
+    network_work_params.function = mender_client_network_work_function;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    network_work_params.arg = mender_client_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    network_work_params.period   = 0;
+    network_work_params.name     = "mender_client_network";
+    network_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_LOW;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&network_work_params, &mender_client_ctx->network_work_handle))) {
+        mender_log_error("Unable to create network work");
+        return ret;
+    }
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+
+    /* Create mender client download progress work, it is executed when a substate is pending, the low priority work queue runs beside the download */
+    mender_scheduler_work_params_t progress_work_params;
+    progress_work_params.function = mender_client_progress_work_function;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    progress_work_params.arg = mender_client_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    progress_work_params.period   = 0;
+    progress_work_params.name     = "mender_client_progress";
+    progress_work_params.priority = MENDER_SCHEDULER_WORK_PRIORITY_LOW;
+    if (MENDER_OK != (ret = mender_scheduler_work_create(&progress_work_params, &mender_client_ctx->progress_work_handle))) {
+        mender_log_error("Unable to create download progress work");
+        return ret;
+    }
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_ctx_clear(void) {
+
+    mender_err_t ret;
+
+    /* Release add-ons, the mutex does not exist if the creation of the context has failed */
+    if (NULL != mender_client_ctx->addons_mutex) {
+
+        /* Take mutex used to protect access to the add-ons management list */
+        if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->addons_mutex, -1))) {
+            mender_log_error("Unable to take mutex");
+            return ret;
+        }
+
+        /* Release add-ons */
+        if (NULL != mender_client_ctx->addons_list) {
+            for (size_t index = 0; index < mender_client_ctx->addons_count; index++) {
+                if (NULL != mender_client_ctx->addons_list[index]->exit) {
+                    mender_client_ctx->addons_list[index]->exit();
+                }
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+                if ((NULL != mender_client_ctx->addons_ctx) && (NULL != mender_client_ctx->addons_ctx[index])) {
+                    mender_client_ctx->addons_list[index]->select_ctx(NULL);
+                    mender_utils_free(mender_client_ctx->addons_ctx[index]);
+                }
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+            }
+        }
+
+        /* Release mutex used to protect access to the add-ons management list */
+        mender_scheduler_mutex_give(mender_client_ctx->addons_mutex);
+    }
+
+    /* Wait the end of the authentication keys task */
+    if (NULL != mender_client_ctx->authentication_keys.task) {
+        mender_scheduler_task_join(mender_client_ctx->authentication_keys.task);
+        mender_client_ctx->authentication_keys.task = NULL;
+    }
+
+    /* Delete mender client works */
+    if (NULL != mender_client_ctx->work_handle) {
+        mender_scheduler_work_delete(mender_client_ctx->work_handle);
+        mender_client_ctx->work_handle = NULL;
+    }
+    if (NULL != mender_client_ctx->refresh_work_handle) {
+        mender_scheduler_work_delete(mender_client_ctx->refresh_work_handle);
+        mender_client_ctx->refresh_work_handle = NULL;
+    }
+    if (NULL != mender_client_ctx->status_work_handle) {
+        mender_scheduler_work_delete(mender_client_ctx->status_work_handle);
+        mender_client_ctx->status_work_handle = NULL;
+    }
+    if (NULL != mender_client_ctx->network_work_handle) {
+        mender_scheduler_work_delete(mender_client_ctx->network_work_handle);
+        mender_client_ctx->network_work_handle = NULL;
+    }
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+    if (NULL != mender_client_ctx->progress_work_handle) {
+        mender_scheduler_work_delete(mender_client_ctx->progress_work_handle);
+        mender_client_ctx->progress_work_handle = NULL;
+    }
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+
+    /* Release memory */
+    mender_client_ctx->config.artifact_name                = NULL;
+    mender_client_ctx->config.device_type                  = NULL;
+    mender_client_ctx->config.host                         = NULL;
+    mender_client_ctx->config.tenant_token                 = NULL;
+    mender_client_ctx->config.authentication_poll_interval = 0;
+    mender_client_ctx->config.update_poll_interval         = 0;
+    mender_client_ctx->config.artifact_verify_key          = NULL;
+    mender_client_ctx->config.artifact_mirror              = NULL;
+    mender_client_ctx->network_count                       = 0;
+    mender_client_ctx->network_lingering                   = false;
+    if (NULL != mender_client_ctx->network_mutex) {
+        mender_scheduler_mutex_give(mender_client_ctx->network_mutex);
+        mender_scheduler_mutex_delete(mender_client_ctx->network_mutex);
+    }
+    mender_client_ctx->network_mutex = NULL;
+#ifdef CONFIG_MENDER_CLIENT_DEFERRED_INSTALL
+    if (NULL != mender_client_ctx->deployment_deferred) {
+        /* The deployment downloaded has not been committed, the images written are discarded */
+        if (true == mender_client_ctx->deployment_needs_set_pending_image) {
+            mender_client_flash_targets_abort();
+        }
+        mender_artifact_release_ctx(mender_client_ctx->deployment_deferred);
+        mender_client_ctx->deployment_deferred = NULL;
+    }
+    mender_client_ctx->deployment_committed = false;
+#endif /* CONFIG_MENDER_CLIENT_DEFERRED_INSTALL */
+    mender_client_deployment_data_release(mender_client_ctx->deployment_data);
+    mender_client_ctx->deployment_data = NULL;
+    if (NULL != mender_client_ctx->deployment_mutex) {
+        mender_scheduler_mutex_delete(mender_client_ctx->deployment_mutex);
+    }
+    mender_client_ctx->deployment_mutex = NULL;
+    if (NULL != mender_client_ctx->artifact_types_list) {
+        for (size_t artifact_type_index = 0; artifact_type_index < mender_client_ctx->artifact_types_count; artifact_type_index++) {
+            mender_utils_free(mender_client_ctx->artifact_types_list[artifact_type_index]);
+        }
+        mender_utils_free(mender_client_ctx->artifact_types_list);
+        mender_client_ctx->artifact_types_list = NULL;
+    }
+    mender_client_ctx->artifact_types_count  = 0;
+    mender_client_ctx->artifact_type_current = NULL;
+    if (NULL != mender_client_ctx->artifact_types_mutex) {
+        mender_scheduler_mutex_give(mender_client_ctx->artifact_types_mutex);
+        mender_scheduler_mutex_delete(mender_client_ctx->artifact_types_mutex);
+    }
+    mender_client_ctx->artifact_types_mutex = NULL;
+    if (NULL != mender_client_ctx->addons_list) {
+        mender_utils_free(mender_client_ctx->addons_list);
+        mender_client_ctx->addons_list = NULL;
+    }
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    mender_utils_free(mender_client_ctx->addons_ctx);
+    mender_client_ctx->addons_ctx = NULL;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    mender_client_ctx->addons_count = 0;
+    if (NULL != mender_client_ctx->addons_mutex) {
+        mender_scheduler_mutex_give(mender_client_ctx->addons_mutex);
+        mender_scheduler_mutex_delete(mender_client_ctx->addons_mutex);
+    }
+    mender_client_ctx->addons_mutex = NULL;
+    while (mender_client_ctx->status_outbox_count > 0) {
+        mender_client_status_outbox_pop();
+    }
+#ifdef CONFIG_MENDER_LOG_BUFFER
+    mender_utils_free(mender_client_ctx->logs_outbox);
+    mender_client_ctx->logs_outbox = NULL;
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+    mender_utils_free(mender_client_ctx->download_progress.id);
+    mender_client_ctx->download_progress.id = NULL;
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+    if (NULL != mender_client_ctx->status_outbox_mutex) {
+        mender_scheduler_mutex_delete(mender_client_ctx->status_outbox_mutex);
+    }
+    mender_client_ctx->status_outbox_mutex = NULL;
+
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_client_work_function(MENDER_SCHEDULER_WORK_ARG) {
+
+    mender_err_t ret = MENDER_OK;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select the context of the device of the work */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Work depending of the client state */
+    if (MENDER_CLIENT_STATE_INITIALIZATION == mender_client_ctx->state) {
+        /* Perform initialization of the client */
+        if (MENDER_DONE != (ret = mender_client_initialization_work_function())) {
+            goto END;
+        }
+        /* Update client state */
+        mender_client_state_set(MENDER_CLIENT_STATE_AUTHENTICATION);
+    }
+    /* Request access to the network */
+    if (MENDER_OK != (ret = mender_client_network_connect())) {
+        goto END;
+    }
+    /* Intentional pass-through */
+    if (MENDER_CLIENT_STATE_AUTHENTICATION == mender_client_ctx->state) {
+        /* Perform authentication with the server */
+        if (MENDER_DONE != (ret = mender_client_authentication_work_function())) {
+            goto RELEASE;
+        }
+        /* Update work period */
+        if (MENDER_OK != (ret = mender_scheduler_work_set_period(mender_client_ctx->work_handle, mender_client_ctx->config.update_poll_interval))) {
+            mender_log_error("Unable to set work period");
+            goto RELEASE;
+        }
+        mender_utils_backoff_init(&mender_client_ctx->backoff,
+                                  (mender_client_ctx->config.update_poll_interval > 0) ? (uint32_t)mender_client_ctx->config.update_poll_interval : 0);
+        /* Update client state */
+        mender_client_state_set(MENDER_CLIENT_STATE_AUTHENTICATED);
+    }
+    /* Intentional pass-through */
+    if (MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_ctx->state) {
+        /* Perform updates */
+        ret = mender_client_update_work_function();
+    }
+
+RELEASE:
+
+    /* Release access to the network */
+    mender_client_network_release();
+
+END:
+
+    /* Apply the backoff policy, the period of the work grows after consecutive failures and is restored on success */
+    if ((MENDER_OK != ret) && (MENDER_DONE != ret)) {
+        __atomic_add_fetch(&mender_client_ctx->stats.failures, 1, __ATOMIC_RELAXED);
+        uint32_t period = mender_utils_backoff_failure(&mender_client_ctx->backoff);
+        if (0 != period) {
+            mender_log_info("Retrying in %u seconds", (unsigned int)period);
+            mender_scheduler_work_set_period(mender_client_ctx->work_handle, period);
+        }
+    } else if ((MENDER_OK == ret) && (true == mender_utils_backoff_success(&mender_client_ctx->backoff))) {
+        mender_scheduler_work_set_period(mender_client_ctx->work_handle, mender_client_ctx->backoff.base);
+    }
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_initialization_work_function(void) {
+
+    assert(NULL != mender_client_ctx->callbacks.get_user_provided_keys);
+
+    const void  *storage_deployment_data        = NULL;
+    size_t       storage_deployment_data_length = 0;
+    mender_err_t ret;
+
+    /* Retrieve or generate authentication keys in the background, key generation may last long on the first boot */
+    if (NULL == mender_client_ctx->authentication_keys.task) {
+        mender_client_ctx->authentication_keys.done = false;
+        mender_scheduler_task_params_t task_params
+            = { .function = mender_client_authentication_keys_task, .arg = mender_client_ctx, .name = "mender_client_keys" };
+        if (MENDER_OK == mender_scheduler_task_create(&task_params, &mender_client_ctx->authentication_keys.task)) {
+            return MENDER_OK;
+        }
+        /* Fallback to the work queue if the task can not be created */
+        mender_log_warning("Unable to create authentication keys task, keys are retrieved or generated in the work queue");
+        mender_client_authentication_keys_task(NULL);
+    } else if (false == mender_client_ctx->authentication_keys.done) {
+        mender_log_info("Authentication keys are not available yet");
+        if (NULL != mender_client_ctx->callbacks.authentication_keys) {
+            mender_client_ctx->callbacks.authentication_keys(false);
+        }
+        return MENDER_OK;
+    } else {
+        mender_scheduler_task_join(mender_client_ctx->authentication_keys.task);
+        mender_client_ctx->authentication_keys.task = NULL;
+    }
+    if (MENDER_OK != (ret = mender_client_ctx->authentication_keys.ret)) {
+        mender_log_error("Unable to retrieve or generate authentication keys");
+        goto END;
+    }
+    if (NULL != mender_client_ctx->callbacks.authentication_keys) {
+        mender_client_ctx->callbacks.authentication_keys(true);
+    }
+
+    /* Seed the backoff jitter with the public key and the uptime, so that the devices of a fleet do not retry in lockstep */
+    char    *public_key_pem = NULL;
+    uint64_t uptime         = 0;
+    uint32_t seed           = 2166136261UL;
+    if (MENDER_OK == mender_tls_get_public_key_pem(&public_key_pem)) {
+        for (const char *p = public_key_pem; '\0' != *p; p++) {
+            seed = (seed ^ (uint8_t)*p) * 16777619UL;
+        }
+        mender_utils_free(public_key_pem);
+    }
+    mender_scheduler_get_uptime(&uptime);
+    mender_utils_backoff_seed(seed ^ (uint32_t)uptime);
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* The deployment data of the additional devices are not recorded in the storage, and the boot timing is the one of mender_client_init */
+    if (&mender_client_default_ctx != mender_client_ctx) {
+        return MENDER_DONE;
+    }
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Retrieve deployment data if it is found (following an update) */
+    mender_client_boot_timing_lap();
+    if (MENDER_OK != (ret = mender_storage_cache_get_deployment_data(&storage_deployment_data, &storage_deployment_data_length))) {
+        if (MENDER_NOT_FOUND != ret) {
+            mender_log_error("Unable to get deployment data");
+            goto REBOOT;
+        }
+    }
+    if (NULL != storage_deployment_data) {
+        if (MENDER_OK != (ret = mender_client_deployment_data_from_record(storage_deployment_data, storage_deployment_data_length))) {
+            mender_log_error("Unable to parse deployment data");
+            goto REBOOT;
+        }
+    }
+    mender_client_boot_timing.deployment_data = mender_client_boot_timing_lap();
+
+    /* Report the boot timing */
+    mender_log_info("Initialization done, confirm %u ms, scheduler %u ms, storage %u ms, TLS %u ms, API %u ms, keys %u ms, deployment data %u ms",
+                    (unsigned int)mender_client_boot_timing.confirm,
+                    (unsigned int)mender_client_boot_timing.scheduler,
+                    (unsigned int)mender_client_boot_timing.storage,
+                    (unsigned int)mender_client_boot_timing.tls,
+                    (unsigned int)mender_client_boot_timing.api,
+                    (unsigned int)mender_client_boot_timing.keys,
+                    (unsigned int)mender_client_boot_timing.deployment_data);
+
+    return MENDER_DONE;
+
+END:
+
+    return ret;
+
+REBOOT:
+
+    /* Delete pending deployment */
+    mender_storage_cache_delete_deployment_data();
+
+    /* Invoke restart callback, application is responsible to shutdown properly and restart the system */
+    if (NULL != mender_client_ctx->callbacks.restart) {
+        mender_client_ctx->callbacks.restart();
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_refresh_work_function(MENDER_SCHEDULER_WORK_ARG) {
+
+    mender_err_t ret;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select the context of the device of the work */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Request access to the network */
+    if (MENDER_OK != (ret = mender_client_network_connect())) {
+        mender_log_error("Requesting access to the network failed");
+        goto END;
+    }
+
+    /* Request a new token, the callbacks are not invoked because the client remains authenticated */
+    mender_log_info("Refreshing authentication token...");
+    if (MENDER_OK != (ret = mender_api_perform_authentication(mender_client_ctx->callbacks.get_identity))) {
+        mender_log_error("Unable to refresh authentication token");
+    }
+
+    /* Release access to the network */
+    mender_client_network_release();
+
+END:
+
+    /* Schedule the next refresh, it is retried later if it failed */
+    if (MENDER_OK == ret) {
+        mender_client_schedule_authentication_refresh();
+    } else if (mender_client_ctx->config.authentication_poll_interval > 0) {
+        mender_scheduler_work_set_period(mender_client_ctx->refresh_work_handle, (uint32_t)mender_client_ctx->config.authentication_poll_interval);
+    }
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    return ret;
+}
+
+static void
+mender_client_schedule_authentication_refresh(void) {
+
+    uint32_t validity;
+    uint32_t period = 0;
+
+    /* Compute the delay before the refresh, the token is refreshed at half of its validity if it is shorter than twice the margin */
+    if ((0 != CONFIG_MENDER_CLIENT_AUTHENTICATION_REFRESH_MARGIN) && (MENDER_OK == mender_api_get_authentication_validity(&validity))) {
+        if (validity > 2 * CONFIG_MENDER_CLIENT_AUTHENTICATION_REFRESH_MARGIN) {
+            period = validity - CONFIG_MENDER_CLIENT_AUTHENTICATION_REFRESH_MARGIN;
+        } else {
+            period = (validity > 2) ? (validity / 2) : 1;
+        }
+        mender_log_debug("Authentication token will be refreshed in %u seconds", (unsigned int)period);
+    }
+    if (MENDER_OK != mender_scheduler_work_set_period(mender_client_ctx->refresh_work_handle, period)) {
+        mender_log_error("Unable to set authentication refresh work period");
+    }
+}
+
+static void
+mender_client_authentication_keys_task(void *arg) {
+
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    /* Select the context of the device of the task, the context of the work queue is already selected */
+    if (NULL != arg) {
+        mender_client_select_ctx((mender_client_ctx_t *)arg);
+    }
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Retrieve or generate authentication keys */
+    uint64_t start, end;
+    mender_scheduler_get_uptime(&start);
+    mender_client_ctx->authentication_keys.ret
+        = mender_tls_init_authentication_keys(mender_client_ctx->callbacks.get_user_provided_keys, mender_client_ctx->config.recommissioning);
+    mender_scheduler_get_uptime(&end);
+    if (&mender_client_default_ctx == mender_client_ctx) {
+        mender_client_boot_timing.keys = (uint32_t)(end - start);
+    }
+    mender_client_ctx->authentication_keys.done = true;
+
+    /* Execute the work now to continue the initialization, nothing to do if invoked from the work queue */
+    if (NULL != arg) {
+        mender_scheduler_work_execute(mender_client_ctx->work_handle);
+    }
+}
+
+static void
+mender_client_state_set(mender_client_state_t state) {
+
+    uint64_t now = 0;
+
+    /* Save the uptime when the state is entered before updating it, the time spent in the state is computed from it */
+    mender_scheduler_get_uptime(&now);
+    mender_client_ctx->stats.timestamps[state] = now;
+    mender_client_ctx->state                   = state;
+}
+
+static uint32_t
+mender_client_boot_timing_lap(void) {
+
+    uint64_t now  = 0;
+    uint64_t last = mender_client_boot_timing.last;
+
+    /* Compute the duration since the end of the previous stage */
+    mender_scheduler_get_uptime(&now);
+    mender_client_boot_timing.last = now;
+
+    return (uint32_t)(now - last);
+}
+
+static mender_err_t
+mender_client_authentication_work_function(void) {
+
+    mender_err_t ret;
+
+    /* Perform authentication with the mender server */
+    if (MENDER_OK != (ret = mender_api_perform_authentication(mender_client_ctx->callbacks.get_identity))) {
+
+        /* Invoke authentication error callback */
+        if (NULL != mender_client_ctx->callbacks.authentication_failure) {
+            if (MENDER_OK != mender_client_ctx->callbacks.authentication_failure()) {
+
+                /* Check if deployment is pending */
+                if (NULL != mender_client_ctx->deployment_data) {
+                    /* Authentication error callback inform the reboot should be done, probably something is broken and it prefers to rollback */
+                    mender_log_error("Authentication error callback failed, rebooting");
+                    goto REBOOT;
+                }
+            }
+        }
+
+        return ret;
+    }
+
+    /* Refresh the authentication token before it expires */
+    mender_client_schedule_authentication_refresh();
+
+    /* Invoke authentication success callback */
+    if (NULL != mender_client_ctx->callbacks.authentication_success) {
+        if (MENDER_OK != mender_client_ctx->callbacks.authentication_success()) {
+
+            /* Check if deployment is pending */
+            if (NULL != mender_client_ctx->deployment_data) {
+                /* Authentication success callback inform the reboot should be done, probably something is broken and it prefers to rollback */
+                mender_log_error("Authentication success callback failed, rebooting");
+                goto REBOOT;
+            }
+        }
+    }
+
+    /* Check if deployment is pending */
+    if (NULL != mender_client_ctx->deployment_data) {
+
+        /* Take mutex used to protect access to the artifact types management list */
+        if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->artifact_types_mutex, -1))) {
+            mender_log_error("Unable to take mutex");
+            goto RELEASE;
+        }
+
+        /* Check if artifact running is the pending one */
+        bool success = true;
+        for (size_t index = 0; index < mender_client_ctx->deployment_data->types_count; index++) {
+            const mender_client_artifact_type_t *artifact_type = mender_client_artifact_type_find(mender_client_ctx->deployment_data->types[index], NULL);
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+            if (NULL == artifact_type) {
+                artifact_type = mender_client_artifact_type_find_static(mender_client_ctx->deployment_data->types[index]);
+            }
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+            if (NULL != artifact_type) {
+                if ((NULL != artifact_type->artifact_name) && (strcmp(artifact_type->artifact_name, mender_client_ctx->deployment_data->artifact_name))) {
+                    /* Deployment status failure */
+                    success = false;
+                }
+            }
+        }
+
+        /* Release mutex used to protect access to the artifact types management list */
+        mender_scheduler_mutex_give(mender_client_ctx->artifact_types_mutex);
+
+        /* Publish deployment status */
+        if (true == success) {
+            mender_client_publish_deployment_status(mender_client_ctx->deployment_data->id, MENDER_DEPLOYMENT_STATUS_SUCCESS);
+        } else {
+            mender_client_publish_deployment_status(mender_client_ctx->deployment_data->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+        }
+
+        /* Delete pending deployment */
+        mender_storage_cache_delete_deployment_data();
+    }
+
+RELEASE:
+
+    /* Release memory */
+    mender_client_deployment_data_release(mender_client_ctx->deployment_data);
+    mender_client_ctx->deployment_data = NULL;
+
+    /* Take mutex used to protect access to the add-ons management list */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->addons_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
+    }
+
+    /* Activate add-ons */
+    if (NULL != mender_client_ctx->addons_list) {
+        for (size_t index = 0; index < mender_client_ctx->addons_count; index++) {
+            if (NULL != mender_client_ctx->addons_list[index]->activate) {
+                mender_client_ctx->addons_list[index]->activate();
+            }
+        }
+    }
+
+    /* Release mutex used to protect access to the add-ons management list */
+    mender_scheduler_mutex_give(mender_client_ctx->addons_mutex);
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+
+    /* Activate add-ons registered at compile time */
+    MENDER_CLIENT_STATIC_FOREACH(mender_client_addon, entry) {
+        if (NULL != entry->addon->activate) {
+            entry->addon->activate();
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+
+    return MENDER_DONE;
+
+REBOOT:
+
+    /* Invoke restart callback, application is responsible to shutdown properly and restart the system */
+    if (NULL != mender_client_ctx->callbacks.restart) {
+        mender_client_ctx->callbacks.restart();
+    }
+
+    return ret;
+}
+
+static mender_err_t
+deployment_destroy(mender_api_deployment_data_t *deployment) {
+    if (NULL != deployment) {
+        mender_utils_free(deployment->id);
+        mender_utils_free(deployment->artifact_name);
+        mender_utils_free(deployment->uri);
+        for (size_t i = 0; i < deployment->device_types_compatible_size; ++i) {
+            mender_utils_free(deployment->device_types_compatible[i]);
+        }
+        mender_utils_free(deployment->device_types_compatible);
+        mender_utils_free(deployment);
+    }
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+static mender_err_t
+mender_compare_device_types(const char  *device_type_artifact,
+                            const char  *device_type_device,
+                            const char **device_type_deployment,
+                            const size_t device_type_deployment_size) {
+
+    assert(NULL != device_type_artifact);
+    assert(NULL != device_type_deployment);
+    assert(NULL != device_type_device);
+    assert(0 < device_type_deployment_size);
+
+    if (0 != strcmp(device_type_artifact, device_type_device)) {
+        mender_log_error("Device type from artifact '%s' is not compatible with device '%s'", device_type_artifact, device_type_device);
+        return MENDER_FAIL;
+    }
+
+    /* Return MENDER_OK if one of the devices in the deployment are compatible with the device */
+    for (size_t i = 0; i < device_type_deployment_size; i++) {
+        if (0 == strcmp(device_type_deployment[i], device_type_device)) {
+            return MENDER_OK;
+        }
+    }
+    mender_log_error("None of the device types from the deployment are compatible with device '%s'", device_type_device);
+    return MENDER_FAIL;
+}
+
+#ifdef CONFIG_MENDER_PROVIDES_DEPENDS
+static mender_err_t
+mender_client_check_depends(mender_key_value_list_t *depends, mender_utils_kv_table_t *provides) {
+
+    /* Check each depends, device type is checked separately */
+    for (mender_key_value_list_t *item = depends; NULL != item; item = item->next) {
+        if ((NULL == item->key) || (!strcmp(item->key, "device_type"))) {
+            continue;
+        }
+
+        /* Check if one of the values of the depends is provided, artifact name is provided by the configuration */
+        bool found = false;
+        for (mender_key_value_list_t *value = depends; (NULL != value) && (false == found); value = value->next) {
+            if ((NULL == value->key) || (NULL == value->value) || (strcmp(value->key, item->key))) {
+                continue;
+            }
+            if ((!strcmp(value->key, "artifact_name")) && (!strcmp(value->value, mender_client_ctx->config.artifact_name))) {
+                found = true;
+            }
+            const char *provide = mender_utils_kv_table_get(provides, value->key);
+            if ((NULL != provide) && (!strcmp(provide, value->value))) {
+                found = true;
+            }
+        }
+        if (false == found) {
+            mender_log_error("Artifact depends '%s' is not satisfied by the device", item->key);
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+}
+#endif /* CONFIG_MENDER_PROVIDES_DEPENDS */
+
+static mender_err_t
+mender_client_check_artifact(mender_artifact_ctx_t *ctx, mender_api_deployment_data_t *deployment) {
+
+    assert(NULL != ctx);
+    assert(NULL != deployment);
+    mender_err_t ret;
+
+    /* Retrieve device type from artifact */
+    const char *device_type_artifact = NULL;
+    if (MENDER_OK != (ret = mender_artifact_get_device_type(ctx, &device_type_artifact))) {
+        mender_log_error("Unable to get device type from artifact");
+        return ret;
+    }
+
+    /* Match device type  */
+    if (MENDER_OK
+        != (ret = mender_compare_device_types(device_type_artifact,
+                                              mender_client_ctx->config.device_type,
+                                              (const char **)deployment->device_types_compatible,
+                                              deployment->device_types_compatible_size))) {
+        /* Erorrs are logged by the function */
+        return ret;
+    }
+
+#ifdef CONFIG_MENDER_PROVIDES_DEPENDS
+    /* Load stored provides, the provides of the additional devices are not recorded in the storage and are empty */
+    mender_utils_kv_table_t stored_provides;
+    memset(&stored_provides, 0, sizeof(mender_utils_kv_table_t));
+    if ((&mender_client_default_ctx == mender_client_ctx) && (MENDER_FAIL == mender_storage_get_provides(&stored_provides))) {
+        mender_log_error("Unable to get stored provides");
+        return MENDER_FAIL;
+    }
+
+    /* Check depends of the artifact and of the payloads */
+    if (MENDER_OK == (ret = mender_client_check_depends(ctx->artifact_info.depends, &stored_provides))) {
+        for (size_t i = 0; (MENDER_OK == ret) && (i < ctx->payloads.size); i++) {
+            ret = mender_client_check_depends(ctx->payloads.values[i].depends, &stored_provides);
+        }
+    }
+    mender_utils_kv_table_release(&stored_provides);
+#endif /* CONFIG_MENDER_PROVIDES_DEPENDS */
+
+    return ret;
+}
+#endif
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+#ifdef CONFIG_MENDER_PROVIDES_DEPENDS
+static mender_err_t
+mender_store_provides(mender_artifact_ctx_t *mender_artifact_ctx) {
+
+    assert(NULL != mender_artifact_ctx);
+    mender_err_t ret = MENDER_FAIL;
+
+    /* Write provides to the store */
+    /* Load the currently stored provides, clear the ones matching the clears provides of the payloads and set the new provides */
+
+    /* Load stored provides */
+    mender_utils_kv_table_t provides;
+    memset(&provides, 0, sizeof(mender_utils_kv_table_t));
+    if (MENDER_FAIL == mender_storage_get_provides(&provides)) {
+        mender_log_error("Unable to get stored provides");
+        goto END;
+    }
+
+    /* Clear the stored provides matching the clears provides of the payloads */
+    for (size_t i = 0; i < mender_artifact_ctx->payloads.size; i++) {
+        for (size_t j = 0; j < mender_artifact_ctx->payloads.values[i].clears_provides_size; j++) {
+            mender_utils_kv_table_clear(&provides, mender_artifact_ctx->payloads.values[i].clears_provides[j]);
+        }
+    }
+
+    /* Set the provides from the header-info and from the payloads, they replace the stored values */
+    if (MENDER_OK != mender_utils_kv_table_set_list(&provides, mender_artifact_ctx->artifact_info.provides)) {
+        mender_log_error("Unable to merge provides");
+        goto END;
+    }
+    for (size_t i = 0; i < mender_artifact_ctx->payloads.size; i++) {
+        if (MENDER_OK != mender_utils_kv_table_set_list(&provides, mender_artifact_ctx->payloads.values[i].provides)) {
+            mender_log_error("Unable to merge provides");
+            goto END;
+        }
+    }
+
+    /* Write the combined provides back to the store */
+    if (MENDER_OK != mender_storage_set_provides(&provides)) {
+        mender_log_error("Unable to set provides");
+        goto END;
+    }
+
+    ret = MENDER_OK;
+END:
+    mender_utils_kv_table_release(&provides);
+    return ret;
+}
+#endif /* CONFIG_MENDER_PROVIDES_DEPENDS */
+#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
+
+static mender_err_t
+mender_client_update_work_function(void) {
+
+    mender_err_t ret;
+
+    /* Take deployment mutex, the deployment is checked at the next period if an artifact is being installed from a local source */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_client_ctx->deployment_mutex, 0)) {
+        mender_log_info("Artifact being installed from local source, checking for deployment later");
+        return MENDER_OK;
+    }
+
+    /* Check for deployment and install it */
+    ret = mender_client_update_check();
+
+    /* Release deployment mutex */
+    mender_scheduler_mutex_give(mender_client_ctx->deployment_mutex);
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_update_check(void) {
+
+    mender_err_t ret;
+
+#ifdef CONFIG_MENDER_CLIENT_DEFERRED_INSTALL
+    /* Install the deployment downloaded once the application has committed it, new deployments are not checked meanwhile */
+    mender_artifact_ctx_t *mender_artifact_ctx = __atomic_load_n(&mender_client_ctx->deployment_deferred, __ATOMIC_ACQUIRE);
+    if (NULL != mender_artifact_ctx) {
+        if (false == __atomic_exchange_n(&mender_client_ctx->deployment_committed, false, __ATOMIC_ACQ_REL)) {
+            mender_log_info("Deployment downloaded, waiting for the application to commit it");
+            return MENDER_OK;
+        }
+        __atomic_store_n(&mender_client_ctx->deployment_deferred, NULL, __ATOMIC_RELEASE);
+        mender_log_info("Installing deployment artifact with id '%s'", mender_client_ctx->deployment_data->id);
+        return mender_client_deployment_commit(mender_artifact_ctx);
+    }
+
+#endif /* CONFIG_MENDER_CLIENT_DEFERRED_INSTALL */
+
+    /* Check for deployment */
+    mender_api_deployment_data_t *deployment = mender_utils_calloc(1, sizeof(mender_api_deployment_data_t));
+
+    mender_log_info("Checking for deployment...");
+    if (MENDER_OK != (ret = mender_api_check_for_deployment(deployment))) {
+        mender_log_error("Unable to check for deployment");
+        goto END;
+    }
+
+    /* Check if deployment is available */
+    if ((NULL == deployment->id) || (NULL == deployment->artifact_name) || (NULL == deployment->uri) || (NULL == deployment->device_types_compatible)) {
+        mender_log_info("No deployment available");
+        goto END;
+    }
+
+    /* Check if artifact is already installed (should not occur) */
+    if (!strcmp(deployment->artifact_name, mender_client_ctx->config.artifact_name)) {
+        mender_log_error("Artifact is already installed");
+        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED);
+        goto END;
+    }
+
+    /* Download and install deployment artifact */
+    mender_log_info(
+        "Downloading deployment artifact with id '%s', artifact name '%s' and uri '%s'", deployment->id, deployment->artifact_name, deployment->uri);
+    ret = mender_client_deployment_install(deployment, NULL, NULL);
+
+END:
+
+    /* Release memory */
+    deployment_destroy(deployment);
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_deployment_install(mender_api_deployment_data_t *deployment, mender_err_t (*callback)(void *, size_t *, void *), void *params) {
+
+    assert(NULL != deployment);
+    mender_err_t ret;
+
+    /* Ensure that the context is initialized to NULL before goto END */
+    mender_artifact_ctx_t *mender_artifact_ctx = NULL;
+
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+    /* Reset the heap peaks, the statistics logged at the end of the deployment cover the whole update cycle */
+    mender_utils_heap_reset_peak();
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+
+    /* Reset flags */
+    mender_client_ctx->deployment_needs_set_pending_image = false;
+    mender_client_ctx->deployment_needs_restart           = false;
+    mender_client_flash_targets_reset();
+
+    /* Create deployment data, ID and artifact name are resolved once for all the data blocks of the artifact */
+    if (NULL == (mender_client_ctx->deployment_data = mender_client_deployment_data_create(deployment->id, deployment->artifact_name))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Download deployment artifact, it is read from the local source if it is defined */
+    mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_DOWNLOADING);
+    if (NULL == (mender_artifact_ctx = mender_artifact_create_ctx())) {
+        mender_log_error("Unable to create artifact context");
+        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    mender_artifact_set_verification_key(mender_artifact_ctx, mender_client_ctx->config.artifact_verify_key);
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+    mender_client_ctx->deployment         = deployment;
+    mender_client_ctx->artifact_ctx       = mender_artifact_ctx;
+    mender_client_ctx->deployment_checked = false;
+#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
+    mender_client_download_progress_reset();
+    if (NULL == callback) {
+        ret = mender_api_download_artifact(deployment->uri, mender_client_artifact_mirror(), mender_artifact_ctx, mender_client_download_artifact_callback);
+    } else {
+        ret = mender_client_read_artifact(mender_artifact_ctx, callback, params);
+    }
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+    mender_client_download_progress_drop();
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+    mender_client_flash_pipeline_stop();
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+    mender_client_ctx->deployment   = NULL;
+    mender_client_ctx->artifact_ctx = NULL;
+#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to download artifact");
+        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+        if (true == mender_client_ctx->deployment_needs_set_pending_image) {
+            mender_client_flash_targets_abort();
+        }
+        goto END;
+    }
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+    /* Check the artifact if it has not been done while downloading, this is the case when the artifact has no payload data */
+    if (false == mender_client_ctx->deployment_checked) {
+        if (MENDER_OK != (ret = mender_client_check_artifact(mender_artifact_ctx, deployment))) {
+            /* Errors are logged by the function */
+            mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+            if (mender_client_ctx->deployment_needs_set_pending_image) {
+                mender_client_flash_targets_abort();
+            }
+            goto END;
+        }
+        mender_client_ctx->deployment_checked = true;
+    }
+#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
+#ifdef CONFIG_MENDER_CLIENT_DEFERRED_INSTALL
+
+    /* Keep the deployment downloaded until the application commits it, the artifacts read from a local source are installed immediately */
+    if (NULL == callback) {
+        mender_log_info("Download done, waiting for the application to commit the deployment");
+        __atomic_store_n(&mender_client_ctx->deployment_deferred, mender_artifact_ctx, __ATOMIC_RELEASE);
+        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_PAUSE_BEFORE_INSTALLING);
+        return MENDER_OK;
+    }
+#endif /* CONFIG_MENDER_CLIENT_DEFERRED_INSTALL */
+
+    /* Install the artifact */
+    return mender_client_deployment_commit(mender_artifact_ctx);
+
+END:
+
+    /* Release memory */
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+    bool deployment_processed = (NULL != mender_client_ctx->deployment_data);
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+    mender_client_deployment_data_release(mender_client_ctx->deployment_data);
+    mender_client_ctx->deployment_data = NULL;
+    mender_artifact_release_ctx(mender_artifact_ctx);
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+
+    /* Log the heap statistics of the deployment if it has been processed */
+    if (true == deployment_processed) {
+        mender_utils_heap_dump();
+    }
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_deployment_commit(mender_artifact_ctx_t *mender_artifact_ctx) {
+
+    assert(NULL != mender_client_ctx->deployment_data);
+    mender_err_t          ret = MENDER_OK;
+    char                 *id  = mender_client_ctx->deployment_data->id;
+    mender_utils_record_t storage_deployment_data;
+    mender_utils_record_init(&storage_deployment_data);
+
+    /* Begin a storage transaction, the provides and the deployment data are written at once, they are not recorded for the additional devices */
+    bool storage_record      = (&mender_client_default_ctx == mender_client_ctx);
+    bool storage_transaction = (true == storage_record) && (MENDER_OK == mender_storage_begin());
+
+#if defined(CONFIG_MENDER_FULL_PARSE_ARTIFACT) && defined(CONFIG_MENDER_PROVIDES_DEPENDS)
+    /* Store provides */
+    if ((true == storage_record) && (MENDER_OK != (ret = mender_store_provides(mender_artifact_ctx)))) {
+        mender_log_error("Unable to store provides");
+        mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+        if (mender_client_ctx->deployment_needs_set_pending_image) {
+            mender_client_flash_targets_abort();
+        }
+        goto END;
+    }
+#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT && CONFIG_MENDER_PROVIDES_DEPENDS */
+
+    /* Set boot partition */
+    mender_log_info("Download done, installing artifact");
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+    /* Verify the image written to the flash while the deployment status is published */
+    if (true == mender_client_ctx->deployment_needs_set_pending_image) {
+        mender_client_flash_verify_start();
+    }
+    mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_INSTALLING);
+    if (true == mender_client_ctx->deployment_needs_set_pending_image) {
+        if (MENDER_OK != (ret = mender_client_flash_verify_wait())) {
+            mender_log_error("Image written to the flash is corrupted");
+            mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+            mender_client_flash_targets_abort();
+            goto END;
+        }
+    }
+#else
+    mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_INSTALLING);
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+    if (true == mender_client_ctx->deployment_needs_set_pending_image) {
+        if (MENDER_OK != (ret = mender_client_flash_targets_set_pending())) {
+            mender_log_error("Unable to set boot partition");
+            mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+            goto END;
+        }
+    }
+
+    /* Check if the system must restart following downloading the deployment */
+    if (true == mender_client_ctx->deployment_needs_restart) {
+        /* Save deployment data to publish deployment status after rebooting */
+        if (true == storage_record) {
+            if (MENDER_OK != (ret = mender_client_deployment_data_to_record(&storage_deployment_data))) {
+                mender_log_error("Unable to save deployment data");
+                mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+                goto END;
+            }
+            if (MENDER_OK != (ret = mender_storage_cache_set_deployment_data(storage_deployment_data.data, storage_deployment_data.length))) {
+                mender_log_error("Unable to save deployment data");
+                mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+                goto END;
+            }
+            if (true == storage_transaction) {
+                storage_transaction = false;
+                if (MENDER_OK != (ret = mender_storage_commit())) {
+                    mender_log_error("Unable to save deployment data");
+                    mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+                    goto END;
+                }
+            }
+        }
+        mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_REBOOTING);
+    } else {
+        /* Publish deployment status success */
+        mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_SUCCESS);
+        goto END;
+    }
+
+    /* Release memory */
+    mender_utils_record_release(&storage_deployment_data);
+    mender_client_deployment_data_release(mender_client_ctx->deployment_data);
+    mender_client_ctx->deployment_data = NULL;
+    mender_artifact_release_ctx(mender_artifact_ctx);
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+
+    /* Log the heap statistics of the deployment */
+    mender_utils_heap_dump();
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+
+    /* Check if the system must restart following downloading the deployment */
+    if (true == mender_client_ctx->deployment_needs_restart) {
+        /* Publish the deployment statuses still queued in the outbox, the status work is not executed after the restart */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+        mender_client_status_work_function(mender_client_ctx);
+#else
+        mender_client_status_work_function();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+        /* Invoke restart callback, application is responsible to shutdown properly and restart the system */
+        if (NULL != mender_client_ctx->callbacks.restart) {
+            mender_client_ctx->callbacks.restart();
+        }
+    }
+
+    return MENDER_DONE;
+
+END:
+
+    /* Commit the storage transaction */
+    if ((true == storage_transaction) && (MENDER_OK != mender_storage_commit())) {
+        mender_log_error("Unable to commit storage transaction");
+    }
+
+    /* Release memory */
+    mender_utils_record_release(&storage_deployment_data);
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+    bool deployment_processed = (NULL != mender_client_ctx->deployment_data);
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+    mender_client_deployment_data_release(mender_client_ctx->deployment_data);
+    mender_client_ctx->deployment_data = NULL;
+    mender_artifact_release_ctx(mender_artifact_ctx);
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+
+    /* Log the heap statistics of the deployment if it has been processed */
+    if (true == deployment_processed) {
+        mender_utils_heap_dump();
+    }
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_read_artifact(mender_artifact_ctx_t *ctx, mender_err_t (*callback)(void *, size_t *, void *), void *params) {
+
+    assert(NULL != ctx);
+    assert(NULL != callback);
+    mender_err_t ret = MENDER_OK;
+    void        *data;
+
+    /* Allocate the buffer, the artifact is read by blocks */
+    if (NULL == (data = mender_utils_malloc(CONFIG_MENDER_CLIENT_INSTALL_BUFFER_LENGTH))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    /* Read the artifact until the end of the source and parse it */
+    for (;;) {
+        size_t length = CONFIG_MENDER_CLIENT_INSTALL_BUFFER_LENGTH;
+        if (MENDER_OK != (ret = callback(data, &length, params))) {
+            mender_log_error("Unable to read artifact");
+            break;
+        }
+        if (0 == length) {
+            break;
+        }
+        if (MENDER_OK != (ret = mender_artifact_process_data(ctx, data, length, &mender_client_download_artifact_callback))) {
+            mender_log_error("Unable to process data");
+            break;
+        }
+    }
+
+    /* Release memory */
+    mender_utils_free(data);
+
+    return ret;
+}
+
+static mender_client_artifact_type_t *
+mender_client_artifact_type_find(char *type, size_t *position) {
+
+    assert(NULL != type);
+    size_t first = 0;
+    size_t last  = mender_client_ctx->artifact_types_count;
+
+    /* Binary search of the artifact type in the sorted list */
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        int    cmp    = strcmp(type, mender_client_ctx->artifact_types_list[middle]->type);
+        if (0 == cmp) {
+            if (NULL != position) {
+                *position = middle;
+            }
+            return mender_client_ctx->artifact_types_list[middle];
+        } else if (cmp < 0) {
+            last = middle;
+        } else {
+            first = middle + 1;
+        }
+    }
+    if (NULL != position) {
+        *position = first;
+    }
+
+    return NULL;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+
+static const mender_client_artifact_type_t *
+mender_client_artifact_type_find_static(char *type) {
+
+    assert(NULL != type);
+
+    /* Linear search of the artifact type, only a few artifact types are registered at compile time */
+    MENDER_CLIENT_STATIC_FOREACH(mender_client_artifact_type, artifact_type) {
+        if (!strcmp(type, artifact_type->type)) {
+            return artifact_type;
+        }
+    }
+
+    return NULL;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+
+static mender_err_t
+mender_client_download_artifact_callback(char *type, mender_meta_data_t *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    assert(NULL != type);
+    mender_err_t ret;
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+    /* Check the artifact at the beginning of the first payload data, the header has been parsed and nothing has been written yet */
+    if ((false == mender_client_ctx->deployment_checked) && (NULL == filename) && (NULL != mender_client_ctx->artifact_ctx)) {
+        if (MENDER_OK != (ret = mender_client_check_artifact(mender_client_ctx->artifact_ctx, mender_client_ctx->deployment))) {
+            mender_log_error("Artifact is not compatible, aborting download");
+            return ret;
+        }
+        mender_client_ctx->deployment_checked = true;
+    }
+#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
+
+    /* Resolve the artifact type handling the payload, this is done once per payload and the data blocks are then handled without lock */
+    const mender_client_artifact_type_t *artifact_type = mender_client_ctx->artifact_type_current;
+    if ((NULL == artifact_type) || (strcmp(type, artifact_type->type))) {
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+        artifact_type = mender_client_artifact_type_find_static(type);
+#else
+        artifact_type = NULL;
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+        if (NULL == artifact_type) {
+            if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->artifact_types_mutex, -1))) {
+                mender_log_error("Unable to take mutex");
+                return ret;
+            }
+            artifact_type = mender_client_artifact_type_find(type, NULL);
+            mender_scheduler_mutex_give(mender_client_ctx->artifact_types_mutex);
+        }
+        mender_client_ctx->artifact_type_current = artifact_type;
+        if (NULL == artifact_type) {
+            /* Content is not supported by the mender-mcu-client */
+            mender_log_error("Unable to handle artifact type '%s'", type);
+            return MENDER_FAIL;
+        }
+    }
+
+    /* Invoke artifact type callback */
+    assert(NULL != mender_client_ctx->deployment_data);
+    if (MENDER_OK
+        != (ret = artifact_type->callback(mender_client_ctx->deployment_data->id,
+                                          mender_client_ctx->deployment_data->artifact_name,
+                                          type,
+                                          meta_data,
+                                          filename,
+                                          size,
+                                          data,
+                                          index,
+                                          length))) {
+        mender_log_error("An error occurred while processing data of the artifact '%s'", type);
+        return ret;
+    }
+
+    /* Treatments related to the artifact type (once) */
+    if (0 == index) {
+
+        /* Add type to the deployment data */
+        if (MENDER_OK != (ret = mender_client_deployment_data_add_type(mender_client_ctx->deployment_data, type))) {
+            mender_log_error("Unable to add type to the deployment data");
+            return ret;
+        }
+
+        /* Set flags */
+        if (true == artifact_type->needs_restart) {
+            mender_client_ctx->deployment_needs_restart = true;
+        }
+    }
+
+    /* Update the download progress with the payload data */
+    if (NULL != filename) {
+        mender_client_download_progress_update(size, index, length);
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_client_download_artifact_flash_callback(
+    char *id, char *artifact_name, char *type, mender_meta_data_t *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    (void)id;
+    (void)artifact_name;
+    (void)type;
+    (void)meta_data;
+    mender_err_t ret = MENDER_OK;
+
+    /* Check if the filename is provided */
+    if (NULL != filename) {
+
+        /* Check if the flash handle must be opened */
+        if (0 == index) {
+
+            /* Open the flash handle of a new flash target, the size of the image differs from the size of the payload if it is sparse */
+            mender_client_flash_target_t *target;
+            size_t                        image_size = size;
+#ifdef CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD
+            mender_client_sparse_begin(meta_data, &image_size);
+#endif /* CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD */
+            if (NULL == (target = mender_client_flash_target_add())) {
+                ret = MENDER_FAIL;
+                goto END;
+            }
+            if (MENDER_OK != (ret = mender_flash_open(filename, image_size, &target->handle))) {
+                mender_log_error("Unable to open flash handle");
+                goto END;
+            }
+            mender_client_flash_handle = target->handle;
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+
+            /* Start the flash pipeline */
+            if (MENDER_OK != (ret = mender_client_flash_pipeline_start())) {
+                mender_log_error("Unable to start flash pipeline");
+                goto END;
+            }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+        }
+
+        /* Write data, the sparse payloads are decoded first */
+#ifdef CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD
+        if (true == mender_client_sparse.enabled) {
+            ret = mender_client_sparse_write((uint8_t *)data, length);
+        } else {
+            ret = mender_client_flash_write_image(size, data, index, length);
+        }
+#else
+        ret = mender_client_flash_write_image(size, data, index, length);
+#endif /* CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD */
+        if (MENDER_OK != ret) {
+            mender_log_error("Unable to write data to flash");
+            goto END;
+        }
+
+        /* Check if the flash handle must be closed */
+        if (index + length >= size) {
+#ifdef CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD
+
+            /* The sparse payload must cover the whole image */
+            if ((true == mender_client_sparse.enabled)
+                && ((mender_client_sparse.offset != mender_client_sparse.size) || (0 != mender_client_sparse.header_length)
+                    || (0 != mender_client_sparse.remaining))) {
+                mender_log_error("Sparse payload does not match the size of the image");
+                ret = MENDER_FAIL;
+                goto END;
+            }
+#endif /* CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+
+            /* Wait all the data are written and stop the flash pipeline */
+            ret = mender_client_flash_pipeline_flush();
+            mender_client_flash_pipeline_stop();
+            if (MENDER_OK != ret) {
+                mender_log_error("Unable to write data to flash");
+                goto END;
+            }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+            /* Close the flash handle */
+            mender_log_trace_begin(MENDER_LOG_TRACE_FLASH_CLOSE);
+            ret = mender_flash_close(mender_client_flash_handle);
+            mender_log_trace_end(MENDER_LOG_TRACE_FLASH_CLOSE);
+            if (MENDER_OK != ret) {
+                mender_log_error("Unable to close flash handle");
+                goto END;
+            }
+        }
+    }
+
+    /* Set flags */
+    mender_client_ctx->deployment_needs_set_pending_image = true;
+
+END:
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_flash_write_image(size_t size, void *data, size_t index, size_t length) {
+
+    mender_err_t ret;
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+    /* Hash data */
+    mender_client_flash_verify_update(size, data, index, length);
+#else
+    (void)size;
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+
+    /* Write data, the data are written to the flash by the flash pipeline task if it is enabled */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+    ret = mender_client_flash_pipeline_write(data, index, length);
+#else
+    mender_log_trace_begin(MENDER_LOG_TRACE_FLASH_WRITE);
+    ret = mender_flash_write(mender_client_flash_handle, data, index, length);
+    mender_log_trace_end(MENDER_LOG_TRACE_FLASH_WRITE);
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD
+
+static void
+mender_client_sparse_begin(mender_meta_data_t *meta_data, size_t *size) {
+
+    assert(NULL != size);
+
+    /* Reset the decoder, the payload is sparse if the size of the image is defined */
+    memset(&mender_client_sparse, 0, sizeof(mender_client_sparse_t));
+    double value = -1;
+#ifdef CONFIG_MENDER_TINY
+    mender_json_token_t *tokens = NULL;
+    mender_json_token_t *json_size;
+    size_t               count;
+    if ((NULL != meta_data) && (MENDER_OK == mender_json_tokenize(meta_data->data, meta_data->length, NULL, 0, &count))
+        && (NULL != (tokens = (mender_json_token_t *)mender_utils_malloc(count * sizeof(mender_json_token_t))))
+        && (MENDER_OK == mender_json_tokenize(meta_data->data, meta_data->length, tokens, count, &count))
+        && (NULL != (json_size = mender_json_token_get(meta_data->data, tokens, MENDER_CLIENT_SPARSE_META_DATA_KEY)))) {
+        mender_json_token_number(meta_data->data, json_size, &value);
+    }
+    mender_utils_free(tokens);
+#else
+    cJSON *json_size = cJSON_GetObjectItemCaseSensitive(meta_data, MENDER_CLIENT_SPARSE_META_DATA_KEY);
+    if (true == cJSON_IsNumber(json_size)) {
+        value = cJSON_GetNumberValue(json_size);
+    }
+#endif /* CONFIG_MENDER_TINY */
+    if (value >= 0) {
+        mender_client_sparse.enabled = true;
+        mender_client_sparse.size    = (size_t)value;
+        mender_log_info("Payload is sparse, size of the image is %zu bytes", mender_client_sparse.size);
+        memset(mender_client_sparse_block, MENDER_CLIENT_SPARSE_ERASED_VALUE, sizeof(mender_client_sparse_block));
+        *size = mender_client_sparse.size;
+    }
+}
+
+static mender_err_t
+mender_client_sparse_write(uint8_t *data, size_t length) {
+
+    assert(NULL != data);
+    mender_err_t ret;
+
+    while (length > 0) {
+
+        /* Write the data of the current chunk */
+        if (mender_client_sparse.remaining > 0) {
+            size_t count = (length < mender_client_sparse.remaining) ? length : mender_client_sparse.remaining;
+            if (MENDER_OK != (ret = mender_client_flash_write_image(mender_client_sparse.size, data, mender_client_sparse.offset, count))) {
+                return ret;
+            }
+            mender_client_sparse.offset += count;
+            mender_client_sparse.remaining -= count;
+            data += count;
+            length -= count;
+            continue;
+        }
+
+        /* Receive the header of the next chunk, it may be split between two data blocks */
+        size_t count = MENDER_CLIENT_SPARSE_HEADER_LENGTH - mender_client_sparse.header_length;
+        count        = (length < count) ? length : count;
+        memcpy(&mender_client_sparse.header[mender_client_sparse.header_length], data, count);
+        mender_client_sparse.header_length += count;
+        data += count;
+        length -= count;
+        if (mender_client_sparse.header_length < MENDER_CLIENT_SPARSE_HEADER_LENGTH) {
+            break;
+        }
+        mender_client_sparse.header_length = 0;
+
+        /* Decode the header, the chunk must be contained in the image */
+        uint32_t header = (uint32_t)mender_client_sparse.header[0] | ((uint32_t)mender_client_sparse.header[1] << 8)
+                          | ((uint32_t)mender_client_sparse.header[2] << 16) | ((uint32_t)mender_client_sparse.header[3] << 24);
+        size_t chunk_length = (size_t)(header & ~MENDER_CLIENT_SPARSE_ERASED_FLAG);
+        if (chunk_length > mender_client_sparse.size - mender_client_sparse.offset) {
+            mender_log_error("Sparse payload exceeds the size of the image");
+            return MENDER_FAIL;
+        }
+
+        /* Write the runs of erased bytes immediately, their data are omitted */
+        if (0 != (header & MENDER_CLIENT_SPARSE_ERASED_FLAG)) {
+            if (MENDER_OK != (ret = mender_client_sparse_erased(mender_client_sparse.offset, chunk_length))) {
+                return ret;
+            }
+            mender_client_sparse.offset += chunk_length;
+        } else {
+            mender_client_sparse.remaining = chunk_length;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_client_sparse_erased(size_t index, size_t length) {
+
+    mender_err_t ret;
+    size_t       count;
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+    /* Hash the erased bytes, the image read back contains them */
+    for (size_t offset = 0; offset < length; offset += count) {
+        count = ((length - offset) < sizeof(mender_client_sparse_block)) ? (length - offset) : sizeof(mender_client_sparse_block);
+        mender_client_flash_verify_update(mender_client_sparse.size, mender_client_sparse_block, index + offset, count);
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+
+    /* Wait all the previous data are written, the run is handled in order with them */
+    if (MENDER_OK != (ret = mender_client_flash_pipeline_flush())) {
+        return ret;
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+    /* Skip the run if the flash target is already erased, the erased bytes are programmed otherwise */
+    mender_log_trace_begin(MENDER_LOG_TRACE_FLASH_WRITE);
+    if (MENDER_NOT_IMPLEMENTED == (ret = mender_flash_write_erased(mender_client_flash_handle, index, length))) {
+        ret = MENDER_OK;
+        for (size_t offset = 0; (MENDER_OK == ret) && (offset < length); offset += count) {
+            count = ((length - offset) < sizeof(mender_client_sparse_block)) ? (length - offset) : sizeof(mender_client_sparse_block);
+            ret   = mender_flash_write(mender_client_flash_handle, mender_client_sparse_block, index + offset, count);
+        }
+    }
+    mender_log_trace_end(MENDER_LOG_TRACE_FLASH_WRITE);
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_SPARSE_PAYLOAD */
+
+static mender_client_flash_target_t *
+mender_client_flash_target_add(void) {
+
+    /* Check if a flash target is available */
+    if (mender_client_flash_targets_count >= CONFIG_MENDER_CLIENT_FLASH_TARGETS) {
+        mender_log_error("Too many payload files written to the flash, at most %d are supported", CONFIG_MENDER_CLIENT_FLASH_TARGETS);
+        return NULL;
+    }
+
+    /* Add the flash target */
+    mender_client_flash_target_t *target = &mender_client_flash_targets[mender_client_flash_targets_count++];
+    memset(target, 0, sizeof(mender_client_flash_target_t));
+
+    return target;
+}
+
+static mender_err_t
+mender_client_flash_targets_set_pending(void) {
+
+    mender_err_t ret = MENDER_OK;
+
+    /* Set pending the images of the flash targets, the handles are released by the flash platform */
+    for (size_t index = 0; index < mender_client_flash_targets_count; index++) {
+        if (MENDER_OK == ret) {
+            mender_log_trace_begin(MENDER_LOG_TRACE_FLASH_SET_PENDING);
+            ret = mender_flash_set_pending_image(mender_client_flash_targets[index].handle);
+            mender_log_trace_end(MENDER_LOG_TRACE_FLASH_SET_PENDING);
+        } else {
+            mender_flash_abort_deployment(mender_client_flash_targets[index].handle);
+        }
+        mender_client_flash_targets[index].handle = NULL;
+    }
+    mender_client_flash_targets_reset();
+
+    return ret;
+}
+
+static void
+mender_client_flash_targets_abort(void) {
+
+    /* Abort the deployment of the flash targets */
+    for (size_t index = 0; index < mender_client_flash_targets_count; index++) {
+        mender_flash_abort_deployment(mender_client_flash_targets[index].handle);
+        mender_client_flash_targets[index].handle = NULL;
+    }
+    mender_client_flash_targets_reset();
+}
+
+static void
+mender_client_flash_targets_reset(void) {
+
+    /* Release memory */
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+    for (size_t index = 0; index < mender_client_flash_targets_count; index++) {
+        if (NULL != mender_client_flash_targets[index].sha256) {
+            mender_tls_sha256_end(mender_client_flash_targets[index].sha256, NULL);
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
+    memset(mender_client_flash_targets, 0, sizeof(mender_client_flash_targets));
+    mender_client_flash_targets_count = 0;
+    mender_client_flash_handle        = NULL;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+static mender_err_t
+mender_client_flash_pipeline_start(void) {
+
+    /* Allocate the buffers */
+    memset(&mender_client_flash_pipeline, 0, sizeof(mender_client_flash_pipeline));
+    mender_client_flash_pipeline.ret = MENDER_OK;
+    mender_client_flash_pipeline.buffers
+        = (uint8_t *)mender_utils_malloc(CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS * CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE);
+    if (NULL == mender_client_flash_pipeline.buffers) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+
+    /* Create the queues, all the buffers are available */
+    if (MENDER_OK != mender_scheduler_queue_create(CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS, sizeof(uint8_t *), &mender_client_flash_pipeline.free_queue)) {
+        mender_log_error("Unable to create flash pipeline queue");
+        goto FAIL;
+    }
+    if (MENDER_OK
+        != mender_scheduler_queue_create(
+            CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS + 1, sizeof(mender_client_flash_pipeline_chunk_t), &mender_client_flash_pipeline.write_queue)) {
+        mender_log_error("Unable to create flash pipeline queue");
+        goto FAIL;
+    }
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS; index++) {
+        uint8_t *buffer = &mender_client_flash_pipeline.buffers[index * CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE];
+        if (MENDER_OK != mender_scheduler_queue_send(mender_client_flash_pipeline.free_queue, &buffer, 0)) {
+            mender_log_error("Unable to initialize flash pipeline queue");
+            goto FAIL;
+        }
+    }
+
+    /* Create the writer task */
+    mender_scheduler_task_params_t task_params = { .function = mender_client_flash_pipeline_task, .arg = NULL, .name = "mender_client_flash" };
+    if (MENDER_OK != mender_scheduler_task_create(&task_params, &mender_client_flash_pipeline.task)) {
+        mender_log_error("Unable to create flash pipeline task");
+        goto FAIL;
+    }
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    mender_client_flash_pipeline_stop();
+
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_client_flash_pipeline_write(void *data, size_t index, size_t length) {
+
+    mender_client_flash_pipeline_chunk_t *current = &mender_client_flash_pipeline.current;
+
+    while (length > 0) {
+
+        /* Check if an error occurred while writing the previous chunks */
+        if (MENDER_OK != mender_client_flash_pipeline.ret) {
+            return mender_client_flash_pipeline.ret;
+        }
+
+        /* Wait for an available buffer, the download is paused only if all the buffers are being written */
+        if (NULL == current->data) {
+            if (MENDER_OK != mender_scheduler_queue_receive(mender_client_flash_pipeline.free_queue, &current->data, -1)) {
+                mender_log_error("Unable to get flash pipeline buffer");
+                current->data = NULL;
+                return MENDER_FAIL;
+            }
+            current->index  = index;
+            current->length = 0;
+        }
+
+        /* Copy data to the buffer */
+        size_t count = CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE - current->length;
+        count        = (length < count) ? length : count;
+        memcpy(&current->data[current->length], data, count);
+        current->length += count;
+        data = (uint8_t *)data + count;
+        index += count;
+        length -= count;
+
+        /* Give the buffer to the writer task when it is full */
+        if (CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFER_SIZE == current->length) {
+            if (MENDER_OK != mender_scheduler_queue_send(mender_client_flash_pipeline.write_queue, current, -1)) {
+                mender_log_error("Unable to give flash pipeline buffer");
+                return MENDER_FAIL;
+            }
+            current->data = NULL;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_client_flash_pipeline_flush(void) {
+
+    mender_client_flash_pipeline_chunk_t *current = &mender_client_flash_pipeline.current;
+    uint8_t                              *buffers[CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS];
+
+    /* Give the buffer currently filled to the writer task */
+    if (NULL != current->data) {
+        if (MENDER_OK != mender_scheduler_queue_send(mender_client_flash_pipeline.write_queue, current, -1)) {
+            mender_log_error("Unable to give flash pipeline buffer");
+            return MENDER_FAIL;
+        }
+        current->data = NULL;
+    }
+
+    /* Wait all the buffers are available, the writer task has written all the data */
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS; index++) {
+        if (MENDER_OK != mender_scheduler_queue_receive(mender_client_flash_pipeline.free_queue, &buffers[index], -1)) {
+            mender_log_error("Unable to get flash pipeline buffer");
+            return MENDER_FAIL;
+        }
+    }
+    for (size_t index = 0; index < CONFIG_MENDER_CLIENT_FLASH_PIPELINE_BUFFERS; index++) {
+        mender_scheduler_queue_send(mender_client_flash_pipeline.free_queue, &buffers[index], 0);
+    }
 
-    return ret;
+    return mender_client_flash_pipeline.ret;
 }
 
-mender_err_t
-mender_client_exit(void) {
-
-    mender_err_t ret;
+static void
+mender_client_flash_pipeline_stop(void) {
 
-    /* Take mutex used to protect access to the add-ons management list */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_addons_mutex, -1))) {
-        mender_log_error("Unable to take mutex");
-        return ret;
+    /* Ask the writer task to terminate and wait the end of its execution */
+    if (NULL != mender_client_flash_pipeline.task) {
+        mender_client_flash_pipeline_chunk_t chunk = { .data = NULL, .index = 0, .length = 0 };
+        mender_scheduler_queue_send(mender_client_flash_pipeline.write_queue, &chunk, -1);
+        mender_scheduler_task_join(mender_client_flash_pipeline.task);
     }
 
-    /* Release add-ons */
-    if (NULL != mender_client_addons_list) {
-        for (size_t index = 0; index < mender_client_addons_count; index++) {
-            if (NULL != mender_client_addons_list[index]->exit) {
-                mender_client_addons_list[index]->exit();
-            }
-        }
+    /* Release memory */
+    if (NULL != mender_client_flash_pipeline.write_queue) {
+        mender_scheduler_queue_delete(mender_client_flash_pipeline.write_queue);
+    }
+    if (NULL != mender_client_flash_pipeline.free_queue) {
+        mender_scheduler_queue_delete(mender_client_flash_pipeline.free_queue);
     }
+    mender_utils_free(mender_client_flash_pipeline.buffers);
+    memset(&mender_client_flash_pipeline, 0, sizeof(mender_client_flash_pipeline));
+}
 
-    /* Release mutex used to protect access to the add-ons management list */
-    mender_scheduler_mutex_give(mender_client_addons_mutex);
+static void
+mender_client_flash_pipeline_task(void *arg) {
 
-    /* Delete mender client work */
-    mender_scheduler_work_delete(mender_client_work_handle);
-    mender_client_work_handle = NULL;
+    (void)arg;
+    mender_client_flash_pipeline_chunk_t chunk;
 
-    /* Release all modules */
-    mender_api_exit();
-    mender_tls_exit();
-    mender_storage_exit();
-    mender_log_exit();
-    mender_scheduler_exit();
+    /* Write the chunks until the pipeline is stopped */
+    while (MENDER_OK == mender_scheduler_queue_receive(mender_client_flash_pipeline.write_queue, &chunk, -1)) {
 
-    /* Release memory */
-    mender_client_config.artifact_name                = NULL;
-    mender_client_config.device_type                  = NULL;
-    mender_client_config.host                         = NULL;
-    mender_client_config.tenant_token                 = NULL;
-    mender_client_config.authentication_poll_interval = 0;
-    mender_client_config.update_poll_interval         = 0;
-    mender_client_network_count                       = 0;
-    mender_scheduler_mutex_give(mender_client_network_mutex);
-    mender_scheduler_mutex_delete(mender_client_network_mutex);
-    mender_client_network_mutex = NULL;
-    if (NULL != mender_client_deployment_data) {
-        cJSON_Delete(mender_client_deployment_data);
-        mender_client_deployment_data = NULL;
-    }
-    if (NULL != mender_client_artifact_types_list) {
-        for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
-            free(mender_client_artifact_types_list[artifact_type_index]);
-        }
-        free(mender_client_artifact_types_list);
-        mender_client_artifact_types_list = NULL;
-    }
-    mender_client_artifact_types_count = 0;
-    mender_scheduler_mutex_give(mender_client_artifact_types_mutex);
-    mender_scheduler_mutex_delete(mender_client_artifact_types_mutex);
-    mender_client_artifact_types_mutex = NULL;
-    if (NULL != mender_client_addons_list) {
-        free(mender_client_addons_list);
-        mender_client_addons_list = NULL;
-    }
-    mender_client_addons_count = 0;
-    mender_scheduler_mutex_give(mender_client_addons_mutex);
-    mender_scheduler_mutex_delete(mender_client_addons_mutex);
-    mender_client_addons_mutex = NULL;
+        /* Check if the writer task must terminate */
+        if (NULL == chunk.data) {
+            break;
+        }
 
-    return ret;
+        /* Write data, the chunks are dropped after an error */
+        if (MENDER_OK == mender_client_flash_pipeline.ret) {
+            mender_log_trace_begin(MENDER_LOG_TRACE_FLASH_WRITE);
+            mender_client_flash_pipeline.ret = mender_flash_write(mender_client_flash_handle, chunk.data, chunk.index, chunk.length);
+            mender_log_trace_end(MENDER_LOG_TRACE_FLASH_WRITE);
+            if (MENDER_OK != mender_client_flash_pipeline.ret) {
+                mender_log_error("Unable to write data to flash");
+            }
+        }
+
+        /* Release the buffer */
+        mender_scheduler_queue_send(mender_client_flash_pipeline.free_queue, &chunk.data, -1);
+    }
 }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
 
-static mender_err_t
-mender_client_work_function(void) {
+#ifdef CONFIG_MENDER_CLIENT_FLASH_VERIFY
+static void
+mender_client_flash_verify_update(size_t size, void *data, size_t index, size_t length) {
 
-    mender_err_t ret = MENDER_OK;
+    assert(mender_client_flash_targets_count > 0);
+    mender_client_flash_target_t *target = &mender_client_flash_targets[mender_client_flash_targets_count - 1];
 
-    /* Work depending of the client state */
-    if (MENDER_CLIENT_STATE_INITIALIZATION == mender_client_state) {
-        /* Perform initialization of the client */
-        if (MENDER_DONE != (ret = mender_client_initialization_work_function())) {
-            goto END;
+    /* Begin computation of the digest with the first data of the image */
+    if (0 == index) {
+        if (MENDER_OK != mender_tls_sha256_begin(&target->sha256)) {
+            mender_log_warning("Unable to compute digest of the image, it will not be verified");
+            target->sha256 = NULL;
+            return;
         }
-        /* Update client state */
-        mender_client_state = MENDER_CLIENT_STATE_AUTHENTICATION;
+        target->size = size;
     }
-    /* Request access to the network */
-    if (MENDER_OK != (ret = mender_client_network_connect())) {
-        goto END;
+    if (NULL == target->sha256) {
+        return;
     }
-    /* Intentional pass-through */
-    if (MENDER_CLIENT_STATE_AUTHENTICATION == mender_client_state) {
-        /* Perform authentication with the server */
-        if (MENDER_DONE != (ret = mender_client_authentication_work_function())) {
-            goto RELEASE;
-        }
-        /* Update work period */
-        if (MENDER_OK != (ret = mender_scheduler_work_set_period(mender_client_work_handle, mender_client_config.update_poll_interval))) {
-            mender_log_error("Unable to set work period");
-            goto RELEASE;
-        }
-        /* Update client state */
-        mender_client_state = MENDER_CLIENT_STATE_AUTHENTICATED;
+
+    /* Hash the data, they must be contiguous */
+    if ((index != target->length) || (MENDER_OK != mender_tls_sha256_update(target->sha256, data, length))) {
+        mender_log_warning("Unable to compute digest of the image, it will not be verified");
+        mender_tls_sha256_end(target->sha256, NULL);
+        target->sha256 = NULL;
+        return;
     }
-    /* Intentional pass-through */
-    if (MENDER_CLIENT_STATE_AUTHENTICATED == mender_client_state) {
-        /* Perform updates */
-        ret = mender_client_update_work_function();
+    target->length += length;
+
+    /* End computation of the digest with the last data of the image */
+    if (target->length >= target->size) {
+        void *sha256   = target->sha256;
+        target->sha256 = NULL;
+        if (MENDER_OK != mender_tls_sha256_end(sha256, target->digest)) {
+            mender_log_warning("Unable to compute digest of the image, it will not be verified");
+            return;
+        }
+        target->completed = true;
     }
+}
 
-RELEASE:
-
-    /* Release access to the network */
-    mender_client_network_release();
-
-END:
+static void
+mender_client_flash_verify_start(void) {
 
-    return ret;
+    /* Create the verification task, the images are verified by the caller if it is not possible */
+    mender_client_flash_verify.ret             = MENDER_OK;
+    mender_scheduler_task_params_t task_params = { .function = mender_client_flash_verify_task, .arg = NULL, .name = "mender_client_verify" };
+    if (MENDER_OK != mender_scheduler_task_create(&task_params, &mender_client_flash_verify.task)) {
+        mender_client_flash_verify.task = NULL;
+    }
 }
 
 static mender_err_t
-mender_client_initialization_work_function(void) {
+mender_client_flash_verify_wait(void) {
+
+    /* Wait the end of the verification task, or verify the images */
+    if (NULL != mender_client_flash_verify.task) {
+        mender_scheduler_task_join(mender_client_flash_verify.task);
+        mender_client_flash_verify.task = NULL;
+    } else {
+        mender_client_flash_verify_task(NULL);
+    }
 
-    assert(NULL != mender_client_callbacks.get_user_provided_keys);
+    return mender_client_flash_verify.ret;
+}
 
-    char        *storage_deployment_data = NULL;
+static mender_err_t
+mender_client_flash_verify_image(mender_client_flash_target_t *target) {
+
+    assert(NULL != target);
+    uint8_t     *buffer = NULL;
+    void        *sha256 = NULL;
+    uint8_t      digest[MENDER_TLS_SHA256_DIGEST_LENGTH];
+    uint64_t     begin = 0;
+    uint64_t     end   = 0;
+    size_t       index;
     mender_err_t ret;
 
-    /* Retrieve or generate authentication keys */
-    if (MENDER_OK != (ret = mender_tls_init_authentication_keys(mender_client_callbacks.get_user_provided_keys, mender_client_config.recommissioning))) {
-        mender_log_error("Unable to retrieve or generate authentication keys");
+    /* Allocate the buffer */
+    if (NULL == (buffer = (uint8_t *)mender_utils_malloc(CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (MENDER_OK != (ret = mender_tls_sha256_begin(&sha256))) {
+        mender_log_error("Unable to compute digest of the image");
         goto END;
     }
 
-    /* Retrieve deployment data if it is found (following an update) */
-    if (MENDER_OK != (ret = mender_storage_get_deployment_data(&storage_deployment_data))) {
-        if (MENDER_NOT_FOUND != ret) {
-            mender_log_error("Unable to get deployment data");
-            goto REBOOT;
+    /* Read back the image and hash it */
+    mender_scheduler_get_uptime(&begin);
+    for (index = 0; index < target->size; index += CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE) {
+        size_t length = target->size - index;
+        if (length > CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE) {
+            length = CONFIG_MENDER_CLIENT_FLASH_VERIFY_BUFFER_SIZE;
         }
-    }
-    if (NULL != storage_deployment_data) {
-        if (NULL == (mender_client_deployment_data = cJSON_Parse(storage_deployment_data))) {
-            mender_log_error("Unable to parse deployment data");
-            free(storage_deployment_data);
-            ret = MENDER_FAIL;
-            goto REBOOT;
+        if (MENDER_OK != (ret = mender_flash_read(target->handle, buffer, index, length))) {
+            if (MENDER_NOT_IMPLEMENTED == ret) {
+                mender_log_warning("Unable to read back the image, it is not verified");
+                ret = MENDER_OK;
+            } else {
+                mender_log_error("Unable to read back the image");
+            }
+            goto END;
+        }
+        if (MENDER_OK != (ret = mender_tls_sha256_update(sha256, buffer, length))) {
+            mender_log_error("Unable to compute digest of the image");
+            goto END;
         }
-        free(storage_deployment_data);
     }
+    ret    = mender_tls_sha256_end(sha256, digest);
+    sha256 = NULL;
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to compute digest of the image");
+        goto END;
+    }
+    mender_scheduler_get_uptime(&end);
 
-    return MENDER_DONE;
+    /* Compare the digests */
+    if (0 != memcmp(digest, target->digest, MENDER_TLS_SHA256_DIGEST_LENGTH)) {
+        mender_log_error("Digest of the image read back does not match the digest of the image downloaded");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    mender_log_info("Image verified, %zu bytes read back in %u ms (%u kB/s)",
+                    target->size,
+                    (uint32_t)(end - begin),
+                    (uint32_t)((end > begin) ? (target->size / (end - begin)) : 0));
 
 END:
 
+    /* Release memory */
+    if (NULL != sha256) {
+        mender_tls_sha256_end(sha256, NULL);
+    }
+    mender_utils_free(buffer);
+
     return ret;
+}
 
-REBOOT:
+static void
+mender_client_flash_verify_task(void *arg) {
 
-    /* Delete pending deployment */
-    mender_storage_delete_deployment_data();
+    (void)arg;
 
-    /* Invoke restart callback, application is responsible to shutdown properly and restart the system */
-    if (NULL != mender_client_callbacks.restart) {
-        mender_client_callbacks.restart();
+    /* Verify the images of the flash targets, until an image is corrupted */
+    for (size_t index = 0; index < mender_client_flash_targets_count; index++) {
+        if ((true == mender_client_flash_targets[index].completed)
+            && (MENDER_OK != (mender_client_flash_verify.ret = mender_client_flash_verify_image(&mender_client_flash_targets[index])))) {
+            break;
+        }
     }
-
-    return ret;
 }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_VERIFY */
 
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
 static mender_err_t
-mender_client_authentication_work_function(void) {
+mender_client_download_artifact_delta_callback(
+    char *id, char *artifact_name, char *type, mender_meta_data_t *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
 
-    mender_err_t ret;
+    (void)id;
+    (void)artifact_name;
+    (void)type;
+    (void)meta_data;
+    mender_err_t ret = MENDER_OK;
 
-    /* Perform authentication with the mender server */
-    if (MENDER_OK != (ret = mender_api_perform_authentication(mender_client_callbacks.get_identity))) {
+    /* Check if the filename is provided */
+    if (NULL != filename) {
 
-        /* Invoke authentication error callback */
-        if (NULL != mender_client_callbacks.authentication_failure) {
-            if (MENDER_OK != mender_client_callbacks.authentication_failure()) {
+        /* Check if the delta handle must be opened, the flash handle is opened once the header of the patch is parsed */
+        if (0 == index) {
 
-                /* Check if deployment is pending */
-                if (NULL != mender_client_deployment_data) {
-                    /* Authentication error callback inform the reboot should be done, probably something is broken and it prefers to rollback */
-                    mender_log_error("Authentication error callback failed, rebooting");
-                    goto REBOOT;
-                }
+            /* Open the delta handle */
+            mender_delta_abort(mender_client_delta_handle);
+            mender_client_delta_handle = NULL;
+            mender_client_flash_target_t *target;
+            if (NULL == (target = mender_client_flash_target_add())) {
+                ret = MENDER_FAIL;
+                goto END;
+            }
+            if (MENDER_OK != (ret = mender_delta_open(filename, &target->handle, &mender_client_delta_handle))) {
+                mender_log_error("Unable to open delta handle");
+                goto END;
             }
         }
 
-        return ret;
-    }
+        /* Apply patch */
+        if (MENDER_OK != (ret = mender_delta_write(mender_client_delta_handle, data, length))) {
+            mender_log_error("Unable to apply patch");
+            goto END;
+        }
 
-    /* Invoke authentication success callback */
-    if (NULL != mender_client_callbacks.authentication_success) {
-        if (MENDER_OK != mender_client_callbacks.authentication_success()) {
+        /* Check if the delta handle must be closed */
+        if (index + length >= size) {
 
-            /* Check if deployment is pending */
-            if (NULL != mender_client_deployment_data) {
-                /* Authentication success callback inform the reboot should be done, probably something is broken and it prefers to rollback */
-                mender_log_error("Authentication success callback failed, rebooting");
-                goto REBOOT;
+            /* Close the delta handle, this also closes the flash handle */
+            ret                        = mender_delta_close(mender_client_delta_handle);
+            mender_client_delta_handle = NULL;
+            if (MENDER_OK != ret) {
+                mender_log_error("Unable to close delta handle");
+                goto END;
             }
         }
     }
 
-    /* Check if deployment is pending */
-    if (NULL != mender_client_deployment_data) {
+    /* Set flags */
+    mender_client_ctx->deployment_needs_set_pending_image = true;
 
-        /* Retrieve deployment data */
-        cJSON *json_id = NULL;
-        if (NULL == (json_id = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "id"))) {
-            mender_log_error("Unable to get ID from the deployment data");
-            goto RELEASE;
-        }
-        char *id;
-        if (NULL == (id = cJSON_GetStringValue(json_id))) {
-            mender_log_error("Unable to get ID from the deployment data");
-            goto RELEASE;
-        }
-        cJSON *json_artifact_name = NULL;
-        if (NULL == (json_artifact_name = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "artifact_name"))) {
-            mender_log_error("Unable to get artifact name from the deployment data");
-            goto RELEASE;
-        }
-        char *artifact_name;
-        if (NULL == (artifact_name = cJSON_GetStringValue(json_artifact_name))) {
-            mender_log_error("Unable to get artifact name from the deployment data");
-            goto RELEASE;
-        }
-        cJSON *json_types = NULL;
-        if (NULL == (json_types = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "types"))) {
-            mender_log_error("Unable to get types from the deployment data");
-            goto RELEASE;
-        }
+END:
 
-        /* Take mutex used to protect access to the artifact types management list */
-        if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_artifact_types_mutex, -1))) {
-            mender_log_error("Unable to take mutex");
-            goto RELEASE;
-        }
+    /* Release memory, the flash handle is aborted by the update work */
+    if ((MENDER_OK != ret) && (NULL != mender_client_delta_handle)) {
+        mender_delta_abort(mender_client_delta_handle);
+        mender_client_delta_handle = NULL;
+    }
 
-        /* Check if artifact running is the pending one */
-        bool   success   = true;
-        cJSON *json_type = NULL;
-        cJSON_ArrayForEach(json_type, json_types) {
-            if (NULL != mender_client_artifact_types_list) {
-                for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
-                    if (!strcmp(mender_client_artifact_types_list[artifact_type_index]->type, cJSON_GetStringValue(json_type))) {
-                        if (NULL != mender_client_artifact_types_list[artifact_type_index]->artifact_name) {
-                            if (strcmp(mender_client_artifact_types_list[artifact_type_index]->artifact_name, artifact_name)) {
-                                /* Deployment status failure */
-                                success = false;
-                            }
-                        }
-                    }
-                }
-            }
-        }
+    return ret;
+}
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
 
-        /* Release mutex used to protect access to the artifact types management list */
-        mender_scheduler_mutex_give(mender_client_artifact_types_mutex);
+static mender_client_deployment_data_t *
+mender_client_deployment_data_create(const char *id, const char *artifact_name) {
 
-        /* Publish deployment status */
-        if (true == success) {
-            mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_SUCCESS);
-        } else {
-            mender_client_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_FAILURE);
-        }
+    assert(NULL != id);
+    assert(NULL != artifact_name);
 
-        /* Delete pending deployment */
-        mender_storage_delete_deployment_data();
+    /* Create deployment data */
+    mender_client_deployment_data_t *deployment_data = (mender_client_deployment_data_t *)mender_utils_calloc(1, sizeof(mender_client_deployment_data_t));
+    if (NULL == deployment_data) {
+        return NULL;
+    }
+    if ((NULL == (deployment_data->id = mender_utils_strdup(id))) || (NULL == (deployment_data->artifact_name = mender_utils_strdup(artifact_name)))) {
+        mender_client_deployment_data_release(deployment_data);
+        return NULL;
     }
 
-RELEASE:
+    return deployment_data;
+}
 
-    /* Release memory */
-    if (NULL != mender_client_deployment_data) {
-        cJSON_Delete(mender_client_deployment_data);
-        mender_client_deployment_data = NULL;
-    }
+static mender_err_t
+mender_client_deployment_data_add_type(mender_client_deployment_data_t *deployment_data, const char *type) {
 
-    /* Take mutex used to protect access to the add-ons management list */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_addons_mutex, -1))) {
-        mender_log_error("Unable to take mutex");
-        return ret;
-    }
+    assert(NULL != deployment_data);
+    assert(NULL != type);
+    char **tmp;
 
-    /* Activate add-ons */
-    if (NULL != mender_client_addons_list) {
-        for (size_t index = 0; index < mender_client_addons_count; index++) {
-            if (NULL != mender_client_addons_list[index]->activate) {
-                mender_client_addons_list[index]->activate();
-            }
+    /* Check if the type is already present */
+    for (size_t index = 0; index < deployment_data->types_count; index++) {
+        if (!strcmp(type, deployment_data->types[index])) {
+            return MENDER_OK;
         }
     }
 
-    /* Release mutex used to protect access to the add-ons management list */
-    mender_scheduler_mutex_give(mender_client_addons_mutex);
+    /* Add the type */
+    if (NULL == (tmp = (char **)mender_utils_realloc(deployment_data->types, (deployment_data->types_count + 1) * sizeof(char *)))) {
+        return MENDER_FAIL;
+    }
+    deployment_data->types = tmp;
+    if (NULL == (deployment_data->types[deployment_data->types_count] = mender_utils_strdup(type))) {
+        return MENDER_FAIL;
+    }
+    deployment_data->types_count++;
 
-    return MENDER_DONE;
+    return MENDER_OK;
+}
 
-REBOOT:
+static void
+mender_client_deployment_data_release(mender_client_deployment_data_t *deployment_data) {
 
-    /* Invoke restart callback, application is responsible to shutdown properly and restart the system */
-    if (NULL != mender_client_callbacks.restart) {
-        mender_client_callbacks.restart();
+    /* Release memory */
+    if (NULL != deployment_data) {
+        for (size_t index = 0; index < deployment_data->types_count; index++) {
+            mender_utils_free(deployment_data->types[index]);
+        }
+        mender_utils_free(deployment_data->types);
+        mender_utils_free(deployment_data->id);
+        mender_utils_free(deployment_data->artifact_name);
+        mender_utils_free(deployment_data);
     }
-
-    return ret;
 }
 
 static mender_err_t
-deployment_destroy(mender_api_deployment_data_t *deployment) {
-    if (NULL != deployment) {
-        free(deployment->id);
-        free(deployment->artifact_name);
-        free(deployment->uri);
-        for (size_t i = 0; i < deployment->device_types_compatible_size; ++i) {
-            free(deployment->device_types_compatible[i]);
-        }
-        free(deployment->device_types_compatible);
-        free(deployment);
+mender_client_deployment_data_to_record(mender_utils_record_t *record) {
+
+    assert(NULL != record);
+    assert(NULL != mender_client_ctx->deployment_data);
+
+    /* Add ID, artifact name and types */
+    mender_utils_record_add(record, mender_client_ctx->deployment_data->id);
+    mender_utils_record_add(record, mender_client_ctx->deployment_data->artifact_name);
+    for (size_t index = 0; index < mender_client_ctx->deployment_data->types_count; index++) {
+        mender_utils_record_add(record, mender_client_ctx->deployment_data->types[index]);
     }
-    return MENDER_OK;
+
+    return mender_utils_record_end(record);
 }
 
-#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
 static mender_err_t
-mender_compare_device_types(const char  *device_type_artifact,
-                            const char  *device_type_device,
-                            const char **device_type_deployment,
-                            const size_t device_type_deployment_size) {
+mender_client_deployment_data_from_record(const void *data, size_t length) {
 
-    assert(NULL != device_type_artifact);
-    assert(NULL != device_type_deployment);
-    assert(NULL != device_type_device);
-    assert(0 < device_type_deployment_size);
+    assert(NULL != data);
+    size_t count;
 
-    if (0 != strcmp(device_type_artifact, device_type_device)) {
-        mender_log_error("Device type from artifact '%s' is not compatible with device '%s'", device_type_artifact, device_type_device);
+    /* Deployment data written by previous versions of the client is null terminated JSON text */
+    if (MENDER_OK != mender_utils_record_check(data, length, &count)) {
+        if ((0 == length) || ('\0' != ((const char *)data)[length - 1])) {
+            return MENDER_FAIL;
+        }
+#ifdef CONFIG_MENDER_TINY
+        return mender_client_deployment_data_from_json((const char *)data, length - 1);
+#else
+        cJSON *json_deployment_data = cJSON_Parse((const char *)data);
+        if (NULL == json_deployment_data) {
+            return MENDER_FAIL;
+        }
+        char *id            = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json_deployment_data, "id"));
+        char *artifact_name = cJSON_GetStringValue(cJSON_GetObjectItemCaseSensitive(json_deployment_data, "artifact_name"));
+        if ((NULL == id) || (NULL == artifact_name)
+            || (NULL == (mender_client_ctx->deployment_data = mender_client_deployment_data_create(id, artifact_name)))) {
+            cJSON_Delete(json_deployment_data);
+            return MENDER_FAIL;
+        }
+        cJSON *json_type = NULL;
+        cJSON_ArrayForEach(json_type, cJSON_GetObjectItemCaseSensitive(json_deployment_data, "types")) {
+            if ((NULL == cJSON_GetStringValue(json_type))
+                || (MENDER_OK != mender_client_deployment_data_add_type(mender_client_ctx->deployment_data, cJSON_GetStringValue(json_type)))) {
+                cJSON_Delete(json_deployment_data);
+                goto FAIL;
+            }
+        }
+        cJSON_Delete(json_deployment_data);
+        return MENDER_OK;
+#endif /* CONFIG_MENDER_TINY */
+    }
+    if (count < 2) {
         return MENDER_FAIL;
     }
 
-    /* Return MENDER_OK if one of the devices in the deployment are compatible with the device */
-    for (size_t i = 0; i < device_type_deployment_size; i++) {
-        if (0 == strcmp(device_type_deployment[i], device_type_device)) {
-            return MENDER_OK;
+    /* Create deployment data from ID, artifact name and types */
+    size_t      offset        = 0;
+    const char *id            = mender_utils_record_next(data, &offset);
+    const char *artifact_name = mender_utils_record_next(data, &offset);
+    if (NULL == (mender_client_ctx->deployment_data = mender_client_deployment_data_create(id, artifact_name))) {
+        return MENDER_FAIL;
+    }
+    for (size_t index = 2; index < count; index++) {
+        if (MENDER_OK != mender_client_deployment_data_add_type(mender_client_ctx->deployment_data, mender_utils_record_next(data, &offset))) {
+            goto FAIL;
         }
     }
-    mender_log_error("None of the device types from the deployment are compatible with device '%s'", device_type_device);
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    mender_client_deployment_data_release(mender_client_ctx->deployment_data);
+    mender_client_ctx->deployment_data = NULL;
+
     return MENDER_FAIL;
 }
-#endif
-
-#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
-#ifdef CONFIG_MENDER_PROVIDES_DEPENDS
-static mender_err_t
-mender_store_provides(mender_artifact_ctx_t *mender_artifact_ctx) {
 
-    assert(NULL != mender_artifact_ctx);
-    mender_err_t ret = MENDER_FAIL;
+#ifdef CONFIG_MENDER_TINY
 
-    /* Write provides to the store */
-    /* Load the currently stored provides, combine it with the new provides and write back */
+static mender_err_t
+mender_client_deployment_data_from_json(const char *data, size_t length) {
 
-    /* Load stored provides */
-    mender_key_value_list_t *stored_provides = NULL;
-    if (MENDER_FAIL == mender_storage_get_provides(&stored_provides)) {
-        mender_log_error("Unable to get stored provides");
-        goto END;
-    }
+    assert(NULL != data);
+    mender_json_token_t *tokens   = NULL;
+    char                *document = NULL;
+    mender_json_token_t *json_type;
+    mender_err_t         ret = MENDER_FAIL;
+    size_t               count;
 
-    /* Combine the provides from the header-info and from the payloads */
-    mender_key_value_list_t *header_provides = mender_artifact_ctx->artifact_info.provides;
-    for (size_t i = 0; i < mender_artifact_ctx->payloads.size; i++) {
-        if (MENDER_OK != mender_utils_append_list(&header_provides, &mender_artifact_ctx->payloads.values[i].provides)) {
-            mender_log_error("Unable to merge provides");
-            goto END;
-        }
+    /* Copy the document, the strings are decoded in place */
+    if (NULL == (document = (char *)mender_utils_malloc(length + 1))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
     }
+    memcpy(document, data, length);
+    document[length] = '\0';
 
-    /* Combine the stored provides with the new ones */
-    if (MENDER_OK != mender_utils_append_list(&header_provides, &stored_provides)) {
-        mender_log_error("Unable to merge provides");
+    /* Tokenize the document */
+    if ((MENDER_OK != mender_json_tokenize(document, length, NULL, 0, &count))
+        || (NULL == (tokens = (mender_json_token_t *)mender_utils_malloc(count * sizeof(mender_json_token_t))))
+        || (MENDER_OK != mender_json_tokenize(document, length, tokens, count, &count))) {
         goto END;
     }
 
-    /* Write the combined list back to the store */
-    if (MENDER_OK != mender_storage_set_provides(header_provides)) {
-        mender_log_error("Unable to set provides");
+    /* Create deployment data from ID, artifact name and types */
+    mender_json_token_t *json_id            = mender_json_token_get(document, tokens, "id");
+    mender_json_token_t *json_artifact_name = mender_json_token_get(document, tokens, "artifact_name");
+    mender_json_token_t *json_types         = mender_json_token_get(document, tokens, "types");
+    char                *id                 = (NULL != json_id) ? mender_json_token_string(document, json_id) : NULL;
+    char                *artifact_name      = (NULL != json_artifact_name) ? mender_json_token_string(document, json_artifact_name) : NULL;
+    if ((NULL == id) || (NULL == artifact_name) || (NULL == (mender_client_ctx->deployment_data = mender_client_deployment_data_create(id, artifact_name)))) {
         goto END;
     }
-
+    for (size_t index = 0; (NULL != json_types) && (NULL != (json_type = mender_json_token_at(json_types, index))); index++) {
+        char *type = mender_json_token_string(document, json_type);
+        if ((NULL == type) || (MENDER_OK != mender_client_deployment_data_add_type(mender_client_ctx->deployment_data, type))) {
+            mender_client_deployment_data_release(mender_client_ctx->deployment_data);
+            mender_client_ctx->deployment_data = NULL;
+            goto END;
+        }
+    }
     ret = MENDER_OK;
+
 END:
-    mender_utils_free_linked_list(stored_provides);
+
+    /* Release memory */
+    mender_utils_free(tokens);
+    mender_utils_free(document);
+
     return ret;
 }
-#endif /* CONFIG_MENDER_PROVIDES_DEPENDS */
-#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
+
+#endif /* CONFIG_MENDER_TINY */
 
 static mender_err_t
-mender_client_update_work_function(void) {
+mender_client_publish_deployment_status(char *id, mender_deployment_status_t deployment_status) {
 
+    assert(NULL != id);
     mender_err_t ret;
+    size_t       index;
 
-    /* Ensure that the context is initialized to NULL before goto END */
-    mender_artifact_ctx_t *mender_artifact_ctx = NULL;
-
-    /* Check for deployment */
-    mender_api_deployment_data_t *deployment              = calloc(1, sizeof(mender_api_deployment_data_t));
-    char                         *storage_deployment_data = NULL;
-
-    mender_log_info("Checking for deployment...");
-    if (MENDER_OK != (ret = mender_api_check_for_deployment(deployment))) {
-        mender_log_error("Unable to check for deployment");
-        goto END;
+    /* Invoke deployment status callback if defined */
+    if (NULL != mender_client_ctx->callbacks.deployment_status) {
+        mender_client_ctx->callbacks.deployment_status(deployment_status, mender_utils_deployment_status_to_string(deployment_status));
     }
 
-    /* Check if deployment is available */
-    if ((NULL == deployment->id) || (NULL == deployment->artifact_name) || (NULL == deployment->uri) || (NULL == deployment->device_types_compatible)) {
-        mender_log_info("No deployment available");
-        goto END;
+    /* Statuses of the deployments installed from a local source are not published */
+    if (!strcmp(id, MENDER_CLIENT_LOCAL_DEPLOYMENT_ID)) {
+        return MENDER_OK;
     }
 
-    /* Check if artifact is already installed (should not occur) */
-    if (!strcmp(deployment->artifact_name, mender_client_config.artifact_name)) {
-        mender_log_error("Artifact is already installed");
-        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED);
-        goto END;
+    /* Take mutex used to protect access to the deployment status outbox */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->status_outbox_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        return ret;
     }
 
-    /* Reset flags */
-    mender_client_deployment_needs_set_pending_image = false;
-    mender_client_deployment_needs_restart           = false;
+    /* Supersede the intermediate status of the deployment if it has not been published yet, final statuses are always published */
+    for (index = 0; index < mender_client_ctx->status_outbox_count; index++) {
+        if ((!strcmp(mender_client_ctx->status_outbox[index].id, id)) && (MENDER_DEPLOYMENT_STATUS_SUCCESS != mender_client_ctx->status_outbox[index].status)
+            && (MENDER_DEPLOYMENT_STATUS_FAILURE != mender_client_ctx->status_outbox[index].status)
+            && (MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED != mender_client_ctx->status_outbox[index].status)) {
+            mender_client_ctx->status_outbox[index].status   = deployment_status;
+            mender_client_ctx->status_outbox[index].attempts = 0;
+            goto END;
+        }
+    }
 
-    /* Create deployment data */
-    if (NULL == (mender_client_deployment_data = cJSON_CreateObject())) {
+    /* Queue the status, the oldest one is dropped if the outbox is full */
+    if (MENDER_CLIENT_STATUS_OUTBOX_LENGTH == mender_client_ctx->status_outbox_count) {
+        mender_log_warning("Deployment status outbox is full, dropping oldest status");
+        mender_client_status_outbox_pop();
+    }
+    if (NULL == (mender_client_ctx->status_outbox[mender_client_ctx->status_outbox_count].id = mender_utils_strdup(id))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
-    cJSON_AddStringToObject(mender_client_deployment_data, "id", deployment->id);
-    cJSON_AddStringToObject(mender_client_deployment_data, "artifact_name", deployment->artifact_name);
-    cJSON_AddArrayToObject(mender_client_deployment_data, "types");
+    mender_client_ctx->status_outbox[mender_client_ctx->status_outbox_count].status   = deployment_status;
+    mender_client_ctx->status_outbox[mender_client_ctx->status_outbox_count].attempts = 0;
+    mender_client_ctx->status_outbox_count++;
 
-    /* Download deployment artifact */
-    mender_log_info(
-        "Downloading deployment artifact with id '%s', artifact name '%s' and uri '%s'", deployment->id, deployment->artifact_name, deployment->uri);
-    mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_DOWNLOADING);
-    if (MENDER_OK != (ret = mender_api_download_artifact(deployment->uri, mender_client_download_artifact_callback))) {
-        mender_log_error("Unable to download artifact");
-        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
-        if (true == mender_client_deployment_needs_set_pending_image) {
-            mender_flash_abort_deployment(mender_client_flash_handle);
+END:
+
+    /* Release mutex used to protect access to the deployment status outbox */
+    mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
+
+    /* Trigger execution of the deployment status work, it is executed once the current work is done */
+    if (MENDER_OK == ret) {
+        if (MENDER_OK != (ret = mender_scheduler_work_execute(mender_client_ctx->status_work_handle))) {
+            mender_log_error("Unable to trigger deployment status work");
         }
-        goto END;
     }
 
-    /* Artifact context */
-    if (MENDER_OK != (ret = mender_artifact_get_ctx(&mender_artifact_ctx))) {
-        mender_log_error("Unable to get artifact context");
-        if (mender_client_deployment_needs_set_pending_image) {
-            mender_flash_abort_deployment(mender_client_flash_handle);
-        }
+    return ret;
+}
+
+static mender_err_t
+mender_client_network_work_function(MENDER_SCHEDULER_WORK_ARG) {
+
+    mender_err_t ret = MENDER_DONE;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select the context of the device of the work */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Take mutex used to protect access to the network management counter */
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_client_ctx->network_mutex, -1)) {
+        mender_log_error("Unable to take mutex");
+        ret = MENDER_FAIL;
         goto END;
     }
 
-#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
-    /* Retrieve device type from artifact */
-    const char *device_type_artifact = NULL;
-    if (MENDER_OK != (ret = mender_artifact_get_device_type(mender_artifact_ctx, &device_type_artifact))) {
-        mender_log_error("Unable to get device type from artifact");
-        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
-        if (mender_client_deployment_needs_set_pending_image) {
-            mender_flash_abort_deployment(mender_client_flash_handle);
+    /* Release network access if it has not been used again during the linger interval */
+    if ((0 == mender_client_ctx->network_count) && (true == mender_client_ctx->network_lingering)) {
+        mender_client_ctx->network_lingering = false;
+        if (NULL != mender_client_ctx->callbacks.network_release) {
+            if (MENDER_OK != mender_client_ctx->callbacks.network_release()) {
+                mender_log_error("Unable to release network");
+            }
         }
-        goto END;
     }
 
-    /* Match device type  */
-    if (MENDER_OK
-        != mender_compare_device_types(device_type_artifact,
-                                       mender_client_config.device_type,
-                                       (const char **)deployment->device_types_compatible,
-                                       deployment->device_types_compatible_size)) {
-        /* Erorrs are logged by the function */
-        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
-        if (mender_client_deployment_needs_set_pending_image) {
-            mender_flash_abort_deployment(mender_client_flash_handle);
-        }
-        goto END;
+    /* Release mutex used to protect access to the network management counter */
+    mender_scheduler_mutex_give(mender_client_ctx->network_mutex);
+
+END:
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    return ret;
+}
+
+static mender_err_t
+mender_client_status_work_function(MENDER_SCHEDULER_WORK_ARG) {
+
+    mender_err_t               ret = MENDER_OK;
+    char                      *id;
+    mender_deployment_status_t deployment_status;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Select the context of the device of the work */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Check if statuses or logs are waiting in the outbox */
+    bool pending = (0 != mender_client_ctx->status_outbox_count);
+#ifdef CONFIG_MENDER_LOG_BUFFER
+    pending = pending || (NULL != mender_client_ctx->logs_outbox);
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+    if (false == pending) {
+        goto RESTORE;
     }
 
-#ifdef CONFIG_MENDER_PROVIDES_DEPENDS
-    /* Store provides */
-    if (MENDER_OK != mender_store_provides(mender_artifact_ctx)) {
-        mender_log_error("Unable to store provides");
-        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
-        if (mender_client_deployment_needs_set_pending_image) {
-            mender_flash_abort_deployment(mender_client_flash_handle);
-        }
+    /* Request access to the network */
+    if (MENDER_OK != (ret = mender_client_network_connect())) {
+        mender_log_error("Requesting access to the network failed");
         goto END;
     }
-#endif /* CONFIG_MENDER_PROVIDES_DEPENDS */
-#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
 
-    /* Set boot partition */
-    mender_log_info("Download done, installing artifact");
-    mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_INSTALLING);
-    if (true == mender_client_deployment_needs_set_pending_image) {
-        if (MENDER_OK != (ret = mender_flash_set_pending_image(mender_client_flash_handle))) {
-            mender_log_error("Unable to set boot partition");
-            mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
-            goto END;
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+    /* Publish the logs if their upload has been requested, the request is dropped if they can't be published */
+    if (MENDER_OK == mender_scheduler_mutex_take(mender_client_ctx->status_outbox_mutex, -1)) {
+        id                             = mender_client_ctx->logs_outbox;
+        mender_client_ctx->logs_outbox = NULL;
+        mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
+        if (NULL != id) {
+            if (MENDER_FAIL == mender_api_publish_deployment_logs(id)) {
+                mender_log_error("Unable to publish deployment logs");
+            }
+            mender_utils_free(id);
         }
     }
 
-    /* Check if the system must restart following downloading the deployment */
-    if (true == mender_client_deployment_needs_restart) {
-        /* Save deployment data to publish deployment status after rebooting */
-        if (NULL == (storage_deployment_data = cJSON_PrintUnformatted(mender_client_deployment_data))) {
-            mender_log_error("Unable to save deployment data");
-            mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
+    /* Publish the statuses in order, the connection of the first request is reused by the following ones */
+    while (MENDER_OK == ret) {
+
+        /* Take mutex used to protect access to the deployment status outbox */
+        if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->status_outbox_mutex, -1))) {
+            mender_log_error("Unable to take mutex");
+            break;
+        }
+        if (0 == mender_client_ctx->status_outbox_count) {
+            mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
+            break;
+        }
+        if (NULL == (id = mender_utils_strdup(mender_client_ctx->status_outbox[0].id))) {
+            mender_log_error("Unable to allocate memory");
+            mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
             ret = MENDER_FAIL;
-            goto END;
+            break;
         }
-        if (MENDER_OK != (ret = mender_storage_set_deployment_data(storage_deployment_data))) {
-            mender_log_error("Unable to save deployment data");
-            mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_FAILURE);
-            goto END;
+        deployment_status = mender_client_ctx->status_outbox[0].status;
+        mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
+
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+        /* Publish the logs before the failure status so that the server attaches them to the deployment, the status is published anyway */
+        if (MENDER_DEPLOYMENT_STATUS_FAILURE == deployment_status) {
+            if (MENDER_FAIL == mender_api_publish_deployment_logs(id)) {
+                mender_log_error("Unable to publish deployment logs");
+            }
         }
-        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_REBOOTING);
-    } else {
-        /* Publish deployment status success */
-        mender_client_publish_deployment_status(deployment->id, MENDER_DEPLOYMENT_STATUS_SUCCESS);
-        goto END;
-    }
 
-    /* Release memory */
-    deployment_destroy(deployment);
-    if (NULL != storage_deployment_data) {
-        free(storage_deployment_data);
-    }
-    if (NULL != mender_client_deployment_data) {
-        cJSON_Delete(mender_client_deployment_data);
-        mender_client_deployment_data = NULL;
-    }
-    mender_artifact_release_ctx(mender_artifact_ctx);
+#endif /* CONFIG_MENDER_LOG_BUFFER */
 
-    /* Check if the system must restart following downloading the deployment */
-    if (true == mender_client_deployment_needs_restart) {
-        /* Invoke restart callback, application is responsible to shutdown properly and restart the system */
-        if (NULL != mender_client_callbacks.restart) {
-            mender_client_callbacks.restart();
+        /* Publish status to the mender server, the outbox is not locked meanwhile */
+        ret = mender_api_publish_deployment_status(id, deployment_status, NULL);
+
+        /* Remove the status from the outbox unless it has been superseded meanwhile, it is dropped after too many attempts */
+        if (MENDER_OK == mender_scheduler_mutex_take(mender_client_ctx->status_outbox_mutex, -1)) {
+            if ((mender_client_ctx->status_outbox_count > 0) && (!strcmp(mender_client_ctx->status_outbox[0].id, id))
+                && (deployment_status == mender_client_ctx->status_outbox[0].status)) {
+                if ((MENDER_OK == ret) || (++mender_client_ctx->status_outbox[0].attempts >= MENDER_CLIENT_STATUS_OUTBOX_ATTEMPTS)) {
+                    if (MENDER_OK != ret) {
+                        mender_log_error("Unable to publish deployment status, dropping it");
+                        ret = MENDER_OK;
+                    }
+                    mender_client_status_outbox_pop();
+                }
+            }
+            mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
         }
+        mender_utils_free(id);
     }
 
-    return MENDER_DONE;
+    /* Release access to the network */
+    mender_client_network_release();
 
 END:
 
-    /* Release memory */
-    deployment_destroy(deployment);
-    if (NULL != storage_deployment_data) {
-        free(storage_deployment_data);
-    }
-    if (NULL != mender_client_deployment_data) {
-        cJSON_Delete(mender_client_deployment_data);
-        mender_client_deployment_data = NULL;
+    /* Retry later if a status has not been published */
+    if (MENDER_OK != ret) {
+        mender_scheduler_work_set_period(mender_client_ctx->status_work_handle, (uint32_t)mender_client_ctx->config.authentication_poll_interval);
+    } else {
+        mender_scheduler_work_set_period(mender_client_ctx->status_work_handle, 0);
     }
-    mender_artifact_release_ctx(mender_artifact_ctx);
+
+RESTORE:
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
     return ret;
 }
 
-static mender_err_t
-mender_client_download_artifact_callback(char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+static char *
+mender_client_artifact_mirror(void) {
 
-    assert(NULL != type);
-    cJSON       *json_types;
-    mender_err_t ret;
+    char *mirror = NULL;
 
-    /* Take mutex used to protect access to the artifact types management list */
-    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_artifact_types_mutex, -1))) {
+    /* Discover the mirror, the configured mirror is used if the application does not provide one */
+    if (NULL != mender_client_ctx->callbacks.get_artifact_mirror) {
+        if (MENDER_OK != mender_client_ctx->callbacks.get_artifact_mirror(&mirror)) {
+            mender_log_warning("Unable to discover artifact mirror");
+            mirror = NULL;
+        }
+    }
+    if ((NULL == mirror) || ('\0' == mirror[0])) {
+        mirror = mender_client_ctx->config.artifact_mirror;
+    }
+    if (NULL != mirror) {
+        mender_log_info("Downloading artifact from mirror '%s'", mirror);
+    }
+
+    return mirror;
+}
+
+static void
+mender_client_download_progress_reset(void) {
+
+    /* Reset the download progress, the pending substate has been dropped at the end of the previous download */
+    mender_client_ctx->download_progress.downloaded = 0;
+    mender_client_ctx->download_progress.total      = 0;
+    mender_client_ctx->download_progress.percent    = 0;
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+    mender_client_ctx->download_progress.published = 0;
+    mender_client_ctx->download_progress.timestamp = 0;
+    mender_scheduler_get_uptime(&mender_client_ctx->download_progress.timestamp);
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+}
+
+static void
+mender_client_download_progress_update(size_t size, size_t index, size_t length) {
+
+    /* Compute the progress, the total is the size of the payload files announced so far */
+    if (0 == index) {
+        mender_client_ctx->download_progress.total += size;
+    }
+    mender_client_ctx->download_progress.downloaded += length;
+    if ((0 == mender_client_ctx->download_progress.total) || (mender_client_ctx->download_progress.downloaded >= mender_client_ctx->download_progress.total)) {
+        mender_client_ctx->download_progress.downloaded = mender_client_ctx->download_progress.total;
+    }
+    uint8_t percent = (0 == mender_client_ctx->download_progress.total)
+                          ? 100
+                          : (uint8_t)(((uint64_t)mender_client_ctx->download_progress.downloaded * 100) / mender_client_ctx->download_progress.total);
+
+    /* Report the progress to the application when it changes, the callback is not invoked for each block */
+    if (percent == mender_client_ctx->download_progress.percent) {
+        return;
+    }
+    mender_client_ctx->download_progress.percent = percent;
+    if (NULL != mender_client_ctx->callbacks.download_progress) {
+        mender_client_ctx->callbacks.download_progress(mender_client_ctx->download_progress.downloaded, mender_client_ctx->download_progress.total, percent);
+    }
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
+
+    /* Check if the progress must be published, at most once per interval or per step */
+    uint64_t now = 0;
+    mender_scheduler_get_uptime(&now);
+    bool due = false;
+#if CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP > 0
+    if (percent >= mender_client_ctx->download_progress.published + CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP) {
+        due = true;
+    }
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_STEP > 0 */
+#if CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL > 0
+    if (now - mender_client_ctx->download_progress.timestamp >= (uint64_t)CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL * 1000) {
+        due = true;
+    }
+#endif /* CONFIG_MENDER_CLIENT_DOWNLOAD_PROGRESS_INTERVAL > 0 */
+    if (false == due) {
+        return;
+    }
+    mender_client_ctx->download_progress.published = percent;
+    mender_client_ctx->download_progress.timestamp = now;
+
+    /* Set the pending substate, it supersedes the previous one if it has not been published yet */
+    if (!strcmp(mender_client_ctx->deployment_data->id, MENDER_CLIENT_LOCAL_DEPLOYMENT_ID)) {
+        return;
+    }
+    if (MENDER_OK != mender_scheduler_mutex_take(mender_client_ctx->status_outbox_mutex, -1)) {
         mender_log_error("Unable to take mutex");
-        return ret;
+        return;
+    }
+    if ((NULL == mender_client_ctx->download_progress.id)
+        && (NULL == (mender_client_ctx->download_progress.id = mender_utils_strdup(mender_client_ctx->deployment_data->id)))) {
+        mender_log_error("Unable to allocate memory");
+        mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
+        return;
     }
+    snprintf(mender_client_ctx->download_progress.substate, sizeof(mender_client_ctx->download_progress.substate), "Downloading: %u%%", (unsigned int)percent);
+    mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
 
-    /* Treatment depending of the type */
-    if (NULL != mender_client_artifact_types_list) {
-        for (size_t artifact_type_index = 0; artifact_type_index < mender_client_artifact_types_count; artifact_type_index++) {
+    /* Trigger execution of the download progress work */
+    if (MENDER_OK != mender_scheduler_work_execute(mender_client_ctx->progress_work_handle)) {
+        mender_log_error("Unable to trigger download progress work");
+    }
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
+}
 
-            /* Check artifact type */
-            if (!strcmp(type, mender_client_artifact_types_list[artifact_type_index]->type)) {
+#ifdef MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH
 
-                /* Retrieve ID and artifact name */
-                cJSON *json_id = NULL;
-                if (NULL == (json_id = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "id"))) {
-                    mender_log_error("Unable to get ID from the deployment data");
-                    goto END;
-                }
-                char *id;
-                if (NULL == (id = cJSON_GetStringValue(json_id))) {
-                    mender_log_error("Unable to get ID from the deployment data");
-                    goto END;
-                }
-                cJSON *json_artifact_name = NULL;
-                if (NULL == (json_artifact_name = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "artifact_name"))) {
-                    mender_log_error("Unable to get artifact name from the deployment data");
-                    goto END;
-                }
-                char *artifact_name;
-                if (NULL == (artifact_name = cJSON_GetStringValue(json_artifact_name))) {
-                    mender_log_error("Unable to get artifact name from the deployment data");
-                    goto END;
-                }
+static void
+mender_client_download_progress_drop(void) {
 
-                /* Invoke artifact type callback */
-                if (MENDER_OK
-                    != (ret = mender_client_artifact_types_list[artifact_type_index]->callback(
-                            id, artifact_name, type, meta_data, filename, size, data, index, length))) {
-                    mender_log_error("An error occurred while processing data of the artifact '%s'", type);
-                    goto END;
-                }
+    /* Drop the pending substate */
+    if (MENDER_OK == mender_scheduler_mutex_take(mender_client_ctx->status_outbox_mutex, -1)) {
+        mender_utils_free(mender_client_ctx->download_progress.id);
+        mender_client_ctx->download_progress.id = NULL;
+        mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
+    }
+}
 
-                /* Treatments related to the artifact type (once) */
-                if (0 == index) {
+static mender_err_t
+mender_client_progress_work_function(MENDER_SCHEDULER_WORK_ARG) {
 
-                    /* Add type to the deployment data */
-                    if (NULL == (json_types = cJSON_GetObjectItemCaseSensitive(mender_client_deployment_data, "types"))) {
-                        mender_log_error("Unable to add type to the deployment data");
-                        ret = MENDER_FAIL;
-                        goto END;
-                    }
-                    bool   found     = false;
-                    cJSON *json_type = NULL;
-                    cJSON_ArrayForEach(json_type, json_types) {
-                        if (!strcmp(type, cJSON_GetStringValue(json_type))) {
-                            found = true;
-                        }
-                    }
-                    if (false == found) {
-                        cJSON_AddItemToArray(json_types, cJSON_CreateString(type));
-                    }
+    mender_err_t ret;
+    char        *id = NULL;
+    char         substate[MENDER_CLIENT_DOWNLOAD_PROGRESS_SUBSTATE_LENGTH];
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
 
-                    /* Set flags */
-                    if (true == mender_client_artifact_types_list[artifact_type_index]->needs_restart) {
-                        mender_client_deployment_needs_restart = true;
-                    }
-                }
+    /* Select the context of the device of the work */
+    mender_client_ctx_t *previous = mender_client_select_ctx((mender_client_ctx_t *)arg);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
-                goto END;
-            }
-        }
+    /* Take the pending substate */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_take(mender_client_ctx->status_outbox_mutex, -1))) {
+        mender_log_error("Unable to take mutex");
+        goto END;
+    }
+    id                                      = mender_client_ctx->download_progress.id;
+    mender_client_ctx->download_progress.id = NULL;
+    strcpy(substate, mender_client_ctx->download_progress.substate);
+    mender_scheduler_mutex_give(mender_client_ctx->status_outbox_mutex);
+    if (NULL == id) {
+        goto END;
+    }
+
+    /* Request access to the network, it is already connected by the download and the connection to the mender-server is reused if it is kept alive */
+    if (MENDER_OK != (ret = mender_client_network_connect())) {
+        mender_log_error("Requesting access to the network failed");
+        goto END;
+    }
+
+    /* Publish the substate, it is not retried because the next progress supersedes it */
+    if (MENDER_OK != (ret = mender_api_publish_deployment_status(id, MENDER_DEPLOYMENT_STATUS_DOWNLOADING, substate))) {
+        mender_log_error("Unable to publish download progress");
     }
 
-    /* Content is not supported by the mender-mcu-client */
-    mender_log_error("Unable to handle artifact type '%s'", type);
-    ret = MENDER_FAIL;
+    /* Release access to the network */
+    mender_client_network_release();
 
 END:
 
-    /* Release mutex used to protect access to the artifact types management list */
-    mender_scheduler_mutex_give(mender_client_artifact_types_mutex);
+    /* Release memory */
+    mender_utils_free(id);
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+    /* Restore the context of the calling thread */
+    mender_client_select_ctx(previous);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 
     return ret;
 }
 
-static mender_err_t
-mender_client_download_artifact_flash_callback(
-    char *id, char *artifact_name, char *type, cJSON *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+#endif /* MENDER_CLIENT_DOWNLOAD_PROGRESS_PUBLISH */
 
-    (void)id;
-    (void)artifact_name;
-    (void)type;
-    (void)meta_data;
-    mender_err_t ret = MENDER_OK;
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
 
-    /* Check if the filename is provided */
-    if (NULL != filename) {
+static mender_err_t
+mender_client_memory_budget_init(void) {
 
-        /* Check if the flash handle must be opened */
-        if (0 == index) {
+    mender_err_t               ret;
+    mender_utils_heap_budget_t budget;
 
-            /* Open the flash handle */
-            if (MENDER_OK != (ret = mender_flash_open(filename, size, &mender_client_flash_handle))) {
-                mender_log_error("Unable to open flash handle");
-                goto END;
-            }
-        }
+    /* Create the mutex protecting the pools, it is allocated before the memory budget is set */
+    if (MENDER_OK != (ret = mender_scheduler_mutex_create(&mender_client_memory_budget.mutex))) {
+        mender_log_error("Unable to create memory budget mutex");
+        return ret;
+    }
 
-        /* Write data */
-        if (MENDER_OK != (ret = mender_flash_write(mender_client_flash_handle, data, index, length))) {
-            mender_log_error("Unable to write data to flash");
-            goto END;
-        }
+    /* Compute the size of the pools */
+    memset(&budget, 0, sizeof(budget));
+    budget.sizes[MENDER_UTILS_HEAP_MODULE_OTHER]    = CONFIG_MENDER_CLIENT_MEMORY_BUDGET_GENERAL_SIZE;
+    budget.sizes[MENDER_UTILS_HEAP_MODULE_ARTIFACT] = CONFIG_MENDER_CLIENT_MEMORY_BUDGET_ARTIFACT_SIZE;
+    budget.sizes[MENDER_UTILS_HEAP_MODULE_HTTP]     = CONFIG_MENDER_CLIENT_MEMORY_BUDGET_HTTP_SIZE;
+    budget.sizes[MENDER_UTILS_HEAP_MODULE_JSON]     = CONFIG_MENDER_CLIENT_MEMORY_BUDGET_JSON_SIZE;
+    budget.sizes[MENDER_UTILS_HEAP_MODULE_ARENA]    = CONFIG_MENDER_CLIENT_MEMORY_BUDGET_ARENA_SIZE;
+    budget.lock                                     = mender_client_memory_budget_lock;
+    budget.unlock                                   = mender_client_memory_budget_unlock;
+    size_t size                                     = 0;
+    for (size_t index = 0; index < MENDER_UTILS_HEAP_MODULE_ALL; index++) {
+        size += budget.sizes[index];
+    }
 
-        /* Check if the flash handle must be closed */
-        if (index + length >= size) {
+    /* Reserve the memory block, this is the only allocation of the client served by the allocator afterwards */
+    if (NULL == (mender_client_memory_budget.memory = mender_utils_malloc(size))) {
+        mender_log_error("Unable to allocate memory budget of %zu bytes", size);
+        return MENDER_FAIL;
+    }
+    budget.memory = mender_client_memory_budget.memory;
 
-            /* Close the flash handle */
-            if (MENDER_OK != (ret = mender_flash_close(mender_client_flash_handle))) {
-                mender_log_error("Unable to close flash handle");
-                goto END;
-            }
-        }
+    /* Serve the following allocations from the pools */
+    if (MENDER_OK != (ret = mender_utils_heap_set_budget(&budget))) {
+        mender_log_error("Unable to set memory budget");
+        return ret;
     }
+    mender_log_info("Memory budget of %zu bytes reserved", size);
 
-    /* Set flags */
-    mender_client_deployment_needs_set_pending_image = true;
+    return MENDER_OK;
+}
 
-END:
+static mender_err_t
+mender_client_memory_budget_lock(void) {
 
-    return ret;
+    return mender_scheduler_mutex_take(mender_client_memory_budget.mutex, -1);
 }
 
 static mender_err_t
-mender_client_publish_deployment_status(char *id, mender_deployment_status_t deployment_status) {
+mender_client_memory_budget_unlock(void) {
 
-    assert(NULL != id);
-    mender_err_t ret;
+    return mender_scheduler_mutex_give(mender_client_memory_budget.mutex);
+}
 
-    /* Publish status to the mender server */
-    ret = mender_api_publish_deployment_status(id, deployment_status);
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
 
-    /* Invoke deployment status callback if defined */
-    if (NULL != mender_client_callbacks.deployment_status) {
-        mender_client_callbacks.deployment_status(deployment_status, mender_utils_deployment_status_to_string(deployment_status));
-    }
+static void
+mender_client_status_outbox_pop(void) {
 
-    return ret;
+    /* Release memory */
+    mender_utils_free(mender_client_ctx->status_outbox[0].id);
+
+    /* Shift the following statuses */
+    mender_client_ctx->status_outbox_count--;
+    memmove(&mender_client_ctx->status_outbox[0],
+            &mender_client_ctx->status_outbox[1],
+            mender_client_ctx->status_outbox_count * sizeof(mender_client_ctx->status_outbox[0]));
+    mender_client_ctx->status_outbox[mender_client_ctx->status_outbox_count].id = NULL;
 }
@@ -0,0 +1,401 @@
+/**
+ * @file      mender-delta.c
+ * @brief     Mender delta update, streaming binary patch applied against the running image
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_ARTIFACT
+
+#include "mender-delta.h"
+#include "mender-flash.h"
+#include "mender-log.h"
+
+#ifdef CONFIG_MENDER_CLIENT_DELTA_UPDATE
+
+/**
+ * @brief Default output buffer size (bytes), data of the target image are written to the flash by chunks of this size
+ */
+#ifndef CONFIG_MENDER_CLIENT_DELTA_UPDATE_BUFFER_SIZE
+#define CONFIG_MENDER_CLIENT_DELTA_UPDATE_BUFFER_SIZE (1024)
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE_BUFFER_SIZE */
+
+/**
+ * @brief Patch magic
+ */
+#define MENDER_DELTA_MAGIC "MDLT"
+
+/**
+ * @brief Patch commands
+ */
+#define MENDER_DELTA_COMMAND_COPY   (0x01)
+#define MENDER_DELTA_COMMAND_ADD    (0x02)
+#define MENDER_DELTA_COMMAND_INSERT (0x03)
+
+/**
+ * @brief Patch state machine used to process input data stream
+ */
+typedef enum {
+    MENDER_DELTA_STATE_HEADER = 0, /**< Currently parsing header */
+    MENDER_DELTA_STATE_COMMAND,    /**< Currently parsing command */
+    MENDER_DELTA_STATE_DATA        /**< Currently parsing data of an ADD or INSERT command */
+} mender_delta_state_t;
+
+/**
+ * @brief Delta update context
+ */
+typedef struct {
+    mender_delta_state_t state;        /**< State of the patch processing */
+    char                *name;         /**< Name of the patch file */
+    void               **flash_handle; /**< Flash handle */
+    struct {
+        uint8_t data[9]; /**< Fields of the header or command currently parsed */
+        size_t  length;  /**< Length of the fields currently received */
+    } fields;            /**< Fields of the header or command currently parsed */
+    struct {
+        uint8_t type;   /**< Type of the command */
+        size_t  offset; /**< Offset in the running image */
+        size_t  length; /**< Remaining length of the command */
+    } command;          /**< Command currently processed */
+    struct {
+        uint8_t data[CONFIG_MENDER_CLIENT_DELTA_UPDATE_BUFFER_SIZE]; /**< Data not written yet */
+        size_t  length;                                               /**< Length of the data not written yet */
+        size_t  index;                                                /**< Index of the data not written yet in the target image */
+        size_t  size;                                                 /**< Size of the target image */
+    } output;                                                         /**< Target image */
+} mender_delta_ctx_t;
+
+/**
+ * @brief Get length of the fields of the header or command currently parsed
+ * @param ctx Delta update context
+ * @return Length of the fields
+ */
+static size_t mender_delta_get_fields_length(mender_delta_ctx_t *ctx);
+
+/**
+ * @brief Decode header or command once all fields have been received
+ * @param ctx Delta update context
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_delta_decode_fields(mender_delta_ctx_t *ctx);
+
+/**
+ * @brief Process data of the command currently parsed
+ * @param ctx Delta update context
+ * @param data Data of the patch, NULL for COPY command
+ * @param length Length of the data to process
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_delta_process_command(mender_delta_ctx_t *ctx, uint8_t *data, size_t length);
+
+/**
+ * @brief Write output buffer to the flash
+ * @param ctx Delta update context
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_delta_flush(mender_delta_ctx_t *ctx);
+
+/**
+ * @brief Decode 32 bits little endian integer
+ * @param data Data
+ * @return Decoded value
+ */
+static size_t mender_delta_decode_uint32(uint8_t *data);
+
+mender_err_t
+mender_delta_open(char *name, void **flash_handle, void **handle) {
+
+    assert(NULL != name);
+    assert(NULL != flash_handle);
+    assert(NULL != handle);
+    mender_delta_ctx_t *ctx;
+
+    /* Create new context */
+    if (NULL == (ctx = (mender_delta_ctx_t *)mender_utils_calloc(1, sizeof(mender_delta_ctx_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (NULL == (ctx->name = mender_utils_strdup(name))) {
+        mender_log_error("Unable to allocate memory");
+        mender_utils_free(ctx);
+        return MENDER_FAIL;
+    }
+    ctx->flash_handle = flash_handle;
+    ctx->state        = MENDER_DELTA_STATE_HEADER;
+
+    *handle = ctx;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_delta_write(void *handle, void *data, size_t length) {
+
+    assert(NULL != handle);
+    mender_delta_ctx_t *ctx   = (mender_delta_ctx_t *)handle;
+    uint8_t            *input = (uint8_t *)data;
+    mender_err_t        ret;
+
+    /* Process input data */
+    while (0 != length) {
+
+        /* Treatment depending of the state */
+        if (MENDER_DELTA_STATE_DATA == ctx->state) {
+
+            /* Process data of the command */
+            size_t count = (length < ctx->command.length) ? length : ctx->command.length;
+            if (MENDER_OK != (ret = mender_delta_process_command(ctx, input, count))) {
+                return ret;
+            }
+            input += count;
+            length -= count;
+
+        } else {
+
+            /* Check if the end of the target image is reached, nothing should follow */
+            if ((MENDER_DELTA_STATE_COMMAND == ctx->state) && (ctx->output.index + ctx->output.length >= ctx->output.size)) {
+                mender_log_error("Invalid patch, data found after the end of the target image");
+                return MENDER_FAIL;
+            }
+
+            /* Retrieve fields of the header or command */
+            ctx->fields.data[ctx->fields.length] = *input;
+            ctx->fields.length++;
+            input++;
+            length--;
+            if (ctx->fields.length == mender_delta_get_fields_length(ctx)) {
+                if (MENDER_OK != (ret = mender_delta_decode_fields(ctx))) {
+                    return ret;
+                }
+                ctx->fields.length = 0;
+            }
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_delta_close(void *handle) {
+
+    assert(NULL != handle);
+    mender_delta_ctx_t *ctx = (mender_delta_ctx_t *)handle;
+    mender_err_t        ret;
+
+    /* Write remaining data */
+    if (MENDER_OK != (ret = mender_delta_flush(ctx))) {
+        goto END;
+    }
+
+    /* Check if the target image is complete */
+    if ((MENDER_DELTA_STATE_COMMAND != ctx->state) || (0 != ctx->fields.length) || (ctx->output.index != ctx->output.size)) {
+        mender_log_error("Invalid patch, target image is not complete");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Close the flash handle */
+    mender_log_trace_begin(MENDER_LOG_TRACE_FLASH_CLOSE);
+    ret = mender_flash_close(*ctx->flash_handle);
+    mender_log_trace_end(MENDER_LOG_TRACE_FLASH_CLOSE);
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to close flash handle");
+        goto END;
+    }
+
+END:
+
+    /* Release memory */
+    mender_delta_abort(ctx);
+
+    return ret;
+}
+
+void
+mender_delta_abort(void *handle) {
+
+    mender_delta_ctx_t *ctx = (mender_delta_ctx_t *)handle;
+
+    /* Release memory */
+    if (NULL != ctx) {
+        if (NULL != ctx->name) {
+            mender_utils_free(ctx->name);
+        }
+        mender_utils_free(ctx);
+    }
+}
+
+static size_t
+mender_delta_get_fields_length(mender_delta_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+
+    /* Header: magic and size of the target image */
+    if (MENDER_DELTA_STATE_HEADER == ctx->state) {
+        return strlen(MENDER_DELTA_MAGIC) + 4;
+    }
+
+    /* Command: type is received first, then offset and length, or length only */
+    return (MENDER_DELTA_COMMAND_INSERT == ctx->fields.data[0]) ? (1 + 4) : (1 + 4 + 4);
+}
+
+static mender_err_t
+mender_delta_decode_fields(mender_delta_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+    mender_err_t ret;
+
+    /* Treatment depending of the state */
+    if (MENDER_DELTA_STATE_HEADER == ctx->state) {
+
+        /* Check magic */
+        if (0 != memcmp(ctx->fields.data, MENDER_DELTA_MAGIC, strlen(MENDER_DELTA_MAGIC))) {
+            mender_log_error("Invalid patch magic");
+            return MENDER_FAIL;
+        }
+        ctx->output.size = mender_delta_decode_uint32(&ctx->fields.data[strlen(MENDER_DELTA_MAGIC)]);
+
+        /* Open the flash handle now that the size of the target image is known */
+        if (MENDER_OK != (ret = mender_flash_open(ctx->name, ctx->output.size, ctx->flash_handle))) {
+            mender_log_error("Unable to open flash handle");
+            return ret;
+        }
+
+        ctx->state = MENDER_DELTA_STATE_COMMAND;
+        return MENDER_OK;
+    }
+
+    /* Decode command */
+    ctx->command.type = ctx->fields.data[0];
+    if ((MENDER_DELTA_COMMAND_COPY != ctx->command.type) && (MENDER_DELTA_COMMAND_ADD != ctx->command.type)
+        && (MENDER_DELTA_COMMAND_INSERT != ctx->command.type)) {
+        mender_log_error("Invalid patch command");
+        return MENDER_FAIL;
+    }
+    if (MENDER_DELTA_COMMAND_INSERT == ctx->command.type) {
+        ctx->command.offset = 0;
+        ctx->command.length = mender_delta_decode_uint32(&ctx->fields.data[1]);
+    } else {
+        ctx->command.offset = mender_delta_decode_uint32(&ctx->fields.data[1]);
+        ctx->command.length = mender_delta_decode_uint32(&ctx->fields.data[5]);
+    }
+
+    /* Check length of the command */
+    if (ctx->command.length > ctx->output.size - (ctx->output.index + ctx->output.length)) {
+        mender_log_error("Invalid patch, command exceeds the size of the target image");
+        return MENDER_FAIL;
+    }
+    if (0 == ctx->command.length) {
+        return MENDER_OK;
+    }
+
+    /* COPY command is processed at once, other commands are followed by data */
+    if (MENDER_DELTA_COMMAND_COPY == ctx->command.type) {
+        return mender_delta_process_command(ctx, NULL, ctx->command.length);
+    }
+    ctx->state = MENDER_DELTA_STATE_DATA;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_delta_process_command(mender_delta_ctx_t *ctx, uint8_t *data, size_t length) {
+
+    assert(NULL != ctx);
+    mender_err_t ret;
+
+    /* Process data chunk by chunk, limited by the free space of the output buffer */
+    while (0 != length) {
+        uint8_t *output = &ctx->output.data[ctx->output.length];
+        size_t   count  = sizeof(ctx->output.data) - ctx->output.length;
+        if (count > length) {
+            count = length;
+        }
+
+        /* Treatment depending of the command */
+        if (MENDER_DELTA_COMMAND_INSERT == ctx->command.type) {
+            memcpy(output, data, count);
+        } else {
+            if (MENDER_OK != (ret = mender_flash_read_running_image(output, ctx->command.offset, count))) {
+                mender_log_error("Unable to read running image");
+                return ret;
+            }
+            if (MENDER_DELTA_COMMAND_ADD == ctx->command.type) {
+                for (size_t index = 0; index < count; index++) {
+                    output[index] += data[index];
+                }
+            }
+            ctx->command.offset += count;
+        }
+        if (NULL != data) {
+            data += count;
+        }
+        ctx->output.length += count;
+        ctx->command.length -= count;
+        length -= count;
+
+        /* Write output buffer to the flash when it is full */
+        if (sizeof(ctx->output.data) == ctx->output.length) {
+            if (MENDER_OK != (ret = mender_delta_flush(ctx))) {
+                return ret;
+            }
+        }
+    }
+
+    /* Check if the command is completed */
+    if (0 == ctx->command.length) {
+        ctx->state = MENDER_DELTA_STATE_COMMAND;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_delta_flush(mender_delta_ctx_t *ctx) {
+
+    assert(NULL != ctx);
+    mender_err_t ret;
+
+    /* Check if there is something to write */
+    if (0 == ctx->output.length) {
+        return MENDER_OK;
+    }
+
+    /* Write data to the flash */
+    mender_log_trace_begin(MENDER_LOG_TRACE_FLASH_WRITE);
+    ret = mender_flash_write(*ctx->flash_handle, ctx->output.data, ctx->output.index, ctx->output.length);
+    mender_log_trace_end(MENDER_LOG_TRACE_FLASH_WRITE);
+    if (MENDER_OK != ret) {
+        mender_log_error("Unable to write data to flash");
+        return ret;
+    }
+    ctx->output.index += ctx->output.length;
+    ctx->output.length = 0;
+
+    return MENDER_OK;
+}
+
+static size_t
+mender_delta_decode_uint32(uint8_t *data) {
+
+    assert(NULL != data);
+
+    return (size_t)data[0] | ((size_t)data[1] << 8) | ((size_t)data[2] << 16) | ((size_t)data[3] << 24);
+}
+
+#endif /* CONFIG_MENDER_CLIENT_DELTA_UPDATE */
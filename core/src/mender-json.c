@@ -0,0 +1,1170 @@
+/**
+ * @file      mender-json.c
+ * @brief     Mender JSON tokenizers and writer, documents are parsed as bytes arrive or in place and written without intermediate tree
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_JSON
+
+#include "mender-json.h"
+#include "mender-log.h"
+
+/**
+ * @brief Minimum capacity of the buffers allocated from the heap by the JSON writer (bytes)
+ */
+#define MENDER_JSON_WRITER_MIN_CAPACITY (128)
+
+/**
+ * @brief Maximum length of the number tokens converted by mender_json_token_number (bytes)
+ */
+#define MENDER_JSON_NUMBER_LENGTH (32)
+
+/**
+ * @brief Tokenizer states
+ */
+typedef enum {
+    MENDER_JSON_STATE_VALUE = 0,    /**< Expecting a value */
+    MENDER_JSON_STATE_ARRAY_FIRST,  /**< Expecting the first value of an array or the end of the array */
+    MENDER_JSON_STATE_OBJECT_FIRST, /**< Expecting the first key of an object or the end of the object */
+    MENDER_JSON_STATE_KEY,          /**< Expecting a key */
+    MENDER_JSON_STATE_COLON,        /**< Expecting the separator between a key and its value */
+    MENDER_JSON_STATE_NEXT,         /**< Expecting a separator or the end of a container */
+    MENDER_JSON_STATE_STRING,       /**< Parsing a key or a string */
+    MENDER_JSON_STATE_ESCAPE,       /**< Parsing an escape sequence */
+    MENDER_JSON_STATE_UNICODE,      /**< Parsing an unicode escape sequence */
+    MENDER_JSON_STATE_LITERAL,      /**< Parsing a number, true, false or null */
+    MENDER_JSON_STATE_DONE          /**< The document has been parsed */
+} mender_json_state_t;
+
+/**
+ * @brief Parse one character of the JSON document
+ * @param stream JSON tokenizer
+ * @param c Character
+ * @param consumed Set to false if the character must be parsed again (end of a literal)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_stream_parse_char(mender_json_stream_t *stream, char c, bool *consumed);
+
+/**
+ * @brief Parse the beginning of a value
+ * @param stream JSON tokenizer
+ * @param c First character of the value
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_stream_begin_value(mender_json_stream_t *stream, char c);
+
+/**
+ * @brief Open a container and invoke the callback
+ * @param stream JSON tokenizer
+ * @param array true if the container is an array, false if it is an object
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_stream_open(mender_json_stream_t *stream, bool array);
+
+/**
+ * @brief Close a container and invoke the callback
+ * @param stream JSON tokenizer
+ * @param array true if the container is an array, false if it is an object
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_stream_close(mender_json_stream_t *stream, bool array);
+
+/**
+ * @brief Terminate the literal currently parsed and invoke the callback
+ * @param stream JSON tokenizer
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_stream_end_literal(mender_json_stream_t *stream);
+
+/**
+ * @brief Update the state when a value has been parsed
+ * @param stream JSON tokenizer
+ */
+static void mender_json_stream_end_value(mender_json_stream_t *stream);
+
+/**
+ * @brief Append a code point to the token currently parsed, encoded in UTF-8
+ * @param stream JSON tokenizer
+ * @param code_point Code point
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_stream_append_unicode(mender_json_stream_t *stream, uint32_t code_point);
+
+/**
+ * @brief Append a character to the token currently parsed
+ * @param stream JSON tokenizer
+ * @param c Character
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_stream_append(mender_json_stream_t *stream, char c);
+
+/**
+ * @brief Check if a literal is a valid number
+ * @param literal Literal
+ * @return true if the literal is a valid number, false otherwise
+ */
+static bool mender_json_is_number(const char *literal);
+
+/**
+ * @brief Add a token found by the in-place tokenizer
+ * @param tokens Tokens, NULL if they are only counted
+ * @param capacity Number of tokens available
+ * @param count Number of tokens already found, incremented
+ * @param type Type of the token
+ * @param start Offset of the token in the document
+ * @param length Length of the token
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_json_tokenize_add(
+    mender_json_token_t *tokens, size_t capacity, size_t *count, mender_json_token_type_t type, size_t start, size_t length);
+
+/**
+ * @brief Check if a primitive found by the in-place tokenizer is a number, true, false or null
+ * @param data Primitive
+ * @param length Length of the primitive
+ * @return true if the primitive is valid, false otherwise
+ */
+static bool mender_json_is_primitive(const char *data, size_t length);
+
+/**
+ * @brief Encode a code point in UTF-8
+ * @param code_point Code point
+ * @param str Buffer of at least 4 bytes
+ * @return Length of the encoded code point (bytes)
+ */
+static size_t mender_json_utf8_encode(uint32_t code_point, char *str);
+
+/**
+ * @brief Parse the 4 hexadecimal digits of an unicode escape sequence
+ * @param str Digits
+ * @param value Value
+ * @return true if the digits are valid, false otherwise
+ */
+static bool mender_json_parse_hex(const char *str, uint32_t *value);
+
+/**
+ * @brief Write the separator and the key preceding a value
+ * @param writer JSON writer
+ * @param key Key of the value in the parent object, NULL at the root of the document or in an array
+ */
+static void mender_json_writer_begin_value(mender_json_writer_t *writer, const char *key);
+
+/**
+ * @brief Write a string between quotes, special characters are escaped
+ * @param writer JSON writer
+ * @param value String
+ */
+static void mender_json_writer_write_string(mender_json_writer_t *writer, const char *value);
+
+/**
+ * @brief Write data to the document
+ * @param writer JSON writer
+ * @param data Data
+ * @param length Length of the data
+ */
+static void mender_json_writer_write(mender_json_writer_t *writer, const char *data, size_t length);
+
+void
+mender_json_stream_init(mender_json_stream_t *stream, mender_err_t (*callback)(void *, mender_json_event_t, size_t, char *), void *arg) {
+
+    assert(NULL != stream);
+    assert(NULL != callback);
+
+    /* Initialize tokenizer */
+    memset(stream, 0, sizeof(mender_json_stream_t));
+    stream->state    = MENDER_JSON_STATE_VALUE;
+    stream->callback = callback;
+    stream->arg      = arg;
+}
+
+mender_err_t
+mender_json_stream_parse(mender_json_stream_t *stream, const char *data, size_t length) {
+
+    assert(NULL != stream);
+    assert((NULL != data) || (0 == length));
+    mender_err_t ret;
+
+    /* Parse data character by character */
+    size_t index = 0;
+    while (index < length) {
+        bool consumed = true;
+        if (MENDER_OK != (ret = mender_json_stream_parse_char(stream, data[index], &consumed))) {
+            return ret;
+        }
+        if (true == consumed) {
+            index++;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_json_stream_end(mender_json_stream_t *stream) {
+
+    assert(NULL != stream);
+    mender_err_t ret;
+
+    /* A literal at the root of the document is terminated by the end of the document */
+    if ((MENDER_JSON_STATE_LITERAL == stream->state) && (0 == stream->depth)) {
+        if (MENDER_OK != (ret = mender_json_stream_end_literal(stream))) {
+            return ret;
+        }
+    }
+
+    /* Check if the document is complete */
+    if (MENDER_JSON_STATE_DONE != stream->state) {
+        mender_log_error("Incomplete JSON document");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_json_tokenize(const char *data, size_t length, mender_json_token_t *tokens, size_t capacity, size_t *count) {
+
+    assert(NULL != data);
+    assert(NULL != count);
+    mender_json_state_t state = MENDER_JSON_STATE_VALUE;
+    size_t              parents[MENDER_JSON_MAX_DEPTH];
+    size_t              depth  = 0;
+    uint32_t            arrays = 0;
+    mender_err_t        ret;
+
+    /* Tokenize the document, the containers being parsed are kept in the stack of parents */
+    *count       = 0;
+    size_t index = 0;
+    while (index < length) {
+        char c = data[index];
+        if ((' ' == c) || ('\t' == c) || ('\n' == c) || ('\r' == c)) {
+            index++;
+            continue;
+        }
+        bool value = ((MENDER_JSON_STATE_VALUE == state) || (MENDER_JSON_STATE_ARRAY_FIRST == state));
+        if (('{' == c) || ('[' == c)) {
+            if ((false == value) || (depth >= MENDER_JSON_MAX_DEPTH)) {
+                goto INVALID;
+            }
+            if ((NULL != tokens) && (0 < depth) && (0 != (arrays & (1UL << (depth - 1))))) {
+                tokens[parents[depth - 1]].size++;
+            }
+            parents[depth] = *count;
+            mender_json_token_type_t type = ('{' == c) ? MENDER_JSON_TOKEN_OBJECT : MENDER_JSON_TOKEN_ARRAY;
+            if (MENDER_OK != (ret = mender_json_tokenize_add(tokens, capacity, count, type, index, 0))) {
+                return ret;
+            }
+            arrays = ('[' == c) ? (arrays | (1UL << depth)) : (arrays & ~(1UL << depth));
+            depth++;
+            state = ('{' == c) ? MENDER_JSON_STATE_OBJECT_FIRST : MENDER_JSON_STATE_ARRAY_FIRST;
+            index++;
+        } else if (('}' == c) || (']' == c)) {
+            bool array = (0 < depth) && (0 != (arrays & (1UL << (depth - 1))));
+            if ((0 == depth) || (array != (']' == c))
+                || ((MENDER_JSON_STATE_NEXT != state) && (MENDER_JSON_STATE_OBJECT_FIRST != state) && (MENDER_JSON_STATE_ARRAY_FIRST != state))) {
+                goto INVALID;
+            }
+            depth--;
+            if (NULL != tokens) {
+                tokens[parents[depth]].length = (uint32_t)(index + 1 - tokens[parents[depth]].start);
+                tokens[parents[depth]].skip   = (uint32_t)(*count - parents[depth]);
+            }
+            state = (0 == depth) ? MENDER_JSON_STATE_DONE : MENDER_JSON_STATE_NEXT;
+            index++;
+        } else if ('"' == c) {
+            bool key = ((MENDER_JSON_STATE_OBJECT_FIRST == state) || (MENDER_JSON_STATE_KEY == state));
+            if ((false == key) && (false == value)) {
+                goto INVALID;
+            }
+            size_t start = ++index;
+            while ((index < length) && ('"' != data[index])) {
+                if ((unsigned char)data[index] < 0x20) {
+                    goto INVALID;
+                }
+                index += ('\\' == data[index]) ? 2 : 1;
+            }
+            if (index >= length) {
+                goto INVALID;
+            }
+            if ((NULL != tokens) && (0 < depth) && ((true == key) || (0 != (arrays & (1UL << (depth - 1)))))) {
+                tokens[parents[depth - 1]].size++;
+            }
+            if (MENDER_OK != (ret = mender_json_tokenize_add(tokens, capacity, count, MENDER_JSON_TOKEN_STRING, start, index - start))) {
+                return ret;
+            }
+            state = (true == key) ? MENDER_JSON_STATE_COLON : ((0 == depth) ? MENDER_JSON_STATE_DONE : MENDER_JSON_STATE_NEXT);
+            index++;
+        } else if (':' == c) {
+            if (MENDER_JSON_STATE_COLON != state) {
+                goto INVALID;
+            }
+            state = MENDER_JSON_STATE_VALUE;
+            index++;
+        } else if (',' == c) {
+            if (MENDER_JSON_STATE_NEXT != state) {
+                goto INVALID;
+            }
+            state = (0 != (arrays & (1UL << (depth - 1)))) ? MENDER_JSON_STATE_VALUE : MENDER_JSON_STATE_KEY;
+            index++;
+        } else {
+            if (false == value) {
+                goto INVALID;
+            }
+            size_t start = index;
+            while ((index < length) && (NULL == strchr(" \t\n\r,:]}", data[index]))) {
+                index++;
+            }
+            if (false == mender_json_is_primitive(&data[start], index - start)) {
+                goto INVALID;
+            }
+            if ((NULL != tokens) && (0 < depth) && (0 != (arrays & (1UL << (depth - 1))))) {
+                tokens[parents[depth - 1]].size++;
+            }
+            if (MENDER_OK != (ret = mender_json_tokenize_add(tokens, capacity, count, MENDER_JSON_TOKEN_PRIMITIVE, start, index - start))) {
+                return ret;
+            }
+            state = (0 == depth) ? MENDER_JSON_STATE_DONE : MENDER_JSON_STATE_NEXT;
+        }
+    }
+
+    /* Check if the document is complete */
+    if (MENDER_JSON_STATE_DONE != state) {
+        goto INVALID;
+    }
+
+    return MENDER_OK;
+
+INVALID:
+
+    mender_log_error("Invalid JSON document");
+    return MENDER_FAIL;
+}
+
+mender_json_token_t *
+mender_json_token_get(const char *data, mender_json_token_t *object, const char *key) {
+
+    assert(NULL != data);
+    assert(NULL != object);
+    assert(NULL != key);
+
+    /* Check type */
+    if (MENDER_JSON_TOKEN_OBJECT != object->type) {
+        return NULL;
+    }
+
+    /* Search the member, the value follows its key */
+    size_t               length = strlen(key);
+    mender_json_token_t *token  = object + 1;
+    for (uint32_t index = 0; index < object->size; index++) {
+        if ((length == token->length) && (0 == memcmp(&data[token->start], key, length))) {
+            return token + 1;
+        }
+        token += 1 + token[1].skip;
+    }
+
+    return NULL;
+}
+
+mender_json_token_t *
+mender_json_token_at(mender_json_token_t *array, size_t index) {
+
+    assert(NULL != array);
+
+    /* Check type and index */
+    if ((MENDER_JSON_TOKEN_ARRAY != array->type) || (index >= array->size)) {
+        return NULL;
+    }
+
+    /* Skip the previous elements */
+    mender_json_token_t *token = array + 1;
+    while (0 < index--) {
+        token += token->skip;
+    }
+
+    return token;
+}
+
+char *
+mender_json_token_string(char *data, mender_json_token_t *token) {
+
+    assert(NULL != data);
+    assert(NULL != token);
+
+    /* Check type */
+    if (MENDER_JSON_TOKEN_STRING != token->type) {
+        return NULL;
+    }
+
+    /* The string is already decoded if it is terminated, strings of the document are followed by the closing quote otherwise */
+    char *str = &data[token->start];
+    if ('\0' == str[token->length]) {
+        return str;
+    }
+
+    /* Decode the escape sequences in place, the decoded string is never longer than the encoded one */
+    const char *src = str;
+    const char *end = str + token->length;
+    char       *dst = str;
+    while (src < end) {
+        if ('\\' != *src) {
+            *dst++ = *src++;
+            continue;
+        }
+        src++;
+        char c = *src++;
+        if (('"' == c) || ('\\' == c) || ('/' == c)) {
+            *dst++ = c;
+        } else if ('b' == c) {
+            *dst++ = '\b';
+        } else if ('f' == c) {
+            *dst++ = '\f';
+        } else if ('n' == c) {
+            *dst++ = '\n';
+        } else if ('r' == c) {
+            *dst++ = '\r';
+        } else if ('t' == c) {
+            *dst++ = '\t';
+        } else if (('u' == c) && (end - src >= 4)) {
+            uint32_t code_point;
+            if (false == mender_json_parse_hex(src, &code_point)) {
+                return NULL;
+            }
+            src += 4;
+            if ((code_point >= 0xD800) && (code_point < 0xDC00)) {
+                uint32_t low;
+                if ((end - src < 6) || ('\\' != src[0]) || ('u' != src[1]) || (false == mender_json_parse_hex(&src[2], &low)) || (low < 0xDC00)
+                    || (low > 0xDFFF)) {
+                    return NULL;
+                }
+                src += 6;
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+            } else if ((code_point >= 0xDC00) && (code_point <= 0xDFFF)) {
+                return NULL;
+            }
+            dst += mender_json_utf8_encode(code_point, dst);
+        } else {
+            return NULL;
+        }
+    }
+    *dst          = '\0';
+    token->length = (uint32_t)(dst - str);
+
+    return str;
+}
+
+mender_err_t
+mender_json_token_number(const char *data, mender_json_token_t *token, double *value) {
+
+    assert(NULL != data);
+    assert(NULL != token);
+    assert(NULL != value);
+    char  literal[MENDER_JSON_NUMBER_LENGTH];
+    char *end;
+
+    /* Check type, the primitive is copied because the document is not terminated after it */
+    if ((MENDER_JSON_TOKEN_PRIMITIVE != token->type) || (token->length >= sizeof(literal))) {
+        return MENDER_FAIL;
+    }
+    memcpy(literal, &data[token->start], token->length);
+    literal[token->length] = '\0';
+
+    /* Convert the number, true, false and null are rejected */
+    double number = strtod(literal, &end);
+    if ((end == literal) || ('\0' != *end)) {
+        return MENDER_FAIL;
+    }
+    *value = number;
+
+    return MENDER_OK;
+}
+
+void
+mender_json_writer_init(mender_json_writer_t *writer, char *buffer, size_t size) {
+
+    assert(NULL != writer);
+    assert((NULL == buffer) || (size > 0));
+
+    /* Initialize writer */
+    memset(writer, 0, sizeof(mender_json_writer_t));
+    if (NULL != buffer) {
+        writer->data     = buffer;
+        writer->capacity = size;
+        writer->limit    = size;
+        buffer[0]        = '\0';
+    } else {
+        writer->limit = size;
+    }
+}
+
+void
+mender_json_writer_begin_object(mender_json_writer_t *writer, const char *key) {
+
+    assert(NULL != writer);
+
+    /* Open object */
+    mender_json_writer_begin_value(writer, key);
+    if (writer->depth >= MENDER_JSON_MAX_DEPTH) {
+        mender_log_error("JSON document too deep");
+        writer->failed = true;
+        return;
+    }
+    mender_json_writer_write(writer, "{", 1);
+    writer->depth++;
+    writer->members &= ~(1UL << (writer->depth - 1));
+}
+
+void
+mender_json_writer_end_object(mender_json_writer_t *writer) {
+
+    assert(NULL != writer);
+
+    /* Close object */
+    if (0 == writer->depth) {
+        writer->failed = true;
+        return;
+    }
+    mender_json_writer_write(writer, "}", 1);
+    writer->depth--;
+}
+
+void
+mender_json_writer_begin_array(mender_json_writer_t *writer, const char *key) {
+
+    assert(NULL != writer);
+
+    /* Open array */
+    mender_json_writer_begin_value(writer, key);
+    if (writer->depth >= MENDER_JSON_MAX_DEPTH) {
+        mender_log_error("JSON document too deep");
+        writer->failed = true;
+        return;
+    }
+    mender_json_writer_write(writer, "[", 1);
+    writer->depth++;
+    writer->members &= ~(1UL << (writer->depth - 1));
+}
+
+void
+mender_json_writer_end_array(mender_json_writer_t *writer) {
+
+    assert(NULL != writer);
+
+    /* Close array */
+    if (0 == writer->depth) {
+        writer->failed = true;
+        return;
+    }
+    mender_json_writer_write(writer, "]", 1);
+    writer->depth--;
+}
+
+void
+mender_json_writer_add_string(mender_json_writer_t *writer, const char *key, const char *value) {
+
+    assert(NULL != writer);
+    assert(NULL != value);
+
+    /* Write string */
+    mender_json_writer_begin_value(writer, key);
+    mender_json_writer_write_string(writer, value);
+}
+
+mender_err_t
+mender_json_writer_end(mender_json_writer_t *writer) {
+
+    assert(NULL != writer);
+
+    /* Check if the document is complete */
+    if ((true == writer->failed) || (0 != writer->depth) || (0 == writer->length)) {
+        mender_log_error("Unable to write JSON document");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+void
+mender_json_writer_release(mender_json_writer_t *writer) {
+
+    assert(NULL != writer);
+
+    /* Release memory */
+    if (true == writer->allocated) {
+        mender_utils_free(writer->data);
+    }
+    writer->data      = NULL;
+    writer->length    = 0;
+    writer->capacity  = 0;
+    writer->allocated = false;
+}
+
+static mender_err_t
+mender_json_stream_parse_char(mender_json_stream_t *stream, char c, bool *consumed) {
+
+    assert(NULL != stream);
+    assert(NULL != consumed);
+    bool whitespace = (' ' == c) || ('\t' == c) || ('\n' == c) || ('\r' == c);
+
+    /* Treatment depending of the state */
+    switch (stream->state) {
+        case MENDER_JSON_STATE_VALUE:
+            if (true == whitespace) {
+                return MENDER_OK;
+            }
+            return mender_json_stream_begin_value(stream, c);
+        case MENDER_JSON_STATE_ARRAY_FIRST:
+            if (true == whitespace) {
+                return MENDER_OK;
+            }
+            if (']' == c) {
+                return mender_json_stream_close(stream, true);
+            }
+            return mender_json_stream_begin_value(stream, c);
+        case MENDER_JSON_STATE_OBJECT_FIRST:
+        case MENDER_JSON_STATE_KEY:
+            if (true == whitespace) {
+                return MENDER_OK;
+            }
+            if (('}' == c) && (MENDER_JSON_STATE_OBJECT_FIRST == stream->state)) {
+                return mender_json_stream_close(stream, false);
+            }
+            if ('"' == c) {
+                stream->token_length = 0;
+                stream->state        = MENDER_JSON_STATE_STRING;
+                stream->next_state   = MENDER_JSON_STATE_COLON;
+                return MENDER_OK;
+            }
+            break;
+        case MENDER_JSON_STATE_COLON:
+            if (true == whitespace) {
+                return MENDER_OK;
+            }
+            if (':' == c) {
+                stream->state = MENDER_JSON_STATE_VALUE;
+                return MENDER_OK;
+            }
+            break;
+        case MENDER_JSON_STATE_NEXT:
+            if (true == whitespace) {
+                return MENDER_OK;
+            }
+            if (',' == c) {
+                stream->state = (0 != (stream->arrays & (1UL << (stream->depth - 1)))) ? MENDER_JSON_STATE_VALUE : MENDER_JSON_STATE_KEY;
+                return MENDER_OK;
+            }
+            if ((']' == c) || ('}' == c)) {
+                return mender_json_stream_close(stream, (']' == c));
+            }
+            break;
+        case MENDER_JSON_STATE_STRING:
+            if (0 != stream->surrogate) {
+                /* The low surrogate of the unicode escape sequence is expected */
+                if ('\\' != c) {
+                    break;
+                }
+            }
+            if ('"' == c) {
+                stream->token[stream->token_length] = '\0';
+                if (MENDER_JSON_STATE_COLON == stream->next_state) {
+                    stream->state = MENDER_JSON_STATE_COLON;
+                    return stream->callback(stream->arg, MENDER_JSON_EVENT_KEY, stream->depth, stream->token);
+                }
+                mender_json_stream_end_value(stream);
+                return stream->callback(stream->arg, MENDER_JSON_EVENT_STRING, stream->depth, stream->token);
+            }
+            if ('\\' == c) {
+                stream->state = MENDER_JSON_STATE_ESCAPE;
+                return MENDER_OK;
+            }
+            if ((unsigned char)c < 0x20) {
+                break;
+            }
+            return mender_json_stream_append(stream, c);
+        case MENDER_JSON_STATE_ESCAPE:
+            stream->state = MENDER_JSON_STATE_STRING;
+            if ((0 != stream->surrogate) && ('u' != c)) {
+                break;
+            }
+            switch (c) {
+                case '"':
+                case '\\':
+                case '/':
+                    return mender_json_stream_append(stream, c);
+                case 'b':
+                    return mender_json_stream_append(stream, '\b');
+                case 'f':
+                    return mender_json_stream_append(stream, '\f');
+                case 'n':
+                    return mender_json_stream_append(stream, '\n');
+                case 'r':
+                    return mender_json_stream_append(stream, '\r');
+                case 't':
+                    return mender_json_stream_append(stream, '\t');
+                case 'u':
+                    stream->state   = MENDER_JSON_STATE_UNICODE;
+                    stream->unicode = 0;
+                    stream->digits  = 0;
+                    return MENDER_OK;
+                default:
+                    break;
+            }
+            break;
+        case MENDER_JSON_STATE_UNICODE:
+            if ((c >= '0') && (c <= '9')) {
+                stream->unicode = (stream->unicode << 4) | (uint32_t)(c - '0');
+            } else if ((c >= 'a') && (c <= 'f')) {
+                stream->unicode = (stream->unicode << 4) | (uint32_t)(c - 'a' + 10);
+            } else if ((c >= 'A') && (c <= 'F')) {
+                stream->unicode = (stream->unicode << 4) | (uint32_t)(c - 'A' + 10);
+            } else {
+                break;
+            }
+            if (4 == ++stream->digits) {
+                stream->state = MENDER_JSON_STATE_STRING;
+                if (0 != stream->surrogate) {
+                    /* Combine the surrogates */
+                    if ((stream->unicode < 0xDC00) || (stream->unicode > 0xDFFF)) {
+                        break;
+                    }
+                    uint32_t code_point = 0x10000 + ((stream->surrogate - 0xD800) << 10) + (stream->unicode - 0xDC00);
+                    stream->surrogate   = 0;
+                    return mender_json_stream_append_unicode(stream, code_point);
+                }
+                if ((stream->unicode >= 0xD800) && (stream->unicode <= 0xDBFF)) {
+                    /* High surrogate, the low surrogate follows */
+                    stream->surrogate = stream->unicode;
+                    return MENDER_OK;
+                }
+                if ((stream->unicode >= 0xDC00) && (stream->unicode <= 0xDFFF)) {
+                    break;
+                }
+                return mender_json_stream_append_unicode(stream, stream->unicode);
+            }
+            return MENDER_OK;
+        case MENDER_JSON_STATE_LITERAL:
+            if (((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'z')) || ('E' == c) || ('.' == c) || ('+' == c) || ('-' == c)) {
+                return mender_json_stream_append(stream, c);
+            }
+            /* End of the literal, the character is parsed again */
+            *consumed = false;
+            return mender_json_stream_end_literal(stream);
+        case MENDER_JSON_STATE_DONE:
+            if (true == whitespace) {
+                return MENDER_OK;
+            }
+            break;
+        default:
+            break;
+    }
+
+    mender_log_error("Invalid JSON document");
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_json_stream_begin_value(mender_json_stream_t *stream, char c) {
+
+    assert(NULL != stream);
+
+    /* Treatment depending of the first character of the value */
+    if (('{' == c) || ('[' == c)) {
+        return mender_json_stream_open(stream, ('[' == c));
+    }
+    if ('"' == c) {
+        stream->token_length = 0;
+        stream->state        = MENDER_JSON_STATE_STRING;
+        stream->next_state   = MENDER_JSON_STATE_NEXT;
+        return MENDER_OK;
+    }
+    if (((c >= '0') && (c <= '9')) || ('-' == c) || ('t' == c) || ('f' == c) || ('n' == c)) {
+        stream->token_length = 0;
+        stream->state        = MENDER_JSON_STATE_LITERAL;
+        return mender_json_stream_append(stream, c);
+    }
+
+    mender_log_error("Invalid JSON document");
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_json_stream_open(mender_json_stream_t *stream, bool array) {
+
+    assert(NULL != stream);
+
+    /* Check depth */
+    if (stream->depth >= MENDER_JSON_MAX_DEPTH) {
+        mender_log_error("JSON document nested too deeply");
+        return MENDER_FAIL;
+    }
+
+    /* Open container, the event is reported at the depth of the container */
+    size_t depth = stream->depth++;
+    if (true == array) {
+        stream->arrays |= (1UL << depth);
+        stream->state = MENDER_JSON_STATE_ARRAY_FIRST;
+    } else {
+        stream->arrays &= ~(1UL << depth);
+        stream->state = MENDER_JSON_STATE_OBJECT_FIRST;
+    }
+
+    return stream->callback(stream->arg, (true == array) ? MENDER_JSON_EVENT_ARRAY_BEGIN : MENDER_JSON_EVENT_OBJECT_BEGIN, depth, NULL);
+}
+
+static mender_err_t
+mender_json_stream_close(mender_json_stream_t *stream, bool array) {
+
+    assert(NULL != stream);
+
+    /* Check the container matches */
+    if ((0 == stream->depth) || (array != (0 != (stream->arrays & (1UL << (stream->depth - 1)))))) {
+        mender_log_error("Invalid JSON document");
+        return MENDER_FAIL;
+    }
+
+    /* Close container */
+    stream->depth--;
+    mender_json_stream_end_value(stream);
+
+    return stream->callback(stream->arg, (true == array) ? MENDER_JSON_EVENT_ARRAY_END : MENDER_JSON_EVENT_OBJECT_END, stream->depth, NULL);
+}
+
+static mender_err_t
+mender_json_stream_end_literal(mender_json_stream_t *stream) {
+
+    assert(NULL != stream);
+    mender_json_event_t event;
+
+    /* Check literal */
+    stream->token[stream->token_length] = '\0';
+    if (!strcmp(stream->token, "true")) {
+        event = MENDER_JSON_EVENT_TRUE;
+    } else if (!strcmp(stream->token, "false")) {
+        event = MENDER_JSON_EVENT_FALSE;
+    } else if (!strcmp(stream->token, "null")) {
+        event = MENDER_JSON_EVENT_NULL;
+    } else if (true == mender_json_is_number(stream->token)) {
+        event = MENDER_JSON_EVENT_NUMBER;
+    } else {
+        mender_log_error("Invalid JSON document");
+        return MENDER_FAIL;
+    }
+    mender_json_stream_end_value(stream);
+
+    return stream->callback(stream->arg, event, stream->depth, stream->token);
+}
+
+static void
+mender_json_stream_end_value(mender_json_stream_t *stream) {
+
+    assert(NULL != stream);
+
+    /* The document is done when the root value has been parsed */
+    stream->state = (0 == stream->depth) ? MENDER_JSON_STATE_DONE : MENDER_JSON_STATE_NEXT;
+}
+
+static mender_err_t
+mender_json_stream_append_unicode(mender_json_stream_t *stream, uint32_t code_point) {
+
+    assert(NULL != stream);
+    mender_err_t ret = MENDER_OK;
+
+    /* Encode code point in UTF-8 */
+    char   str[4];
+    size_t length = mender_json_utf8_encode(code_point, str);
+    for (size_t index = 0; (MENDER_OK == ret) && (index < length); index++) {
+        ret = mender_json_stream_append(stream, str[index]);
+    }
+
+    return ret;
+}
+
+static mender_err_t
+mender_json_stream_append(mender_json_stream_t *stream, char c) {
+
+    assert(NULL != stream);
+
+    /* Check length of the token */
+    if (stream->token_length >= CONFIG_MENDER_JSON_TOKEN_SIZE) {
+        mender_log_error("JSON token too long");
+        return MENDER_FAIL;
+    }
+
+    /* Append character */
+    stream->token[stream->token_length++] = c;
+
+    return MENDER_OK;
+}
+
+static bool
+mender_json_is_number(const char *literal) {
+
+    assert(NULL != literal);
+    const char *p = literal;
+
+    /* Check number: optional minus sign, integer part, optional fraction and optional exponent */
+    if ('-' == *p) {
+        p++;
+    }
+    if ('0' == *p) {
+        p++;
+    } else if ((*p >= '1') && (*p <= '9')) {
+        while ((*p >= '0') && (*p <= '9')) {
+            p++;
+        }
+    } else {
+        return false;
+    }
+    if ('.' == *p) {
+        p++;
+        if ((*p < '0') || (*p > '9')) {
+            return false;
+        }
+        while ((*p >= '0') && (*p <= '9')) {
+            p++;
+        }
+    }
+    if (('e' == *p) || ('E' == *p)) {
+        p++;
+        if (('+' == *p) || ('-' == *p)) {
+            p++;
+        }
+        if ((*p < '0') || (*p > '9')) {
+            return false;
+        }
+        while ((*p >= '0') && (*p <= '9')) {
+            p++;
+        }
+    }
+
+    return ('\0' == *p);
+}
+
+static void
+mender_json_writer_begin_value(mender_json_writer_t *writer, const char *key) {
+
+    assert(NULL != writer);
+
+    /* A single value is permitted at the root of the document */
+    if (0 == writer->depth) {
+        if (0 != writer->length) {
+            writer->failed = true;
+        }
+        return;
+    }
+
+    /* Write separator */
+    uint32_t mask = 1UL << (writer->depth - 1);
+    if (0 != (writer->members & mask)) {
+        mender_json_writer_write(writer, ",", 1);
+    }
+    writer->members |= mask;
+
+    /* Write key */
+    if (NULL != key) {
+        mender_json_writer_write_string(writer, key);
+        mender_json_writer_write(writer, ":", 1);
+    }
+}
+
+static void
+mender_json_writer_write_string(mender_json_writer_t *writer, const char *value) {
+
+    assert(NULL != writer);
+    assert(NULL != value);
+    const char *begin = value;
+
+    /* Write the string, consecutive characters not requiring escape sequences are written at once */
+    mender_json_writer_write(writer, "\"", 1);
+    for (const char *p = value; '\0' != *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if ((c >= 0x20) && ('"' != c) && ('\\' != c)) {
+            continue;
+        }
+        mender_json_writer_write(writer, begin, (size_t)(p - begin));
+        begin = p + 1;
+        switch (c) {
+            case '"':
+                mender_json_writer_write(writer, "\\\"", 2);
+                break;
+            case '\\':
+                mender_json_writer_write(writer, "\\\\", 2);
+                break;
+            case '\b':
+                mender_json_writer_write(writer, "\\b", 2);
+                break;
+            case '\f':
+                mender_json_writer_write(writer, "\\f", 2);
+                break;
+            case '\n':
+                mender_json_writer_write(writer, "\\n", 2);
+                break;
+            case '\r':
+                mender_json_writer_write(writer, "\\r", 2);
+                break;
+            case '\t':
+                mender_json_writer_write(writer, "\\t", 2);
+                break;
+            default: {
+                char escape[7];
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                mender_json_writer_write(writer, escape, 6);
+                break;
+            }
+        }
+    }
+    mender_json_writer_write(writer, begin, strlen(begin));
+    mender_json_writer_write(writer, "\"", 1);
+}
+
+static void
+mender_json_writer_write(mender_json_writer_t *writer, const char *data, size_t length) {
+
+    assert(NULL != writer);
+    assert((NULL != data) || (0 == length));
+
+    /* Nothing is written once an error occurred */
+    if ((true == writer->failed) || (0 == length)) {
+        return;
+    }
+
+    /* Grow the buffer if required, buffers provided by the caller are not reallocated */
+    if (writer->length + length + 1 > writer->capacity) {
+        size_t capacity = (0 != writer->capacity) ? writer->capacity : MENDER_JSON_WRITER_MIN_CAPACITY;
+        while (writer->length + length + 1 > capacity) {
+            capacity *= 2;
+        }
+        if ((0 != writer->limit) && (capacity > writer->limit)) {
+            capacity = writer->limit;
+        }
+        if ((writer->length + length + 1 > capacity) || ((NULL != writer->data) && (false == writer->allocated))) {
+            mender_log_error("JSON document too long");
+            writer->failed = true;
+            return;
+        }
+        char *tmp = (char *)mender_utils_realloc(writer->data, capacity);
+        if (NULL == tmp) {
+            mender_log_error("Unable to allocate memory");
+            writer->failed = true;
+            return;
+        }
+        writer->data      = tmp;
+        writer->capacity  = capacity;
+        writer->allocated = true;
+    }
+
+    /* Append data */
+    memcpy(&writer->data[writer->length], data, length);
+    writer->length += length;
+    writer->data[writer->length] = '\0';
+}
+
+static mender_err_t
+mender_json_tokenize_add(mender_json_token_t *tokens, size_t capacity, size_t *count, mender_json_token_type_t type, size_t start, size_t length) {
+
+    assert(NULL != count);
+
+    /* Check capacity, tokens are only counted if they are not provided */
+    if (NULL != tokens) {
+        if (*count >= capacity) {
+            mender_log_error("Not enough JSON tokens");
+            return MENDER_FAIL;
+        }
+        tokens[*count].type   = type;
+        tokens[*count].start  = (uint32_t)start;
+        tokens[*count].length = (uint32_t)length;
+        tokens[*count].size   = 0;
+        tokens[*count].skip   = 1;
+    }
+    (*count)++;
+
+    return MENDER_OK;
+}
+
+static bool
+mender_json_is_primitive(const char *data, size_t length) {
+
+    assert(NULL != data);
+    char literal[32];
+
+    /* Check true, false and null */
+    if (((4 == length) && (0 == memcmp(data, "true", 4))) || ((5 == length) && (0 == memcmp(data, "false", 5)))
+        || ((4 == length) && (0 == memcmp(data, "null", 4)))) {
+        return true;
+    }
+
+    /* Check number, the literal is terminated to be checked */
+    if ((0 == length) || (length >= sizeof(literal))) {
+        return false;
+    }
+    memcpy(literal, data, length);
+    literal[length] = '\0';
+
+    return mender_json_is_number(literal);
+}
+
+static size_t
+mender_json_utf8_encode(uint32_t code_point, char *str) {
+
+    assert(NULL != str);
+
+    /* Encode code point in UTF-8 */
+    if (code_point < 0x80) {
+        str[0] = (char)code_point;
+        return 1;
+    } else if (code_point < 0x800) {
+        str[0] = (char)(0xC0 | (code_point >> 6));
+        str[1] = (char)(0x80 | (code_point & 0x3F));
+        return 2;
+    } else if (code_point < 0x10000) {
+        str[0] = (char)(0xE0 | (code_point >> 12));
+        str[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+        str[2] = (char)(0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    str[0] = (char)(0xF0 | (code_point >> 18));
+    str[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+    str[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+    str[3] = (char)(0x80 | (code_point & 0x3F));
+
+    return 4;
+}
+
+static bool
+mender_json_parse_hex(const char *str, uint32_t *value) {
+
+    assert(NULL != str);
+    assert(NULL != value);
+
+    /* Parse the digits */
+    *value = 0;
+    for (size_t index = 0; index < 4; index++) {
+        char c = str[index];
+        if ((c >= '0') && (c <= '9')) {
+            *value = (*value << 4) | (uint32_t)(c - '0');
+        } else if ((c >= 'a') && (c <= 'f')) {
+            *value = (*value << 4) | (uint32_t)(c - 'a' + 10);
+        } else if ((c >= 'A') && (c <= 'F')) {
+            *value = (*value << 4) | (uint32_t)(c - 'A' + 10);
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
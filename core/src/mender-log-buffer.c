@@ -0,0 +1,284 @@
+/**
+ * @file      mender-log-buffer.c
+ * @brief     Mender log buffer, the logs are kept in a ring buffer in RAM so that they can be uploaded to the Mender server afterward
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mender-log.h"
+#include "mender-log-buffer.h"
+#include "mender-scheduler.h"
+
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+#ifdef CONFIG_MENDER_LOG_BUFFER_RETAINED
+#if defined(__ZEPHYR__)
+#include <zephyr/linker/section_tags.h>
+#elif defined(ESP_PLATFORM)
+#include <esp_attr.h>
+#endif
+#endif /* CONFIG_MENDER_LOG_BUFFER_RETAINED */
+
+/**
+ * @brief Default log buffer size (bytes)
+ */
+#ifndef CONFIG_MENDER_LOG_BUFFER_SIZE
+#define CONFIG_MENDER_LOG_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_LOG_BUFFER_SIZE */
+
+/**
+ * @brief Attributes of the log buffer, it is placed in a section which is not initialized at startup so that the logs survive a warm reboot
+ */
+#ifdef CONFIG_MENDER_LOG_BUFFER_RETAINED
+#if defined(__ZEPHYR__)
+#define MENDER_LOG_BUFFER_ATTRIBUTES __noinit
+#elif defined(ESP_PLATFORM)
+#define MENDER_LOG_BUFFER_ATTRIBUTES __NOINIT_ATTR
+#else
+#define MENDER_LOG_BUFFER_ATTRIBUTES __attribute__((section(".noinit")))
+#endif
+#else
+#define MENDER_LOG_BUFFER_ATTRIBUTES
+#endif /* CONFIG_MENDER_LOG_BUFFER_RETAINED */
+
+/**
+ * @brief Magic value of the log buffer, the content of the buffer is reset if it doesn't match
+ */
+#define MENDER_LOG_BUFFER_MAGIC (0x4D4C4F47)
+
+/**
+ * @brief Length of the header of the records: log level (1 byte), length of the message (1 byte), uptime in seconds (4 bytes)
+ */
+#define MENDER_LOG_BUFFER_HEADER_LENGTH (6)
+
+/**
+ * @brief Maximum length of the messages (bytes)
+ */
+#define MENDER_LOG_BUFFER_MESSAGE_LENGTH (255)
+
+/**
+ * @brief Log buffer, the records are written one after the other and wrap around the end of the data
+ */
+static struct {
+    uint32_t magic;                               /**< Magic value, the buffer has been initialized if it matches */
+    uint32_t start;                               /**< Offset of the oldest record in the data */
+    uint32_t used;                                /**< Length of the records in the data (bytes) */
+    uint32_t position;                            /**< Position of the oldest record, incremented each time a record is removed (bytes) */
+    uint8_t  data[CONFIG_MENDER_LOG_BUFFER_SIZE]; /**< Records */
+} mender_log_buffer MENDER_LOG_BUFFER_ATTRIBUTES;
+
+/**
+ * @brief Lock of the log buffer, the buffer is accessed from any context including the logging one, so that a mutex can't be used
+ */
+static bool mender_log_buffer_lock = false;
+
+/**
+ * @brief Flag set once the log buffer has been checked, the content of the retained RAM is checked once after each reboot
+ */
+static bool mender_log_buffer_checked = false;
+
+/**
+ * @brief Function used to reset the log buffer if it has not been initialized or if its content is not valid, the log buffer must be locked
+ */
+static void mender_log_buffer_check(void);
+
+/**
+ * @brief Function used to copy data to the log buffer, after the newest record
+ * @param data Data
+ * @param length Length of the data
+ */
+static void mender_log_buffer_copy_to(const void *data, size_t length);
+
+/**
+ * @brief Function used to copy data from the log buffer
+ * @param offset Offset of the data in the log buffer
+ * @param data Data
+ * @param length Length of the data
+ */
+static void mender_log_buffer_copy_from(uint32_t offset, void *data, size_t length);
+
+/**
+ * @brief Function used to remove the oldest record of the log buffer
+ */
+static void mender_log_buffer_drop(void);
+
+void
+mender_log_buffer_write(uint8_t level, const char *message, size_t length) {
+
+    assert(NULL != message);
+    uint8_t  header[MENDER_LOG_BUFFER_HEADER_LENGTH];
+    uint64_t uptime = 0;
+    uint32_t seconds;
+
+    /* Format header of the record, the message is truncated if it is too long */
+    if (length > MENDER_LOG_BUFFER_MESSAGE_LENGTH) {
+        length = MENDER_LOG_BUFFER_MESSAGE_LENGTH;
+    }
+    mender_scheduler_get_uptime(&uptime);
+    seconds   = (uint32_t)(uptime / 1000);
+    header[0] = level;
+    header[1] = (uint8_t)length;
+    memcpy(&header[2], &seconds, sizeof(seconds));
+
+    /* Take lock, the message is dropped rather than waiting if the buffer is being accessed */
+    if (true == __atomic_test_and_set(&mender_log_buffer_lock, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    mender_log_buffer_check();
+
+    /* Remove the oldest records to make room for the new one */
+    while (mender_log_buffer.used + MENDER_LOG_BUFFER_HEADER_LENGTH + length > CONFIG_MENDER_LOG_BUFFER_SIZE) {
+        mender_log_buffer_drop();
+    }
+
+    /* Append the record */
+    mender_log_buffer_copy_to(header, MENDER_LOG_BUFFER_HEADER_LENGTH);
+    mender_log_buffer_copy_to(message, length);
+
+    /* Release lock */
+    __atomic_clear(&mender_log_buffer_lock, __ATOMIC_RELEASE);
+}
+
+mender_err_t
+mender_log_buffer_read(mender_err_t (*callback)(uint8_t, uint32_t, const char *, size_t, void *), void *arg, uint32_t *end) {
+
+    assert(NULL != callback);
+    assert(NULL != end);
+    mender_err_t ret = MENDER_OK;
+    uint8_t      header[MENDER_LOG_BUFFER_HEADER_LENGTH];
+    char         message[MENDER_LOG_BUFFER_MESSAGE_LENGTH + 1];
+    uint32_t     seconds;
+    uint32_t     offset = 0;
+
+    /* Take lock, the messages logged by the callback are dropped meanwhile */
+    if (true == __atomic_test_and_set(&mender_log_buffer_lock, __ATOMIC_ACQUIRE)) {
+        mender_log_error("Log buffer is busy");
+        return MENDER_FAIL;
+    }
+    mender_log_buffer_check();
+
+    /* Parse the records from the oldest to the newest */
+    while ((MENDER_OK == ret) && (offset < mender_log_buffer.used)) {
+        mender_log_buffer_copy_from(offset, header, MENDER_LOG_BUFFER_HEADER_LENGTH);
+        mender_log_buffer_copy_from(offset + MENDER_LOG_BUFFER_HEADER_LENGTH, message, header[1]);
+        message[header[1]] = '\0';
+        memcpy(&seconds, &header[2], sizeof(seconds));
+        ret = callback(header[0], seconds, message, header[1], arg);
+        offset += MENDER_LOG_BUFFER_HEADER_LENGTH + header[1];
+    }
+    *end = mender_log_buffer.position + offset;
+
+    /* Release lock */
+    __atomic_clear(&mender_log_buffer_lock, __ATOMIC_RELEASE);
+
+    return ret;
+}
+
+void
+mender_log_buffer_consume(uint32_t end) {
+
+    /* Take lock, the function is called by the client only so that waiting for the lock is not required */
+    if (true == __atomic_test_and_set(&mender_log_buffer_lock, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    /* Remove the records up to the position, they may have been dropped in the meantime already */
+    while ((mender_log_buffer.used > 0) && ((int32_t)(end - mender_log_buffer.position) > 0)) {
+        mender_log_buffer_drop();
+    }
+
+    /* Release lock */
+    __atomic_clear(&mender_log_buffer_lock, __ATOMIC_RELEASE);
+}
+
+static void
+mender_log_buffer_check(void) {
+
+    uint8_t  header[MENDER_LOG_BUFFER_HEADER_LENGTH];
+    uint32_t offset = 0;
+
+    /* Check the log buffer once only */
+    if (true == mender_log_buffer_checked) {
+        return;
+    }
+    mender_log_buffer_checked = true;
+
+    /* Check the records, a record may be corrupted if the device has been reset while it was written to the retained RAM */
+    if ((MENDER_LOG_BUFFER_MAGIC == mender_log_buffer.magic) && (mender_log_buffer.start < CONFIG_MENDER_LOG_BUFFER_SIZE)
+        && (mender_log_buffer.used <= CONFIG_MENDER_LOG_BUFFER_SIZE)) {
+        while (offset + MENDER_LOG_BUFFER_HEADER_LENGTH <= mender_log_buffer.used) {
+            mender_log_buffer_copy_from(offset, header, MENDER_LOG_BUFFER_HEADER_LENGTH);
+            if ((header[0] < MENDER_LOG_LEVEL_ERR) || (header[0] > MENDER_LOG_LEVEL_DBG)) {
+                break;
+            }
+            offset += MENDER_LOG_BUFFER_HEADER_LENGTH + header[1];
+        }
+        if (offset == mender_log_buffer.used) {
+            return;
+        }
+    }
+
+    /* Reset the log buffer */
+    mender_log_buffer.start    = 0;
+    mender_log_buffer.used     = 0;
+    mender_log_buffer.position = 0;
+    mender_log_buffer.magic    = MENDER_LOG_BUFFER_MAGIC;
+}
+
+static void
+mender_log_buffer_copy_to(const void *data, size_t length) {
+
+    uint32_t offset = (mender_log_buffer.start + mender_log_buffer.used) % CONFIG_MENDER_LOG_BUFFER_SIZE;
+    size_t   first  = CONFIG_MENDER_LOG_BUFFER_SIZE - offset;
+
+    /* Copy the data, in two parts if it wraps around the end of the buffer */
+    if (length <= first) {
+        memcpy(&mender_log_buffer.data[offset], data, length);
+    } else {
+        memcpy(&mender_log_buffer.data[offset], data, first);
+        memcpy(mender_log_buffer.data, (const uint8_t *)data + first, length - first);
+    }
+    mender_log_buffer.used += (uint32_t)length;
+}
+
+static void
+mender_log_buffer_copy_from(uint32_t offset, void *data, size_t length) {
+
+    uint32_t begin = (mender_log_buffer.start + offset) % CONFIG_MENDER_LOG_BUFFER_SIZE;
+    size_t   first = CONFIG_MENDER_LOG_BUFFER_SIZE - begin;
+
+    /* Copy the data, in two parts if it wraps around the end of the buffer */
+    if (length <= first) {
+        memcpy(data, &mender_log_buffer.data[begin], length);
+    } else {
+        memcpy(data, &mender_log_buffer.data[begin], first);
+        memcpy((uint8_t *)data + first, mender_log_buffer.data, length - first);
+    }
+}
+
+static void
+mender_log_buffer_drop(void) {
+
+    uint8_t header[MENDER_LOG_BUFFER_HEADER_LENGTH];
+
+    /* Remove the oldest record */
+    mender_log_buffer_copy_from(0, header, MENDER_LOG_BUFFER_HEADER_LENGTH);
+    uint32_t length = MENDER_LOG_BUFFER_HEADER_LENGTH + header[1];
+    mender_log_buffer.start = (mender_log_buffer.start + length) % CONFIG_MENDER_LOG_BUFFER_SIZE;
+    mender_log_buffer.used -= length;
+    mender_log_buffer.position += length;
+}
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
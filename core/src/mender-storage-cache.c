@@ -0,0 +1,337 @@
+/**
+ * @file      mender-storage-cache.c
+ * @brief     Mender storage cache, items are kept in RAM after the first read from the storage and handed out as const views
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "mender-log.h"
+#include "mender-storage-cache.h"
+
+#ifdef CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA
+#if defined(__ZEPHYR__)
+#include <zephyr/linker/section_tags.h>
+#elif defined(ESP_PLATFORM)
+#include <esp_attr.h>
+#endif
+
+/**
+ * @brief Default size of the deployment data retained across the restart (bytes)
+ */
+#ifndef CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA_SIZE
+#define CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA_SIZE (256)
+#endif /* CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA_SIZE */
+
+/**
+ * @brief Attributes of the retained deployment data, it is placed in a section which is not initialized at startup so that it survives a warm reboot
+ */
+#if defined(__ZEPHYR__)
+#define MENDER_STORAGE_CACHE_RETAINED_ATTRIBUTES __noinit
+#elif defined(ESP_PLATFORM)
+#define MENDER_STORAGE_CACHE_RETAINED_ATTRIBUTES __NOINIT_ATTR
+#else
+#define MENDER_STORAGE_CACHE_RETAINED_ATTRIBUTES __attribute__((section(".noinit")))
+#endif
+
+/**
+ * @brief Magic value of the retained deployment data, the content is ignored if it doesn't match
+ */
+#define MENDER_STORAGE_CACHE_RETAINED_MAGIC (0x4D524554)
+
+#endif /* CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA */
+
+/**
+ * @brief Cached items
+ */
+typedef enum {
+    MENDER_STORAGE_CACHE_PRIVATE_KEY = 0, /**< Private key */
+    MENDER_STORAGE_CACHE_PUBLIC_KEY,      /**< Public key */
+    MENDER_STORAGE_CACHE_DEPLOYMENT_DATA, /**< Deployment data */
+    MENDER_STORAGE_CACHE_ITEMS            /**< Number of cached items */
+} mender_storage_cache_item_t;
+
+/**
+ * @brief Cache entry
+ */
+typedef struct {
+    bool   cached; /**< Item has been read from the storage, data is NULL if it has not been found */
+    void  *data;   /**< Data of the item, as allocated by the storage */
+    size_t length; /**< Length of the item */
+} mender_storage_cache_entry_t;
+
+/**
+ * @brief Cache entries
+ */
+static mender_storage_cache_entry_t mender_storage_cache_entries[MENDER_STORAGE_CACHE_ITEMS];
+
+#ifdef CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA
+
+/**
+ * @brief Deployment data retained across the restart following the installation of an artifact
+ */
+static struct {
+    uint32_t magic;                                                    /**< Magic value, the deployment data is retained if it matches */
+    uint32_t length;                                                   /**< Length of the deployment data */
+    uint32_t crc;                                                      /**< CRC-32 of the length and of the deployment data */
+    uint8_t  data[CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA_SIZE]; /**< Deployment data */
+} mender_storage_cache_retained MENDER_STORAGE_CACHE_RETAINED_ATTRIBUTES;
+
+/**
+ * @brief Flag set when the deployment data is retained only, it has not been written to the storage
+ */
+static bool mender_storage_cache_retained_only = false;
+
+#endif /* CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA */
+
+/**
+ * @brief Function used to fill a cache entry with the result of a storage read
+ * @param item Cached item
+ * @param data Data of the item, the cache takes ownership of it
+ * @param length Length of the item
+ */
+static void mender_storage_cache_fill(mender_storage_cache_item_t item, void *data, size_t length);
+
+/**
+ * @brief Function used to invalidate a cache entry
+ * @param item Cached item
+ */
+static void mender_storage_cache_invalidate(mender_storage_cache_item_t item);
+
+#ifdef CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA
+
+/**
+ * @brief Function used to compute the CRC of the retained deployment data
+ * @return CRC-32 of the length and of the deployment data
+ */
+static uint32_t mender_storage_cache_retained_crc(void);
+
+/**
+ * @brief Function used to read the retained deployment data, the content of the retained RAM is verified
+ * @param deployment_data Copy of the deployment data, to be released with mender_utils_free
+ * @param deployment_data_length Deployment data length
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the deployment data is not retained, error code otherwise
+ */
+static mender_err_t mender_storage_cache_retained_read(void **deployment_data, size_t *deployment_data_length);
+
+#endif /* CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA */
+
+mender_err_t
+mender_storage_cache_set_authentication_keys(unsigned char *private_key, size_t private_key_length, unsigned char *public_key, size_t public_key_length) {
+
+    /* Invalidate the cached keys before the storage is modified */
+    mender_storage_cache_invalidate(MENDER_STORAGE_CACHE_PRIVATE_KEY);
+    mender_storage_cache_invalidate(MENDER_STORAGE_CACHE_PUBLIC_KEY);
+
+    return mender_storage_set_authentication_keys(private_key, private_key_length, public_key, public_key_length);
+}
+
+mender_err_t
+mender_storage_cache_get_authentication_keys(const unsigned char **private_key,
+                                             size_t               *private_key_length,
+                                             const unsigned char **public_key,
+                                             size_t               *public_key_length) {
+
+    assert(NULL != private_key);
+    assert(NULL != private_key_length);
+    assert(NULL != public_key);
+    assert(NULL != public_key_length);
+    mender_storage_cache_entry_t *private_entry = &mender_storage_cache_entries[MENDER_STORAGE_CACHE_PRIVATE_KEY];
+    mender_storage_cache_entry_t *public_entry  = &mender_storage_cache_entries[MENDER_STORAGE_CACHE_PUBLIC_KEY];
+    mender_err_t                  ret;
+
+    /* Read the keys from the storage on the first call only */
+    if ((false == private_entry->cached) || (false == public_entry->cached)) {
+        unsigned char *private_data   = NULL;
+        size_t         private_length = 0;
+        unsigned char *public_data    = NULL;
+        size_t         public_length  = 0;
+        if ((MENDER_OK != (ret = mender_storage_get_authentication_keys(&private_data, &private_length, &public_data, &public_length)))
+            && (MENDER_NOT_FOUND != ret)) {
+            return ret;
+        }
+        mender_storage_cache_fill(MENDER_STORAGE_CACHE_PRIVATE_KEY, private_data, private_length);
+        mender_storage_cache_fill(MENDER_STORAGE_CACHE_PUBLIC_KEY, public_data, public_length);
+    }
+
+    /* Hand out views on the cached keys */
+    *private_key        = private_entry->data;
+    *private_key_length = private_entry->length;
+    *public_key         = public_entry->data;
+    *public_key_length  = public_entry->length;
+
+    return ((NULL != *private_key) && (NULL != *public_key)) ? MENDER_OK : MENDER_NOT_FOUND;
+}
+
+mender_err_t
+mender_storage_cache_delete_authentication_keys(void) {
+
+    /* Invalidate the cached keys before the storage is modified */
+    mender_storage_cache_invalidate(MENDER_STORAGE_CACHE_PRIVATE_KEY);
+    mender_storage_cache_invalidate(MENDER_STORAGE_CACHE_PUBLIC_KEY);
+
+    return mender_storage_delete_authentication_keys();
+}
+
+mender_err_t
+mender_storage_cache_set_deployment_data(const void *deployment_data, size_t deployment_data_length) {
+
+    /* Invalidate the cached deployment data before the storage is modified */
+    mender_storage_cache_invalidate(MENDER_STORAGE_CACHE_DEPLOYMENT_DATA);
+
+#ifdef CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA
+    /* Keep the deployment data in the retained RAM if it fits, the storage is not written */
+    mender_storage_cache_retained.magic = 0;
+    if (deployment_data_length <= sizeof(mender_storage_cache_retained.data)) {
+        memcpy(mender_storage_cache_retained.data, deployment_data, deployment_data_length);
+        mender_storage_cache_retained.length = (uint32_t)deployment_data_length;
+        mender_storage_cache_retained.crc    = mender_storage_cache_retained_crc();
+        mender_storage_cache_retained.magic  = MENDER_STORAGE_CACHE_RETAINED_MAGIC;
+        mender_storage_cache_retained_only   = true;
+        return MENDER_OK;
+    }
+    mender_storage_cache_retained_only = false;
+#endif /* CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA */
+
+    return mender_storage_set_deployment_data(deployment_data, deployment_data_length);
+}
+
+mender_err_t
+mender_storage_cache_get_deployment_data(const void **deployment_data, size_t *deployment_data_length) {
+
+    assert(NULL != deployment_data);
+    assert(NULL != deployment_data_length);
+    mender_storage_cache_entry_t *entry = &mender_storage_cache_entries[MENDER_STORAGE_CACHE_DEPLOYMENT_DATA];
+    mender_err_t                  ret;
+
+    /* Read the deployment data from the storage on the first call only */
+    if (false == entry->cached) {
+        void  *data   = NULL;
+        size_t length = 0;
+#ifdef CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA
+        /* Use the retained deployment data if it is valid, falling back to the storage */
+        if ((MENDER_OK != (ret = mender_storage_cache_retained_read(&data, &length))) && (MENDER_NOT_FOUND != ret)) {
+            return ret;
+        }
+        mender_storage_cache_retained_only = (MENDER_OK == ret);
+        if (false == mender_storage_cache_retained_only) {
+            if ((MENDER_OK != (ret = mender_storage_get_deployment_data(&data, &length))) && (MENDER_NOT_FOUND != ret)) {
+                return ret;
+            }
+        }
+#else
+        if ((MENDER_OK != (ret = mender_storage_get_deployment_data(&data, &length))) && (MENDER_NOT_FOUND != ret)) {
+            return ret;
+        }
+#endif /* CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA */
+        mender_storage_cache_fill(MENDER_STORAGE_CACHE_DEPLOYMENT_DATA, data, length);
+    }
+
+    /* Hand out a view on the cached deployment data */
+    *deployment_data        = entry->data;
+    *deployment_data_length = entry->length;
+
+    return (NULL != *deployment_data) ? MENDER_OK : MENDER_NOT_FOUND;
+}
+
+mender_err_t
+mender_storage_cache_delete_deployment_data(void) {
+
+    /* Invalidate the cached deployment data before the storage is modified */
+    mender_storage_cache_invalidate(MENDER_STORAGE_CACHE_DEPLOYMENT_DATA);
+
+#ifdef CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA
+    /* Release the retained deployment data, the storage is not modified if the deployment data has not been written to it */
+    mender_storage_cache_retained.magic = 0;
+    if (true == mender_storage_cache_retained_only) {
+        mender_storage_cache_retained_only = false;
+        return MENDER_OK;
+    }
+#endif /* CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA */
+
+    return mender_storage_delete_deployment_data();
+}
+
+mender_err_t
+mender_storage_cache_exit(void) {
+
+    /* Release all the cached items */
+    for (size_t index = 0; index < MENDER_STORAGE_CACHE_ITEMS; index++) {
+        mender_storage_cache_invalidate((mender_storage_cache_item_t)index);
+    }
+
+    return MENDER_OK;
+}
+
+static void
+mender_storage_cache_fill(mender_storage_cache_item_t item, void *data, size_t length) {
+
+    mender_storage_cache_entry_t *entry = &mender_storage_cache_entries[item];
+
+    /* Replace the cached item, items not found are cached too so that the storage is not read again */
+    mender_utils_free(entry->data);
+    entry->cached = true;
+    entry->data   = data;
+    entry->length = (NULL != data) ? length : 0;
+}
+
+static void
+mender_storage_cache_invalidate(mender_storage_cache_item_t item) {
+
+    mender_storage_cache_entry_t *entry = &mender_storage_cache_entries[item];
+
+    /* Release the cached item, it is read from the storage again on the next call */
+    mender_utils_free(entry->data);
+    entry->cached = false;
+    entry->data   = NULL;
+    entry->length = 0;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA
+
+static uint32_t
+mender_storage_cache_retained_crc(void) {
+
+    /* Compute CRC of the length and of the data */
+    uint32_t crc = mender_utils_crc32(0, &mender_storage_cache_retained.length, sizeof(mender_storage_cache_retained.length));
+
+    return mender_utils_crc32(crc, mender_storage_cache_retained.data, mender_storage_cache_retained.length);
+}
+
+static mender_err_t
+mender_storage_cache_retained_read(void **deployment_data, size_t *deployment_data_length) {
+
+    assert(NULL != deployment_data);
+    assert(NULL != deployment_data_length);
+
+    /* Check the content of the retained RAM, it is not initialized after a cold boot */
+    if ((MENDER_STORAGE_CACHE_RETAINED_MAGIC != mender_storage_cache_retained.magic)
+        || (mender_storage_cache_retained.length > sizeof(mender_storage_cache_retained.data))
+        || (mender_storage_cache_retained_crc() != mender_storage_cache_retained.crc)) {
+        mender_storage_cache_retained.magic = 0;
+        return MENDER_NOT_FOUND;
+    }
+
+    /* Copy the deployment data, the cache takes ownership of it */
+    if (NULL == (*deployment_data = mender_utils_malloc((0 != mender_storage_cache_retained.length) ? mender_storage_cache_retained.length : 1))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    memcpy(*deployment_data, mender_storage_cache_retained.data, mender_storage_cache_retained.length);
+    *deployment_data_length = mender_storage_cache_retained.length;
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_RETAINED_DEPLOYMENT_DATA */
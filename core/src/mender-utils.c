@@ -18,6 +18,9 @@
  * limitations under the License.
  */
 
+#ifdef CONFIG_MENDER_HTTP_GZIP
+#include <zlib.h>
+#endif /* CONFIG_MENDER_HTTP_GZIP */
 #include "mender-log.h"
 
 /* ASCII unit separator */
@@ -25,6 +28,264 @@
 /* ASCII record separator */
 #define MENDER_KEY_VALUE_SEPARATOR "\x1E"
 
+/**
+ * @brief Default arena block size (bytes), allocations larger than the block size get a block of their own
+ */
+#ifndef CONFIG_MENDER_UTILS_ARENA_BLOCK_SIZE
+#define CONFIG_MENDER_UTILS_ARENA_BLOCK_SIZE (512)
+#endif /* CONFIG_MENDER_UTILS_ARENA_BLOCK_SIZE */
+
+/**
+ * @brief Default maximum period of the works retried after failures (seconds), 0 to disable the backoff
+ */
+#ifndef CONFIG_MENDER_CLIENT_BACKOFF_MAX_INTERVAL
+#define CONFIG_MENDER_CLIENT_BACKOFF_MAX_INTERVAL (3600)
+#endif /* CONFIG_MENDER_CLIENT_BACKOFF_MAX_INTERVAL */
+
+#ifdef CONFIG_MENDER_HTTP_GZIP
+
+/**
+ * @brief Default base two logarithm of the compression window size
+ */
+#ifndef CONFIG_MENDER_HTTP_GZIP_WINDOW_BITS
+#define CONFIG_MENDER_HTTP_GZIP_WINDOW_BITS (10)
+#endif /* CONFIG_MENDER_HTTP_GZIP_WINDOW_BITS */
+
+/**
+ * @brief Memory level of the compression, the hash table is sized on the window so that the compressor uses about (window size * 4) + 6 kB
+ */
+#define MENDER_UTILS_GZIP_MEM_LEVEL (CONFIG_MENDER_HTTP_GZIP_WINDOW_BITS - 7)
+
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+/**
+ * @brief Alignment of the memory allocated from an arena
+ */
+#define MENDER_UTILS_ARENA_ALIGNMENT (sizeof(void *) > sizeof(uint64_t) ? sizeof(void *) : sizeof(uint64_t))
+
+/**
+ * @brief Offset of the data in an arena block, the data follow the block header
+ */
+#define MENDER_UTILS_ARENA_BLOCK_HEADER_SIZE \
+    ((sizeof(mender_utils_arena_block_t) + MENDER_UTILS_ARENA_ALIGNMENT - 1) / MENDER_UTILS_ARENA_ALIGNMENT * MENDER_UTILS_ARENA_ALIGNMENT)
+
+/**
+ * @brief Version of the records, it is the first byte of the record
+ */
+#define MENDER_UTILS_RECORD_VERSION (1)
+
+/**
+ * @brief Size of the header of the records, version and number of fields (bytes)
+ */
+#define MENDER_UTILS_RECORD_HEADER_SIZE (3)
+
+/**
+ * @brief Size of the CRC at the end of the records (bytes)
+ */
+#define MENDER_UTILS_RECORD_CRC_SIZE (4)
+
+/**
+ * @brief Minimum capacity of the buffers allocated for the records (bytes)
+ */
+#define MENDER_UTILS_RECORD_MIN_CAPACITY (64)
+
+/**
+ * @brief Header of the block of a packed key-store, it is followed by the items and the strings, the empty items of the key-store reference the block
+ */
+typedef struct {
+    uint32_t refcount; /**< Number of key-stores sharing the block, updated atomically because the key-stores are copied in all the threads */
+    size_t   size;     /**< Size of the block including the header (bytes) */
+} mender_utils_keystore_block_t;
+
+/**
+ * @brief Offset of the items in the block of a packed key-store, the header is padded to preserve the alignment of the items
+ */
+#define MENDER_UTILS_KEYSTORE_BLOCK_HEADER_SIZE \
+    ((sizeof(mender_utils_keystore_block_t) + MENDER_UTILS_ARENA_ALIGNMENT - 1) / MENDER_UTILS_ARENA_ALIGNMENT * MENDER_UTILS_ARENA_ALIGNMENT)
+
+/**
+ * @brief State of the pseudo-random generator of the backoff jitter, never 0
+ * @note The state is shared by the works of the client and the add-ons, which may run concurrently, it is updated with compare-exchange operations
+ */
+static uint32_t mender_utils_backoff_state = 2463534242UL;
+
+/**
+ * @brief Allocator, the standard library one unless it is set by the application
+ */
+static mender_utils_allocator_t mender_utils_allocator = { malloc, realloc, free };
+
+/**
+ * @brief Function used to create a packed key-store, the items and the strings are allocated in one block
+ * @param length Length of the key-store
+ * @param size Size of the strings including the null terminators (bytes)
+ * @param strings Beginning of the strings in the block
+ * @return Key-store if the function succeeds, NULL otherwise
+ */
+static mender_keystore_t *mender_utils_keystore_pack(size_t length, size_t size, char **strings);
+
+/**
+ * @brief Function used to copy a string in the block of a packed key-store
+ * @param strings Position of the next string in the block, it is updated
+ * @param s String to copy
+ * @return Copied string
+ */
+static char *mender_utils_keystore_pack_string(char **strings, const char *s);
+
+/**
+ * @brief Function used to search an item of a key-value table by bisection
+ * @param table Key-value table
+ * @param name Name of the item
+ * @param index Index of the item if it is found, index where it should be inserted otherwise
+ * @return true if the item is found, false otherwise
+ */
+static bool mender_utils_kv_table_search(mender_utils_kv_table_t *table, const char *name, size_t *index);
+
+/**
+ * @brief Function used to retrieve the block of a packed key-store
+ * @param keystore Key-store
+ * @return Block if the key-store is packed, NULL otherwise
+ */
+static mender_utils_keystore_block_t *mender_utils_keystore_get_block(mender_keystore_t *keystore);
+
+/**
+ * @brief Function used to check if memory belongs to the block of a packed key-store
+ * @param block Block, NULL if the key-store is not packed
+ * @param ptr Pointer to the memory
+ * @return true if the memory belongs to the block, false otherwise
+ */
+static bool mender_utils_keystore_block_contains(mender_utils_keystore_block_t *block, void *ptr);
+
+/**
+ * @brief Function used to append data to a string written to a buffer, the data which does not fit is only counted
+ * @param buffer Buffer, NULL to count the data only
+ * @param size Size of the buffer, one byte is kept for the null terminator
+ * @param offset Length of the string already written
+ * @param data Data to append
+ * @param length Length of the data
+ * @return Length of the string with the data appended
+ */
+static size_t mender_utils_buffer_append(char *buffer, size_t size, size_t offset, const char *data, size_t length);
+
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+
+/**
+ * @brief Header of the accounted allocations, it precedes the memory returned to the caller
+ */
+typedef struct {
+    size_t                     size;   /**< Size of the memory returned to the caller (bytes) */
+    mender_utils_heap_module_t module; /**< Module to which the allocation is accounted */
+} mender_utils_heap_header_t;
+
+/**
+ * @brief Offset of the memory returned to the caller, the header is padded to preserve the alignment of the allocator
+ */
+#define MENDER_UTILS_HEAP_HEADER_SIZE \
+    ((sizeof(mender_utils_heap_header_t) + MENDER_UTILS_ARENA_ALIGNMENT - 1) / MENDER_UTILS_ARENA_ALIGNMENT * MENDER_UTILS_ARENA_ALIGNMENT)
+
+/**
+ * @brief Heap statistics of the modules, the last entry is the whole client, they are updated atomically because allocations occur in all the threads
+ */
+static mender_utils_heap_stats_t mender_utils_heap_stats[MENDER_UTILS_HEAP_MODULE_ALL + 1];
+
+/**
+ * @brief Function used to account an allocation or a release to the statistics
+ * @param stats Heap statistics
+ * @param size Size of the memory (bytes)
+ * @param allocated Memory is allocated if true, released otherwise
+ */
+static void mender_utils_heap_account(mender_utils_heap_stats_t *stats, size_t size, bool allocated);
+
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+
+/**
+ * @brief Block of a pool, the header precedes the memory returned to the caller
+ */
+typedef struct mender_utils_heap_pool_block_t {
+    size_t                                 size; /**< Size of the block including the header (bytes) */
+    struct mender_utils_heap_pool_block_t *next; /**< Next free block by address, only used when the block is free */
+} mender_utils_heap_pool_block_t;
+
+/**
+ * @brief Size of the header of the blocks of the pools, it is padded to preserve the alignment
+ */
+#define MENDER_UTILS_HEAP_POOL_BLOCK_HEADER_SIZE \
+    ((sizeof(mender_utils_heap_pool_block_t) + MENDER_UTILS_ARENA_ALIGNMENT - 1) / MENDER_UTILS_ARENA_ALIGNMENT * MENDER_UTILS_ARENA_ALIGNMENT)
+
+/**
+ * @brief Pools of the memory budget, one per module, a module without pool uses the one of MENDER_UTILS_HEAP_MODULE_OTHER
+ */
+static struct {
+    uint8_t                        *start; /**< Beginning of the pool, NULL if the module has no pool */
+    uint8_t                        *end;   /**< End of the pool */
+    mender_utils_heap_pool_block_t *free;  /**< Free blocks sorted by address */
+} mender_utils_heap_pools[MENDER_UTILS_HEAP_MODULE_ALL];
+
+/**
+ * @brief Memory budget, the allocations are served from the allocator while it is not set
+ */
+static mender_utils_heap_budget_t mender_utils_heap_budget;
+static bool                       mender_utils_heap_budget_set = false;
+
+/**
+ * @brief Function used to retrieve the pool containing memory
+ * @param ptr Pointer to the memory
+ * @return Index of the pool, MENDER_UTILS_HEAP_MODULE_ALL if the memory is not in the pools
+ */
+static size_t mender_utils_heap_pool_find(void *ptr);
+
+/**
+ * @brief Function used to allocate memory from a pool, the caller must hold the lock
+ * @param pool Index of the pool
+ * @param size Size of the memory (bytes)
+ * @return Pointer to the memory, NULL if the pool is exhausted
+ */
+static void *mender_utils_heap_pool_take(size_t pool, size_t size);
+
+/**
+ * @brief Function used to release memory to a pool, adjacent free blocks are merged, the caller must hold the lock
+ * @param pool Index of the pool
+ * @param ptr Pointer to the memory
+ */
+static void mender_utils_heap_pool_give(size_t pool, void *ptr);
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
+/**
+ * @brief Function used to allocate memory from the pool of the module if the memory budget is set, from the allocator otherwise
+ * @param module Module of the allocation
+ * @param size Size of the memory (bytes)
+ * @return Pointer to the memory, NULL if an error occurred
+ */
+static void *mender_utils_heap_raw_malloc(mender_utils_heap_module_t module, size_t size);
+
+/**
+ * @brief Function used to resize memory in its pool if it belongs to the memory budget, with the allocator otherwise
+ * @param module Module of the allocation, it selects the pool if new memory is allocated
+ * @param ptr Pointer to the memory, NULL to allocate new memory
+ * @param size New size of the memory (bytes)
+ * @return Pointer to the memory, NULL if an error occurred and the memory is not modified
+ */
+static void *mender_utils_heap_raw_realloc(mender_utils_heap_module_t module, void *ptr, size_t size);
+
+/**
+ * @brief Function used to release memory to its pool if it belongs to the memory budget, to the allocator otherwise
+ * @param ptr Pointer to the memory
+ */
+static void mender_utils_heap_raw_free(void *ptr);
+
+#if !defined(CONFIG_MENDER_TINY) && (defined(CONFIG_MENDER_UTILS_HEAP_ACCOUNTING) || defined(CONFIG_MENDER_CLIENT_MEMORY_BUDGET))
+
+/**
+ * @brief Function used by cJSON to allocate memory, it is accounted to the JSON module
+ * @param size Size of the memory (bytes)
+ * @return Pointer to the memory, NULL if an error occurred
+ */
+static void *mender_utils_heap_json_malloc(size_t size);
+
+#endif /* !CONFIG_MENDER_TINY && (CONFIG_MENDER_UTILS_HEAP_ACCOUNTING || CONFIG_MENDER_CLIENT_MEMORY_BUDGET) */
+
 char *
 mender_utils_http_status_to_string(int status) {
 
@@ -159,6 +420,8 @@ mender_utils_deployment_status_to_string(mender_deployment_status_t deployment_s
         return "failure";
     } else if (MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED == deployment_status) {
         return "already-installed";
+    } else if (MENDER_DEPLOYMENT_STATUS_PAUSE_BEFORE_INSTALLING == deployment_status) {
+        return "pause_before_installing";
     }
 
     return NULL;
@@ -168,7 +431,7 @@ mender_keystore_t *
 mender_utils_keystore_new(size_t length) {
 
     /* Allocate memory */
-    mender_keystore_t *keystore = (mender_keystore_t *)malloc((length + 1) * sizeof(mender_item_t));
+    mender_keystore_t *keystore = (mender_keystore_t *)mender_utils_malloc((length + 1) * sizeof(mender_item_t));
     if (NULL == keystore) {
         mender_log_error("Unable to allocate memory");
         return NULL;
@@ -186,18 +449,52 @@ mender_utils_keystore_copy(mender_keystore_t **dst_keystore, mender_keystore_t *
     assert(NULL != dst_keystore);
     mender_err_t ret = MENDER_OK;
 
-    /* Copy the new keystore */
-    size_t length = mender_utils_keystore_length(src_keystore);
-    if (NULL == (*dst_keystore = mender_utils_keystore_new(length))) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
-    for (size_t index = 0; index < length; index++) {
-        if (MENDER_OK != (ret = mender_utils_keystore_set_item(*dst_keystore, index, src_keystore[index].name, src_keystore[index].value))) {
+    /* Check if the source key-store is packed */
+    size_t                         length = mender_utils_keystore_length(src_keystore);
+    mender_utils_keystore_block_t *block  = mender_utils_keystore_get_block(src_keystore);
+    if (NULL != block) {
+
+        /* Share the block, only the items are allocated */
+        if (NULL == (*dst_keystore = (mender_keystore_t *)mender_utils_malloc((length + 1) * sizeof(mender_item_t)))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        __atomic_add_fetch(&block->refcount, 1, __ATOMIC_RELAXED);
+        for (size_t index = 0; index <= length; index++) {
+            (*dst_keystore)[index].name  = NULL;
+            (*dst_keystore)[index].value = (char *)block;
+        }
+
+        /* Copy the items, the strings set after packing do not belong to the block and are duplicated */
+        for (size_t index = 0; index < length; index++) {
+            if ((true == mender_utils_keystore_block_contains(block, src_keystore[index].name))
+                && (true == mender_utils_keystore_block_contains(block, src_keystore[index].value))) {
+                (*dst_keystore)[index].name  = src_keystore[index].name;
+                (*dst_keystore)[index].value = src_keystore[index].value;
+            } else if (MENDER_OK != (ret = mender_utils_keystore_set_item(*dst_keystore, index, src_keystore[index].name, src_keystore[index].value))) {
+                mender_log_error("Unable to allocate memory");
+                goto END;
+            }
+        }
+
+    } else {
+
+        /* Pack the source key-store */
+        size_t size = 0;
+        for (size_t index = 0; index < length; index++) {
+            size += strlen(src_keystore[index].name) + strlen(src_keystore[index].value) + 2;
+        }
+        char *strings;
+        if (NULL == (*dst_keystore = mender_utils_keystore_pack(length, size, &strings))) {
             mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
             goto END;
         }
+        for (size_t index = 0; index < length; index++) {
+            (*dst_keystore)[index].name  = mender_utils_keystore_pack_string(&strings, src_keystore[index].name);
+            (*dst_keystore)[index].value = mender_utils_keystore_pack_string(&strings, src_keystore[index].value);
+        }
     }
 
 END:
@@ -205,6 +502,8 @@ END:
     return ret;
 }
 
+#ifndef CONFIG_MENDER_TINY
+
 mender_err_t
 mender_utils_keystore_from_json(mender_keystore_t **keystore, cJSON *object) {
 
@@ -221,22 +520,23 @@ mender_utils_keystore_from_json(mender_keystore_t **keystore, cJSON *object) {
     /* Set key-store */
     if (NULL != object) {
         size_t length       = 0;
+        size_t size         = 0;
         cJSON *current_item = object->child;
         while (NULL != current_item) {
             if ((NULL != current_item->string) && (NULL != current_item->valuestring)) {
                 length++;
+                size += strlen(current_item->string) + strlen(current_item->valuestring) + 2;
             }
             current_item = current_item->next;
         }
-        if (NULL != (*keystore = mender_utils_keystore_new(length))) {
+        char *strings;
+        if (NULL != (*keystore = mender_utils_keystore_pack(length, size, &strings))) {
             size_t index = 0;
             current_item = object->child;
             while (NULL != current_item) {
                 if ((NULL != current_item->string) && (NULL != current_item->valuestring)) {
-                    if (MENDER_OK != (ret = mender_utils_keystore_set_item(*keystore, index, current_item->string, current_item->valuestring))) {
-                        mender_log_error("Unable to allocate memory");
-                        return ret;
-                    }
+                    (*keystore)[index].name  = mender_utils_keystore_pack_string(&strings, current_item->string);
+                    (*keystore)[index].value = mender_utils_keystore_pack_string(&strings, current_item->valuestring);
                     index++;
                 }
                 current_item = current_item->next;
@@ -272,30 +572,40 @@ mender_utils_keystore_to_json(mender_keystore_t *keystore, cJSON **object) {
     return MENDER_OK;
 }
 
+#endif /* CONFIG_MENDER_TINY */
+
 mender_err_t
 mender_utils_keystore_set_item(mender_keystore_t *keystore, size_t index, char *name, char *value) {
 
     assert(NULL != keystore);
 
-    /* Release memory */
-    if (NULL != keystore[index].name) {
-        free(keystore[index].name);
-        keystore[index].name = NULL;
+    /* An item without name is empty */
+    if ((NULL == name) && (NULL != value)) {
+        mender_log_error("Invalid item");
+        return MENDER_FAIL;
     }
-    if (NULL != keystore[index].value) {
-        free(keystore[index].value);
-        keystore[index].value = NULL;
+
+    /* Release memory, the strings belonging to the block of a packed key-store are released with the block */
+    mender_utils_keystore_block_t *block = mender_utils_keystore_get_block(keystore);
+    if ((NULL != keystore[index].name) && (false == mender_utils_keystore_block_contains(block, keystore[index].name))) {
+        mender_utils_free(keystore[index].name);
     }
+    if ((NULL != keystore[index].value) && (false == mender_utils_keystore_block_contains(block, keystore[index].value))) {
+        mender_utils_free(keystore[index].value);
+    }
+    keystore[index].name  = NULL;
+    keystore[index].value = (char *)block;
 
     /* Copy name and value */
     if (NULL != name) {
-        if (NULL == (keystore[index].name = strdup(name))) {
+        if (NULL == (keystore[index].name = mender_utils_strdup(name))) {
             mender_log_error("Unable to allocate memory");
             return MENDER_FAIL;
         }
+        keystore[index].value = NULL;
     }
     if (NULL != value) {
-        if (NULL == (keystore[index].value = strdup(value))) {
+        if (NULL == (keystore[index].value = mender_utils_strdup(value))) {
             mender_log_error("Unable to allocate memory");
             return MENDER_FAIL;
         }
@@ -323,22 +633,35 @@ mender_utils_keystore_delete(mender_keystore_t *keystore) {
 
     /* Release memory */
     if (NULL != keystore) {
-        size_t index = 0;
-        while ((NULL != keystore[index].name) || (NULL != keystore[index].value)) {
-            if (NULL != keystore[index].name) {
-                free(keystore[index].name);
+        mender_utils_keystore_block_t *block = mender_utils_keystore_get_block(keystore);
+        size_t                         index = 0;
+        while (NULL != keystore[index].name) {
+            if (false == mender_utils_keystore_block_contains(block, keystore[index].name)) {
+                mender_utils_free(keystore[index].name);
             }
-            if (NULL != keystore[index].value) {
-                free(keystore[index].value);
+            if ((NULL != keystore[index].value) && (false == mender_utils_keystore_block_contains(block, keystore[index].value))) {
+                mender_utils_free(keystore[index].value);
             }
             index++;
         }
-        free(keystore);
+        if (NULL == block) {
+            mender_utils_free(keystore);
+        } else {
+            /* The items of the key-store are allocated separately if it is a copy, the block is released with the last key-store sharing it */
+            if ((mender_keystore_t *)((uint8_t *)block + MENDER_UTILS_KEYSTORE_BLOCK_HEADER_SIZE) != keystore) {
+                mender_utils_free(keystore);
+            }
+            if (0 == __atomic_sub_fetch(&block->refcount, 1, __ATOMIC_ACQ_REL)) {
+                mender_utils_free(block);
+            }
+        }
     }
 
     return MENDER_OK;
 }
 
+#ifndef CONFIG_MENDER_TINY
+
 mender_err_t
 mender_utils_identity_to_json(mender_identity_t *identity, cJSON **object) {
 
@@ -357,14 +680,16 @@ mender_utils_identity_to_json(mender_identity_t *identity, cJSON **object) {
     return MENDER_OK;
 }
 
+#endif /* CONFIG_MENDER_TINY */
+
 mender_err_t
 mender_utils_free_linked_list(mender_key_value_list_t *list) {
     mender_key_value_list_t *item = list;
     while (NULL != item) {
         mender_key_value_list_t *next = item->next;
-        free(item->key);
-        free(item->value);
-        free(item);
+        mender_utils_free(item->key);
+        mender_utils_free(item->value);
+        mender_utils_free(item);
         item = next;
     }
     return MENDER_OK;
@@ -376,19 +701,19 @@ mender_utils_create_key_value_node(const char *type, const char *value, mender_k
     assert(NULL != value);
     assert(NULL != list);
 
-    mender_key_value_list_t *item = (mender_key_value_list_t *)calloc(1, sizeof(mender_key_value_list_t));
+    mender_key_value_list_t *item = (mender_key_value_list_t *)mender_utils_calloc(1, sizeof(mender_key_value_list_t));
     if (NULL == item) {
         mender_log_error("Unable to allocate memory for linked list node");
         return MENDER_FAIL;
     }
 
-    item->key = strdup(type);
+    item->key = mender_utils_strdup(type);
     if (NULL == item->key) {
         mender_log_error("Unable to allocate memory for type");
         goto ERROR;
     }
 
-    item->value = strdup(value);
+    item->value = mender_utils_strdup(value);
     if (NULL == item->value) {
         mender_log_error("Unable to allocate memory for value");
         goto ERROR;
@@ -413,35 +738,40 @@ mender_utils_key_value_list_to_string(mender_key_value_list_t *list, char **key_
      *  Where \x1F is the ASCII unit separator and \x1E is the ASCII record separator
      * */
 
-    /* Start with 1 for the null terminator */
-    size_t total_len = 1;
-    for (mender_key_value_list_t *item = list; NULL != item; item = item->next) {
-        if (NULL != item->key && NULL != item->value) {
-            total_len += strlen(item->key) + strlen(item->value) + 3; // key=value<space>
-        }
-    }
+    assert(NULL != key_value_str);
 
-    *key_value_str = (char *)calloc(1, total_len);
-    if (NULL == *key_value_str) {
+    /* Measure the string, it is then written once to a buffer of the exact size */
+    size_t length = mender_utils_key_value_list_to_buffer(list, NULL, 0);
+    if (NULL == (*key_value_str = (char *)mender_utils_malloc(length + 1))) {
         mender_log_error("Unable to allocate memory for string");
         return MENDER_FAIL;
     }
+    mender_utils_key_value_list_to_buffer(list, *key_value_str, length + 1);
+
+    return MENDER_OK;
+}
+
+size_t
+mender_utils_key_value_list_to_buffer(mender_key_value_list_t *list, char *buffer, size_t size) {
 
-    /* Pointer to key_value_str pointer */
-    char *str_ptr = *key_value_str;
+    size_t length = 0;
+
+    /* Write the items, the length of the whole string is computed meanwhile */
     for (mender_key_value_list_t *item = list; NULL != item; item = item->next) {
-        if (NULL != item->key && NULL != item->value) {
-            int ret = snprintf(
-                str_ptr, total_len - (str_ptr - *key_value_str), "%s" MENDER_KEY_VALUE_DELIMITER "%s" MENDER_KEY_VALUE_SEPARATOR, item->key, item->value);
-            if (0 > ret) {
-                mender_log_error("Unable to write to string");
-                return MENDER_FAIL;
-            }
-            str_ptr += ret;
+        if ((NULL != item->key) && (NULL != item->value)) {
+            length = mender_utils_buffer_append(buffer, size, length, item->key, strlen(item->key));
+            length = mender_utils_buffer_append(buffer, size, length, MENDER_KEY_VALUE_DELIMITER, 1);
+            length = mender_utils_buffer_append(buffer, size, length, item->value, strlen(item->value));
+            length = mender_utils_buffer_append(buffer, size, length, MENDER_KEY_VALUE_SEPARATOR, 1);
         }
     }
 
-    return MENDER_OK;
+    /* Terminate the string */
+    if ((NULL != buffer) && (size > 0)) {
+        buffer[(length < size) ? length : size - 1] = '\0';
+    }
+
+    return length;
 }
 
 mender_err_t
@@ -457,7 +787,7 @@ mender_utils_string_to_key_value_list(const char *key_value_str, mender_key_valu
     assert(NULL != key_value_str);
     assert(NULL != list);
 
-    char *str = strdup(key_value_str);
+    char *str = mender_utils_strdup(key_value_str);
     if (NULL == str) {
         mender_log_error("Unable to allocate memory for string");
         return MENDER_FAIL;
@@ -485,10 +815,70 @@ mender_utils_string_to_key_value_list(const char *key_value_str, mender_key_valu
 
     ret = MENDER_OK;
 END:
-    free(str);
+    mender_utils_free(str);
     return ret;
 }
 
+mender_err_t
+mender_utils_string_to_key_value_list_in_place(char *key_value_str, mender_key_value_list_t **list) {
+
+    assert(NULL != key_value_str);
+    assert(NULL != list);
+    mender_key_value_list_t *nodes  = NULL;
+    size_t                   count  = 1;
+    size_t                   used   = 0;
+    char                    *record = key_value_str;
+
+    /* Count the records to allocate the nodes at once */
+    *list = NULL;
+    if ('\0' == *key_value_str) {
+        return MENDER_OK;
+    }
+    for (char *str = key_value_str; '\0' != *str; str++) {
+        if (MENDER_KEY_VALUE_SEPARATOR[0] == *str) {
+            count++;
+        }
+    }
+    if (NULL == (nodes = (mender_key_value_list_t *)mender_utils_malloc(count * sizeof(mender_key_value_list_t)))) {
+        mender_log_error("Unable to allocate memory for linked list");
+        return MENDER_FAIL;
+    }
+
+    /* Split the records and the keys from the values, empty records are skipped */
+    while (NULL != record) {
+        char *end = strchr(record, MENDER_KEY_VALUE_SEPARATOR[0]);
+        if (NULL != end) {
+            *end = '\0';
+        }
+        if ('\0' != *record) {
+            char *delimiter = strchr(record, MENDER_KEY_VALUE_DELIMITER[0]);
+            if (NULL == delimiter) {
+                mender_log_error("Invalid key-value string");
+                mender_utils_free(nodes);
+                return MENDER_FAIL;
+            }
+            *delimiter        = '\0';
+            nodes[used].key   = record;
+            nodes[used].value = delimiter + 1;
+            nodes[used].next  = NULL;
+            if (used > 0) {
+                nodes[used - 1].next = &nodes[used];
+            }
+            used++;
+        }
+        record = (NULL != end) ? end + 1 : NULL;
+    }
+
+    /* Return the list, the nodes are released at once */
+    if (0 == used) {
+        mender_utils_free(nodes);
+        nodes = NULL;
+    }
+    *list = nodes;
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_utils_append_list(mender_key_value_list_t **list1, mender_key_value_list_t **list2) {
 
@@ -509,3 +899,1269 @@ mender_utils_append_list(mender_key_value_list_t **list1, mender_key_value_list_
     *list2 = NULL;
     return MENDER_OK;
 }
+
+bool
+mender_utils_glob_match(const char *pattern, const char *str) {
+
+    assert(NULL != pattern);
+    assert(NULL != str);
+    const char *star      = NULL;
+    const char *backtrack = NULL;
+
+    /* Match the string, the last star absorbs one more character each time the rest of the pattern fails */
+    while ('\0' != *str) {
+        if ('*' == *pattern) {
+            star      = pattern++;
+            backtrack = str;
+        } else if (('?' == *pattern) || (*pattern == *str)) {
+            pattern++;
+            str++;
+        } else if (NULL != star) {
+            pattern = star + 1;
+            str     = ++backtrack;
+        } else {
+            return false;
+        }
+    }
+
+    /* Trailing stars match the empty string */
+    while ('*' == *pattern) {
+        pattern++;
+    }
+
+    return '\0' == *pattern;
+}
+
+const char *
+mender_utils_kv_table_get(mender_utils_kv_table_t *table, const char *name) {
+
+    assert(NULL != table);
+    assert(NULL != name);
+    size_t index;
+
+    /* Search the item */
+    if (false == mender_utils_kv_table_search(table, name, &index)) {
+        return NULL;
+    }
+
+    return table->items[index].value;
+}
+
+mender_err_t
+mender_utils_kv_table_set(mender_utils_kv_table_t *table, const char *name, const char *value) {
+
+    assert(NULL != table);
+    assert(NULL != name);
+    assert(NULL != value);
+    size_t index;
+
+    /* Replace the value if the item already exists, the previous one is released with the table */
+    bool found = mender_utils_kv_table_search(table, name, &index);
+    if ((true == found) && (!strcmp(table->items[index].value, value))) {
+        return MENDER_OK;
+    }
+    char *str;
+    if (NULL == (str = mender_utils_arena_strdup(&table->strings, value))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (true == found) {
+        table->items[index].value = str;
+        return MENDER_OK;
+    }
+
+    /* Grow the items, the capacity is doubled when it is reached */
+    if (table->size == table->capacity) {
+        size_t         capacity = (0 == table->capacity) ? 8 : 2 * table->capacity;
+        mender_item_t *items;
+        if (NULL == (items = (mender_item_t *)mender_utils_realloc(table->items, capacity * sizeof(mender_item_t)))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        table->items    = items;
+        table->capacity = capacity;
+    }
+
+    /* Insert the item, items are appended without moves when they are set in order */
+    char *key;
+    if (NULL == (key = mender_utils_arena_strdup(&table->strings, name))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    memmove(&table->items[index + 1], &table->items[index], (table->size - index) * sizeof(mender_item_t));
+    table->items[index].name  = key;
+    table->items[index].value = str;
+    table->size++;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_utils_kv_table_set_list(mender_utils_kv_table_t *table, mender_key_value_list_t *list) {
+
+    assert(NULL != table);
+
+    /* Set the items of the list */
+    for (mender_key_value_list_t *item = list; NULL != item; item = item->next) {
+        if ((NULL != item->key) && (NULL != item->value)) {
+            if (MENDER_OK != mender_utils_kv_table_set(table, item->key, item->value)) {
+                return MENDER_FAIL;
+            }
+        }
+    }
+
+    return MENDER_OK;
+}
+
+size_t
+mender_utils_kv_table_clear(mender_utils_kv_table_t *table, const char *pattern) {
+
+    assert(NULL != table);
+    assert(NULL != pattern);
+    size_t count = 0;
+
+    /* Compact the items that do not match the pattern, the order is preserved */
+    for (size_t index = 0; index < table->size; index++) {
+        if (true == mender_utils_glob_match(pattern, table->items[index].name)) {
+            continue;
+        }
+        table->items[count++] = table->items[index];
+    }
+    size_t removed = table->size - count;
+    table->size    = count;
+
+    return removed;
+}
+
+void
+mender_utils_kv_table_release(mender_utils_kv_table_t *table) {
+
+    assert(NULL != table);
+
+    /* Release memory */
+    mender_utils_free(table->items);
+    mender_utils_arena_release(&table->strings);
+    memset(table, 0, sizeof(mender_utils_kv_table_t));
+}
+
+void *
+mender_utils_arena_alloc(mender_utils_arena_t *arena, size_t size) {
+
+    assert(NULL != arena);
+    mender_utils_arena_block_t *block = arena->blocks;
+
+    /* Round up the size to keep the following allocations aligned */
+    size = (size + MENDER_UTILS_ARENA_ALIGNMENT - 1) / MENDER_UTILS_ARENA_ALIGNMENT * MENDER_UTILS_ARENA_ALIGNMENT;
+
+    /* Check if a new block is needed */
+    if ((NULL == block) || (block->size - block->used < size)) {
+        size_t block_size = (size > CONFIG_MENDER_UTILS_ARENA_BLOCK_SIZE) ? size : CONFIG_MENDER_UTILS_ARENA_BLOCK_SIZE;
+        if (NULL
+            == (block = (mender_utils_arena_block_t *)mender_utils_heap_calloc(
+                    MENDER_UTILS_HEAP_MODULE_ARENA, 1, MENDER_UTILS_ARENA_BLOCK_HEADER_SIZE + block_size))) {
+            return NULL;
+        }
+        block->size = block_size;
+
+        /* Allocations larger than the block size do not replace the block currently used */
+        if ((NULL != arena->blocks) && (block_size > CONFIG_MENDER_UTILS_ARENA_BLOCK_SIZE)) {
+            block->next         = arena->blocks->next;
+            arena->blocks->next = block;
+        } else {
+            block->next   = arena->blocks;
+            arena->blocks = block;
+        }
+    }
+
+    /* Allocate memory from the block, it is already zeroed */
+    void *ptr = (uint8_t *)block + MENDER_UTILS_ARENA_BLOCK_HEADER_SIZE + block->used;
+    block->used += size;
+
+    return ptr;
+}
+
+char *
+mender_utils_arena_strdup(mender_utils_arena_t *arena, const char *s) {
+
+    assert(NULL != arena);
+    assert(NULL != s);
+    char *tmp;
+
+    /* Duplicate string */
+    size_t length = strlen(s) + 1;
+    if (NULL == (tmp = (char *)mender_utils_arena_alloc(arena, length))) {
+        return NULL;
+    }
+    memcpy(tmp, s, length);
+
+    return tmp;
+}
+
+void
+mender_utils_arena_release(mender_utils_arena_t *arena) {
+
+    assert(NULL != arena);
+
+    /* Release memory */
+    mender_utils_arena_block_t *block = arena->blocks;
+    while (NULL != block) {
+        mender_utils_arena_block_t *next = block->next;
+        mender_utils_free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
+
+void
+mender_utils_backoff_seed(uint32_t seed) {
+
+    uint32_t state = __atomic_load_n(&mender_utils_backoff_state, __ATOMIC_RELAXED);
+    uint32_t next;
+
+    /* Mix the seed with the current state, the state must never be 0 */
+    do {
+        next = state ^ seed;
+        if (0 == next) {
+            next = 2463534242UL;
+        }
+    } while (false == __atomic_compare_exchange_n(&mender_utils_backoff_state, &state, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void
+mender_utils_backoff_init(mender_utils_backoff_t *backoff, uint32_t base) {
+
+    assert(NULL != backoff);
+
+    /* Initialize backoff policy */
+    backoff->base     = base;
+    backoff->attempts = 0;
+}
+
+uint32_t
+mender_utils_backoff_failure(mender_utils_backoff_t *backoff) {
+
+    assert(NULL != backoff);
+
+    /* Nothing to do if the work is not periodic or if the backoff is disabled */
+    if ((0 == backoff->base) || (0 == CONFIG_MENDER_CLIENT_BACKOFF_MAX_INTERVAL)) {
+        return backoff->base;
+    }
+
+    /* Compute the window, the base period doubles with each consecutive failure until the maximum is reached */
+    uint32_t cap    = (backoff->base > CONFIG_MENDER_CLIENT_BACKOFF_MAX_INTERVAL) ? backoff->base : CONFIG_MENDER_CLIENT_BACKOFF_MAX_INTERVAL;
+    uint32_t window = backoff->base;
+    for (uint32_t index = 0; (index < backoff->attempts) && (window < cap); index++) {
+        window = (window > cap / 2) ? cap : (window * 2);
+    }
+    if (backoff->attempts < UINT32_MAX) {
+        backoff->attempts++;
+    }
+
+    /* Pick the period randomly in the window (xorshift32), so that devices failing at the same time do not retry in lockstep */
+    uint32_t state = __atomic_load_n(&mender_utils_backoff_state, __ATOMIC_RELAXED);
+    uint32_t next;
+    do {
+        next = state;
+        next ^= next << 13;
+        next ^= next >> 17;
+        next ^= next << 5;
+    } while (false == __atomic_compare_exchange_n(&mender_utils_backoff_state, &state, next, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return 1 + (next % window);
+}
+
+bool
+mender_utils_backoff_success(mender_utils_backoff_t *backoff) {
+
+    assert(NULL != backoff);
+
+    /* Check if the period has been modified by failures */
+    if (0 == backoff->attempts) {
+        return false;
+    }
+    backoff->attempts = 0;
+
+    return (0 != backoff->base) && (0 != CONFIG_MENDER_CLIENT_BACKOFF_MAX_INTERVAL);
+}
+
+uint32_t
+mender_utils_crc32(uint32_t crc, const void *data, size_t length) {
+
+    assert((NULL != data) || (0 == length));
+
+    /* Compute CRC bit per bit, records are small and a table would cost 1 kB of flash */
+    crc = ~crc;
+    for (size_t index = 0; index < length; index++) {
+        crc ^= ((const uint8_t *)data)[index];
+        for (size_t bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+#ifdef CONFIG_MENDER_HTTP_GZIP
+
+mender_err_t
+mender_utils_gzip_compress(const void *data, size_t length, void **output, size_t *output_length) {
+
+    assert(NULL != data);
+    assert(NULL != output);
+    assert(NULL != output_length);
+    mender_err_t ret    = MENDER_FAIL;
+    z_stream     stream = { 0 };
+
+    /* Allocate the compressed data, it is useless if it is not smaller than the data */
+    if (NULL == (*output = mender_utils_malloc(length))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+
+    /* Create the compression stream, gzip header and trailer are written */
+    int window_bits = 16 + CONFIG_MENDER_HTTP_GZIP_WINDOW_BITS;
+    if (Z_OK != deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits, MENDER_UTILS_GZIP_MEM_LEVEL, Z_DEFAULT_STRATEGY)) {
+        mender_log_error("Unable to initialize compressor");
+        goto END;
+    }
+
+    /* Compress the data at once, the end of the stream is not reached if the output is full */
+    stream.next_in   = (Bytef *)data;
+    stream.avail_in  = (uInt)length;
+    stream.next_out  = (Bytef *)*output;
+    stream.avail_out = (uInt)length;
+    if (Z_STREAM_END != deflate(&stream, Z_FINISH)) {
+        mender_log_debug("Data is not compressible, it is sent as is");
+        deflateEnd(&stream);
+        goto END;
+    }
+    *output_length = (size_t)stream.total_out;
+    deflateEnd(&stream);
+
+    ret = MENDER_OK;
+
+END:
+
+    /* Release memory */
+    if (MENDER_OK != ret) {
+        mender_utils_free(*output);
+        *output = NULL;
+    }
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+void
+mender_utils_record_init(mender_utils_record_t *record) {
+
+    assert(NULL != record);
+
+    /* Initialize record */
+    memset(record, 0, sizeof(mender_utils_record_t));
+}
+
+void
+mender_utils_record_add(mender_utils_record_t *record, const char *field) {
+
+    assert(NULL != record);
+
+    /* Nothing to do if adding a previous field failed */
+    if (true == record->failed) {
+        return;
+    }
+    if (NULL == field) {
+        mender_log_error("Invalid record field");
+        record->failed = true;
+        return;
+    }
+
+    /* Fields are stored with their null terminator so that they are handed out as views when the record is read */
+    size_t length = strlen(field) + 1;
+    if ((length > UINT16_MAX) || (record->count >= UINT16_MAX)) {
+        mender_log_error("Record field is too large");
+        record->failed = true;
+        return;
+    }
+
+    /* Grow the buffer, the header and the CRC are reserved */
+    size_t needed = ((0 == record->length) ? MENDER_UTILS_RECORD_HEADER_SIZE : record->length) + 2 + length + MENDER_UTILS_RECORD_CRC_SIZE;
+    if (needed > record->capacity) {
+        size_t capacity = (0 == record->capacity) ? MENDER_UTILS_RECORD_MIN_CAPACITY : record->capacity;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        unsigned char *tmp;
+        if (NULL == (tmp = (unsigned char *)mender_utils_realloc(record->data, capacity))) {
+            mender_log_error("Unable to allocate memory");
+            record->failed = true;
+            return;
+        }
+        record->data     = tmp;
+        record->capacity = capacity;
+    }
+    if (0 == record->length) {
+        record->length = MENDER_UTILS_RECORD_HEADER_SIZE;
+    }
+
+    /* Add the field, lengths are little endian */
+    record->data[record->length++] = (unsigned char)(length & 0xFF);
+    record->data[record->length++] = (unsigned char)(length >> 8);
+    memcpy(&record->data[record->length], field, length);
+    record->length += length;
+    record->count++;
+}
+
+mender_err_t
+mender_utils_record_end(mender_utils_record_t *record) {
+
+    assert(NULL != record);
+
+    /* Check if adding a field failed */
+    if (true == record->failed) {
+        return MENDER_FAIL;
+    }
+
+    /* Allocate the buffer of an empty record */
+    if (NULL == record->data) {
+        if (NULL == (record->data = (unsigned char *)mender_utils_malloc(MENDER_UTILS_RECORD_HEADER_SIZE + MENDER_UTILS_RECORD_CRC_SIZE))) {
+            mender_log_error("Unable to allocate memory");
+            record->failed = true;
+            return MENDER_FAIL;
+        }
+        record->capacity = MENDER_UTILS_RECORD_HEADER_SIZE + MENDER_UTILS_RECORD_CRC_SIZE;
+        record->length   = MENDER_UTILS_RECORD_HEADER_SIZE;
+    }
+
+    /* Write the header and the CRC, the space has been reserved when the fields have been added */
+    record->data[0] = MENDER_UTILS_RECORD_VERSION;
+    record->data[1] = (unsigned char)(record->count & 0xFF);
+    record->data[2] = (unsigned char)(record->count >> 8);
+    uint32_t crc    = mender_utils_crc32(0, record->data, record->length);
+    for (size_t index = 0; index < MENDER_UTILS_RECORD_CRC_SIZE; index++) {
+        record->data[record->length++] = (unsigned char)(crc >> (8 * index));
+    }
+
+    return MENDER_OK;
+}
+
+void
+mender_utils_record_release(mender_utils_record_t *record) {
+
+    assert(NULL != record);
+
+    /* Release memory */
+    mender_utils_free(record->data);
+    memset(record, 0, sizeof(mender_utils_record_t));
+}
+
+mender_err_t
+mender_utils_record_check(const void *data, size_t length, size_t *count) {
+
+    assert(NULL != data);
+    assert(NULL != count);
+    const unsigned char *record = (const unsigned char *)data;
+
+    /* Check version, records written by previous versions of the client are text */
+    if ((length < MENDER_UTILS_RECORD_HEADER_SIZE + MENDER_UTILS_RECORD_CRC_SIZE) || (MENDER_UTILS_RECORD_VERSION != record[0])) {
+        return MENDER_FAIL;
+    }
+
+    /* Check CRC */
+    length -= MENDER_UTILS_RECORD_CRC_SIZE;
+    uint32_t crc = 0;
+    for (size_t index = 0; index < MENDER_UTILS_RECORD_CRC_SIZE; index++) {
+        crc |= (uint32_t)record[length + index] << (8 * index);
+    }
+    if (crc != mender_utils_crc32(0, record, length)) {
+        mender_log_error("Invalid record CRC");
+        return MENDER_FAIL;
+    }
+
+    /* Check fields, they must be null terminated and fill the record exactly */
+    *count        = (size_t)record[1] | ((size_t)record[2] << 8);
+    size_t offset = MENDER_UTILS_RECORD_HEADER_SIZE;
+    for (size_t index = 0; index < *count; index++) {
+        if (offset + 2 > length) {
+            mender_log_error("Invalid record");
+            return MENDER_FAIL;
+        }
+        size_t field_length = (size_t)record[offset] | ((size_t)record[offset + 1] << 8);
+        offset += 2;
+        if ((0 == field_length) || (field_length > length - offset) || ('\0' != record[offset + field_length - 1])) {
+            mender_log_error("Invalid record");
+            return MENDER_FAIL;
+        }
+        offset += field_length;
+    }
+    if (offset != length) {
+        mender_log_error("Invalid record");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+const char *
+mender_utils_record_next(const void *data, size_t *offset) {
+
+    assert(NULL != data);
+    assert(NULL != offset);
+    const unsigned char *record = (const unsigned char *)data;
+
+    /* Skip the header before the first field */
+    if (0 == *offset) {
+        *offset = MENDER_UTILS_RECORD_HEADER_SIZE;
+    }
+
+    /* Hand out a view on the field */
+    size_t      field_length = (size_t)record[*offset] | ((size_t)record[*offset + 1] << 8);
+    const char *field        = (const char *)&record[*offset + 2];
+    *offset += 2 + field_length;
+
+    return field;
+}
+
+mender_err_t
+mender_utils_key_value_list_to_record(mender_key_value_list_t *list, mender_utils_record_t *record) {
+
+    assert(NULL != record);
+
+    /* Add keys and values as consecutive fields */
+    mender_utils_record_init(record);
+    for (mender_key_value_list_t *item = list; NULL != item; item = item->next) {
+        if ((NULL != item->key) && (NULL != item->value)) {
+            mender_utils_record_add(record, item->key);
+            mender_utils_record_add(record, item->value);
+        }
+    }
+    if (MENDER_OK != mender_utils_record_end(record)) {
+        mender_log_error("Unable to format record");
+        mender_utils_record_release(record);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_utils_record_to_key_value_list(const void *data, size_t length, mender_key_value_list_t **list) {
+
+    assert(NULL != data);
+    assert(NULL != list);
+    size_t count;
+
+    /* Check record */
+    if ((MENDER_OK != mender_utils_record_check(data, length, &count)) || (0 != count % 2)) {
+        return MENDER_FAIL;
+    }
+
+    /* Create the key-value nodes */
+    size_t offset = 0;
+    for (size_t index = 0; index < count; index += 2) {
+        const char *key   = mender_utils_record_next(data, &offset);
+        const char *value = mender_utils_record_next(data, &offset);
+        if (MENDER_OK != mender_utils_create_key_value_node(key, value, list)) {
+            mender_log_error("Unable to create key-value node");
+            mender_utils_free_linked_list(*list);
+            *list = NULL;
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_utils_kv_table_to_record(mender_utils_kv_table_t *table, mender_utils_record_t *record) {
+
+    assert(NULL != table);
+    assert(NULL != record);
+
+    /* Add names and values as consecutive fields, the record is sorted and read back without moves */
+    mender_utils_record_init(record);
+    for (size_t index = 0; index < table->size; index++) {
+        mender_utils_record_add(record, table->items[index].name);
+        mender_utils_record_add(record, table->items[index].value);
+    }
+    if (MENDER_OK != mender_utils_record_end(record)) {
+        mender_log_error("Unable to format record");
+        mender_utils_record_release(record);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_utils_record_to_kv_table(const void *data, size_t length, mender_utils_kv_table_t *table) {
+
+    assert(NULL != data);
+    assert(NULL != table);
+    size_t count;
+
+    /* Check record */
+    if ((MENDER_OK != mender_utils_record_check(data, length, &count)) || (0 != count % 2)) {
+        return MENDER_FAIL;
+    }
+
+    /* Set the items */
+    size_t offset = 0;
+    for (size_t index = 0; index < count; index += 2) {
+        const char *name  = mender_utils_record_next(data, &offset);
+        const char *value = mender_utils_record_next(data, &offset);
+        if (MENDER_OK != mender_utils_kv_table_set(table, name, value)) {
+            mender_log_error("Unable to set key-value item");
+            mender_utils_kv_table_release(table);
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_utils_set_allocator(mender_utils_allocator_t *allocator) {
+
+    /* Check allocator, all the functions are required */
+    if ((NULL != allocator) && ((NULL == allocator->malloc_fn) || (NULL == allocator->realloc_fn) || (NULL == allocator->free_fn))) {
+        mender_log_error("Invalid allocator");
+        return MENDER_FAIL;
+    }
+
+    /* Set allocator */
+    if (NULL != allocator) {
+        mender_utils_allocator = *allocator;
+    } else {
+        mender_utils_allocator.malloc_fn  = malloc;
+        mender_utils_allocator.realloc_fn = realloc;
+        mender_utils_allocator.free_fn    = free;
+    }
+
+    /* Install the allocator in cJSON, cJSON restores the standard library one when the hooks are NULL */
+#ifndef CONFIG_MENDER_TINY
+#if defined(CONFIG_MENDER_UTILS_HEAP_ACCOUNTING) || defined(CONFIG_MENDER_CLIENT_MEMORY_BUDGET)
+    /* The memory of cJSON is always accounted and served from the pool of the JSON module, it is released by the client with mender_utils_free */
+    cJSON_Hooks hooks = { .malloc_fn = mender_utils_heap_json_malloc, .free_fn = mender_utils_free };
+    cJSON_InitHooks(&hooks);
+#else
+    cJSON_Hooks hooks = { .malloc_fn = mender_utils_allocator.malloc_fn, .free_fn = mender_utils_allocator.free_fn };
+    cJSON_InitHooks((NULL != allocator) ? &hooks : NULL);
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING || CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+#endif /* CONFIG_MENDER_TINY */
+
+    return MENDER_OK;
+}
+
+/* The names of the functions are parenthesized because they are replaced by macros when the heap accounting is enabled */
+
+void *
+(mender_utils_malloc)(size_t size) {
+
+    return mender_utils_heap_malloc(MENDER_UTILS_HEAP_MODULE_OTHER, size);
+}
+
+void *
+(mender_utils_calloc)(size_t count, size_t size) {
+
+    return mender_utils_heap_calloc(MENDER_UTILS_HEAP_MODULE_OTHER, count, size);
+}
+
+void *
+(mender_utils_realloc)(void *ptr, size_t size) {
+
+    return mender_utils_heap_realloc(MENDER_UTILS_HEAP_MODULE_OTHER, ptr, size);
+}
+
+char *
+(mender_utils_strdup)(const char *s) {
+
+    return mender_utils_heap_strdup(MENDER_UTILS_HEAP_MODULE_OTHER, s);
+}
+
+char *
+(mender_utils_strndup)(const char *s, size_t n) {
+
+    return mender_utils_heap_strndup(MENDER_UTILS_HEAP_MODULE_OTHER, s, n);
+}
+
+int
+(mender_utils_vasprintf)(char **str, const char *format, va_list args) {
+
+    return mender_utils_heap_vasprintf(MENDER_UTILS_HEAP_MODULE_OTHER, str, format, args);
+}
+
+void *
+mender_utils_heap_malloc(mender_utils_heap_module_t module, size_t size) {
+
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+    assert(module < MENDER_UTILS_HEAP_MODULE_ALL);
+
+    /* Allocate memory and its header */
+    if (size > SIZE_MAX - MENDER_UTILS_HEAP_HEADER_SIZE) {
+        return NULL;
+    }
+    mender_utils_heap_header_t *header = (mender_utils_heap_header_t *)mender_utils_heap_raw_malloc(module, MENDER_UTILS_HEAP_HEADER_SIZE + size);
+    if (NULL == header) {
+        return NULL;
+    }
+    header->size   = size;
+    header->module = module;
+
+    /* Account the allocation */
+    mender_utils_heap_account(&mender_utils_heap_stats[module], size, true);
+    mender_utils_heap_account(&mender_utils_heap_stats[MENDER_UTILS_HEAP_MODULE_ALL], size, true);
+
+    return (uint8_t *)header + MENDER_UTILS_HEAP_HEADER_SIZE;
+#else
+    return mender_utils_heap_raw_malloc(module, size);
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+}
+
+void *
+mender_utils_heap_calloc(mender_utils_heap_module_t module, size_t count, size_t size) {
+
+    /* Check overflow */
+    if ((0 != size) && (count > SIZE_MAX / size)) {
+        return NULL;
+    }
+
+    /* Allocate memory and initialize it to zero */
+    void *ptr = mender_utils_heap_malloc(module, count * size);
+    if (NULL != ptr) {
+        memset(ptr, 0, count * size);
+    }
+
+    return ptr;
+}
+
+void *
+mender_utils_heap_realloc(mender_utils_heap_module_t module, void *ptr, size_t size) {
+
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+    assert(module < MENDER_UTILS_HEAP_MODULE_ALL);
+
+    /* Allocate new memory if the pointer is NULL */
+    if (NULL == ptr) {
+        return mender_utils_heap_malloc(module, size);
+    }
+
+    /* Resize memory and its header */
+    if (size > SIZE_MAX - MENDER_UTILS_HEAP_HEADER_SIZE) {
+        return NULL;
+    }
+    mender_utils_heap_header_t *header     = (mender_utils_heap_header_t *)((uint8_t *)ptr - MENDER_UTILS_HEAP_HEADER_SIZE);
+    size_t                      old_size   = header->size;
+    mender_utils_heap_module_t  old_module = header->module;
+    mender_utils_heap_header_t *resized    = (mender_utils_heap_header_t *)mender_utils_heap_raw_realloc(module, header, MENDER_UTILS_HEAP_HEADER_SIZE + size);
+    if (NULL == resized) {
+        return NULL;
+    }
+    resized->size   = size;
+    resized->module = module;
+
+    /* Account the resize, the memory is moved to the module of the caller */
+    mender_utils_heap_account(&mender_utils_heap_stats[old_module], old_size, false);
+    mender_utils_heap_account(&mender_utils_heap_stats[MENDER_UTILS_HEAP_MODULE_ALL], old_size, false);
+    mender_utils_heap_account(&mender_utils_heap_stats[module], size, true);
+    mender_utils_heap_account(&mender_utils_heap_stats[MENDER_UTILS_HEAP_MODULE_ALL], size, true);
+
+    return (uint8_t *)resized + MENDER_UTILS_HEAP_HEADER_SIZE;
+#else
+    return mender_utils_heap_raw_realloc(module, ptr, size);
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+}
+
+char *
+mender_utils_heap_strdup(mender_utils_heap_module_t module, const char *s) {
+
+    assert(NULL != s);
+
+    /* Duplicate string */
+    size_t length = strlen(s);
+    char  *str    = (char *)mender_utils_heap_malloc(module, length + 1);
+    if (NULL != str) {
+        memcpy(str, s, length + 1);
+    }
+
+    return str;
+}
+
+char *
+mender_utils_heap_strndup(mender_utils_heap_module_t module, const char *s, size_t n) {
+
+    assert(NULL != s);
+
+    /* Duplicate at most n characters of the string */
+    size_t length = 0;
+    while ((length < n) && ('\0' != s[length])) {
+        length++;
+    }
+    char *str = (char *)mender_utils_heap_malloc(module, length + 1);
+    if (NULL != str) {
+        memcpy(str, s, length);
+        str[length] = '\0';
+    }
+
+    return str;
+}
+
+int
+mender_utils_heap_vasprintf(mender_utils_heap_module_t module, char **str, const char *format, va_list args) {
+
+    assert(NULL != str);
+    assert(NULL != format);
+    va_list copy;
+
+    /* Compute the length of the formatted string */
+    va_copy(copy, args);
+    int length = vsnprintf(NULL, 0, format, copy);
+    va_end(copy);
+    if (length < 0) {
+        return length;
+    }
+
+    /* Format the string */
+    if (NULL == (*str = (char *)mender_utils_heap_malloc(module, (size_t)length + 1))) {
+        return -1;
+    }
+    vsnprintf(*str, (size_t)length + 1, format, args);
+
+    return length;
+}
+
+void
+mender_utils_free(void *ptr) {
+
+    if (NULL == ptr) {
+        return;
+    }
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+
+    /* Account the release and release the memory with its header */
+    mender_utils_heap_header_t *header = (mender_utils_heap_header_t *)((uint8_t *)ptr - MENDER_UTILS_HEAP_HEADER_SIZE);
+    mender_utils_heap_account(&mender_utils_heap_stats[header->module], header->size, false);
+    mender_utils_heap_account(&mender_utils_heap_stats[MENDER_UTILS_HEAP_MODULE_ALL], header->size, false);
+    mender_utils_heap_raw_free(header);
+#else
+    mender_utils_heap_raw_free(ptr);
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+}
+
+char *
+mender_utils_heap_module_to_string(mender_utils_heap_module_t module) {
+
+    /* Return module as string */
+    if (MENDER_UTILS_HEAP_MODULE_OTHER == module) {
+        return "other";
+    } else if (MENDER_UTILS_HEAP_MODULE_API == module) {
+        return "api";
+    } else if (MENDER_UTILS_HEAP_MODULE_ARTIFACT == module) {
+        return "artifact";
+    } else if (MENDER_UTILS_HEAP_MODULE_CLIENT == module) {
+        return "client";
+    } else if (MENDER_UTILS_HEAP_MODULE_TROUBLESHOOT == module) {
+        return "troubleshoot";
+    } else if (MENDER_UTILS_HEAP_MODULE_TLS == module) {
+        return "tls";
+    } else if (MENDER_UTILS_HEAP_MODULE_HTTP == module) {
+        return "http";
+    } else if (MENDER_UTILS_HEAP_MODULE_JSON == module) {
+        return "json";
+    } else if (MENDER_UTILS_HEAP_MODULE_ARENA == module) {
+        return "arena";
+    } else if (MENDER_UTILS_HEAP_MODULE_ALL == module) {
+        return "all";
+    }
+
+    return NULL;
+}
+
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+
+mender_err_t
+mender_utils_heap_get_stats(mender_utils_heap_module_t module, mender_utils_heap_stats_t *stats) {
+
+    assert(NULL != stats);
+
+    /* Check module */
+    if (module > MENDER_UTILS_HEAP_MODULE_ALL) {
+        return MENDER_FAIL;
+    }
+
+    /* Retrieve the statistics */
+    stats->current = __atomic_load_n(&mender_utils_heap_stats[module].current, __ATOMIC_RELAXED);
+    stats->peak    = __atomic_load_n(&mender_utils_heap_stats[module].peak, __ATOMIC_RELAXED);
+    stats->count   = __atomic_load_n(&mender_utils_heap_stats[module].count, __ATOMIC_RELAXED);
+
+    return MENDER_OK;
+}
+
+void
+mender_utils_heap_reset_peak(void) {
+
+    /* Reset the peaks to the memory currently allocated */
+    for (size_t index = 0; index <= MENDER_UTILS_HEAP_MODULE_ALL; index++) {
+        __atomic_store_n(&mender_utils_heap_stats[index].peak, __atomic_load_n(&mender_utils_heap_stats[index].current, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    }
+}
+
+void
+mender_utils_heap_dump(void) {
+
+    mender_utils_heap_stats_t stats;
+
+    /* Log the statistics of all the modules */
+    for (size_t index = 0; index <= MENDER_UTILS_HEAP_MODULE_ALL; index++) {
+        mender_utils_heap_get_stats((mender_utils_heap_module_t)index, &stats);
+        mender_log_debug("Heap %s: current %zu bytes, peak %zu bytes, %zu blocks",
+                         mender_utils_heap_module_to_string((mender_utils_heap_module_t)index),
+                         stats.current,
+                         stats.peak,
+                         stats.count);
+    }
+}
+
+static void
+mender_utils_heap_account(mender_utils_heap_stats_t *stats, size_t size, bool allocated) {
+
+    assert(NULL != stats);
+
+    /* Update the statistics, the peak is raised with a compare and swap so that concurrent allocations never lower it */
+    if (true == allocated) {
+        size_t current = __atomic_add_fetch(&stats->current, size, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stats->count, 1, __ATOMIC_RELAXED);
+        size_t peak = __atomic_load_n(&stats->peak, __ATOMIC_RELAXED);
+        while ((current > peak) && (false == __atomic_compare_exchange_n(&stats->peak, &peak, current, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))) {
+            /* The peak has been updated meanwhile, try again */
+        }
+    } else {
+        __atomic_sub_fetch(&stats->current, size, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&stats->count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+
+mender_err_t
+mender_utils_heap_set_budget(mender_utils_heap_budget_t *budget) {
+
+    /* Remove the memory budget, the pools must be empty */
+    if (NULL == budget) {
+        mender_utils_heap_budget_set = false;
+        memset(mender_utils_heap_pools, 0, sizeof(mender_utils_heap_pools));
+        return MENDER_OK;
+    }
+
+    /* Check memory budget, the pool of the other modules is required */
+    if ((NULL == budget->memory) || (NULL == budget->lock) || (NULL == budget->unlock)) {
+        mender_log_error("Invalid memory budget");
+        return MENDER_FAIL;
+    }
+
+    /* Carve the memory block into the pools, each pool is a single free block at the beginning */
+    memset(mender_utils_heap_pools, 0, sizeof(mender_utils_heap_pools));
+    uint8_t *memory = (uint8_t *)budget->memory;
+    for (size_t index = 0; index < MENDER_UTILS_HEAP_MODULE_ALL; index++) {
+        size_t size = budget->sizes[index] / MENDER_UTILS_ARENA_ALIGNMENT * MENDER_UTILS_ARENA_ALIGNMENT;
+        if (size < 2 * MENDER_UTILS_HEAP_POOL_BLOCK_HEADER_SIZE) {
+            continue;
+        }
+        mender_utils_heap_pools[index].start      = memory;
+        mender_utils_heap_pools[index].end        = memory + size;
+        mender_utils_heap_pools[index].free       = (mender_utils_heap_pool_block_t *)memory;
+        mender_utils_heap_pools[index].free->size = size;
+        mender_utils_heap_pools[index].free->next = NULL;
+        memory += size;
+    }
+    if (NULL == mender_utils_heap_pools[MENDER_UTILS_HEAP_MODULE_OTHER].start) {
+        mender_log_error("Invalid memory budget");
+        return MENDER_FAIL;
+    }
+    mender_utils_heap_budget     = *budget;
+    mender_utils_heap_budget_set = true;
+
+    return MENDER_OK;
+}
+
+static size_t
+mender_utils_heap_pool_find(void *ptr) {
+
+    /* Search the pool containing the memory */
+    for (size_t index = 0; index < MENDER_UTILS_HEAP_MODULE_ALL; index++) {
+        if ((NULL != mender_utils_heap_pools[index].start) && ((uint8_t *)ptr >= mender_utils_heap_pools[index].start)
+            && ((uint8_t *)ptr < mender_utils_heap_pools[index].end)) {
+            return index;
+        }
+    }
+
+    return MENDER_UTILS_HEAP_MODULE_ALL;
+}
+
+static void *
+mender_utils_heap_pool_take(size_t pool, size_t size) {
+
+    /* Compute the size of the block, the remaining of a block is split only if it can hold an allocation */
+    if (size > SIZE_MAX - MENDER_UTILS_HEAP_POOL_BLOCK_HEADER_SIZE - MENDER_UTILS_ARENA_ALIGNMENT) {
+        return NULL;
+    }
+    size_t needed
+        = MENDER_UTILS_HEAP_POOL_BLOCK_HEADER_SIZE + (size + MENDER_UTILS_ARENA_ALIGNMENT - 1) / MENDER_UTILS_ARENA_ALIGNMENT * MENDER_UTILS_ARENA_ALIGNMENT;
+
+    /* Take the first free block large enough */
+    mender_utils_heap_pool_block_t **link = &mender_utils_heap_pools[pool].free;
+    while (NULL != *link) {
+        mender_utils_heap_pool_block_t *block = *link;
+        if (block->size >= needed) {
+            if (block->size - needed >= MENDER_UTILS_HEAP_POOL_BLOCK_HEADER_SIZE + MENDER_UTILS_ARENA_ALIGNMENT) {
+                mender_utils_heap_pool_block_t *remaining = (mender_utils_heap_pool_block_t *)((uint8_t *)block + needed);
+                remaining->size                           = block->size - needed;
+                remaining->next                           = block->next;
+                block->size                               = needed;
+                *link                                     = remaining;
+            } else {
+                *link = block->next;
+            }
+            return (uint8_t *)block + MENDER_UTILS_HEAP_POOL_BLOCK_HEADER_SIZE;
+        }
+        link = &block->next;
+    }
+
+    return NULL;
+}
+
+static void
+mender_utils_heap_pool_give(size_t pool, void *ptr) {
+
+    mender_utils_heap_pool_block_t *block = (mender_utils_heap_pool_block_t *)((uint8_t *)ptr - MENDER_UTILS_HEAP_POOL_BLOCK_HEADER_SIZE);
+    mender_utils_heap_pool_block_t *prev  = NULL;
+    mender_utils_heap_pool_block_t *next  = mender_utils_heap_pools[pool].free;
+
+    /* Search the position of the block in the free blocks sorted by address */
+    while ((NULL != next) && (next < block)) {
+        prev = next;
+        next = next->next;
+    }
+
+    /* Insert the block and merge it with the adjacent free blocks */
+    if ((NULL != next) && ((uint8_t *)block + block->size == (uint8_t *)next)) {
+        block->size += next->size;
+        block->next = next->next;
+    } else {
+        block->next = next;
+    }
+    if ((NULL != prev) && ((uint8_t *)prev + prev->size == (uint8_t *)block)) {
+        prev->size += block->size;
+        prev->next = block->next;
+    } else if (NULL != prev) {
+        prev->next = block;
+    } else {
+        mender_utils_heap_pools[pool].free = block;
+    }
+}
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
+static void *
+mender_utils_heap_raw_malloc(mender_utils_heap_module_t module, size_t size) {
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+    /* Allocate memory from the pool of the module, the explicit error replaces the exhaustion of the heap */
+    if (true == mender_utils_heap_budget_set) {
+        size_t pool = (NULL != mender_utils_heap_pools[module].start) ? (size_t)module : (size_t)MENDER_UTILS_HEAP_MODULE_OTHER;
+        void  *ptr  = NULL;
+        if (MENDER_OK == mender_utils_heap_budget.lock()) {
+            ptr = mender_utils_heap_pool_take(pool, size);
+            mender_utils_heap_budget.unlock();
+        }
+        if (NULL == ptr) {
+            mender_log_error("Memory budget of the %s pool is exhausted, unable to allocate %zu bytes",
+                             mender_utils_heap_module_to_string((mender_utils_heap_module_t)pool),
+                             size);
+        }
+        return ptr;
+    }
+#else
+    (void)module;
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
+    return mender_utils_allocator.malloc_fn(size);
+}
+
+static void *
+mender_utils_heap_raw_realloc(mender_utils_heap_module_t module, void *ptr, size_t size) {
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+    /* Resize memory in its pool, the memory allocated before the memory budget has been set remains on the allocator */
+    size_t pool;
+    if ((true == mender_utils_heap_budget_set) && ((NULL == ptr) || (MENDER_UTILS_HEAP_MODULE_ALL != (pool = mender_utils_heap_pool_find(ptr))))) {
+        if (NULL == ptr) {
+            return mender_utils_heap_raw_malloc(module, size);
+        }
+
+        /* Keep the block if it is large enough */
+        mender_utils_heap_pool_block_t *block  = (mender_utils_heap_pool_block_t *)((uint8_t *)ptr - MENDER_UTILS_HEAP_POOL_BLOCK_HEADER_SIZE);
+        size_t                          length = block->size - MENDER_UTILS_HEAP_POOL_BLOCK_HEADER_SIZE;
+        if (size <= length) {
+            return ptr;
+        }
+
+        /* Move the memory to a larger block */
+        void *tmp;
+        if (NULL == (tmp = mender_utils_heap_raw_malloc(module, size))) {
+            return NULL;
+        }
+        memcpy(tmp, ptr, length);
+        mender_utils_heap_raw_free(ptr);
+        return tmp;
+    }
+#else
+    (void)module;
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
+    return mender_utils_allocator.realloc_fn(ptr, size);
+}
+
+static void
+mender_utils_heap_raw_free(void *ptr) {
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+    /* Release memory to its pool */
+    size_t pool;
+    if ((true == mender_utils_heap_budget_set) && (MENDER_UTILS_HEAP_MODULE_ALL != (pool = mender_utils_heap_pool_find(ptr)))) {
+        if (MENDER_OK == mender_utils_heap_budget.lock()) {
+            mender_utils_heap_pool_give(pool, ptr);
+            mender_utils_heap_budget.unlock();
+        }
+        return;
+    }
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
+    mender_utils_allocator.free_fn(ptr);
+}
+
+#if !defined(CONFIG_MENDER_TINY) && (defined(CONFIG_MENDER_UTILS_HEAP_ACCOUNTING) || defined(CONFIG_MENDER_CLIENT_MEMORY_BUDGET))
+
+static void *
+mender_utils_heap_json_malloc(size_t size) {
+
+    return mender_utils_heap_malloc(MENDER_UTILS_HEAP_MODULE_JSON, size);
+}
+
+#endif /* !CONFIG_MENDER_TINY && (CONFIG_MENDER_UTILS_HEAP_ACCOUNTING || CONFIG_MENDER_CLIENT_MEMORY_BUDGET) */
+
+static mender_keystore_t *
+mender_utils_keystore_pack(size_t length, size_t size, char **strings) {
+
+    assert(NULL != strings);
+
+    /* Allocate the block, the packed key-stores are accounted to the arenas */
+    size_t                         items_size = (length + 1) * sizeof(mender_item_t);
+    size_t                         block_size = MENDER_UTILS_KEYSTORE_BLOCK_HEADER_SIZE + items_size + size;
+    mender_utils_keystore_block_t *block      = (mender_utils_keystore_block_t *)mender_utils_heap_malloc(MENDER_UTILS_HEAP_MODULE_ARENA, block_size);
+    if (NULL == block) {
+        return NULL;
+    }
+    block->refcount = 1;
+    block->size     = block_size;
+
+    /* Initialize the items, they are all empty */
+    mender_keystore_t *keystore = (mender_keystore_t *)((uint8_t *)block + MENDER_UTILS_KEYSTORE_BLOCK_HEADER_SIZE);
+    for (size_t index = 0; index <= length; index++) {
+        keystore[index].name  = NULL;
+        keystore[index].value = (char *)block;
+    }
+    *strings = (char *)keystore + items_size;
+
+    return keystore;
+}
+
+static char *
+mender_utils_keystore_pack_string(char **strings, const char *s) {
+
+    assert(NULL != strings);
+    assert(NULL != s);
+
+    /* Copy the string and move to the next one */
+    char  *str    = *strings;
+    size_t length = strlen(s) + 1;
+    memcpy(str, s, length);
+    *strings += length;
+
+    return str;
+}
+
+static mender_utils_keystore_block_t *
+mender_utils_keystore_get_block(mender_keystore_t *keystore) {
+
+    /* The empty items of a packed key-store reference its block, the ones of other key-stores have no value */
+    size_t index = 0;
+    if (NULL != keystore) {
+        while (NULL != keystore[index].name) {
+            index++;
+        }
+        return (mender_utils_keystore_block_t *)keystore[index].value;
+    }
+
+    return NULL;
+}
+
+static bool
+mender_utils_keystore_block_contains(mender_utils_keystore_block_t *block, void *ptr) {
+
+    /* Check the address range of the block */
+    if (NULL == block) {
+        return false;
+    }
+
+    return ((uint8_t *)ptr >= (uint8_t *)block) && ((uint8_t *)ptr < (uint8_t *)block + block->size);
+}
+
+static bool
+mender_utils_kv_table_search(mender_utils_kv_table_t *table, const char *name, size_t *index) {
+
+    assert(NULL != table);
+    assert(NULL != name);
+    assert(NULL != index);
+    size_t low  = 0;
+    size_t high = table->size;
+
+    /* Check the last item first, the items read from the storage are set in order */
+    if ((0 < high) && (0 < strcmp(name, table->items[high - 1].name))) {
+        *index = high;
+        return false;
+    }
+
+    /* Bisect the items */
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int    cmp    = strcmp(name, table->items[middle].name);
+        if (0 == cmp) {
+            *index = middle;
+            return true;
+        } else if (0 > cmp) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    *index = low;
+
+    return false;
+}
+
+static size_t
+mender_utils_buffer_append(char *buffer, size_t size, size_t offset, const char *data, size_t length) {
+
+    assert(NULL != data);
+
+    /* Copy the part of the data which fits in the buffer */
+    if ((NULL != buffer) && (offset + 1 < size)) {
+        memcpy(&buffer[offset], data, (length < size - 1 - offset) ? length : size - 1 - offset);
+    }
+
+    return offset + length;
+}
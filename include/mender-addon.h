@@ -34,6 +34,11 @@ typedef struct {
     mender_err_t (*activate)(void);       /**< Invoked to activate the add-on */
     mender_err_t (*deactivate)(void);     /**< Invoked to deactivate the add-on */
     mender_err_t (*exit)(void);           /**< Invoked to cleanup the add-on */
+    mender_err_t (*trigger)(uint32_t);    /**< Invoked when the client is triggered with the reasons, NULL if the add-on is not concerned */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    size_t ctx_size;             /**< Size of the context allocated for each additional device, 0 if the contexts are not supported */
+    void *(*select_ctx)(void *); /**< Invoked to select the context of the calling thread, NULL for the one of mender_client_init, returns the previous one */
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
 } mender_addon_instance_t;
 
 #ifdef __cplusplus
@@ -27,17 +27,27 @@ extern "C" {
 
 #include "mender-utils.h"
 #include "mender-artifact.h"
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+#include "mender-websocket.h"
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
 
 /**
  * @brief Mender API configuration
  */
 typedef struct {
-    char *artifact_name; /**< Artifact name */
-    char *device_type;   /**< Device type */
-    char *host;          /**< URL of the mender server */
-    char *tenant_token;  /**< Tenant token used to authenticate on the mender server (optional) */
+    char  *artifact_name;             /**< Artifact name */
+    char  *device_type;               /**< Device type */
+    char  *host;                      /**< URL of the mender server, several URLs separated by spaces to fail over */
+    char  *tenant_token;              /**< Tenant token used to authenticate on the mender server (optional) */
+    size_t http_recv_buf_length;      /**< Length of the receive buffer of the HTTP client (bytes), 0 to use the default of the platform */
+    size_t websocket_recv_buf_length; /**< Length of the receive buffer of the websocket client (bytes), 0 to use the default of the platform */
 } mender_api_config_t;
 
+/**
+ * @brief Context of a device, it holds the configuration, the authentication token and the entity tags of the device
+ */
+typedef struct mender_api_ctx_s mender_api_ctx_t;
+
 /**
  * @brief Deployment API Struct
  */
@@ -49,6 +59,48 @@ typedef struct {
     size_t device_types_compatible_size; /**< Size of the  deployment type array */
 } mender_api_deployment_data_t;
 
+/**
+ * @brief Mender API statistics, cumulated since the initialization of the API
+ */
+typedef struct {
+    struct {
+        uint32_t requests;  /**< Number of HTTP requests performed */
+        uint32_t errors;    /**< Number of HTTP requests failed before a response has been received */
+        uint32_t status[5]; /**< Number of HTTP responses per status class, from 1xx to 5xx */
+        size_t   received;  /**< Length of the data received (bytes) */
+    } http;                 /**< HTTP requests */
+    struct {
+        uint32_t successes; /**< Number of authentications succeeded */
+        uint32_t failures;  /**< Number of authentications failed */
+    } authentication;       /**< Authentication with the server */
+    struct {
+        uint32_t successes;  /**< Number of artifact downloads succeeded */
+        uint32_t failures;   /**< Number of artifact downloads failed */
+        uint32_t resumes;    /**< Number of artifact downloads resumed after the connection has been lost */
+        size_t   received;   /**< Length of the artifacts received (bytes) */
+        size_t   copied;     /**< Length of the artifact data copied to the ring buffer of the parser instead of being given directly to the callback (bytes) */
+        size_t   length;     /**< Length of the last artifact download (bytes) */
+        uint32_t duration;   /**< Duration of the last artifact download (milliseconds) */
+        uint32_t throughput; /**< Throughput of the last artifact download (bytes per second) */
+    } download;              /**< Artifact downloads */
+    struct {
+        uint32_t connections; /**< Number of connections of the troubleshoot websocket */
+        uint32_t failures;    /**< Number of connections of the troubleshoot websocket failed */
+    } websocket;              /**< Troubleshoot websocket */
+} mender_api_stats_t;
+
+#ifdef CONFIG_MENDER_API_BATCH
+
+/**
+ * @brief Requests performed back-to-back with the deployment checks, their responses are kept until they are consumed
+ */
+typedef enum {
+    MENDER_API_BATCH_CONFIGURATION = 0, /**< Download of the device configuration, consumed by mender_api_download_configuration_data */
+    MENDER_API_BATCH_COUNT              /**< Number of requests of the batches, not a request */
+} mender_api_batch_request_t;
+
+#endif /* CONFIG_MENDER_API_BATCH */
+
 /**
  * @brief Initialization of the API
  * @param config Mender API configuration
@@ -62,6 +114,13 @@ mender_err_t mender_api_init(mender_api_config_t *config);
  */
 mender_err_t mender_api_perform_authentication(mender_err_t (*get_identity)(mender_identity_t **identity));
 
+/**
+ * @brief Get the remaining validity of the authentication token, computed from its lifetime and the time elapsed since it has been received
+ * @param validity Remaining validity of the token (seconds), 0 if the token has expired
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the lifetime of the token is not known, error code otherwise
+ */
+mender_err_t mender_api_get_authentication_validity(uint32_t *validity);
+
 /**
  * @brief Check for deployments for the device from the mender-server
  * @param deployment Deployment structure to be filled with the deployment information, if one is pending
@@ -73,24 +132,89 @@ mender_err_t mender_api_check_for_deployment(mender_api_deployment_data_t *deplo
  * @brief Publish deployment status of the device to the mender-server
  * @param id ID of the deployment received from mender_api_check_for_deployment function
  * @param deployment_status Deployment status
+ * @param substate Substate of the deployment, NULL if not provided
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_publish_deployment_status(char *id, mender_deployment_status_t deployment_status, char *substate);
+
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+/**
+ * @brief Publish the messages of the log buffer to the mender-server, they are removed from the log buffer once they have been published
+ * @note The payload is compressed when CONFIG_MENDER_HTTP_GZIP is enabled and it is large enough
+ * @param id ID of the deployment to which the logs are attached
+ * @return MENDER_OK if the function succeeds, MENDER_DONE if there is nothing to publish, error code otherwise
+ */
+mender_err_t mender_api_publish_deployment_logs(char *id);
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
+/**
+ * @brief Set the rate of the artifact downloads, the download in progress (if any) is paced immediately
+ * @param rate Rate (bytes per second), 0 if not limited
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_api_publish_deployment_status(char *id, mender_deployment_status_t deployment_status);
+mender_err_t mender_api_set_download_rate(uint32_t rate);
+
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+
+/**
+ * @brief Fragment of an artifact download, as delivered by the HTTP client with the MENDER_HTTP_EVENT_DATA_RECEIVED events
+ */
+typedef struct {
+    uint32_t delay;  /**< Time elapsed since the previous fragment, or since the request for the first fragment of a request (milliseconds) */
+    size_t   length; /**< Length of the fragment (bytes) */
+} mender_api_download_fragment_t;
+
+/**
+ * @brief Set the callback invoked with each fragment received by the artifact downloads, used to record the pattern of the network
+ * @note The capture begins with the next download, the callback is invoked from the thread performing it and must return quickly
+ * @param callback Callback invoked with the fragment received, NULL to stop the capture
+ * @param params Parameters of the callback
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_set_download_capture(void (*callback)(mender_api_download_fragment_t *, void *), void *params);
+
+/**
+ * @brief Set the fragments replayed by the artifact downloads, the data received is delivered to the artifact parser cut and timed as the fragments
+ * @note The replay begins with the next download from the first fragment, the fragments are replayed again from the first one when they are all replayed
+ * @note The fragments must remain valid until the replay is stopped, the data is delivered at least as late as recorded and possibly later
+ * @param fragments Fragments, NULL to stop the replay
+ * @param count Number of fragments
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_set_download_replay(const mender_api_download_fragment_t *fragments, size_t count);
+
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+/**
+ * @brief Retrieve the statistics of the API, the counters are updated without lock so that the requests are not slowed down
+ * @note The counters are read one by one, the fields of the last download may be inconsistent if a download ends meanwhile
+ * @param stats Statistics of the API
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_get_stats(mender_api_stats_t *stats);
 
 /**
  * @brief Download artifact from the mender-server
+ * @note The artifact is downloaded from the mirror if it is defined, the download falls back to the URI if the mirror is not able to serve it
  * @param uri URI of the deployment received from mender_api_check_for_deployment function
+ * @param mirror Base URL of a mirror caching the artifacts, the scheme of the URI is replaced by it, NULL or empty to download from the URI
+ * @param ctx Artifact context used to parse the artifact, created by the caller with mender_artifact_create_ctx function
  * @param callback Callback function to be invoked to perform the treatment of the data from the artifact
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_api_download_artifact(char *uri, mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
+mender_err_t mender_api_download_artifact(char                  *uri,
+                                          char                  *mirror,
+                                          mender_artifact_ctx_t *ctx,
+                                          mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t));
 
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
 #ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
 
 /**
  * @brief Download configure data of the device from the mender-server
- * @param configuration Mender configuration key/value pairs table, ends with a NULL/NULL element, NULL if not defined
+ * @param configuration Mender configuration key/value pairs table, ends with a NULL/NULL element, NULL if not defined or not modified since the last download
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_api_download_configuration_data(mender_keystore_t **configuration);
@@ -108,6 +232,19 @@ mender_err_t mender_api_publish_configuration_data(mender_keystore_t *configurat
 
 #ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
 
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+/**
+ * @brief Connect the device and make it available to the server
+ * @param callback Callback function to be invoked to perform the treatment of the data from the websocket, invoked with the argument
+ * @param arg Argument of the callback, it permits to retrieve the context of the device from the thread of the websocket
+ * @param handle Connection handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_troubleshoot_connect(mender_err_t (*callback)(void *, size_t, void *), void *arg, void **handle);
+
+#else
+
 /**
  * @brief Connect the device and make it available to the server
  * @param callback Callback function to be invoked to perform the treatment of the data from the websocket
@@ -116,15 +253,26 @@ mender_err_t mender_api_publish_configuration_data(mender_keystore_t *configurat
  */
 mender_err_t mender_api_troubleshoot_connect(mender_err_t (*callback)(void *, size_t), void **handle);
 
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
 /**
  * @brief Send binary data to the server
  * @param handle Connection handle
  * @param payload Payload to send
  * @param length Length of the payload
- * @return MENDER_OK if the function succeeds, error code otherwise
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue is full, error code otherwise
  */
 mender_err_t mender_api_troubleshoot_send(void *handle, void *payload, size_t length);
 
+/**
+ * @brief Send binary data made of several segments to the server, the segments are not copied to a contiguous buffer
+ * @param handle Connection handle
+ * @param segments Segments to send
+ * @param count Number of segments
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue is full, error code otherwise
+ */
+mender_err_t mender_api_troubleshoot_send_v(void *handle, mender_websocket_segment_t *segments, size_t count);
+
 /**
  * @brief Disconnect the device
  * @param handle Connection handle
@@ -139,12 +287,51 @@ mender_err_t mender_api_troubleshoot_disconnect(void *handle);
 /**
  * @brief Publish inventory data of the device to the mender-server
  * @param inventory Mender inventory key/value pairs table, must end with a NULL/NULL element, NULL if not defined
+ * @param patch Only the attributes of the inventory are added or updated with a PATCH request if true, all the attributes are replaced otherwise
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_api_publish_inventory_data(mender_keystore_t *inventory);
+mender_err_t mender_api_publish_inventory_data(mender_keystore_t *inventory, bool patch);
 
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
 
+#ifdef CONFIG_MENDER_API_BATCH
+
+/**
+ * @brief Register a request to be performed back-to-back with the deployment checks, on the same connection and with the same token
+ * @note The response replaces the previous one if it has not been consumed, the callback is invoked by the work checking for deployments
+ * @param request Request
+ * @param callback Callback invoked when the response of the request is available, NULL to unregister the request
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_api_batch_register(mender_api_batch_request_t request, mender_err_t (*callback)(void));
+
+#endif /* CONFIG_MENDER_API_BATCH */
+
+#ifdef CONFIG_MENDER_API_CONTEXTS
+
+/**
+ * @brief Create the context of an additional device, it is used to simulate many devices in a single process
+ * @note The server hosts, the HTTP and websocket clients, the download rate and the statistics are shared with the context of mender_api_init
+ * @param config Mender API configuration of the device, the host and the buffer lengths are ignored, the strings must remain valid
+ * @return Context if the function succeeds, NULL otherwise
+ */
+mender_api_ctx_t *mender_api_create_ctx(mender_api_config_t *config);
+
+/**
+ * @brief Select the context of the requests performed by the calling thread, the other threads are not affected
+ * @param ctx Context, NULL to select the context of mender_api_init
+ * @return Context previously selected by the calling thread, NULL if it was the context of mender_api_init
+ */
+mender_api_ctx_t *mender_api_select_ctx(mender_api_ctx_t *ctx);
+
+/**
+ * @brief Release the context of an additional device, it must not be selected by the calling thread
+ * @param ctx Context
+ */
+void mender_api_release_ctx(mender_api_ctx_t *ctx);
+
+#endif /* CONFIG_MENDER_API_CONTEXTS */
+
 /**
  * @brief Release mender API
  * @return MENDER_OK if the function succeeds, error code otherwise
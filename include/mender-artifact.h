@@ -25,6 +25,16 @@ extern "C" {
 #endif /* __cplusplus */
 
 #include "mender-utils.h"
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+#include "mender-tls.h"
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
+
+/**
+ * @brief Artifact input ring buffer size (bytes), must be a multiple of the TAR block size and hold at least two blocks
+ */
+#ifndef CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE
+#define CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE */
 
 /**
  * @brief Artifact state machine used to process input data stream
@@ -34,6 +44,24 @@ typedef enum {
     MENDER_ARTIFACT_STREAM_STATE_PARSING_DATA        /**< Currently parsing data */
 } mender_artifact_stream_state_t;
 
+/**
+ * @brief Artifact file types, the file currently parsed is classified once when its TAR header is parsed
+ */
+typedef enum {
+    MENDER_ARTIFACT_FILE_TYPE_VERSION = 0,  /**< Version file */
+    MENDER_ARTIFACT_FILE_TYPE_MANIFEST,     /**< Manifest file */
+    MENDER_ARTIFACT_FILE_TYPE_MANIFEST_SIG, /**< Signature of the manifest file */
+    MENDER_ARTIFACT_FILE_TYPE_HEADER_INFO,  /**< Header-info file */
+    MENDER_ARTIFACT_FILE_TYPE_META_DATA,    /**< Meta-data file of a payload */
+    MENDER_ARTIFACT_FILE_TYPE_TYPE_INFO,    /**< Type-info file of a payload */
+    MENDER_ARTIFACT_FILE_TYPE_DATA_TAR,     /**< Beginning of the data file of a payload */
+    MENDER_ARTIFACT_FILE_TYPE_DATA,         /**< File of a payload */
+    MENDER_ARTIFACT_FILE_TYPE_DATA_TAR_GZ,  /**< Compressed data file of a payload */
+    MENDER_ARTIFACT_FILE_TYPE_TAR_GZ,       /**< Compressed TAR file */
+    MENDER_ARTIFACT_FILE_TYPE_TAR,          /**< TAR file, nothing to do */
+    MENDER_ARTIFACT_FILE_TYPE_DROP          /**< File not relevant, dropped */
+} mender_artifact_file_type_t;
+
 /**
  * @brief Artifact payloads
  */
@@ -47,7 +75,7 @@ typedef struct {
     char **clears_provides;      /**< Clears provides of the payload (string list) */
     size_t clears_provides_size; /**< Number of clears provides of the payload */
 #endif
-    cJSON *meta_data; /**< Meta-data from the header tarball, NULL if no meta-data */
+    mender_meta_data_t *meta_data; /**< Meta-data from the header tarball, NULL if no meta-data */
 } mender_artifact_payload_t;
 
 /**
@@ -56,9 +84,14 @@ typedef struct {
 typedef struct {
     mender_artifact_stream_state_t stream_state; /**< Stream state of the artifact processing */
     struct {
-        void  *data;   /**< Data received, concatenated chunk by chunk */
-        size_t length; /**< Length of the data received */
-    } input;           /**< Input data of the artifact */
+        uint8_t data[CONFIG_MENDER_ARTIFACT_INPUT_BUFFER_SIZE]; /**< Ring buffer of the data received and not parsed yet */
+        size_t  head;                                           /**< Index of the first byte not parsed yet in the ring buffer */
+        size_t  length;                                         /**< Length of the data available in the ring buffer */
+    } input;                                                    /**< Input data of the artifact */
+    struct {
+        size_t received; /**< Length of the data received (bytes) */
+        size_t copied;   /**< Length of the data copied to the ring buffer (bytes), the other data are given directly to the callback or skipped */
+    } stats;             /**< Statistics of the artifact processing */
     struct {
         size_t                     size;   /**< Number of payloads in the artifact */
         mender_artifact_payload_t *values; /**< Values of payloads in the artifact */
@@ -71,10 +104,40 @@ typedef struct {
     } artifact_info;                        /**< Global information about the artifact */
 #endif
     struct {
-        char  *name;  /**< Name of the file currently parsed */
-        size_t size;  /**< Size of the file currently parsed (bytes) */
-        size_t index; /**< Index of the data in the file currently parsed (bytes), incremented block by block */
-    } file;           /**< Information about the file currently parsed */
+        char                       *name;          /**< Name of the file currently parsed */
+        mender_artifact_file_type_t type;          /**< Type of the file currently parsed */
+        size_t                      payload_index; /**< Payload index of the file currently parsed, only relevant for the files of a payload */
+        size_t                      size;          /**< Size of the file currently parsed (bytes) */
+        size_t                      index;         /**< Index of the data in the file currently parsed (bytes), incremented block by block */
+        void                       *data; /**< Content of the file currently parsed, only used for the files that must be parsed at once, NULL otherwise */
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+        void *sha256; /**< SHA-256 digest handle of the payload file currently parsed, NULL otherwise */
+#endif
+#ifdef CONFIG_MENDER_ARTIFACT_STREAMING_JSON
+        void *json; /**< Streaming JSON parser of the header-info or type-info file currently parsed, NULL otherwise */
+#endif /* CONFIG_MENDER_ARTIFACT_STREAMING_JSON */
+    } file; /**< Information about the file currently parsed */
+    mender_utils_arena_t arena; /**< Arena holding the metadata of the artifact, released at once with the context */
+#ifdef CONFIG_MENDER_ARTIFACT_GZIP
+    struct {
+        void *stream; /**< Decompression stream of the compressed TAR file currently parsed, NULL otherwise */
+        void *ctx;    /**< Artifact context used to parse the decompressed TAR file, NULL otherwise */
+    } decompressor;   /**< Decompressor of the compressed TAR file currently parsed */
+#endif
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
+    struct {
+        const char                 *key;       /**< Public key used to verify the signature (PEM format), NULL if unsigned artifacts are accepted */
+        bool                        verified;  /**< Signature of the manifest has been verified */
+        mender_artifact_file_type_t type;      /**< Type of the signed file currently hashed */
+        void                       *sha256;    /**< SHA-256 digest handle of the signed file currently hashed, NULL otherwise */
+        size_t                      remaining; /**< Length of the data of the signed file currently hashed not consumed yet (bytes) */
+        bool                        version_hashed;  /**< Digest of the version file has been computed */
+        bool                        manifest_hashed; /**< Digest of the manifest file has been computed */
+        uint8_t                     version[MENDER_TLS_SHA256_DIGEST_LENGTH];        /**< Digest of the version file */
+        uint8_t                     manifest[MENDER_TLS_SHA256_DIGEST_LENGTH];       /**< Digest of the manifest file */
+        char                        header[2 * MENDER_TLS_SHA256_DIGEST_LENGTH + 1]; /**< Checksum of the header file retrieved from the signed manifest */
+    } signature; /**< Signature verification of the artifact, chained with the checksums of the manifest */
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
 } mender_artifact_ctx_t;
 
 #ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
@@ -93,11 +156,14 @@ mender_err_t mender_artifact_get_device_type(mender_artifact_ctx_t *ctx, const c
  */
 mender_artifact_ctx_t *mender_artifact_create_ctx(void);
 
+#ifdef CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE
 /**
- * @brief Function used to create a new artifact context
- * @return MENDER_OK if the function succeeds, error code otherwise
+ * @brief Function used to set the public key used to verify the signature of the artifact, unsigned artifacts are then rejected
+ * @param ctx Artifact context
+ * @param key Public key (PEM format), must remain valid until the context is released, NULL to accept unsigned artifacts
  */
-mender_err_t mender_artifact_get_ctx(mender_artifact_ctx_t **ctx);
+void mender_artifact_set_verification_key(mender_artifact_ctx_t *ctx, const char *key);
+#endif /* CONFIG_MENDER_ARTIFACT_VERIFY_SIGNATURE */
 
 /**
  * @brief Function used to process data from artifact stream
@@ -110,7 +176,7 @@ mender_err_t mender_artifact_get_ctx(mender_artifact_ctx_t **ctx);
 mender_err_t mender_artifact_process_data(mender_artifact_ctx_t *ctx,
                                           void                  *input_data,
                                           size_t                 input_length,
-                                          mender_err_t (*callback)(char *, cJSON *, char *, size_t, void *, size_t, size_t));
+                                          mender_err_t (*callback)(char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t));
 
 /**
  * @brief Function used to release artifact context
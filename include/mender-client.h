@@ -26,19 +26,47 @@ extern "C" {
 #endif /* __cplusplus */
 
 #include "mender-addon.h"
+#include "mender-api.h"
 #include "mender-utils.h"
 
+/**
+ * @brief Reasons of the triggers of the client, they can be combined
+ */
+typedef enum {
+    MENDER_CLIENT_TRIGGER_NETWORK_AVAILABLE = (1 << 0), /**< Network became available, the works which may have failed meanwhile are executed */
+    MENDER_CLIENT_TRIGGER_INVENTORY_REFRESH = (1 << 1), /**< Application requested the inventory to be published */
+    MENDER_CLIENT_TRIGGER_DEPLOYMENT_HINT   = (1 << 2), /**< A deployment is likely pending, for example following a notification from the application */
+} mender_client_trigger_t;
+
+/**
+ * @brief Mender client statistics, cumulated since the initialization of the client
+ */
+typedef struct {
+    mender_api_stats_t api; /**< Statistics of the requests to the server */
+    struct {
+        uint64_t initialization; /**< Time spent initializing the client (milliseconds) */
+        uint64_t authentication; /**< Time spent authenticating with the server (milliseconds) */
+        uint64_t authenticated;  /**< Time spent authenticated with the server (milliseconds) */
+    } states;                    /**< Time spent in each state of the client */
+    uint32_t failures;           /**< Number of failed executions of the client work, they are retried according to the backoff policy */
+} mender_client_stats_t;
+
 /**
  * @brief Mender client configuration
  */
 typedef struct {
-    char   *artifact_name;                /**< Artifact name */
-    char   *device_type;                  /**< Device type */
-    char   *host;                         /**< URL of the mender server */
-    char   *tenant_token;                 /**< Tenant token used to authenticate on the mender server (optional) */
-    int32_t authentication_poll_interval; /**< Authentication poll interval, default is 60 seconds, -1 permits to disable periodic execution */
-    int32_t update_poll_interval;         /**< Update poll interval, default is 1800 seconds, -1 permits to disable periodic execution */
-    bool    recommissioning;              /**< Used to force creation of new authentication keys */
+    char                     *artifact_name;                /**< Artifact name */
+    char                     *device_type;                  /**< Device type */
+    char                     *host;                         /**< URL of the mender server, several URLs separated by spaces to fail over */
+    char                     *tenant_token;                 /**< Tenant token used to authenticate on the mender server (optional) */
+    int32_t                   authentication_poll_interval; /**< Authentication poll interval, default is 60 seconds, -1 to disable periodic execution */
+    int32_t                   update_poll_interval;         /**< Update poll interval, default is 1800 seconds, -1 to disable periodic execution */
+    bool                      recommissioning;              /**< Used to force creation of new authentication keys */
+    size_t                    http_recv_buf_length;         /**< Length of the receive buffer of the HTTP client (bytes), 0 to use the platform default */
+    size_t                    websocket_recv_buf_length;    /**< Length of the receive buffer of the websocket client (bytes), 0 to use the platform default */
+    char                     *artifact_verify_key;          /**< Public key to verify the artifact signatures (PEM format), NULL to accept unsigned artifacts */
+    char                     *artifact_mirror;              /**< Base URL of a mirror caching the artifacts, the server is used if it fails (optional) */
+    mender_utils_allocator_t *allocator;                    /**< Allocator of the client and of cJSON, NULL for the standard library (optional) */
 } mender_client_config_t;
 
 /**
@@ -54,8 +82,21 @@ typedef struct {
     mender_err_t (*get_identity)(mender_identity_t **identity);            /**< Invoked to retrieve identity */
     mender_err_t (*get_user_provided_keys)(
         char **user_provided_key, size_t *user_provided_key_length); /**< Invoked to retrieve buffer and buffer size of PEM encoded user-provided key */
+    mender_err_t (*authentication_keys)(
+        bool completed); /**< Invoked while authentication keys are generated in the background, completed is set when keys are available (optional) */
+    mender_err_t (*network_connected)(
+        uint32_t duration); /**< Invoked when the network is connected with the duration of network_connect (milliseconds), to tune the linger (optional) */
+    mender_err_t (*download_progress)(
+        size_t downloaded, size_t total, uint8_t percent); /**< Invoked when the download progress changes, total is the size of payloads known (optional) */
+    mender_err_t (*get_artifact_mirror)(
+        char **mirror); /**< Invoked before downloading an artifact to discover a mirror, NULL to use the configured mirror, must remain valid (optional) */
 } mender_client_callbacks_t;
 
+/**
+ * @brief Context of a device, it holds the configuration, the state, the works, the deployments and the add-ons of the client
+ */
+typedef struct mender_client_ctx_s mender_client_ctx_t;
+
 /**
  * @brief Return mender client version
  * @return Mender client version as string
@@ -70,6 +111,63 @@ char *mender_client_version(void);
  */
 mender_err_t mender_client_init(mender_client_config_t *config, mender_client_callbacks_t *callbacks);
 
+/**
+ * @brief Mender client artifact type
+ */
+typedef struct mender_client_artifact_type {
+    char *type; /**< Artifact type */
+    mender_err_t (*callback)(
+        char *, char *, char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t); /**< Callback to be invoked to handle the artifact type */
+    bool  needs_restart; /**< Indicate the artifact type needs a restart to be applied on the system */
+    char *artifact_name; /**< Artifact name (optional, NULL otherwise), set to validate module update after restarting */
+} mender_client_artifact_type_t;
+
+#ifdef CONFIG_MENDER_CLIENT_STATIC_REGISTRATION
+
+/**
+ * @brief Mender client add-on registered at compile time
+ */
+typedef struct mender_client_addon {
+    mender_addon_instance_t *addon;     /**< Add-on */
+    void                    *config;    /**< Add-on configuration */
+    void                    *callbacks; /**< Add-on callbacks */
+} mender_client_addon_t;
+
+/**
+ * @brief Define an entry registered at compile time, the entries are gathered by the linker in a section of the flash
+ * @note On Zephyr the entries are iterable sections, otherwise the linker must provide the __start_ and __stop_ symbols of the section (GNU ld, lld)
+ */
+#ifdef __ZEPHYR__
+#include <zephyr/sys/iterable_sections.h>
+#define MENDER_CLIENT_STATIC_DEFINE(struct_type, name) const STRUCT_SECTION_ITERABLE(struct_type, name)
+#else
+#define MENDER_CLIENT_STATIC_DEFINE(struct_type, name) \
+    const struct struct_type name __attribute__((used, section(#struct_type), aligned(__alignof__(struct struct_type))))
+#endif /* __ZEPHYR__ */
+
+/**
+ * @brief Register an artifact type at compile time, it is never released and it is resolved without lock
+ * @param name Name of the entry
+ * @param type Artifact type
+ * @param callback Artifact type callback
+ * @param needs_restart Flag to indicate if the artifact type requires the device to restart after downloading
+ * @param artifact_name Artifact name (optional, NULL otherwise), set to validate module update after restarting
+ */
+#define MENDER_CLIENT_ARTIFACT_TYPE_DEFINE(name, type, callback, needs_restart, artifact_name) \
+    MENDER_CLIENT_STATIC_DEFINE(mender_client_artifact_type, name) = { (type), (callback), (needs_restart), (artifact_name) }
+
+/**
+ * @brief Register an add-on at compile time, it is initialized by mender_client_init
+ * @param name Name of the entry
+ * @param addon Add-on
+ * @param config Add-on configuration, it must remain valid
+ * @param callbacks Add-on callbacks, they must remain valid
+ */
+#define MENDER_CLIENT_ADDON_DEFINE(name, addon, config, callbacks) \
+    MENDER_CLIENT_STATIC_DEFINE(mender_client_addon, name) = { (mender_addon_instance_t *)(addon), (void *)(config), (void *)(callbacks) }
+
+#endif /* CONFIG_MENDER_CLIENT_STATIC_REGISTRATION */
+
 /**
  * @brief Register artifact type
  * @param type Artifact type
@@ -79,7 +177,8 @@ mender_err_t mender_client_init(mender_client_config_t *config, mender_client_ca
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_client_register_artifact_type(char *type,
-                                                  mender_err_t (*callback)(char *, char *, char *, cJSON *, char *, size_t, void *, size_t, size_t),
+                                                  mender_err_t (*callback)(
+                                                      char *, char *, char *, mender_meta_data_t *, char *, size_t, void *, size_t, size_t),
                                                   bool  needs_restart,
                                                   char *artifact_name);
 
@@ -88,6 +187,7 @@ mender_err_t mender_client_register_artifact_type(char *type,
  * @param addon Add-on
  * @param config Add-on configuration
  * @param callbacks Add-on callbacks
+ * @note The add-ons of an additional device must support the contexts and must be registered before the device is activated
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_client_register_addon(mender_addon_instance_t *addon, void *config, void *callbacks);
@@ -113,6 +213,86 @@ mender_err_t mender_client_deactivate(void);
  */
 mender_err_t mender_client_execute(void);
 
+/**
+ * @brief Install an artifact read from a local source (USB, SD card, serial link...), the network and the mender-server are not used
+ * @note The artifact is handled by the artifact type callbacks as if it was downloaded, they receive an empty deployment ID
+ * @note The statuses of the deployment are only given to the deployment status callback, the restart callback is invoked if the artifact requires it
+ * @note The installation fails if the update work is processing a deployment, the update work skips checking for deployments meanwhile
+ * @param artifact_name Artifact name, it is checked after restarting to report the deployment status
+ * @param callback Function invoked to read the artifact, it sets the length to the number of bytes read in the buffer, 0 at the end of the artifact
+ * @param params Parameters of the callback function
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_install_artifact_stream(char *artifact_name, mender_err_t (*callback)(void *, size_t *, void *), void *params);
+
+/**
+ * @brief Function used to trigger the works concerned by events, the other ones are not executed
+ * @note The works already pending are executed once, the authentication is skipped if the token is still valid
+ * @param reasons Reasons of the trigger, combination of mender_client_trigger_t
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_trigger(uint32_t reasons);
+
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+/**
+ * @brief Function used to trigger the upload of the log buffer to the mender-server
+ * @note The logs are published by the deployment status work, they are also published automatically when a deployment fails
+ * @param id ID of the deployment to which the logs are attached
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_publish_deployment_logs(char *id);
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
+/**
+ * @brief Function used to set the rate of the artifact downloads, so that the application traffic sharing the link is not starved
+ * @note The rate can be raised when the application is idle and lowered while critical traffic flows, the download in progress is paced immediately
+ * @param rate Rate (bytes per second), 0 if not limited
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_set_download_rate(uint32_t rate);
+
+#ifdef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+
+/**
+ * @brief Function used to record the pattern of the network, the callback is invoked with the delay and the length of each fragment downloaded
+ * @param callback Callback invoked with the fragment received, NULL to stop the capture
+ * @param params Parameters of the callback
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_set_download_capture(void (*callback)(mender_api_download_fragment_t *, void *), void *params);
+
+/**
+ * @brief Function used to replay a pattern recorded with mender_client_set_download_capture, so that the performance of the updates is reproducible
+ * @param fragments Fragments, they must remain valid until the replay is stopped, NULL to stop the replay
+ * @param count Number of fragments
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_set_download_replay(const mender_api_download_fragment_t *fragments, size_t count);
+
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+#ifdef CONFIG_MENDER_CLIENT_DEFERRED_INSTALL
+
+/**
+ * @brief Function used to commit the deployment downloaded, the artifact is then installed by the update work and the device restarted if it is required
+ * @note The deployments are downloaded in the background, the status "pause before installing" informs the application that one is waiting to be committed
+ * @note New deployments are not checked until the deployment downloaded is committed
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if no deployment is waiting to be committed, error code otherwise
+ */
+mender_err_t mender_client_commit_deployment(void);
+
+#endif /* CONFIG_MENDER_CLIENT_DEFERRED_INSTALL */
+
+/**
+ * @brief Function used to retrieve the statistics of the client, the counters are updated without lock so that the client is not slowed down
+ * @note The counters are read one by one, the statistics may be slightly inconsistent if a request ends meanwhile
+ * @param stats Statistics of the client
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_client_get_stats(mender_client_stats_t *stats);
+
 /**
  * @brief Function to be called from add-ons to request network access
  * @return MENDER_OK if network is connected following the request, error code otherwise
@@ -125,6 +305,41 @@ mender_err_t mender_client_network_connect(void);
  */
 mender_err_t mender_client_network_release(void);
 
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+/**
+ * @brief Create the context of an additional device, it is used to simulate many devices in a single process
+ * @note The client must be initialized with mender_client_init function first, and the context is released before mender_client_exit function
+ * @note The host, the buffer lengths, the recommissioning and the allocator of the configuration are ignored, the flash artifact types are not registered
+ * @note The scheduler, the storage and the flash are shared, the authentication keys, the deployment data and the provides are not recorded in the storage
+ * @param config Mender client configuration of the device, the strings must remain valid
+ * @param callbacks Mender client callbacks of the device
+ * @return Context if the function succeeds, NULL otherwise
+ */
+mender_client_ctx_t *mender_client_create_ctx(mender_client_config_t *config, mender_client_callbacks_t *callbacks);
+
+/**
+ * @brief Select the context of the device used by the calling thread, the other threads are not affected
+ * @note The contexts of the requests, of the authentication keys and of the add-ons of the device are selected as well
+ * @param ctx Context, NULL to select the context of mender_client_init
+ * @return Context previously selected by the calling thread, NULL if it was the context of mender_client_init
+ */
+mender_client_ctx_t *mender_client_select_ctx(mender_client_ctx_t *ctx);
+
+/**
+ * @brief Get the context of the device used by the calling thread, the add-ons use it to create works executed with the context of their device
+ * @return Context selected by the calling thread, NULL if it is the context of mender_client_init
+ */
+mender_client_ctx_t *mender_client_get_ctx(void);
+
+/**
+ * @brief Release the context of an additional device, it must be deactivated and it must not be selected by the calling thread
+ * @param ctx Context
+ */
+void mender_client_release_ctx(mender_client_ctx_t *ctx);
+
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
 /**
  * @brief Release mender client
  * @return MENDER_OK if the function succeeds, error code otherwise
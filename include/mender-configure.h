@@ -43,11 +43,12 @@ typedef struct {
 
 /**
  * @brief Mender configure callbacks
+ * @note The configuration update callback is only invoked when items have been added, modified or removed since the previous configuration
  */
 typedef struct {
 #ifndef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
-    mender_err_t (*config_updated)(mender_keystore_t *); /**< Invoked when configuration is updated */
-#endif                                                   /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+    mender_err_t (*config_updated)(mender_keystore_t *, mender_keystore_t *); /**< Invoked with the items added or modified and the items removed */
+#endif                                                                         /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 } mender_configure_callbacks_t;
 
 /**
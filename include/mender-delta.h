@@ -0,0 +1,73 @@
+/**
+ * @file      mender-delta.h
+ * @brief     Mender delta update, streaming binary patch applied against the running image
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_DELTA_H__
+#define __MENDER_DELTA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/*
+ * Format of the patch, all integers are 32 bits little endian:
+ *   header:  "MDLT" magic, size of the target image
+ *   command: 0x01 COPY   source offset, length         copy bytes from the running image
+ *            0x02 ADD    source offset, length, <data> add <data> bytewise to bytes from the running image
+ *            0x03 INSERT length, <data>                insert <data> as is
+ * Commands follow each other until the size of the target image is reached.
+ */
+
+/**
+ * @brief Open a delta update
+ * @param name Name of the patch file
+ * @param flash_handle Flash handle, set when the flash is opened (after the header of the patch has been parsed)
+ * @param handle Handle of the delta update to be used with mender delta functions
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_delta_open(char *name, void **flash_handle, void **handle);
+
+/**
+ * @brief Apply data of the patch
+ * @param handle Handle from mender_delta_open
+ * @param data Data of the patch
+ * @param length Length of the data of the patch
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_delta_write(void *handle, void *data, size_t length);
+
+/**
+ * @brief Close a delta update, the target image is completed and the flash is closed
+ * @param handle Handle from mender_delta_open
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_delta_close(void *handle);
+
+/**
+ * @brief Abort a delta update, the flash handle is not released and must be aborted by the caller
+ * @param handle Handle from mender_delta_open
+ */
+void mender_delta_abort(void *handle);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_DELTA_H__ */
@@ -27,8 +27,8 @@ extern "C" {
 #include "mender-utils.h"
 
 /**
- * @brief Open flash device
- * @param name Name of the artifact
+ * @brief Open flash device, several flash devices may be opened by a deployment, one per payload file
+ * @param name Name of the payload file, used to select the flash target
  * @param size Size of the artifact
  * @param handle Handle of the deployment to be used with mender flash functions
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -45,6 +45,34 @@ mender_err_t mender_flash_open(char *name, size_t size, void **handle);
  */
 mender_err_t mender_flash_write(void *handle, void *data, size_t index, size_t length);
 
+/**
+ * @brief Write a run of erased bytes of the deployment data, used to skip programming the regions already erased
+ * @param handle Handle from mender_flash_open
+ * @param index Index of the run to be written
+ * @param length Length of the run to be written
+ * @return MENDER_OK if the run is already erased, MENDER_NOT_IMPLEMENTED if it must be written with mender_flash_write, error code otherwise
+ */
+mender_err_t mender_flash_write_erased(void *handle, size_t index, size_t length);
+
+/**
+ * @brief Read data of the running image, used as the source of delta updates
+ * @param data Buffer to store the data read
+ * @param index Index of the data to be read
+ * @param length Length of the data to be read
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_flash_read_running_image(void *data, size_t index, size_t length);
+
+/**
+ * @brief Read back deployment data, used to verify the image written
+ * @param handle Handle from mender_flash_open, the flash device may have been closed
+ * @param data Buffer to store the data read
+ * @param index Index of the data to be read
+ * @param length Length of the data to be read
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the data can not be read back, error code otherwise
+ */
+mender_err_t mender_flash_read(void *handle, void *data, size_t index, size_t length);
+
 /**
  * @brief Close flash device
  * @param handle Handle from mender_flash_open
@@ -78,6 +106,45 @@ mender_err_t mender_flash_confirm_image(void);
  */
 bool mender_flash_is_image_confirmed(void);
 
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+
+/**
+ * @brief Write performed on the simulated flash, after the aggregation of the data by the flash platform
+ */
+typedef struct {
+    size_t offset;  /**< Offset of the data in the update file */
+    size_t length;  /**< Length of the data */
+    bool   aligned; /**< Offset and length are multiple of the page size */
+} mender_flash_simulation_write_t;
+
+/**
+ * @brief Report of the simulated flash
+ */
+typedef struct {
+    uint64_t                               time;         /**< Time spent waiting for the simulated operations, including scheduling delays (microseconds) */
+    uint64_t                               erase_time;   /**< Simulated erase time (microseconds) */
+    uint64_t                               program_time; /**< Simulated program time (microseconds) */
+    size_t                                 erases;       /**< Number of pages erased */
+    size_t                                 unaligned;    /**< Number of writes which are not aligned on the page size */
+    size_t                                 count;        /**< Number of writes */
+    const mender_flash_simulation_write_t *writes;       /**< Writes, in the order they have been performed */
+} mender_flash_simulation_report_t;
+
+/**
+ * @brief Get the report of the simulated flash since it has been reset
+ * @note The writes remain valid until the report is reset
+ * @param report Report
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_flash_simulation_get_report(mender_flash_simulation_report_t *report);
+
+/**
+ * @brief Reset the report of the simulated flash
+ */
+void mender_flash_simulation_reset(void);
+
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -30,9 +30,19 @@ extern "C" {
  * @brief Mender HTTP configuration
  */
 typedef struct {
-    char *host; /**< URL of the mender server */
+    char  *host;            /**< URL of the mender server */
+    size_t recv_buf_length; /**< Length of the receive buffer (bytes), 0 to use the default of the platform */
 } mender_http_config_t;
 
+/**
+ * @brief HTTP request statistics
+ */
+typedef struct {
+    size_t   length;    /**< Length of the data received (bytes) */
+    size_t   fragments; /**< Number of fragments of data given to the callback */
+    uint32_t duration;  /**< Duration of the request (milliseconds) */
+} mender_http_stats_t;
+
 /**
  * @brief HTTP methods
  */
@@ -81,6 +91,101 @@ mender_err_t mender_http_perform(char                *jwt,
                                  void *params,
                                  int  *status);
 
+/**
+ * @brief Perform HTTP request starting at the given offset of the resource, used to resume a download
+ * @param jwt Token, NULL if not authenticated yet
+ * @param path Path of the request
+ * @param method Method
+ * @param payload Payload, NULL if empty
+ * @param signature Signature of the payload, NULL if it is not required
+ * @param offset Offset of the first byte requested, a "Range" header is added if it is not 0
+ * @param callback Callback invoked on HTTP events
+ * @param params Parameters passed to the callback, NULL if not used
+ * @param status Status code, 206 if the server returns the requested range only
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_perform_range(char                *jwt,
+                                       char                *path,
+                                       mender_http_method_t method,
+                                       char                *payload,
+                                       char                *signature,
+                                       size_t               offset,
+                                       mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                       void *params,
+                                       int  *status);
+
+/**
+ * @brief Perform a conditional HTTP request, the server answers 304 if the resource matches the entity tag
+ * @param jwt Token, NULL if not authenticated yet
+ * @param path Path of the request
+ * @param method Method
+ * @param payload Payload, NULL if empty
+ * @param signature Signature of the payload, NULL if it is not required
+ * @param if_none_match Entity tag sent in the "If-None-Match" header, NULL or empty if not used
+ * @param etag Buffer used to return the "ETag" header of the response, empty string if the server does not send it or if it is too long
+ * @param etag_size Size of the etag buffer
+ * @param callback Callback invoked on HTTP events
+ * @param params Parameters passed to the callback, NULL if not used
+ * @param status Status code, 304 if the resource has not been modified
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_perform_conditional(char                *jwt,
+                                             char                *path,
+                                             mender_http_method_t method,
+                                             char                *payload,
+                                             char                *signature,
+                                             char                *if_none_match,
+                                             char                *etag,
+                                             size_t               etag_size,
+                                             mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                             void *params,
+                                             int  *status);
+
+/**
+ * @brief Start an asynchronous HTTP request, it is performed by mender_http_async_poll so that a single thread drives several requests
+ * @param jwt Token, NULL if not authenticated yet
+ * @param path Path of the request
+ * @param method Method
+ * @param payload Payload, NULL if empty, copied by the function
+ * @param signature Signature of the payload, NULL if it is not required
+ * @param callback Callback invoked on HTTP events
+ * @param done Callback invoked when the request is completed with its result and status code, the handle is released when it returns
+ * @param params Parameters passed to the callbacks, NULL if not used
+ * @param handle Handle of the request, used to cancel it
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_async_start(char                *jwt,
+                                     char                *path,
+                                     mender_http_method_t method,
+                                     char                *payload,
+                                     char                *signature,
+                                     mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                     void (*done)(mender_err_t, int, void *),
+                                     void  *params,
+                                     void **handle);
+
+/**
+ * @brief Perform the asynchronous HTTP requests in progress, the callbacks are invoked from the caller context
+ * @param timeout Maximum time waiting for network activity (milliseconds)
+ * @param count Number of requests still in progress when the function returns, NULL if not used
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_async_poll(uint32_t timeout, size_t *count);
+
+/**
+ * @brief Cancel an asynchronous HTTP request, the done callback is not invoked, must not be called from the callbacks of the request
+ * @param handle Handle of the request
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_async_cancel(void *handle);
+
+/**
+ * @brief Retrieve the statistics of the last HTTP request of the calling thread, the mean fragment size is length / fragments
+ * @param stats Statistics of the last request
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_http_get_stats(mender_http_stats_t *stats);
+
 /**
  * @brief Release mender http
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -41,6 +41,15 @@ typedef struct {
     int32_t refresh_interval; /**< Inventory refresh interval, default is 28800 seconds, -1 permits to disable periodic execution */
 } mender_inventory_config_t;
 
+/**
+ * @brief Mender inventory provider, invoked when the inventory is published to retrieve the value of an item
+ * @param value Buffer receiving the value, null terminated
+ * @param size Size of the buffer (bytes)
+ * @param arg Argument given when the provider has been added
+ * @return MENDER_OK if the function succeeds, error code otherwise, the item is not published in this case
+ */
+typedef mender_err_t (*mender_inventory_provider_t)(char *value, size_t size, void *arg);
+
 /**
  * @brief Initialize mender inventory add-on
  * @param config Mender inventory configuration
@@ -69,6 +78,23 @@ mender_err_t mender_inventory_deactivate(void);
  */
 mender_err_t mender_inventory_set(mender_keystore_t *inventory);
 
+/**
+ * @brief Add a mender inventory provider, the value of the item is retrieved only when the inventory is published
+ * @note The provider takes precedence over an item of the same name set with mender_inventory_set, it is invoked from the inventory work
+ * @param name Name of the item, the string is not copied and must remain valid as long as the add-on is initialized
+ * @param provider Provider of the value of the item
+ * @param arg Argument of the provider
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_inventory_add_provider(const char *name, mender_inventory_provider_t provider, void *arg);
+
+/**
+ * @brief Remove a mender inventory provider
+ * @param name Name of the item
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if there is no provider for this item, error code otherwise
+ */
+mender_err_t mender_inventory_remove_provider(const char *name);
+
 /**
  * @brief Function used to trigger execution of the inventory work
  * @note Calling this function is optional when the periodic execution of the work is configured
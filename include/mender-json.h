@@ -0,0 +1,238 @@
+/**
+ * @file      mender-json.h
+ * @brief     Mender JSON tokenizers and writer, documents are parsed as bytes arrive or in place and written without intermediate tree
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_JSON_H__
+#define __MENDER_JSON_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Maximum length of a JSON token (key, string or literal) reported by the tokenizer (bytes)
+ */
+#ifndef CONFIG_MENDER_JSON_TOKEN_SIZE
+#define CONFIG_MENDER_JSON_TOKEN_SIZE (256)
+#endif /* CONFIG_MENDER_JSON_TOKEN_SIZE */
+
+/**
+ * @brief Maximum nesting depth of the JSON documents
+ */
+#define MENDER_JSON_MAX_DEPTH (32)
+
+/**
+ * @brief JSON events reported by the tokenizer
+ */
+typedef enum {
+    MENDER_JSON_EVENT_OBJECT_BEGIN = 0, /**< Beginning of an object */
+    MENDER_JSON_EVENT_OBJECT_END,       /**< End of an object */
+    MENDER_JSON_EVENT_ARRAY_BEGIN,      /**< Beginning of an array */
+    MENDER_JSON_EVENT_ARRAY_END,        /**< End of an array */
+    MENDER_JSON_EVENT_KEY,              /**< Key of an object member, the value follows */
+    MENDER_JSON_EVENT_STRING,           /**< String value */
+    MENDER_JSON_EVENT_NUMBER,           /**< Number value */
+    MENDER_JSON_EVENT_TRUE,             /**< True value */
+    MENDER_JSON_EVENT_FALSE,            /**< False value */
+    MENDER_JSON_EVENT_NULL              /**< Null value */
+} mender_json_event_t;
+
+/**
+ * @brief Types of the tokens of the in-place tokenizer
+ */
+typedef enum {
+    MENDER_JSON_TOKEN_OBJECT = 0, /**< Object, its members follow as key and value tokens */
+    MENDER_JSON_TOKEN_ARRAY,      /**< Array, its elements follow */
+    MENDER_JSON_TOKEN_STRING,     /**< Key or string value */
+    MENDER_JSON_TOKEN_PRIMITIVE   /**< Number, true, false or null */
+} mender_json_token_type_t;
+
+/**
+ * @brief Token of the in-place tokenizer, it references the document without copy
+ */
+typedef struct {
+    mender_json_token_type_t type;   /**< Type of the token */
+    uint32_t                 start;  /**< Offset of the token in the document, strings begin after the opening quote */
+    uint32_t                 length; /**< Length of the token, the quotes of the strings are excluded (bytes) */
+    uint32_t                 size;   /**< Number of members of an object or elements of an array, 0 otherwise */
+    uint32_t                 skip;   /**< Number of tokens of the value including itself, the next sibling follows them */
+} mender_json_token_t;
+
+/**
+ * @brief JSON tokenizer
+ */
+typedef struct {
+    uint8_t  state;                                    /**< State of the tokenizer */
+    uint8_t  next_state;                               /**< State of the tokenizer when the string or escape sequence currently parsed is completed */
+    size_t   depth;                                    /**< Current nesting depth */
+    uint32_t arrays;                                   /**< Bit set when the container at the corresponding depth is an array */
+    char     token[CONFIG_MENDER_JSON_TOKEN_SIZE + 1]; /**< Token currently parsed, null terminated */
+    size_t   token_length;                             /**< Length of the token currently parsed */
+    uint32_t unicode;                                  /**< Code point of the unicode escape sequence currently parsed */
+    uint32_t surrogate;                                /**< High surrogate waiting for the low surrogate of the unicode escape sequence, 0 otherwise */
+    size_t   digits;                                   /**< Number of hexadecimal digits of the unicode escape sequence already parsed */
+    mender_err_t (*callback)(void *, mender_json_event_t, size_t, char *); /**< Callback invoked for each event */
+    void *arg;                                                             /**< Argument of the callback */
+} mender_json_stream_t;
+
+/**
+ * @brief JSON writer
+ */
+typedef struct {
+    char    *data;      /**< Document, null terminated, NULL if nothing has been written and no buffer has been provided */
+    size_t   length;    /**< Length of the document (bytes) */
+    size_t   capacity;  /**< Capacity of the buffer, including the null terminator (bytes) */
+    size_t   limit;     /**< Maximum capacity of the buffer allocated from the heap, 0 if not limited (bytes) */
+    bool     allocated; /**< Buffer has been allocated from the heap and must be released */
+    bool     failed;    /**< Writing failed, the document is not valid */
+    size_t   depth;     /**< Current nesting depth */
+    uint32_t members;   /**< Bit set when the container at the corresponding depth already has members */
+} mender_json_writer_t;
+
+/**
+ * @brief Function used to initialize a JSON tokenizer
+ * @param stream JSON tokenizer
+ * @param callback Callback invoked for each event with the argument, the event, the depth of the event and the token (NULL for containers)
+ * @param arg Argument of the callback
+ */
+void mender_json_stream_init(mender_json_stream_t *stream, mender_err_t (*callback)(void *, mender_json_event_t, size_t, char *), void *arg);
+
+/**
+ * @brief Function used to parse data of a JSON document, the document may be split anywhere
+ * @param stream JSON tokenizer
+ * @param data Data of the JSON document
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_json_stream_parse(mender_json_stream_t *stream, const char *data, size_t length);
+
+/**
+ * @brief Function used to terminate parsing of a JSON document
+ * @param stream JSON tokenizer
+ * @return MENDER_OK if a complete JSON document has been parsed, error code otherwise
+ */
+mender_err_t mender_json_stream_end(mender_json_stream_t *stream);
+
+/**
+ * @brief Function used to tokenize a complete JSON document in place, nothing is allocated and the tokens reference the document
+ * @param data JSON document
+ * @param length Length of the JSON document
+ * @param tokens Tokens, NULL to only count them
+ * @param capacity Number of tokens available
+ * @param count Number of tokens of the document
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_json_tokenize(const char *data, size_t length, mender_json_token_t *tokens, size_t capacity, size_t *count);
+
+/**
+ * @brief Function used to get the value of a member of an object token, keys are compared without decoding the escape sequences
+ * @param data JSON document
+ * @param object Object token
+ * @param key Key of the member
+ * @return Value token, NULL if it is not found or if the token is not an object
+ */
+mender_json_token_t *mender_json_token_get(const char *data, mender_json_token_t *object, const char *key);
+
+/**
+ * @brief Function used to get an element of an array token
+ * @param array Array token
+ * @param index Index of the element
+ * @return Element token, NULL if it is not found or if the token is not an array
+ */
+mender_json_token_t *mender_json_token_at(mender_json_token_t *array, size_t index);
+
+/**
+ * @brief Function used to get the value of a string token, the escape sequences are decoded and the string is terminated in the document
+ * @note The closing quote is overwritten, the tokens remain valid and the function can be called again on the same token
+ * @param data JSON document
+ * @param token String token
+ * @return String, NULL if the token is not a string or if an escape sequence is invalid
+ */
+char *mender_json_token_string(char *data, mender_json_token_t *token);
+
+/**
+ * @brief Function used to get the value of a number token
+ * @param data JSON document
+ * @param token Primitive token
+ * @param value Value of the number
+ * @return MENDER_OK if the function succeeds, error code if the token is not a number
+ */
+mender_err_t mender_json_token_number(const char *data, mender_json_token_t *token, double *value);
+
+/**
+ * @brief Function used to initialize a JSON writer
+ * @param writer JSON writer
+ * @param buffer Buffer provided by the caller, NULL to allocate it from the heap while the document is written
+ * @param size Size of the buffer provided by the caller, maximum size of the buffer allocated from the heap otherwise (0 if not limited)
+ */
+void mender_json_writer_init(mender_json_writer_t *writer, char *buffer, size_t size);
+
+/**
+ * @brief Function used to begin an object
+ * @param writer JSON writer
+ * @param key Key of the object in the parent object, NULL at the root of the document or in an array
+ */
+void mender_json_writer_begin_object(mender_json_writer_t *writer, const char *key);
+
+/**
+ * @brief Function used to end an object
+ * @param writer JSON writer
+ */
+void mender_json_writer_end_object(mender_json_writer_t *writer);
+
+/**
+ * @brief Function used to begin an array
+ * @param writer JSON writer
+ * @param key Key of the array in the parent object, NULL at the root of the document or in an array
+ */
+void mender_json_writer_begin_array(mender_json_writer_t *writer, const char *key);
+
+/**
+ * @brief Function used to end an array
+ * @param writer JSON writer
+ */
+void mender_json_writer_end_array(mender_json_writer_t *writer);
+
+/**
+ * @brief Function used to add a string, special characters are escaped
+ * @param writer JSON writer
+ * @param key Key of the string in the parent object, NULL at the root of the document or in an array
+ * @param value String
+ */
+void mender_json_writer_add_string(mender_json_writer_t *writer, const char *key, const char *value);
+
+/**
+ * @brief Function used to terminate writing of a JSON document, errors of the previous functions are reported here
+ * @param writer JSON writer
+ * @return MENDER_OK if a complete JSON document has been written, error code otherwise
+ */
+mender_err_t mender_json_writer_end(mender_json_writer_t *writer);
+
+/**
+ * @brief Function used to release a JSON writer
+ * @param writer JSON writer
+ */
+void mender_json_writer_release(mender_json_writer_t *writer);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_JSON_H__ */
@@ -0,0 +1,57 @@
+/**
+ * @file      mender-log-buffer.h
+ * @brief     Mender log buffer, the logs are kept in a ring buffer in RAM so that they can be uploaded to the Mender server afterward
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_LOG_BUFFER_H__
+#define __MENDER_LOG_BUFFER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Write a message to the log buffer, the oldest messages are dropped to make room for it
+ * @note The function never blocks, the message is dropped if the buffer is being accessed by another context
+ * @param level Log level
+ * @param message Message, not null terminated
+ * @param length Length of the message, truncated to 255 bytes
+ */
+void mender_log_buffer_write(uint8_t level, const char *message, size_t length);
+
+/**
+ * @brief Read the messages of the log buffer, from the oldest to the newest, the messages are not removed
+ * @param callback Callback invoked for each message with the log level, the uptime (seconds), the null terminated message and its length
+ * @param arg Argument of the callback
+ * @param end Position of the end of the messages read, used to remove them once they have been uploaded
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_log_buffer_read(mender_err_t (*callback)(uint8_t, uint32_t, const char *, size_t, void *), void *arg, uint32_t *end);
+
+/**
+ * @brief Remove the messages of the log buffer up to a position returned by mender_log_buffer_read, the messages written meanwhile are kept
+ * @param end Position of the end of the messages to remove
+ */
+void mender_log_buffer_consume(uint32_t end);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_LOG_BUFFER_H__ */
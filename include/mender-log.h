@@ -42,6 +42,14 @@ extern "C" {
 #define CONFIG_MENDER_LOG_LEVEL MENDER_LOG_LEVEL_INF
 #endif /* CONFIG_MENDER_LOG_LEVEL */
 
+/**
+ * @brief Log level of the module, a source file overrides the default log level by defining MENDER_LOG_MODULE_LEVEL before including the headers
+ * @note The Zephyr logging subsystem still drops the logs above CONFIG_MENDER_LOG_LEVEL
+ */
+#ifndef MENDER_LOG_MODULE_LEVEL
+#define MENDER_LOG_MODULE_LEVEL CONFIG_MENDER_LOG_LEVEL
+#endif /* MENDER_LOG_MODULE_LEVEL */
+
 /**
  * @brief Initialize mender log
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -60,38 +68,100 @@ mender_err_t mender_log_init(void);
  */
 mender_err_t mender_log_print(uint8_t level, const char *filename, const char *function, int line, char *format, ...);
 
+/**
+ * @brief Print log with the platform logging subsystem, the format and the arguments are passed as is so that the log is formatted only once
+ * @note The Zephyr logging subsystem formats the log in the logging thread in deferred mode, or on the host with dictionary based logging
+ * @param log Platform log macro
+ * @param format Log format, must be a string literal
+ * @param ... Arguments
+ * @return Error code
+ */
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+#if defined(__ZEPHYR__)
+#include <zephyr/logging/log.h>
+#define MENDER_LOG_DEFERRED_ERR LOG_ERR
+#define MENDER_LOG_DEFERRED_WRN LOG_WRN
+#define MENDER_LOG_DEFERRED_INF LOG_INF
+#define MENDER_LOG_DEFERRED_DBG LOG_DBG
+#define MENDER_LOG_DEFERRED(log, format, ...)                         \
+    ({                                                                \
+        LOG_MODULE_DECLARE(mender, CONFIG_MENDER_LOG_LEVEL);          \
+        log("%s (%d): " format, __FILE__, __LINE__, ##__VA_ARGS__); \
+        MENDER_OK;                                                    \
+    })
+#elif defined(ESP_PLATFORM)
+#include <esp_log.h>
+#define MENDER_LOG_DEFERRED_ERR ESP_LOGE
+#define MENDER_LOG_DEFERRED_WRN ESP_LOGW
+#define MENDER_LOG_DEFERRED_INF ESP_LOGI
+#define MENDER_LOG_DEFERRED_DBG ESP_LOGD
+#define MENDER_LOG_DEFERRED(log, format, ...)                                   \
+    ({                                                                          \
+        log("mender", "%s (%d): " format, __FILE__, __LINE__, ##__VA_ARGS__); \
+        MENDER_OK;                                                              \
+    })
+#else
+#error "Deferred logging is only supported with Zephyr and ESP-IDF"
+#endif /* __ZEPHYR__ */
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
+
+/**
+ * @brief Disabled log, the format and the arguments are type-checked but never evaluated and the call is eliminated at compile time
+ * @param ... Arguments
+ * @return Error code
+ */
+#define MENDER_LOG_DISABLED(...)                                                                     \
+    ({                                                                                               \
+        if (0) {                                                                                     \
+            mender_log_print(MENDER_LOG_LEVEL_OFF, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); \
+        }                                                                                            \
+        MENDER_OK;                                                                                   \
+    })
+
 /**
  * @brief Print error log
  * @param ... Arguments
  * @return Error code
  */
-#if CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_ERR
+#if MENDER_LOG_MODULE_LEVEL >= MENDER_LOG_LEVEL_ERR
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+#define mender_log_error(...) MENDER_LOG_DEFERRED(MENDER_LOG_DEFERRED_ERR, __VA_ARGS__)
+#else
 #define mender_log_error(...) ({ mender_log_print(MENDER_LOG_LEVEL_ERR, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); })
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
 #else
-#define mender_log_error(...)
-#endif /* CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_ERR */
+#define mender_log_error(...) MENDER_LOG_DISABLED(__VA_ARGS__)
+#endif /* MENDER_LOG_MODULE_LEVEL >= MENDER_LOG_LEVEL_ERR */
 
 /**
  * @brief Print warning log
  * @param ... Arguments
  * @return Error code
  */
-#if CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_WRN
+#if MENDER_LOG_MODULE_LEVEL >= MENDER_LOG_LEVEL_WRN
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+#define mender_log_warning(...) MENDER_LOG_DEFERRED(MENDER_LOG_DEFERRED_WRN, __VA_ARGS__)
+#else
 #define mender_log_warning(...) ({ mender_log_print(MENDER_LOG_LEVEL_WRN, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); })
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
 #else
-#define mender_log_warning(...)
-#endif /* CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_WRN */
+#define mender_log_warning(...) MENDER_LOG_DISABLED(__VA_ARGS__)
+#endif /* MENDER_LOG_MODULE_LEVEL >= MENDER_LOG_LEVEL_WRN */
 
 /**
  * @brief Print info log
  * @param ... Arguments
  * @return Error code
  */
-#if CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_INF
+#if MENDER_LOG_MODULE_LEVEL >= MENDER_LOG_LEVEL_INF
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+#define mender_log_info(...) MENDER_LOG_DEFERRED(MENDER_LOG_DEFERRED_INF, __VA_ARGS__)
+#else
 #define mender_log_info(...) ({ mender_log_print(MENDER_LOG_LEVEL_INF, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); })
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
 #else
-#define mender_log_info(...)
-#endif /* CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_INF */
+#define mender_log_info(...) MENDER_LOG_DISABLED(__VA_ARGS__)
+#endif /* MENDER_LOG_MODULE_LEVEL >= MENDER_LOG_LEVEL_INF */
 
 /**
  * @brief Print debug log
@@ -99,11 +169,54 @@ mender_err_t mender_log_print(uint8_t level, const char *filename, const char *f
  * @param ... Arguments
  * @return Error code
  */
-#if CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_DBG
+#if MENDER_LOG_MODULE_LEVEL >= MENDER_LOG_LEVEL_DBG
+#ifdef CONFIG_MENDER_LOG_DEFERRED
+#define mender_log_debug(...) MENDER_LOG_DEFERRED(MENDER_LOG_DEFERRED_DBG, __VA_ARGS__)
+#else
 #define mender_log_debug(...) ({ mender_log_print(MENDER_LOG_LEVEL_DBG, __FILE__, __FUNCTION__, __LINE__, __VA_ARGS__); })
+#endif /* CONFIG_MENDER_LOG_DEFERRED */
+#else
+#define mender_log_debug(...) MENDER_LOG_DISABLED(__VA_ARGS__)
+#endif /* MENDER_LOG_MODULE_LEVEL >= MENDER_LOG_LEVEL_DBG */
+
+/**
+ * @brief Trace points of the deployment pipeline, each trace point spans from its begin to its end
+ */
+typedef enum {
+    MENDER_LOG_TRACE_AUTHENTICATION = 0, /**< Authentication with the server */
+    MENDER_LOG_TRACE_SIGN,               /**< Signature of the authentication request */
+    MENDER_LOG_TRACE_CONNECT,            /**< Connection to the server, including the name resolution */
+    MENDER_LOG_TRACE_TLS_HANDSHAKE,      /**< Connection of the TLS socket, including the TLS handshake */
+    MENDER_LOG_TRACE_HTTP_REQUEST,       /**< HTTP request */
+    MENDER_LOG_TRACE_TAR_HEADER,         /**< Parsing of a TAR header of the artifact */
+    MENDER_LOG_TRACE_PAYLOAD_CALLBACK,   /**< Callback invoked with the payload data of the artifact */
+    MENDER_LOG_TRACE_FLASH_WRITE,        /**< Write of the update to the flash */
+    MENDER_LOG_TRACE_FLASH_CLOSE,        /**< Close of the update written to the flash */
+    MENDER_LOG_TRACE_FLASH_SET_PENDING,  /**< Set of the update as pending image */
+    MENDER_LOG_TRACE_COUNT               /**< Number of trace points, not a trace point */
+} mender_log_trace_t;
+
+/**
+ * @brief Record a trace event with the platform tracing subsystem
+ * @note Zephyr tracing subsystem, SEGGER SystemView with ESP-IDF app_trace or FreeRTOS, or a Chrome trace JSON file on posix
+ * @param trace Trace point
+ * @param begin true at the begin of the trace point, false at its end
+ */
+#ifdef CONFIG_MENDER_LOG_TRACE
+void mender_log_trace(mender_log_trace_t trace, bool begin);
+#endif /* CONFIG_MENDER_LOG_TRACE */
+
+/**
+ * @brief Begin and end of a trace point, they compile to nothing if the tracing is disabled
+ * @param trace Trace point
+ */
+#ifdef CONFIG_MENDER_LOG_TRACE
+#define mender_log_trace_begin(trace) mender_log_trace((trace), true)
+#define mender_log_trace_end(trace)   mender_log_trace((trace), false)
 #else
-#define mender_log_debug(...)
-#endif /* CONFIG_MENDER_LOG_LEVEL >= MENDER_LOG_LEVEL_DBG */
+#define mender_log_trace_begin(trace) ((void)0)
+#define mender_log_trace_end(trace)   ((void)0)
+#endif /* CONFIG_MENDER_LOG_TRACE */
 
 /**
  * @brief Release mender log
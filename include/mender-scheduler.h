@@ -26,15 +26,67 @@ extern "C" {
 
 #include "mender-utils.h"
 
+/**
+ * @brief Work priorities, works pending with a higher priority are executed first
+ */
+typedef enum {
+    MENDER_SCHEDULER_WORK_PRIORITY_LOW = 0, /**< Low priority, for works which can be delayed (inventory, configuration) */
+    MENDER_SCHEDULER_WORK_PRIORITY_NORMAL,  /**< Normal priority */
+    MENDER_SCHEDULER_WORK_PRIORITY_HIGH     /**< High priority, for works which must not be delayed (authentication, healthchecks) */
+} mender_scheduler_work_priority_t;
+
+/**
+ * @brief Number of work priorities
+ */
+#define MENDER_SCHEDULER_WORK_PRIORITIES (MENDER_SCHEDULER_WORK_PRIORITY_HIGH + 1)
+
+/**
+ * @brief Parameters of the work functions and of the batch callbacks
+ * @note With CONFIG_MENDER_CLIENT_CONTEXTS they take the argument of the work, the context of the device which queued it, otherwise they take none
+ */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+#define MENDER_SCHEDULER_WORK_ARG void *arg
+#else
+#define MENDER_SCHEDULER_WORK_ARG void
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
 /**
  * @brief Work parameters
  */
 typedef struct {
-    mender_err_t (*function)(void); /**< Work function */
-    int32_t period;                 /**< Work period (seconds), negative or null value permits to disable periodic execution */
-    char   *name;                   /**< Work name */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    mender_err_t (*function)(void *);          /**< Work function, invoked with the argument */
+    void                            *arg;      /**< Work function argument, the context of the device which queued the work */
+#else
+    mender_err_t (*function)(void);            /**< Work function */
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    int32_t                          period;   /**< Work period (seconds), negative or null value permits to disable periodic execution */
+    char                            *name;     /**< Work name */
+    mender_scheduler_work_priority_t priority; /**< Work priority */
 } mender_scheduler_work_params_t;
 
+/**
+ * @brief Work statistics
+ */
+typedef struct {
+    uint32_t executions;   /**< Number of executions of the work */
+    uint32_t overruns;     /**< Number of times the work was due while it was already pending or executing */
+    uint32_t latency_avg;  /**< Average delay between the submission of the work and the beginning of its execution (milliseconds) */
+    uint32_t latency_max;  /**< Maximum delay between the submission of the work and the beginning of its execution (milliseconds) */
+    uint32_t duration_min; /**< Minimum execution time of the work (milliseconds) */
+    uint32_t duration_avg; /**< Average execution time of the work (milliseconds) */
+    uint32_t duration_max; /**< Maximum execution time of the work (milliseconds) */
+} mender_scheduler_work_statistics_t;
+
+/**
+ * @brief Task parameters
+ */
+typedef struct {
+    void (*function)(void *); /**< Task function, the task ends when the function returns */
+    void *arg;                /**< Task function argument */
+    char *name;               /**< Task name */
+} mender_scheduler_task_params_t;
+
 /**
  * @brief Initialization of the scheduler
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -85,6 +137,31 @@ mender_err_t mender_scheduler_work_deactivate(void *handle);
  */
 mender_err_t mender_scheduler_work_delete(void *handle);
 
+/**
+ * @brief Function used to get the statistics of a work
+ * @param handle Work handle
+ * @param statistics Work statistics
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_work_get_statistics(void *handle, mender_scheduler_work_statistics_t *statistics);
+
+/**
+ * @brief Function used to get the minimum stack space which has remained unused by the work queue threads since they started
+ * @param space Stack space (bytes), minimum of the work queue threads
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the platform does not track stack usage, error code otherwise
+ */
+mender_err_t mender_scheduler_get_work_queue_stack_space(size_t *space);
+
+/**
+ * @brief Function used to set the callbacks invoked around a batch of works, several works pending at the same time and executed back-to-back
+ * @param begin Callback invoked before the works of the batch are executed, NULL if not used
+ * @param end Callback invoked after the works of the batch are executed if the begin callback succeeded, NULL if not used
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ * @note The expiration of the timers of the works may be advanced by CONFIG_MENDER_SCHEDULER_WORK_SLACK seconds to gather them in a batch
+ * @note With CONFIG_MENDER_CLIENT_CONTEXTS both callbacks are invoked with the argument of the work which begins the batch
+ */
+mender_err_t mender_scheduler_set_batch_callbacks(mender_err_t (*begin)(MENDER_SCHEDULER_WORK_ARG), mender_err_t (*end)(MENDER_SCHEDULER_WORK_ARG));
+
 /**
  * @brief Function used to create a mutex
  * @param handle Mutex handle if the function succeeds, NULL otherwise
@@ -114,6 +191,69 @@ mender_err_t mender_scheduler_mutex_give(void *handle);
  */
 mender_err_t mender_scheduler_mutex_delete(void *handle);
 
+/**
+ * @brief Function used to create and start a task, running concurrently with the work queue
+ * @param task_params Task parameters
+ * @param handle Task handle if the function succeeds, NULL otherwise
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle);
+
+/**
+ * @brief Function used to wait the end of a task and release it
+ * @param handle Task handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_task_join(void *handle);
+
+/**
+ * @brief Function used to create a queue
+ * @param length Maximum number of items in the queue
+ * @param item_size Size of the items (bytes), the items are copied to the queue
+ * @param handle Queue handle if the function succeeds, NULL otherwise
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_queue_create(size_t length, size_t item_size, void **handle);
+
+/**
+ * @brief Function used to send an item to a queue
+ * @param handle Queue handle
+ * @param item Item
+ * @param delay_ms Delay to wait room in the queue, -1 to block indefinitely (without a timeout)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms);
+
+/**
+ * @brief Function used to receive an item from a queue
+ * @param handle Queue handle
+ * @param item Item
+ * @param delay_ms Delay to wait an item in the queue, -1 to block indefinitely (without a timeout)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms);
+
+/**
+ * @brief Function used to delete a queue
+ * @param handle Queue handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_queue_delete(void *handle);
+
+/**
+ * @brief Function used to get the time elapsed since the system started, it is not affected by changes of the system time
+ * @param uptime Uptime (milliseconds)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_get_uptime(uint64_t *uptime);
+
+/**
+ * @brief Function used to suspend the calling thread
+ * @param delay_ms Delay (milliseconds)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_scheduler_delay(uint32_t delay_ms);
+
 /**
  * @brief Release mender scheduler
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -0,0 +1,95 @@
+/**
+ * @file      mender-storage-cache.h
+ * @brief     Mender storage cache, items are kept in RAM after the first read from the storage and handed out as const views
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_STORAGE_CACHE_H__
+#define __MENDER_STORAGE_CACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-storage.h"
+
+/**
+ * @brief Set authentication keys, the cached keys are invalidated
+ * @param private_key Private key to store
+ * @param private_key_length Private key length
+ * @param public_key Public key to store
+ * @param public_key_length Public key length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_set_authentication_keys(unsigned char *private_key,
+                                                          size_t         private_key_length,
+                                                          unsigned char *public_key,
+                                                          size_t         public_key_length);
+
+/**
+ * @brief Get authentication keys, the keys are read from the storage on the first call only
+ * @note The views remain valid until the keys are set or deleted, or the cache is released
+ * @param private_key Private key view, NULL if not found
+ * @param private_key_length Private key length, 0 if not found
+ * @param public_key Public key view, NULL if not found
+ * @param public_key_length Public key length, 0 if not found
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the keys are not found, error code otherwise
+ */
+mender_err_t mender_storage_cache_get_authentication_keys(const unsigned char **private_key,
+                                                          size_t               *private_key_length,
+                                                          const unsigned char **public_key,
+                                                          size_t               *public_key_length);
+
+/**
+ * @brief Delete authentication keys, the cached keys are invalidated
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_delete_authentication_keys(void);
+
+/**
+ * @brief Set deployment data, the cached deployment data is invalidated
+ * @param deployment_data Deployment data to store, binary record
+ * @param deployment_data_length Deployment data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_set_deployment_data(const void *deployment_data, size_t deployment_data_length);
+
+/**
+ * @brief Get deployment data, the deployment data is read from the storage on the first call only
+ * @note The view remains valid until the deployment data is set or deleted, or the cache is released
+ * @param deployment_data Deployment data view, NULL if not found
+ * @param deployment_data_length Deployment data length, 0 if not found
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the deployment data is not found, error code otherwise
+ */
+mender_err_t mender_storage_cache_get_deployment_data(const void **deployment_data, size_t *deployment_data_length);
+
+/**
+ * @brief Delete deployment data, the cached deployment data is invalidated
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_delete_deployment_data(void);
+
+/**
+ * @brief Release mender storage cache, all the views are invalidated
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_storage_cache_exit(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_STORAGE_CACHE_H__ */
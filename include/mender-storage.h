@@ -26,6 +26,14 @@ extern "C" {
 
 #include "mender-utils.h"
 
+/**
+ * @brief Storage statistics
+ */
+typedef struct {
+    uint32_t writes;  /**< Number of items written to the storage */
+    uint32_t skipped; /**< Number of writes skipped because the item stored is identical */
+} mender_storage_statistics_t;
+
 /**
  * @brief Initialize mender storage
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -34,6 +42,7 @@ mender_err_t mender_storage_init(void);
 
 /**
  * @brief Set authentication keys
+ * @note Keys may be provisioned at manufacturing between mender_storage_init and mender_storage_exit, key generation is then skipped on first boot
  * @param private_key Private key to store
  * @param private_key_length Private key length
  * @param public_key Public key to store
@@ -63,17 +72,19 @@ mender_err_t mender_storage_delete_authentication_keys(void);
 
 /**
  * @brief Set deployment data
- * @param deployment_data Deployment data to store
+ * @param deployment_data Deployment data to store, binary record
+ * @param deployment_data_length Deployment data length
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_storage_set_deployment_data(char *deployment_data);
+mender_err_t mender_storage_set_deployment_data(const void *deployment_data, size_t deployment_data_length);
 
 /**
  * @brief Get deployment data
  * @param deployment_data Deployment data from storage, NULL if not found
+ * @param deployment_data_length Deployment data length from storage, 0 if not found
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_storage_get_deployment_data(char **deployment_data);
+mender_err_t mender_storage_get_deployment_data(void **deployment_data, size_t *deployment_data_length);
 
 /**
  * @brief Delete deployment data
@@ -111,15 +122,17 @@ mender_err_t mender_storage_delete_device_config(void);
 #ifdef CONFIG_MENDER_PROVIDES_DEPENDS
 /**
  * @brief Set provides
+ * @param provides Provides
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_storage_set_provides(mender_key_value_list_t *provides);
+mender_err_t mender_storage_set_provides(mender_utils_kv_table_t *provides);
 
 /**
  * @brief Get provides
+ * @param provides Provides, the stored items are set to the table
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
-mender_err_t mender_storage_get_provides(mender_key_value_list_t **provides);
+mender_err_t mender_storage_get_provides(mender_utils_kv_table_t *provides);
 
 /**
  * @brief Delete provides
@@ -130,6 +143,26 @@ mender_err_t mender_storage_delete_provides(void);
 #endif /* CONFIG_MENDER_PROVIDES_DEPENDS */
 #endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
 
+/**
+ * @brief Get storage statistics
+ * @param statistics Storage statistics since the initialization of the storage
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the storage does not count writes, error code otherwise
+ */
+mender_err_t mender_storage_get_statistics(mender_storage_statistics_t *statistics);
+
+/**
+ * @brief Begin a transaction, the items set or deleted until the transaction is committed are written to the storage at once
+ * @note Transactions may be nested, the items are written when the outermost transaction is committed
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the storage writes the items immediately, error code otherwise
+ */
+mender_err_t mender_storage_begin(void);
+
+/**
+ * @brief Commit a transaction begun with mender_storage_begin
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if the storage writes the items immediately, error code otherwise
+ */
+mender_err_t mender_storage_commit(void);
+
 /**
  * @brief Release mender storage
  * @return MENDER_OK if the function succeeds, error code otherwise
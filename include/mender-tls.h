@@ -27,6 +27,16 @@ extern "C" {
 
 #include "mender-utils.h"
 
+/**
+ * @brief SHA-256 digest length (bytes)
+ */
+#define MENDER_TLS_SHA256_DIGEST_LENGTH (32)
+
+/**
+ * @brief Context of the authentication keys of a device
+ */
+typedef struct mender_tls_ctx_s mender_tls_ctx_t;
+
 /**
  * @brief Initialize mender TLS
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -58,6 +68,64 @@ mender_err_t mender_tls_get_public_key_pem(char **public_key);
  */
 mender_err_t mender_tls_sign_payload(char *payload, char **signature, size_t *signature_length);
 
+/**
+ * @brief Verify the signature of a SHA-256 digest
+ * @param public_key Public key (PEM format)
+ * @param digest Digest of MENDER_TLS_SHA256_DIGEST_LENGTH bytes
+ * @param signature Signature encoded in base64, RSA PKCS#1 v1.5 or ECDSA P-256 with r and s concatenated as written by mender-artifact
+ * @param signature_length Length of the signature
+ * @return MENDER_OK if the signature is valid, error code otherwise
+ */
+mender_err_t mender_tls_verify_signature(const char *public_key, const uint8_t *digest, const char *signature, size_t signature_length);
+
+/**
+ * @brief Begin computation of a SHA-256 digest
+ * @param handle Digest handle, to be used by mender_tls_sha256_update and mender_tls_sha256_end
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_tls_sha256_begin(void **handle);
+
+/**
+ * @brief Update a SHA-256 digest with new data
+ * @param handle Digest handle
+ * @param data Data
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_tls_sha256_update(void *handle, const void *data, size_t length);
+
+/**
+ * @brief End computation of a SHA-256 digest and release the handle
+ * @param handle Digest handle
+ * @param digest Digest of MENDER_TLS_SHA256_DIGEST_LENGTH bytes, NULL to release the handle only
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_tls_sha256_end(void *handle, uint8_t *digest);
+
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+/**
+ * @brief Create the context of the authentication keys of an additional device, the keys are initialized with mender_tls_init_authentication_keys
+ * @note The keys of the additional devices are generated or provided by the user each time they are initialized, they are not recorded in the storage
+ * @return Context if the function succeeds, NULL otherwise
+ */
+mender_tls_ctx_t *mender_tls_create_ctx(void);
+
+/**
+ * @brief Select the context of the authentication keys used by the calling thread, the other threads are not affected
+ * @param ctx Context, NULL to select the context of the keys recorded in the storage
+ * @return Context previously selected by the calling thread, NULL if it was the context of the keys recorded in the storage
+ */
+mender_tls_ctx_t *mender_tls_select_ctx(mender_tls_ctx_t *ctx);
+
+/**
+ * @brief Release the context of the authentication keys of an additional device, it must not be selected by the calling thread
+ * @param ctx Context
+ */
+void mender_tls_release_ctx(mender_tls_ctx_t *ctx);
+
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
 /**
  * @brief Release mender TLS
  * @return MENDER_OK if the function succeeds, error code otherwise
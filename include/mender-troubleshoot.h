@@ -38,17 +38,26 @@ extern const mender_addon_instance_t mender_troubleshoot_addon_instance;
  * @brief Mender troubleshoot configuration
  */
 typedef struct {
-    int32_t healthcheck_interval; /**< Troubleshoot healthcheck interval, default is 30 seconds, -1 permits to disable periodic execution */
+    int32_t healthcheck_interval;     /**< Troubleshoot healthcheck interval, default is 30 seconds, -1 permits to disable periodic execution */
+    int32_t healthcheck_max_interval; /**< Troubleshoot healthcheck maximum interval when the session is idle, default is 240 seconds */
 } mender_troubleshoot_config_t;
 
 /**
  * @brief Mender troubleshoot callbacks
  */
 typedef struct {
-    mender_err_t (*shell_begin)(uint16_t, uint16_t);  /**< Invoked when shell is connected */
-    mender_err_t (*shell_resize)(uint16_t, uint16_t); /**< Invoked when shell is resized */
-    mender_err_t (*shell_write)(uint8_t *, size_t);   /**< Invoked when shell data is received */
-    mender_err_t (*shell_end)(void);                  /**< Invoked when shell is disconnected */
+    mender_err_t (*shell_begin)(uint16_t, uint16_t);                       /**< Invoked when shell is connected */
+    mender_err_t (*shell_resize)(uint16_t, uint16_t);                      /**< Invoked when shell is resized */
+    mender_err_t (*shell_write)(uint8_t *, size_t);                        /**< Invoked when shell data is received */
+    mender_err_t (*shell_end)(void);                                       /**< Invoked when shell is disconnected */
+    mender_err_t (*file_stat)(char *, size_t *);                           /**< Invoked to get the size of a file */
+    mender_err_t (*file_open)(char *, bool, void **);                      /**< Invoked to open a file, for writing if the flag is set, for reading otherwise */
+    mender_err_t (*file_read)(void *, uint8_t *, size_t, size_t *);        /**< Invoked to read data from a file, no data is read at the end of the file */
+    mender_err_t (*file_write)(void *, uint8_t *, size_t);                 /**< Invoked to write data to a file */
+    mender_err_t (*file_close)(void *);                                    /**< Invoked to close a file */
+    mender_err_t (*port_forward_connect)(char *, uint16_t, bool, void **); /**< Invoked to connect to a local service, using UDP if the flag is set */
+    mender_err_t (*port_forward_write)(void *, uint8_t *, size_t);         /**< Invoked when port forward data is received */
+    mender_err_t (*port_forward_close)(void *);                            /**< Invoked to disconnect from a local service */
 } mender_troubleshoot_callbacks_t;
 
 /**
@@ -77,10 +86,28 @@ mender_err_t mender_troubleshoot_deactivate(void);
  * @brief Send shell data to the server
  * @param data Data to send to the server for printing in the console
  * @param length Length of data to send to the server
- * @return MENDER_OK if the function succeeds, error code otherwise
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue is full and the data should be sent again later, error code otherwise
  */
 mender_err_t mender_troubleshoot_shell_print(uint8_t *data, size_t length);
 
+/**
+ * @brief Send port forward data to the server
+ * @note The data is sent entirely or not at all, it should be sent again later if the send queue is full
+ * @param handle Local connection handle returned by the port forward connect callback
+ * @param data Data received from the local service
+ * @param length Length of data received from the local service
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue is full and none of the data is sent, error code otherwise
+ */
+mender_err_t mender_troubleshoot_port_forward_send(void *handle, uint8_t *data, size_t length);
+
+/**
+ * @brief Stop port forward session when the local service disconnects
+ * @note The port forward close callback is not invoked, the local connection handle is released by the caller
+ * @param handle Local connection handle returned by the port forward connect callback
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_troubleshoot_port_forward_stop(void *handle);
+
 /**
  * @brief Release mender troubleshoot add-on
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -32,7 +32,9 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
+#ifndef CONFIG_MENDER_TINY
 #include <cJSON.h>
+#endif /* CONFIG_MENDER_TINY */
 
 /**
  * @brief Mender error codes
@@ -43,6 +45,7 @@ typedef enum {
     MENDER_FAIL            = -1, /**< Failure */
     MENDER_NOT_FOUND       = -2, /**< Not found */
     MENDER_NOT_IMPLEMENTED = -3, /**< Not implemented */
+    MENDER_BUSY            = -4, /**< Busy, the operation may be retried later */
 } mender_err_t;
 
 /**
@@ -54,7 +57,8 @@ typedef enum {
     MENDER_DEPLOYMENT_STATUS_REBOOTING,        /**< Status is "rebooting" */
     MENDER_DEPLOYMENT_STATUS_SUCCESS,          /**< Status is "success" */
     MENDER_DEPLOYMENT_STATUS_FAILURE,          /**< Status is "failure" */
-    MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED /**< Status is "already installed" */
+    MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED,      /**< Status is "already installed" */
+    MENDER_DEPLOYMENT_STATUS_PAUSE_BEFORE_INSTALLING /**< Status is "pause before installing", the artifact is downloaded and waits to be committed */
 } mender_deployment_status_t;
 
 /**
@@ -66,7 +70,9 @@ typedef struct {
 } mender_item_t;
 
 /**
- * @brief Key-store
+ * @brief Key-store, array of items terminated by an item without name
+ * @note The key-stores created by mender_utils_keystore_copy and mender_utils_keystore_from_json are packed: the items and the strings are allocated in
+ *       one block shared by the copies, the empty items reference the block and must not be modified directly
  */
 typedef mender_item_t mender_keystore_t;
 
@@ -75,6 +81,26 @@ typedef mender_item_t mender_keystore_t;
  */
 typedef mender_item_t mender_identity_t;
 
+#ifdef CONFIG_MENDER_TINY
+
+/**
+ * @brief Meta-data of a payload, the JSON document is kept as received and it is parsed in place with mender_json_tokenize
+ * @note mender_json_token_string decodes the strings in the document, the tokens must be kept to read the meta-data several times
+ */
+typedef struct {
+    char  *data;   /**< JSON document, null terminated */
+    size_t length; /**< Length of the JSON document (bytes) */
+} mender_meta_data_t;
+
+#else
+
+/**
+ * @brief Meta-data of a payload, JSON object
+ */
+typedef cJSON mender_meta_data_t;
+
+#endif /* CONFIG_MENDER_TINY */
+
 /**
  * @brief Linked-list
  */
@@ -83,6 +109,96 @@ typedef struct mender_key_value_list_t {
     char                           *value;
     struct mender_key_value_list_t *next;
 } mender_key_value_list_t;
+
+/**
+ * @brief Arena block
+ */
+typedef struct mender_utils_arena_block_t {
+    struct mender_utils_arena_block_t *next; /**< Next block of the arena */
+    size_t                             size; /**< Size of the data of the block (bytes) */
+    size_t                             used; /**< Length of the data already allocated in the block (bytes) */
+} mender_utils_arena_block_t;
+
+/**
+ * @brief Arena, memory is allocated in blocks and released all at once, a zeroed arena is empty and ready to be used
+ */
+typedef struct {
+    mender_utils_arena_block_t *blocks; /**< Blocks of the arena, the first one is the block currently used */
+} mender_utils_arena_t;
+
+/**
+ * @brief Key-value table, the items are sorted by name to be searched by bisection and the names are unique, a zeroed table is empty and ready to be used
+ */
+typedef struct {
+    mender_item_t       *items;    /**< Items sorted by name */
+    size_t               size;     /**< Number of items */
+    size_t               capacity; /**< Number of items allocated */
+    mender_utils_arena_t strings;  /**< Arena holding the names and the values, released with the table */
+} mender_utils_kv_table_t;
+
+/**
+ * @brief Backoff policy of a work retried after failures, the period grows exponentially with full jitter and is restored on success
+ */
+typedef struct {
+    uint32_t base;     /**< Period of the work when it succeeds (seconds), 0 if the work is not periodic */
+    uint32_t attempts; /**< Number of consecutive failures */
+} mender_utils_backoff_t;
+
+/**
+ * @brief Record persisted in the storage, fields are length-prefixed strings, the record is versioned and protected by a CRC
+ */
+typedef struct {
+    unsigned char *data;     /**< Record, NULL if nothing has been added */
+    size_t         length;   /**< Length of the record (bytes) */
+    size_t         capacity; /**< Capacity of the buffer (bytes) */
+    size_t         count;    /**< Number of fields of the record */
+    bool           failed;   /**< Adding a field failed, the record is not valid */
+} mender_utils_record_t;
+
+/**
+ * @brief Allocator used by the client and the libraries it configures, the functions have the semantic of the standard library ones
+ */
+typedef struct {
+    void *(*malloc_fn)(size_t size);             /**< Allocate memory */
+    void *(*realloc_fn)(void *ptr, size_t size); /**< Resize memory */
+    void (*free_fn)(void *ptr);                  /**< Release memory */
+} mender_utils_allocator_t;
+
+/**
+ * @brief Modules to which the allocations are accounted, a source file selects its module with MENDER_UTILS_HEAP_MODULE before including the headers
+ */
+typedef enum {
+    MENDER_UTILS_HEAP_MODULE_OTHER = 0,    /**< Modules not listed below */
+    MENDER_UTILS_HEAP_MODULE_API,          /**< API */
+    MENDER_UTILS_HEAP_MODULE_ARTIFACT,     /**< Artifact parser */
+    MENDER_UTILS_HEAP_MODULE_CLIENT,       /**< Client */
+    MENDER_UTILS_HEAP_MODULE_TROUBLESHOOT, /**< Troubleshoot add-on */
+    MENDER_UTILS_HEAP_MODULE_TLS,          /**< TLS */
+    MENDER_UTILS_HEAP_MODULE_HTTP,         /**< HTTP and websocket */
+    MENDER_UTILS_HEAP_MODULE_JSON,         /**< cJSON and JSON writer */
+    MENDER_UTILS_HEAP_MODULE_ARENA,        /**< Blocks of the arenas */
+    MENDER_UTILS_HEAP_MODULE_ALL           /**< All the modules, only used to retrieve the statistics */
+} mender_utils_heap_module_t;
+
+/**
+ * @brief Heap statistics of a module
+ */
+typedef struct {
+    size_t current; /**< Memory currently allocated (bytes) */
+    size_t peak;    /**< Peak of the memory allocated (bytes) */
+    size_t count;   /**< Number of blocks currently allocated */
+} mender_utils_heap_stats_t;
+
+/**
+ * @brief Memory budget, the allocations of each module are served from a pool carved in a fixed memory block instead of the allocator
+ */
+typedef struct {
+    void  *memory;                              /**< Memory block carved into the pools, its size is the sum of the sizes of the pools */
+    size_t sizes[MENDER_UTILS_HEAP_MODULE_ALL]; /**< Size of the pool of each module (bytes), 0 to share the pool of MENDER_UTILS_HEAP_MODULE_OTHER */
+    mender_err_t (*lock)(void);                 /**< Take the lock protecting the pools */
+    mender_err_t (*unlock)(void);               /**< Release the lock protecting the pools */
+} mender_utils_heap_budget_t;
+
 /**
  * @brief Function used to print HTTP status as string
  * @param status HTTP status code
@@ -129,15 +245,17 @@ bool mender_utils_strendwith(const char *s1, const char *s2);
 mender_keystore_t *mender_utils_keystore_new(size_t length);
 
 /**
- * @brief Function used to copy key-store
+ * @brief Function used to copy key-store, a packed key-store is created, or the block of the source key-store is shared if it is already packed
  * @param dst_keystore Destination key-store to create
  * @param src_keystore Source key-store to copy
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_utils_keystore_copy(mender_keystore_t **dst_keystore, mender_keystore_t *src_keystore);
 
+#ifndef CONFIG_MENDER_TINY
+
 /**
- * @brief Function used to set key-store from JSON string
+ * @brief Function used to set key-store from JSON string, a packed key-store is created
  * @param keystore Key-store
  * @param object JSON object
  * @return MENDER_OK if the function succeeds, error code otherwise
@@ -160,12 +278,14 @@ mender_err_t mender_utils_keystore_to_json(mender_keystore_t *keystore, cJSON **
  */
 mender_err_t mender_utils_identity_to_json(mender_identity_t *identity, cJSON **object);
 
+#endif /* CONFIG_MENDER_TINY */
+
 /**
  * @brief Function used to set key-store item name and value
  * @param keystore Key-store to be updated
  * @param index Index of the item in the key-store
- * @param name Name of the item
- * @param value Value of the item
+ * @param name Name of the item, NULL to empty the item
+ * @param value Value of the item, it must be NULL if the name is NULL
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
 mender_err_t mender_utils_keystore_set_item(mender_keystore_t *keystore, size_t index, char *name, char *value);
@@ -178,7 +298,7 @@ mender_err_t mender_utils_keystore_set_item(mender_keystore_t *keystore, size_t
 size_t mender_utils_keystore_length(mender_keystore_t *keystore);
 
 /**
- * @brief Function used to delete key-store
+ * @brief Function used to delete key-store, the block of a packed key-store is released with the last key-store sharing it
  * @param keystore Key-store to be deleted
  * @return MENDER_OK if the function succeeds, error code otherwise
  */
@@ -210,6 +330,394 @@ mender_err_t mender_utils_key_value_list_to_string(mender_key_value_list_t *list
  */
 mender_err_t mender_utils_string_to_key_value_list(const char *key_value_str, mender_key_value_list_t **list);
 
+/**
+ * @brief Write linked list to a caller-provided buffer, in the format of mender_utils_key_value_list_to_string
+ * @param list Linked list
+ * @param buffer Buffer, NULL to compute the length of the string only
+ * @param size Size of the buffer, the string is truncated if it does not fit and always null terminated
+ * @return Length of the string, excluding the null terminator, whatever the size of the buffer
+ */
+size_t mender_utils_key_value_list_to_buffer(mender_key_value_list_t *list, char *buffer, size_t size);
+
+/**
+ * @brief Convert string to linked list in place, the separators of the string are replaced by null terminators
+ * @note The nodes are allocated in a single block released with mender_utils_free, the keys and values reference the string which must outlive the list
+ * @param key_value_str String to parse, modified by the function
+ * @param list Linked list, NULL if the string is empty
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_string_to_key_value_list_in_place(char *key_value_str, mender_key_value_list_t **list);
+
+/**
+ * @brief Function used to match a string against a glob pattern, '*' matches any sequence of characters and '?' matches any character
+ * @param pattern Pattern
+ * @param str String
+ * @return true if the string matches the pattern, false otherwise
+ */
+bool mender_utils_glob_match(const char *pattern, const char *str);
+
+/**
+ * @brief Function used to get the value of an item of a key-value table
+ * @param table Key-value table
+ * @param name Name of the item
+ * @return Value of the item, NULL if it is not found
+ */
+const char *mender_utils_kv_table_get(mender_utils_kv_table_t *table, const char *name);
+
+/**
+ * @brief Function used to set an item of a key-value table, the value replaces the previous one if the item already exists
+ * @param table Key-value table
+ * @param name Name of the item
+ * @param value Value of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_kv_table_set(mender_utils_kv_table_t *table, const char *name, const char *value);
+
+/**
+ * @brief Function used to set the items of a linked list to a key-value table
+ * @param table Key-value table
+ * @param list Linked list
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_kv_table_set_list(mender_utils_kv_table_t *table, mender_key_value_list_t *list);
+
+/**
+ * @brief Function used to remove the items of a key-value table whose name matches a glob pattern
+ * @param table Key-value table
+ * @param pattern Pattern, see mender_utils_glob_match
+ * @return Number of items removed
+ */
+size_t mender_utils_kv_table_clear(mender_utils_kv_table_t *table, const char *pattern);
+
+/**
+ * @brief Function used to release a key-value table, the table is empty and can be used again
+ * @param table Key-value table
+ */
+void mender_utils_kv_table_release(mender_utils_kv_table_t *table);
+
+/**
+ * @brief Function used to allocate memory from an arena
+ * @param arena Arena
+ * @param size Size of the memory to allocate (bytes)
+ * @return Zeroed memory if the function succeeds, NULL otherwise
+ */
+void *mender_utils_arena_alloc(mender_utils_arena_t *arena, size_t size);
+
+/**
+ * @brief Function used to duplicate a string in an arena
+ * @param arena Arena
+ * @param s String to duplicate
+ * @return Duplicated string if the function succeeds, NULL otherwise
+ */
+char *mender_utils_arena_strdup(mender_utils_arena_t *arena, const char *s);
+
+/**
+ * @brief Function used to release all the memory allocated from an arena, the arena is empty and can be used again
+ * @param arena Arena
+ */
+void mender_utils_arena_release(mender_utils_arena_t *arena);
+
+/**
+ * @brief Function used to seed the pseudo-random generator of the backoff jitter, the seed must be different on each device
+ * @param seed Seed
+ */
+void mender_utils_backoff_seed(uint32_t seed);
+
+/**
+ * @brief Function used to initialize a backoff policy
+ * @param backoff Backoff policy
+ * @param base Period of the work when it succeeds (seconds), 0 if the work is not periodic
+ */
+void mender_utils_backoff_init(mender_utils_backoff_t *backoff, uint32_t base);
+
+/**
+ * @brief Function used to compute the period of a work following a failure
+ * @param backoff Backoff policy
+ * @return Period picked randomly between 1 second and the base period multiplied by 2 for each consecutive failure, capped, 0 if the work is not periodic
+ */
+uint32_t mender_utils_backoff_failure(mender_utils_backoff_t *backoff);
+
+/**
+ * @brief Function used to reset a backoff policy following a success
+ * @param backoff Backoff policy
+ * @return true if the period of the work must be restored to the base period, false if it has not been modified
+ */
+bool mender_utils_backoff_success(mender_utils_backoff_t *backoff);
+
+/**
+ * @brief Function used to compute the CRC-32 (IEEE 802.3) of data
+ * @param crc CRC-32 of the previous data, 0 for the first data
+ * @param data Data
+ * @param length Length of the data
+ * @return CRC-32 of the data
+ */
+uint32_t mender_utils_crc32(uint32_t crc, const void *data, size_t length);
+
+#ifdef CONFIG_MENDER_HTTP_GZIP
+
+/**
+ * @brief Function used to compress data in the gzip format, used to reduce the size of the payload of the requests
+ * @param data Data
+ * @param length Length of the data
+ * @param output Compressed data, to be released with mender_utils_free
+ * @param output_length Length of the compressed data
+ * @return MENDER_OK if the function succeeds, MENDER_FAIL if an error occurred or if the compressed data is not smaller than the data
+ */
+mender_err_t mender_utils_gzip_compress(const void *data, size_t length, void **output, size_t *output_length);
+
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+/**
+ * @brief Function used to initialize a record
+ * @param record Record
+ */
+void mender_utils_record_init(mender_utils_record_t *record);
+
+/**
+ * @brief Function used to add a field to a record
+ * @param record Record
+ * @param field Field, null terminated, the record is not valid if it is NULL
+ */
+void mender_utils_record_add(mender_utils_record_t *record, const char *field);
+
+/**
+ * @brief Function used to terminate a record, the header and the CRC are written, errors of the previous functions are reported here
+ * @param record Record
+ * @return MENDER_OK if the record is valid, error code otherwise
+ */
+mender_err_t mender_utils_record_end(mender_utils_record_t *record);
+
+/**
+ * @brief Function used to release a record
+ * @param record Record
+ */
+void mender_utils_record_release(mender_utils_record_t *record);
+
+/**
+ * @brief Function used to check a record read from the storage, version, CRC and fields are verified
+ * @param data Record
+ * @param length Length of the record
+ * @param count Number of fields of the record
+ * @return MENDER_OK if the record is valid, error code otherwise
+ */
+mender_err_t mender_utils_record_check(const void *data, size_t length, size_t *count);
+
+/**
+ * @brief Function used to get the next field of a record previously checked
+ * @param data Record
+ * @param offset Offset of the field in the record, 0 for the first field, updated to the offset of the next field
+ * @return View on the field, null terminated, valid as long as the record
+ */
+const char *mender_utils_record_next(const void *data, size_t *offset);
+
+/**
+ * @brief Function used to format linked list to record
+ * @param list Linked list
+ * @param record Record, keys and values are added as consecutive fields
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_key_value_list_to_record(mender_key_value_list_t *list, mender_utils_record_t *record);
+
+/**
+ * @brief Function used to convert record to linked list
+ * @param data Record
+ * @param length Length of the record
+ * @param list Linked list
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_record_to_key_value_list(const void *data, size_t length, mender_key_value_list_t **list);
+
+/**
+ * @brief Function used to format key-value table to record
+ * @param table Key-value table
+ * @param record Record, names and values are added as consecutive fields in the order of the table
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_kv_table_to_record(mender_utils_kv_table_t *table, mender_utils_record_t *record);
+
+/**
+ * @brief Function used to set the items of a record to a key-value table
+ * @param data Record
+ * @param length Length of the record
+ * @param table Key-value table
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_record_to_kv_table(const void *data, size_t length, mender_utils_kv_table_t *table);
+
+/**
+ * @brief Function used to set the allocator, it is also installed in cJSON, it must be set before any allocation and not modified meanwhile
+ * @param allocator Allocator, NULL to restore the standard library one
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_set_allocator(mender_utils_allocator_t *allocator);
+
+/**
+ * @brief Function used to allocate memory
+ * @param size Size of the memory (bytes)
+ * @return Pointer to the memory, NULL if an error occurred
+ */
+void *mender_utils_malloc(size_t size);
+
+/**
+ * @brief Function used to allocate memory initialized to zero
+ * @param count Number of elements
+ * @param size Size of each element (bytes)
+ * @return Pointer to the memory, NULL if an error occurred
+ */
+void *mender_utils_calloc(size_t count, size_t size);
+
+/**
+ * @brief Function used to resize memory, the content is preserved up to the lesser of the old and new sizes
+ * @param ptr Pointer to the memory, NULL to allocate new memory
+ * @param size New size of the memory (bytes)
+ * @return Pointer to the memory, NULL if an error occurred and the memory is not modified
+ */
+void *mender_utils_realloc(void *ptr, size_t size);
+
+/**
+ * @brief Function used to duplicate a string
+ * @param s String
+ * @return Duplicated string, NULL if an error occurred
+ */
+char *mender_utils_strdup(const char *s);
+
+/**
+ * @brief Function used to duplicate at most n characters of a string, the duplicated string is always terminated
+ * @param s String
+ * @param n Maximum number of characters
+ * @return Duplicated string, NULL if an error occurred
+ */
+char *mender_utils_strndup(const char *s, size_t n);
+
+/**
+ * @brief Function used to format a string in memory allocated to hold it
+ * @param str Formatted string, to be released with mender_utils_free
+ * @param format Format string
+ * @param args Arguments
+ * @return Length of the formatted string, negative value if an error occurred
+ */
+int mender_utils_vasprintf(char **str, const char *format, va_list args);
+
+/**
+ * @brief Function used to allocate memory accounted to a module
+ * @param module Module of the allocation
+ * @param size Size of the memory (bytes)
+ * @return Pointer to the memory, NULL if an error occurred
+ */
+void *mender_utils_heap_malloc(mender_utils_heap_module_t module, size_t size);
+
+/**
+ * @brief Function used to allocate memory initialized to zero accounted to a module
+ * @param module Module of the allocation
+ * @param count Number of elements
+ * @param size Size of each element (bytes)
+ * @return Pointer to the memory, NULL if an error occurred
+ */
+void *mender_utils_heap_calloc(mender_utils_heap_module_t module, size_t count, size_t size);
+
+/**
+ * @brief Function used to resize memory accounted to a module
+ * @param module Module of the allocation, the memory is accounted to it after the resize
+ * @param ptr Pointer to the memory, NULL to allocate new memory
+ * @param size New size of the memory (bytes)
+ * @return Pointer to the memory, NULL if an error occurred and the memory is not modified
+ */
+void *mender_utils_heap_realloc(mender_utils_heap_module_t module, void *ptr, size_t size);
+
+/**
+ * @brief Function used to duplicate a string accounted to a module
+ * @param module Module of the allocation
+ * @param s String
+ * @return Duplicated string, NULL if an error occurred
+ */
+char *mender_utils_heap_strdup(mender_utils_heap_module_t module, const char *s);
+
+/**
+ * @brief Function used to duplicate at most n characters of a string accounted to a module
+ * @param module Module of the allocation
+ * @param s String
+ * @param n Maximum number of characters
+ * @return Duplicated string, NULL if an error occurred
+ */
+char *mender_utils_heap_strndup(mender_utils_heap_module_t module, const char *s, size_t n);
+
+/**
+ * @brief Function used to format a string in memory accounted to a module
+ * @param module Module of the allocation
+ * @param str Formatted string, to be released with mender_utils_free
+ * @param format Format string
+ * @param args Arguments
+ * @return Length of the formatted string, negative value if an error occurred
+ */
+int mender_utils_heap_vasprintf(mender_utils_heap_module_t module, char **str, const char *format, va_list args);
+
+/**
+ * @brief Function used to release memory
+ * @param ptr Pointer to the memory, nothing is done if it is NULL
+ */
+void mender_utils_free(void *ptr);
+
+/**
+ * @brief Function used to print heap module as string
+ * @param module Module
+ * @return Module as string, NULL if it is not found
+ */
+char *mender_utils_heap_module_to_string(mender_utils_heap_module_t module);
+
+#ifdef CONFIG_MENDER_CLIENT_MEMORY_BUDGET
+
+/**
+ * @brief Function used to set the memory budget, the pools must be empty when it is removed
+ * @param budget Memory budget, NULL to serve the allocations from the allocator again
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_heap_set_budget(mender_utils_heap_budget_t *budget);
+
+#endif /* CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
+#ifdef CONFIG_MENDER_UTILS_HEAP_ACCOUNTING
+
+/**
+ * @brief Function used to retrieve the heap statistics of a module
+ * @param module Module, MENDER_UTILS_HEAP_MODULE_ALL for the whole client
+ * @param stats Heap statistics
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_utils_heap_get_stats(mender_utils_heap_module_t module, mender_utils_heap_stats_t *stats);
+
+/**
+ * @brief Function used to reset the peaks of the heap statistics to the memory currently allocated
+ */
+void mender_utils_heap_reset_peak(void);
+
+/**
+ * @brief Function used to log the heap statistics of all the modules at debug level
+ */
+void mender_utils_heap_dump(void);
+
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING */
+
+#if defined(CONFIG_MENDER_UTILS_HEAP_ACCOUNTING) || defined(CONFIG_MENDER_CLIENT_MEMORY_BUDGET)
+
+/**
+ * @brief Module of the allocations of the source file, the allocations are accounted to the other modules by default
+ */
+#ifndef MENDER_UTILS_HEAP_MODULE
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_OTHER
+#endif /* MENDER_UTILS_HEAP_MODULE */
+
+/**
+ * @brief Allocations are accounted to the module of the source file and served from its pool
+ */
+#define mender_utils_malloc(size)                 mender_utils_heap_malloc(MENDER_UTILS_HEAP_MODULE, (size))
+#define mender_utils_calloc(count, size)          mender_utils_heap_calloc(MENDER_UTILS_HEAP_MODULE, (count), (size))
+#define mender_utils_realloc(ptr, size)           mender_utils_heap_realloc(MENDER_UTILS_HEAP_MODULE, (ptr), (size))
+#define mender_utils_strdup(s)                    mender_utils_heap_strdup(MENDER_UTILS_HEAP_MODULE, (s))
+#define mender_utils_strndup(s, n)                mender_utils_heap_strndup(MENDER_UTILS_HEAP_MODULE, (s), (n))
+#define mender_utils_vasprintf(str, format, args) mender_utils_heap_vasprintf(MENDER_UTILS_HEAP_MODULE, (str), (format), (args))
+
+#endif /* CONFIG_MENDER_UTILS_HEAP_ACCOUNTING || CONFIG_MENDER_CLIENT_MEMORY_BUDGET */
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -30,7 +30,8 @@ extern "C" {
  * @brief Mender websocket configuration
  */
 typedef struct {
-    char *host; /**< URL of the mender server */
+    char  *host;            /**< URL of the mender server */
+    size_t recv_buf_length; /**< Length of the receive buffer (bytes), 0 to use the default of the platform */
 } mender_websocket_config_t;
 
 /**
@@ -42,6 +43,15 @@ typedef enum {
     MENDER_WEBSOCKET_EVENT_DISCONNECTED,  /**< Disconnected from the server */
     MENDER_WEBSOCKET_EVENT_ERROR          /**< An error occurred */
 } mender_websocket_client_event_t;
+
+/**
+ * @brief Segment of a websocket message, the segments are sent one after the other without being copied to a contiguous buffer
+ */
+typedef struct {
+    void  *data;   /**< Data of the segment */
+    size_t length; /**< Length of the segment */
+} mender_websocket_segment_t;
+
 /**
  * @brief Initialize mender websocket
  * @param config Mender websocket configuration
@@ -63,13 +73,24 @@ mender_err_t mender_websocket_connect(
 
 /**
  * @brief Send binary data over websocket connection
+ * @note When the platform has a send queue, the payload is copied to the queue and the function returns without waiting for it to be sent
  * @param handle Websocket connection handle
  * @param payload Payload to send
  * @param length Length of the payload
- * @return MENDER_OK if the function succeeds, error code otherwise
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue of the platform is full, error code otherwise
  */
 mender_err_t mender_websocket_send(void *handle, void *payload, size_t length);
 
+/**
+ * @brief Send binary data made of several segments over websocket connection, the segments are received by the server as a single message
+ * @note When the platform has a send queue, the segments are merged in a single frame of the queue
+ * @param handle Websocket connection handle
+ * @param segments Segments to send
+ * @param count Number of segments
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue of the platform is full, error code otherwise
+ */
+mender_err_t mender_websocket_send_v(void *handle, mender_websocket_segment_t *segments, size_t count);
+
 /**
  * @brief Close the websocket connection
  * @param handle Websocket connection handle
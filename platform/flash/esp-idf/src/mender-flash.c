@@ -17,9 +17,59 @@
  * limitations under the License.
  */
 
+#if defined(CONFIG_MENDER_FLASH_ERASE_AHEAD) || defined(CONFIG_MENDER_FLASH_SKIP_UNCHANGED)
+#include <esp_image_format.h>
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD || CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
 #include <esp_ota_ops.h>
 #include "mender-flash.h"
 #include "mender-log.h"
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+#include "mender-scheduler.h"
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+#if defined(CONFIG_MENDER_FLASH_ERASE_AHEAD) && defined(CONFIG_MENDER_FLASH_SKIP_UNCHANGED)
+#error "CONFIG_MENDER_FLASH_SKIP_UNCHANGED is not compatible with CONFIG_MENDER_FLASH_ERASE_AHEAD"
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD && CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+
+/**
+ * @brief Delay between two checks of the progress of the erase task, in case a notification has been missed (milliseconds)
+ */
+#define MENDER_FLASH_ERASE_WAIT_DELAY (100)
+
+/**
+ * @brief Erasure of the update partition, performed ahead of the write pointer
+ */
+typedef struct {
+    bool                  enabled; /**< Erase-ahead is used, the OTA API is used otherwise (encrypted partitions) */
+    size_t                size;    /**< Length of the update partition covered by the image (bytes) */
+    volatile size_t       erased;  /**< Length of the update partition already erased (bytes) */
+    volatile bool         done;    /**< Erasure is completed or has failed */
+    volatile bool         abort;   /**< Erasure must be stopped */
+    volatile mender_err_t ret;     /**< Result of the erasure */
+    void                 *task;    /**< Erase task, NULL if the sectors are erased by the writer */
+    void                 *queue;   /**< Queue used to notify the progress of the erase task */
+} mender_flash_erase_t;
+
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+/**
+ * @brief Sector of the update partition being written, the sector is erased and programmed only if its content changes
+ */
+typedef struct {
+    bool     enabled; /**< Skip-unchanged is used, the OTA API is used otherwise (encrypted partitions) */
+    uint8_t *data;    /**< New content of the sector */
+    uint8_t *current; /**< Current content of the sector, read back from the update partition */
+    size_t   offset;  /**< Offset of the sector in the update partition */
+    size_t   length;  /**< Length of the new content of the sector */
+    size_t   skipped; /**< Number of sectors left unchanged */
+    size_t   total;   /**< Number of sectors written */
+} mender_flash_sector_t;
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
 
 /**
  * @brief Flash handle
@@ -27,8 +77,107 @@
 typedef struct {
     const esp_partition_t *partition;  /**< Update partition to which the firmware is flashed */
     esp_ota_handle_t       ota_handle; /**< OTA handle used to flash the firmware */
+    bool                   data;       /**< Data partition selected by the name of the payload file, written without the OTA API */
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+    mender_flash_erase_t erase; /**< Erasure of the update partition */
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    mender_flash_sector_t sector; /**< Sector of the update partition being written */
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
 } mender_flash_handle_t;
 
+/**
+ * @brief Erase the part of a data partition covered by the image
+ * @param flash_handle Flash handle
+ * @param size Size of the image
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase_data_partition(mender_flash_handle_t *flash_handle, size_t size);
+
+#if defined(CONFIG_MENDER_FLASH_ERASE_AHEAD) || defined(CONFIG_MENDER_FLASH_SKIP_UNCHANGED)
+
+/**
+ * @brief Validate the image written to the update partition, as performed by esp_ota_end
+ * @param flash_handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_verify_image(mender_flash_handle_t *flash_handle);
+
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD || CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+
+/**
+ * @brief Start erasure of the update partition, in a background task if possible
+ * @param flash_handle Flash handle
+ * @param size Size of the image
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase_start(mender_flash_handle_t *flash_handle, size_t size);
+
+/**
+ * @brief Erase the next sector of the update partition
+ * @param flash_handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase_next(mender_flash_handle_t *flash_handle);
+
+/**
+ * @brief Erase task function
+ * @param arg Flash handle
+ */
+static void mender_flash_erase_task(void *arg);
+
+/**
+ * @brief Wait until the update partition is erased up to the given length, the sectors are erased by the caller if there is no erase task
+ * @param flash_handle Flash handle
+ * @param length Length of the update partition that must be erased (bytes), SIZE_MAX to wait the end of the erasure
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase_wait(mender_flash_handle_t *flash_handle, size_t length);
+
+/**
+ * @brief Stop erasure of the update partition and release the erase task
+ * @param flash_handle Flash handle
+ */
+static void mender_flash_erase_stop(mender_flash_handle_t *flash_handle);
+
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+/**
+ * @brief Allocate the sector buffers
+ * @param flash_handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_sector_start(mender_flash_handle_t *flash_handle);
+
+/**
+ * @brief Write data to the sector buffer, the sector is flushed when it is full or when the data are not contiguous
+ * @param flash_handle Flash handle
+ * @param data Data to be written
+ * @param index Offset of the data in the update partition
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_sector_write(mender_flash_handle_t *flash_handle, uint8_t *data, size_t index, size_t length);
+
+/**
+ * @brief Compare the sector buffer with the content of the update partition, erase and program the sector only if it is different
+ * @param flash_handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_sector_flush(mender_flash_handle_t *flash_handle);
+
+/**
+ * @brief Release the sector buffers
+ * @param flash_handle Flash handle
+ */
+static void mender_flash_sector_stop(mender_flash_handle_t *flash_handle);
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
 mender_err_t
 mender_flash_open(char *name, size_t size, void **handle) {
 
@@ -40,11 +189,22 @@ mender_flash_open(char *name, size_t size, void **handle) {
     mender_log_info("Start flashing artifact '%s' with size %d", name, size);
 
     /* Allocate memory to store the flash handle */
-    if (NULL == (*handle = malloc(sizeof(mender_flash_handle_t)))) {
+    if (NULL == (*handle = mender_utils_calloc(1, sizeof(mender_flash_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
 
+    /* Check for a data partition labeled with the name of the payload file, used to flash the images of co-processors */
+    if (NULL != (((mender_flash_handle_t *)(*handle))->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, name))) {
+        mender_log_info("Data partition is '%s', subtype %d at offset 0x%x and with size %d",
+                        ((mender_flash_handle_t *)(*handle))->partition->label,
+                        ((mender_flash_handle_t *)(*handle))->partition->subtype,
+                        ((mender_flash_handle_t *)(*handle))->partition->address,
+                        ((mender_flash_handle_t *)(*handle))->partition->size);
+        ((mender_flash_handle_t *)(*handle))->data = true;
+        return mender_flash_erase_data_partition((mender_flash_handle_t *)*handle, size);
+    }
+
     /* Check for the next update partition */
     if (NULL == (((mender_flash_handle_t *)(*handle))->partition = esp_ota_get_next_update_partition(NULL))) {
         mender_log_error("Unable to find next update partition");
@@ -56,6 +216,28 @@ mender_flash_open(char *name, size_t size, void **handle) {
                     ((mender_flash_handle_t *)(*handle))->partition->address,
                     ((mender_flash_handle_t *)(*handle))->partition->size);
 
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+    /* Begin erasure of the update partition, the data are then written directly to the partition, encrypted partitions use the OTA API */
+    if (false == ((mender_flash_handle_t *)(*handle))->partition->encrypted) {
+        if (MENDER_OK != mender_flash_erase_start((mender_flash_handle_t *)*handle, size)) {
+            mender_log_error("Unable to erase the update partition");
+            return MENDER_FAIL;
+        }
+        return MENDER_OK;
+    }
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    /* Sectors are compared with the content of the update partition and programmed only if they change, encrypted partitions use the OTA API */
+    if (false == ((mender_flash_handle_t *)(*handle))->partition->encrypted) {
+        if (size > ((mender_flash_handle_t *)(*handle))->partition->size) {
+            mender_log_error("Image is too large for the update partition");
+            return MENDER_FAIL;
+        }
+        return mender_flash_sector_start((mender_flash_handle_t *)*handle);
+    }
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
     /* Begin OTA with sequential writes */
     if (ESP_OK
         != (err
@@ -70,7 +252,6 @@ mender_flash_open(char *name, size_t size, void **handle) {
 mender_err_t
 mender_flash_write(void *handle, void *data, size_t index, size_t length) {
 
-    (void)index;
     esp_err_t err;
 
     /* Check flash handle */
@@ -79,6 +260,37 @@ mender_flash_write(void *handle, void *data, size_t index, size_t length) {
         return MENDER_FAIL;
     }
 
+    /* Write data received to the data partition, already erased */
+    if (true == ((mender_flash_handle_t *)handle)->data) {
+        if (ESP_OK != (err = esp_partition_write(((mender_flash_handle_t *)handle)->partition, index, data, length))) {
+            mender_log_error("esp_partition_write failed (%s)", esp_err_to_name(err));
+            return MENDER_FAIL;
+        }
+        return MENDER_OK;
+    }
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+    /* Write data received to sectors already erased */
+    if (true == ((mender_flash_handle_t *)handle)->erase.enabled) {
+        if (MENDER_OK != mender_flash_erase_wait((mender_flash_handle_t *)handle, index + length)) {
+            mender_log_error("Unable to erase the update partition");
+            return MENDER_FAIL;
+        }
+        if (ESP_OK != (err = esp_partition_write(((mender_flash_handle_t *)handle)->partition, index, data, length))) {
+            mender_log_error("esp_partition_write failed (%s)", esp_err_to_name(err));
+            return MENDER_FAIL;
+        }
+        return MENDER_OK;
+    }
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    /* Write data received to the sector buffer */
+    if (true == ((mender_flash_handle_t *)handle)->sector.enabled) {
+        return mender_flash_sector_write((mender_flash_handle_t *)handle, data, index, length);
+    }
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
     /* Write data received to the update partition */
     if (ESP_OK != (err = esp_ota_write(((mender_flash_handle_t *)handle)->ota_handle, data, length))) {
         mender_log_error("esp_ota_write failed (%s)", esp_err_to_name(err));
@@ -88,17 +300,108 @@ mender_flash_write(void *handle, void *data, size_t index, size_t length) {
     return MENDER_OK;
 }
 
+mender_err_t
+mender_flash_write_erased(void *handle, size_t index, size_t length) {
+
+    /* Check flash handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid flash handle");
+        return MENDER_FAIL;
+    }
+
+    /* Nothing to write to the data partition, already erased */
+    if (true == ((mender_flash_handle_t *)handle)->data) {
+        return MENDER_OK;
+    }
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+    /* Nothing to write to sectors already erased, the erase task must have reached the end of the run */
+    if (true == ((mender_flash_handle_t *)handle)->erase.enabled) {
+        if (MENDER_OK != mender_flash_erase_wait((mender_flash_handle_t *)handle, index + length)) {
+            mender_log_error("Unable to erase the update partition");
+            return MENDER_FAIL;
+        }
+        return MENDER_OK;
+    }
+#else
+    (void)index;
+    (void)length;
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+    /* The run must be written, the update partition is written sequentially */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_read_running_image(void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    const esp_partition_t *partition;
+    esp_err_t              err;
+
+    /* Retrieve the running partition */
+    if (NULL == (partition = esp_ota_get_running_partition())) {
+        mender_log_error("Unable to find running partition");
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the running partition */
+    if (ESP_OK != (err = esp_partition_read(partition, index, data, length))) {
+        mender_log_error("esp_partition_read failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    esp_err_t err;
+
+    /* Check flash handle */
+    if (NULL == handle) {
+        mender_log_error("Invalid flash handle");
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the update partition */
+    if (ESP_OK != (err = esp_partition_read(((mender_flash_handle_t *)handle)->partition, index, data, length))) {
+        mender_log_error("esp_partition_read failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_flash_abort_deployment(void *handle) {
 
     /* Check flash handle */
     if (NULL != handle) {
 
-        /* Abort current deployment */
-        esp_ota_abort(((mender_flash_handle_t *)handle)->ota_handle);
+        /* Abort current deployment, nothing to do for data partitions */
+        if (false == ((mender_flash_handle_t *)handle)->data) {
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+            if (true == ((mender_flash_handle_t *)handle)->erase.enabled) {
+                mender_flash_erase_stop((mender_flash_handle_t *)handle);
+            } else {
+                esp_ota_abort(((mender_flash_handle_t *)handle)->ota_handle);
+            }
+#elif defined(CONFIG_MENDER_FLASH_SKIP_UNCHANGED)
+            if (true == ((mender_flash_handle_t *)handle)->sector.enabled) {
+                mender_flash_sector_stop((mender_flash_handle_t *)handle);
+            } else {
+                esp_ota_abort(((mender_flash_handle_t *)handle)->ota_handle);
+            }
+#else
+            esp_ota_abort(((mender_flash_handle_t *)handle)->ota_handle);
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+        }
 
         /* Release memory */
-        free(handle);
+        mender_utils_free(handle);
     }
 
     return MENDER_OK;
@@ -115,6 +418,38 @@ mender_flash_close(void *handle) {
         return MENDER_FAIL;
     }
 
+    /* Nothing to do for data partitions */
+    if (true == ((mender_flash_handle_t *)handle)->data) {
+        return MENDER_OK;
+    }
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+    /* Wait the end of the erasure and validate the image, as performed by esp_ota_end */
+    if (true == ((mender_flash_handle_t *)handle)->erase.enabled) {
+        if (MENDER_OK != mender_flash_erase_wait((mender_flash_handle_t *)handle, SIZE_MAX)) {
+            mender_log_error("Unable to erase the update partition");
+            mender_flash_erase_stop((mender_flash_handle_t *)handle);
+            return MENDER_FAIL;
+        }
+        mender_flash_erase_stop((mender_flash_handle_t *)handle);
+        return mender_flash_verify_image((mender_flash_handle_t *)handle);
+    }
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+    /* Write the last sector and validate the image, as performed by esp_ota_end */
+    if (true == ((mender_flash_handle_t *)handle)->sector.enabled) {
+        mender_flash_sector_t *sector = &((mender_flash_handle_t *)handle)->sector;
+        if (MENDER_OK != mender_flash_sector_flush((mender_flash_handle_t *)handle)) {
+            mender_flash_sector_stop((mender_flash_handle_t *)handle);
+            return MENDER_FAIL;
+        }
+        mender_log_info("%zu/%zu sectors of the update partition were unchanged", sector->skipped, sector->total);
+        mender_flash_sector_stop((mender_flash_handle_t *)handle);
+        return mender_flash_verify_image((mender_flash_handle_t *)handle);
+    }
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
     /* Ending current deployment */
     if (ESP_OK != (err = esp_ota_end(((mender_flash_handle_t *)handle)->ota_handle))) {
         if (ESP_ERR_OTA_VALIDATE_FAILED == err) {
@@ -136,14 +471,15 @@ mender_flash_set_pending_image(void *handle) {
     /* Check flash handle */
     if (NULL != handle) {
 
-        /* Set new boot partition */
-        if (ESP_OK != (err = esp_ota_set_boot_partition(((mender_flash_handle_t *)handle)->partition))) {
+        /* Set new boot partition, data partitions are used as is */
+        if ((false == ((mender_flash_handle_t *)handle)->data)
+            && (ESP_OK != (err = esp_ota_set_boot_partition(((mender_flash_handle_t *)handle)->partition)))) {
             mender_log_error("esp_ota_set_boot_partition failed (%s)!", esp_err_to_name(err));
             return MENDER_FAIL;
         }
 
         /* Release memory */
-        free(handle);
+        mender_utils_free(handle);
     }
 
     return MENDER_OK;
@@ -181,3 +517,279 @@ mender_flash_is_image_confirmed(void) {
     /* Check if the image is still pending */
     return (ESP_OTA_IMG_VALID == img_state);
 }
+
+static mender_err_t
+mender_flash_erase_data_partition(mender_flash_handle_t *flash_handle, size_t size) {
+
+    assert(NULL != flash_handle);
+    size_t    erase_size = flash_handle->partition->erase_size;
+    esp_err_t err;
+
+    /* Check size of the image */
+    if (size > flash_handle->partition->size) {
+        mender_log_error("Image is too large for the data partition");
+        return MENDER_FAIL;
+    }
+
+    /* Erase the sectors covered by the image */
+    if (ESP_OK != (err = esp_partition_erase_range(flash_handle->partition, 0, ((size + erase_size - 1) / erase_size) * erase_size))) {
+        mender_log_error("esp_partition_erase_range failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+#if defined(CONFIG_MENDER_FLASH_ERASE_AHEAD) || defined(CONFIG_MENDER_FLASH_SKIP_UNCHANGED)
+
+static mender_err_t
+mender_flash_verify_image(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+    const esp_partition_pos_t part_pos = { .offset = flash_handle->partition->address, .size = flash_handle->partition->size };
+    esp_image_metadata_t      data;
+
+    /* Verify the image */
+    if (ESP_OK != esp_image_verify(ESP_IMAGE_VERIFY, &part_pos, &data)) {
+        mender_log_error("Image validation failed, image is corrupted");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD || CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+
+static mender_err_t
+mender_flash_erase_start(mender_flash_handle_t *flash_handle, size_t size) {
+
+    assert(NULL != flash_handle);
+    mender_flash_erase_t *erase = &flash_handle->erase;
+
+    /* Check size of the image */
+    if (size > flash_handle->partition->size) {
+        mender_log_error("Image is too large for the update partition");
+        return MENDER_FAIL;
+    }
+    erase->enabled = true;
+    erase->size    = size;
+    erase->ret     = MENDER_OK;
+    erase->done    = (0 == size);
+
+#ifndef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+    /* Create the erase task, the task stack is used by the writer task of the flash pipeline otherwise */
+    mender_scheduler_task_params_t task_params = { .function = mender_flash_erase_task, .arg = flash_handle, .name = "mender_flash_erase" };
+    if (MENDER_OK == mender_scheduler_queue_create(1, sizeof(uint8_t), &erase->queue)) {
+        if (MENDER_OK != mender_scheduler_task_create(&task_params, &erase->task)) {
+            mender_scheduler_queue_delete(erase->queue);
+            erase->queue = NULL;
+        }
+    }
+    if (NULL == erase->task) {
+        mender_log_warning("Unable to create erase task, sectors are erased on demand");
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_flash_erase_next(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+    mender_flash_erase_t *erase = &flash_handle->erase;
+    esp_err_t             err;
+
+    /* Erase the next sector */
+    if (ESP_OK != (err = esp_partition_erase_range(flash_handle->partition, erase->erased, flash_handle->partition->erase_size))) {
+        mender_log_error("esp_partition_erase_range failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+
+    /* Update progress of the erasure */
+    erase->erased += flash_handle->partition->erase_size;
+    erase->done = (erase->erased >= erase->size);
+
+    return MENDER_OK;
+}
+
+static void
+mender_flash_erase_task(void *arg) {
+
+    assert(NULL != arg);
+    mender_flash_erase_t *erase        = &((mender_flash_handle_t *)arg)->erase;
+    uint8_t               notification = 0;
+
+    /* Erase the update partition sector by sector, the writer is notified after each sector */
+    while ((false == erase->done) && (false == erase->abort)) {
+        if (MENDER_OK != (erase->ret = mender_flash_erase_next((mender_flash_handle_t *)arg))) {
+            erase->done = true;
+        }
+        mender_scheduler_queue_send(erase->queue, &notification, 0);
+    }
+}
+
+static mender_err_t
+mender_flash_erase_wait(mender_flash_handle_t *flash_handle, size_t length) {
+
+    assert(NULL != flash_handle);
+    mender_flash_erase_t *erase = &flash_handle->erase;
+    uint8_t               notification;
+
+    /* Wait until the sectors are erased, or erase them if there is no erase task */
+    while ((false == erase->done) && ((SIZE_MAX == length) || (erase->erased < length))) {
+        if (NULL != erase->task) {
+            mender_scheduler_queue_receive(erase->queue, &notification, MENDER_FLASH_ERASE_WAIT_DELAY);
+        } else if (MENDER_OK != (erase->ret = mender_flash_erase_next(flash_handle))) {
+            erase->done = true;
+        }
+    }
+
+    return erase->ret;
+}
+
+static void
+mender_flash_erase_stop(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+    mender_flash_erase_t *erase = &flash_handle->erase;
+
+    /* Stop the erase task and release it */
+    if (NULL != erase->task) {
+        erase->abort = true;
+        mender_scheduler_task_join(erase->task);
+        erase->task = NULL;
+    }
+    if (NULL != erase->queue) {
+        mender_scheduler_queue_delete(erase->queue);
+        erase->queue = NULL;
+    }
+}
+
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+#ifdef CONFIG_MENDER_FLASH_SKIP_UNCHANGED
+
+static mender_err_t
+mender_flash_sector_start(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+    mender_flash_sector_t *sector = &flash_handle->sector;
+
+    /* Allocate the sector buffers */
+    if ((NULL == (sector->data = (uint8_t *)mender_utils_malloc(flash_handle->partition->erase_size)))
+        || (NULL == (sector->current = (uint8_t *)mender_utils_malloc(flash_handle->partition->erase_size)))) {
+        mender_log_error("Unable to allocate memory");
+        mender_flash_sector_stop(flash_handle);
+        return MENDER_FAIL;
+    }
+    sector->enabled = true;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_flash_sector_write(mender_flash_handle_t *flash_handle, uint8_t *data, size_t index, size_t length) {
+
+    assert(NULL != flash_handle);
+    mender_flash_sector_t *sector     = &flash_handle->sector;
+    size_t                 erase_size = flash_handle->partition->erase_size;
+    esp_err_t              err;
+
+    /* Check the data fit in the update partition */
+    if ((index > flash_handle->partition->size) || (length > flash_handle->partition->size - index)) {
+        mender_log_error("Data exceed the size of the update partition");
+        return MENDER_FAIL;
+    }
+
+    /* Flush the sector if the data are not contiguous with its content */
+    if ((sector->length > 0) && (index != sector->offset + sector->length)) {
+        if (MENDER_OK != mender_flash_sector_flush(flash_handle)) {
+            return MENDER_FAIL;
+        }
+    }
+
+    while (length > 0) {
+
+        /* Begin a new sector, the part of the sector preceding the data is read back from the update partition */
+        if (0 == sector->length) {
+            sector->offset = index - (index % erase_size);
+            sector->length = index - sector->offset;
+            if ((sector->length > 0) && (ESP_OK != (err = esp_partition_read(flash_handle->partition, sector->offset, sector->data, sector->length)))) {
+                mender_log_error("esp_partition_read failed (%s)", esp_err_to_name(err));
+                sector->length = 0;
+                return MENDER_FAIL;
+            }
+        }
+
+        /* Copy data to the sector buffer */
+        size_t chunk = erase_size - sector->length;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(&sector->data[sector->length], data, chunk);
+        sector->length += chunk;
+        data += chunk;
+        index += chunk;
+        length -= chunk;
+
+        /* Flush the sector when it is full */
+        if (erase_size == sector->length) {
+            if (MENDER_OK != mender_flash_sector_flush(flash_handle)) {
+                return MENDER_FAIL;
+            }
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_flash_sector_flush(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+    mender_flash_sector_t *sector = &flash_handle->sector;
+    size_t                 length = sector->length;
+    esp_err_t              err;
+
+    /* Nothing to do if the sector is empty */
+    if (0 == length) {
+        return MENDER_OK;
+    }
+    sector->length = 0;
+    sector->total++;
+
+    /* Compare with the current content of the sector, erase and program it only if it is different */
+    if ((ESP_OK == esp_partition_read(flash_handle->partition, sector->offset, sector->current, length))
+        && (0 == memcmp(sector->current, sector->data, length))) {
+        sector->skipped++;
+        return MENDER_OK;
+    }
+    if (ESP_OK != (err = esp_partition_erase_range(flash_handle->partition, sector->offset, flash_handle->partition->erase_size))) {
+        mender_log_error("esp_partition_erase_range failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+    if (ESP_OK != (err = esp_partition_write(flash_handle->partition, sector->offset, sector->data, length))) {
+        mender_log_error("esp_partition_write failed (%s)", esp_err_to_name(err));
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+static void
+mender_flash_sector_stop(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+    mender_flash_sector_t *sector = &flash_handle->sector;
+
+    /* Release the sector buffers */
+    mender_utils_free(sector->data);
+    sector->data = NULL;
+    mender_utils_free(sector->current);
+    sector->current = NULL;
+}
+
+#endif /* CONFIG_MENDER_FLASH_SKIP_UNCHANGED */
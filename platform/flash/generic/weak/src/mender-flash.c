@@ -42,6 +42,40 @@ mender_flash_write(void *handle, void *data, size_t index, size_t length) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_flash_write_erased(void *handle, size_t index, size_t length) {
+
+    (void)handle;
+    (void)index;
+    (void)length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_flash_read_running_image(void *data, size_t index, size_t length) {
+
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_flash_read(void *handle, void *data, size_t index, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)index;
+    (void)length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_flash_close(void *handle) {
 
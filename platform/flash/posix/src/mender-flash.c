@@ -18,6 +18,16 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+#include <pthread.h>
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+#ifdef CONFIG_MENDER_FLASH_MMAP
+#include <sys/mman.h>
+#endif /* CONFIG_MENDER_FLASH_MMAP */
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+#include <time.h>
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
 #include <unistd.h>
 #include "mender-flash.h"
 #include "mender-log.h"
@@ -29,38 +39,201 @@
 #define CONFIG_MENDER_FLASH_PATH ""
 #endif /* CONFIG_MENDER_FLASH_PATH */
 
+/**
+ * @brief Default running image path (current executable)
+ */
+#ifndef CONFIG_MENDER_FLASH_RUNNING_IMAGE_PATH
+#define CONFIG_MENDER_FLASH_RUNNING_IMAGE_PATH "/proc/self/exe"
+#endif /* CONFIG_MENDER_FLASH_RUNNING_IMAGE_PATH */
+
+/**
+ * @brief Default write-behind buffer size, 0 to write the data to the update file as they are received (bytes)
+ */
+#ifndef CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE
+#define CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE (65536)
+#endif /* CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE */
+
+/**
+ * @brief Default length of data written to the update file between two synchronizations, 0 to let the system flush the update file (bytes)
+ */
+#ifndef CONFIG_MENDER_FLASH_SYNC_SIZE
+#define CONFIG_MENDER_FLASH_SYNC_SIZE (0)
+#endif /* CONFIG_MENDER_FLASH_SYNC_SIZE */
+
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+
+/**
+ * @brief Default page size of the simulated flash, the erase unit (bytes)
+ */
+#ifndef CONFIG_MENDER_FLASH_SIMULATION_PAGE_SIZE
+#define CONFIG_MENDER_FLASH_SIMULATION_PAGE_SIZE (4096)
+#endif /* CONFIG_MENDER_FLASH_SIMULATION_PAGE_SIZE */
+
+/**
+ * @brief Default erase time of a page of the simulated flash (microseconds)
+ */
+#ifndef CONFIG_MENDER_FLASH_SIMULATION_ERASE_TIME
+#define CONFIG_MENDER_FLASH_SIMULATION_ERASE_TIME (45000)
+#endif /* CONFIG_MENDER_FLASH_SIMULATION_ERASE_TIME */
+
+/**
+ * @brief Default program time of a page of the simulated flash, partial pages are programmed in proportion (microseconds)
+ */
+#ifndef CONFIG_MENDER_FLASH_SIMULATION_PROGRAM_TIME
+#define CONFIG_MENDER_FLASH_SIMULATION_PROGRAM_TIME (6400)
+#endif /* CONFIG_MENDER_FLASH_SIMULATION_PROGRAM_TIME */
+
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+
 /**
  * @brief Deployment files
  */
 #define MENDER_FLASH_REQUEST_UPGRADE CONFIG_MENDER_FLASH_PATH "request_upgrade"
 
+/**
+ * @brief Flash handle
+ */
+typedef struct {
+    int      fd;       /**< Update file descriptor, -1 when the update file is closed */
+    uint8_t *buffer;   /**< Write-behind buffer, NULL if not used */
+    size_t   offset;   /**< Offset in the update file of the data in the write-behind buffer */
+    size_t   length;   /**< Length of the data in the write-behind buffer */
+    size_t   unsynced; /**< Length of the data written to the update file since the last synchronization */
+#ifdef CONFIG_MENDER_FLASH_MMAP
+    uint8_t *map;  /**< Mapping of the update file, NULL if the data are written using pwrite */
+    size_t   size; /**< Size of the mapping */
+#endif /* CONFIG_MENDER_FLASH_MMAP */
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+    size_t erased; /**< End of the pages of the simulated flash already erased */
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+} mender_flash_handle_t;
+
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+
+/**
+ * @brief Report of the simulated flash, the writes are allocated with the standard allocator so that they are not accounted in the heap of the client
+ */
+static mender_flash_simulation_report_t mender_flash_simulation_report;
+
+/**
+ * @brief Writes of the simulated flash and number of writes allocated
+ */
+static mender_flash_simulation_write_t *mender_flash_simulation_writes          = NULL;
+static size_t                           mender_flash_simulation_writes_capacity = 0;
+
+/**
+ * @brief Mutex used to protect access to the report, the flash may be written by the flash pipeline task
+ */
+static pthread_mutex_t mender_flash_simulation_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Get the time of the monotonic clock
+ * @return Time (microseconds)
+ */
+static uint64_t mender_flash_simulation_now(void);
+
+/**
+ * @brief Wait for the end of a simulated operation, by spinning or sleeping depending on CONFIG_MENDER_FLASH_SIMULATION_BUSY_WAIT
+ * @param duration Duration of the operation (microseconds)
+ */
+static void mender_flash_simulation_wait(uint64_t duration);
+
+/**
+ * @brief Simulate the erase and the program of data written to the update file and record the write
+ * @param flash_handle Flash handle
+ * @param offset Offset of the data in the update file
+ * @param length Length of the data
+ */
+static void mender_flash_simulation_program(mender_flash_handle_t *flash_handle, size_t offset, size_t length);
+
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+
+/**
+ * @brief Write data to the update file at the given offset, synchronize the update file if required
+ * @param flash_handle Flash handle
+ * @param data Data to be written
+ * @param offset Offset of the data in the update file
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_pwrite(mender_flash_handle_t *flash_handle, const uint8_t *data, size_t offset, size_t length);
+
+/**
+ * @brief Write the data of the write-behind buffer to the update file
+ * @param flash_handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_flush(mender_flash_handle_t *flash_handle);
+
+/**
+ * @brief Release the update file and the write-behind buffer
+ * @param flash_handle Flash handle
+ */
+static void mender_flash_release(mender_flash_handle_t *flash_handle);
+
 mender_err_t
 mender_flash_open(char *name, size_t size, void **handle) {
 
     assert(NULL != name);
     assert(NULL != handle);
-    char *path = NULL;
+    char                  *path = NULL;
+    mender_flash_handle_t *flash_handle;
 
     /* Print current file name and size */
     mender_log_info("Start flashing artifact '%s' with size %d", name, size);
 
     /* Compute path */
     size_t str_length = strlen(CONFIG_MENDER_FLASH_PATH) + strlen(name) + 1;
-    if (NULL == (path = (char *)malloc(str_length))) {
+    if (NULL == (path = (char *)mender_utils_malloc(str_length))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
     snprintf(path, str_length, "%s%s", CONFIG_MENDER_FLASH_PATH, name);
 
-    /* Begin deployment with sequential writes */
-    if (NULL == (*handle = fopen(path, "wb"))) {
-        mender_log_error("fopen failed (%d)", errno);
-        free(path);
+    /* Create flash handle */
+    if (NULL == (flash_handle = (mender_flash_handle_t *)mender_utils_calloc(1, sizeof(mender_flash_handle_t)))) {
+        mender_log_error("Unable to allocate memory");
+        mender_utils_free(path);
+        return MENDER_FAIL;
+    }
+
+    /* Begin deployment, data are written at the given index */
+    if (-1 == (flash_handle->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644))) {
+        mender_log_error("open failed (%d)", errno);
+        mender_utils_free(flash_handle);
+        mender_utils_free(path);
         return MENDER_FAIL;
     }
 
     /* Release memory */
-    free(path);
+    mender_utils_free(path);
+
+#ifdef CONFIG_MENDER_FLASH_MMAP
+    /* Preallocate the update file and map it, fallback to pwrite if not possible */
+    if (0 != size) {
+        if ((0 == ftruncate(flash_handle->fd, (off_t)size))
+            && (MAP_FAILED != (flash_handle->map = (uint8_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, flash_handle->fd, 0)))) {
+            flash_handle->size = size;
+            *handle            = flash_handle;
+            return MENDER_OK;
+        }
+        mender_log_warning("Unable to map the update file (%d), using pwrite", errno);
+        flash_handle->map = NULL;
+    }
+#endif /* CONFIG_MENDER_FLASH_MMAP */
+
+#if CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0
+    /* Allocate write-behind buffer, aligned on the page size */
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (0 != posix_memalign((void **)&flash_handle->buffer, (page_size > 0) ? (size_t)page_size : sizeof(void *), CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE)) {
+        mender_log_error("Unable to allocate memory");
+        mender_flash_release(flash_handle);
+        mender_utils_free(flash_handle);
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0 */
+
+    *handle = flash_handle;
 
     return MENDER_OK;
 }
@@ -68,36 +241,180 @@ mender_flash_open(char *name, size_t size, void **handle) {
 mender_err_t
 mender_flash_write(void *handle, void *data, size_t index, size_t length) {
 
-    (void)index;
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
 
     /* Check flash handle */
-    if (NULL == handle) {
+    if ((NULL == flash_handle) || (-1 == flash_handle->fd)) {
         mender_log_error("Invalid flash handle");
         return MENDER_FAIL;
     }
 
-    /* Write data received to the update file */
-    if (fwrite(data, sizeof(unsigned char), length, handle) != length) {
-        mender_log_error("fwrite failed (%d)", length);
+#ifdef CONFIG_MENDER_FLASH_MMAP
+    /* Copy data received to the mapping of the update file */
+    if (NULL != flash_handle->map) {
+        if ((index > flash_handle->size) || (length > flash_handle->size - index)) {
+            mender_log_error("Data exceed the size of the update file");
+            return MENDER_FAIL;
+        }
+        memcpy(&flash_handle->map[index], data, length);
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+        mender_flash_simulation_program(flash_handle, index, length);
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+        return MENDER_OK;
+    }
+#endif /* CONFIG_MENDER_FLASH_MMAP */
+
+#if CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0
+
+    /* Flush the write-behind buffer if the data are not contiguous with its content */
+    if ((flash_handle->length > 0) && (index != flash_handle->offset + flash_handle->length)) {
+        if (MENDER_OK != mender_flash_flush(flash_handle)) {
+            return MENDER_FAIL;
+        }
+    }
+
+    /* Aggregate data received in the write-behind buffer, large writes are performed directly when the buffer is empty */
+    while (length > 0) {
+        if (0 == flash_handle->length) {
+            flash_handle->offset = index;
+            if (length >= CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE) {
+                return mender_flash_pwrite(flash_handle, data, index, length);
+            }
+        }
+        size_t chunk = CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE - flash_handle->length;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(&flash_handle->buffer[flash_handle->length], data, chunk);
+        flash_handle->length += chunk;
+        data = (uint8_t *)data + chunk;
+        index += chunk;
+        length -= chunk;
+        if (CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE == flash_handle->length) {
+            if (MENDER_OK != mender_flash_flush(flash_handle)) {
+                return MENDER_FAIL;
+            }
+        }
+    }
+
+    return MENDER_OK;
+#else
+    /* Write data received directly */
+    return mender_flash_pwrite(flash_handle, data, index, length);
+#endif /* CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0 */
+}
+
+mender_err_t
+mender_flash_write_erased(void *handle, size_t index, size_t length) {
+
+    (void)handle;
+    (void)index;
+    (void)length;
+
+    /* The run must be written, the update file is not erased */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_read_running_image(void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    FILE        *file;
+    mender_err_t ret = MENDER_OK;
+
+    /* Open running image */
+    if (NULL == (file = fopen(CONFIG_MENDER_FLASH_RUNNING_IMAGE_PATH, "rb"))) {
+        mender_log_error("fopen failed (%d)", errno);
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the running image */
+    if (0 != fseek(file, (long)index, SEEK_SET)) {
+        mender_log_error("fseek failed (%d)", errno);
+        ret = MENDER_FAIL;
+    } else if (fread(data, sizeof(unsigned char), length, file) != length) {
+        mender_log_error("fread failed (%d)", length);
+        ret = MENDER_FAIL;
+    }
+
+    /* Close running image */
+    fclose(file);
+
+    return ret;
+}
+
+mender_err_t
+mender_flash_read(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    ssize_t                result;
+
+    /* Check flash handle */
+    if ((NULL == flash_handle) || (-1 == flash_handle->fd)) {
+        mender_log_error("Invalid flash handle");
         return MENDER_FAIL;
     }
 
+    /* Read data from the update file, data remaining in the write-behind buffer are not read */
+    while (length > 0) {
+        if (-1 == (result = pread(flash_handle->fd, data, length, (off_t)index))) {
+            if (EINTR == errno) {
+                continue;
+            }
+            mender_log_error("pread failed (%d)", errno);
+            return MENDER_FAIL;
+        }
+        if (0 == result) {
+            mender_log_error("Unable to read data beyond the end of the update file");
+            return MENDER_FAIL;
+        }
+        data = (uint8_t *)data + result;
+        index += (size_t)result;
+        length -= (size_t)result;
+    }
+
     return MENDER_OK;
 }
 
 mender_err_t
 mender_flash_close(void *handle) {
 
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    mender_err_t           ret          = MENDER_OK;
+
     /* Check flash handle */
-    if (NULL == handle) {
+    if ((NULL == flash_handle) || (-1 == flash_handle->fd)) {
         mender_log_error("Invalid flash handle");
         return MENDER_FAIL;
     }
 
-    /* Close update file */
-    fclose(handle);
+    /* Write remaining data to the update file */
+    if (NULL != flash_handle->buffer) {
+        ret = mender_flash_flush(flash_handle);
+    }
 
-    return MENDER_OK;
+#if CONFIG_MENDER_FLASH_SYNC_SIZE > 0
+    /* Synchronize the update file */
+    if (MENDER_OK == ret) {
+#ifdef CONFIG_MENDER_FLASH_MMAP
+        if ((NULL != flash_handle->map) && (0 != msync(flash_handle->map, flash_handle->size, MS_SYNC))) {
+            mender_log_error("msync failed (%d)", errno);
+            ret = MENDER_FAIL;
+        }
+#endif /* CONFIG_MENDER_FLASH_MMAP */
+        if ((MENDER_OK == ret) && (0 != fdatasync(flash_handle->fd))) {
+            mender_log_error("fdatasync failed (%d)", errno);
+            ret = MENDER_FAIL;
+        }
+    }
+#endif /* CONFIG_MENDER_FLASH_SYNC_SIZE > 0 */
+
+    /* Release the write-behind buffer, the update file is kept open to be read back until the deployment is completed */
+    mender_utils_free(flash_handle->buffer);
+    flash_handle->buffer = NULL;
+
+    return ret;
 }
 
 mender_err_t
@@ -116,6 +433,10 @@ mender_flash_set_pending_image(void *handle) {
         } else {
             fclose(file);
         }
+
+        /* Release memory */
+        mender_flash_release((mender_flash_handle_t *)handle);
+        mender_utils_free(handle);
     }
 
     return ret;
@@ -128,7 +449,8 @@ mender_flash_abort_deployment(void *handle) {
     if (NULL != handle) {
 
         /* Release memory */
-        fclose(handle);
+        mender_flash_release((mender_flash_handle_t *)handle);
+        mender_utils_free(handle);
     }
 
     return MENDER_OK;
@@ -159,3 +481,193 @@ mender_flash_is_image_confirmed(void) {
     /* Check if the image it still pending */
     return (0 != access(MENDER_FLASH_REQUEST_UPGRADE, F_OK));
 }
+
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+
+mender_err_t
+mender_flash_simulation_get_report(mender_flash_simulation_report_t *report) {
+
+    assert(NULL != report);
+
+    /* Copy the report */
+    pthread_mutex_lock(&mender_flash_simulation_mutex);
+    memcpy(report, &mender_flash_simulation_report, sizeof(mender_flash_simulation_report_t));
+    report->writes = mender_flash_simulation_writes;
+    pthread_mutex_unlock(&mender_flash_simulation_mutex);
+
+    return MENDER_OK;
+}
+
+void
+mender_flash_simulation_reset(void) {
+
+    /* Release the writes and clear the report */
+    pthread_mutex_lock(&mender_flash_simulation_mutex);
+    free(mender_flash_simulation_writes);
+    mender_flash_simulation_writes          = NULL;
+    mender_flash_simulation_writes_capacity = 0;
+    memset(&mender_flash_simulation_report, 0, sizeof(mender_flash_simulation_report));
+    pthread_mutex_unlock(&mender_flash_simulation_mutex);
+}
+
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+
+static mender_err_t
+mender_flash_pwrite(mender_flash_handle_t *flash_handle, const uint8_t *data, size_t offset, size_t length) {
+
+    assert(NULL != flash_handle);
+    ssize_t written;
+
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+    /* Simulate the erase and the program of the data */
+    mender_flash_simulation_program(flash_handle, offset, length);
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+
+    /* Write data, partial writes are completed */
+    while (length > 0) {
+        if (-1 == (written = pwrite(flash_handle->fd, data, length, (off_t)offset))) {
+            if (EINTR == errno) {
+                continue;
+            }
+            mender_log_error("pwrite failed (%d)", errno);
+            return MENDER_FAIL;
+        }
+        data += written;
+        offset += (size_t)written;
+        length -= (size_t)written;
+        flash_handle->unsynced += (size_t)written;
+    }
+
+#if CONFIG_MENDER_FLASH_SYNC_SIZE > 0
+    /* Synchronize the update file when enough data have been written */
+    if (flash_handle->unsynced >= CONFIG_MENDER_FLASH_SYNC_SIZE) {
+        if (0 != fdatasync(flash_handle->fd)) {
+            mender_log_error("fdatasync failed (%d)", errno);
+            return MENDER_FAIL;
+        }
+        flash_handle->unsynced = 0;
+    }
+#endif /* CONFIG_MENDER_FLASH_SYNC_SIZE > 0 */
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_flash_flush(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+    mender_err_t ret = MENDER_OK;
+
+    /* Write the content of the write-behind buffer */
+    if (flash_handle->length > 0) {
+        ret                  = mender_flash_pwrite(flash_handle, flash_handle->buffer, flash_handle->offset, flash_handle->length);
+        flash_handle->length = 0;
+    }
+
+    return ret;
+}
+
+static void
+mender_flash_release(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+
+#ifdef CONFIG_MENDER_FLASH_MMAP
+    /* Unmap the update file */
+    if (NULL != flash_handle->map) {
+        munmap(flash_handle->map, flash_handle->size);
+        flash_handle->map = NULL;
+    }
+#endif /* CONFIG_MENDER_FLASH_MMAP */
+
+    /* Close the update file */
+    if (-1 != flash_handle->fd) {
+        close(flash_handle->fd);
+        flash_handle->fd = -1;
+    }
+
+    /* Release the write-behind buffer */
+    if (NULL != flash_handle->buffer) {
+        mender_utils_free(flash_handle->buffer);
+        flash_handle->buffer = NULL;
+    }
+}
+
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+
+static uint64_t
+mender_flash_simulation_now(void) {
+
+    struct timespec now;
+
+    /* Read the monotonic clock */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static void
+mender_flash_simulation_wait(uint64_t duration) {
+
+#ifdef CONFIG_MENDER_FLASH_SIMULATION_BUSY_WAIT
+    /* Spin until the end of the operation, as a flash driver polling the status of the flash */
+    uint64_t end = mender_flash_simulation_now() + duration;
+    while (mender_flash_simulation_now() < end) {
+        /* Nothing to do */
+    }
+#else
+    /* Sleep until the end of the operation, as a flash driver waiting for the interrupt of the flash */
+    struct timespec remaining = { .tv_sec = (time_t)(duration / 1000000), .tv_nsec = (long)(duration % 1000000) * 1000 };
+    while ((-1 == nanosleep(&remaining, &remaining)) && (EINTR == errno)) {
+        /* Nothing to do */
+    }
+#endif /* CONFIG_MENDER_FLASH_SIMULATION_BUSY_WAIT */
+}
+
+static void
+mender_flash_simulation_program(mender_flash_handle_t *flash_handle, size_t offset, size_t length) {
+
+    assert(NULL != flash_handle);
+    size_t erases = 0;
+
+    /* Erase the pages ahead of the data, the pages are erased in sequence as the update file is written */
+    while (flash_handle->erased < offset + length) {
+        flash_handle->erased += CONFIG_MENDER_FLASH_SIMULATION_PAGE_SIZE;
+        erases++;
+    }
+    uint64_t erase_time = (uint64_t)erases * CONFIG_MENDER_FLASH_SIMULATION_ERASE_TIME;
+
+    /* Program the data, the program time is proportional to the length */
+    uint64_t program_time = (uint64_t)length * CONFIG_MENDER_FLASH_SIMULATION_PROGRAM_TIME / CONFIG_MENDER_FLASH_SIMULATION_PAGE_SIZE;
+    uint64_t begin = mender_flash_simulation_now();
+    mender_flash_simulation_wait(erase_time + program_time);
+    uint64_t end = mender_flash_simulation_now();
+
+    /* Record the write, it is dropped if the writes can't be allocated */
+    pthread_mutex_lock(&mender_flash_simulation_mutex);
+    if (mender_flash_simulation_report.count == mender_flash_simulation_writes_capacity) {
+        size_t                           capacity = (0 != mender_flash_simulation_writes_capacity) ? 2 * mender_flash_simulation_writes_capacity : 256;
+        mender_flash_simulation_write_t *tmp;
+        if (NULL != (tmp = (mender_flash_simulation_write_t *)realloc(mender_flash_simulation_writes, capacity * sizeof(mender_flash_simulation_write_t)))) {
+            mender_flash_simulation_writes          = tmp;
+            mender_flash_simulation_writes_capacity = capacity;
+        }
+    }
+    if (mender_flash_simulation_report.count < mender_flash_simulation_writes_capacity) {
+        bool aligned = (0 == offset % CONFIG_MENDER_FLASH_SIMULATION_PAGE_SIZE) && (0 == length % CONFIG_MENDER_FLASH_SIMULATION_PAGE_SIZE);
+        mender_flash_simulation_write_t *write = &mender_flash_simulation_writes[mender_flash_simulation_report.count++];
+        write->offset                          = offset;
+        write->length                          = length;
+        write->aligned                         = aligned;
+        if (false == aligned) {
+            mender_flash_simulation_report.unaligned++;
+        }
+    }
+    mender_flash_simulation_report.erases += erases;
+    mender_flash_simulation_report.erase_time += erase_time;
+    mender_flash_simulation_report.program_time += program_time;
+    mender_flash_simulation_report.time += end - begin;
+    pthread_mutex_unlock(&mender_flash_simulation_mutex);
+}
+
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
@@ -19,9 +19,99 @@
 
 #include <zephyr/dfu/flash_img.h>
 #include <zephyr/dfu/mcuboot.h>
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+#include <zephyr/drivers/flash.h>
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+#include <zephyr/storage/flash_map.h>
 #include <zephyr/sys/reboot.h>
 #include "mender-flash.h"
 #include "mender-log.h"
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+#include "mender-scheduler.h"
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+/**
+ * @brief Size of the buffer used to aggregate the data written to the update partition (bytes), 0 to forward the data directly
+ */
+#ifndef CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE
+#define CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE (4096)
+#endif /* CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE */
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+
+/**
+ * @brief Delay between two checks of the progress of the erase task, in case a notification has been missed (milliseconds)
+ */
+#define MENDER_FLASH_ERASE_WAIT_DELAY (100)
+
+/**
+ * @brief Erasure of the update partition, performed ahead of the write pointer
+ */
+typedef struct {
+    size_t                size;    /**< Length of the update partition covered by the image (bytes) */
+    volatile size_t       erased;  /**< Length of the update partition already erased (bytes) */
+    volatile bool         trailer; /**< The image trailer has been erased */
+    volatile bool         done;    /**< Erasure is completed or has failed */
+    volatile bool         abort;   /**< Erasure must be stopped */
+    volatile mender_err_t ret;     /**< Result of the erasure */
+    void                 *task;    /**< Erase task, NULL if the sectors are erased by the writer */
+    void                 *queue;   /**< Queue used to notify the progress of the erase task */
+} mender_flash_erase_t;
+
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+/**
+ * @brief Flash handle
+ */
+typedef struct {
+    struct flash_img_context ctx; /**< Flash image context */
+#if CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0
+    uint8_t buffer[CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE]; /**< Data aggregated and not written yet */
+    size_t  length;                                        /**< Length of the data aggregated (bytes) */
+#endif /* CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0 */
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+    mender_flash_erase_t erase; /**< Erasure of the update partition */
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+} mender_flash_handle_t;
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+
+/**
+ * @brief Start erasure of the update partition, in a background task if possible
+ * @param flash_handle Flash handle
+ * @param size Size of the image
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase_start(mender_flash_handle_t *flash_handle, size_t size);
+
+/**
+ * @brief Erase the next sector of the update partition, the image trailer is erased at the end
+ * @param flash_handle Flash handle
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase_next(mender_flash_handle_t *flash_handle);
+
+/**
+ * @brief Erase task function
+ * @param arg Flash handle
+ */
+static void mender_flash_erase_task(void *arg);
+
+/**
+ * @brief Wait until the update partition is erased up to the given length, the sectors are erased by the caller if there is no erase task
+ * @param flash_handle Flash handle
+ * @param length Length of the update partition that must be erased (bytes), SIZE_MAX to wait the end of the erasure including the image trailer
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_flash_erase_wait(mender_flash_handle_t *flash_handle, size_t length);
+
+/**
+ * @brief Stop erasure of the update partition and release the erase task
+ * @param flash_handle Flash handle
+ */
+static void mender_flash_erase_stop(mender_flash_handle_t *flash_handle);
+
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
 
 mender_err_t
 mender_flash_open(char *name, size_t size, void **handle) {
@@ -34,16 +124,28 @@ mender_flash_open(char *name, size_t size, void **handle) {
     mender_log_info("Start flashing artifact '%s' with size %d", name, size);
 
     /* Allocate memory to store the flash handle */
-    if (NULL == (*handle = malloc(sizeof(struct flash_img_context)))) {
+    if (NULL == (*handle = mender_utils_calloc(1, sizeof(mender_flash_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
 
     /* Begin deployment with sequential writes */
-    if ((result = flash_img_init((struct flash_img_context *)*handle)) < 0) {
+    if ((result = flash_img_init(&((mender_flash_handle_t *)*handle)->ctx)) < 0) {
         mender_log_error("flash_img_init failed (%d)", result);
+        mender_utils_free(*handle);
+        *handle = NULL;
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+    /* Begin erasure of the update partition, progressive erase of the flash image API is disabled */
+    if (MENDER_OK != mender_flash_erase_start((mender_flash_handle_t *)*handle, size)) {
+        mender_log_error("Unable to erase the update partition");
+        mender_utils_free(*handle);
+        *handle = NULL;
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
 
     return MENDER_OK;
 }
@@ -52,26 +154,105 @@ mender_err_t
 mender_flash_write(void *handle, void *data, size_t index, size_t length) {
 
     (void)index;
-    int result;
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    int                    result;
 
     /* Check flash handle */
-    if (NULL == handle) {
+    if (NULL == flash_handle) {
         mender_log_error("Invalid flash handle");
         return MENDER_FAIL;
     }
 
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+    /* Data must be written to sectors already erased */
+    if (MENDER_OK != mender_flash_erase_wait(flash_handle, index + length)) {
+        mender_log_error("Unable to erase the update partition");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+#if CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0
+    /* Aggregate data received, only full buffers are written to the update partition */
+    while (length > 0) {
+
+        /* Write full buffers directly from the data received when nothing is pending */
+        size_t chunk;
+        if ((0 == flash_handle->length) && (length >= CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE)) {
+            chunk = length - (length % CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE);
+            if ((result = flash_img_buffered_write(&flash_handle->ctx, (const uint8_t *)data, chunk, false)) < 0) {
+                mender_log_error("flash_img_buffered_write failed (%d)", result);
+                return MENDER_FAIL;
+            }
+        } else {
+            chunk = CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE - flash_handle->length;
+            if (chunk > length) {
+                chunk = length;
+            }
+            memcpy(&flash_handle->buffer[flash_handle->length], data, chunk);
+            flash_handle->length += chunk;
+            if (CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE == flash_handle->length) {
+                if ((result = flash_img_buffered_write(&flash_handle->ctx, flash_handle->buffer, flash_handle->length, false)) < 0) {
+                    mender_log_error("flash_img_buffered_write failed (%d)", result);
+                    return MENDER_FAIL;
+                }
+                flash_handle->length = 0;
+            }
+        }
+        data = (uint8_t *)data + chunk;
+        length -= chunk;
+    }
+#else
     /* Write data received to the update partition */
-    if ((result = flash_img_buffered_write((struct flash_img_context *)handle, (const uint8_t *)data, length, false)) < 0) {
+    if ((result = flash_img_buffered_write(&flash_handle->ctx, (const uint8_t *)data, length, false)) < 0) {
         mender_log_error("flash_img_buffered_write failed (%d)", result);
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0 */
 
     return MENDER_OK;
 }
 
 mender_err_t
-mender_flash_close(void *handle) {
+mender_flash_write_erased(void *handle, size_t index, size_t length) {
+
+    (void)handle;
+    (void)index;
+    (void)length;
+
+    /* The run must be written, the flash image context writes the update partition sequentially */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_flash_read_running_image(void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
+    const struct flash_area *flash_area;
+    int                      result;
 
+    /* Open the running image partition */
+    if ((result = flash_area_open(FIXED_PARTITION_ID(slot0_partition), &flash_area)) < 0) {
+        mender_log_error("flash_area_open failed (%d)", result);
+        return MENDER_FAIL;
+    }
+
+    /* Read data from the running image partition */
+    if ((result = flash_area_read(flash_area, (off_t)index, data, length)) < 0) {
+        mender_log_error("flash_area_read failed (%d)", result);
+        flash_area_close(flash_area);
+        return MENDER_FAIL;
+    }
+
+    /* Close the running image partition */
+    flash_area_close(flash_area);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_read(void *handle, void *data, size_t index, size_t length) {
+
+    assert(NULL != data);
     int result;
 
     /* Check flash handle */
@@ -80,8 +261,45 @@ mender_flash_close(void *handle) {
         return MENDER_FAIL;
     }
 
-    /* Flush data received to the update partition */
-    if ((result = flash_img_buffered_write((struct flash_img_context *)handle, NULL, 0, true)) < 0) {
+    /* Read data from the update partition */
+    if ((result = flash_area_read(((mender_flash_handle_t *)handle)->ctx.flash_area, (off_t)index, data, length)) < 0) {
+        mender_log_error("flash_area_read failed (%d)", result);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_flash_close(void *handle) {
+
+    mender_flash_handle_t *flash_handle = (mender_flash_handle_t *)handle;
+    int                    result;
+
+    /* Check flash handle */
+    if (NULL == flash_handle) {
+        mender_log_error("Invalid flash handle");
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+    /* Wait the end of the erasure, the image trailer must be erased before the upgrade is requested */
+    if (MENDER_OK != mender_flash_erase_wait(flash_handle, SIZE_MAX)) {
+        mender_log_error("Unable to erase the update partition");
+        mender_flash_erase_stop(flash_handle);
+        return MENDER_FAIL;
+    }
+    mender_flash_erase_stop(flash_handle);
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
+    /* Flush data received to the update partition, including the tail of the data aggregated */
+#if CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0
+    result               = flash_img_buffered_write(&flash_handle->ctx, flash_handle->buffer, flash_handle->length, true);
+    flash_handle->length = 0;
+#else
+    result = flash_img_buffered_write(&flash_handle->ctx, NULL, 0, true);
+#endif /* CONFIG_MENDER_FLASH_WRITE_BUFFER_SIZE > 0 */
+    if (result < 0) {
         mender_log_error("flash_img_buffered_write failed (%d)", result);
         return MENDER_FAIL;
     }
@@ -104,7 +322,7 @@ mender_flash_set_pending_image(void *handle) {
         }
 
         /* Release memory */
-        free(handle);
+        mender_utils_free(handle);
     }
 
     return MENDER_OK;
@@ -116,8 +334,13 @@ mender_flash_abort_deployment(void *handle) {
     /* Check flash handle */
     if (NULL != handle) {
 
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+        /* Stop erasure of the update partition */
+        mender_flash_erase_stop((mender_flash_handle_t *)handle);
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
+
         /* Release memory */
-        free(handle);
+        mender_utils_free(handle);
     }
 
     return MENDER_OK;
@@ -148,3 +371,127 @@ mender_flash_is_image_confirmed(void) {
     /* Check if the image it still pending */
     return boot_is_img_confirmed();
 }
+
+#ifdef CONFIG_MENDER_FLASH_ERASE_AHEAD
+
+static mender_err_t
+mender_flash_erase_start(mender_flash_handle_t *flash_handle, size_t size) {
+
+    assert(NULL != flash_handle);
+    mender_flash_erase_t *erase = &flash_handle->erase;
+
+    /* Check size of the image */
+    if (size > flash_handle->ctx.flash_area->fa_size) {
+        mender_log_error("Image is too large for the update partition");
+        return MENDER_FAIL;
+    }
+    erase->size = size;
+    erase->ret  = MENDER_OK;
+
+#ifndef CONFIG_MENDER_CLIENT_FLASH_PIPELINE
+    /* Create the erase task, the task stack is used by the writer task of the flash pipeline otherwise */
+    mender_scheduler_task_params_t task_params = { .function = mender_flash_erase_task, .arg = flash_handle, .name = "mender_flash_erase" };
+    if (MENDER_OK == mender_scheduler_queue_create(1, sizeof(uint8_t), &erase->queue)) {
+        if (MENDER_OK != mender_scheduler_task_create(&task_params, &erase->task)) {
+            mender_scheduler_queue_delete(erase->queue);
+            erase->queue = NULL;
+        }
+    }
+    if (NULL == erase->task) {
+        mender_log_warning("Unable to create erase task, sectors are erased on demand");
+    }
+#endif /* CONFIG_MENDER_CLIENT_FLASH_PIPELINE */
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_flash_erase_next(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+    mender_flash_erase_t    *erase      = &flash_handle->erase;
+    const struct flash_area *flash_area = flash_handle->ctx.flash_area;
+    struct flash_pages_info  info;
+    off_t                    offset;
+    int                      result;
+
+    /* Retrieve the next sector, the image trailer is located in the last sector of the update partition */
+    offset = (erase->erased < erase->size) ? (off_t)erase->erased : (off_t)(flash_area->fa_size - 1);
+    if ((result = flash_get_page_info_by_offs(flash_area_get_device(flash_area), flash_area->fa_off + offset, &info)) < 0) {
+        mender_log_error("flash_get_page_info_by_offs failed (%d)", result);
+        return MENDER_FAIL;
+    }
+    offset = info.start_offset - flash_area->fa_off;
+
+    /* Erase the sector */
+    if ((result = flash_area_erase(flash_area, offset, info.size)) < 0) {
+        mender_log_error("flash_area_erase failed (%d)", result);
+        return MENDER_FAIL;
+    }
+
+    /* Update progress of the erasure */
+    if (erase->erased < erase->size) {
+        erase->erased = (size_t)offset + info.size;
+    }
+    if ((size_t)offset + info.size >= flash_area->fa_size) {
+        erase->trailer = true;
+    }
+    erase->done = ((erase->erased >= erase->size) && (true == erase->trailer));
+
+    return MENDER_OK;
+}
+
+static void
+mender_flash_erase_task(void *arg) {
+
+    assert(NULL != arg);
+    mender_flash_erase_t *erase        = &((mender_flash_handle_t *)arg)->erase;
+    uint8_t               notification = 0;
+
+    /* Erase the update partition sector by sector, the writer is notified after each sector */
+    while ((false == erase->done) && (false == erase->abort)) {
+        if (MENDER_OK != (erase->ret = mender_flash_erase_next((mender_flash_handle_t *)arg))) {
+            erase->done = true;
+        }
+        mender_scheduler_queue_send(erase->queue, &notification, 0);
+    }
+}
+
+static mender_err_t
+mender_flash_erase_wait(mender_flash_handle_t *flash_handle, size_t length) {
+
+    assert(NULL != flash_handle);
+    mender_flash_erase_t *erase = &flash_handle->erase;
+    uint8_t               notification;
+
+    /* Wait until the sectors are erased, or erase them if there is no erase task */
+    while ((false == erase->done) && ((SIZE_MAX == length) || ((erase->erased < length) && (erase->erased < erase->size)))) {
+        if (NULL != erase->task) {
+            mender_scheduler_queue_receive(erase->queue, &notification, MENDER_FLASH_ERASE_WAIT_DELAY);
+        } else if (MENDER_OK != (erase->ret = mender_flash_erase_next(flash_handle))) {
+            erase->done = true;
+        }
+    }
+
+    return erase->ret;
+}
+
+static void
+mender_flash_erase_stop(mender_flash_handle_t *flash_handle) {
+
+    assert(NULL != flash_handle);
+    mender_flash_erase_t *erase = &flash_handle->erase;
+
+    /* Stop the erase task and release it */
+    if (NULL != erase->task) {
+        erase->abort = true;
+        mender_scheduler_task_join(erase->task);
+        erase->task = NULL;
+    }
+    if (NULL != erase->queue) {
+        mender_scheduler_queue_delete(erase->queue);
+        erase->queue = NULL;
+    }
+}
+
+#endif /* CONFIG_MENDER_FLASH_ERASE_AHEAD */
@@ -18,7 +18,11 @@
  */
 
 #include <esp_log.h>
+#ifdef CONFIG_MENDER_LOG_TRACE
+#include "SEGGER_SYSVIEW.h"
+#endif /* CONFIG_MENDER_LOG_TRACE */
 #include "mender-log.h"
+#include "mender-log-buffer.h"
 
 mender_err_t
 mender_log_init(void) {
@@ -39,6 +43,13 @@ mender_log_print(uint8_t level, const char *filename, const char *function, int
     vsnprintf(log, sizeof(log), format, args);
     va_end(args);
 
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+    /* Save message to the log buffer, it is uploaded to the Mender server afterward */
+    mender_log_buffer_write(level, log, strlen(log));
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
     /* Switch depending log level */
     switch (level) {
         case MENDER_LOG_LEVEL_ERR:
@@ -60,6 +71,21 @@ mender_log_print(uint8_t level, const char *filename, const char *function, int
     return MENDER_OK;
 }
 
+#ifdef CONFIG_MENDER_LOG_TRACE
+
+void
+mender_log_trace(mender_log_trace_t trace, bool begin) {
+
+    /* Record a SystemView user event through app_trace, the ID of the user event is the trace point */
+    if (true == begin) {
+        SEGGER_SYSVIEW_OnUserStart((unsigned)trace);
+    } else {
+        SEGGER_SYSVIEW_OnUserStop((unsigned)trace);
+    }
+}
+
+#endif /* CONFIG_MENDER_LOG_TRACE */
+
 mender_err_t
 mender_log_exit(void) {
 
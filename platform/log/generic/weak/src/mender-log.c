@@ -17,6 +17,9 @@
  * limitations under the License.
  */
 
+#ifdef CONFIG_MENDER_LOG_TRACE_SYSTEMVIEW
+#include "SEGGER_SYSVIEW.h"
+#endif /* CONFIG_MENDER_LOG_TRACE_SYSTEMVIEW */
 #include "mender-log.h"
 
 __attribute__((weak)) mender_err_t
@@ -39,6 +42,32 @@ mender_log_print(uint8_t level, const char *filename, const char *function, int
     return MENDER_OK;
 }
 
+#ifdef CONFIG_MENDER_LOG_TRACE
+
+__attribute__((weak)) void
+mender_log_trace(mender_log_trace_t trace, bool begin) {
+
+#ifdef CONFIG_MENDER_LOG_TRACE_SYSTEMVIEW
+
+    /* Record a SystemView user event, the ID of the user event is the trace point */
+    if (true == begin) {
+        SEGGER_SYSVIEW_OnUserStart((unsigned)trace);
+    } else {
+        SEGGER_SYSVIEW_OnUserStop((unsigned)trace);
+    }
+
+#else
+
+    (void)trace;
+    (void)begin;
+
+    /* Nothing to do */
+
+#endif /* CONFIG_MENDER_LOG_TRACE_SYSTEMVIEW */
+}
+
+#endif /* CONFIG_MENDER_LOG_TRACE */
+
 __attribute__((weak)) mender_err_t
 mender_log_exit(void) {
 
@@ -18,12 +18,61 @@
  */
 
 #include <time.h>
+#ifdef CONFIG_MENDER_LOG_TRACE
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif /* CONFIG_MENDER_LOG_TRACE */
 #include "mender-log.h"
+#include "mender-log-buffer.h"
+
+#ifdef CONFIG_MENDER_LOG_TRACE
+
+/**
+ * @brief Default trace file, the Chrome trace event format is opened with Perfetto or chrome://tracing
+ */
+#ifndef CONFIG_MENDER_LOG_TRACE_FILE
+#define CONFIG_MENDER_LOG_TRACE_FILE "mender-trace.json"
+#endif /* CONFIG_MENDER_LOG_TRACE_FILE */
+
+/**
+ * @brief Names of the trace points
+ */
+static const char *mender_log_trace_names[MENDER_LOG_TRACE_COUNT] = { "authentication",
+                                                                      "sign",
+                                                                      "connect",
+                                                                      "tls_handshake",
+                                                                      "http_request",
+                                                                      "tar_header",
+                                                                      "payload_callback",
+                                                                      "flash_write",
+                                                                      "flash_close",
+                                                                      "flash_set_pending" };
+
+/**
+ * @brief Trace file, NULL if it is not opened, the events are separated by commas so that the mutex also protects the first event flag
+ */
+static FILE           *mender_log_trace_file  = NULL;
+static bool            mender_log_trace_first = true;
+static pthread_mutex_t mender_log_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#endif /* CONFIG_MENDER_LOG_TRACE */
 
 mender_err_t
 mender_log_init(void) {
 
-    /* Nothing to do */
+#ifdef CONFIG_MENDER_LOG_TRACE
+
+    /* Open the trace file, the events are appended to the JSON array until the log is released */
+    pthread_mutex_lock(&mender_log_trace_mutex);
+    if ((NULL == mender_log_trace_file) && (NULL != (mender_log_trace_file = fopen(CONFIG_MENDER_LOG_TRACE_FILE, "w")))) {
+        fputs("[\n", mender_log_trace_file);
+        mender_log_trace_first = true;
+    }
+    pthread_mutex_unlock(&mender_log_trace_mutex);
+
+#endif /* CONFIG_MENDER_LOG_TRACE */
+
     return MENDER_OK;
 }
 
@@ -43,6 +92,13 @@ mender_log_print(uint8_t level, const char *filename, const char *function, int
     vsnprintf(log, sizeof(log), format, args);
     va_end(args);
 
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+    /* Save message to the log buffer, it is uploaded to the Mender server afterward */
+    mender_log_buffer_write(level, log, strlen(log));
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
     /* Switch depending log level */
     switch (level) {
         case MENDER_LOG_LEVEL_ERR:
@@ -64,9 +120,49 @@ mender_log_print(uint8_t level, const char *filename, const char *function, int
     return MENDER_OK;
 }
 
+#ifdef CONFIG_MENDER_LOG_TRACE
+
+void
+mender_log_trace(mender_log_trace_t trace, bool begin) {
+
+    struct timespec now;
+
+    /* Get time, the monotonic clock is not affected by the adjustments of the system time */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* Append the event to the trace file, the timestamp is expressed in microseconds */
+    pthread_mutex_lock(&mender_log_trace_mutex);
+    if ((NULL != mender_log_trace_file) && (trace < MENDER_LOG_TRACE_COUNT)) {
+        fprintf(mender_log_trace_file,
+                "%s{\"name\":\"%s\",\"cat\":\"mender\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":%ld}",
+                (true == mender_log_trace_first) ? "" : ",\n",
+                mender_log_trace_names[trace],
+                (true == begin) ? 'B' : 'E',
+                (unsigned long long)now.tv_sec * 1000000 + (unsigned long long)now.tv_nsec / 1000,
+                (int)getpid(),
+                (long)syscall(SYS_gettid));
+        mender_log_trace_first = false;
+    }
+    pthread_mutex_unlock(&mender_log_trace_mutex);
+}
+
+#endif /* CONFIG_MENDER_LOG_TRACE */
+
 mender_err_t
 mender_log_exit(void) {
 
-    /* Nothing to do */
+#ifdef CONFIG_MENDER_LOG_TRACE
+
+    /* Close the trace file */
+    pthread_mutex_lock(&mender_log_trace_mutex);
+    if (NULL != mender_log_trace_file) {
+        fputs("\n]\n", mender_log_trace_file);
+        fclose(mender_log_trace_file);
+        mender_log_trace_file = NULL;
+    }
+    pthread_mutex_unlock(&mender_log_trace_mutex);
+
+#endif /* CONFIG_MENDER_LOG_TRACE */
+
     return MENDER_OK;
 }
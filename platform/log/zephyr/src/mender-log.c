@@ -19,8 +19,12 @@
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_REGISTER(mender, CONFIG_MENDER_LOG_LEVEL);
+#ifdef CONFIG_MENDER_LOG_TRACE
+#include <zephyr/tracing/tracing.h>
+#endif /* CONFIG_MENDER_LOG_TRACE */
 
 #include "mender-log.h"
+#include "mender-log-buffer.h"
 
 mender_err_t
 mender_log_init(void) {
@@ -41,6 +45,13 @@ mender_log_print(uint8_t level, const char *filename, const char *function, int
     vsnprintf(log, sizeof(log), format, args);
     va_end(args);
 
+#ifdef CONFIG_MENDER_LOG_BUFFER
+
+    /* Save message to the log buffer, it is uploaded to the Mender server afterward */
+    mender_log_buffer_write(level, log, strlen(log));
+
+#endif /* CONFIG_MENDER_LOG_BUFFER */
+
     /* Switch depending log level */
     switch (level) {
         case MENDER_LOG_LEVEL_ERR:
@@ -62,6 +73,17 @@ mender_log_print(uint8_t level, const char *filename, const char *function, int
     return MENDER_OK;
 }
 
+#ifdef CONFIG_MENDER_LOG_TRACE
+
+void
+mender_log_trace(mender_log_trace_t trace, bool begin) {
+
+    /* Record a named event, the trace point and its begin or end are given as arguments so that the tracing backend decodes them */
+    sys_trace_named_event((true == begin) ? "mender_trace_begin" : "mender_trace_end", (uint32_t)trace, 0);
+}
+
+#endif /* CONFIG_MENDER_LOG_TRACE */
+
 mender_err_t
 mender_log_exit(void) {
 
@@ -17,9 +17,23 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_HTTP
+
 #include <errno.h>
 #include <esp_http_client.h>
 #include <esp_crt_bundle.h>
+#ifdef CONFIG_MENDER_HTTP_RECV_BUF_SPIRAM
+#include <esp_heap_caps.h>
+#endif /* CONFIG_MENDER_HTTP_RECV_BUF_SPIRAM */
+#include <esp_timer.h>
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+#include <strings.h>
 #include "mender-http.h"
 #include "mender-log.h"
 #include "mender-utils.h"
@@ -30,15 +44,96 @@
 #define MENDER_HTTP_USER_AGENT "mender-mcu-client/" MENDER_CLIENT_VERSION " (mender-http) esp-idf/" IDF_VER
 
 /**
- * @brief Receive buffer length
+ * @brief Default receive buffer length (bytes)
+ */
+#ifndef CONFIG_MENDER_HTTP_RECV_BUF_LENGTH
+#define CONFIG_MENDER_HTTP_RECV_BUF_LENGTH (512)
+#endif /* CONFIG_MENDER_HTTP_RECV_BUF_LENGTH */
+
+/**
+ * @brief Default keep-alive idle timeout (seconds)
  */
-#define MENDER_HTTP_RECV_BUF_LENGTH (512)
+#ifndef CONFIG_MENDER_HTTP_KEEP_ALIVE_IDLE_TIMEOUT
+#define CONFIG_MENDER_HTTP_KEEP_ALIVE_IDLE_TIMEOUT (30)
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE_IDLE_TIMEOUT */
+
+/**
+ * @brief Default length of the payloads from which they are compressed (bytes)
+ */
+#ifndef CONFIG_MENDER_HTTP_GZIP_THRESHOLD
+#define CONFIG_MENDER_HTTP_GZIP_THRESHOLD (512)
+#endif /* CONFIG_MENDER_HTTP_GZIP_THRESHOLD */
 
 /**
  * @brief Mender HTTP configuration
  */
 static mender_http_config_t mender_http_config;
 
+/**
+ * @brief Statistics of the last request of the calling thread, the requests are performed concurrently when several workers are used
+ */
+static __thread mender_http_stats_t mender_http_stats;
+
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+/**
+ * @brief Client kept after a request, reused by the next request so that the connection to the host is kept open
+ */
+static struct {
+    esp_http_client_handle_t handle;    /**< Client, NULL if no client is kept or if a request is using it */
+    int64_t                  timestamp; /**< Time at the end of the last request (microseconds) */
+} mender_http_client;
+
+/**
+ * @brief Mutex protecting the client kept, the requests performed concurrently use their own client
+ */
+static StaticSemaphore_t mender_http_client_mutex_buffer;
+static SemaphoreHandle_t mender_http_client_mutex = NULL;
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+
+/**
+ * @brief Buffer used to return the ETag of the response
+ */
+typedef struct {
+    char  *etag;      /**< ETag buffer */
+    size_t etag_size; /**< Size of the ETag buffer */
+} mender_http_etag_t;
+
+/**
+ * @brief HTTP event handler, used to retrieve the ETag of the response
+ * @param evt HTTP client event
+ * @return ESP_OK
+ */
+static esp_err_t mender_http_event_handler(esp_http_client_event_t *evt);
+
+/**
+ * @brief Perform HTTP request
+ * @param jwt Token, NULL if not authenticated yet
+ * @param path Path of the request
+ * @param method Method
+ * @param payload Payload, NULL if empty
+ * @param signature Signature of the payload, NULL if it is not required
+ * @param offset Offset of the first byte requested, a "Range" header is added if it is not 0
+ * @param if_none_match Entity tag sent in the "If-None-Match" header, NULL or empty if not used
+ * @param etag Buffer used to return the "ETag" header of the response, NULL if not used
+ * @param etag_size Size of the etag buffer
+ * @param callback Callback invoked on HTTP events
+ * @param params Parameters passed to the callback, NULL if not used
+ * @param status Status code
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_perform_request(char                *jwt,
+                                                char                *path,
+                                                mender_http_method_t method,
+                                                char                *payload,
+                                                char                *signature,
+                                                size_t               offset,
+                                                char                *if_none_match,
+                                                char                *etag,
+                                                size_t               etag_size,
+                                                mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                                void *params,
+                                                int  *status);
+
 /**
  * @brief Convert mender HTTP method to ESP HTTP client method
  * @param method Mender HTTP method
@@ -46,6 +141,46 @@ static mender_http_config_t mender_http_config;
  */
 static esp_http_client_method_t mender_http_method_to_esp_http_client_method(mender_http_method_t method);
 
+/**
+ * @brief Set or remove a header of the request, headers of the previous request are removed when the client is reused
+ * @param client HTTP client
+ * @param key Header name
+ * @param value Header value, NULL to remove the header
+ */
+static void mender_http_set_header(esp_http_client_handle_t client, const char *key, const char *value);
+
+/**
+ * @brief Allocate the receive buffer, it is allocated in the external RAM if CONFIG_MENDER_HTTP_RECV_BUF_SPIRAM is enabled
+ * @return Receive buffer if the function succeeds, NULL otherwise
+ */
+static char *mender_http_recv_buf_alloc(void);
+
+/**
+ * @brief Release the receive buffer
+ * @param data Receive buffer
+ */
+static void mender_http_recv_buf_free(char *data);
+
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+/**
+ * @brief Take the client kept by the previous request and set the URL, a new client is initialized if none is kept or if it is used by another request
+ * @param config Client configuration, only used to initialize a new client
+ * @return HTTP client if the function succeeds, NULL otherwise
+ */
+static esp_http_client_handle_t mender_http_client_get(esp_http_client_config_t *config);
+
+/**
+ * @brief Give back the client of a request, it is kept for the next request if no other client is kept, released otherwise
+ * @param client HTTP client
+ */
+static void mender_http_client_put(esp_http_client_handle_t client);
+
+/**
+ * @brief Release the client kept and close its connection
+ */
+static void mender_http_client_release(void);
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+
 mender_err_t
 mender_http_init(mender_http_config_t *config) {
 
@@ -54,19 +189,34 @@ mender_http_init(mender_http_config_t *config) {
 
     /* Save configuration */
     memcpy(&mender_http_config, config, sizeof(mender_http_config_t));
+    if (0 == mender_http_config.recv_buf_length) {
+        mender_http_config.recv_buf_length = CONFIG_MENDER_HTTP_RECV_BUF_LENGTH;
+    }
+
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    /* Create the mutex protecting the client kept */
+    if ((NULL == mender_http_client_mutex) && (NULL == (mender_http_client_mutex = xSemaphoreCreateMutexStatic(&mender_http_client_mutex_buffer)))) {
+        mender_log_error("Unable to create mutex");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
 
     return MENDER_OK;
 }
 
-mender_err_t
-mender_http_perform(char                *jwt,
-                    char                *path,
-                    mender_http_method_t method,
-                    char                *payload,
-                    char                *signature,
-                    mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
-                    void *params,
-                    int  *status) {
+static mender_err_t
+mender_http_perform_request(char                *jwt,
+                            char                *path,
+                            mender_http_method_t method,
+                            char                *payload,
+                            char                *signature,
+                            size_t               offset,
+                            char                *if_none_match,
+                            char                *etag,
+                            size_t               etag_size,
+                            mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                            void *params,
+                            int  *status) {
 
     assert(NULL != path);
     assert(NULL != callback);
@@ -76,11 +226,25 @@ mender_http_perform(char                *jwt,
     esp_http_client_handle_t client = NULL;
     char                    *url    = NULL;
     char                    *bearer = NULL;
+    char                    *data   = NULL;
+    size_t                   payload_length = (NULL != payload) ? strlen(payload) : 0;
+    char                     range[sizeof("bytes=-") + 20];
+    mender_http_etag_t       response_etag = { .etag = etag, .etag_size = etag_size };
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    void *compressed = NULL;
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+    /* Reset statistics */
+    int64_t begin = esp_timer_get_time();
+    memset(&mender_http_stats, 0, sizeof(mender_http_stats_t));
+
+    /* Begin of the request */
+    mender_log_trace_begin(MENDER_LOG_TRACE_HTTP_REQUEST);
 
     /* Compute URL if required */
     if ((false == mender_utils_strbeginwith(path, "http://")) && (false == mender_utils_strbeginwith(path, "https://"))) {
         size_t str_length = strlen(mender_http_config.host) + strlen(path) + 1;
-        if (NULL == (url = (char *)malloc(str_length))) {
+        if (NULL == (url = (char *)mender_utils_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -89,35 +253,77 @@ mender_http_perform(char                *jwt,
     }
 
     /* Configuration of the client */
-    esp_http_client_config_t config
-        = { .url = (NULL != url) ? url : path, .user_agent = MENDER_HTTP_USER_AGENT, .crt_bundle_attach = esp_crt_bundle_attach, .buffer_size_tx = 2048 };
+    /* The event handler is always installed because it can not be changed when the client is reused, it does nothing without user data */
+    esp_http_client_config_t config = { .url               = (NULL != url) ? url : path,
+                                        .user_agent        = MENDER_HTTP_USER_AGENT,
+                                        .crt_bundle_attach = esp_crt_bundle_attach,
+                                        .buffer_size       = (int)mender_http_config.recv_buf_length,
+                                        .buffer_size_tx    = 2048,
+                                        .event_handler     = mender_http_event_handler };
+#if defined(CONFIG_MENDER_NET_TLS_SESSION_CACHE) && defined(CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS)
+    config.save_client_session = true;
+#endif /* CONFIG_MENDER_NET_TLS_SESSION_CACHE && CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS */
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    config.keep_alive_enable = true;
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
 
-    /* Initialization of the client */
-    if (NULL == (client = esp_http_client_init(&config))) {
+    /* Initialization of the client, or retrieval of the client kept by the previous request */
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    client = mender_http_client_get(&config);
+#else
+    client = esp_http_client_init(&config);
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+    if (NULL == client) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
+    if (NULL != etag) {
+        /* Retrieve the ETag of the response */
+        assert(etag_size > 0);
+        etag[0] = '\0';
+    }
+    esp_http_client_set_user_data(client, (NULL != etag) ? &response_etag : NULL);
     esp_http_client_set_method(client, mender_http_method_to_esp_http_client_method(method));
     if (NULL != jwt) {
         size_t str_length = strlen("Bearer ") + strlen(jwt) + 1;
-        if (NULL == (bearer = (char *)malloc(str_length))) {
+        if (NULL == (bearer = (char *)mender_utils_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
         }
         snprintf(bearer, str_length, "Bearer %s", jwt);
-        esp_http_client_set_header(client, "Authorization", bearer);
     }
-    if (NULL != signature) {
-        esp_http_client_set_header(client, "X-MEN-Signature", signature);
+    mender_http_set_header(client, "Authorization", bearer);
+    mender_http_set_header(client, "X-MEN-Signature", signature);
+    mender_http_set_header(client, "Content-Type", (NULL != payload) ? "application/json" : NULL);
+    mender_http_set_header(client, "Content-Encoding", NULL);
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    /* Compress large payloads, signed payloads are sent as is because the signature is verified on the data received by the server */
+    if ((NULL != payload) && (NULL == signature) && (payload_length >= CONFIG_MENDER_HTTP_GZIP_THRESHOLD)
+        && (MENDER_OK == mender_utils_gzip_compress(payload, payload_length, &compressed, &payload_length))) {
+        mender_http_set_header(client, "Content-Encoding", "gzip");
+        payload = (char *)compressed;
     }
-    if (NULL != payload) {
-        esp_http_client_set_header(client, "Content-Type", "application/json");
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+    if (0 != offset) {
+        snprintf(range, sizeof(range), "bytes=%zu-", offset);
     }
+    mender_http_set_header(client, "Range", (0 != offset) ? range : NULL);
+    mender_http_set_header(client, "If-None-Match", ((NULL != if_none_match) && ('\0' != if_none_match[0])) ? if_none_match : NULL);
 
-    /* Open HTTP client connection */
-    if (ESP_OK != (err = esp_http_client_open(client, (NULL != payload) ? (int)strlen(payload) : 0))) {
+    /* Open HTTP client connection, the trace point spans the connection and the TLS handshake which are not distinguished by the HTTP client */
+    mender_log_trace_begin(MENDER_LOG_TRACE_CONNECT);
+    err = esp_http_client_open(client, (int)payload_length);
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    if (ESP_OK != err) {
+        /* The connection kept may have been closed by the server, retry once with a new connection */
+        esp_http_client_close(client);
+        err = esp_http_client_open(client, (int)payload_length);
+    }
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+    mender_log_trace_end(MENDER_LOG_TRACE_CONNECT);
+    if (ESP_OK != err) {
         mender_log_error("Unable to open HTTP client connection: %s", esp_err_to_name(err));
         ret = MENDER_FAIL;
         goto END;
@@ -129,7 +335,7 @@ mender_http_perform(char                *jwt,
 
     /* Write data if payload is defined */
     if (NULL != payload) {
-        if (esp_http_client_write(client, payload, (int)strlen(payload)) < 0) {
+        if (esp_http_client_write(client, payload, (int)payload_length) < 0) {
             mender_log_error("Unable to write data");
             ret = MENDER_FAIL;
             goto END;
@@ -143,11 +349,17 @@ mender_http_perform(char                *jwt,
         goto END;
     }
 
+    /* Allocate receive buffer */
+    if (NULL == (data = mender_http_recv_buf_alloc())) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
     /* Read data until all have been received */
     do {
 
-        char data[MENDER_HTTP_RECV_BUF_LENGTH];
-        int  read_length = esp_http_client_read(client, data, sizeof(data));
+        int read_length = esp_http_client_read(client, data, (int)mender_http_config.recv_buf_length);
         if (read_length < 0) {
             mender_log_error("An error occured, unable to read data");
             callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
@@ -155,6 +367,8 @@ mender_http_perform(char                *jwt,
             goto END;
         } else if (read_length > 0) {
             /* Transmit data received to the upper layer */
+            mender_http_stats.length += (size_t)read_length;
+            mender_http_stats.fragments++;
             if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_DATA_RECEIVED, data, (size_t)read_length, params))) {
                 mender_log_error("An error occurred, stop reading data");
                 goto END;
@@ -178,27 +392,177 @@ mender_http_perform(char                *jwt,
 
 END:
 
-    /* Release memory */
+    /* Save statistics */
+    mender_http_stats.duration = (uint32_t)((esp_timer_get_time() - begin) / 1000);
+    mender_log_debug("Received %zu bytes in %zu fragments (mean %zu bytes) in %u ms",
+                     mender_http_stats.length,
+                     mender_http_stats.fragments,
+                     (0 != mender_http_stats.fragments) ? (mender_http_stats.length / mender_http_stats.fragments) : 0,
+                     (unsigned int)mender_http_stats.duration);
+
+    /* Release memory, the client is kept for the next request unless an error occurred */
+    mender_http_recv_buf_free(data);
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    if (NULL != client) {
+        if (MENDER_OK != ret) {
+            esp_http_client_close(client);
+        }
+        mender_http_client_put(client);
+    }
+#else
     if (NULL != client) {
         esp_http_client_cleanup(client);
     }
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
     if (NULL != bearer) {
-        free(bearer);
+        mender_utils_free(bearer);
     }
     if (NULL != url) {
-        free(url);
+        mender_utils_free(url);
     }
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    mender_utils_free(compressed);
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+    /* End of the request */
+    mender_log_trace_end(MENDER_LOG_TRACE_HTTP_REQUEST);
 
     return ret;
 }
 
+mender_err_t
+mender_http_perform(char                *jwt,
+                    char                *path,
+                    mender_http_method_t method,
+                    char                *payload,
+                    char                *signature,
+                    mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                    void *params,
+                    int  *status) {
+
+    /* Request the whole resource */
+    return mender_http_perform_request(jwt, path, method, payload, signature, 0, NULL, NULL, 0, callback, params, status);
+}
+
+mender_err_t
+mender_http_perform_range(char                *jwt,
+                          char                *path,
+                          mender_http_method_t method,
+                          char                *payload,
+                          char                *signature,
+                          size_t               offset,
+                          mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                          void *params,
+                          int  *status) {
+
+    /* Request the resource starting at the given offset */
+    return mender_http_perform_request(jwt, path, method, payload, signature, offset, NULL, NULL, 0, callback, params, status);
+}
+
+mender_err_t
+mender_http_perform_conditional(char                *jwt,
+                                char                *path,
+                                mender_http_method_t method,
+                                char                *payload,
+                                char                *signature,
+                                char                *if_none_match,
+                                char                *etag,
+                                size_t               etag_size,
+                                mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                void *params,
+                                int  *status) {
+
+    assert(NULL != etag);
+
+    /* Request the whole resource if it does not match the entity tag */
+    return mender_http_perform_request(jwt, path, method, payload, signature, 0, if_none_match, etag, etag_size, callback, params, status);
+}
+
+mender_err_t
+mender_http_async_start(char                *jwt,
+                        char                *path,
+                        mender_http_method_t method,
+                        char                *payload,
+                        char                *signature,
+                        mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                        void (*done)(mender_err_t, int, void *),
+                        void  *params,
+                        void **handle) {
+
+    (void)jwt;
+    (void)path;
+    (void)method;
+    (void)payload;
+    (void)signature;
+    (void)callback;
+    (void)done;
+    (void)params;
+    (void)handle;
+
+    /* Not supported, the HTTP client of ESP-IDF is blocking */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_http_async_poll(uint32_t timeout, size_t *count) {
+
+    (void)timeout;
+    (void)count;
+
+    /* Not supported, the HTTP client of ESP-IDF is blocking */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_http_async_cancel(void *handle) {
+
+    (void)handle;
+
+    /* Not supported, the HTTP client of ESP-IDF is blocking */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_http_get_stats(mender_http_stats_t *stats) {
+
+    assert(NULL != stats);
+
+    /* Return statistics of the last request */
+    memcpy(stats, &mender_http_stats, sizeof(mender_http_stats_t));
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_http_exit(void) {
 
-    /* Nothing to do */
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    /* Release the client kept */
+    mender_http_client_release();
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+
     return MENDER_OK;
 }
 
+static esp_err_t
+mender_http_event_handler(esp_http_client_event_t *evt) {
+
+    assert(NULL != evt);
+
+    /* Save the ETag, it is discarded if it is too long */
+    if ((HTTP_EVENT_ON_HEADER == evt->event_id) && (NULL != evt->user_data) && (NULL != evt->header_key) && (NULL != evt->header_value)
+        && (0 == strcasecmp(evt->header_key, "ETag"))) {
+        mender_http_etag_t *response_etag = (mender_http_etag_t *)evt->user_data;
+        if (strlen(evt->header_value) < response_etag->etag_size) {
+            strcpy(response_etag->etag, evt->header_value);
+        } else {
+            response_etag->etag[0] = '\0';
+        }
+    }
+
+    return ESP_OK;
+}
+
 static esp_http_client_method_t
 mender_http_method_to_esp_http_client_method(mender_http_method_t method) {
 
@@ -215,3 +579,109 @@ mender_http_method_to_esp_http_client_method(mender_http_method_t method) {
 
     return HTTP_METHOD_MAX;
 }
+
+static void
+mender_http_set_header(esp_http_client_handle_t client, const char *key, const char *value) {
+
+    assert(NULL != client);
+    assert(NULL != key);
+
+    /* Set or remove the header */
+    if (NULL != value) {
+        esp_http_client_set_header(client, key, value);
+    } else {
+        esp_http_client_delete_header(client, key);
+    }
+}
+
+static char *
+mender_http_recv_buf_alloc(void) {
+
+#ifdef CONFIG_MENDER_HTTP_RECV_BUF_SPIRAM
+    /* Allocate the receive buffer in the external RAM so that large buffers do not exhaust the internal RAM */
+    return (char *)heap_caps_malloc(mender_http_config.recv_buf_length, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+    return (char *)mender_utils_malloc(mender_http_config.recv_buf_length);
+#endif /* CONFIG_MENDER_HTTP_RECV_BUF_SPIRAM */
+}
+
+static void
+mender_http_recv_buf_free(char *data) {
+
+    /* Release the receive buffer */
+    if (NULL != data) {
+#ifdef CONFIG_MENDER_HTTP_RECV_BUF_SPIRAM
+        heap_caps_free(data);
+#else
+        mender_utils_free(data);
+#endif /* CONFIG_MENDER_HTTP_RECV_BUF_SPIRAM */
+    }
+}
+
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+static esp_http_client_handle_t
+mender_http_client_get(esp_http_client_config_t *config) {
+
+    assert(NULL != config);
+    esp_http_client_handle_t client;
+    int64_t                  timestamp;
+
+    /* Take the client kept, it is not shared with the requests performed concurrently */
+    xSemaphoreTake(mender_http_client_mutex, portMAX_DELAY);
+    client                    = mender_http_client.handle;
+    timestamp                 = mender_http_client.timestamp;
+    mender_http_client.handle = NULL;
+    xSemaphoreGive(mender_http_client_mutex);
+
+    /* Initialize a new client if none is kept */
+    if (NULL == client) {
+        return esp_http_client_init(config);
+    }
+
+    /* Close the connection if it has been idle for too long, it is probably closed by the server */
+    if (esp_timer_get_time() - timestamp >= (int64_t)CONFIG_MENDER_HTTP_KEEP_ALIVE_IDLE_TIMEOUT * 1000000) {
+        esp_http_client_close(client);
+    }
+
+    /* Set the URL, the connection is closed by the client if the host changes */
+    if (ESP_OK != esp_http_client_set_url(client, config->url)) {
+        esp_http_client_cleanup(client);
+        client = esp_http_client_init(config);
+    }
+
+    return client;
+}
+
+static void
+mender_http_client_put(esp_http_client_handle_t client) {
+
+    assert(NULL != client);
+
+    /* Keep the client for the next request, release it if another one is already kept */
+    xSemaphoreTake(mender_http_client_mutex, portMAX_DELAY);
+    if (NULL == mender_http_client.handle) {
+        mender_http_client.handle    = client;
+        mender_http_client.timestamp = esp_timer_get_time();
+        client                       = NULL;
+    }
+    xSemaphoreGive(mender_http_client_mutex);
+    if (NULL != client) {
+        esp_http_client_cleanup(client);
+    }
+}
+
+static void
+mender_http_client_release(void) {
+
+    /* Release the client, this closes the connection, nothing is kept if the module has not been initialized */
+    if (NULL == mender_http_client_mutex) {
+        return;
+    }
+    xSemaphoreTake(mender_http_client_mutex, portMAX_DELAY);
+    if (NULL != mender_http_client.handle) {
+        esp_http_client_cleanup(mender_http_client.handle);
+        mender_http_client.handle = NULL;
+    }
+    xSemaphoreGive(mender_http_client_mutex);
+}
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
@@ -17,10 +17,18 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_HTTP
+
 #include <esp_event.h>
 #include <esp_websocket_client.h>
 #include <esp_crt_bundle.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
 #include "mender-log.h"
+#include "mender-scheduler.h"
 #include "mender-utils.h"
 #include "mender-websocket.h"
 
@@ -52,6 +60,18 @@
 #define CONFIG_MENDER_WEBSOCKET_PING_INTERVAL (60)
 #endif /* CONFIG_MENDER_WEBSOCKET_PING_INTERVAL */
 
+/**
+ * @brief Default length of the send queue, 0 to send the messages from the calling task (bytes)
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH
+#define CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH (0)
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+
+/**
+ * @brief Interval at which the abort flag is checked while waiting for the messages of the send queue (milliseconds)
+ */
+#define MENDER_WEBSOCKET_SEND_QUEUE_WAIT (100)
+
 /**
  * @brief WebSocket User-Agent
  */
@@ -62,6 +82,11 @@
  */
 typedef struct {
     esp_websocket_client_handle_t client; /**< Websocket client handle */
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+    RingbufHandle_t               queue;  /**< Send queue */
+    void                         *task;   /**< Task sending the messages of the send queue */
+    bool                          abort;  /**< Flag used to indicate the task should be terminated */
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
     mender_err_t (*callback)(mender_websocket_client_event_t,
                              void *,
                              size_t,
@@ -83,6 +108,31 @@ static mender_websocket_config_t mender_websocket_config;
  */
 static void mender_websocket_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data);
 
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+
+/**
+ * @brief Append a message to the send queue, the segments are merged in a single frame
+ * @param handle Websocket handle
+ * @param segments Segments of the message
+ * @param count Number of segments
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue is full, error code otherwise
+ */
+static mender_err_t mender_websocket_queue_push(mender_websocket_handle_t *handle, mender_websocket_segment_t *segments, size_t count);
+
+/**
+ * @brief Task used to send the messages of the send queue, the task of the websocket client does not allow to perform it
+ * @param arg Websocket handle
+ */
+static void mender_websocket_queue_task(void *arg);
+
+/**
+ * @brief Stop the task sending the messages of the send queue and release the send queue
+ * @param handle Websocket handle
+ */
+static void mender_websocket_queue_stop(mender_websocket_handle_t *handle);
+
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+
 mender_err_t
 mender_websocket_init(mender_websocket_config_t *config) {
 
@@ -108,7 +158,7 @@ mender_websocket_connect(
     char        *bearer = NULL;
 
     /* Allocate a new handle */
-    if (NULL == (*handle = malloc(sizeof(mender_websocket_handle_t)))) {
+    if (NULL == (*handle = mender_utils_malloc(sizeof(mender_websocket_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -119,11 +169,25 @@ mender_websocket_connect(
     ((mender_websocket_handle_t *)*handle)->callback = callback;
     ((mender_websocket_handle_t *)*handle)->params   = params;
 
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+    /* Create the send queue and the task sending its messages, the connected callback may already send messages */
+    if (NULL == (((mender_websocket_handle_t *)*handle)->queue = xRingbufferCreate(CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH, RINGBUF_TYPE_NOSPLIT))) {
+        mender_log_error("Unable to create send queue");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    mender_scheduler_task_params_t task_params = { .function = mender_websocket_queue_task, .arg = *handle, .name = "mender_websocket" };
+    if (MENDER_OK != (ret = mender_scheduler_task_create(&task_params, &((mender_websocket_handle_t *)*handle)->task))) {
+        mender_log_error("Unable to create send queue task");
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+
     /* Compute URL if required */
     if ((false == mender_utils_strbeginwith(path, "ws://")) && (false == mender_utils_strbeginwith(path, "wss://"))) {
         if ((true == mender_utils_strbeginwith(path, "http://")) || (true == mender_utils_strbeginwith(mender_websocket_config.host, "http://"))) {
             size_t str_length = strlen(mender_websocket_config.host) - strlen("http://") + strlen("ws://") + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_utils_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -131,7 +195,7 @@ mender_websocket_connect(
             snprintf(url, str_length, "ws://%s%s", mender_websocket_config.host + strlen("http://"), path);
         } else if ((true == mender_utils_strbeginwith(path, "https://")) || (true == mender_utils_strbeginwith(mender_websocket_config.host, "https://"))) {
             size_t str_length = strlen(mender_websocket_config.host) - strlen("https://") + strlen("wss://") + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_utils_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -154,9 +218,12 @@ mender_websocket_connect(
     } else {
         config.transport = WEBSOCKET_TRANSPORT_UNKNOWN;
     }
+    if (0 != mender_websocket_config.recv_buf_length) {
+        config.buffer_size = (int)mender_websocket_config.recv_buf_length;
+    }
     if (NULL != jwt) {
         size_t str_length = strlen("Authorization: Bearer ") + strlen(jwt) + strlen("\r\n") + 1;
-        if (NULL == (bearer = (char *)malloc(str_length))) {
+        if (NULL == (bearer = (char *)mender_utils_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto END;
@@ -192,10 +259,13 @@ FAIL:
 
     /* Release memory */
     if (NULL != *handle) {
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+        mender_websocket_queue_stop((mender_websocket_handle_t *)*handle);
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
         if (NULL != ((mender_websocket_handle_t *)*handle)->client) {
             esp_websocket_client_destroy(((mender_websocket_handle_t *)*handle)->client);
         }
-        free(*handle);
+        mender_utils_free(*handle);
         *handle = NULL;
     }
 
@@ -203,10 +273,10 @@ END:
 
     /* Release memory */
     if (NULL != bearer) {
-        free(bearer);
+        mender_utils_free(bearer);
     }
     if (NULL != url) {
-        free(url);
+        mender_utils_free(url);
     }
 
     return ret;
@@ -218,6 +288,14 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
     assert(NULL != handle);
     assert(NULL != payload);
 
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+
+    /* Append the payload to the send queue, it is sent by the send queue task */
+    mender_websocket_segment_t segment = { .data = payload, .length = length };
+    return mender_websocket_queue_push((mender_websocket_handle_t *)handle, &segment, 1);
+
+#else
+
     /* Send binary payload */
     if (length
         != esp_websocket_client_send_bin(
@@ -227,6 +305,43 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
     }
 
     return MENDER_OK;
+
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+}
+
+mender_err_t
+mender_websocket_send_v(void *handle, mender_websocket_segment_t *segments, size_t count) {
+
+    assert(NULL != handle);
+    assert((NULL != segments) && (count > 0));
+
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+
+    /* Append the segments to the send queue, they are sent by the send queue task as a single frame */
+    return mender_websocket_queue_push((mender_websocket_handle_t *)handle, segments, count);
+
+#else
+
+    /* Send each segment as a fragment of the message, the first one is a binary frame and the next ones are continuation frames */
+    for (size_t index = 0; index < count; index++) {
+        ws_transport_opcodes_t opcode = (0 == index) ? WS_TRANSPORT_OPCODES_BINARY : WS_TRANSPORT_OPCODES_CONT;
+        if (index == count - 1) {
+            opcode |= WS_TRANSPORT_OPCODES_FIN;
+        }
+        if (segments[index].length
+            != esp_websocket_client_send_with_exact_opcode(((mender_websocket_handle_t *)handle)->client,
+                                                           opcode,
+                                                           segments[index].data,
+                                                           (int)segments[index].length,
+                                                           pdMS_TO_TICKS(CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT))) {
+            mender_log_error("Unable to send data over websocket connection");
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
 }
 
 mender_err_t
@@ -235,6 +350,11 @@ mender_websocket_disconnect(void *handle) {
     assert(NULL != handle);
     esp_err_t err;
 
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+    /* Stop sending the messages of the send queue, the remaining ones are dropped */
+    mender_websocket_queue_stop((mender_websocket_handle_t *)handle);
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+
     /* Close websocket connection */
     if (ESP_OK != (err = esp_websocket_client_close(((mender_websocket_handle_t *)handle)->client, pdMS_TO_TICKS(CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT)))) {
         mender_log_error("Unable to close websocket connection: %s", esp_err_to_name(err));
@@ -243,7 +363,7 @@ mender_websocket_disconnect(void *handle) {
 
     /* Release memory */
     esp_websocket_client_destroy(((mender_websocket_handle_t *)handle)->client);
-    free(handle);
+    mender_utils_free(handle);
 
     return MENDER_OK;
 }
@@ -311,3 +431,76 @@ mender_websocket_event_handler(void *handler_args, esp_event_base_t base, int32_
             break;
     }
 }
+
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+
+static mender_err_t
+mender_websocket_queue_push(mender_websocket_handle_t *handle, mender_websocket_segment_t *segments, size_t count) {
+
+    assert(NULL != handle);
+    assert((NULL != segments) && (count > 0));
+    uint8_t *item   = NULL;
+    size_t   length = 0;
+
+    /* Compute the length of the message */
+    for (size_t index = 0; index < count; index++) {
+        length += segments[index].length;
+    }
+    if (length > xRingbufferGetMaxItemSize(handle->queue)) {
+        mender_log_error("Message larger than the send queue, it is dropped");
+        return MENDER_FAIL;
+    }
+
+    /* Reserve the message in the send queue without waiting, the segments are then copied one after the other */
+    if (pdTRUE != xRingbufferSendAcquire(handle->queue, (void **)&item, length, 0)) {
+        return MENDER_BUSY;
+    }
+    for (size_t index = 0; index < count; index++) {
+        memcpy(item, segments[index].data, segments[index].length);
+        item += segments[index].length;
+    }
+    xRingbufferSendComplete(handle->queue, item - length);
+
+    return MENDER_OK;
+}
+
+static void
+mender_websocket_queue_task(void *arg) {
+
+    assert(NULL != arg);
+    mender_websocket_handle_t *handle = (mender_websocket_handle_t *)arg;
+    void                      *item;
+    size_t                     length;
+
+    /* Send the messages back-to-back until the connection is closed, the abort flag is checked periodically */
+    while (false == handle->abort) {
+        if (NULL != (item = xRingbufferReceive(handle->queue, &length, pdMS_TO_TICKS(MENDER_WEBSOCKET_SEND_QUEUE_WAIT)))) {
+            if ((int)length
+                != esp_websocket_client_send_bin(handle->client, (const char *)item, (int)length, pdMS_TO_TICKS(CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT))) {
+                mender_log_error("Unable to send data over websocket connection");
+            }
+            vRingbufferReturnItem(handle->queue, item);
+        }
+    }
+}
+
+static void
+mender_websocket_queue_stop(mender_websocket_handle_t *handle) {
+
+    assert(NULL != handle);
+
+    /* Wait end of execution of the send queue task */
+    if (NULL != handle->task) {
+        handle->abort = true;
+        mender_scheduler_task_join(handle->task);
+        handle->task = NULL;
+    }
+
+    /* Release the send queue */
+    if (NULL != handle->queue) {
+        vRingbufferDelete(handle->queue);
+        handle->queue = NULL;
+    }
+}
+
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
@@ -0,0 +1,52 @@
+/**
+ * @file      mender-net.h
+ * @brief     Mender network common file interface for curl platform
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MENDER_NET_H__
+#define __MENDER_NET_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <curl/curl.h>
+#include "mender-utils.h"
+
+/**
+ * @brief Initialize the share handle used by the HTTP and websocket clients, to be called by each client
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_net_init(void);
+
+/**
+ * @brief Returns the share handle keeping the DNS, connection and TLS session caches between the requests
+ * @return Share handle, NULL if not initialized
+ */
+CURLSH *mender_net_get_share(void);
+
+/**
+ * @brief Release the share handle when the last client is released
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_net_exit(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __MENDER_NET_H__ */
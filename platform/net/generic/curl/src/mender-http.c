@@ -17,9 +17,18 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_HTTP
+
 #include <curl/curl.h>
+#include <pthread.h>
+#include <strings.h>
+#include <time.h>
 #include "mender-http.h"
 #include "mender-log.h"
+#include "mender-net.h"
 #include "mender-utils.h"
 
 /**
@@ -31,19 +40,145 @@
 #define MENDER_HTTP_USER_AGENT "mender-mcu-client (mender-http) curl/" LIBCURL_VERSION
 #endif /* MENDER_CLIENT_VERSION */
 
+/**
+ * @brief Default length of the payloads from which they are compressed (bytes)
+ */
+#ifndef CONFIG_MENDER_HTTP_GZIP_THRESHOLD
+#define CONFIG_MENDER_HTTP_GZIP_THRESHOLD (512)
+#endif /* CONFIG_MENDER_HTTP_GZIP_THRESHOLD */
+
+#ifdef CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD
+
+/**
+ * @brief Default number of connections of the parallel downloads
+ */
+#ifndef CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS
+#define CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS (4)
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS */
+
+/**
+ * @brief Default size of the ranges of the parallel downloads, each connection keeps one range in memory (bytes)
+ */
+#ifndef CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE
+#define CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE (1048576)
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE */
+
+/**
+ * @brief Poll timeout of the parallel downloads (milliseconds)
+ */
+#define MENDER_HTTP_PARALLEL_DOWNLOAD_POLL_TIMEOUT (1000)
+
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD */
+
 /**
  * @brief User data
  */
 typedef struct {
     mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *); /**< Callback invoked on HTTP events */
-    void *params;                                                                 /**< Parameters passed to the callback, NULL if not used */
+    void                *params;                                                  /**< Parameters passed to the callback, NULL if not used */
+    char                *etag;                                                    /**< Buffer used to return the ETag of the response, NULL if not requested */
+    size_t               etag_size;                                               /**< Size of the ETag buffer */
+    mender_http_stats_t *stats;                                                   /**< Statistics of the request */
 } mender_http_curl_user_data_t;
 
+/**
+ * @brief Request, holds the resources which must be kept until the transfer is completed
+ */
+typedef struct {
+    CURL                        *curl;                    /**< Client handle */
+    mender_http_curl_user_data_t user_data;               /**< User data of the callbacks */
+    char                        *url;                     /**< URL of the request, NULL if the path is already an URL */
+    char                        *bearer;                  /**< Authorization header, NULL if not authenticated */
+    char                        *x_men_signature;         /**< Signature header, NULL if it is not required */
+    char                        *etag_header;             /**< If-None-Match header, NULL if not used */
+    struct curl_slist           *headers;                 /**< Headers of the request */
+    char                         range[sizeof("-") + 20]; /**< Range of the request */
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    void *compressed; /**< Compressed payload, NULL if the payload is sent as is */
+#endif                /* CONFIG_MENDER_HTTP_GZIP */
+} mender_http_curl_request_t;
+
+/**
+ * @brief Asynchronous request, performed by the multi handle
+ */
+typedef struct mender_http_async {
+    mender_http_curl_request_t request;      /**< Request */
+    char                      *payload;      /**< Copy of the payload, NULL if empty */
+    void (*done)(mender_err_t, int, void *); /**< Callback invoked when the request is completed */
+    mender_http_stats_t       stats;         /**< Statistics of the request */
+    struct mender_http_async *next;          /**< Next asynchronous request in progress */
+} mender_http_async_t;
+
+#ifdef CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD
+
+/**
+ * @brief Parallel download
+ */
+typedef struct mender_http_parallel_download mender_http_parallel_download_t;
+
+/**
+ * @brief Range of a parallel download, fetched by one of the connections
+ */
+typedef struct {
+    mender_http_parallel_download_t *download;  /**< Parallel download of the range */
+    CURL                            *curl;      /**< Client handle of the connection */
+    size_t                           index;     /**< Index of the range in the resource */
+    uint8_t                         *buffer;    /**< Data of the range, kept until the previous ranges have been given to the upper layer */
+    size_t                           length;    /**< Length of the data received */
+    size_t                           delivered; /**< Length of the data given to the upper layer */
+    bool                             active;    /**< The range is being fetched or waits to be given to the upper layer */
+    bool                             done;      /**< The range has been received completely */
+} mender_http_parallel_range_t;
+
+/**
+ * @brief Parallel download, the ranges are fetched concurrently and the data are reordered before they are given to the upper layer
+ */
+struct mender_http_parallel_download {
+    mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *); /**< Callback invoked on HTTP events */
+    void                        *params;                                           /**< Parameters passed to the callback, NULL if not used */
+    char                        *url;                                              /**< URL of the resource */
+    size_t                       offset;                                           /**< Offset of the first range in the resource */
+    size_t                       total;                                            /**< Length of the resource, 0 until it is known */
+    size_t                       next;                                             /**< Index of the next range to be fetched */
+    size_t                       current;                                          /**< Index of the range given to the upper layer */
+    bool                         connected;                                        /**< The connected event has been given to the upper layer */
+    bool                         fallback;   /**< The server does not return ranges, the resource is downloaded with a single request */
+    mender_err_t                 ret;        /**< Result of the download, the first error is kept */
+    mender_http_parallel_range_t ranges[CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS]; /**< Ranges fetched */
+};
+
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD */
+
 /**
  * @brief Mender HTTP configuration
  */
 static mender_http_config_t mender_http_config;
 
+/**
+ * @brief Client handle, kept between the requests so that its connection is reused, NULL while a request is using it
+ */
+static CURL *mender_http_curl = NULL;
+
+/**
+ * @brief Mutex protecting the client handle kept between the requests, the requests performed concurrently use their own client handle
+ */
+static pthread_mutex_t mender_http_curl_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Multi handle performing the asynchronous requests
+ */
+static CURLM *mender_http_multi = NULL;
+
+/**
+ * @brief Asynchronous requests in progress
+ */
+static mender_http_async_t *mender_http_async_list = NULL;
+
+/**
+ * @brief Statistics of the last request of the calling thread, the requests are performed concurrently when several workers are used
+ */
+static __thread mender_http_stats_t mender_http_stats;
+
 /**
  * @brief HTTP PREREQ callback, used to inform the client is connected to the server
  * @param params User data
@@ -65,6 +200,155 @@ static int mender_http_prereq_callback(void *params, char *conn_primary_ip, char
  */
 static size_t mender_http_write_callback(char *data, size_t size, size_t nmemb, void *params);
 
+/**
+ * @brief HTTP header callback, used to retrieve the ETag of the response
+ * @param data Header line from the server
+ * @param size Size of the data
+ * @param nmemb Number of element
+ * @param params User data
+ * @return Real size of data
+ */
+static size_t mender_http_header_callback(char *data, size_t size, size_t nmemb, void *params);
+
+/**
+ * @brief Take the client handle kept between the requests, a new client handle is allocated if it is used by another request
+ * @return Client handle if the function succeeds, NULL otherwise
+ */
+static CURL *mender_http_curl_take(void);
+
+/**
+ * @brief Give back a client handle, it is kept for the next request if no other client handle is kept, released otherwise
+ * @param curl Client handle
+ */
+static void mender_http_curl_give(CURL *curl);
+
+/**
+ * @brief Perform HTTP request
+ * @param jwt Token, NULL if not authenticated yet
+ * @param path Path of the request
+ * @param method Method
+ * @param payload Payload, NULL if empty
+ * @param signature Signature of the payload, NULL if it is not required
+ * @param offset Offset of the first byte requested, a "Range" header is added if it is not 0
+ * @param if_none_match Entity tag sent in the "If-None-Match" header, NULL or empty if not used
+ * @param etag Buffer used to return the "ETag" header of the response, NULL if not used
+ * @param etag_size Size of the etag buffer
+ * @param callback Callback invoked on HTTP events
+ * @param params Parameters passed to the callback, NULL if not used
+ * @param status Status code
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_perform_request(char                *jwt,
+                                                char                *path,
+                                                mender_http_method_t method,
+                                                char                *payload,
+                                                char                *signature,
+                                                size_t               offset,
+                                                char                *if_none_match,
+                                                char                *etag,
+                                                size_t               etag_size,
+                                                mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                                void *params,
+                                                int  *status);
+
+/**
+ * @brief Configure the client handle of a request, the resources allocated are kept in the request until it is released
+ * @param request Request, the client handle and the user data must be set
+ * @param jwt Token, NULL if not authenticated yet
+ * @param path Path of the request
+ * @param method Method
+ * @param payload Payload, NULL if empty, must be kept until the request is released
+ * @param signature Signature of the payload, NULL if it is not required
+ * @param offset Offset of the first byte requested, a "Range" header is added if it is not 0
+ * @param if_none_match Entity tag sent in the "If-None-Match" header, NULL or empty if not used
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_request_setup(mender_http_curl_request_t *request,
+                                              char                       *jwt,
+                                              char                       *path,
+                                              mender_http_method_t        method,
+                                              char                       *payload,
+                                              char                       *signature,
+                                              size_t                      offset,
+                                              char                       *if_none_match);
+
+/**
+ * @brief Release the resources of a request, the client handle is not released
+ * @param request Request
+ */
+static void mender_http_request_release(mender_http_curl_request_t *request);
+
+/**
+ * @brief Remove an asynchronous request from the multi handle and from the list of the requests in progress
+ * @param async Asynchronous request
+ */
+static void mender_http_async_remove(mender_http_async_t *async);
+
+/**
+ * @brief Release an asynchronous request
+ * @param async Asynchronous request
+ */
+static void mender_http_async_release(mender_http_async_t *async);
+
+#ifdef CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD
+
+/**
+ * @brief Download a resource starting at the given offset with several ranges fetched concurrently
+ * @param path Path of the resource
+ * @param offset Offset of the first byte requested
+ * @param callback Callback invoked on HTTP events, the data are given in sequence
+ * @param params Parameters passed to the callback, NULL if not used
+ * @param status Status code, same as the one of a single request of the resource
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the server does not return ranges, error code otherwise
+ */
+static mender_err_t mender_http_parallel_download(
+    char *path, size_t offset, mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *), void *params, int *status);
+
+/**
+ * @brief Start fetching the next range of the parallel download with an idle connection
+ * @param download Parallel download
+ * @param multi Multi handle
+ * @param range Range of the idle connection
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_parallel_start(mender_http_parallel_download_t *download, CURLM *multi, mender_http_parallel_range_t *range);
+
+/**
+ * @brief Give the data of the ranges to the upper layer in sequence, the ranges completely given are released
+ * @param download Parallel download
+ */
+static void mender_http_parallel_deliver(mender_http_parallel_download_t *download);
+
+/**
+ * @brief Expected length of a range of the parallel download, the last range is shorter
+ * @param download Parallel download
+ * @param index Index of the range
+ * @return Length of the range
+ */
+static size_t mender_http_parallel_range_length(mender_http_parallel_download_t *download, size_t index);
+
+/**
+ * @brief HTTP write callback of the ranges, the data are given directly to the upper layer if the range is the current one, buffered otherwise
+ * @param data Data from the server
+ * @param size Size of the data
+ * @param nmemb Number of element
+ * @param params Range
+ * @return Real size of data if the function succeeds, 0 otherwise
+ */
+static size_t mender_http_parallel_write_callback(char *data, size_t size, size_t nmemb, void *params);
+
+/**
+ * @brief HTTP header callback of the ranges, used to retrieve the length of the resource from the "Content-Range" header
+ * @param data Header line from the server
+ * @param size Size of the data
+ * @param nmemb Number of element
+ * @param params Range
+ * @return Real size of data
+ */
+static size_t mender_http_parallel_header_callback(char *data, size_t size, size_t nmemb, void *params);
+
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD */
+
 mender_err_t
 mender_http_init(mender_http_config_t *config) {
 
@@ -77,9 +361,118 @@ mender_http_init(mender_http_config_t *config) {
     /* Initialization of curl */
     curl_global_init(CURL_GLOBAL_DEFAULT);
 
+    /* Share DNS, connection and TLS session caches with the websocket client */
+    if (MENDER_OK != mender_net_init()) {
+        mender_log_error("Unable to initialize share handle");
+        return MENDER_FAIL;
+    }
+
+    /* Initialization of the client */
+    if (NULL == (mender_http_curl = curl_easy_init())) {
+        mender_log_error("Unable to allocate memory");
+        mender_net_exit();
+        return MENDER_FAIL;
+    }
+
+    /* Initialization of the multi handle of the asynchronous requests */
+    if (NULL == (mender_http_multi = curl_multi_init())) {
+        mender_log_error("Unable to allocate memory");
+        curl_easy_cleanup(mender_http_curl);
+        mender_http_curl = NULL;
+        mender_net_exit();
+        return MENDER_FAIL;
+    }
+
     return MENDER_OK;
 }
 
+static mender_err_t
+mender_http_perform_request(char                *jwt,
+                            char                *path,
+                            mender_http_method_t method,
+                            char                *payload,
+                            char                *signature,
+                            size_t               offset,
+                            char                *if_none_match,
+                            char                *etag,
+                            size_t               etag_size,
+                            mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                            void *params,
+                            int  *status) {
+
+    assert(NULL != path);
+    assert(NULL != callback);
+    assert(NULL != status);
+    CURLcode                   err;
+    mender_err_t               ret;
+    mender_http_curl_request_t request = {
+        .user_data = { .callback = callback, .params = params, .etag = etag, .etag_size = etag_size, .stats = &mender_http_stats },
+    };
+    struct timespec            begin, end;
+
+    /* Reset statistics */
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    memset(&mender_http_stats, 0, sizeof(mender_http_stats_t));
+
+    /* Begin of the request */
+    mender_log_trace_begin(MENDER_LOG_TRACE_HTTP_REQUEST);
+
+    /* Take the client handle, it is not shared with the requests performed concurrently */
+    if (NULL == (request.curl = mender_http_curl_take())) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Configuration of the client, the connection, DNS and TLS session caches are kept */
+    if (MENDER_OK != (ret = mender_http_request_setup(&request, jwt, path, method, payload, signature, offset, if_none_match))) {
+        goto END;
+    }
+
+    /* Perform request */
+    if (CURLE_OK != (err = curl_easy_perform(request.curl))) {
+        mender_log_error("Unable to perform HTTP request: %s", curl_easy_strerror(err));
+        callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Read HTTP status code */
+    long response_code;
+    if (CURLE_OK != (err = curl_easy_getinfo(request.curl, CURLINFO_RESPONSE_CODE, &response_code))) {
+        mender_log_error("Unable to read HTTP response code: %s", curl_easy_strerror(err));
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    *status = (int)response_code;
+    if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_DISCONNECTED, NULL, 0, params))) {
+        mender_log_error("An error occurred");
+        goto END;
+    }
+
+END:
+
+    /* Save statistics */
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    mender_http_stats.duration = (uint32_t)((end.tv_sec - begin.tv_sec) * 1000 + (end.tv_nsec - begin.tv_nsec) / 1000000);
+    mender_log_debug("Received %zu bytes in %zu fragments (mean %zu bytes) in %u ms",
+                     mender_http_stats.length,
+                     mender_http_stats.fragments,
+                     (0 != mender_http_stats.fragments) ? (mender_http_stats.length / mender_http_stats.fragments) : 0,
+                     (unsigned int)mender_http_stats.duration);
+
+    /* Release memory, the client handle is given back for the next request */
+    mender_http_request_release(&request);
+    if (NULL != request.curl) {
+        mender_http_curl_give(request.curl);
+    }
+
+    /* End of the request */
+    mender_log_trace_end(MENDER_LOG_TRACE_HTTP_REQUEST);
+
+    return ret;
+}
+
 mender_err_t
 mender_http_perform(char                *jwt,
                     char                *path,
@@ -90,123 +483,647 @@ mender_http_perform(char                *jwt,
                     void *params,
                     int  *status) {
 
+    /* Request the whole resource */
+    return mender_http_perform_request(jwt, path, method, payload, signature, 0, NULL, NULL, 0, callback, params, status);
+}
+
+mender_err_t
+mender_http_perform_range(char                *jwt,
+                          char                *path,
+                          mender_http_method_t method,
+                          char                *payload,
+                          char                *signature,
+                          size_t               offset,
+                          mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                          void *params,
+                          int  *status) {
+
+#ifdef CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD
+    /* Download the resource with concurrent ranges if it is not authenticated, a single request is used if the server does not return ranges */
+    if ((NULL == jwt) && (MENDER_HTTP_GET == method) && (NULL == payload) && (NULL == signature)) {
+        mender_err_t ret = mender_http_parallel_download(path, offset, callback, params, status);
+        if (MENDER_NOT_FOUND != ret) {
+            return ret;
+        }
+        mender_log_warning("Ranges are not supported by the server, downloading with a single request");
+    }
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD */
+
+    /* Request the resource starting at the given offset */
+    return mender_http_perform_request(jwt, path, method, payload, signature, offset, NULL, NULL, 0, callback, params, status);
+}
+
+mender_err_t
+mender_http_perform_conditional(char                *jwt,
+                                char                *path,
+                                mender_http_method_t method,
+                                char                *payload,
+                                char                *signature,
+                                char                *if_none_match,
+                                char                *etag,
+                                size_t               etag_size,
+                                mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                void *params,
+                                int  *status) {
+
+    assert(NULL != etag);
+
+    /* Request the whole resource if it does not match the entity tag */
+    return mender_http_perform_request(jwt, path, method, payload, signature, 0, if_none_match, etag, etag_size, callback, params, status);
+}
+
+mender_err_t
+mender_http_async_start(char                *jwt,
+                        char                *path,
+                        mender_http_method_t method,
+                        char                *payload,
+                        char                *signature,
+                        mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                        void (*done)(mender_err_t, int, void *),
+                        void  *params,
+                        void **handle) {
+
     assert(NULL != path);
     assert(NULL != callback);
-    assert(NULL != status);
-    CURLcode           err;
-    mender_err_t       ret             = MENDER_OK;
-    CURL              *curl            = NULL;
-    char              *url             = NULL;
-    char              *bearer          = NULL;
-    char              *x_men_signature = NULL;
-    struct curl_slist *headers         = NULL;
+    assert(NULL != handle);
+    mender_err_t         ret;
+    mender_http_async_t *async;
+
+    /* Allocate the request, the payload is copied because it is sent once the function has returned */
+    if (NULL == (async = (mender_http_async_t *)mender_utils_calloc(1, sizeof(mender_http_async_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    async->done                       = done;
+    async->request.user_data.callback = callback;
+    async->request.user_data.params   = params;
+    async->request.user_data.stats    = &async->stats;
+    if ((NULL != payload) && (NULL == (async->payload = mender_utils_strdup(payload)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+
+    /* Configuration of the client, each request uses its own client handle */
+    if (NULL == (async->request.curl = curl_easy_init())) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (MENDER_OK != (ret = mender_http_request_setup(&async->request, jwt, path, method, async->payload, signature, 0, NULL))) {
+        goto FAIL;
+    }
+    curl_easy_setopt(async->request.curl, CURLOPT_PRIVATE, (char *)async);
+
+    /* Start the transfer, it is performed by mender_http_async_poll */
+    if (CURLM_OK != curl_multi_add_handle(mender_http_multi, async->request.curl)) {
+        mender_log_error("Unable to start HTTP request");
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    async->next            = mender_http_async_list;
+    mender_http_async_list = async;
+    *handle                = async;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    mender_http_async_release(async);
+
+    return ret;
+}
+
+mender_err_t
+mender_http_async_poll(uint32_t timeout, size_t *count) {
+
+    CURLMcode mcode;
+    CURLMsg  *msg;
+    int       running, queued;
+
+    /* Wait for network activity, then perform the transfers */
+    if ((CURLM_OK != (mcode = curl_multi_poll(mender_http_multi, NULL, 0, (int)timeout, NULL)))
+        || (CURLM_OK != (mcode = curl_multi_perform(mender_http_multi, &running)))) {
+        mender_log_error("Unable to perform HTTP requests: %s", curl_multi_strerror(mcode));
+        return MENDER_FAIL;
+    }
+
+    /* Complete the requests done, they are released once the done callback has returned */
+    while (NULL != (msg = curl_multi_info_read(mender_http_multi, &queued))) {
+        if (CURLMSG_DONE != msg->msg) {
+            continue;
+        }
+        mender_http_async_t *async  = NULL;
+        CURLcode             result = msg->data.result;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&async);
+        mender_http_async_remove(async);
+        mender_err_t ret;
+        long         response_code = 0;
+        if (CURLE_OK != result) {
+            mender_log_error("Unable to perform HTTP request: %s", curl_easy_strerror(result));
+            async->request.user_data.callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, async->request.user_data.params);
+            ret = MENDER_FAIL;
+        } else {
+            curl_easy_getinfo(async->request.curl, CURLINFO_RESPONSE_CODE, &response_code);
+            if (MENDER_OK != (ret = async->request.user_data.callback(MENDER_HTTP_EVENT_DISCONNECTED, NULL, 0, async->request.user_data.params))) {
+                mender_log_error("An error occurred");
+            }
+        }
+        mender_log_debug("Received %zu bytes in %zu fragments", async->stats.length, async->stats.fragments);
+        if (NULL != async->done) {
+            async->done(ret, (int)response_code, async->request.user_data.params);
+        }
+        mender_http_async_release(async);
+    }
+
+    /* Return the number of requests in progress */
+    if (NULL != count) {
+        *count = 0;
+        for (mender_http_async_t *async = mender_http_async_list; NULL != async; async = async->next) {
+            (*count)++;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_http_async_cancel(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Stop the transfer and release the request */
+    mender_http_async_remove((mender_http_async_t *)handle);
+    mender_http_async_release((mender_http_async_t *)handle);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_http_get_stats(mender_http_stats_t *stats) {
+
+    assert(NULL != stats);
+
+    /* Return statistics of the last request */
+    memcpy(stats, &mender_http_stats, sizeof(mender_http_stats_t));
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_http_exit(void) {
+
+    /* Cleaning, the asynchronous requests in progress are cancelled */
+    while (NULL != mender_http_async_list) {
+        mender_http_async_cancel(mender_http_async_list);
+    }
+    if (NULL != mender_http_multi) {
+        curl_multi_cleanup(mender_http_multi);
+        mender_http_multi = NULL;
+    }
+    pthread_mutex_lock(&mender_http_curl_mutex);
+    if (NULL != mender_http_curl) {
+        curl_easy_cleanup(mender_http_curl);
+        mender_http_curl = NULL;
+    }
+    pthread_mutex_unlock(&mender_http_curl_mutex);
+    mender_net_exit();
+    curl_global_cleanup();
+
+    return MENDER_OK;
+}
+
+static CURL *
+mender_http_curl_take(void) {
+
+    CURL *curl;
+
+    /* Take the client handle kept, or allocate a new one if it is used by another request */
+    pthread_mutex_lock(&mender_http_curl_mutex);
+    curl             = mender_http_curl;
+    mender_http_curl = NULL;
+    pthread_mutex_unlock(&mender_http_curl_mutex);
+    if (NULL == curl) {
+        curl = curl_easy_init();
+    }
+
+    return curl;
+}
+
+static void
+mender_http_curl_give(CURL *curl) {
+
+    assert(NULL != curl);
+
+    /* Keep the client handle for the next request, release it if another one is already kept */
+    pthread_mutex_lock(&mender_http_curl_mutex);
+    if (NULL == mender_http_curl) {
+        mender_http_curl = curl;
+        curl             = NULL;
+    }
+    pthread_mutex_unlock(&mender_http_curl_mutex);
+    if (NULL != curl) {
+        curl_easy_cleanup(curl);
+    }
+}
+
+static int
+mender_http_prereq_callback(void *params, char *conn_primary_ip, char *conn_local_ip, int conn_primary_port, int conn_local_port) {
+
+    assert(NULL != params);
+    mender_http_curl_user_data_t *user_data = (mender_http_curl_user_data_t *)params;
+    (void)conn_primary_ip;
+    (void)conn_local_ip;
+    (void)conn_primary_port;
+    (void)conn_local_port;
+
+    /* Invoke callback */
+    if (MENDER_OK != user_data->callback(MENDER_HTTP_EVENT_CONNECTED, NULL, 0, user_data->params)) {
+        mender_log_error("An error occurred");
+        return CURL_PREREQFUNC_ABORT;
+    }
+
+    return CURL_PREREQFUNC_OK;
+}
+
+static size_t
+mender_http_write_callback(char *data, size_t size, size_t nmemb, void *params) {
+
+    assert(NULL != params);
+    mender_http_curl_user_data_t *user_data = (mender_http_curl_user_data_t *)params;
+    size_t                        realsize  = size * nmemb;
+
+    /* Transmit data received to the upper layer */
+    if (realsize > 0) {
+        user_data->stats->length += realsize;
+        user_data->stats->fragments++;
+        if (MENDER_OK != user_data->callback(MENDER_HTTP_EVENT_DATA_RECEIVED, (void *)data, realsize, user_data->params)) {
+            mender_log_error("An error occurred, stop reading data");
+            return -1;
+        }
+    }
+
+    return realsize;
+}
+
+static size_t
+mender_http_header_callback(char *data, size_t size, size_t nmemb, void *params) {
+
+    assert(NULL != params);
+    mender_http_curl_user_data_t *user_data = (mender_http_curl_user_data_t *)params;
+    size_t                        realsize  = size * nmemb;
+
+    /* Check if the line is the ETag header, the value is trimmed */
+    if ((realsize > strlen("ETag:")) && (0 == strncasecmp(data, "ETag:", strlen("ETag:")))) {
+        size_t begin = strlen("ETag:");
+        size_t end   = realsize;
+        while ((begin < end) && ((' ' == data[begin]) || ('\t' == data[begin]))) {
+            begin++;
+        }
+        while ((end > begin) && ((' ' == data[end - 1]) || ('\t' == data[end - 1]) || ('\r' == data[end - 1]) || ('\n' == data[end - 1]))) {
+            end--;
+        }
+        /* Save the ETag, it is discarded if it is too long */
+        if (end - begin < user_data->etag_size) {
+            memcpy(user_data->etag, &data[begin], end - begin);
+            user_data->etag[end - begin] = '\0';
+        } else {
+            user_data->etag[0] = '\0';
+        }
+    }
+
+    return realsize;
+}
+
+static mender_err_t
+mender_http_request_setup(mender_http_curl_request_t *request,
+                          char                       *jwt,
+                          char                       *path,
+                          mender_http_method_t        method,
+                          char                       *payload,
+                          char                       *signature,
+                          size_t                      offset,
+                          char                       *if_none_match) {
+
+    assert(NULL != request);
+    assert(NULL != request->curl);
+    assert(NULL != path);
+    CURLcode err;
+    size_t   payload_length = (NULL != payload) ? strlen(payload) : 0;
 
     /* Compute URL if required */
     if ((false == mender_utils_strbeginwith(path, "http://")) && (false == mender_utils_strbeginwith(path, "https://"))) {
         size_t str_length = strlen(mender_http_config.host) + strlen(path) + 1;
-        if (NULL == (url = (char *)malloc(str_length))) {
+        if (NULL == (request->url = (char *)mender_utils_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto END;
+            return MENDER_FAIL;
         }
-        snprintf(url, str_length, "%s%s", mender_http_config.host, path);
+        snprintf(request->url, str_length, "%s%s", mender_http_config.host, path);
     }
 
-    /* Initialization of the client */
-    if (NULL == (curl = curl_easy_init())) {
-        mender_log_error("Unable to allocate memory");
-        ret = MENDER_FAIL;
-        goto END;
-    }
+    /* Reset options of the previous request */
+    curl_easy_reset(request->curl);
 
     /* Configuration of the client */
-    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_URL, (NULL != url) ? url : path))) {
+    if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_URL, (NULL != request->url) ? request->url : path))) {
         mender_log_error("Unable to set HTTP URL: %s", curl_easy_strerror(err));
-        ret = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
     }
-    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_USERAGENT, MENDER_HTTP_USER_AGENT))) {
+    if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_USERAGENT, MENDER_HTTP_USER_AGENT))) {
         mender_log_error("Unable to set HTTP User-Agent: %s", curl_easy_strerror(err));
-        ret = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
     }
-    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2))) {
+    if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2))) {
         mender_log_error("Unable to set TLSv1.2: %s", curl_easy_strerror(err));
-        ret = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
+    }
+    if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_SHARE, mender_net_get_share()))) {
+        mender_log_error("Unable to set HTTP share handle: %s", curl_easy_strerror(err));
+        return MENDER_FAIL;
+    }
+    if (0 != mender_http_config.recv_buf_length) {
+        if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_BUFFERSIZE, (long)mender_http_config.recv_buf_length))) {
+            mender_log_error("Unable to set HTTP receive buffer size: %s", curl_easy_strerror(err));
+            return MENDER_FAIL;
+        }
     }
-    mender_http_curl_user_data_t user_data = { .callback = callback, .params = params };
-    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_PREREQFUNCTION, &mender_http_prereq_callback))) {
+    if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_PREREQFUNCTION, &mender_http_prereq_callback))) {
         mender_log_error("Unable to set HTTP PREREQ function: %s", curl_easy_strerror(err));
-        ret = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
     }
-    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_PREREQDATA, &user_data))) {
+    if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_PREREQDATA, &request->user_data))) {
         mender_log_error("Unable to set HTTP PREREQ data: %s", curl_easy_strerror(err));
-        ret = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
     }
-    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &mender_http_write_callback))) {
+    if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_WRITEFUNCTION, &mender_http_write_callback))) {
         mender_log_error("Unable to set HTTP write function: %s", curl_easy_strerror(err));
-        ret = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
     }
-    if (CURLE_OK != (err = curl_easy_setopt(curl, CURLOPT_WRITEDATA, &user_data))) {
+    if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_WRITEDATA, &request->user_data))) {
         mender_log_error("Unable to set HTTP write data: %s", curl_easy_strerror(err));
-        ret = MENDER_FAIL;
-        goto END;
+        return MENDER_FAIL;
+    }
+    if (NULL != request->user_data.etag) {
+        assert(request->user_data.etag_size > 0);
+        request->user_data.etag[0] = '\0';
+        if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_HEADERFUNCTION, &mender_http_header_callback))) {
+            mender_log_error("Unable to set HTTP header function: %s", curl_easy_strerror(err));
+            return MENDER_FAIL;
+        }
+        if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_HEADERDATA, &request->user_data))) {
+            mender_log_error("Unable to set HTTP header data: %s", curl_easy_strerror(err));
+            return MENDER_FAIL;
+        }
     }
     if (NULL != jwt) {
         size_t str_length = strlen("Authorization: Bearer ") + strlen(jwt) + 1;
-        if (NULL == (bearer = (char *)malloc(str_length))) {
+        if (NULL == (request->bearer = (char *)mender_utils_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto END;
+            return MENDER_FAIL;
         }
-        snprintf(bearer, str_length, "Authorization: Bearer %s", jwt);
-        headers = curl_slist_append(headers, bearer);
+        snprintf(request->bearer, str_length, "Authorization: Bearer %s", jwt);
+        request->headers = curl_slist_append(request->headers, request->bearer);
     }
     if (NULL != signature) {
         size_t str_length = strlen("X-MEN-Signature: ") + strlen(signature) + 1;
-        if (NULL == (x_men_signature = (char *)malloc(str_length))) {
+        if (NULL == (request->x_men_signature = (char *)mender_utils_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
-            ret = MENDER_FAIL;
-            goto END;
+            return MENDER_FAIL;
         }
-        snprintf(x_men_signature, str_length, "X-MEN-Signature: %s", signature);
-        headers = curl_slist_append(headers, x_men_signature);
+        snprintf(request->x_men_signature, str_length, "X-MEN-Signature: %s", signature);
+        request->headers = curl_slist_append(request->headers, request->x_men_signature);
     }
     if (NULL != payload) {
-        headers = curl_slist_append(headers, "Content-Type: application/json");
+        request->headers = curl_slist_append(request->headers, "Content-Type: application/json");
+#ifdef CONFIG_MENDER_HTTP_GZIP
+        /* Compress large payloads, signed payloads are sent as is because the signature is verified on the data received by the server */
+        if ((NULL == signature) && (payload_length >= CONFIG_MENDER_HTTP_GZIP_THRESHOLD)
+            && (MENDER_OK == mender_utils_gzip_compress(payload, payload_length, &request->compressed, &payload_length))) {
+            request->headers = curl_slist_append(request->headers, "Content-Encoding: gzip");
+            payload = (char *)request->compressed;
+        }
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+    }
+    if ((NULL != if_none_match) && ('\0' != if_none_match[0])) {
+        size_t str_length = strlen("If-None-Match: ") + strlen(if_none_match) + 1;
+        if (NULL == (request->etag_header = (char *)mender_utils_malloc(str_length))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        snprintf(request->etag_header, str_length, "If-None-Match: %s", if_none_match);
+        request->headers = curl_slist_append(request->headers, request->etag_header);
     }
-    if (NULL != headers) {
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    if (NULL != request->headers) {
+        curl_easy_setopt(request->curl, CURLOPT_HTTPHEADER, request->headers);
+    }
+    if (0 != offset) {
+        snprintf(request->range, sizeof(request->range), "%zu-", offset);
+        if (CURLE_OK != (err = curl_easy_setopt(request->curl, CURLOPT_RANGE, request->range))) {
+            mender_log_error("Unable to set HTTP range: %s", curl_easy_strerror(err));
+            return MENDER_FAIL;
+        }
     }
 
     /* Write data if payload is defined */
     if (NULL != payload) {
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
+        curl_easy_setopt(request->curl, CURLOPT_POSTFIELDSIZE, (long)payload_length);
+        curl_easy_setopt(request->curl, CURLOPT_POSTFIELDS, payload);
         if (MENDER_HTTP_PUT == method) {
-            curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+            curl_easy_setopt(request->curl, CURLOPT_CUSTOMREQUEST, "PUT");
+        } else if (MENDER_HTTP_PATCH == method) {
+            curl_easy_setopt(request->curl, CURLOPT_CUSTOMREQUEST, "PATCH");
         }
     }
 
-    /* Perform request */
-    if (CURLE_OK != (err = curl_easy_perform(curl))) {
-        mender_log_error("Unable to perform HTTP request: %s", curl_easy_strerror(err));
-        callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+    return MENDER_OK;
+}
+
+static void
+mender_http_request_release(mender_http_curl_request_t *request) {
+
+    assert(NULL != request);
+
+    /* Release memory */
+    if (NULL != request->headers) {
+        curl_slist_free_all(request->headers);
+    }
+    if (NULL != request->etag_header) {
+        mender_utils_free(request->etag_header);
+    }
+    if (NULL != request->x_men_signature) {
+        mender_utils_free(request->x_men_signature);
+    }
+    if (NULL != request->bearer) {
+        mender_utils_free(request->bearer);
+    }
+    if (NULL != request->url) {
+        mender_utils_free(request->url);
+    }
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    mender_utils_free(request->compressed);
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+}
+
+static void
+mender_http_async_remove(mender_http_async_t *async) {
+
+    assert(NULL != async);
+
+    /* Stop the transfer and remove the request from the list */
+    curl_multi_remove_handle(mender_http_multi, async->request.curl);
+    for (mender_http_async_t **item = &mender_http_async_list; NULL != *item; item = &(*item)->next) {
+        if (async == *item) {
+            *item = async->next;
+            break;
+        }
+    }
+    async->next = NULL;
+}
+
+static void
+mender_http_async_release(mender_http_async_t *async) {
+
+    assert(NULL != async);
+
+    /* Release memory */
+    mender_http_request_release(&async->request);
+    if (NULL != async->request.curl) {
+        curl_easy_cleanup(async->request.curl);
+    }
+    mender_utils_free(async->payload);
+    mender_utils_free(async);
+}
+
+#ifdef CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD
+
+static mender_err_t
+mender_http_parallel_download(
+    char *path, size_t offset, mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *), void *params, int *status) {
+
+    assert(NULL != path);
+    assert(NULL != callback);
+    assert(NULL != status);
+    mender_err_t                     ret;
+    CURLM                           *multi = NULL;
+    mender_http_parallel_download_t *download;
+    size_t                           buffers_size = CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS * CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE;
+    struct timespec                  begin, end;
+
+    /* Reset statistics */
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    memset(&mender_http_stats, 0, sizeof(mender_http_stats_t));
+
+    /* Allocate the download, the buffers of the ranges are allocated with it */
+    if (NULL
+        == (download = (mender_http_parallel_download_t *)mender_utils_calloc(
+                1, sizeof(mender_http_parallel_download_t) + buffers_size))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    download->callback = callback;
+    download->params   = params;
+    download->offset   = offset;
+    download->ret      = MENDER_OK;
+
+    /* Begin of the request */
+    mender_log_trace_begin(MENDER_LOG_TRACE_HTTP_REQUEST);
+
+    /* Compute URL if required */
+    if ((false == mender_utils_strbeginwith(path, "http://")) && (false == mender_utils_strbeginwith(path, "https://"))) {
+        size_t str_length = strlen(mender_http_config.host) + strlen(path) + 1;
+        if (NULL != (download->url = (char *)mender_utils_malloc(str_length))) {
+            snprintf(download->url, str_length, "%s%s", mender_http_config.host, path);
+        }
+    } else {
+        download->url = mender_utils_strdup(path);
+    }
+    if (NULL == download->url) {
+        mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
 
-    /* Read HTTP status code */
-    long response_code;
-    if (CURLE_OK != (err = curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code))) {
-        mender_log_error("Unable to read HTTP response code: %s", curl_easy_strerror(err));
+    /* Create the multi handle, each range uses its own connection instead of being multiplexed on a single one */
+    if (NULL == (multi = curl_multi_init())) {
+        mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
     }
-    *status = (int)response_code;
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_NOTHING);
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS; index++) {
+        mender_http_parallel_range_t *range = &download->ranges[index];
+        range->download                     = download;
+        range->buffer = (uint8_t *)&download[1] + index * CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE;
+        if (NULL == (range->curl = curl_easy_init())) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+    }
+
+    /* Fetch the first range, the other ones are fetched once the length of the resource is known */
+    if (MENDER_OK != (ret = mender_http_parallel_start(download, multi, &download->ranges[0]))) {
+        goto END;
+    }
+
+    /* Perform the transfers until all the data have been given to the upper layer */
+    int running = 1;
+    while ((MENDER_OK == download->ret) && (false == download->fallback)
+           && ((0 == download->total) || (download->offset + download->current * CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE < download->total))) {
+        CURLMcode mcode;
+        if ((CURLM_OK != (mcode = curl_multi_perform(multi, &running)))
+            || (CURLM_OK != (mcode = curl_multi_poll(multi, NULL, 0, MENDER_HTTP_PARALLEL_DOWNLOAD_POLL_TIMEOUT, NULL)))) {
+            mender_log_error("Unable to perform HTTP requests: %s", curl_multi_strerror(mcode));
+            download->ret = MENDER_FAIL;
+            break;
+        }
+
+        /* Check the transfers completed */
+        CURLMsg *msg;
+        int      queued;
+        while (NULL != (msg = curl_multi_info_read(multi, &queued))) {
+            if (CURLMSG_DONE != msg->msg) {
+                continue;
+            }
+            mender_http_parallel_range_t *range = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&range);
+            curl_multi_remove_handle(multi, msg->easy_handle);
+            if ((true == download->fallback) || (MENDER_OK != download->ret)) {
+                continue;
+            }
+            if ((CURLE_OK != msg->data.result) || (range->length != mender_http_parallel_range_length(download, range->index))) {
+                mender_log_error("Unable to download range %zu: %s", range->index, curl_easy_strerror(msg->data.result));
+                download->ret = MENDER_FAIL;
+                continue;
+            }
+            range->done = true;
+        }
+
+        /* Give the ranges received to the upper layer and fetch the next ones with the connections released */
+        mender_http_parallel_deliver(download);
+        for (size_t index = 0; (0 != download->total) && (index < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS); index++) {
+            if ((false == download->ranges[index].active)
+                && (download->offset + download->next * CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE < download->total)
+                && (MENDER_OK != mender_http_parallel_start(download, multi, &download->ranges[index]))) {
+                download->ret = MENDER_FAIL;
+            }
+        }
+    }
+    ret = download->ret;
+
+    /* The server does not return ranges, nothing has been given to the upper layer */
+    if (true == download->fallback) {
+        ret = MENDER_NOT_FOUND;
+        goto END;
+    }
+
+    /* Invoke callback, the status of a single request of the resource is returned */
+    if (MENDER_OK != ret) {
+        callback(MENDER_HTTP_EVENT_ERROR, NULL, 0, params);
+        goto END;
+    }
+    *status = (0 == offset) ? 200 : 206;
     if (MENDER_OK != (ret = callback(MENDER_HTTP_EVENT_DISCONNECTED, NULL, 0, params))) {
         mender_log_error("An error occurred");
         goto END;
@@ -214,68 +1131,199 @@ mender_http_perform(char                *jwt,
 
 END:
 
+    /* Save statistics */
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    mender_http_stats.duration = (uint32_t)((end.tv_sec - begin.tv_sec) * 1000 + (end.tv_nsec - begin.tv_nsec) / 1000000);
+    mender_log_debug("Received %zu bytes in %zu fragments (mean %zu bytes) in %u ms with %d connections",
+                     mender_http_stats.length,
+                     mender_http_stats.fragments,
+                     (0 != mender_http_stats.fragments) ? (mender_http_stats.length / mender_http_stats.fragments) : 0,
+                     (unsigned int)mender_http_stats.duration,
+                     CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS);
+
     /* Release memory */
-    if (NULL != curl) {
-        curl_easy_cleanup(curl);
+    for (size_t index = 0; index < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS; index++) {
+        if (NULL != download->ranges[index].curl) {
+            if (NULL != multi) {
+                curl_multi_remove_handle(multi, download->ranges[index].curl);
+            }
+            curl_easy_cleanup(download->ranges[index].curl);
+        }
     }
-    if (NULL != headers) {
-        curl_slist_free_all(headers);
+    if (NULL != multi) {
+        curl_multi_cleanup(multi);
     }
-    if (NULL != x_men_signature) {
-        free(x_men_signature);
+    mender_utils_free(download->url);
+    mender_utils_free(download);
+
+    /* End of the request */
+    mender_log_trace_end(MENDER_LOG_TRACE_HTTP_REQUEST);
+
+    return ret;
+}
+
+static mender_err_t
+mender_http_parallel_start(mender_http_parallel_download_t *download, CURLM *multi, mender_http_parallel_range_t *range) {
+
+    assert(NULL != download);
+    assert(NULL != multi);
+    assert(NULL != range);
+    CURLcode err;
+    char     value[2 * 20 + sizeof("-")];
+
+    /* Reset the range */
+    range->index     = download->next++;
+    range->length    = 0;
+    range->delivered = 0;
+    range->done      = false;
+    range->active    = true;
+
+    /* Configuration of the client, the last byte of the range is only requested once the length of the resource is known */
+    size_t first = download->offset + range->index * CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE;
+    snprintf(value, sizeof(value), "%zu-%zu", first, first + CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE - 1);
+    curl_easy_reset(range->curl);
+    if ((CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_URL, download->url)))
+        || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_USERAGENT, MENDER_HTTP_USER_AGENT)))
+        || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_SSLVERSION, CURL_SSLVERSION_TLSv1_2)))
+        || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_SHARE, mender_net_get_share())))
+        || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_RANGE, value)))
+        || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_PRIVATE, (char *)range)))
+        || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_WRITEFUNCTION, &mender_http_parallel_write_callback)))
+        || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_WRITEDATA, range)))
+        || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_HEADERFUNCTION, &mender_http_parallel_header_callback)))
+        || (CURLE_OK != (err = curl_easy_setopt(range->curl, CURLOPT_HEADERDATA, range)))) {
+        mender_log_error("Unable to configure HTTP request: %s", curl_easy_strerror(err));
+        return MENDER_FAIL;
     }
-    if (NULL != bearer) {
-        free(bearer);
+    if (0 != mender_http_config.recv_buf_length) {
+        curl_easy_setopt(range->curl, CURLOPT_BUFFERSIZE, (long)mender_http_config.recv_buf_length);
     }
-    if (NULL != url) {
-        free(url);
+
+    /* Start the transfer */
+    if (CURLM_OK != curl_multi_add_handle(multi, range->curl)) {
+        mender_log_error("Unable to start HTTP request");
+        return MENDER_FAIL;
     }
 
-    return ret;
+    return MENDER_OK;
 }
 
-mender_err_t
-mender_http_exit(void) {
+static void
+mender_http_parallel_deliver(mender_http_parallel_download_t *download) {
 
-    /* Cleaning */
-    curl_global_cleanup();
+    assert(NULL != download);
 
-    return MENDER_OK;
+    /* Give the data of the current range, then of the next ones if it is complete */
+    for (size_t index = 0; (MENDER_OK == download->ret) && (index < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_CONNECTIONS);) {
+        mender_http_parallel_range_t *range = &download->ranges[index];
+        if ((false == range->active) || (range->index != download->current)) {
+            index++;
+            continue;
+        }
+        if (range->delivered < range->length) {
+            mender_http_stats.length += range->length - range->delivered;
+            mender_http_stats.fragments++;
+            if (MENDER_OK
+                != (download->ret = download->callback(
+                        MENDER_HTTP_EVENT_DATA_RECEIVED, &range->buffer[range->delivered], range->length - range->delivered, download->params))) {
+                mender_log_error("An error occurred, stop reading data");
+                return;
+            }
+            range->delivered = range->length;
+        }
+        if (false == range->done) {
+            return;
+        }
+
+        /* The range is released and the search restarts for the next one */
+        range->active = false;
+        download->current++;
+        index = 0;
+    }
 }
 
-static int
-mender_http_prereq_callback(void *params, char *conn_primary_ip, char *conn_local_ip, int conn_primary_port, int conn_local_port) {
+static size_t
+mender_http_parallel_range_length(mender_http_parallel_download_t *download, size_t index) {
+
+    assert(NULL != download);
+    size_t first = download->offset + index * CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE;
+    if (first >= download->total) {
+        return 0;
+    }
+
+    return (download->total - first < CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE) ? (download->total - first)
+                                                                                          : CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD_RANGE_SIZE;
+}
+
+static size_t
+mender_http_parallel_write_callback(char *data, size_t size, size_t nmemb, void *params) {
 
     assert(NULL != params);
-    mender_http_curl_user_data_t *user_data = (mender_http_curl_user_data_t *)params;
-    (void)conn_primary_ip;
-    (void)conn_local_ip;
-    (void)conn_primary_port;
-    (void)conn_local_port;
+    mender_http_parallel_range_t    *range    = (mender_http_parallel_range_t *)params;
+    mender_http_parallel_download_t *download = range->download;
+    size_t                           realsize = size * nmemb;
+    long                             response_code;
 
-    /* Invoke callback */
-    if (MENDER_OK != user_data->callback(MENDER_HTTP_EVENT_CONNECTED, NULL, 0, user_data->params)) {
-        mender_log_error("An error occurred");
-        return CURL_PREREQFUNC_ABORT;
+    /* Check the response, the transfers are stopped if the server does not return the range */
+    curl_easy_getinfo(range->curl, CURLINFO_RESPONSE_CODE, &response_code);
+    if ((206 != response_code) || (0 == download->total)) {
+        if ((0 == range->index) && (false == download->connected)) {
+            download->fallback = true;
+        } else {
+            mender_log_error("Unexpected response to range %zu: %ld", range->index, response_code);
+            download->ret = MENDER_FAIL;
+        }
+        return 0;
+    }
+    if ((MENDER_OK != download->ret) || (range->length + realsize > mender_http_parallel_range_length(download, range->index))) {
+        return 0;
     }
 
-    return CURL_PREREQFUNC_OK;
+    /* Invoke connected callback once the server has returned the first range */
+    if (false == download->connected) {
+        download->connected = true;
+        if (MENDER_OK != (download->ret = download->callback(MENDER_HTTP_EVENT_CONNECTED, NULL, 0, download->params))) {
+            mender_log_error("An error occurred");
+            return 0;
+        }
+    }
+
+    /* Give the data directly to the upper layer if the range is the current one and all the previous data have been given, buffer them otherwise */
+    if ((range->index == download->current) && (range->delivered == range->length)) {
+        mender_http_stats.length += realsize;
+        mender_http_stats.fragments++;
+        if (MENDER_OK != (download->ret = download->callback(MENDER_HTTP_EVENT_DATA_RECEIVED, (void *)data, realsize, download->params))) {
+            mender_log_error("An error occurred, stop reading data");
+            return 0;
+        }
+        range->delivered += realsize;
+    } else {
+        memcpy(&range->buffer[range->length], data, realsize);
+    }
+    range->length += realsize;
+
+    return realsize;
 }
 
 static size_t
-mender_http_write_callback(char *data, size_t size, size_t nmemb, void *params) {
+mender_http_parallel_header_callback(char *data, size_t size, size_t nmemb, void *params) {
 
     assert(NULL != params);
-    mender_http_curl_user_data_t *user_data = (mender_http_curl_user_data_t *)params;
-    size_t                        realsize  = size * nmemb;
+    mender_http_parallel_range_t *range    = (mender_http_parallel_range_t *)params;
+    size_t                        realsize = size * nmemb;
+    char                          line[128];
 
-    /* Transmit data received to the upper layer */
-    if (realsize > 0) {
-        if (MENDER_OK != user_data->callback(MENDER_HTTP_EVENT_DATA_RECEIVED, (void *)data, realsize, user_data->params)) {
-            mender_log_error("An error occurred, stop reading data");
-            return -1;
+    /* Retrieve the length of the resource, the header is "Content-Range: bytes <first>-<last>/<length>" */
+    if ((realsize > strlen("Content-Range:")) && (realsize < sizeof(line)) && (0 == strncasecmp(data, "Content-Range:", strlen("Content-Range:")))) {
+        memcpy(line, data, realsize);
+        line[realsize] = '\0';
+        char *total    = strchr(line, '/');
+        if ((NULL != total) && ('*' != total[1])) {
+            range->download->total = (size_t)strtoull(&total[1], NULL, 10);
         }
     }
 
     return realsize;
 }
+
+#endif /* CONFIG_MENDER_HTTP_PARALLEL_DOWNLOAD */
@@ -0,0 +1,132 @@
+/**
+ * @file      mender-net.c
+ * @brief     Mender network common file for curl platform
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include "mender-log.h"
+#include "mender-net.h"
+
+/**
+ * @brief Share handle used by the HTTP and websocket clients
+ */
+static CURLSH *mender_net_share = NULL;
+
+/**
+ * @brief Number of clients using the share handle
+ */
+static size_t mender_net_share_users = 0;
+
+/**
+ * @brief Mutexes protecting the data of the share handle, the websocket thread uses it concurrently with the HTTP requests
+ */
+static pthread_mutex_t mender_net_share_mutex[CURL_LOCK_DATA_LAST];
+
+/**
+ * @brief Share handle lock callback
+ * @param handle Easy handle
+ * @param data Data to be locked
+ * @param access Access requested
+ * @param params User data
+ */
+static void mender_net_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *params);
+
+/**
+ * @brief Share handle unlock callback
+ * @param handle Easy handle
+ * @param data Data to be unlocked
+ * @param params User data
+ */
+static void mender_net_share_unlock(CURL *handle, curl_lock_data data, void *params);
+
+mender_err_t
+mender_net_init(void) {
+
+    /* Share handle already initialized by the other client */
+    if (0 != mender_net_share_users) {
+        mender_net_share_users++;
+        return MENDER_OK;
+    }
+
+    /* Create the share handle */
+    if (NULL == (mender_net_share = curl_share_init())) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    for (size_t index = 0; index < CURL_LOCK_DATA_LAST; index++) {
+        pthread_mutex_init(&mender_net_share_mutex[index], NULL);
+    }
+    if ((CURLSHE_OK != curl_share_setopt(mender_net_share, CURLSHOPT_LOCKFUNC, &mender_net_share_lock))
+        || (CURLSHE_OK != curl_share_setopt(mender_net_share, CURLSHOPT_UNLOCKFUNC, &mender_net_share_unlock))
+        || (CURLSHE_OK != curl_share_setopt(mender_net_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS))
+        || (CURLSHE_OK != curl_share_setopt(mender_net_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT))
+        || (CURLSHE_OK != curl_share_setopt(mender_net_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION))) {
+        mender_log_error("Unable to configure share handle");
+        curl_share_cleanup(mender_net_share);
+        mender_net_share = NULL;
+        for (size_t index = 0; index < CURL_LOCK_DATA_LAST; index++) {
+            pthread_mutex_destroy(&mender_net_share_mutex[index]);
+        }
+        return MENDER_FAIL;
+    }
+    mender_net_share_users = 1;
+
+    return MENDER_OK;
+}
+
+CURLSH *
+mender_net_get_share(void) {
+
+    /* Return the share handle */
+    return mender_net_share;
+}
+
+mender_err_t
+mender_net_exit(void) {
+
+    /* Release the share handle with the last client, the easy handles using it must be released before */
+    if ((0 != mender_net_share_users) && (0 == --mender_net_share_users)) {
+        curl_share_cleanup(mender_net_share);
+        mender_net_share = NULL;
+        for (size_t index = 0; index < CURL_LOCK_DATA_LAST; index++) {
+            pthread_mutex_destroy(&mender_net_share_mutex[index]);
+        }
+    }
+
+    return MENDER_OK;
+}
+
+static void
+mender_net_share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *params) {
+
+    (void)handle;
+    (void)access;
+    (void)params;
+
+    /* Lock the data */
+    pthread_mutex_lock(&mender_net_share_mutex[data]);
+}
+
+static void
+mender_net_share_unlock(CURL *handle, curl_lock_data data, void *params) {
+
+    (void)handle;
+    (void)params;
+
+    /* Unlock the data */
+    pthread_mutex_unlock(&mender_net_share_mutex[data]);
+}
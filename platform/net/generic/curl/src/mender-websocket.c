@@ -17,9 +17,15 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_HTTP
+
 #include <curl/curl.h>
 #include <pthread.h>
 #include "mender-log.h"
+#include "mender-net.h"
 #include "mender-utils.h"
 #include "mender-websocket.h"
 
@@ -87,6 +93,17 @@ static int mender_websocket_prereq_callback(void *params, char *conn_primary_ip,
  */
 static size_t mender_websocket_write_callback(char *data, size_t size, size_t nmemb, void *params);
 
+/**
+ * @brief Websocket progress callback, used to stop the transfer when the connection should be terminated
+ * @param params User data
+ * @param dltotal Total number of bytes expected to be downloaded
+ * @param dlnow Number of bytes downloaded
+ * @param ultotal Total number of bytes expected to be uploaded
+ * @param ulnow Number of bytes uploaded
+ * @return 0 to continue the transfer, 1 to abort it
+ */
+static int mender_websocket_progress_callback(void *params, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+
 /**
  * @brief Thread used to perform connection and reception of data
  * @param arg Websocket handle
@@ -106,6 +123,12 @@ mender_websocket_init(mender_websocket_config_t *config) {
     /* Initialization of curl */
     curl_global_init(CURL_GLOBAL_DEFAULT);
 
+    /* Share DNS, connection and TLS session caches with the HTTP client */
+    if (MENDER_OK != mender_net_init()) {
+        mender_log_error("Unable to initialize share handle");
+        return MENDER_FAIL;
+    }
+
     return MENDER_OK;
 }
 
@@ -123,7 +146,7 @@ mender_websocket_connect(
     char        *bearer = NULL;
 
     /* Allocate a new handle */
-    if (NULL == (*handle = malloc(sizeof(mender_websocket_handle_t)))) {
+    if (NULL == (*handle = mender_utils_malloc(sizeof(mender_websocket_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto FAIL;
@@ -138,7 +161,7 @@ mender_websocket_connect(
     if ((false == mender_utils_strbeginwith(path, "ws://")) && (false == mender_utils_strbeginwith(path, "wss://"))) {
         if ((true == mender_utils_strbeginwith(path, "http://")) || (true == mender_utils_strbeginwith(mender_websocket_config.host, "http://"))) {
             size_t str_length = strlen(mender_websocket_config.host) - strlen("http://") + strlen("ws://") + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_utils_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -146,7 +169,7 @@ mender_websocket_connect(
             snprintf(url, str_length, "ws://%s%s", mender_websocket_config.host + strlen("http://"), path);
         } else if ((true == mender_utils_strbeginwith(path, "https://")) || (true == mender_utils_strbeginwith(mender_websocket_config.host, "https://"))) {
             size_t str_length = strlen(mender_websocket_config.host) - strlen("https://") + strlen("wss://") + strlen(path) + 1;
-            if (NULL == (url = (char *)malloc(str_length))) {
+            if (NULL == (url = (char *)mender_utils_malloc(str_length))) {
                 mender_log_error("Unable to allocate memory");
                 ret = MENDER_FAIL;
                 goto FAIL;
@@ -178,6 +201,20 @@ mender_websocket_connect(
         ret = MENDER_FAIL;
         goto FAIL;
     }
+    if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_SHARE, mender_net_get_share()))) {
+        mender_log_error("Unable to set websocket share handle: %s", curl_easy_strerror(err_curl));
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (0 != mender_websocket_config.recv_buf_length) {
+        if (CURLE_OK
+            != (err_curl = curl_easy_setopt(
+                    ((mender_websocket_handle_t *)*handle)->client, CURLOPT_BUFFERSIZE, (long)mender_websocket_config.recv_buf_length))) {
+            mender_log_error("Unable to set websocket receive buffer size: %s", curl_easy_strerror(err_curl));
+            ret = MENDER_FAIL;
+            goto FAIL;
+        }
+    }
     if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_PREREQFUNCTION, &mender_websocket_prereq_callback))) {
         mender_log_error("Unable to set websocket PREREQ function: %s", curl_easy_strerror(err_curl));
         ret = MENDER_FAIL;
@@ -198,9 +235,25 @@ mender_websocket_connect(
         ret = MENDER_FAIL;
         goto FAIL;
     }
+    if (CURLE_OK
+        != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_XFERINFOFUNCTION, &mender_websocket_progress_callback))) {
+        mender_log_error("Unable to set websocket progress function: %s", curl_easy_strerror(err_curl));
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_XFERINFODATA, *handle))) {
+        mender_log_error("Unable to set websocket progress data: %s", curl_easy_strerror(err_curl));
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
+    if (CURLE_OK != (err_curl = curl_easy_setopt(((mender_websocket_handle_t *)*handle)->client, CURLOPT_NOPROGRESS, 0L))) {
+        mender_log_error("Unable to enable websocket progress function: %s", curl_easy_strerror(err_curl));
+        ret = MENDER_FAIL;
+        goto FAIL;
+    }
     if (NULL != jwt) {
         size_t str_length = strlen("Authorization: Bearer ") + strlen(jwt) + 1;
-        if (NULL == (bearer = (char *)malloc(str_length))) {
+        if (NULL == (bearer = (char *)mender_utils_malloc(str_length))) {
             mender_log_error("Unable to allocate memory");
             ret = MENDER_FAIL;
             goto FAIL;
@@ -251,7 +304,7 @@ FAIL:
     if (NULL != *handle) {
         curl_easy_cleanup(((mender_websocket_handle_t *)*handle)->client);
         curl_slist_free_all(((mender_websocket_handle_t *)handle)->headers);
-        free(*handle);
+        mender_utils_free(*handle);
         *handle = NULL;
     }
 
@@ -259,10 +312,10 @@ END:
 
     /* Release memory */
     if (NULL != bearer) {
-        free(bearer);
+        mender_utils_free(bearer);
     }
     if (NULL != url) {
-        free(url);
+        mender_utils_free(url);
     }
 
     return ret;
@@ -286,17 +339,49 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
 }
 
 mender_err_t
-mender_websocket_disconnect(void *handle) {
+mender_websocket_send_v(void *handle, mender_websocket_segment_t *segments, size_t count) {
 
     assert(NULL != handle);
+    assert((NULL != segments) && (count > 0));
     CURLcode err;
-    size_t   sent = 0;
+    size_t   sent   = 0;
+    size_t   length = 0;
+
+    /* Compute the length of the frame */
+    for (size_t index = 0; index < count; index++) {
+        length += segments[index].length;
+    }
+
+    /* Send the segments as parts of a single frame, the length of the frame is given with the first one */
+    for (size_t index = 0; index < count; index++) {
+        if (CURLE_OK
+            != (err = curl_ws_send(((mender_websocket_handle_t *)handle)->client,
+                                   segments[index].data,
+                                   segments[index].length,
+                                   &sent,
+                                   (curl_off_t)((0 == index) ? length : 0),
+                                   CURLWS_BINARY | CURLWS_OFFSET))) {
+            mender_log_error("Unable to send data over websocket connection: %s", curl_easy_strerror(err));
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_websocket_disconnect(void *handle) {
 
-    /* Close websocket connection */
+    assert(NULL != handle);
+    mender_err_t ret = MENDER_OK;
+    CURLcode     err;
+    size_t       sent = 0;
+
+    /* Close websocket connection, the transfer is stopped by the progress callback even if the close payload is not sent */
     ((mender_websocket_handle_t *)handle)->abort = true;
     if (CURLE_OK != (err = curl_ws_send(((mender_websocket_handle_t *)handle)->client, NULL, 0, &sent, 0, CURLWS_CLOSE))) {
         mender_log_error("Unable to send close payload: %s", curl_easy_strerror(err));
-        return MENDER_FAIL;
+        ret = MENDER_FAIL;
     }
 
     /* Wait end of execution of the websocket thread */
@@ -305,15 +390,16 @@ mender_websocket_disconnect(void *handle) {
     /* Release memory */
     curl_easy_cleanup(((mender_websocket_handle_t *)handle)->client);
     curl_slist_free_all(((mender_websocket_handle_t *)handle)->headers);
-    free(handle);
+    mender_utils_free(handle);
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_websocket_exit(void) {
 
     /* Cleaning */
+    mender_net_exit();
     curl_global_cleanup();
 
     return MENDER_OK;
@@ -356,6 +442,20 @@ mender_websocket_write_callback(char *data, size_t size, size_t nmemb, void *par
     return realsize;
 }
 
+static int
+mender_websocket_progress_callback(void *params, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+
+    assert(NULL != params);
+    mender_websocket_handle_t *handle = (mender_websocket_handle_t *)params;
+    (void)dltotal;
+    (void)dlnow;
+    (void)ultotal;
+    (void)ulnow;
+
+    /* Abort the transfer if the connection should be terminated */
+    return (true == handle->abort) ? 1 : 0;
+}
+
 __attribute__((noreturn)) static void *
 mender_websocket_thread(void *arg) {
 
@@ -366,7 +466,7 @@ mender_websocket_thread(void *arg) {
     /* Perform reception of data from the websocket connection */
     while (false == handle->abort) {
         err = curl_easy_perform(handle->client);
-        if (CURLE_OK != err) {
+        if ((CURLE_OK != err) && (false == handle->abort)) {
             if (CURLE_HTTP_RETURNED_ERROR == err) {
                 mender_log_error("Connection has been closed");
                 goto END;
@@ -51,6 +51,113 @@ mender_http_perform(char                *jwt,
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_http_perform_range(char                *jwt,
+                          char                *path,
+                          mender_http_method_t method,
+                          char                *payload,
+                          char                *signature,
+                          size_t               offset,
+                          mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                          void *params,
+                          int  *status) {
+
+    (void)jwt;
+    (void)path;
+    (void)method;
+    (void)payload;
+    (void)signature;
+    (void)offset;
+    (void)callback;
+    (void)params;
+    (void)status;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_http_perform_conditional(char                *jwt,
+                                char                *path,
+                                mender_http_method_t method,
+                                char                *payload,
+                                char                *signature,
+                                char                *if_none_match,
+                                char                *etag,
+                                size_t               etag_size,
+                                mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                void *params,
+                                int  *status) {
+
+    (void)jwt;
+    (void)path;
+    (void)method;
+    (void)payload;
+    (void)signature;
+    (void)if_none_match;
+    (void)etag;
+    (void)etag_size;
+    (void)callback;
+    (void)params;
+    (void)status;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_http_async_start(char                *jwt,
+                        char                *path,
+                        mender_http_method_t method,
+                        char                *payload,
+                        char                *signature,
+                        mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                        void (*done)(mender_err_t, int, void *),
+                        void  *params,
+                        void **handle) {
+
+    (void)jwt;
+    (void)path;
+    (void)method;
+    (void)payload;
+    (void)signature;
+    (void)callback;
+    (void)done;
+    (void)params;
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_http_async_poll(uint32_t timeout, size_t *count) {
+
+    (void)timeout;
+    (void)count;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_http_async_cancel(void *handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_http_get_stats(mender_http_stats_t *stats) {
+
+    (void)stats;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_http_exit(void) {
 
@@ -53,6 +53,17 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_websocket_send_v(void *handle, mender_websocket_segment_t *segments, size_t count) {
+
+    (void)handle;
+    (void)segments;
+    (void)count;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_websocket_disconnect(void *handle) {
 
@@ -26,6 +26,26 @@ extern "C" {
 
 #include "mender-utils.h"
 
+/**
+ * @brief Traffic of the connections, the socket options are tuned depending of it
+ */
+typedef enum {
+    MENDER_NET_TRAFFIC_REQUEST = 0, /**< Small API requests, latency matters */
+    MENDER_NET_TRAFFIC_DOWNLOAD,    /**< Artifact downloads, throughput matters */
+    MENDER_NET_TRAFFIC_WEBSOCKET    /**< Websocket connections, long lived and interactive */
+} mender_net_traffic_t;
+
+/**
+ * @brief Socket options applied to the connections
+ */
+typedef struct {
+    int  rcvbuf;             /**< Size of the receive buffer (SO_RCVBUF), 0 to keep the default of the stack (bytes) */
+    bool nodelay;            /**< Disable the Nagle algorithm (TCP_NODELAY) */
+    int  keepalive_idle;     /**< Idle time before the keep-alive probes are sent, 0 to disable keep-alive (seconds) */
+    int  keepalive_interval; /**< Interval between the keep-alive probes (seconds) */
+    int  keepalive_count;    /**< Number of keep-alive probes not acknowledged before the connection is dropped */
+} mender_net_options_t;
+
 /**
  * @brief Returns host name, port and URL from path
  * @param path Path
@@ -37,6 +57,19 @@ extern "C" {
  */
 mender_err_t mender_net_get_host_port_url(char *path, char *config_host, char **host, char **port, char **url);
 
+/**
+ * @brief Returns host name, port and URL from path without allocating memory
+ * @param path Path
+ * @param config_host Host name from configuration
+ * @param host Buffer used to return the host name
+ * @param host_size Size of the host name buffer
+ * @param port Buffer used to return the port as string
+ * @param port_size Size of the port buffer
+ * @param url URL, pointing to the path or to the host name from configuration
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t mender_net_parse_host_port_url(char *path, char *config_host, char *host, size_t host_size, char *port, size_t port_size, char **url);
+
 /**
  * @brief Add a header to the header list
  * @param header_list Header list
@@ -55,13 +88,28 @@ mender_err_t header_add(const char **header_list, size_t header_list_size, const
  */
 char *header_alloc_and_add(const char **header_list, size_t header_list_size, const char *format, ...);
 
+/**
+ * @brief Get the socket options configured for the traffic
+ * @param traffic Traffic of the connection
+ * @param options Socket options, they can be modified before they are given to mender_net_connect or mender_net_set_options
+ */
+void mender_net_get_options(mender_net_traffic_t traffic, mender_net_options_t *options);
+
+/**
+ * @brief Apply socket options to a connection, the options not supported by the network stack are ignored
+ * @param sock Client socket
+ * @param options Socket options
+ */
+void mender_net_set_options(int sock, const mender_net_options_t *options);
+
 /**
  * @brief Perform connection with the server
  * @param host Host
  * @param port Port
+ * @param options Socket options applied before the connection is established, NULL to use the ones of the API requests
  * @return socket descriptor if the function succeeds, -1 otherwise
  */
-int mender_net_connect(const char *host, const char *port);
+int mender_net_connect(const char *host, const char *port, const mender_net_options_t *options);
 
 /**
  * @brief Close connection with the server
@@ -17,9 +17,15 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_HTTP
+
 #include <version.h>
 #include <zephyr/net/http/client.h>
 #include <zephyr/kernel.h>
+#include <ctype.h>
 #include "mender-http.h"
 #include "mender-log.h"
 #include "mender-net.h"
@@ -30,15 +36,44 @@
 #define MENDER_HEADER_HTTP_USER_AGENT "User-Agent: Mender/" MENDER_CLIENT_VERSION " MCU Zephyr/" KERNEL_VERSION_STRING "\r\n"
 
 /**
- * @brief Receive buffer length
+ * @brief Default receive buffer length (bytes)
  */
-#define MENDER_HTTP_RECV_BUF_LENGTH (512)
+#ifndef CONFIG_MENDER_HTTP_RECV_BUF_LENGTH
+#define CONFIG_MENDER_HTTP_RECV_BUF_LENGTH (512)
+#endif /* CONFIG_MENDER_HTTP_RECV_BUF_LENGTH */
 
 /**
  * @brief Request timeout (milliseconds)
  */
 #define MENDER_HTTP_REQUEST_TIMEOUT (600 * MSEC_PER_SEC)
 
+/**
+ * @brief Maximum length of the host name and of the port
+ */
+#define MENDER_HTTP_HOST_LENGTH (253)
+#define MENDER_HTTP_PORT_LENGTH (5)
+
+/**
+ * @brief Default size of the scratch area of the headers (bytes)
+ */
+#ifndef CONFIG_MENDER_HTTP_HEADERS_BUFFER_SIZE
+#define CONFIG_MENDER_HTTP_HEADERS_BUFFER_SIZE (2048)
+#endif /* CONFIG_MENDER_HTTP_HEADERS_BUFFER_SIZE */
+
+/**
+ * @brief Default keep-alive idle timeout (seconds)
+ */
+#ifndef CONFIG_MENDER_HTTP_KEEP_ALIVE_IDLE_TIMEOUT
+#define CONFIG_MENDER_HTTP_KEEP_ALIVE_IDLE_TIMEOUT (30)
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE_IDLE_TIMEOUT */
+
+/**
+ * @brief Default length of the payloads from which they are compressed (bytes)
+ */
+#ifndef CONFIG_MENDER_HTTP_GZIP_THRESHOLD
+#define CONFIG_MENDER_HTTP_GZIP_THRESHOLD (512)
+#endif /* CONFIG_MENDER_HTTP_GZIP_THRESHOLD */
+
 /**
  * @brief Request context
  */
@@ -46,13 +81,114 @@ typedef struct {
     mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *); /**< Callback to be invoked when data are received */
     void        *params;                                                          /**< Callback parameters */
     mender_err_t ret;                                                             /**< Last callback return value */
+    bool         data_received;                                                   /**< Data have been transmitted to the upper layer */
+    char        *etag;                                                            /**< Buffer used to return the ETag of the response, NULL if not requested */
+    size_t       etag_size;                                                       /**< Size of the ETag buffer */
+    size_t       etag_length;                                                     /**< Length of the ETag received, etag_size if it is too long */
+    size_t       header_field_length;                                             /**< Length of the header field currently parsed */
+    bool         header_field_is_etag;                                            /**< Header field currently parsed is "ETag" */
+    bool         header_value;                                                    /**< Header value is currently parsed */
 } mender_http_request_context;
 
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+/**
+ * @brief Connection kept open after a request, reused by the next request to the same host
+ */
+static struct {
+    int     sock;                              /**< Socket, -1 if no connection is kept */
+    char    host[MENDER_HTTP_HOST_LENGTH + 1]; /**< Host of the connection */
+    char    port[MENDER_HTTP_PORT_LENGTH + 1]; /**< Port of the connection */
+    int64_t timestamp;                         /**< Uptime at the end of the last request (milliseconds) */
+} mender_http_connection = { .sock = -1 };
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+
+#ifdef CONFIG_MENDER_HTTP_STATIC_BUFFERS
+/**
+ * @brief Buffers reserved for the requests, so that a request makes no heap allocation
+ */
+static struct {
+    uint8_t recv_buf[CONFIG_MENDER_HTTP_RECV_BUF_LENGTH];    /**< Receive buffer */
+    char    host[MENDER_HTTP_HOST_LENGTH + 1];               /**< Host of the request */
+    char    port[MENDER_HTTP_PORT_LENGTH + 1];               /**< Port of the request */
+    char    headers[CONFIG_MENDER_HTTP_HEADERS_BUFFER_SIZE]; /**< Scratch area of the headers of the request */
+    size_t  headers_length;                                  /**< Length of the scratch area already used */
+} mender_http_buffers;
+#endif /* CONFIG_MENDER_HTTP_STATIC_BUFFERS */
+
 /**
  * @brief Mender HTTP configuration
  */
 static mender_http_config_t mender_http_config;
 
+/**
+ * @brief Host of the configuration parsed once, and constant headers of the requests sent to it
+ */
+static struct {
+    char  host[MENDER_HTTP_HOST_LENGTH + 1]; /**< Host name */
+    char  port[MENDER_HTTP_PORT_LENGTH + 1]; /**< Port */
+    char *headers;                           /**< "Host" and "User-Agent" headers, NULL if not initialized */
+} mender_http_host;
+
+/**
+ * @brief Statistics of the last request
+ */
+static mender_http_stats_t mender_http_stats;
+
+/**
+ * @brief HTTP header field callback, used to find the ETag header of the response
+ * @param parser HTTP parser
+ * @param at Header field data, the field may be split in several calls
+ * @param length Length of the data
+ * @return 0 to continue parsing
+ */
+static int mender_http_header_field_cb(struct http_parser *parser, const char *at, size_t length);
+
+/**
+ * @brief HTTP header value callback, used to save the value of the ETag header of the response
+ * @param parser HTTP parser
+ * @param at Header value data, the value may be split in several calls
+ * @param length Length of the data
+ * @return 0 to continue parsing
+ */
+static int mender_http_header_value_cb(struct http_parser *parser, const char *at, size_t length);
+
+/**
+ * @brief HTTP parser callbacks, invoked by the HTTP client in addition to its own callbacks
+ */
+static const struct http_parser_settings mender_http_parser_settings
+    = { .on_header_field = mender_http_header_field_cb, .on_header_value = mender_http_header_value_cb };
+
+/**
+ * @brief Perform HTTP request
+ * @param jwt Token, NULL if not authenticated yet
+ * @param path Path of the request
+ * @param method Method
+ * @param payload Payload, NULL if empty
+ * @param signature Signature of the payload, NULL if it is not required
+ * @param offset Offset of the first byte requested, a "Range" header is added if it is not 0
+ * @param if_none_match Entity tag sent in the "If-None-Match" header, NULL or empty if not used
+ * @param etag Buffer used to return the "ETag" header of the response, NULL if not used
+ * @param etag_size Size of the etag buffer
+ * @param options Socket options of the connection, applied to the connection kept open too
+ * @param callback Callback invoked on HTTP events
+ * @param params Parameters passed to the callback, NULL if not used
+ * @param status Status code
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_http_perform_request(char                       *jwt,
+                                                char                       *path,
+                                                mender_http_method_t        method,
+                                                char                       *payload,
+                                                char                       *signature,
+                                                size_t                      offset,
+                                                char                       *if_none_match,
+                                                char                       *etag,
+                                                size_t                      etag_size,
+                                                const mender_net_options_t *options,
+                                                mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                                void *params,
+                                                int  *status);
+
 /**
  * @brief HTTP response callback, invoked to handle data received
  * @param response HTTP response structure
@@ -68,6 +204,38 @@ static void mender_http_response_cb(struct http_response *response, enum http_fi
  */
 static enum http_method mender_http_method_to_zephyr_http_client_method(mender_http_method_t method);
 
+/**
+ * @brief Format and add a header to the header list, the header is written to the scratch area if static buffers are used, allocated otherwise
+ * @param header_list Header list
+ * @param header_list_size Header list size
+ * @param format Format string
+ * @return Pointer to the header if the function succeeds, NULL otherwise
+ */
+static char *mender_http_header_format_and_add(const char **header_list, size_t header_list_size, const char *format, ...);
+
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+/**
+ * @brief Retrieve the connection kept open to the host if it has not been idle for too long
+ * @param host Host
+ * @param port Port
+ * @return Socket if a connection is available, -1 otherwise
+ */
+static int mender_http_connection_get(char *host, char *port);
+
+/**
+ * @brief Keep the connection open so that it is reused by the next request, the connection previously kept is closed
+ * @param sock Socket
+ * @param host Host
+ * @param port Port
+ */
+static void mender_http_connection_put(int sock, const char *host, const char *port);
+
+/**
+ * @brief Close the connection kept open
+ */
+static void mender_http_connection_close(void);
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+
 mender_err_t
 mender_http_init(mender_http_config_t *config) {
 
@@ -76,6 +244,30 @@ mender_http_init(mender_http_config_t *config) {
 
     /* Save configuration */
     memcpy(&mender_http_config, config, sizeof(mender_http_config_t));
+    if (0 == mender_http_config.recv_buf_length) {
+        mender_http_config.recv_buf_length = CONFIG_MENDER_HTTP_RECV_BUF_LENGTH;
+    }
+#ifdef CONFIG_MENDER_HTTP_STATIC_BUFFERS
+    if (mender_http_config.recv_buf_length > sizeof(mender_http_buffers.recv_buf)) {
+        mender_log_warning("Receive buffer length is limited to %zu bytes with static buffers", sizeof(mender_http_buffers.recv_buf));
+        mender_http_config.recv_buf_length = sizeof(mender_http_buffers.recv_buf);
+    }
+#endif /* CONFIG_MENDER_HTTP_STATIC_BUFFERS */
+
+    /* Parse the host of the configuration and format the constant headers, the requests with a path only are sent to it without parsing it again */
+    char *url;
+    if (MENDER_OK
+        != mender_net_parse_host_port_url(
+            mender_http_config.host, NULL, mender_http_host.host, sizeof(mender_http_host.host), mender_http_host.port, sizeof(mender_http_host.port), &url)) {
+        mender_log_error("Invalid host");
+        return MENDER_FAIL;
+    }
+    size_t str_length = strlen("Host: \r\n") + strlen(mender_http_host.host) + strlen(MENDER_HEADER_HTTP_USER_AGENT) + 1;
+    if (NULL == (mender_http_host.headers = (char *)mender_utils_malloc(str_length))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    snprintf(mender_http_host.headers, str_length, "Host: %s\r\n" MENDER_HEADER_HTTP_USER_AGENT, mender_http_host.host);
 
     return MENDER_OK;
 }
@@ -87,39 +279,82 @@ mender_http_init(mender_http_config_t *config) {
     Authorization: Bearer <jwt token>
     X-MEN-Signature: <string>
     Content-Type: application/json
+    Content-Encoding: gzip
+    Range: bytes=<offset>-
+    If-None-Match: <etag>
+    Connection: keep-alive
 */
-mender_err_t
-mender_http_perform(char                *jwt,
-                    char                *path,
-                    mender_http_method_t method,
-                    char                *payload,
-                    char                *signature,
-                    mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
-                    void *params,
-                    int  *status) {
+static mender_err_t
+mender_http_perform_request(char                       *jwt,
+                            char                       *path,
+                            mender_http_method_t        method,
+                            char                       *payload,
+                            char                       *signature,
+                            size_t                      offset,
+                            char                       *if_none_match,
+                            char                       *etag,
+                            size_t                      etag_size,
+                            const mender_net_options_t *options,
+                            mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                            void *params,
+                            int  *status) {
 
     assert(NULL != path);
     assert(NULL != callback);
+    assert(NULL != options);
     assert(NULL != status);
     mender_err_t                ret                = MENDER_FAIL;
     struct http_request         request            = { 0 };
-    mender_http_request_context request_context    = { callback = callback, params = params, ret = MENDER_OK };
-    const char                 *header_fields[6]   = { NULL }; /* The list is NULL terminated; make sure the size reflects it */
+    mender_http_request_context request_context    = { .callback = callback, .params = params, .ret = MENDER_OK, .data_received = false };
+    const char                 *header_fields[10]  = { NULL }; /* The list is NULL terminated; make sure the size reflects it */
     size_t                      header_fields_size = sizeof(header_fields) / sizeof(header_fields[0]);
     char                       *host               = NULL;
     char                       *port               = NULL;
     char                       *url                = NULL;
     int                         sock               = -1;
+    bool                        reused             = false;
+    bool                        configured         = false;
+    size_t                      payload_length     = (NULL != payload) ? strlen(payload) : 0;
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    void *compressed = NULL;
+#endif /* CONFIG_MENDER_HTTP_GZIP */
 
     /* Headers to be added to the request */
     char *host_header      = NULL;
     char *auth_header      = NULL;
     char *signature_header = NULL;
-
-    /* Retrieve host, port and url */
-    if (MENDER_OK != mender_net_get_host_port_url(path, mender_http_config.host, &host, &port, &url)) {
-        mender_log_error("Unable to retrieve host/port/url");
-        goto END;
+    char *range_header     = NULL;
+    char *etag_header      = NULL;
+
+    /* Reset statistics */
+    int64_t begin = k_uptime_get();
+    memset(&mender_http_stats, 0, sizeof(mender_http_stats_t));
+
+    /* Begin of the request */
+    mender_log_trace_begin(MENDER_LOG_TRACE_HTTP_REQUEST);
+
+    /* Retrieve host, port and url, the host of the configuration has been parsed at initialization */
+#ifdef CONFIG_MENDER_HTTP_STATIC_BUFFERS
+    mender_http_buffers.headers_length = 0;
+#endif /* CONFIG_MENDER_HTTP_STATIC_BUFFERS */
+    if ((false == mender_utils_strbeginwith(path, "http://")) && (false == mender_utils_strbeginwith(path, "https://"))) {
+        configured = true;
+        host       = mender_http_host.host;
+        port       = mender_http_host.port;
+        url        = path;
+    } else {
+#ifdef CONFIG_MENDER_HTTP_STATIC_BUFFERS
+        host = mender_http_buffers.host;
+        port = mender_http_buffers.port;
+        if (MENDER_OK
+            != mender_net_parse_host_port_url(
+                path, mender_http_config.host, host, sizeof(mender_http_buffers.host), port, sizeof(mender_http_buffers.port), &url)) {
+#else
+        if (MENDER_OK != mender_net_get_host_port_url(path, mender_http_config.host, &host, &port, &url)) {
+#endif /* CONFIG_MENDER_HTTP_STATIC_BUFFERS */
+            mender_log_error("Unable to retrieve host/port/url");
+            goto END;
+        }
     }
 
     /* Configuration of the client */
@@ -128,28 +363,46 @@ mender_http_perform(char                *jwt,
     request.host        = host;
     request.protocol    = "HTTP/1.1";
     request.payload     = payload;
-    request.payload_len = (NULL != payload) ? strlen(payload) : 0;
+    request.payload_len = payload_length;
     request.response    = mender_http_response_cb;
-    if (NULL == (request.recv_buf = (uint8_t *)malloc(MENDER_HTTP_RECV_BUF_LENGTH))) {
-        mender_log_error("Unable to allocate memory");
-        goto END;
+    if (NULL != etag) {
+        /* Retrieve the ETag of the response */
+        assert(etag_size > 0);
+        etag[0]                   = '\0';
+        request_context.etag      = etag;
+        request_context.etag_size = etag_size;
+        request.http_cb           = &mender_http_parser_settings;
     }
-    request.recv_buf_len = MENDER_HTTP_RECV_BUF_LENGTH;
-
-    /* Add headers */
-    host_header = header_alloc_and_add(header_fields, header_fields_size, "Host: %s\r\n", host);
-    if (NULL == host_header) {
-        mender_log_error("Unable to add 'Host' header");
+#ifdef CONFIG_MENDER_HTTP_STATIC_BUFFERS
+    request.recv_buf = mender_http_buffers.recv_buf;
+#else
+    if (NULL == (request.recv_buf = (uint8_t *)mender_utils_malloc(mender_http_config.recv_buf_length))) {
+        mender_log_error("Unable to allocate memory");
         goto END;
     }
+#endif /* CONFIG_MENDER_HTTP_STATIC_BUFFERS */
+    request.recv_buf_len = mender_http_config.recv_buf_length;
 
-    if (MENDER_FAIL == header_add(header_fields, header_fields_size, MENDER_HEADER_HTTP_USER_AGENT)) {
-        mender_log_error("Unable to add 'User-Agent' header");
-        goto END;
+    /* Add headers, the constant headers of the host of the configuration are added at once */
+    if (true == configured) {
+        if (MENDER_FAIL == header_add(header_fields, header_fields_size, mender_http_host.headers)) {
+            mender_log_error("Unable to add 'Host' and 'User-Agent' headers");
+            goto END;
+        }
+    } else {
+        host_header = mender_http_header_format_and_add(header_fields, header_fields_size, "Host: %s\r\n", host);
+        if (NULL == host_header) {
+            mender_log_error("Unable to add 'Host' header");
+            goto END;
+        }
+        if (MENDER_FAIL == header_add(header_fields, header_fields_size, MENDER_HEADER_HTTP_USER_AGENT)) {
+            mender_log_error("Unable to add 'User-Agent' header");
+            goto END;
+        }
     }
 
     if (NULL != jwt) {
-        auth_header = header_alloc_and_add(header_fields, header_fields_size, "Authorization: Bearer %s\r\n", jwt);
+        auth_header = mender_http_header_format_and_add(header_fields, header_fields_size, "Authorization: Bearer %s\r\n", jwt);
         if (NULL == auth_header) {
             mender_log_error("Unable to add 'Authorization' header");
             goto END;
@@ -157,7 +410,7 @@ mender_http_perform(char                *jwt,
     }
 
     if (NULL != signature) {
-        signature_header = header_alloc_and_add(header_fields, header_fields_size, "X-MEN-Signature: %s\r\n", signature);
+        signature_header = mender_http_header_format_and_add(header_fields, header_fields_size, "X-MEN-Signature: %s\r\n", signature);
         if (NULL == signature_header) {
             mender_log_error("Unable to add 'X-MEN-Signature' header");
             goto END;
@@ -169,12 +422,54 @@ mender_http_perform(char                *jwt,
             mender_log_error("Unable to add 'Content-Type' header");
             goto END;
         }
+#ifdef CONFIG_MENDER_HTTP_GZIP
+        /* Compress large payloads, signed payloads are sent as is because the signature is verified on the data received by the server */
+        if ((NULL == signature) && (payload_length >= CONFIG_MENDER_HTTP_GZIP_THRESHOLD)
+            && (MENDER_OK == mender_utils_gzip_compress(payload, payload_length, &compressed, &payload_length))) {
+            if (MENDER_FAIL == header_add(header_fields, header_fields_size, "Content-Encoding: gzip\r\n")) {
+                mender_log_error("Unable to add 'Content-Encoding' header");
+                goto END;
+            }
+            request.payload     = (const char *)compressed;
+            request.payload_len = payload_length;
+        }
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+    }
+
+    if (0 != offset) {
+        range_header = mender_http_header_format_and_add(header_fields, header_fields_size, "Range: bytes=%zu-\r\n", offset);
+        if (NULL == range_header) {
+            mender_log_error("Unable to add 'Range' header");
+            goto END;
+        }
     }
 
+    if ((NULL != if_none_match) && ('\0' != if_none_match[0])) {
+        etag_header = mender_http_header_format_and_add(header_fields, header_fields_size, "If-None-Match: %s\r\n", if_none_match);
+        if (NULL == etag_header) {
+            mender_log_error("Unable to add 'If-None-Match' header");
+            goto END;
+        }
+    }
+
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    if (MENDER_FAIL == header_add(header_fields, header_fields_size, "Connection: keep-alive\r\n")) {
+        mender_log_error("Unable to add 'Connection' header");
+        goto END;
+    }
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+
     request.header_fields = header_fields;
 
-    /* Connect to the server */
-    sock = mender_net_connect(host, port);
+    /* Connect to the server, the connection kept open by the previous request is reused if possible */
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    if (true == (reused = ((sock = mender_http_connection_get(host, port)) >= 0))) {
+        mender_net_set_options(sock, options);
+    }
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+    if (sock < 0) {
+        sock = mender_net_connect(host, port, options);
+    }
     if (sock < 0) {
         mender_log_error("Unable to open HTTP client connection");
         goto END;
@@ -185,7 +480,23 @@ mender_http_perform(char                *jwt,
     }
 
     /* Perform HTTP request */
-    if (http_client_req(sock, &request, MENDER_HTTP_REQUEST_TIMEOUT, (void *)&request_context) < 0) {
+    int err = http_client_req(sock, &request, MENDER_HTTP_REQUEST_TIMEOUT, (void *)&request_context);
+
+    /* The server may have closed the connection kept open in the meantime, try again with a new connection if nothing has been received */
+    if ((true == reused) && ((err < 0) || (0 == request.internal.response.http_status_code)) && (false == request_context.data_received)) {
+        mender_log_debug("Connection kept open has been closed by the server, reconnecting");
+        mender_net_disconnect(sock);
+        if ((sock = mender_net_connect(host, port, options)) < 0) {
+            mender_log_error("Unable to open HTTP client connection");
+            goto END;
+        }
+        memset(&request.internal, 0, sizeof(request.internal));
+        request_context.etag_length         = 0;
+        request_context.header_field_length = 0;
+        request_context.header_value        = false;
+        err = http_client_req(sock, &request, MENDER_HTTP_REQUEST_TIMEOUT, (void *)&request_context);
+    }
+    if (err < 0) {
         mender_log_error("Unable to write data");
         goto END;
     }
@@ -210,6 +521,14 @@ mender_http_perform(char                *jwt,
 
     ret = MENDER_OK;
 
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    /* Keep the connection open if the response is complete and the server does not close it */
+    if ((true == request.internal.response.message_complete) && (0 != http_should_keep_alive(&request.internal.parser))) {
+        mender_http_connection_put(sock, host, port);
+        sock = -1;
+    }
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+
 END:
 
     /* Close connection */
@@ -217,23 +536,162 @@ END:
         mender_net_disconnect(sock);
     }
 
-    /* Release memory */
-    free(host);
-    free(port);
-    free(url);
-    free(host_header);
-    free(auth_header);
-    free(signature_header);
+    /* Save statistics */
+    mender_http_stats.duration = (uint32_t)(k_uptime_get() - begin);
+    mender_log_debug("Received %zu bytes in %zu fragments (mean %zu bytes) in %u ms",
+                     mender_http_stats.length,
+                     mender_http_stats.fragments,
+                     (0 != mender_http_stats.fragments) ? (mender_http_stats.length / mender_http_stats.fragments) : 0,
+                     (unsigned int)mender_http_stats.duration);
+
+#ifndef CONFIG_MENDER_HTTP_STATIC_BUFFERS
+    /* Release memory, the host of the configuration and the path are not allocated */
+    if (false == configured) {
+        mender_utils_free(host);
+        mender_utils_free(port);
+        mender_utils_free(url);
+    }
+    mender_utils_free(host_header);
+    mender_utils_free(auth_header);
+    mender_utils_free(signature_header);
+    mender_utils_free(range_header);
+    mender_utils_free(etag_header);
 
-    free(request.recv_buf);
+    mender_utils_free(request.recv_buf);
+#endif /* CONFIG_MENDER_HTTP_STATIC_BUFFERS */
+#ifdef CONFIG_MENDER_HTTP_GZIP
+    mender_utils_free(compressed);
+#endif /* CONFIG_MENDER_HTTP_GZIP */
+
+    /* End of the request */
+    mender_log_trace_end(MENDER_LOG_TRACE_HTTP_REQUEST);
 
     return ret;
 }
 
+mender_err_t
+mender_http_perform(char                *jwt,
+                    char                *path,
+                    mender_http_method_t method,
+                    char                *payload,
+                    char                *signature,
+                    mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                    void *params,
+                    int  *status) {
+
+    mender_net_options_t options;
+    mender_net_get_options(MENDER_NET_TRAFFIC_REQUEST, &options);
+
+    /* Request the whole resource */
+    return mender_http_perform_request(jwt, path, method, payload, signature, 0, NULL, NULL, 0, &options, callback, params, status);
+}
+
+mender_err_t
+mender_http_perform_range(char                *jwt,
+                          char                *path,
+                          mender_http_method_t method,
+                          char                *payload,
+                          char                *signature,
+                          size_t               offset,
+                          mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                          void *params,
+                          int  *status) {
+
+    mender_net_options_t options;
+    mender_net_get_options(MENDER_NET_TRAFFIC_DOWNLOAD, &options);
+
+    /* Request the resource starting at the given offset */
+    return mender_http_perform_request(jwt, path, method, payload, signature, offset, NULL, NULL, 0, &options, callback, params, status);
+}
+
+mender_err_t
+mender_http_perform_conditional(char                *jwt,
+                                char                *path,
+                                mender_http_method_t method,
+                                char                *payload,
+                                char                *signature,
+                                char                *if_none_match,
+                                char                *etag,
+                                size_t               etag_size,
+                                mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                                void *params,
+                                int  *status) {
+
+    assert(NULL != etag);
+    mender_net_options_t options;
+    mender_net_get_options(MENDER_NET_TRAFFIC_REQUEST, &options);
+
+    /* Request the whole resource if it does not match the entity tag */
+    return mender_http_perform_request(jwt, path, method, payload, signature, 0, if_none_match, etag, etag_size, &options, callback, params, status);
+}
+
+mender_err_t
+mender_http_async_start(char                *jwt,
+                        char                *path,
+                        mender_http_method_t method,
+                        char                *payload,
+                        char                *signature,
+                        mender_err_t (*callback)(mender_http_client_event_t, void *, size_t, void *),
+                        void (*done)(mender_err_t, int, void *),
+                        void  *params,
+                        void **handle) {
+
+    (void)jwt;
+    (void)path;
+    (void)method;
+    (void)payload;
+    (void)signature;
+    (void)callback;
+    (void)done;
+    (void)params;
+    (void)handle;
+
+    /* Not supported, the HTTP client of Zephyr is blocking */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_http_async_poll(uint32_t timeout, size_t *count) {
+
+    (void)timeout;
+    (void)count;
+
+    /* Not supported, the HTTP client of Zephyr is blocking */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_http_async_cancel(void *handle) {
+
+    (void)handle;
+
+    /* Not supported, the HTTP client of Zephyr is blocking */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_http_get_stats(mender_http_stats_t *stats) {
+
+    assert(NULL != stats);
+
+    /* Return statistics of the last request */
+    memcpy(stats, &mender_http_stats, sizeof(mender_http_stats_t));
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_http_exit(void) {
 
-    /* Nothing to do */
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+    /* Close the connection kept open */
+    mender_http_connection_close();
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
+
+    /* Release memory */
+    mender_utils_free(mender_http_host.headers);
+    mender_http_host.headers = NULL;
+
     return MENDER_OK;
 }
 
@@ -251,6 +709,9 @@ mender_http_response_cb(struct http_response *response, enum http_final_call fin
     if ((true == response->body_found) && (NULL != response->body_frag_start) && (0 != response->body_frag_len) && (MENDER_OK == request_context->ret)) {
 
         /* Transmit data received to the upper layer */
+        request_context->data_received = true;
+        mender_http_stats.length += response->body_frag_len;
+        mender_http_stats.fragments++;
         if (MENDER_OK
             != (request_context->ret = request_context->callback(
                     MENDER_HTTP_EVENT_DATA_RECEIVED, (void *)response->body_frag_start, response->body_frag_len, request_context->params))) {
@@ -259,6 +720,105 @@ mender_http_response_cb(struct http_response *response, enum http_final_call fin
     }
 }
 
+static int
+mender_http_header_field_cb(struct http_parser *parser, const char *at, size_t length) {
+
+    assert(NULL != parser);
+    struct http_request         *request         = CONTAINER_OF(parser, struct http_request, internal.parser);
+    mender_http_request_context *request_context = (mender_http_request_context *)request->internal.user_data;
+    static const char            field[]         = "etag";
+
+    /* A new header field begins after a value */
+    if ((true == request_context->header_value) || (0 == request_context->header_field_length)) {
+        request_context->header_field_length  = 0;
+        request_context->header_field_is_etag = true;
+        request_context->header_value         = false;
+    }
+
+    /* Compare the field to "ETag", case insensitive */
+    for (size_t index = 0; index < length; index++) {
+        if ((request_context->header_field_length >= strlen(field))
+            || (field[request_context->header_field_length] != tolower((unsigned char)at[index]))) {
+            request_context->header_field_is_etag = false;
+        }
+        request_context->header_field_length++;
+    }
+
+    return 0;
+}
+
+static int
+mender_http_header_value_cb(struct http_parser *parser, const char *at, size_t length) {
+
+    assert(NULL != parser);
+    struct http_request         *request         = CONTAINER_OF(parser, struct http_request, internal.parser);
+    mender_http_request_context *request_context = (mender_http_request_context *)request->internal.user_data;
+
+    /* The value of the header field begins */
+    if (false == request_context->header_value) {
+        request_context->header_value         = true;
+        request_context->header_field_is_etag = (true == request_context->header_field_is_etag) && (strlen("etag") == request_context->header_field_length);
+        if (true == request_context->header_field_is_etag) {
+            request_context->etag_length = 0;
+        }
+    }
+
+    /* Save the ETag, it is discarded if it is too long */
+    if ((true == request_context->header_field_is_etag) && (request_context->etag_length < request_context->etag_size)) {
+        if (request_context->etag_length + length < request_context->etag_size) {
+            memcpy(&request_context->etag[request_context->etag_length], at, length);
+            request_context->etag_length += length;
+            request_context->etag[request_context->etag_length] = '\0';
+        } else {
+            request_context->etag_length = request_context->etag_size;
+            request_context->etag[0]     = '\0';
+        }
+    }
+
+    return 0;
+}
+
+static char *
+mender_http_header_format_and_add(const char **header_list, size_t header_list_size, const char *format, ...) {
+
+    char   *header = NULL;
+    va_list args;
+
+#ifdef CONFIG_MENDER_HTTP_STATIC_BUFFERS
+    /* Write the header to the scratch area */
+    size_t available = sizeof(mender_http_buffers.headers) - mender_http_buffers.headers_length;
+    header           = &mender_http_buffers.headers[mender_http_buffers.headers_length];
+    va_start(args, format);
+    int ret = vsnprintf(header, available, format, args);
+    va_end(args);
+    if ((ret < 0) || ((size_t)ret >= available)) {
+        mender_log_error("Unable to create header, scratch area is too small");
+        return NULL;
+    }
+    mender_http_buffers.headers_length += (size_t)ret + 1;
+#else
+    /* Allocate the header */
+    va_start(args, format);
+    int ret = mender_utils_vasprintf(&header, format, args);
+    va_end(args);
+    if (ret < 0) {
+        mender_log_error("Unable to create header");
+        return NULL;
+    }
+#endif /* CONFIG_MENDER_HTTP_STATIC_BUFFERS */
+
+    /* Add the header to the list */
+    if (MENDER_FAIL == header_add(header_list, header_list_size, header)) {
+        mender_log_error("Unable to add header to the list");
+#ifndef CONFIG_MENDER_HTTP_STATIC_BUFFERS
+        mender_utils_free(header);
+#endif /* CONFIG_MENDER_HTTP_STATIC_BUFFERS */
+        return NULL;
+    }
+
+    return header;
+}
+
 static enum http_method
 mender_http_method_to_zephyr_http_client_method(mender_http_method_t method) {
 
@@ -276,3 +836,62 @@ mender_http_method_to_zephyr_http_client_method(mender_http_method_t method) {
             return -1;
     }
 }
+
+#ifdef CONFIG_MENDER_HTTP_KEEP_ALIVE
+static int
+mender_http_connection_get(char *host, char *port) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+
+    /* Check if a connection is kept open */
+    if (mender_http_connection.sock < 0) {
+        return -1;
+    }
+
+    /* Check host, port and idle time, the connection is closed if it can not be reused */
+    if ((strcmp(host, mender_http_connection.host)) || (strcmp(port, mender_http_connection.port))
+        || (k_uptime_get() - mender_http_connection.timestamp >= (int64_t)CONFIG_MENDER_HTTP_KEEP_ALIVE_IDLE_TIMEOUT * MSEC_PER_SEC)) {
+        mender_http_connection_close();
+        return -1;
+    }
+
+    /* The connection is given to the caller */
+    int sock                    = mender_http_connection.sock;
+    mender_http_connection.sock = -1;
+
+    return sock;
+}
+
+static void
+mender_http_connection_put(int sock, const char *host, const char *port) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+
+    /* Close the connection previously kept */
+    mender_http_connection_close();
+
+    /* Check length of host and port, the connection is closed if they can not be saved */
+    if ((strlen(host) > MENDER_HTTP_HOST_LENGTH) || (strlen(port) > MENDER_HTTP_PORT_LENGTH)) {
+        mender_net_disconnect(sock);
+        return;
+    }
+
+    /* Keep the connection */
+    mender_http_connection.sock = sock;
+    strcpy(mender_http_connection.host, host);
+    strcpy(mender_http_connection.port, port);
+    mender_http_connection.timestamp = k_uptime_get();
+}
+
+static void
+mender_http_connection_close(void) {
+
+    /* Close the connection */
+    if (mender_http_connection.sock >= 0) {
+        mender_net_disconnect(mender_http_connection.sock);
+        mender_http_connection.sock = -1;
+    }
+}
+#endif /* CONFIG_MENDER_HTTP_KEEP_ALIVE */
@@ -17,12 +17,20 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_HTTP
+
 #include <errno.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/kernel.h>
 #ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
 #include <zephyr/net/tls_credentials.h>
 #endif /* CONFIG_NET_SOCKETS_SOCKOPT_TLS */
+#ifdef CONFIG_MENDER_NET_HAPPY_EYEBALLS
+#include <zephyr/posix/fcntl.h>
+#endif /* CONFIG_MENDER_NET_HAPPY_EYEBALLS */
 #include "mender-log.h"
 #include "mender-net.h"
 #include "mender-utils.h"
@@ -36,6 +44,150 @@
 
 #define RESOLVE_ATTEMPTS (10)
 
+/**
+ * @brief Default size of the receive buffer of the artifact downloads, 0 to keep the default of the stack (bytes)
+ */
+#ifndef CONFIG_MENDER_NET_SO_RCVBUF
+#define CONFIG_MENDER_NET_SO_RCVBUF (0)
+#endif /* CONFIG_MENDER_NET_SO_RCVBUF */
+
+/**
+ * @brief Default TCP keep-alive settings, used if CONFIG_MENDER_NET_TCP_KEEPALIVE is enabled (seconds)
+ */
+#ifndef CONFIG_MENDER_NET_TCP_KEEPALIVE_IDLE
+#define CONFIG_MENDER_NET_TCP_KEEPALIVE_IDLE (60)
+#endif /* CONFIG_MENDER_NET_TCP_KEEPALIVE_IDLE */
+#ifndef CONFIG_MENDER_NET_TCP_KEEPALIVE_INTERVAL
+#define CONFIG_MENDER_NET_TCP_KEEPALIVE_INTERVAL (10)
+#endif /* CONFIG_MENDER_NET_TCP_KEEPALIVE_INTERVAL */
+#ifndef CONFIG_MENDER_NET_TCP_KEEPALIVE_COUNT
+#define CONFIG_MENDER_NET_TCP_KEEPALIVE_COUNT (3)
+#endif /* CONFIG_MENDER_NET_TCP_KEEPALIVE_COUNT */
+
+/**
+ * @brief Default DNS cache TTL (seconds)
+ */
+#ifndef CONFIG_MENDER_NET_DNS_CACHE_TTL
+#define CONFIG_MENDER_NET_DNS_CACHE_TTL (300)
+#endif /* CONFIG_MENDER_NET_DNS_CACHE_TTL */
+
+/**
+ * @brief Default delay between the connection attempts of the happy eyeballs algorithm, RFC 8305 recommends 250 ms (milliseconds)
+ */
+#ifndef CONFIG_MENDER_NET_HAPPY_EYEBALLS_DELAY
+#define CONFIG_MENDER_NET_HAPPY_EYEBALLS_DELAY (250)
+#endif /* CONFIG_MENDER_NET_HAPPY_EYEBALLS_DELAY */
+
+/**
+ * @brief Default timeout of the happy eyeballs algorithm, all the attempts fail if none has succeeded meanwhile (milliseconds)
+ */
+#ifndef CONFIG_MENDER_NET_HAPPY_EYEBALLS_TIMEOUT
+#define CONFIG_MENDER_NET_HAPPY_EYEBALLS_TIMEOUT (10000)
+#endif /* CONFIG_MENDER_NET_HAPPY_EYEBALLS_TIMEOUT */
+
+#ifdef CONFIG_MENDER_NET_HAPPY_EYEBALLS
+
+/**
+ * @brief Maximum number of addresses raced by the happy eyeballs algorithm, the next ones are ignored
+ */
+#define MENDER_NET_HAPPY_EYEBALLS_CANDIDATES (4)
+
+/**
+ * @brief Family of the address which won the last race, it is tried first by the next one
+ */
+static sa_family_t mender_net_happy_eyeballs_family = AF_INET6;
+
+/**
+ * @brief Race the connections to the addresses of the host, alternating the families, a new attempt is started after a short delay or when one fails
+ * @note The attempts are plain TCP connections, the winning address is then connected with the socket configured by mender_net_connect_addr
+ * @param addr Addresses resolved
+ * @return Address of the first connection established, NULL if all the attempts fail
+ */
+static struct zsock_addrinfo *mender_net_happy_eyeballs_race(struct zsock_addrinfo *addr);
+
+#endif /* CONFIG_MENDER_NET_HAPPY_EYEBALLS */
+
+#ifdef CONFIG_MENDER_NET_DNS_CACHE
+
+/**
+ * @brief Number of entries of the DNS cache, mender-server and artifact storage
+ */
+#define MENDER_NET_DNS_CACHE_ENTRIES (4)
+
+/**
+ * @brief Maximum length of the host name and of the port of the DNS cache entries
+ */
+#define MENDER_NET_DNS_CACHE_HOST_LENGTH (253)
+#define MENDER_NET_DNS_CACHE_PORT_LENGTH (5)
+
+/**
+ * @brief DNS cache entry
+ */
+typedef struct {
+    char            host[MENDER_NET_DNS_CACHE_HOST_LENGTH + 1]; /**< Host name, empty if the entry is not used */
+    char            port[MENDER_NET_DNS_CACHE_PORT_LENGTH + 1]; /**< Port */
+    struct sockaddr addr;                                       /**< Address resolved */
+    socklen_t       addrlen;                                    /**< Length of the address */
+    int64_t         timestamp;                                  /**< Uptime of the resolution (milliseconds) */
+} mender_net_dns_cache_entry_t;
+
+/**
+ * @brief DNS cache, shared by the HTTP and websocket clients
+ */
+static mender_net_dns_cache_entry_t mender_net_dns_cache[MENDER_NET_DNS_CACHE_ENTRIES];
+
+/**
+ * @brief DNS cache mutex
+ */
+static K_MUTEX_DEFINE(mender_net_dns_cache_mutex);
+
+/**
+ * @brief Retrieve the address of the host from the DNS cache if it has not expired
+ * @param host Host
+ * @param port Port
+ * @param addr Address
+ * @param addrlen Length of the address
+ * @return true if the address is found, false otherwise
+ */
+static bool mender_net_dns_cache_get(const char *host, const char *port, struct sockaddr *addr, socklen_t *addrlen);
+
+/**
+ * @brief Save the address of the host to the DNS cache, the oldest entry is replaced if the cache is full
+ * @param host Host
+ * @param port Port
+ * @param addr Address
+ * @param addrlen Length of the address
+ */
+static void mender_net_dns_cache_put(const char *host, const char *port, struct sockaddr *addr, socklen_t addrlen);
+
+/**
+ * @brief Remove the address of the host from the DNS cache
+ * @param host Host
+ * @param port Port
+ */
+static void mender_net_dns_cache_remove(const char *host, const char *port);
+
+#endif /* CONFIG_MENDER_NET_DNS_CACHE */
+
+/**
+ * @brief Resolve the host name and connect to the host
+ * @param host Host
+ * @param port Port
+ * @param options Socket options
+ * @return socket descriptor if the function succeeds, -1 otherwise
+ */
+static int mender_net_connect_host(const char *host, const char *port, const mender_net_options_t *options);
+
+/**
+ * @brief Create a socket and connect to the address of the host
+ * @param host Host
+ * @param addr Address
+ * @param addrlen Length of the address
+ * @param options Socket options
+ * @return socket descriptor if the function succeeds, -1 otherwise
+ */
+static int mender_net_connect_addr(const char *host, struct sockaddr *addr, socklen_t addrlen, const mender_net_options_t *options);
+
 mender_err_t
 mender_net_get_host_port_url(char *path, char *config_host, char **host, char **port, char **url) {
 
@@ -47,29 +199,35 @@ mender_net_get_host_port_url(char *path, char *config_host, char **host, char **
     bool  is_https       = false;
 
     /* Check if the path start with protocol (meaning we have the full path); alternatively we have only URL (path/to/resource) */
-    if ((false == mender_utils_strbeginwith(path, "http://")) && (false == mender_utils_strbeginwith(path, "https://"))) {
+    if ((false == mender_utils_strbeginwith(path, "http://")) && (false == mender_utils_strbeginwith(path, "https://"))
+        && (false == mender_utils_strbeginwith(path, "ws://")) && (false == mender_utils_strbeginwith(path, "wss://"))) {
 
         /* Path contains the URL only, retrieve host and port from configuration (config_host) */
         assert(NULL != url);
-        if (NULL == (*url = strdup(path))) {
+        if (NULL == (*url = mender_utils_strdup(path))) {
             mender_log_error("Unable to allocate memory");
             return MENDER_FAIL;
         }
         return mender_net_get_host_port_url(config_host, NULL, host, port, NULL);
     }
 
-    /* Determine protocol and default port */
+    /* Determine protocol and default port, the websocket schemes are handled as their HTTP counterparts */
     if (mender_utils_strbeginwith(path, "http://")) {
         path_no_prefix = path + strlen("http://");
     } else if (mender_utils_strbeginwith(path, "https://")) {
         path_no_prefix = path + strlen("https://");
         is_https       = true;
+    } else if (mender_utils_strbeginwith(path, "ws://")) {
+        path_no_prefix = path + strlen("ws://");
+    } else if (mender_utils_strbeginwith(path, "wss://")) {
+        path_no_prefix = path + strlen("wss://");
+        is_https       = true;
     }
 
     /* Extract url path: next '/' character in the path after finding protocol must be the beginning of url */
     char *path_url = strchr(path_no_prefix, '/');
     if ((NULL != path_url) && (NULL != url)) {
-        if (NULL == (*url = strdup(path_url))) {
+        if (NULL == (*url = mender_utils_strdup(path_url))) {
             mender_log_error("Unable to allocate memory for URL");
             return MENDER_FAIL;
         }
@@ -78,24 +236,24 @@ mender_net_get_host_port_url(char *path, char *config_host, char **host, char **
     /* Extract host and port */
     char *path_port = strchr(path_no_prefix, ':');
     if ((NULL == path_port) && (NULL == path_url)) {
-        *port = strdup(is_https ? "443" : "80");
-        *host = strdup(path_no_prefix);
+        *port = mender_utils_strdup(is_https ? "443" : "80");
+        *host = mender_utils_strdup(path_no_prefix);
     } else if ((NULL == path_port) && (NULL != path_url)) {
-        *port = strdup(is_https ? "443" : "80");
-        *host = strndup(path_no_prefix, path_url - path_no_prefix);
+        *port = mender_utils_strdup(is_https ? "443" : "80");
+        *host = mender_utils_strndup(path_no_prefix, path_url - path_no_prefix);
     } else if ((NULL != path_port) && (NULL == path_url)) {
-        *port = strdup(path_port + 1);
-        *host = strndup(path_no_prefix, path_port - path_no_prefix);
+        *port = mender_utils_strdup(path_port + 1);
+        *host = mender_utils_strndup(path_no_prefix, path_port - path_no_prefix);
     } else {
-        *host = strndup(path_no_prefix, path_port - path_no_prefix);
-        *port = strndup(path_port + 1, path_url - path_port - 1);
+        *host = mender_utils_strndup(path_no_prefix, path_port - path_no_prefix);
+        *port = mender_utils_strndup(path_port + 1, path_url - path_port - 1);
     }
 
     if (NULL == *host || NULL == *port) {
         /* Clean up */
-        free(*host);
-        free(*port);
-        free(*url);
+        mender_utils_free(*host);
+        mender_utils_free(*port);
+        mender_utils_free(*url);
 
         mender_log_error("Unable to allocate memory for host or port");
         return MENDER_FAIL;
@@ -104,6 +262,64 @@ mender_net_get_host_port_url(char *path, char *config_host, char **host, char **
     return MENDER_OK;
 }
 
+mender_err_t
+mender_net_parse_host_port_url(char *path, char *config_host, char *host, size_t host_size, char *port, size_t port_size, char **url) {
+
+    assert(NULL != path);
+    assert(NULL != host);
+    assert(NULL != port);
+    assert(NULL != url);
+
+    char *path_no_prefix = NULL;
+    bool  is_https       = false;
+
+    /* Check if the path start with protocol (meaning we have the full path); alternatively we have only URL (path/to/resource) */
+    if ((false == mender_utils_strbeginwith(path, "http://")) && (false == mender_utils_strbeginwith(path, "https://"))
+        && (false == mender_utils_strbeginwith(path, "ws://")) && (false == mender_utils_strbeginwith(path, "wss://"))) {
+
+        /* Path contains the URL only, retrieve host and port from configuration (config_host) */
+        char *config_url;
+        *url = path;
+        return mender_net_parse_host_port_url(config_host, NULL, host, host_size, port, port_size, &config_url);
+    }
+
+    /* Determine protocol and default port */
+    if (mender_utils_strbeginwith(path, "http://")) {
+        path_no_prefix = path + strlen("http://");
+    } else {
+        path_no_prefix = path + strlen("https://");
+        is_https       = true;
+    }
+
+    /* Extract url path: next '/' character in the path after finding protocol must be the beginning of url */
+    char *path_url = strchr(path_no_prefix, '/');
+    *url           = (NULL != path_url) ? path_url : "/";
+
+    /* Extract host and port */
+    char       *path_port = strchr(path_no_prefix, ':');
+    const char *port_begin;
+    size_t      host_length, port_length;
+    if (NULL != path_port) {
+        host_length = path_port - path_no_prefix;
+        port_begin  = path_port + 1;
+        port_length = (NULL != path_url) ? (size_t)(path_url - port_begin) : strlen(port_begin);
+    } else {
+        host_length = (NULL != path_url) ? (size_t)(path_url - path_no_prefix) : strlen(path_no_prefix);
+        port_begin  = is_https ? "443" : "80";
+        port_length = strlen(port_begin);
+    }
+    if ((host_length >= host_size) || (port_length >= port_size)) {
+        mender_log_error("Host or port is too long");
+        return MENDER_FAIL;
+    }
+    memcpy(host, path_no_prefix, host_length);
+    host[host_length] = '\0';
+    memcpy(port, port_begin, port_length);
+    port[port_length] = '\0';
+
+    return MENDER_OK;
+}
+
 mender_err_t
 header_add(const char **header_list, size_t header_list_size, const char *header) {
 
@@ -131,7 +347,7 @@ header_alloc_and_add(const char **header_list, size_t header_list_size, const ch
     va_list args;
 
     va_start(args, format);
-    int ret = vasprintf(&header, format, args);
+    int ret = mender_utils_vasprintf(&header, format, args);
     va_end(args);
     if (ret < 0) {
         mender_log_error("Unable to create header");
@@ -140,26 +356,121 @@ header_alloc_and_add(const char **header_list, size_t header_list_size, const ch
 
     if (MENDER_FAIL == header_add(header_list, header_list_size, header)) {
         mender_log_error("Unable to add header to the list");
-        free(header);
+        mender_utils_free(header);
         return NULL;
     }
     return header;
 }
 
+void
+mender_net_get_options(mender_net_traffic_t traffic, mender_net_options_t *options) {
+
+    assert(NULL != options);
+
+    /* The receive buffer is enlarged for the downloads only, the Nagle algorithm is disabled for the small and interactive exchanges */
+    memset(options, 0, sizeof(mender_net_options_t));
+    options->rcvbuf  = (MENDER_NET_TRAFFIC_DOWNLOAD == traffic) ? CONFIG_MENDER_NET_SO_RCVBUF : 0;
+    options->nodelay = IS_ENABLED(CONFIG_MENDER_NET_TCP_NODELAY) && (MENDER_NET_TRAFFIC_DOWNLOAD != traffic);
+#ifdef CONFIG_MENDER_NET_TCP_KEEPALIVE
+    options->keepalive_idle     = CONFIG_MENDER_NET_TCP_KEEPALIVE_IDLE;
+    options->keepalive_interval = CONFIG_MENDER_NET_TCP_KEEPALIVE_INTERVAL;
+    options->keepalive_count    = CONFIG_MENDER_NET_TCP_KEEPALIVE_COUNT;
+#endif /* CONFIG_MENDER_NET_TCP_KEEPALIVE */
+}
+
+void
+mender_net_set_options(int sock, const mender_net_options_t *options) {
+
+    assert(NULL != options);
+    int result;
+
+    /* Set SO_RCVBUF option, the size is kept as is if it is not modified */
+    if (0 != options->rcvbuf) {
+        if ((result = zsock_setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &options->rcvbuf, sizeof(int))) < 0) {
+            mender_log_warning("Unable to set SO_RCVBUF option, result = %d, errno = %d", result, errno);
+        }
+    }
+
+    /* Set TCP_NODELAY option */
+    int nodelay = (true == options->nodelay) ? 1 : 0;
+    if ((result = zsock_setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(int))) < 0) {
+        mender_log_warning("Unable to set TCP_NODELAY option, result = %d, errno = %d", result, errno);
+    }
+
+#ifdef CONFIG_NET_TCP_KEEPALIVE
+    /* Set SO_KEEPALIVE option and the keep-alive settings */
+    int keepalive = (0 != options->keepalive_idle) ? 1 : 0;
+    if ((result = zsock_setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(int))) < 0) {
+        mender_log_warning("Unable to set SO_KEEPALIVE option, result = %d, errno = %d", result, errno);
+    } else if ((0 != keepalive)
+               && (((result = zsock_setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &options->keepalive_idle, sizeof(int))) < 0)
+                   || ((result = zsock_setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &options->keepalive_interval, sizeof(int))) < 0)
+                   || ((result = zsock_setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &options->keepalive_count, sizeof(int))) < 0))) {
+        mender_log_warning("Unable to set keep-alive options, result = %d, errno = %d", result, errno);
+    }
+#endif /* CONFIG_NET_TCP_KEEPALIVE */
+}
+
 int
-mender_net_connect(const char *host, const char *port) {
+mender_net_connect(const char *host, const char *port, const mender_net_options_t *options) {
 
     assert(NULL != host);
     assert(NULL != port);
+    mender_net_options_t request_options;
+    int                  sock;
+
+    /* Use the options of the API requests if they are not provided */
+    if (NULL == options) {
+        mender_net_get_options(MENDER_NET_TRAFFIC_REQUEST, &request_options);
+        options = &request_options;
+    }
+
+    /* Connect to the host, the trace point spans the name resolution and the connection */
+    mender_log_trace_begin(MENDER_LOG_TRACE_CONNECT);
+    sock = mender_net_connect_host(host, port, options);
+    mender_log_trace_end(MENDER_LOG_TRACE_CONNECT);
+
+    return sock;
+}
+
+mender_err_t
+mender_net_disconnect(int sock) {
 
+    /* Close socket */
+    zsock_close(sock);
+
+    return MENDER_OK;
+}
+
+static int
+mender_net_connect_host(const char *host, const char *port, const mender_net_options_t *options) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+    assert(NULL != options);
     int                    result;
     int                    sock             = -1;
     struct zsock_addrinfo  hints            = { 0 };
     struct zsock_addrinfo *addr             = NULL;
     unsigned int           resolve_attempts = RESOLVE_ATTEMPTS;
 
-    /* Set hints */
-    if (IS_ENABLED(CONFIG_NET_IPV6)) {
+#ifdef CONFIG_MENDER_NET_DNS_CACHE
+    /* Connect to the address saved in the DNS cache, the host name is resolved again if the connection fails */
+    struct sockaddr cached_addr;
+    socklen_t       cached_addrlen;
+    if (true == mender_net_dns_cache_get(host, port, &cached_addr, &cached_addrlen)) {
+        if ((sock = mender_net_connect_addr(host, &cached_addr, cached_addrlen, options)) >= 0) {
+            return sock;
+        }
+        mender_log_debug("Unable to connect to the cached address of '%s:%s', resolving host name again", host, port);
+        mender_net_dns_cache_remove(host, port);
+    }
+#endif /* CONFIG_MENDER_NET_DNS_CACHE */
+
+    /* Set hints, both families are resolved when they are raced */
+    if (IS_ENABLED(CONFIG_MENDER_NET_HAPPY_EYEBALLS)) {
+        hints.ai_family = AF_UNSPEC;
+    } else if (IS_ENABLED(CONFIG_NET_IPV6)) {
         hints.ai_family = AF_INET6;
     } else if (IS_ENABLED(CONFIG_NET_IPV4)) {
         hints.ai_family = AF_INET;
@@ -179,14 +490,51 @@ mender_net_connect(const char *host, const char *port) {
 
     if (0 != result) {
         mender_log_error("Unable to resolve host name '%s:%s', result = %d, errno = %d", host, port, result, errno);
+        return -1;
+    }
+
+    /* Select the address of the host, the first one unless the addresses are raced */
+    struct zsock_addrinfo *selected = addr;
+#ifdef CONFIG_MENDER_NET_HAPPY_EYEBALLS
+    if (NULL == (selected = mender_net_happy_eyeballs_race(addr))) {
+        mender_log_error("Unable to reach the host '%s:%s'", host, port);
         goto END;
     }
+#endif /* CONFIG_MENDER_NET_HAPPY_EYEBALLS */
+
+    /* Connect to the host */
+    if ((sock = mender_net_connect_addr(host, selected->ai_addr, selected->ai_addrlen, options)) < 0) {
+        mender_log_error("Unable to connect to the host '%s:%s'", host, port);
+        goto END;
+    }
+
+#ifdef CONFIG_MENDER_NET_DNS_CACHE
+    /* Save the address to the DNS cache */
+    mender_net_dns_cache_put(host, port, selected->ai_addr, selected->ai_addrlen);
+#endif /* CONFIG_MENDER_NET_DNS_CACHE */
+
+END:
+
+    /* Free the address info */
+    zsock_freeaddrinfo(addr);
+
+    return sock;
+}
+
+static int
+mender_net_connect_addr(const char *host, struct sockaddr *addr, socklen_t addrlen, const mender_net_options_t *options) {
+
+    assert(NULL != host);
+    assert(NULL != addr);
+    assert(NULL != options);
+    int result;
+    int sock = -1;
 
     /* Create socket */
 #ifdef CONFIG_NET_SOCKETS_SOCKOPT_TLS
-    if ((sock = zsock_socket(addr->ai_family, SOCK_STREAM, IPPROTO_TLS_1_2)) < 0) {
+    if ((sock = zsock_socket(addr->sa_family, SOCK_STREAM, IPPROTO_TLS_1_2)) < 0) {
 #else
-    if ((sock = zsock_socket(addr->ai_family, SOCK_STREAM, IPPROTO_TCP)) < 0) {
+    if ((sock = zsock_socket(addr->sa_family, SOCK_STREAM, IPPROTO_TCP)) < 0) {
 #endif /* CONFIG_NET_SOCKETS_SOCKOPT_TLS */
         mender_log_error("Unable to create socket, result = %d, errno= %d", sock, errno);
         goto END;
@@ -216,38 +564,213 @@ mender_net_connect(const char *host, const char *port) {
         goto END;
     }
 
+#if defined(CONFIG_MENDER_NET_TLS_SESSION_CACHE) && defined(TLS_SESSION_CACHE)
+    /* Set TLS_SESSION_CACHE option, the session is resumed on the next connections to the host, CONFIG_NET_SOCKETS_TLS_MAX_CLIENT_SESSION_COUNT must be set */
+    int session_cache = TLS_SESSION_CACHE_ENABLED;
+    if ((result = zsock_setsockopt(sock, SOL_TLS, TLS_SESSION_CACHE, &session_cache, sizeof(int))) < 0) {
+        mender_log_error("Unable to set TLS_SESSION_CACHE option, result = %d, errno = %d", result, errno);
+        goto END;
+    }
+#endif /* CONFIG_MENDER_NET_TLS_SESSION_CACHE && TLS_SESSION_CACHE */
+
 #endif /* CONFIG_NET_SOCKETS_SOCKOPT_TLS */
 
-    /* Connect to the host */
-    if (0 != (result = zsock_connect(sock, addr->ai_addr, addr->ai_addrlen))) {
-        mender_log_error("Unable to connect to the host '%s:%s', result = %d, errno = %d", host, port, result, errno);
+    /* Set the socket options, before the connection so that the receive window is advertised accordingly */
+    mender_net_set_options(sock, options);
+
+    /* Connect to the host, the TLS handshake is performed by the connection of the TLS socket */
+    mender_log_trace_begin(MENDER_LOG_TRACE_TLS_HANDSHAKE);
+    result = zsock_connect(sock, addr, addrlen);
+    mender_log_trace_end(MENDER_LOG_TRACE_TLS_HANDSHAKE);
+    if (0 != result) {
+        mender_log_error("Unable to connect, result = %d, errno = %d", result, errno);
         goto END;
     }
 
-    /* Free the address info */
-    if (NULL != addr) {
-        zsock_freeaddrinfo(addr);
-    }
     return sock;
 
 END:
+
     /* Close socket */
     if (sock >= 0) {
         zsock_close(sock);
     }
 
-    if (NULL != addr) {
-        zsock_freeaddrinfo(addr);
+    return -1; /* Error */
+}
+
+#ifdef CONFIG_MENDER_NET_HAPPY_EYEBALLS
+
+static struct zsock_addrinfo *
+mender_net_happy_eyeballs_race(struct zsock_addrinfo *addr) {
+
+    assert(NULL != addr);
+    struct zsock_addrinfo *candidates[MENDER_NET_HAPPY_EYEBALLS_CANDIDATES];
+    struct zsock_pollfd    fds[MENDER_NET_HAPPY_EYEBALLS_CANDIDATES];
+    struct zsock_addrinfo *winner = NULL;
+    size_t                 count  = 0;
+
+    /* Sort the addresses, alternating the families starting with the one which won the last race */
+    struct zsock_addrinfo *preferred = NULL, *other = NULL;
+    for (struct zsock_addrinfo *item = addr; NULL != item; item = item->ai_next) {
+        if ((NULL == preferred) && (mender_net_happy_eyeballs_family == item->ai_family)) {
+            preferred = item;
+        } else if ((NULL == other) && (mender_net_happy_eyeballs_family != item->ai_family)) {
+            other = item;
+        }
+    }
+    while ((count < MENDER_NET_HAPPY_EYEBALLS_CANDIDATES) && ((NULL != preferred) || (NULL != other))) {
+        struct zsock_addrinfo **next = ((NULL != preferred) && ((0 == count % 2) || (NULL == other))) ? &preferred : &other;
+        candidates[count++]          = *next;
+        sa_family_t family           = (*next)->ai_family;
+        do {
+            *next = (*next)->ai_next;
+        } while ((NULL != *next) && (family != (*next)->ai_family));
     }
 
-    return -1; /* Error */
+    /* Start the attempts one after the other until one of them succeeds */
+    size_t  started = 0, pending = 0;
+    int64_t now = k_uptime_get(), next_attempt = now, deadline = now + CONFIG_MENDER_NET_HAPPY_EYEBALLS_TIMEOUT;
+    while ((NULL == winner) && (now < deadline) && ((started < count) || (0 != pending))) {
+
+        /* Start the next attempt if the delay has elapsed or if the previous attempts have failed */
+        if ((started < count) && ((now >= next_attempt) || (0 == pending))) {
+            fds[started].events = ZSOCK_POLLOUT;
+            if ((fds[started].fd = zsock_socket(candidates[started]->ai_family, SOCK_STREAM, IPPROTO_TCP)) >= 0) {
+                zsock_fcntl(fds[started].fd, F_SETFL, O_NONBLOCK);
+                if (0 == zsock_connect(fds[started].fd, candidates[started]->ai_addr, candidates[started]->ai_addrlen)) {
+                    winner = candidates[started];
+                } else if (EINPROGRESS == errno) {
+                    pending++;
+                } else {
+                    zsock_close(fds[started].fd);
+                    fds[started].fd = -1;
+                }
+            }
+            started++;
+            next_attempt = now + CONFIG_MENDER_NET_HAPPY_EYEBALLS_DELAY;
+            continue;
+        }
+
+        /* Wait for one of the attempts to complete, the closed sockets are ignored by poll */
+        int64_t timeout = ((started < count) ? next_attempt : deadline) - now;
+        if (zsock_poll(fds, started, (int)((timeout > 0) ? timeout : 0)) > 0) {
+            for (size_t index = 0; (NULL == winner) && (index < started); index++) {
+                if ((fds[index].fd < 0) || (0 == fds[index].revents)) {
+                    continue;
+                }
+                int       error  = 0;
+                socklen_t length = sizeof(error);
+                if ((0 == zsock_getsockopt(fds[index].fd, SOL_SOCKET, SO_ERROR, &error, &length)) && (0 == error)
+                    && (0 == (fds[index].revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP)))) {
+                    winner = candidates[index];
+                } else {
+                    zsock_close(fds[index].fd);
+                    fds[index].fd = -1;
+                    pending--;
+                    next_attempt = 0;
+                }
+            }
+        }
+        now = k_uptime_get();
+    }
+
+    /* Close the attempts, the winning family is tried first by the next race */
+    for (size_t index = 0; index < started; index++) {
+        if (fds[index].fd >= 0) {
+            zsock_close(fds[index].fd);
+        }
+    }
+    if (NULL != winner) {
+        mender_log_debug("Address family %d won the race", winner->ai_family);
+        mender_net_happy_eyeballs_family = winner->ai_family;
+    }
+
+    return winner;
 }
 
-mender_err_t
-mender_net_disconnect(int sock) {
+#endif /* CONFIG_MENDER_NET_HAPPY_EYEBALLS */
 
-    /* Close socket */
-    zsock_close(sock);
+#ifdef CONFIG_MENDER_NET_DNS_CACHE
 
-    return MENDER_OK;
+static bool
+mender_net_dns_cache_get(const char *host, const char *port, struct sockaddr *addr, socklen_t *addrlen) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+    assert(NULL != addr);
+    assert(NULL != addrlen);
+    bool found = false;
+
+    /* Look for the host, expired entries are released */
+    k_mutex_lock(&mender_net_dns_cache_mutex, K_FOREVER);
+    for (size_t index = 0; index < MENDER_NET_DNS_CACHE_ENTRIES; index++) {
+        mender_net_dns_cache_entry_t *entry = &mender_net_dns_cache[index];
+        if ('\0' == entry->host[0]) {
+            continue;
+        }
+        if ((k_uptime_get() - entry->timestamp) >= ((int64_t)CONFIG_MENDER_NET_DNS_CACHE_TTL * MSEC_PER_SEC)) {
+            entry->host[0] = '\0';
+            continue;
+        }
+        if ((0 == strcmp(entry->host, host)) && (0 == strcmp(entry->port, port))) {
+            memcpy(addr, &entry->addr, entry->addrlen);
+            *addrlen = entry->addrlen;
+            found    = true;
+            break;
+        }
+    }
+    k_mutex_unlock(&mender_net_dns_cache_mutex);
+
+    return found;
+}
+
+static void
+mender_net_dns_cache_put(const char *host, const char *port, struct sockaddr *addr, socklen_t addrlen) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+    assert(NULL != addr);
+
+    /* Check length of host, port and address, they are not saved if they do not fit in the entry */
+    if ((strlen(host) > MENDER_NET_DNS_CACHE_HOST_LENGTH) || (strlen(port) > MENDER_NET_DNS_CACHE_PORT_LENGTH) || (addrlen > sizeof(struct sockaddr))) {
+        return;
+    }
+
+    /* Use the entry of the host if it exists, a free entry otherwise, or the oldest entry */
+    k_mutex_lock(&mender_net_dns_cache_mutex, K_FOREVER);
+    mender_net_dns_cache_entry_t *entry = &mender_net_dns_cache[0];
+    for (size_t index = 0; index < MENDER_NET_DNS_CACHE_ENTRIES; index++) {
+        if ((0 == strcmp(mender_net_dns_cache[index].host, host)) && (0 == strcmp(mender_net_dns_cache[index].port, port))) {
+            entry = &mender_net_dns_cache[index];
+            break;
+        }
+        if (('\0' != entry->host[0]) && (('\0' == mender_net_dns_cache[index].host[0]) || (mender_net_dns_cache[index].timestamp < entry->timestamp))) {
+            entry = &mender_net_dns_cache[index];
+        }
+    }
+    strcpy(entry->host, host);
+    strcpy(entry->port, port);
+    memcpy(&entry->addr, addr, addrlen);
+    entry->addrlen   = addrlen;
+    entry->timestamp = k_uptime_get();
+    k_mutex_unlock(&mender_net_dns_cache_mutex);
 }
+
+static void
+mender_net_dns_cache_remove(const char *host, const char *port) {
+
+    assert(NULL != host);
+    assert(NULL != port);
+
+    /* Release the entry of the host */
+    k_mutex_lock(&mender_net_dns_cache_mutex, K_FOREVER);
+    for (size_t index = 0; index < MENDER_NET_DNS_CACHE_ENTRIES; index++) {
+        if ((0 == strcmp(mender_net_dns_cache[index].host, host)) && (0 == strcmp(mender_net_dns_cache[index].port, port))) {
+            mender_net_dns_cache[index].host[0] = '\0';
+        }
+    }
+    k_mutex_unlock(&mender_net_dns_cache_mutex);
+}
+
+#endif /* CONFIG_MENDER_NET_DNS_CACHE */
@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_HTTP
+
 #include <errno.h>
 #include <version.h>
 #include <zephyr/kernel.h>
@@ -66,9 +71,53 @@
 #define MENDER_HEADER_WEBSOCKET_USER_AGENT "User-Agent: Mender/" MENDER_CLIENT_VERSION " MCU Zephyr(websocket)/" KERNEL_VERSION_STRING "\r\n"
 
 /**
- * @brief Websocket receive buffer length
+ * @brief Default websocket receive buffer length (bytes)
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_RECV_BUF_LENGTH
+#define CONFIG_MENDER_WEBSOCKET_RECV_BUF_LENGTH (3 * 512)
+#endif /* CONFIG_MENDER_WEBSOCKET_RECV_BUF_LENGTH */
+
+/**
+ * @brief Default maximum length of the messages reassembled, it is the size of the buffers of the message pool (bytes)
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_MESSAGE_LENGTH
+#define CONFIG_MENDER_WEBSOCKET_MESSAGE_LENGTH (4096)
+#endif /* CONFIG_MENDER_WEBSOCKET_MESSAGE_LENGTH */
+
+/**
+ * @brief Default number of buffers of the message pool
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_MESSAGE_BUFFERS
+#define CONFIG_MENDER_WEBSOCKET_MESSAGE_BUFFERS (2)
+#endif /* CONFIG_MENDER_WEBSOCKET_MESSAGE_BUFFERS */
+
+/**
+ * @brief Default length of the send queue, 0 to send the messages from the calling thread (bytes)
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH
+#define CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH (0)
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+
+/**
+ * @brief Default interval at which the send queue is serviced while no data is received (milliseconds)
+ */
+#ifndef CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_INTERVAL
+#define CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_INTERVAL (20)
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_INTERVAL */
+
+/**
+ * @brief Timeout of the reception, the send queue is serviced between the receptions (milliseconds)
+ */
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+#define MENDER_WEBSOCKET_RECV_TIMEOUT CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_INTERVAL
+#else
+#define MENDER_WEBSOCKET_RECV_TIMEOUT SYS_FOREVER_MS
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+
+/**
+ * @brief Interval at which the abort flag is checked while waiting for a buffer of the message pool (milliseconds)
  */
-#define MENDER_WEBSOCKET_RECV_BUF_LENGTH (3 * 512)
+#define MENDER_WEBSOCKET_MESSAGE_POOL_WAIT (100)
 
 /**
  * @brief Websocket handle
@@ -78,6 +127,11 @@ typedef struct {
     int             client;        /**< Websocket client handle */
     struct k_thread thread_handle; /**< Websocket thread handle */
     bool            abort;         /**< Flag used to indicate connection should be terminated */
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+    struct k_mutex  queue_mutex;   /**< Mutex used to protect access to the send queue */
+    uint8_t        *queue;         /**< Send queue, each message is preceded by its length */
+    size_t          queue_length;  /**< Length of the send queue used */
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
     mender_err_t (*callback)(mender_websocket_client_event_t,
                              void *,
                              size_t,
@@ -95,6 +149,11 @@ static mender_websocket_config_t mender_websocket_config;
  */
 K_THREAD_STACK_DEFINE(mender_websocket_thread_stack, CONFIG_MENDER_WEBSOCKET_THREAD_STACK_SIZE * 1024);
 
+/**
+ * @brief Message pool, the fragments of the messages are reassembled in its buffers before they are given to the upper layer
+ */
+K_MEM_SLAB_DEFINE_STATIC(mender_websocket_message_pool, CONFIG_MENDER_WEBSOCKET_MESSAGE_LENGTH, CONFIG_MENDER_WEBSOCKET_MESSAGE_BUFFERS, 4);
+
 /**
  * @brief Thread used to perform reception of data
  * @param p1 Websocket handle
@@ -103,6 +162,32 @@ K_THREAD_STACK_DEFINE(mender_websocket_thread_stack, CONFIG_MENDER_WEBSOCKET_THR
  */
 static void mender_websocket_thread(void *p1, void *p2, void *p3);
 
+/**
+ * @brief Take a buffer of the message pool, the reception is paused until a buffer is available so that the server is slowed down
+ * @param handle Websocket handle
+ * @return Buffer if the function succeeds, NULL if the connection is aborted meanwhile
+ */
+static uint8_t *mender_websocket_message_alloc(mender_websocket_handle_t *handle);
+
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+
+/**
+ * @brief Append a message to the send queue, the segments are merged in a single frame
+ * @param handle Websocket handle
+ * @param segments Segments of the message
+ * @param count Number of segments
+ * @return MENDER_OK if the function succeeds, MENDER_BUSY if the send queue is full, error code otherwise
+ */
+static mender_err_t mender_websocket_queue_push(mender_websocket_handle_t *handle, mender_websocket_segment_t *segments, size_t count);
+
+/**
+ * @brief Send the messages of the send queue, invoked by the websocket thread
+ * @param handle Websocket handle
+ */
+static void mender_websocket_queue_flush(mender_websocket_handle_t *handle);
+
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+
 mender_err_t
 mender_websocket_init(mender_websocket_config_t *config) {
 
@@ -111,6 +196,9 @@ mender_websocket_init(mender_websocket_config_t *config) {
 
     /* Save configuration */
     memcpy(&mender_websocket_config, config, sizeof(mender_websocket_config_t));
+    if (0 == mender_websocket_config.recv_buf_length) {
+        mender_websocket_config.recv_buf_length = CONFIG_MENDER_WEBSOCKET_RECV_BUF_LENGTH;
+    }
 
     return MENDER_OK;
 }
@@ -133,13 +221,22 @@ mender_websocket_connect(
     char *auth_header = NULL;
 
     /* Allocate a new handle */
-    if (NULL == (*handle = calloc(1, sizeof(mender_websocket_handle_t)))) {
+    if (NULL == (*handle = mender_utils_calloc(1, sizeof(mender_websocket_handle_t)))) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
 
     ((mender_websocket_handle_t *)*handle)->sock = -1;
 
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+    /* Allocate the send queue, the connected callback may already send messages */
+    k_mutex_init(&((mender_websocket_handle_t *)*handle)->queue_mutex);
+    if (NULL == (((mender_websocket_handle_t *)*handle)->queue = (uint8_t *)mender_utils_malloc(CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+
     /* Save callback and params */
     ((mender_websocket_handle_t *)*handle)->callback = callback;
     ((mender_websocket_handle_t *)*handle)->params   = params;
@@ -153,11 +250,11 @@ mender_websocket_connect(
     /* Configuration of the client */
     request.url  = url;
     request.host = host;
-    if (NULL == (request.tmp_buf = (uint8_t *)malloc(MENDER_WEBSOCKET_RECV_BUF_LENGTH))) {
+    if (NULL == (request.tmp_buf = (uint8_t *)mender_utils_malloc(mender_websocket_config.recv_buf_length))) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
-    request.tmp_buf_len = MENDER_WEBSOCKET_RECV_BUF_LENGTH;
+    request.tmp_buf_len = mender_websocket_config.recv_buf_length;
 
     /* Add headers */
     if (MENDER_FAIL == header_add(header_fields, header_fields_size, MENDER_HEADER_WEBSOCKET_USER_AGENT)) {
@@ -175,7 +272,9 @@ mender_websocket_connect(
     request.optional_headers = header_fields;
 
     /* Connect to the server */
-    ((mender_websocket_handle_t *)*handle)->sock = mender_net_connect(host, port);
+    mender_net_options_t options;
+    mender_net_get_options(MENDER_NET_TRAFFIC_WEBSOCKET, &options);
+    ((mender_websocket_handle_t *)*handle)->sock = mender_net_connect(host, port, &options);
     if (((mender_websocket_handle_t *)*handle)->sock < 0) {
         mender_log_error("Unable to open HTTP client connection");
         goto FAIL;
@@ -216,19 +315,22 @@ FAIL:
         if (((mender_websocket_handle_t *)*handle)->sock > 0) {
             mender_net_disconnect(((mender_websocket_handle_t *)*handle)->sock);
         }
-        free(*handle);
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+        mender_utils_free(((mender_websocket_handle_t *)*handle)->queue);
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+        mender_utils_free(*handle);
         *handle = NULL;
     }
 
 END:
 
     /* Release memory */
-    free(host);
-    free(port);
-    free(url);
+    mender_utils_free(host);
+    mender_utils_free(port);
+    mender_utils_free(url);
 
-    free(auth_header);
-    free(request.tmp_buf);
+    mender_utils_free(auth_header);
+    mender_utils_free(request.tmp_buf);
 
     return ret;
 }
@@ -238,6 +340,15 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
 
     assert(NULL != handle);
     assert(NULL != payload);
+
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+
+    /* Append the payload to the send queue, it is sent by the websocket thread */
+    mender_websocket_segment_t segment = { .data = payload, .length = length };
+    return mender_websocket_queue_push((mender_websocket_handle_t *)handle, &segment, 1);
+
+#else
+
     int sent;
 
     /* Send binary payload */
@@ -254,6 +365,43 @@ mender_websocket_send(void *handle, void *payload, size_t length) {
     }
 
     return MENDER_OK;
+
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+}
+
+mender_err_t
+mender_websocket_send_v(void *handle, mender_websocket_segment_t *segments, size_t count) {
+
+    assert(NULL != handle);
+    assert((NULL != segments) && (count > 0));
+
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+
+    /* Append the segments to the send queue, they are sent by the websocket thread as a single frame */
+    return mender_websocket_queue_push((mender_websocket_handle_t *)handle, segments, count);
+
+#else
+
+    int sent;
+
+    /* Send each segment as a fragment of the message, the first one is a binary frame and the next ones are continuation frames */
+    for (size_t index = 0; index < count; index++) {
+        if (segments[index].length
+            != (sent = websocket_send_msg(((mender_websocket_handle_t *)handle)->client,
+                                          segments[index].data,
+                                          segments[index].length,
+                                          (0 == index) ? WEBSOCKET_OPCODE_DATA_BINARY : WEBSOCKET_OPCODE_CONTINUE,
+                                          true,
+                                          (index == count - 1),
+                                          CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT))) {
+            mender_log_error("Unable to send data over websocket connection: %d", sent);
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
 }
 
 mender_err_t
@@ -268,8 +416,11 @@ mender_websocket_disconnect(void *handle) {
     /* Wait end of execution of the websocket thread */
     k_thread_join(&((mender_websocket_handle_t *)handle)->thread_handle, K_FOREVER);
 
-    /* Release memory */
-    free(handle);
+    /* Release memory, the messages remaining in the send queue are dropped */
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+    mender_utils_free(((mender_websocket_handle_t *)handle)->queue);
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+    mender_utils_free(handle);
 
     return MENDER_OK;
 }
@@ -288,41 +439,70 @@ mender_websocket_thread(void *p1, void *p2, void *p3) {
     mender_websocket_handle_t *handle = (mender_websocket_handle_t *)p1;
     (void)p2;
     (void)p3;
-    uint8_t *payload;
+    uint8_t *message   = NULL;
+    size_t   offset    = 0;
+    bool     fragments = false;
+    bool     overflow  = false;
     int      received;
     uint32_t message_type = 0;
     uint64_t remaining    = 0;
 
-    /* Allocate payload */
-    if (NULL == (payload = (uint8_t *)malloc(MENDER_WEBSOCKET_RECV_BUF_LENGTH))) {
-        mender_log_error("Unable to allocate memory");
-        goto END;
-    }
-
     /* Perform reception of data from the websocket connection */
     while (false == handle->abort) {
 
-        received = websocket_recv_msg(handle->client, payload, MENDER_WEBSOCKET_RECV_BUF_LENGTH, &message_type, &remaining, SYS_FOREVER_MS);
+        /* Take a buffer to reassemble the next message */
+        if ((NULL == message) && (NULL == (message = mender_websocket_message_alloc(handle)))) {
+            goto END;
+        }
+
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+        /* Send the messages queued meanwhile */
+        mender_websocket_queue_flush(handle);
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
+
+        /* Receive the data following the fragments already received, the data are discarded once the buffer is full */
+        size_t length = MIN(CONFIG_MENDER_WEBSOCKET_MESSAGE_LENGTH - offset, mender_websocket_config.recv_buf_length);
+        received      = websocket_recv_msg(handle->client, &message[offset], length, &message_type, &remaining, MENDER_WEBSOCKET_RECV_TIMEOUT);
         if (received < 0) {
             if (-ENOTCONN == received) {
                 mender_log_error("Connection has been closed");
                 goto END;
             }
-            mender_log_error("Unable to receive websocket message: errno=%d", errno);
+            if (-EAGAIN != received) {
+                mender_log_error("Unable to receive websocket message: errno=%d", errno);
+            }
 
         } else if (received > 0) {
 
-            /* Perform treatment depending of the opcode */
+            /* Perform treatment depending of the opcode, control frames may be received between the fragments of a message */
             if (WEBSOCKET_FLAG_PING == (message_type & WEBSOCKET_FLAG_PING)) {
 
                 /* Send pong message with the same payload */
-                websocket_send_msg(handle->client, payload, received, WEBSOCKET_OPCODE_PONG, true, true, CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT);
+                websocket_send_msg(handle->client, &message[offset], received, WEBSOCKET_OPCODE_PONG, true, true, CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT);
+
+            } else if ((WEBSOCKET_FLAG_BINARY == (message_type & WEBSOCKET_FLAG_BINARY))
+                       || ((true == fragments) && (0 == (message_type & (WEBSOCKET_FLAG_TEXT | WEBSOCKET_FLAG_CLOSE | WEBSOCKET_FLAG_PONG))))) {
 
-            } else if (WEBSOCKET_FLAG_BINARY == (message_type & WEBSOCKET_FLAG_BINARY)) {
+                /* Append the data to the message, it is truncated if it does not fit in the buffer */
+                fragments = true;
+                offset += (size_t)received;
+                if ((CONFIG_MENDER_WEBSOCKET_MESSAGE_LENGTH == offset) && ((0 != remaining) || (0 == (message_type & WEBSOCKET_FLAG_FINAL)))) {
+                    overflow = true;
+                    offset   = 0;
+                }
 
-                /* Invoke callback */
-                if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, payload, received, handle->params)) {
-                    mender_log_error("An error occurred");
+                /* Invoke callback once the message is complete */
+                if ((0 == remaining) && (WEBSOCKET_FLAG_FINAL == (message_type & WEBSOCKET_FLAG_FINAL))) {
+                    if (true == overflow) {
+                        mender_log_error("Message larger than %d bytes, it is dropped", CONFIG_MENDER_WEBSOCKET_MESSAGE_LENGTH);
+                    } else if (MENDER_OK != handle->callback(MENDER_WEBSOCKET_EVENT_DATA_RECEIVED, message, offset, handle->params)) {
+                        mender_log_error("An error occurred");
+                    }
+                    k_mem_slab_free(&mender_websocket_message_pool, (void *)message);
+                    message   = NULL;
+                    offset    = 0;
+                    fragments = false;
+                    overflow  = false;
                 }
             }
         }
@@ -334,5 +514,99 @@ END:
     handle->callback(MENDER_WEBSOCKET_EVENT_DISCONNECTED, NULL, 0, handle->params);
 
     /* Release memory */
-    free(payload);
+    if (NULL != message) {
+        k_mem_slab_free(&mender_websocket_message_pool, (void *)message);
+    }
+}
+
+static uint8_t *
+mender_websocket_message_alloc(mender_websocket_handle_t *handle) {
+
+    assert(NULL != handle);
+    void *block = NULL;
+
+    /* Wait for a buffer, the abort flag is checked periodically */
+    while (0 != k_mem_slab_alloc(&mender_websocket_message_pool, &block, K_MSEC(MENDER_WEBSOCKET_MESSAGE_POOL_WAIT))) {
+        if (true == handle->abort) {
+            return NULL;
+        }
+    }
+
+    return (uint8_t *)block;
+}
+
+#if (CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH > 0)
+
+static mender_err_t
+mender_websocket_queue_push(mender_websocket_handle_t *handle, mender_websocket_segment_t *segments, size_t count) {
+
+    assert(NULL != handle);
+    assert((NULL != segments) && (count > 0));
+    mender_err_t ret    = MENDER_OK;
+    size_t       length = 0;
+
+    /* Compute the length of the message */
+    for (size_t index = 0; index < count; index++) {
+        length += segments[index].length;
+    }
+    if (sizeof(size_t) + length > CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH) {
+        mender_log_error("Message larger than the send queue, it is dropped");
+        return MENDER_FAIL;
+    }
+
+    /* Append the message after the ones already queued, they are not moved while the websocket thread is sending them */
+    k_mutex_lock(&handle->queue_mutex, K_FOREVER);
+    if (handle->queue_length + sizeof(size_t) + length > CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH) {
+        ret = MENDER_BUSY;
+        goto END;
+    }
+    memcpy(&handle->queue[handle->queue_length], &length, sizeof(size_t));
+    handle->queue_length += sizeof(size_t);
+    for (size_t index = 0; index < count; index++) {
+        memcpy(&handle->queue[handle->queue_length], segments[index].data, segments[index].length);
+        handle->queue_length += segments[index].length;
+    }
+
+END:
+
+    k_mutex_unlock(&handle->queue_mutex);
+
+    return ret;
 }
+
+static void
+mender_websocket_queue_flush(mender_websocket_handle_t *handle) {
+
+    assert(NULL != handle);
+    size_t offset = 0;
+    size_t queue_length;
+    size_t length;
+    int    sent;
+
+    /* Retrieve the length of the messages to be sent, the ones queued meanwhile are sent at the next flush */
+    k_mutex_lock(&handle->queue_mutex, K_FOREVER);
+    queue_length = handle->queue_length;
+    k_mutex_unlock(&handle->queue_mutex);
+
+    /* Send the messages back-to-back, the queue is not locked meanwhile */
+    while (offset < queue_length) {
+        memcpy(&length, &handle->queue[offset], sizeof(size_t));
+        offset += sizeof(size_t);
+        if (length
+            != (sent = websocket_send_msg(
+                    handle->client, &handle->queue[offset], length, WEBSOCKET_OPCODE_DATA_BINARY, true, true, CONFIG_MENDER_WEBSOCKET_REQUEST_TIMEOUT))) {
+            mender_log_error("Unable to send data over websocket connection: %d", sent);
+        }
+        offset += length;
+    }
+
+    /* Release the messages sent */
+    if (offset > 0) {
+        k_mutex_lock(&handle->queue_mutex, K_FOREVER);
+        memmove(handle->queue, &handle->queue[offset], handle->queue_length - offset);
+        handle->queue_length -= offset;
+        k_mutex_unlock(&handle->queue_mutex);
+    }
+}
+
+#endif /* CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH */
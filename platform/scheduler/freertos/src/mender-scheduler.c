@@ -53,50 +53,392 @@
 #endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH */
 
 /**
- * @brief Work context
+ * @brief Default number of work queue threads, works are executed concurrently when it is greater than 1
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS
+#define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS (1)
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS */
+
+/**
+ * @brief Default work slack (seconds), works which timers expire within the slack when a work is executed are executed with it
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_WORK_SLACK
+#define CONFIG_MENDER_SCHEDULER_WORK_SLACK (0)
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_SLACK */
+
+/**
+ * @brief Default task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE
+#define CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE (4)
+#endif /* CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE */
+
+/**
+ * @brief Default task priority
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_TASK_PRIORITY
+#define CONFIG_MENDER_SCHEDULER_TASK_PRIORITY (5)
+#endif /* CONFIG_MENDER_SCHEDULER_TASK_PRIORITY */
+
+/**
+ * @brief Default core affinity of the work queue threads, -1 if they are not pinned to a core
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_WORK_QUEUE_CORE
+#define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_CORE (-1)
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_CORE */
+
+/**
+ * @brief Default core affinity of the task threads, -1 if they are not pinned to a core
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_TASK_CORE
+#define CONFIG_MENDER_SCHEDULER_TASK_CORE (-1)
+#endif /* CONFIG_MENDER_SCHEDULER_TASK_CORE */
+
+/**
+ * @brief Creation of the threads, they are pinned to the core selected on ESP-IDF and the core affinity is ignored on the other platforms
+ */
+#ifdef ESP_PLATFORM
+#define MENDER_SCHEDULER_CORE(core) (((core) < 0) ? tskNO_AFFINITY : (BaseType_t)(core))
+#define MENDER_SCHEDULER_THREAD_CREATE(function, name, depth, arg, priority, handle, core) \
+    xTaskCreatePinnedToCore((function), (name), (depth), (arg), (priority), (handle), MENDER_SCHEDULER_CORE(core))
+#define MENDER_SCHEDULER_THREAD_CREATE_STATIC(function, name, depth, arg, priority, stack, buffer, core) \
+    xTaskCreateStaticPinnedToCore((function), (name), (depth), (arg), (priority), (stack), (buffer), MENDER_SCHEDULER_CORE(core))
+#else
+#define MENDER_SCHEDULER_THREAD_CREATE(function, name, depth, arg, priority, handle, core) \
+    xTaskCreate((function), (name), (depth), (arg), (priority), (handle))
+#define MENDER_SCHEDULER_THREAD_CREATE_STATIC(function, name, depth, arg, priority, stack, buffer, core) \
+    xTaskCreateStatic((function), (name), (depth), (arg), (priority), (stack), (buffer))
+#endif /* ESP_PLATFORM */
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+#if (configSUPPORT_STATIC_ALLOCATION != 1)
+#error "configSUPPORT_STATIC_ALLOCATION must be enabled to use the static allocation mode of the scheduler"
+#endif /* (configSUPPORT_STATIC_ALLOCATION != 1) */
+
+/**
+ * @brief Default number of works of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_WORKS
+#define CONFIG_MENDER_SCHEDULER_STATIC_WORKS (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_WORKS */
+
+/**
+ * @brief Default number of mutexes of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES
+#define CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES */
+
+/**
+ * @brief Default number of tasks of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_TASKS
+#define CONFIG_MENDER_SCHEDULER_STATIC_TASKS (3)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_TASKS */
+
+/**
+ * @brief Default number of queues of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_QUEUES
+#define CONFIG_MENDER_SCHEDULER_STATIC_QUEUES (4)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_QUEUES */
+
+/**
+ * @brief Default storage size of the queues of the static pool (bytes), the length of the queue multiplied by the size of the items should not exceed it
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_STORAGE_SIZE
+#define CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_STORAGE_SIZE (64)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_STORAGE_SIZE */
+
+/**
+ * @brief Stack depth of the work queue threads and of the task threads, in units of StackType_t
+ */
+#define MENDER_SCHEDULER_WORK_QUEUE_STACK_DEPTH (CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE * 1024 / sizeof(StackType_t))
+#define MENDER_SCHEDULER_TASK_STACK_DEPTH       (CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE * 1024 / sizeof(StackType_t))
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+/**
+ * @brief Work counters
  */
 typedef struct {
-    mender_scheduler_work_params_t params;       /**< Work parameters */
-    SemaphoreHandle_t              sem_handle;   /**< Semaphore used to indicate work is pending or executing */
-    TimerHandle_t                  timer_handle; /**< Timer used to periodically execute work */
-    bool                           activated;    /**< Flag indicating the work is activated */
+    uint32_t executions;     /**< Number of executions of the work */
+    uint32_t overruns;       /**< Number of times the work was due while it was already pending or executing */
+    uint64_t latency_total;  /**< Sum of the delays between the submission of the work and the beginning of its execution (milliseconds) */
+    uint32_t latency_max;    /**< Maximum delay between the submission of the work and the beginning of its execution (milliseconds) */
+    uint64_t duration_total; /**< Sum of the execution times of the work (milliseconds) */
+    uint32_t duration_min;   /**< Minimum execution time of the work (milliseconds) */
+    uint32_t duration_max;   /**< Maximum execution time of the work (milliseconds) */
+} mender_scheduler_work_counters_t;
+
+/**
+ * @brief Work context
+ */
+typedef struct mender_scheduler_work_context {
+    mender_scheduler_work_params_t        params;       /**< Work parameters */
+    SemaphoreHandle_t                     sem_handle;   /**< Semaphore used to indicate work is pending or executing */
+    TimerHandle_t                         timer_handle; /**< Timer used to periodically execute work */
+    bool                                  activated;    /**< Flag indicating the work is activated */
+    struct mender_scheduler_work_context *next;         /**< Next work of the works list */
+    TickType_t                            submitted;    /**< Submission time of the work (ticks), valid when the work is pending */
+    mender_scheduler_work_counters_t      counters;     /**< Work counters */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    char name[configMAX_TASK_NAME_LEN]; /**< Work name, params.name points to it */
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 } mender_scheduler_work_context_t;
 
+/**
+ * @brief Task context
+ */
+typedef struct {
+    mender_scheduler_task_params_t params;      /**< Task parameters */
+    SemaphoreHandle_t              done_handle; /**< Semaphore given when the task function returns */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    TaskHandle_t      thread_handle;                            /**< Task thread handle, the thread is deleted when the task is joined */
+    char              name[configMAX_TASK_NAME_LEN];            /**< Task name, params.name points to it */
+    StaticSemaphore_t done_buffer;                              /**< Semaphore buffer */
+    StaticTask_t      thread_buffer;                            /**< Task thread buffer */
+    StackType_t       stack[MENDER_SCHEDULER_TASK_STACK_DEPTH]; /**< Task thread stack */
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+} mender_scheduler_task_context_t;
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Mutex context
+ */
+typedef struct {
+    SemaphoreHandle_t handle; /**< Mutex handle */
+    StaticSemaphore_t buffer; /**< Mutex buffer */
+} mender_scheduler_mutex_context_t;
+
+/**
+ * @brief Queue context
+ */
+typedef struct {
+    QueueHandle_t handle;                                                     /**< Queue handle */
+    StaticQueue_t buffer;                                                     /**< Queue buffer */
+    uint8_t       storage[CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_STORAGE_SIZE]; /**< Queue storage */
+} mender_scheduler_queue_context_t;
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
 /**
  * @brief Function used to handle work context timer when it expires
  * @param handle Timer handler
  */
 static void mender_scheduler_timer_callback(TimerHandle_t handle);
 
+#if CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0
+
+/**
+ * @brief Function used to submit the works which timers expire within the slack, so that they are executed with the work
+ * @param work_context Work context
+ */
+static void mender_scheduler_work_gather(mender_scheduler_work_context_t *work_context);
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0 */
+
+/**
+ * @brief Function used to submit a work to the work queue of its priority
+ * @param work_context Work context, NULL to ask a work queue thread to terminate
+ * @param delay Delay to wait room in the work queue (ticks)
+ * @return pdPASS if the work has been submitted, pdFAIL otherwise
+ */
+static BaseType_t mender_scheduler_work_queue_send(mender_scheduler_work_context_t *work_context, TickType_t delay);
+
+/**
+ * @brief Function used to wait and receive the work pending with the highest priority
+ * @param work_context Work context
+ * @return pdPASS if a work has been received, pdFAIL otherwise
+ */
+static BaseType_t mender_scheduler_work_queue_receive(mender_scheduler_work_context_t **work_context);
+
 /**
- * @brief Thread used to handle work queue
+ * @brief Function used to count an execution of a work
+ * @param counters Work counters
+ * @param latency Delay between the submission of the work and the beginning of its execution (milliseconds)
+ * @param duration Execution time of the work (milliseconds)
+ */
+static void mender_scheduler_work_count(mender_scheduler_work_counters_t *counters, uint32_t latency, uint32_t duration);
+
+/**
+ * @brief Function used to begin a batch if works are pending in the work queue
+ * @param work_context Context of the work about to be executed, it begins the batch
+ */
+static void mender_scheduler_batch_open(mender_scheduler_work_context_t *work_context);
+
+/**
+ * @brief Function used to end the batch if no work is pending in the work queue
+ */
+static void mender_scheduler_batch_close(void);
+
+/**
+ * @brief Thread used to handle work queue, several threads may run concurrently
  * @param arg Not used
  */
 static void mender_scheduler_work_queue_thread(void *arg);
 
 /**
- * @brief Work queue handle
+ * @brief Thread used to execute task function
+ * @param arg Task context
+ */
+static void mender_scheduler_task_thread(void *arg);
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Function used to take a free slot of a static pool
+ * @param used Flags indicating the slots of the pool are used
+ * @param count Number of slots of the pool
+ * @return Index of the slot, count if the pool is exhausted
+ */
+static size_t mender_scheduler_pool_take(bool *used, size_t count);
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+/**
+ * @brief Work queue handles, one per priority, and semaphore counting the works pending in the work queues
+ */
+static QueueHandle_t     mender_scheduler_work_queue_handles[MENDER_SCHEDULER_WORK_PRIORITIES] = { NULL };
+static SemaphoreHandle_t mender_scheduler_work_queue_count_handle                              = NULL;
+
+/**
+ * @brief Semaphore given by the work queue threads when they terminate
+ */
+static SemaphoreHandle_t mender_scheduler_work_queue_done_handle = NULL;
+
+/**
+ * @brief Work queue thread handles
+ */
+static TaskHandle_t mender_scheduler_work_queue_thread_handles[CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS];
+
+/**
+ * @brief Works list and mutex, the mutex also protects the batch
+ */
+static mender_scheduler_work_context_t *mender_scheduler_works        = NULL;
+static SemaphoreHandle_t                mender_scheduler_works_mutex = NULL;
+
+/**
+ * @brief Batch callbacks and flag indicating a batch is executing
+ */
+static mender_err_t (*mender_scheduler_batch_begin)(MENDER_SCHEDULER_WORK_ARG) = NULL;
+static mender_err_t (*mender_scheduler_batch_end)(MENDER_SCHEDULER_WORK_ARG)   = NULL;
+static bool mender_scheduler_batch        = false;
+static bool mender_scheduler_batch_opened = false;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+/**
+ * @brief Argument of the work which began the batch, the callbacks of the batch are invoked with it
+ */
+static void *mender_scheduler_batch_arg = NULL;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Static buffers of the work queues, of their semaphores, of the works mutex and of the work queue threads
  */
-static QueueHandle_t mender_scheduler_work_queue_handle = NULL;
+static StaticQueue_t     mender_scheduler_work_queue_buffers[MENDER_SCHEDULER_WORK_PRIORITIES];
+static uint8_t           mender_scheduler_work_queue_storages[MENDER_SCHEDULER_WORK_PRIORITIES]
+                                                   [CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH * sizeof(mender_scheduler_work_context_t *)];
+static StaticSemaphore_t mender_scheduler_work_queue_count_buffer;
+static StaticSemaphore_t mender_scheduler_work_queue_done_buffer;
+static StaticSemaphore_t mender_scheduler_works_mutex_buffer;
+static StaticTask_t      mender_scheduler_work_queue_thread_buffers[CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS];
+static StackType_t       mender_scheduler_work_queue_thread_stacks[CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS][MENDER_SCHEDULER_WORK_QUEUE_STACK_DEPTH];
+
+/**
+ * @brief Static pools of works, mutexes, tasks and queues, and flags indicating the slots of the pools are used
+ */
+static mender_scheduler_work_context_t  mender_scheduler_static_works[CONFIG_MENDER_SCHEDULER_STATIC_WORKS];
+static bool                             mender_scheduler_static_works_used[CONFIG_MENDER_SCHEDULER_STATIC_WORKS];
+static mender_scheduler_mutex_context_t mender_scheduler_static_mutexes[CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES];
+static bool                             mender_scheduler_static_mutexes_used[CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES];
+static mender_scheduler_task_context_t  mender_scheduler_static_tasks[CONFIG_MENDER_SCHEDULER_STATIC_TASKS];
+static bool                             mender_scheduler_static_tasks_used[CONFIG_MENDER_SCHEDULER_STATIC_TASKS];
+static mender_scheduler_queue_context_t mender_scheduler_static_queues[CONFIG_MENDER_SCHEDULER_STATIC_QUEUES];
+static bool                             mender_scheduler_static_queues_used[CONFIG_MENDER_SCHEDULER_STATIC_QUEUES];
+
+/**
+ * @brief Semaphores and timers of the static pool of works, they are created once and reused by the works using the slots of the pool
+ * This is required because deleting a timer only posts a command to the timer service task, so its buffer can not be reused immediately
+ */
+static SemaphoreHandle_t mender_scheduler_static_works_sem_handles[CONFIG_MENDER_SCHEDULER_STATIC_WORKS];
+static StaticSemaphore_t mender_scheduler_static_works_sem_buffers[CONFIG_MENDER_SCHEDULER_STATIC_WORKS];
+static TimerHandle_t     mender_scheduler_static_works_timer_handles[CONFIG_MENDER_SCHEDULER_STATIC_WORKS];
+static StaticTimer_t     mender_scheduler_static_works_timer_buffers[CONFIG_MENDER_SCHEDULER_STATIC_WORKS];
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
 mender_err_t
 mender_scheduler_init(void) {
 
-    /* Create and start work queue */
-    if (NULL == (mender_scheduler_work_queue_handle = xQueueCreate(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH, sizeof(mender_scheduler_work_context_t *)))) {
-        mender_log_error("Unable to create work queue");
+    /* Create works list mutex */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_works_mutex = xSemaphoreCreateMutexStatic(&mender_scheduler_works_mutex_buffer);
+#else
+    mender_scheduler_works_mutex = xSemaphoreCreateMutex();
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    if (NULL == mender_scheduler_works_mutex) {
+        mender_log_error("Unable to create works mutex");
         return MENDER_FAIL;
     }
-    if (pdPASS
-        != xTaskCreate(mender_scheduler_work_queue_thread,
-                       "mender_scheduler_work_queue",
-                       (configSTACK_DEPTH_TYPE)(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE * 1024 / sizeof(configSTACK_DEPTH_TYPE)),
-                       NULL,
-                       CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY,
-                       NULL)) {
-        mender_log_error("Unable to create work queue thread");
+
+    /* Create and start work queues */
+    for (size_t priority = 0; priority < MENDER_SCHEDULER_WORK_PRIORITIES; priority++) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        mender_scheduler_work_queue_handles[priority] = xQueueCreateStatic(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH,
+                                                                           sizeof(mender_scheduler_work_context_t *),
+                                                                           mender_scheduler_work_queue_storages[priority],
+                                                                           &mender_scheduler_work_queue_buffers[priority]);
+#else
+        mender_scheduler_work_queue_handles[priority] = xQueueCreate(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH, sizeof(mender_scheduler_work_context_t *));
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+        if (NULL == mender_scheduler_work_queue_handles[priority]) {
+            mender_log_error("Unable to create work queue");
+            return MENDER_FAIL;
+        }
+    }
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_work_queue_count_handle = xSemaphoreCreateCountingStatic(
+        MENDER_SCHEDULER_WORK_PRIORITIES * CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH, 0, &mender_scheduler_work_queue_count_buffer);
+    mender_scheduler_work_queue_done_handle
+        = xSemaphoreCreateCountingStatic(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS, 0, &mender_scheduler_work_queue_done_buffer);
+#else
+    mender_scheduler_work_queue_count_handle = xSemaphoreCreateCounting(MENDER_SCHEDULER_WORK_PRIORITIES * CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH, 0);
+    mender_scheduler_work_queue_done_handle  = xSemaphoreCreateCounting(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS, 0);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    if ((NULL == mender_scheduler_work_queue_count_handle) || (NULL == mender_scheduler_work_queue_done_handle)) {
+        mender_log_error("Unable to create work queue semaphore");
         return MENDER_FAIL;
     }
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS; index++) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        if (NULL
+            == (mender_scheduler_work_queue_thread_handles[index] = MENDER_SCHEDULER_THREAD_CREATE_STATIC(mender_scheduler_work_queue_thread,
+                                                                                                          "mender_scheduler_work_queue",
+                                                                                                          MENDER_SCHEDULER_WORK_QUEUE_STACK_DEPTH,
+                                                                                                          NULL,
+                                                                                                          CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY,
+                                                                                                          mender_scheduler_work_queue_thread_stacks[index],
+                                                                                                          &mender_scheduler_work_queue_thread_buffers[index],
+                                                                                                          CONFIG_MENDER_SCHEDULER_WORK_QUEUE_CORE))) {
+#else
+        if (pdPASS
+            != MENDER_SCHEDULER_THREAD_CREATE(mender_scheduler_work_queue_thread,
+                                              "mender_scheduler_work_queue",
+                                              (configSTACK_DEPTH_TYPE)(CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE * 1024 / sizeof(configSTACK_DEPTH_TYPE)),
+                                              NULL,
+                                              CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY,
+                                              &mender_scheduler_work_queue_thread_handles[index],
+                                              CONFIG_MENDER_SCHEDULER_WORK_QUEUE_CORE)) {
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+            mender_log_error("Unable to create work queue thread");
+            return MENDER_FAIL;
+        }
+    }
 
     return MENDER_OK;
 }
@@ -110,20 +452,68 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
     assert(NULL != handle);
 
     /* Create work context */
-    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)malloc(sizeof(mender_scheduler_work_context_t));
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_work_context_t *work_context = NULL;
+    size_t                           index        = mender_scheduler_pool_take(mender_scheduler_static_works_used, CONFIG_MENDER_SCHEDULER_STATIC_WORKS);
+    if (CONFIG_MENDER_SCHEDULER_STATIC_WORKS == index) {
+        mender_log_error("Unable to allocate work, the static pool is exhausted");
+        goto FAIL;
+    }
+    work_context = &mender_scheduler_static_works[index];
+#else
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_utils_malloc(sizeof(mender_scheduler_work_context_t));
     if (NULL == work_context) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     memset(work_context, 0, sizeof(mender_scheduler_work_context_t));
 
     /* Copy work parameters */
     work_context->params.function = work_params->function;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    work_context->params.arg = work_params->arg;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
     work_context->params.period   = work_params->period;
-    if (NULL == (work_context->params.name = strdup(work_params->name))) {
+    work_context->params.priority = work_params->priority;
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    strncpy(work_context->name, work_params->name, sizeof(work_context->name) - 1);
+    work_context->params.name = work_context->name;
+#else
+    if (NULL == (work_context->params.name = mender_utils_strdup(work_params->name))) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+    /* Create semaphore used to protect work function, or reset the one of the slot */
+    if (NULL == mender_scheduler_static_works_sem_handles[index]) {
+        mender_scheduler_static_works_sem_handles[index] = xSemaphoreCreateBinaryStatic(&mender_scheduler_static_works_sem_buffers[index]);
+    } else {
+        xSemaphoreTake(mender_scheduler_static_works_sem_handles[index], 0);
+    }
+    if (NULL == (work_context->sem_handle = mender_scheduler_static_works_sem_handles[index])) {
+        mender_log_error("Unable to create semaphore");
+        goto FAIL;
+    }
+
+    /* Create timer to handle the work periodically, or reuse the one of the slot, the period is set when the work is activated */
+    if (NULL == mender_scheduler_static_works_timer_handles[index]) {
+        mender_scheduler_static_works_timer_handles[index] = xTimerCreateStatic("mender_scheduler_work",
+                                                                                portMAX_DELAY,
+                                                                                pdTRUE,
+                                                                                work_context,
+                                                                                mender_scheduler_timer_callback,
+                                                                                &mender_scheduler_static_works_timer_buffers[index]);
+    }
+    if (NULL == (work_context->timer_handle = mender_scheduler_static_works_timer_handles[index])) {
+        mender_log_error("Unable to create timer");
+        goto FAIL;
+    }
+
+#else
 
     /* Create semaphore used to protect work function */
     if (NULL == (work_context->sem_handle = xSemaphoreCreateBinary())) {
@@ -143,6 +533,14 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
         goto FAIL;
     }
 
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    /* Add the work to the works list */
+    xSemaphoreTake(mender_scheduler_works_mutex, portMAX_DELAY);
+    work_context->next     = mender_scheduler_works;
+    mender_scheduler_works = work_context;
+    xSemaphoreGive(mender_scheduler_works_mutex);
+
     /* Return handle to the new work */
     *handle = (void *)work_context;
 
@@ -152,6 +550,9 @@ FAIL:
 
     /* Release memory */
     if (NULL != work_context) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        mender_scheduler_static_works_used[work_context - mender_scheduler_static_works] = false;
+#else
         if (NULL != work_context->timer_handle) {
             xTimerDelete(work_context->timer_handle, portMAX_DELAY);
         }
@@ -159,9 +560,10 @@ FAIL:
             vSemaphoreDelete(work_context->sem_handle);
         }
         if (NULL != work_context->params.name) {
-            free(work_context->params.name);
+            mender_utils_free(work_context->params.name);
         }
-        free(work_context);
+        mender_utils_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     }
 
     return MENDER_FAIL;
@@ -184,8 +586,8 @@ mender_scheduler_work_activate(void *handle) {
     /* Check the timer period */
     if (work_context->params.period > 0) {
 
-        /* Start the timer to handle the work */
-        if (pdPASS != xTimerStart(work_context->timer_handle, portMAX_DELAY)) {
+        /* Start the timer to handle the work with its period */
+        if (pdPASS != xTimerChangePeriod(work_context->timer_handle, (1000 * work_context->params.period) / portTICK_PERIOD_MS, portMAX_DELAY)) {
             mender_log_error("Unable to start timer");
             return MENDER_FAIL;
         }
@@ -277,13 +679,95 @@ mender_scheduler_work_delete(void *handle) {
     /* Get work context */
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
+    /* Remove the work from the works list */
+    xSemaphoreTake(mender_scheduler_works_mutex, portMAX_DELAY);
+    mender_scheduler_work_context_t **link = &mender_scheduler_works;
+    while ((NULL != *link) && (work_context != *link)) {
+        link = &(*link)->next;
+    }
+    if (NULL != *link) {
+        *link = work_context->next;
+    }
+    xSemaphoreGive(mender_scheduler_works_mutex);
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    /* Stop the timer, it is kept with the semaphore for the next work using the slot, then release the slot */
+    xTimerStop(work_context->timer_handle, portMAX_DELAY);
+    while (pdFALSE != xTimerIsTimerActive(work_context->timer_handle)) {
+        vTaskDelay(1);
+    }
+    mender_scheduler_static_works_used[work_context - mender_scheduler_static_works] = false;
+#else
     /* Release memory */
     xTimerDelete(work_context->timer_handle, portMAX_DELAY);
     vSemaphoreDelete(work_context->sem_handle);
     if (NULL != work_context->params.name) {
-        free(work_context->params.name);
+        mender_utils_free(work_context->params.name);
+    }
+    mender_utils_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_get_statistics(void *handle, mender_scheduler_work_statistics_t *statistics) {
+
+    assert(NULL != handle);
+    assert(NULL != statistics);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Compute statistics from the work counters, they are updated by the work queue threads without lock and may be slightly inconsistent */
+    mender_scheduler_work_counters_t counters = work_context->counters;
+    memset(statistics, 0, sizeof(mender_scheduler_work_statistics_t));
+    statistics->executions = counters.executions;
+    statistics->overruns   = counters.overruns;
+    if (counters.executions > 0) {
+        statistics->latency_avg  = (uint32_t)(counters.latency_total / counters.executions);
+        statistics->latency_max  = counters.latency_max;
+        statistics->duration_min = counters.duration_min;
+        statistics->duration_avg = (uint32_t)(counters.duration_total / counters.executions);
+        statistics->duration_max = counters.duration_max;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_get_work_queue_stack_space(size_t *space) {
+
+    assert(NULL != space);
+
+#if (INCLUDE_uxTaskGetStackHighWaterMark == 1)
+    /* Get the minimum stack high water mark of the work queue threads, ESP-IDF reports it in bytes */
+    *space = SIZE_MAX;
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS; index++) {
+        size_t unused = (size_t)uxTaskGetStackHighWaterMark(mender_scheduler_work_queue_thread_handles[index]);
+#ifndef ESP_PLATFORM
+        unused *= sizeof(StackType_t);
+#endif /* ESP_PLATFORM */
+        if (unused < *space) {
+            *space = unused;
+        }
     }
-    free(work_context);
+
+    return MENDER_OK;
+#else
+    /* Stack high water mark is not available */
+    return MENDER_NOT_IMPLEMENTED;
+#endif /* (INCLUDE_uxTaskGetStackHighWaterMark == 1) */
+}
+
+mender_err_t
+mender_scheduler_set_batch_callbacks(mender_err_t (*begin)(MENDER_SCHEDULER_WORK_ARG), mender_err_t (*end)(MENDER_SCHEDULER_WORK_ARG)) {
+
+    /* Set batch callbacks */
+    xSemaphoreTake(mender_scheduler_works_mutex, portMAX_DELAY);
+    mender_scheduler_batch_begin = begin;
+    mender_scheduler_batch_end   = end;
+    xSemaphoreGive(mender_scheduler_works_mutex);
 
     return MENDER_OK;
 }
@@ -294,9 +778,22 @@ mender_scheduler_mutex_create(void **handle) {
     assert(NULL != handle);
 
     /* Create mutex */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    size_t index = mender_scheduler_pool_take(mender_scheduler_static_mutexes_used, CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES);
+    if (CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES == index) {
+        mender_log_error("Unable to allocate mutex, the static pool is exhausted");
+        return MENDER_FAIL;
+    }
+    mender_scheduler_static_mutexes[index].handle = xSemaphoreCreateMutexStatic(&mender_scheduler_static_mutexes[index].buffer);
+    if (NULL == (*handle = (void *)mender_scheduler_static_mutexes[index].handle)) {
+        mender_scheduler_static_mutexes_used[index] = false;
+        return MENDER_FAIL;
+    }
+#else
     if (NULL == (*handle = (void *)xSemaphoreCreateMutex())) {
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     return MENDER_OK;
 }
@@ -334,6 +831,255 @@ mender_scheduler_mutex_delete(void *handle) {
 
     /* Release memory */
     vSemaphoreDelete((SemaphoreHandle_t)handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES; index++) {
+        if ((true == mender_scheduler_static_mutexes_used[index]) && ((SemaphoreHandle_t)handle == mender_scheduler_static_mutexes[index].handle)) {
+            mender_scheduler_static_mutexes[index].handle = NULL;
+            mender_scheduler_static_mutexes_used[index]   = false;
+            break;
+        }
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
+
+    assert(NULL != task_params);
+    assert(NULL != task_params->function);
+    assert(NULL != task_params->name);
+    assert(NULL != handle);
+
+    /* Create task context */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_task_context_t *task_context = NULL;
+    size_t                           index        = mender_scheduler_pool_take(mender_scheduler_static_tasks_used, CONFIG_MENDER_SCHEDULER_STATIC_TASKS);
+    if (CONFIG_MENDER_SCHEDULER_STATIC_TASKS == index) {
+        mender_log_error("Unable to allocate task, the static pool is exhausted");
+        goto FAIL;
+    }
+    task_context = &mender_scheduler_static_tasks[index];
+    memset(task_context, 0, sizeof(mender_scheduler_task_context_t));
+#else
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_utils_malloc(sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+    memset(task_context, 0, sizeof(mender_scheduler_task_context_t));
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    /* Copy task parameters */
+    task_context->params.function = task_params->function;
+    task_context->params.arg      = task_params->arg;
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    strncpy(task_context->name, task_params->name, sizeof(task_context->name) - 1);
+    task_context->params.name = task_context->name;
+#else
+    if (NULL == (task_context->params.name = mender_utils_strdup(task_params->name))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    /* Create semaphore used to wait the end of the task */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    task_context->done_handle = xSemaphoreCreateBinaryStatic(&task_context->done_buffer);
+#else
+    task_context->done_handle = xSemaphoreCreateBinary();
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    if (NULL == task_context->done_handle) {
+        mender_log_error("Unable to create semaphore");
+        goto FAIL;
+    }
+
+    /* Create and start task thread */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (NULL
+        == (task_context->thread_handle = MENDER_SCHEDULER_THREAD_CREATE_STATIC(mender_scheduler_task_thread,
+                                                                                task_context->params.name,
+                                                                                MENDER_SCHEDULER_TASK_STACK_DEPTH,
+                                                                                task_context,
+                                                                                CONFIG_MENDER_SCHEDULER_TASK_PRIORITY,
+                                                                                task_context->stack,
+                                                                                &task_context->thread_buffer,
+                                                                                CONFIG_MENDER_SCHEDULER_TASK_CORE))) {
+#else
+    if (pdPASS
+        != MENDER_SCHEDULER_THREAD_CREATE(mender_scheduler_task_thread,
+                                          task_context->params.name,
+                                          (configSTACK_DEPTH_TYPE)(CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE * 1024 / sizeof(configSTACK_DEPTH_TYPE)),
+                                          task_context,
+                                          CONFIG_MENDER_SCHEDULER_TASK_PRIORITY,
+                                          NULL,
+                                          CONFIG_MENDER_SCHEDULER_TASK_CORE)) {
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+        mender_log_error("Unable to create task thread");
+        goto FAIL;
+    }
+
+    /* Return handle to the new task context */
+    *handle = (void *)task_context;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != task_context) {
+        if (NULL != task_context->done_handle) {
+            vSemaphoreDelete(task_context->done_handle);
+        }
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        mender_scheduler_static_tasks_used[task_context - mender_scheduler_static_tasks] = false;
+#else
+        if (NULL != task_context->params.name) {
+            mender_utils_free(task_context->params.name);
+        }
+        mender_utils_free(task_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+    }
+    *handle = NULL;
+
+    return MENDER_FAIL;
+}
+
+mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)handle;
+
+    /* Wait end of execution of the task thread */
+    if (pdPASS != xSemaphoreTake(task_context->done_handle, portMAX_DELAY)) {
+        mender_log_error("Unable to join task '%s'", task_context->params.name);
+        return MENDER_FAIL;
+    }
+
+    /* Release memory */
+    vSemaphoreDelete(task_context->done_handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    vTaskDelete(task_context->thread_handle);
+    mender_scheduler_static_tasks_used[task_context - mender_scheduler_static_tasks] = false;
+#else
+    mender_utils_free(task_context->params.name);
+    mender_utils_free(task_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_create(size_t length, size_t item_size, void **handle) {
+
+    assert(0 != length);
+    assert(0 != item_size);
+    assert(NULL != handle);
+
+    /* Create queue */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    if (length * item_size > CONFIG_MENDER_SCHEDULER_STATIC_QUEUE_STORAGE_SIZE) {
+        mender_log_error("Unable to create queue, the storage of the static pool is too small");
+        return MENDER_FAIL;
+    }
+    size_t index = mender_scheduler_pool_take(mender_scheduler_static_queues_used, CONFIG_MENDER_SCHEDULER_STATIC_QUEUES);
+    if (CONFIG_MENDER_SCHEDULER_STATIC_QUEUES == index) {
+        mender_log_error("Unable to allocate queue, the static pool is exhausted");
+        return MENDER_FAIL;
+    }
+    mender_scheduler_static_queues[index].handle
+        = xQueueCreateStatic(length, item_size, mender_scheduler_static_queues[index].storage, &mender_scheduler_static_queues[index].buffer);
+    if (NULL == (*handle = (void *)mender_scheduler_static_queues[index].handle)) {
+        mender_log_error("Unable to create queue");
+        mender_scheduler_static_queues_used[index] = false;
+        return MENDER_FAIL;
+    }
+#else
+    if (NULL == (*handle = (void *)xQueueCreate(length, item_size))) {
+        mender_log_error("Unable to create queue");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+
+    /* Send item */
+    if (pdPASS != xQueueSend((QueueHandle_t)handle, item, (delay_ms >= 0) ? (delay_ms / portTICK_PERIOD_MS) : portMAX_DELAY)) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+
+    /* Receive item */
+    if (pdPASS != xQueueReceive((QueueHandle_t)handle, item, (delay_ms >= 0) ? (delay_ms / portTICK_PERIOD_MS) : portMAX_DELAY)) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_delete(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Release memory */
+    vQueueDelete((QueueHandle_t)handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_STATIC_QUEUES; index++) {
+        if ((true == mender_scheduler_static_queues_used[index]) && ((QueueHandle_t)handle == mender_scheduler_static_queues[index].handle)) {
+            mender_scheduler_static_queues[index].handle = NULL;
+            mender_scheduler_static_queues_used[index]   = false;
+            break;
+        }
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_get_uptime(uint64_t *uptime) {
+
+    assert(NULL != uptime);
+    static TickType_t last  = 0;
+    static uint64_t   wraps = 0;
+    TickType_t        ticks = xTaskGetTickCount();
+
+    /* Get uptime, wrap around of the tick counter is detected as long as the function is called at least once per period of the counter */
+    if (ticks < last) {
+        wraps++;
+    }
+    last    = ticks;
+    *uptime = (wraps * ((uint64_t)portMAX_DELAY + 1) + (uint64_t)ticks) * portTICK_PERIOD_MS;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_delay(uint32_t delay_ms) {
+
+    /* Suspend the task, at least one tick so that the delay is not lost */
+    TickType_t ticks = pdMS_TO_TICKS(delay_ms);
+    vTaskDelay((0 != ticks) ? ticks : 1);
 
     return MENDER_OK;
 }
@@ -341,12 +1087,39 @@ mender_scheduler_mutex_delete(void *handle) {
 mender_err_t
 mender_scheduler_exit(void) {
 
-    /* Submit empty work to the work queue, this ask the work queue thread to terminate */
+    /* Submit one empty work per work queue thread to the work queue, this ask the work queue threads to terminate */
     mender_scheduler_work_context_t *work_context = NULL;
-    if (pdPASS != xQueueSend(mender_scheduler_work_queue_handle, &work_context, portMAX_DELAY)) {
-        mender_log_error("Unable to submit empty work to the work queue");
-        return MENDER_FAIL;
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS; index++) {
+        if (pdPASS != mender_scheduler_work_queue_send(work_context, portMAX_DELAY)) {
+            mender_log_error("Unable to submit empty work to the work queue");
+            return MENDER_FAIL;
+        }
+    }
+
+    /* Wait end of execution of the work queue threads */
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS; index++) {
+        xSemaphoreTake(mender_scheduler_work_queue_done_handle, portMAX_DELAY);
+    }
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS; index++) {
+        vTaskDelete(mender_scheduler_work_queue_thread_handles[index]);
+    }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    /* End the batch which was executing (if any) */
+    mender_scheduler_batch_close();
+
+    /* Release memory */
+    for (size_t priority = 0; priority < MENDER_SCHEDULER_WORK_PRIORITIES; priority++) {
+        vQueueDelete(mender_scheduler_work_queue_handles[priority]);
+        mender_scheduler_work_queue_handles[priority] = NULL;
     }
+    vSemaphoreDelete(mender_scheduler_work_queue_count_handle);
+    mender_scheduler_work_queue_count_handle = NULL;
+    vSemaphoreDelete(mender_scheduler_work_queue_done_handle);
+    mender_scheduler_work_queue_done_handle = NULL;
+    vSemaphoreDelete(mender_scheduler_works_mutex);
+    mender_scheduler_works_mutex = NULL;
 
     return MENDER_OK;
 }
@@ -363,16 +1136,141 @@ mender_scheduler_timer_callback(TimerHandle_t handle) {
     /* Exit if the work is already pending or executing */
     if (pdPASS != xSemaphoreTake(work_context->sem_handle, 0)) {
         mender_log_debug("Work '%s' is not activated, already pending or executing", work_context->params.name);
+        if (true == work_context->activated) {
+            work_context->counters.overruns++;
+        }
         return;
     }
+    work_context->submitted = xTaskGetTickCount();
 
     /* Submit the work to the work queue */
-    if (pdPASS != xQueueSend(mender_scheduler_work_queue_handle, &work_context, 0)) {
+    if (pdPASS != mender_scheduler_work_queue_send(work_context, 0)) {
         mender_log_warning("Unable to submit work '%s' to the work queue", work_context->params.name);
         xSemaphoreGive(work_context->sem_handle);
     }
 }
 
+#if CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0
+
+static void
+mender_scheduler_work_gather(mender_scheduler_work_context_t *work_context) {
+
+    assert(NULL != work_context);
+    TickType_t now = xTaskGetTickCount();
+
+    /* Submit the works which timers expire within the slack, their timers are restarted */
+    xSemaphoreTake(mender_scheduler_works_mutex, portMAX_DELAY);
+    for (mender_scheduler_work_context_t *other = mender_scheduler_works; NULL != other; other = other->next) {
+        if ((other != work_context) && (true == other->activated) && (pdFALSE != xTimerIsTimerActive(other->timer_handle))
+            && ((TickType_t)(xTimerGetExpiryTime(other->timer_handle) - now) <= (1000 * CONFIG_MENDER_SCHEDULER_WORK_SLACK) / portTICK_PERIOD_MS)) {
+            xTimerReset(other->timer_handle, portMAX_DELAY);
+            mender_scheduler_timer_callback(other->timer_handle);
+        }
+    }
+    xSemaphoreGive(mender_scheduler_works_mutex);
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0 */
+
+static BaseType_t
+mender_scheduler_work_queue_send(mender_scheduler_work_context_t *work_context, TickType_t delay) {
+
+    /* Submit the work to the work queue of its priority, then count it */
+    mender_scheduler_work_priority_t priority = (NULL != work_context) ? work_context->params.priority : MENDER_SCHEDULER_WORK_PRIORITY_LOW;
+    if (pdPASS != xQueueSend(mender_scheduler_work_queue_handles[priority], &work_context, delay)) {
+        return pdFAIL;
+    }
+    xSemaphoreGive(mender_scheduler_work_queue_count_handle);
+
+    return pdPASS;
+}
+
+static BaseType_t
+mender_scheduler_work_queue_receive(mender_scheduler_work_context_t **work_context) {
+
+    assert(NULL != work_context);
+
+    /* Wait a work, then receive it from the work queue with the highest priority */
+    if (pdPASS != xSemaphoreTake(mender_scheduler_work_queue_count_handle, portMAX_DELAY)) {
+        return pdFAIL;
+    }
+    for (size_t priority = MENDER_SCHEDULER_WORK_PRIORITIES; priority > 0; priority--) {
+        if (pdPASS == xQueueReceive(mender_scheduler_work_queue_handles[priority - 1], work_context, 0)) {
+            return pdPASS;
+        }
+    }
+
+    return pdFAIL;
+}
+
+static void
+mender_scheduler_work_count(mender_scheduler_work_counters_t *counters, uint32_t latency, uint32_t duration) {
+
+    assert(NULL != counters);
+
+    /* Update the work counters */
+    counters->latency_total += latency;
+    if (latency > counters->latency_max) {
+        counters->latency_max = latency;
+    }
+    counters->duration_total += duration;
+    if ((0 == counters->executions) || (duration < counters->duration_min)) {
+        counters->duration_min = duration;
+    }
+    if (duration > counters->duration_max) {
+        counters->duration_max = duration;
+    }
+    counters->executions++;
+}
+
+static void
+mender_scheduler_batch_open(mender_scheduler_work_context_t *work_context) {
+
+    assert(NULL != work_context);
+#ifndef CONFIG_MENDER_CLIENT_CONTEXTS
+    (void)work_context;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Begin a batch if works are pending and no batch is executing */
+    xSemaphoreTake(mender_scheduler_works_mutex, portMAX_DELAY);
+    if ((true != mender_scheduler_batch) && (uxSemaphoreGetCount(mender_scheduler_work_queue_count_handle) > 0)) {
+        mender_scheduler_batch = true;
+        if (NULL != mender_scheduler_batch_begin) {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+            if (MENDER_OK == mender_scheduler_batch_begin(work_context->params.arg)) {
+                mender_scheduler_batch_opened = true;
+                mender_scheduler_batch_arg    = work_context->params.arg;
+#else
+            if (MENDER_OK == mender_scheduler_batch_begin()) {
+                mender_scheduler_batch_opened = true;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+            } else {
+                mender_log_warning("Unable to begin batch of works");
+            }
+        }
+    }
+    xSemaphoreGive(mender_scheduler_works_mutex);
+}
+
+static void
+mender_scheduler_batch_close(void) {
+
+    /* End the batch if it is executing and no work is pending */
+    xSemaphoreTake(mender_scheduler_works_mutex, portMAX_DELAY);
+    if ((true == mender_scheduler_batch) && (0 == uxSemaphoreGetCount(mender_scheduler_work_queue_count_handle))) {
+        if ((true == mender_scheduler_batch_opened) && (NULL != mender_scheduler_batch_end)) {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+            mender_scheduler_batch_end(mender_scheduler_batch_arg);
+#else
+            mender_scheduler_batch_end();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+        }
+        mender_scheduler_batch        = false;
+        mender_scheduler_batch_opened = false;
+    }
+    xSemaphoreGive(mender_scheduler_works_mutex);
+}
+
 static void
 mender_scheduler_work_queue_thread(void *arg) {
 
@@ -380,15 +1278,32 @@ mender_scheduler_work_queue_thread(void *arg) {
     mender_scheduler_work_context_t *work_context = NULL;
 
     /* Handle work to be executed */
-    while (pdPASS == xQueueReceive(mender_scheduler_work_queue_handle, &work_context, portMAX_DELAY)) {
+    while (pdPASS == mender_scheduler_work_queue_receive(&work_context)) {
 
         /* Check if empty work is received from the work queue, this ask the work queue thread to terminate */
         if (NULL == work_context) {
             goto END;
         }
 
+#if CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0
+        /* Gather the works which timers expire soon */
+        mender_scheduler_work_gather(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0 */
+
+        /* Begin a batch if other works are pending, they are executed back-to-back */
+        mender_scheduler_batch_open(work_context);
+
         /* Call work function */
-        if (MENDER_DONE == work_context->params.function()) {
+        TickType_t   start = xTaskGetTickCount();
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+        mender_err_t ret   = work_context->params.function(work_context->params.arg);
+#else
+        mender_err_t ret   = work_context->params.function();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+        mender_scheduler_work_count(&work_context->counters,
+                                    (uint32_t)((start - work_context->submitted) * portTICK_PERIOD_MS),
+                                    (uint32_t)((xTaskGetTickCount() - start) * portTICK_PERIOD_MS));
+        if (MENDER_DONE == ret) {
 
             /* Work is done, stop timer used to execute the work periodically */
             xTimerStop(work_context->timer_handle, portMAX_DELAY);
@@ -399,14 +1314,63 @@ mender_scheduler_work_queue_thread(void *arg) {
 
         /* Release semaphore used to protect the work function */
         xSemaphoreGive(work_context->sem_handle);
+
+        /* End the batch if no other work is pending */
+        mender_scheduler_batch_close();
     }
 
 END:
 
-    /* Release memory */
-    vQueueDelete(mender_scheduler_work_queue_handle);
-    mender_scheduler_work_queue_handle = NULL;
+    /* Indicate the work queue thread terminates and terminate it */
+    xSemaphoreGive(mender_scheduler_work_queue_done_handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    /* The thread is deleted by mender_scheduler_exit, this ensures its static buffers are no longer used when the scheduler is initialized again */
+    vTaskSuspend(NULL);
+#else
+    vTaskDelete(NULL);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+}
+
+static void
+mender_scheduler_task_thread(void *arg) {
+
+    assert(NULL != arg);
 
-    /* Terminate work queue thread */
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)arg;
+
+    /* Call task function */
+    task_context->params.function(task_context->params.arg);
+
+    /* Indicate the task function returned and terminate task thread */
+    xSemaphoreGive(task_context->done_handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    /* The thread is deleted when the task is joined, this ensures its static buffers are no longer used when the slot is released */
+    vTaskSuspend(NULL);
+#else
     vTaskDelete(NULL);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+}
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+static size_t
+mender_scheduler_pool_take(bool *used, size_t count) {
+
+    assert(NULL != used);
+    size_t index;
+
+    /* Take the first free slot of the pool, the scheduler is suspended so that slots are taken atomically */
+    vTaskSuspendAll();
+    for (index = 0; index < count; index++) {
+        if (true != used[index]) {
+            used[index] = true;
+            break;
+        }
+    }
+    xTaskResumeAll();
+
+    return index;
 }
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
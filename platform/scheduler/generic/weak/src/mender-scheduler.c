@@ -82,6 +82,35 @@ mender_scheduler_work_delete(void *handle) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_scheduler_work_get_statistics(void *handle, mender_scheduler_work_statistics_t *statistics) {
+
+    (void)handle;
+    (void)statistics;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_get_work_queue_stack_space(size_t *space) {
+
+    (void)space;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_set_batch_callbacks(mender_err_t (*begin)(MENDER_SCHEDULER_WORK_ARG), mender_err_t (*end)(MENDER_SCHEDULER_WORK_ARG)) {
+
+    (void)begin;
+    (void)end;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_scheduler_mutex_create(void **handle) {
 
@@ -119,6 +148,85 @@ mender_scheduler_mutex_delete(void *handle) {
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
+
+    (void)task_params;
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_queue_create(size_t length, size_t item_size, void **handle) {
+
+    (void)length;
+    (void)item_size;
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms) {
+
+    (void)handle;
+    (void)item;
+    (void)delay_ms;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms) {
+
+    (void)handle;
+    (void)item;
+    (void)delay_ms;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_queue_delete(void *handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_get_uptime(uint64_t *uptime) {
+
+    (void)uptime;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_scheduler_delay(uint32_t delay_ms) {
+
+    (void)delay_ms;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_scheduler_exit(void) {
 
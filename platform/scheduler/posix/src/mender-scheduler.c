@@ -18,10 +18,7 @@
  */
 
 #include <errno.h>
-#include <math.h>
-#include <mqueue.h>
 #include <pthread.h>
-#include <signal.h>
 #include <time.h>
 #include <unistd.h>
 #include "mender-log.h"
@@ -42,67 +39,238 @@
 #endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY */
 
 /**
- * @brief Default work queue length
+ * @brief Default number of work queue threads, works are executed concurrently when it is greater than 1
  */
-#ifndef CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH
-#define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH (10)
-#endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH */
+#ifndef CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS
+#define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS (1)
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS */
 
 /**
- * @brief Work context
+ * @brief Default work slack (seconds), works which timers expire within the slack of an expired timer are executed with it
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_WORK_SLACK
+#define CONFIG_MENDER_SCHEDULER_WORK_SLACK (0)
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_SLACK */
+
+/**
+ * @brief Default task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE
+#define CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE (64)
+#endif /* CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE */
+
+/**
+ * @brief Index of the works which are not in the timers heap
+ */
+#define MENDER_SCHEDULER_TIMER_DISARMED (SIZE_MAX)
+
+/**
+ * @brief Work counters
  */
 typedef struct {
-    mender_scheduler_work_params_t params;       /**< Work parameters */
-    pthread_mutex_t                sem_handle;   /**< Semaphore used to indicate work is pending or executing */
-    timer_t                        timer_handle; /**< Timer used to periodically execute work */
-    bool                           activated;    /**< Flag indicating the work is activated */
+    uint32_t executions;     /**< Number of executions of the work */
+    uint32_t overruns;       /**< Number of times the work was due while it was already pending or executing */
+    uint64_t latency_total;  /**< Sum of the delays between the submission of the work and the beginning of its execution (milliseconds) */
+    uint32_t latency_max;    /**< Maximum delay between the submission of the work and the beginning of its execution (milliseconds) */
+    uint64_t duration_total; /**< Sum of the execution times of the work (milliseconds) */
+    uint32_t duration_min;   /**< Minimum execution time of the work (milliseconds) */
+    uint32_t duration_max;   /**< Maximum execution time of the work (milliseconds) */
+} mender_scheduler_work_counters_t;
+
+/**
+ * @brief Work context
+ */
+typedef struct mender_scheduler_work_context {
+    mender_scheduler_work_params_t        params;    /**< Work parameters */
+    uint64_t                              deadline;  /**< Next periodic execution of the work (uptime, milliseconds) */
+    size_t                                timer;     /**< Index of the work in the timers heap, MENDER_SCHEDULER_TIMER_DISARMED if the timer is stopped */
+    struct mender_scheduler_work_context *next;      /**< Next work pending in the work queue */
+    pthread_t                             thread;    /**< Work queue thread executing the work, valid when the work is executing */
+    uint64_t                              submitted; /**< Submission time of the work (uptime, milliseconds), valid when the work is pending */
+    mender_scheduler_work_counters_t      counters;  /**< Work counters */
+    bool                                  activated; /**< Flag indicating the work is activated */
+    bool                                  pending;   /**< Flag indicating the work is pending in the work queue */
+    bool                                  executing; /**< Flag indicating the work is executing */
 } mender_scheduler_work_context_t;
 
 /**
- *
- * @brief Work queue parameters
+ * @brief Task context
+ */
+typedef struct {
+    mender_scheduler_task_params_t params;        /**< Task parameters */
+    pthread_t                      thread_handle; /**< Task thread handle */
+} mender_scheduler_task_context_t;
+
+/**
+ * @brief Queue context
+ */
+typedef struct {
+    pthread_mutex_t mutex;     /**< Mutex used to protect the queue */
+    pthread_cond_t  cond;      /**< Condition signaled when an item is sent or received */
+    uint8_t        *items;     /**< Items of the queue */
+    size_t          length;    /**< Maximum number of items */
+    size_t          item_size; /**< Size of the items */
+    size_t          head;      /**< Index of the first item */
+    size_t          count;     /**< Number of items in the queue */
+} mender_scheduler_queue_context_t;
+
+/**
+ * @brief Function used to get the current time of the scheduler
+ * @return Uptime (milliseconds)
  */
-#define MENDER_SCHEDULER_WORK_QUEUE_NAME  "/mender-work-queue"
-#define MENDER_SCHEDULER_WORK_QUEUE_PERMS (0644)
+static uint64_t mender_scheduler_now(void);
 
 /**
- * @brief Function used to handle work context timer when it expires
- * @param timer_data Timer data
+ * @brief Function used to start or restart the timer of a work, the timer is stopped if the work is not periodic
+ * @param work_context Work context, the scheduler mutex must be taken
+ * @return MENDER_OK if the function succeeds, error code otherwise
  */
-static void mender_scheduler_timer_callback(union sigval timer_data);
+static mender_err_t mender_scheduler_timer_start(mender_scheduler_work_context_t *work_context);
 
 /**
- * @brief Thread used to handle work queue
+ * @brief Function used to stop the timer of a work
+ * @param work_context Work context, the scheduler mutex must be taken
+ */
+static void mender_scheduler_timer_stop(mender_scheduler_work_context_t *work_context);
+
+/**
+ * @brief Function used to move a timer up in the timers heap until its parent expires before it
+ * @param index Index of the timer
+ */
+static void mender_scheduler_timers_sift_up(size_t index);
+
+/**
+ * @brief Function used to move a timer down in the timers heap until its children expire after it
+ * @param index Index of the timer
+ */
+static void mender_scheduler_timers_sift_down(size_t index);
+
+/**
+ * @brief Function used to swap two timers of the timers heap
+ * @param index1 Index of the first timer
+ * @param index2 Index of the second timer
+ */
+static void mender_scheduler_timers_swap(size_t index1, size_t index2);
+
+/**
+ * @brief Function used to submit a work to the work queue
+ * @param work_context Work context, the scheduler mutex must be taken
+ */
+static void mender_scheduler_work_submit(mender_scheduler_work_context_t *work_context);
+
+/**
+ * @brief Function used to count an execution of a work
+ * @param counters Work counters
+ * @param latency Delay between the submission of the work and the beginning of its execution (milliseconds)
+ * @param duration Execution time of the work (milliseconds)
+ */
+static void mender_scheduler_work_count(mender_scheduler_work_counters_t *counters, uint32_t latency, uint32_t duration);
+
+/**
+ * @brief Function used to remove a work from the work queue if it is pending
+ * @param work_context Work context, the scheduler mutex must be taken
+ */
+static void mender_scheduler_work_cancel(mender_scheduler_work_context_t *work_context);
+
+/**
+ * @brief Thread used to handle the timers and the work queue, several threads may run concurrently
  * @param arg Not used
  * @return Not used
  */
 static void *mender_scheduler_work_queue_thread(void *arg);
 
 /**
- * @brief Work queue handle
+ * @brief Thread used to execute task function
+ * @param arg Task context
+ * @return Not used
+ */
+static void *mender_scheduler_task_thread(void *arg);
+
+/**
+ * @brief Function used to wait the condition of a queue
+ * @param queue_context Queue context, the mutex must be taken
+ * @param delay_ms Delay to wait the condition, -1 to block indefinitely (without a timeout)
+ * @return MENDER_OK if the condition is signaled, error code otherwise
+ */
+static mender_err_t mender_scheduler_queue_wait(mender_scheduler_queue_context_t *queue_context, int32_t delay_ms);
+
+/**
+ * @brief Scheduler mutex, protecting the timers, the work queue and the state of the works
+ */
+static pthread_mutex_t mender_scheduler_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Scheduler condition, signaled when the timers, the work queue or the state of the works change
+ */
+static pthread_cond_t mender_scheduler_cond;
+
+/**
+ * @brief Timers heap, the work which timer expires first is at the root
+ */
+static mender_scheduler_work_context_t **mender_scheduler_timers = NULL;
+static size_t                            mender_scheduler_timers_count    = 0;
+static size_t                            mender_scheduler_timers_capacity = 0;
+
+/**
+ * @brief Work queue, first work pending, the works are ordered by priority
+ */
+static mender_scheduler_work_context_t *mender_scheduler_work_queue_head = NULL;
+
+/**
+ * @brief Flag indicating the work queue thread must terminate
+ */
+static bool mender_scheduler_work_queue_exit = false;
+
+/**
+ * @brief Batch callbacks, invoked before and after the execution of several works pending at the same time
+ */
+static mender_err_t (*mender_scheduler_batch_begin)(MENDER_SCHEDULER_WORK_ARG) = NULL;
+static mender_err_t (*mender_scheduler_batch_end)(MENDER_SCHEDULER_WORK_ARG)   = NULL;
+
+/**
+ * @brief Flags indicating a batch is executing and its begin callback is executing, and callback to invoke at the end of the batch
  */
-static mqd_t mender_scheduler_work_queue_handle;
+static bool mender_scheduler_batch           = false;
+static bool mender_scheduler_batch_beginning = false;
+static mender_err_t (*mender_scheduler_batch_close)(MENDER_SCHEDULER_WORK_ARG) = NULL;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
 
 /**
- * @brief Work queue thread handle
+ * @brief Argument of the work which began the batch, the callbacks of the batch are invoked with it
  */
-static pthread_t mender_scheduler_work_queue_thread_handle;
+static void *mender_scheduler_batch_arg = NULL;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+/**
+ * @brief Work queue thread handles
+ */
+static pthread_t mender_scheduler_work_queue_thread_handles[CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS];
 
 mender_err_t
 mender_scheduler_init(void) {
 
     int ret;
 
-    /* Create and start work queue */
-    struct mq_attr mq_attr;
-    memset(&mq_attr, 0, sizeof(struct mq_attr));
-    mq_attr.mq_maxmsg  = CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH;
-    mq_attr.mq_msgsize = sizeof(mender_scheduler_work_context_t *);
-    mq_unlink(MENDER_SCHEDULER_WORK_QUEUE_NAME);
-    if ((mender_scheduler_work_queue_handle = mq_open(MENDER_SCHEDULER_WORK_QUEUE_NAME, O_CREAT | O_RDWR, MENDER_SCHEDULER_WORK_QUEUE_PERMS, &mq_attr)) < 0) {
-        mender_log_error("Unable to create work queue (errno=%d)", errno);
+    /* Create the scheduler condition, timeouts are computed with the monotonic clock so that they are not affected by changes of the system time */
+    pthread_condattr_t pthread_condattr;
+    if (0 != (ret = pthread_condattr_init(&pthread_condattr))) {
+        mender_log_error("Unable to initialize scheduler condition attributes (ret=%d)", ret);
+        return MENDER_FAIL;
+    }
+    if (0 != (ret = pthread_condattr_setclock(&pthread_condattr, CLOCK_MONOTONIC))) {
+        mender_log_error("Unable to set scheduler condition clock (ret=%d)", ret);
+        pthread_condattr_destroy(&pthread_condattr);
+        return MENDER_FAIL;
+    }
+    ret = pthread_cond_init(&mender_scheduler_cond, &pthread_condattr);
+    pthread_condattr_destroy(&pthread_condattr);
+    if (0 != ret) {
+        mender_log_error("Unable to create scheduler condition (ret=%d)", ret);
         return MENDER_FAIL;
     }
+    mender_scheduler_work_queue_exit = false;
+
+    /* Create and start work queue threads */
     pthread_attr_t pthread_attr;
     if (0 != (ret = pthread_attr_init(&pthread_attr))) {
         mender_log_error("Unable to initialize work queue thread attributes (ret=%d)", ret);
@@ -114,13 +282,15 @@ mender_scheduler_init(void) {
         mender_log_error("Unable to set work queue thread stack size (ret=%d)", ret);
         return MENDER_FAIL;
     }
-    if (0 != (ret = pthread_create(&mender_scheduler_work_queue_thread_handle, &pthread_attr, mender_scheduler_work_queue_thread, NULL))) {
-        mender_log_error("Unable to create work queue thread (ret=%d)", ret);
-        return MENDER_FAIL;
-    }
-    if (0 != (ret = pthread_setschedprio(mender_scheduler_work_queue_thread_handle, CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY))) {
-        mender_log_error("Unable to set work queue thread priority (ret=%d)", ret);
-        return MENDER_FAIL;
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS; index++) {
+        if (0 != (ret = pthread_create(&mender_scheduler_work_queue_thread_handles[index], &pthread_attr, mender_scheduler_work_queue_thread, NULL))) {
+            mender_log_error("Unable to create work queue thread (ret=%d)", ret);
+            return MENDER_FAIL;
+        }
+        if (0 != (ret = pthread_setschedprio(mender_scheduler_work_queue_thread_handles[index], CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY))) {
+            mender_log_error("Unable to set work queue thread priority (ret=%d)", ret);
+            return MENDER_FAIL;
+        }
     }
 
     return MENDER_OK;
@@ -135,38 +305,26 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
     assert(NULL != handle);
 
     /* Create work context */
-    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)malloc(sizeof(mender_scheduler_work_context_t));
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_utils_malloc(sizeof(mender_scheduler_work_context_t));
     if (NULL == work_context) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
     memset(work_context, 0, sizeof(mender_scheduler_work_context_t));
+    work_context->timer = MENDER_SCHEDULER_TIMER_DISARMED;
 
     /* Copy work parameters */
     work_context->params.function = work_params->function;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    work_context->params.arg = work_params->arg;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
     work_context->params.period   = work_params->period;
-    if (NULL == (work_context->params.name = strdup(work_params->name))) {
+    work_context->params.priority = work_params->priority;
+    if (NULL == (work_context->params.name = mender_utils_strdup(work_params->name))) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
 
-    /* Create semaphore used to protect work function */
-    if (0 != pthread_mutex_init(&work_context->sem_handle, NULL)) {
-        mender_log_error("Unable to create semaphore");
-        goto FAIL;
-    }
-
-    /* Create timer to handle the work periodically */
-    struct sigevent sev;
-    memset(&sev, 0, sizeof(struct sigevent));
-    sev.sigev_notify          = SIGEV_THREAD;
-    sev.sigev_notify_function = mender_scheduler_timer_callback;
-    sev.sigev_value.sival_ptr = work_context;
-    if (0 != timer_create(CLOCK_REALTIME, &sev, &work_context->timer_handle)) {
-        mender_log_error("Unable to create timer");
-        goto FAIL;
-    }
-
     /* Return handle to the new work */
     *handle = (void *)work_context;
 
@@ -176,12 +334,7 @@ FAIL:
 
     /* Release memory */
     if (NULL != work_context) {
-        timer_delete(work_context->timer_handle);
-        pthread_mutex_destroy(&work_context->sem_handle);
-        if (NULL != work_context->params.name) {
-            free(work_context->params.name);
-        }
-        free(work_context);
+        mender_utils_free(work_context);
     }
 
     return MENDER_FAIL;
@@ -191,63 +344,51 @@ mender_err_t
 mender_scheduler_work_activate(void *handle) {
 
     assert(NULL != handle);
+    mender_err_t ret = MENDER_OK;
 
     /* Get work context */
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
-    /* Give semaphore used to protect the work function */
-    if (0 != pthread_mutex_unlock(&work_context->sem_handle)) {
-        mender_log_error("Unable to give semaphore");
-        return MENDER_FAIL;
-    }
+    /* Indicate the work has been activated */
+    pthread_mutex_lock(&mender_scheduler_mutex);
+    work_context->activated = true;
 
     /* Check the timer period */
     if (work_context->params.period > 0) {
 
         /* Start the timer to handle the work */
-        struct itimerspec its;
-        memset(&its, 0, sizeof(struct itimerspec));
-        its.it_value.tv_sec    = work_context->params.period;
-        its.it_interval.tv_sec = work_context->params.period;
-        if (0 != timer_settime(work_context->timer_handle, 0, &its, NULL)) {
+        if (MENDER_OK != (ret = mender_scheduler_timer_start(work_context))) {
             mender_log_error("Unable to start timer");
-            return MENDER_FAIL;
         }
 
         /* Execute the work now */
-        union sigval timer_data;
-        timer_data.sival_ptr = (void *)work_context;
-        mender_scheduler_timer_callback(timer_data);
+        mender_scheduler_work_submit(work_context);
     }
+    pthread_mutex_unlock(&mender_scheduler_mutex);
 
-    /* Indicate the work has been activated */
-    work_context->activated = true;
-
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
 mender_scheduler_work_set_period(void *handle, uint32_t period) {
 
     assert(NULL != handle);
+    mender_err_t ret = MENDER_OK;
 
     /* Get work context */
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
-    /* Set timer period */
-    work_context->params.period = period;
-    struct itimerspec its;
-    memset(&its, 0, sizeof(struct itimerspec));
-    if (work_context->params.period > 0) {
-        its.it_value.tv_sec    = work_context->params.period;
-        its.it_interval.tv_sec = work_context->params.period;
-    }
-    if (0 != timer_settime(work_context->timer_handle, 0, &its, NULL)) {
-        mender_log_error("Unable to set timer period");
-        return MENDER_FAIL;
+    /* Set timer period, the timer is restarted if the work is activated */
+    pthread_mutex_lock(&mender_scheduler_mutex);
+    work_context->params.period = (int32_t)period;
+    if (true == work_context->activated) {
+        if (MENDER_OK != (ret = mender_scheduler_timer_start(work_context))) {
+            mender_log_error("Unable to set timer period");
+        }
     }
+    pthread_mutex_unlock(&mender_scheduler_mutex);
 
-    return MENDER_OK;
+    return ret;
 }
 
 mender_err_t
@@ -259,9 +400,9 @@ mender_scheduler_work_execute(void *handle) {
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
     /* Execute the work now */
-    union sigval timer_data;
-    timer_data.sival_ptr = (void *)work_context;
-    mender_scheduler_timer_callback(timer_data);
+    pthread_mutex_lock(&mender_scheduler_mutex);
+    mender_scheduler_work_submit(work_context);
+    pthread_mutex_unlock(&mender_scheduler_mutex);
 
     return MENDER_OK;
 }
@@ -275,25 +416,22 @@ mender_scheduler_work_deactivate(void *handle) {
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
     /* Check if the work was activated */
+    pthread_mutex_lock(&mender_scheduler_mutex);
     if (true == work_context->activated) {
 
-        /* Stop the timer used to periodically execute the work (if it is running) */
-        struct itimerspec its;
-        memset(&its, 0, sizeof(struct itimerspec));
-        if (0 != timer_settime(work_context->timer_handle, 0, &its, NULL)) {
-            mender_log_error("Unable to stop timer");
-            return MENDER_FAIL;
-        }
-
-        /* Wait if the work is pending or executing */
-        if (0 != pthread_mutex_lock(&work_context->sem_handle)) {
-            mender_log_error("Work '%s' is pending or executing", work_context->params.name);
-            return MENDER_FAIL;
-        }
+        /* Stop the timer used to periodically execute the work (if it is running) and remove the work from the work queue (if it is pending) */
+        mender_scheduler_timer_stop(work_context);
+        mender_scheduler_work_cancel(work_context);
 
         /* Indicate the work has been deactivated */
         work_context->activated = false;
+
+        /* Wait if the work is executing, unless the work deactivates itself */
+        while ((true == work_context->executing) && (0 == pthread_equal(pthread_self(), work_context->thread))) {
+            pthread_cond_wait(&mender_scheduler_cond, &mender_scheduler_mutex);
+        }
     }
+    pthread_mutex_unlock(&mender_scheduler_mutex);
 
     return MENDER_OK;
 }
@@ -306,13 +444,65 @@ mender_scheduler_work_delete(void *handle) {
     /* Get work context */
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
+    /* Make sure the work is no longer referenced by the scheduler */
+    pthread_mutex_lock(&mender_scheduler_mutex);
+    mender_scheduler_timer_stop(work_context);
+    mender_scheduler_work_cancel(work_context);
+    pthread_mutex_unlock(&mender_scheduler_mutex);
+
     /* Release memory */
-    timer_delete(work_context->timer_handle);
-    pthread_mutex_destroy(&work_context->sem_handle);
     if (NULL != work_context->params.name) {
-        free(work_context->params.name);
+        mender_utils_free(work_context->params.name);
+    }
+    mender_utils_free(work_context);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_get_statistics(void *handle, mender_scheduler_work_statistics_t *statistics) {
+
+    assert(NULL != handle);
+    assert(NULL != statistics);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Compute statistics from the work counters */
+    pthread_mutex_lock(&mender_scheduler_mutex);
+    mender_scheduler_work_counters_t *counters = &work_context->counters;
+    memset(statistics, 0, sizeof(mender_scheduler_work_statistics_t));
+    statistics->executions = counters->executions;
+    statistics->overruns   = counters->overruns;
+    if (counters->executions > 0) {
+        statistics->latency_avg  = (uint32_t)(counters->latency_total / counters->executions);
+        statistics->latency_max  = counters->latency_max;
+        statistics->duration_min = counters->duration_min;
+        statistics->duration_avg = (uint32_t)(counters->duration_total / counters->executions);
+        statistics->duration_max = counters->duration_max;
     }
-    free(work_context);
+    pthread_mutex_unlock(&mender_scheduler_mutex);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_get_work_queue_stack_space(size_t *space) {
+
+    (void)space;
+
+    /* Stack usage is not tracked on this platform */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_scheduler_set_batch_callbacks(mender_err_t (*begin)(MENDER_SCHEDULER_WORK_ARG), mender_err_t (*end)(MENDER_SCHEDULER_WORK_ARG)) {
+
+    /* Set batch callbacks, the batch currently executing (if any) is ended with the previous callback */
+    pthread_mutex_lock(&mender_scheduler_mutex);
+    mender_scheduler_batch_begin = begin;
+    mender_scheduler_batch_end   = end;
+    pthread_mutex_unlock(&mender_scheduler_mutex);
 
     return MENDER_OK;
 }
@@ -323,11 +513,11 @@ mender_scheduler_mutex_create(void **handle) {
     assert(NULL != handle);
 
     /* Create mutex */
-    if (NULL == (*handle = malloc(sizeof(pthread_mutex_t)))) {
+    if (NULL == (*handle = mender_utils_malloc(sizeof(pthread_mutex_t)))) {
         return MENDER_FAIL;
     }
     if (0 != pthread_mutex_init(*handle, NULL)) {
-        free(*handle);
+        mender_utils_free(*handle);
         *handle = NULL;
         return MENDER_FAIL;
     }
@@ -377,84 +567,630 @@ mender_scheduler_mutex_delete(void *handle) {
 
     /* Release memory */
     pthread_mutex_destroy((pthread_mutex_t *)handle);
-    free(handle);
+    mender_utils_free(handle);
 
     return MENDER_OK;
 }
 
 mender_err_t
-mender_scheduler_exit(void) {
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
 
-    /* Submit empty work to the work queue, this ask the work queue thread to terminate */
-    mender_scheduler_work_context_t *work_context = NULL;
-    if (0 != mq_send(mender_scheduler_work_queue_handle, (const char *)&work_context, sizeof(mender_scheduler_work_context_t *), 0)) {
-        mender_log_error("Unable to submit empty work to the work queue");
+    assert(NULL != task_params);
+    assert(NULL != task_params->function);
+    assert(NULL != task_params->name);
+    assert(NULL != handle);
+    int ret;
+
+    /* Create task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_utils_malloc(sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+    memset(task_context, 0, sizeof(mender_scheduler_task_context_t));
+
+    /* Copy task parameters */
+    task_context->params.function = task_params->function;
+    task_context->params.arg      = task_params->arg;
+    if (NULL == (task_context->params.name = mender_utils_strdup(task_params->name))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+
+    /* Create and start task thread */
+    pthread_attr_t pthread_attr;
+    if (0 != (ret = pthread_attr_init(&pthread_attr))) {
+        mender_log_error("Unable to initialize task thread attributes (ret=%d)", ret);
+        goto FAIL;
+    }
+    if (0
+        != (ret = pthread_attr_setstacksize(&pthread_attr,
+                                            ((CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE > 16) ? CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE : 16) * 1024))) {
+        mender_log_error("Unable to set task thread stack size (ret=%d)", ret);
+        goto FAIL;
+    }
+    if (0 != (ret = pthread_create(&task_context->thread_handle, &pthread_attr, mender_scheduler_task_thread, task_context))) {
+        mender_log_error("Unable to create task thread (ret=%d)", ret);
+        goto FAIL;
+    }
+
+    /* Return handle to the new task context */
+    *handle = (void *)task_context;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != task_context) {
+        if (NULL != task_context->params.name) {
+            mender_utils_free(task_context->params.name);
+        }
+        mender_utils_free(task_context);
+    }
+    *handle = NULL;
+
+    return MENDER_FAIL;
+}
+
+mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)handle;
+
+    /* Wait end of execution of the task thread */
+    pthread_join(task_context->thread_handle, NULL);
+
+    /* Release memory */
+    mender_utils_free(task_context->params.name);
+    mender_utils_free(task_context);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_create(size_t length, size_t item_size, void **handle) {
+
+    assert(0 != length);
+    assert(0 != item_size);
+    assert(NULL != handle);
+
+    /* Create queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)mender_utils_malloc(sizeof(mender_scheduler_queue_context_t));
+    if (NULL == queue_context) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+    memset(queue_context, 0, sizeof(mender_scheduler_queue_context_t));
+    queue_context->length    = length;
+    queue_context->item_size = item_size;
+    if (NULL == (queue_context->items = (uint8_t *)mender_utils_malloc(length * item_size))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+
+    /* Create mutex and condition used to protect the queue */
+    if (0 != pthread_mutex_init(&queue_context->mutex, NULL)) {
+        mender_log_error("Unable to create queue mutex");
+        goto FAIL;
+    }
+    if (0 != pthread_cond_init(&queue_context->cond, NULL)) {
+        mender_log_error("Unable to create queue condition");
+        pthread_mutex_destroy(&queue_context->mutex);
+        goto FAIL;
+    }
+
+    /* Return handle to the new queue context */
+    *handle = (void *)queue_context;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != queue_context) {
+        mender_utils_free(queue_context->items);
+        mender_utils_free(queue_context);
+    }
+    *handle = NULL;
+
+    return MENDER_FAIL;
+}
+
+mender_err_t
+mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+    mender_err_t ret = MENDER_OK;
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Wait room in the queue */
+    pthread_mutex_lock(&queue_context->mutex);
+    while ((MENDER_OK == ret) && (queue_context->count >= queue_context->length)) {
+        ret = mender_scheduler_queue_wait(queue_context, delay_ms);
+    }
+
+    /* Copy the item at the end of the queue */
+    if (MENDER_OK == ret) {
+        memcpy(&queue_context->items[((queue_context->head + queue_context->count) % queue_context->length) * queue_context->item_size],
+               item,
+               queue_context->item_size);
+        queue_context->count++;
+        pthread_cond_broadcast(&queue_context->cond);
+    }
+    pthread_mutex_unlock(&queue_context->mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+    mender_err_t ret = MENDER_OK;
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Wait an item in the queue */
+    pthread_mutex_lock(&queue_context->mutex);
+    while ((MENDER_OK == ret) && (0 == queue_context->count)) {
+        ret = mender_scheduler_queue_wait(queue_context, delay_ms);
+    }
+
+    /* Copy the item at the beginning of the queue */
+    if (MENDER_OK == ret) {
+        memcpy(item, &queue_context->items[queue_context->head * queue_context->item_size], queue_context->item_size);
+        queue_context->head = (queue_context->head + 1) % queue_context->length;
+        queue_context->count--;
+        pthread_cond_broadcast(&queue_context->cond);
+    }
+    pthread_mutex_unlock(&queue_context->mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_scheduler_queue_delete(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Release memory */
+    pthread_cond_destroy(&queue_context->cond);
+    pthread_mutex_destroy(&queue_context->mutex);
+    mender_utils_free(queue_context->items);
+    mender_utils_free(queue_context);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_get_uptime(uint64_t *uptime) {
+
+    assert(NULL != uptime);
+    struct timespec now;
+
+    /* Get uptime */
+    if (0 != clock_gettime(CLOCK_MONOTONIC, &now)) {
+        mender_log_error("Unable to get uptime");
         return MENDER_FAIL;
     }
+    *uptime = (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_delay(uint32_t delay_ms) {
+
+    struct timespec delay = { .tv_sec = delay_ms / 1000, .tv_nsec = (long)(delay_ms % 1000) * 1000000 };
+
+    /* Suspend the thread, the delay is restarted with the remaining time if it is interrupted by a signal */
+    while (0 != nanosleep(&delay, &delay)) {
+        if (EINTR != errno) {
+            mender_log_error("Unable to suspend thread");
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_exit(void) {
+
+    /* Ask the work queue threads to terminate */
+    pthread_mutex_lock(&mender_scheduler_mutex);
+    mender_scheduler_work_queue_exit = true;
+    pthread_cond_broadcast(&mender_scheduler_cond);
+    pthread_mutex_unlock(&mender_scheduler_mutex);
+
+    /* Wait end of execution of the work queue threads */
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS; index++) {
+        pthread_join(mender_scheduler_work_queue_thread_handles[index], NULL);
+    }
+
+    /* End the batch which was executing (if any) */
+    if (NULL != mender_scheduler_batch_close) {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+        mender_scheduler_batch_close(mender_scheduler_batch_arg);
+#else
+        mender_scheduler_batch_close();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    }
+    mender_scheduler_batch       = false;
+    mender_scheduler_batch_close = NULL;
+
+    /* Release memory */
+    mender_utils_free(mender_scheduler_timers);
+    mender_scheduler_timers          = NULL;
+    mender_scheduler_timers_count    = 0;
+    mender_scheduler_timers_capacity = 0;
+    mender_scheduler_work_queue_head = NULL;
+    pthread_cond_destroy(&mender_scheduler_cond);
+
+    return MENDER_OK;
+}
+
+static uint64_t
+mender_scheduler_now(void) {
+
+    struct timespec now;
+
+    /* Get uptime, the monotonic clock is not expected to fail */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static mender_err_t
+mender_scheduler_timer_start(mender_scheduler_work_context_t *work_context) {
+
+    assert(NULL != work_context);
+
+    /* Stop the timer if it is running */
+    mender_scheduler_timer_stop(work_context);
+    if (work_context->params.period <= 0) {
+        return MENDER_OK;
+    }
 
-    /* Wait end of execution of the work queue thread */
-    pthread_join(mender_scheduler_work_queue_thread_handle, NULL);
+    /* Grow the timers heap if required */
+    if (mender_scheduler_timers_count >= mender_scheduler_timers_capacity) {
+        size_t                            capacity = (0 == mender_scheduler_timers_capacity) ? 8 : (2 * mender_scheduler_timers_capacity);
+        mender_scheduler_work_context_t **timers
+            = (mender_scheduler_work_context_t **)mender_utils_realloc(mender_scheduler_timers, capacity * sizeof(mender_scheduler_work_context_t *));
+        if (NULL == timers) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+        mender_scheduler_timers          = timers;
+        mender_scheduler_timers_capacity = capacity;
+    }
+
+    /* Insert the timer in the timers heap */
+    work_context->deadline                                 = mender_scheduler_now() + (uint64_t)work_context->params.period * 1000;
+    work_context->timer                                    = mender_scheduler_timers_count;
+    mender_scheduler_timers[mender_scheduler_timers_count] = work_context;
+    mender_scheduler_timers_count++;
+    mender_scheduler_timers_sift_up(work_context->timer);
+
+    /* Wake up the work queue threads, the first timer to expire may be the new one */
+    pthread_cond_broadcast(&mender_scheduler_cond);
 
     return MENDER_OK;
 }
 
 static void
-mender_scheduler_timer_callback(union sigval timer_data) {
+mender_scheduler_timer_stop(mender_scheduler_work_context_t *work_context) {
+
+    assert(NULL != work_context);
+
+    /* Check if the timer is running */
+    if (MENDER_SCHEDULER_TIMER_DISARMED == work_context->timer) {
+        return;
+    }
+
+    /* Replace the timer by the last one of the timers heap, then restore the order of the heap */
+    size_t index = work_context->timer;
+    mender_scheduler_timers_count--;
+    if (index != mender_scheduler_timers_count) {
+        mender_scheduler_timers_swap(index, mender_scheduler_timers_count);
+        mender_scheduler_timers_sift_up(index);
+        mender_scheduler_timers_sift_down(index);
+    }
+    work_context->timer = MENDER_SCHEDULER_TIMER_DISARMED;
+}
+
+static void
+mender_scheduler_timers_sift_up(size_t index) {
+
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (mender_scheduler_timers[parent]->deadline <= mender_scheduler_timers[index]->deadline) {
+            break;
+        }
+        mender_scheduler_timers_swap(index, parent);
+        index = parent;
+    }
+}
+
+static void
+mender_scheduler_timers_sift_down(size_t index) {
+
+    while (true) {
+        size_t first = index;
+        size_t left  = 2 * index + 1;
+        size_t right = 2 * index + 2;
+        if ((left < mender_scheduler_timers_count) && (mender_scheduler_timers[left]->deadline < mender_scheduler_timers[first]->deadline)) {
+            first = left;
+        }
+        if ((right < mender_scheduler_timers_count) && (mender_scheduler_timers[right]->deadline < mender_scheduler_timers[first]->deadline)) {
+            first = right;
+        }
+        if (first == index) {
+            break;
+        }
+        mender_scheduler_timers_swap(index, first);
+        index = first;
+    }
+}
+
+static void
+mender_scheduler_timers_swap(size_t index1, size_t index2) {
+
+    mender_scheduler_work_context_t *work_context = mender_scheduler_timers[index1];
+    mender_scheduler_timers[index1]               = mender_scheduler_timers[index2];
+    mender_scheduler_timers[index2]               = work_context;
+    mender_scheduler_timers[index1]->timer        = index1;
+    mender_scheduler_timers[index2]->timer        = index2;
+}
+
+static void
+mender_scheduler_work_submit(mender_scheduler_work_context_t *work_context) {
 
-    /* Get work context */
-    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)timer_data.sival_ptr;
     assert(NULL != work_context);
 
-    /* Exit if the work is already pending or executing */
-    struct timespec timeout;
-    memset(&timeout, 0, sizeof(struct timespec));
-    if (0 != pthread_mutex_timedlock(&work_context->sem_handle, &timeout)) {
+    /* Exit if the work is not activated or if it is already pending or executing */
+    if ((true != work_context->activated) || (true == work_context->pending) || (true == work_context->executing)) {
         mender_log_debug("Work '%s' is not activated, already pending or executing", work_context->params.name);
+        if (true == work_context->activated) {
+            work_context->counters.overruns++;
+        }
         return;
     }
+    work_context->submitted = mender_scheduler_now();
+
+    /* Insert the work in the work queue after the works pending with the same or a higher priority */
+    mender_scheduler_work_context_t *previous = NULL;
+    mender_scheduler_work_context_t *current  = mender_scheduler_work_queue_head;
+    while ((NULL != current) && (current->params.priority >= work_context->params.priority)) {
+        previous = current;
+        current  = current->next;
+    }
+    work_context->next    = current;
+    work_context->pending = true;
+    if (NULL == previous) {
+        mender_scheduler_work_queue_head = work_context;
+    } else {
+        previous->next = work_context;
+    }
+    pthread_cond_broadcast(&mender_scheduler_cond);
+}
+
+static void
+mender_scheduler_work_cancel(mender_scheduler_work_context_t *work_context) {
 
-    /* Submit the work to the work queue */
-    if (0 != mq_send(mender_scheduler_work_queue_handle, (const char *)&work_context, sizeof(mender_scheduler_work_context_t *), 0)) {
-        mender_log_warning("Unable to submit work '%s' to the work queue", work_context->params.name);
-        pthread_mutex_unlock(&work_context->sem_handle);
+    assert(NULL != work_context);
+
+    /* Check if the work is pending */
+    if (true != work_context->pending) {
+        return;
+    }
+
+    /* Unlink the work from the work queue */
+    mender_scheduler_work_context_t *previous = NULL;
+    mender_scheduler_work_context_t *current  = mender_scheduler_work_queue_head;
+    while ((NULL != current) && (current != work_context)) {
+        previous = current;
+        current  = current->next;
+    }
+    if (NULL != current) {
+        if (NULL == previous) {
+            mender_scheduler_work_queue_head = current->next;
+        } else {
+            previous->next = current->next;
+        }
     }
+    work_context->next    = NULL;
+    work_context->pending = false;
 }
 
-__attribute__((noreturn)) static void *
+static void
+mender_scheduler_work_count(mender_scheduler_work_counters_t *counters, uint32_t latency, uint32_t duration) {
+
+    assert(NULL != counters);
+
+    /* Update the work counters */
+    counters->latency_total += latency;
+    if (latency > counters->latency_max) {
+        counters->latency_max = latency;
+    }
+    counters->duration_total += duration;
+    if ((0 == counters->executions) || (duration < counters->duration_min)) {
+        counters->duration_min = duration;
+    }
+    if (duration > counters->duration_max) {
+        counters->duration_max = duration;
+    }
+    counters->executions++;
+}
+
+static void *
 mender_scheduler_work_queue_thread(void *arg) {
 
     (void)arg;
-    mender_scheduler_work_context_t *work_context = NULL;
 
-    /* Handle work to be executed */
-    while (mq_receive(mender_scheduler_work_queue_handle, (char *)&work_context, sizeof(mender_scheduler_work_context_t *), NULL) > 0) {
+    pthread_mutex_lock(&mender_scheduler_mutex);
+    while (true != mender_scheduler_work_queue_exit) {
 
-        /* Check if empty work is received from the work queue, this ask the work queue thread to terminate */
-        if (NULL == work_context) {
-            goto END;
+        /* Submit the works which timers expired, and those expiring within the slack so that they are executed together */
+        uint64_t now   = mender_scheduler_now();
+        uint64_t limit = now;
+        if ((mender_scheduler_timers_count > 0) && (mender_scheduler_timers[0]->deadline <= now)) {
+            limit += (uint64_t)CONFIG_MENDER_SCHEDULER_WORK_SLACK * 1000;
+        }
+        for (size_t count = mender_scheduler_timers_count; (count > 0) && (mender_scheduler_timers[0]->deadline <= limit); count--) {
+            mender_scheduler_work_context_t *work_context = mender_scheduler_timers[0];
+            work_context->deadline += (uint64_t)work_context->params.period * 1000;
+            if (work_context->deadline <= now) {
+                /* Periods missed while the work queue was busy are skipped instead of executing the work several times in a row */
+                work_context->deadline = now + (uint64_t)work_context->params.period * 1000;
+            }
+            mender_scheduler_timers_sift_down(0);
+            mender_scheduler_work_submit(work_context);
         }
 
-        /* Call work function */
-        if (MENDER_DONE == work_context->params.function()) {
+        /* Begin a batch when several works are pending, they are executed back-to-back between the batch callbacks */
+        if ((true != mender_scheduler_batch) && (NULL != mender_scheduler_work_queue_head) && (NULL != mender_scheduler_work_queue_head->next)) {
+            mender_scheduler_batch = true;
+            if (NULL != mender_scheduler_batch_begin) {
+                mender_err_t (*begin)(MENDER_SCHEDULER_WORK_ARG) = mender_scheduler_batch_begin;
+                mender_err_t (*end)(MENDER_SCHEDULER_WORK_ARG)   = mender_scheduler_batch_end;
+                mender_scheduler_batch_beginning                 = true;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+                void *arg = mender_scheduler_work_queue_head->params.arg;
+                pthread_mutex_unlock(&mender_scheduler_mutex);
+                mender_err_t ret = begin(arg);
+#else
+                pthread_mutex_unlock(&mender_scheduler_mutex);
+                mender_err_t ret = begin();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+                pthread_mutex_lock(&mender_scheduler_mutex);
+                mender_scheduler_batch_beginning = false;
+                if (MENDER_OK == ret) {
+                    mender_scheduler_batch_close = end;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+                    mender_scheduler_batch_arg = arg;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+                } else {
+                    mender_log_warning("Unable to begin batch of works");
+                }
+                continue;
+            }
+        }
+
+        /* Execute the first work pending in the work queue, the other work queue threads handle the timers and the next works meanwhile */
+        mender_scheduler_work_context_t *work_context = mender_scheduler_work_queue_head;
+        if (NULL != work_context) {
+            mender_scheduler_work_queue_head = work_context->next;
+            work_context->next      = NULL;
+            work_context->pending   = false;
+            work_context->executing = true;
+            work_context->thread    = pthread_self();
+
+            /* Call work function, the scheduler mutex is released so that the work can use the scheduler */
+            uint64_t start = mender_scheduler_now();
+            pthread_mutex_unlock(&mender_scheduler_mutex);
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+            mender_err_t ret = work_context->params.function(work_context->params.arg);
+#else
+            mender_err_t ret = work_context->params.function();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+            pthread_mutex_lock(&mender_scheduler_mutex);
+            mender_scheduler_work_count(&work_context->counters, (uint32_t)(start - work_context->submitted), (uint32_t)(mender_scheduler_now() - start));
 
             /* Work is done, stop timer used to execute the work periodically */
-            struct itimerspec its;
-            memset(&its, 0, sizeof(struct itimerspec));
-            if (0 != timer_settime(work_context->timer_handle, 0, &its, NULL)) {
-                mender_log_error("Unable to stop timer");
+            if (MENDER_DONE == ret) {
+                mender_scheduler_timer_stop(work_context);
             }
+
+            /* Indicate the work is no longer executing */
+            work_context->executing = false;
+            pthread_cond_broadcast(&mender_scheduler_cond);
+            continue;
         }
 
-        /* Release semaphore used to protect the work function */
-        pthread_mutex_unlock(&work_context->sem_handle);
+        /* End the batch when the work queue is empty */
+        if ((true == mender_scheduler_batch) && (true != mender_scheduler_batch_beginning)) {
+            mender_err_t (*end)(MENDER_SCHEDULER_WORK_ARG) = mender_scheduler_batch_close;
+            mender_scheduler_batch                         = false;
+            mender_scheduler_batch_close                   = NULL;
+            if (NULL != end) {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+                void *arg = mender_scheduler_batch_arg;
+                pthread_mutex_unlock(&mender_scheduler_mutex);
+                end(arg);
+#else
+                pthread_mutex_unlock(&mender_scheduler_mutex);
+                end();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+                pthread_mutex_lock(&mender_scheduler_mutex);
+            }
+            continue;
+        }
+
+        /* Wait until the next timer expires or something changes */
+        if (mender_scheduler_timers_count > 0) {
+            struct timespec timeout;
+            timeout.tv_sec  = (time_t)(mender_scheduler_timers[0]->deadline / 1000);
+            timeout.tv_nsec = (long)(mender_scheduler_timers[0]->deadline % 1000) * 1000000;
+            pthread_cond_timedwait(&mender_scheduler_cond, &mender_scheduler_mutex, &timeout);
+        } else {
+            pthread_cond_wait(&mender_scheduler_cond, &mender_scheduler_mutex);
+        }
     }
+    pthread_mutex_unlock(&mender_scheduler_mutex);
+
+    return NULL;
+}
 
-END:
+static void *
+mender_scheduler_task_thread(void *arg) {
 
-    /* Release memory */
-    mq_close(mender_scheduler_work_queue_handle);
-    mq_unlink(MENDER_SCHEDULER_WORK_QUEUE_NAME);
+    assert(NULL != arg);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)arg;
+
+    /* Call task function */
+    task_context->params.function(task_context->params.arg);
+
+    return NULL;
+}
+
+static mender_err_t
+mender_scheduler_queue_wait(mender_scheduler_queue_context_t *queue_context, int32_t delay_ms) {
+
+    assert(NULL != queue_context);
 
-    /* Terminate work queue thread */
-    pthread_exit(NULL);
+    /* Wait the condition */
+    if (delay_ms >= 0) {
+        struct timespec timeout;
+        clock_gettime(CLOCK_REALTIME, &timeout);
+        timeout.tv_sec += delay_ms / 1000;
+        timeout.tv_nsec += (delay_ms % 1000) * 1000000;
+        if (timeout.tv_nsec >= 1000000000) {
+            timeout.tv_sec++;
+            timeout.tv_nsec -= 1000000000;
+        }
+        if (0 != pthread_cond_timedwait(&queue_context->cond, &queue_context->mutex, &timeout)) {
+            return MENDER_FAIL;
+        }
+    } else {
+        if (0 != pthread_cond_wait(&queue_context->cond, &queue_context->mutex)) {
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
 }
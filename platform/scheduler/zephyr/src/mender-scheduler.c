@@ -36,20 +36,134 @@
 #endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY */
 
 /**
- * @brief Work context
+ * @brief Default work queue length
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH
+#define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH (10)
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH */
+
+/**
+ * @brief Default number of work queue threads, works are executed concurrently when it is greater than 1
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS
+#define CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS (1)
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS */
+
+/**
+ * @brief Default work slack (seconds), works which timers expire within the slack when a work is executed are executed with it
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_WORK_SLACK
+#define CONFIG_MENDER_SCHEDULER_WORK_SLACK (0)
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_SLACK */
+
+/**
+ * @brief Default task stack size (kB)
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE
+#define CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE (4)
+#endif /* CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE */
+
+/**
+ * @brief Default task priority
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_TASK_PRIORITY
+#define CONFIG_MENDER_SCHEDULER_TASK_PRIORITY (5)
+#endif /* CONFIG_MENDER_SCHEDULER_TASK_PRIORITY */
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Default number of works of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_WORKS
+#define CONFIG_MENDER_SCHEDULER_STATIC_WORKS (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_WORKS */
+
+/**
+ * @brief Default number of mutexes of the static pool
+ */
+#ifndef CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES
+#define CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES (8)
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES */
+
+/**
+ * @brief Maximum length of the names of the works of the static pool, longer names are truncated
+ */
+#define MENDER_SCHEDULER_STATIC_WORK_NAME_LENGTH (32)
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+/**
+ * @brief Work counters
  */
 typedef struct {
-    mender_scheduler_work_params_t params;       /**< Work parameters */
-    struct k_sem                   sem_handle;   /**< Semaphore used to indicate work is pending or executing */
-    struct k_timer                 timer_handle; /**< Timer used to periodically execute work */
-    struct k_work                  work_handle;  /**< Work handle used to execute the work function */
-    bool                           activated;    /**< Flag indicating the work is activated */
+    uint32_t executions;     /**< Number of executions of the work */
+    uint32_t overruns;       /**< Number of times the work was due while it was already pending or executing */
+    uint64_t latency_total;  /**< Sum of the delays between the submission of the work and the beginning of its execution (milliseconds) */
+    uint32_t latency_max;    /**< Maximum delay between the submission of the work and the beginning of its execution (milliseconds) */
+    uint64_t duration_total; /**< Sum of the execution times of the work (milliseconds) */
+    uint32_t duration_min;   /**< Minimum execution time of the work (milliseconds) */
+    uint32_t duration_max;   /**< Maximum execution time of the work (milliseconds) */
+} mender_scheduler_work_counters_t;
+
+/**
+ * @brief Work context
+ */
+typedef struct mender_scheduler_work_context {
+    mender_scheduler_work_params_t        params;       /**< Work parameters */
+    struct k_sem                          sem_handle;   /**< Semaphore used to indicate work is pending or executing */
+    struct k_timer                        timer_handle; /**< Timer used to periodically execute work */
+    bool                                  activated;    /**< Flag indicating the work is activated */
+    struct mender_scheduler_work_context *next;         /**< Next work of the works list */
+    uint32_t                              submitted;    /**< Submission time of the work (uptime, milliseconds), valid when the work is pending */
+    mender_scheduler_work_counters_t      counters;     /**< Work counters */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    char name[MENDER_SCHEDULER_STATIC_WORK_NAME_LENGTH]; /**< Work name, params.name points to it */
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 } mender_scheduler_work_context_t;
 
 /**
- * @brief Mender scheduler work queue stack
+ * @brief Task context
+ */
+typedef struct {
+    mender_scheduler_task_params_t params;        /**< Task parameters */
+    struct k_thread                thread_handle; /**< Task thread handle */
+} mender_scheduler_task_context_t;
+
+/**
+ * @brief Queue context
+ */
+typedef struct {
+    struct k_msgq msgq_handle; /**< Message queue handle */
+    char         *buffer;      /**< Buffer of the message queue */
+} mender_scheduler_queue_context_t;
+
+/**
+ * @brief Mender scheduler work queue stacks, one per work queue thread
  */
-K_THREAD_STACK_DEFINE(mender_scheduler_work_queue_stack, CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE * 1024);
+K_THREAD_STACK_ARRAY_DEFINE(mender_scheduler_work_queue_stacks,
+                            CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS,
+                            CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE * 1024);
+
+/**
+ * @brief Mender scheduler semaphore counting the works pending in the work queues
+ */
+K_SEM_DEFINE(mender_scheduler_work_queue_count_handle, 0, MENDER_SCHEDULER_WORK_PRIORITIES * CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH);
+
+/**
+ * @brief Mender scheduler works list mutex, it also protects the batch
+ */
+K_MUTEX_DEFINE(mender_scheduler_works_mutex);
+
+/**
+ * @brief Mender scheduler task stack, a single task is running at a time
+ */
+K_THREAD_STACK_DEFINE(mender_scheduler_task_stack, CONFIG_MENDER_SCHEDULER_TASK_STACK_SIZE * 1024);
+
+/**
+ * @brief Flag indicating the task stack is used
+ */
+static bool mender_scheduler_task_stack_used = false;
 
 /**
  * @brief Function used to handle work context timer when it expires
@@ -57,28 +171,147 @@ K_THREAD_STACK_DEFINE(mender_scheduler_work_queue_stack, CONFIG_MENDER_SCHEDULER
  */
 static void mender_scheduler_timer_callback(struct k_timer *handle);
 
+#if CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0
+
+/**
+ * @brief Function used to submit the works which timers expire within the slack, so that they are executed with the work
+ * @param work_context Work context
+ */
+static void mender_scheduler_work_gather(mender_scheduler_work_context_t *work_context);
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0 */
+
+/**
+ * @brief Function used to submit a work to the work queue of its priority
+ * @param work_context Work context
+ * @return 0 if the work has been submitted, negative error code otherwise
+ */
+static int mender_scheduler_work_queue_send(mender_scheduler_work_context_t *work_context);
+
+/**
+ * @brief Function used to wait and receive the work pending with the highest priority
+ * @param work_context Work context
+ * @return 0 if a work has been received, negative error code otherwise
+ */
+static int mender_scheduler_work_queue_receive(mender_scheduler_work_context_t **work_context);
+
+/**
+ * @brief Function used to count an execution of a work
+ * @param counters Work counters
+ * @param latency Delay between the submission of the work and the beginning of its execution (milliseconds)
+ * @param duration Execution time of the work (milliseconds)
+ */
+static void mender_scheduler_work_count(mender_scheduler_work_counters_t *counters, uint32_t latency, uint32_t duration);
+
+/**
+ * @brief Function used to begin a batch if works are pending in the work queue
+ * @param work_context Context of the work about to be executed, it begins the batch
+ */
+static void mender_scheduler_batch_open(mender_scheduler_work_context_t *work_context);
+
 /**
- * @brief Function used to handle work
- * @param handle Work handler
+ * @brief Function used to end the batch if no work is pending in the work queue
  */
-static void mender_scheduler_work_handler(struct k_work *handle);
+static void mender_scheduler_batch_close(void);
 
 /**
- * @brief Mender scheduler work queue handle
+ * @brief Thread used to handle work queue, several threads may run concurrently
+ * @param p1 Not used
+ * @param p2 Not used
+ * @param p3 Not used
  */
-static struct k_work_q mender_scheduler_work_queue_handle;
+static void mender_scheduler_work_queue_thread(void *p1, void *p2, void *p3);
+
+/**
+ * @brief Function used to execute task function
+ * @param p1 Task context
+ * @param p2 Not used
+ * @param p3 Not used
+ */
+static void mender_scheduler_task_thread(void *p1, void *p2, void *p3);
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Function used to take a free slot of a static pool
+ * @param used Flags indicating the slots of the pool are used
+ * @param count Number of slots of the pool
+ * @return Index of the slot, count if the pool is exhausted
+ */
+static size_t mender_scheduler_pool_take(bool *used, size_t count);
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+/**
+ * @brief Mender scheduler work queues, one per priority, works pending are shared by the work queue threads
+ */
+static struct k_msgq mender_scheduler_work_queue_handles[MENDER_SCHEDULER_WORK_PRIORITIES];
+static char __aligned(sizeof(void *))
+    mender_scheduler_work_queue_buffers[MENDER_SCHEDULER_WORK_PRIORITIES][CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH * sizeof(void *)];
+
+/**
+ * @brief Mender scheduler work queue thread handles
+ */
+static struct k_thread mender_scheduler_work_queue_thread_handles[CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS];
+
+/**
+ * @brief Mender scheduler works list
+ */
+static mender_scheduler_work_context_t *mender_scheduler_works = NULL;
+
+/**
+ * @brief Batch callbacks and flag indicating a batch is executing
+ */
+static mender_err_t (*mender_scheduler_batch_begin)(MENDER_SCHEDULER_WORK_ARG) = NULL;
+static mender_err_t (*mender_scheduler_batch_end)(MENDER_SCHEDULER_WORK_ARG)   = NULL;
+static bool mender_scheduler_batch        = false;
+static bool mender_scheduler_batch_opened = false;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+/**
+ * @brief Argument of the work which began the batch, the callbacks of the batch are invoked with it
+ */
+static void *mender_scheduler_batch_arg = NULL;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+/**
+ * @brief Static pools of works and mutexes, flags indicating the slots of the pools are used and lock protecting the flags
+ */
+static mender_scheduler_work_context_t mender_scheduler_static_works[CONFIG_MENDER_SCHEDULER_STATIC_WORKS];
+static bool                            mender_scheduler_static_works_used[CONFIG_MENDER_SCHEDULER_STATIC_WORKS];
+static struct k_mutex                  mender_scheduler_static_mutexes[CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES];
+static bool                            mender_scheduler_static_mutexes_used[CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES];
+static struct k_spinlock               mender_scheduler_static_lock;
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
 mender_err_t
 mender_scheduler_init(void) {
 
-    /* Create and start work queue */
-    k_work_queue_init(&mender_scheduler_work_queue_handle);
-    k_work_queue_start(&mender_scheduler_work_queue_handle,
-                       mender_scheduler_work_queue_stack,
-                       CONFIG_MENDER_SCHEDULER_WORK_QUEUE_STACK_SIZE * 1024,
-                       CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY,
-                       NULL);
-    k_thread_name_set(k_work_queue_thread_get(&mender_scheduler_work_queue_handle), "mender_scheduler_work_queue");
+    /* Create work queues */
+    for (size_t priority = 0; priority < MENDER_SCHEDULER_WORK_PRIORITIES; priority++) {
+        k_msgq_init(&mender_scheduler_work_queue_handles[priority],
+                    mender_scheduler_work_queue_buffers[priority],
+                    sizeof(void *),
+                    CONFIG_MENDER_SCHEDULER_WORK_QUEUE_LENGTH);
+    }
+
+    /* Create and start work queue threads */
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS; index++) {
+        k_tid_t thread = k_thread_create(&mender_scheduler_work_queue_thread_handles[index],
+                                         mender_scheduler_work_queue_stacks[index],
+                                         K_THREAD_STACK_SIZEOF(mender_scheduler_work_queue_stacks[index]),
+                                         mender_scheduler_work_queue_thread,
+                                         NULL,
+                                         NULL,
+                                         NULL,
+                                         CONFIG_MENDER_SCHEDULER_WORK_QUEUE_PRIORITY,
+                                         0,
+                                         K_NO_WAIT);
+        k_thread_name_set(thread, "mender_scheduler_work_queue");
+    }
 
     return MENDER_OK;
 }
@@ -92,20 +325,39 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
     assert(NULL != handle);
 
     /* Create work context */
-    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)malloc(sizeof(mender_scheduler_work_context_t));
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_work_context_t *work_context = NULL;
+    size_t                           index        = mender_scheduler_pool_take(mender_scheduler_static_works_used, CONFIG_MENDER_SCHEDULER_STATIC_WORKS);
+    if (CONFIG_MENDER_SCHEDULER_STATIC_WORKS == index) {
+        mender_log_error("Unable to allocate work, the static pool is exhausted");
+        goto FAIL;
+    }
+    work_context = &mender_scheduler_static_works[index];
+#else
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)mender_utils_malloc(sizeof(mender_scheduler_work_context_t));
     if (NULL == work_context) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     memset(work_context, 0, sizeof(mender_scheduler_work_context_t));
 
     /* Copy work parameters */
     work_context->params.function = work_params->function;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    work_context->params.arg = work_params->arg;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
     work_context->params.period   = work_params->period;
-    if (NULL == (work_context->params.name = strdup(work_params->name))) {
+    work_context->params.priority = work_params->priority;
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    strncpy(work_context->name, work_params->name, sizeof(work_context->name) - 1);
+    work_context->params.name = work_context->name;
+#else
+    if (NULL == (work_context->params.name = mender_utils_strdup(work_params->name))) {
         mender_log_error("Unable to allocate memory");
         goto FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     /* Create semaphore used to protect work function */
     if (0 != k_sem_init(&work_context->sem_handle, 0, 1)) {
@@ -117,8 +369,11 @@ mender_scheduler_work_create(mender_scheduler_work_params_t *work_params, void *
     k_timer_init(&work_context->timer_handle, mender_scheduler_timer_callback, NULL);
     k_timer_user_data_set(&work_context->timer_handle, (void *)work_context);
 
-    /* Create work used to execute work function */
-    k_work_init(&work_context->work_handle, mender_scheduler_work_handler);
+    /* Add the work to the works list */
+    k_mutex_lock(&mender_scheduler_works_mutex, K_FOREVER);
+    work_context->next     = mender_scheduler_works;
+    mender_scheduler_works = work_context;
+    k_mutex_unlock(&mender_scheduler_works_mutex);
 
     /* Return handle to the new work context */
     *handle = (void *)work_context;
@@ -129,10 +384,14 @@ FAIL:
 
     /* Release memory */
     if (NULL != work_context) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+        mender_scheduler_static_works_used[work_context - mender_scheduler_static_works] = false;
+#else
         if (NULL != work_context->params.name) {
-            free(work_context->params.name);
+            mender_utils_free(work_context->params.name);
         }
-        free(work_context);
+        mender_utils_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
     }
 
     return MENDER_FAIL;
@@ -187,7 +446,7 @@ mender_scheduler_work_set_period(void *handle, uint32_t period) {
     /* Set timer period */
     work_context->params.period = period;
     if (work_context->params.period > 0) {
-        k_timer_start(&work_context->timer_handle, K_FOREVER, K_MSEC(1000 * work_context->params.period));
+        k_timer_start(&work_context->timer_handle, K_MSEC(1000 * work_context->params.period), K_MSEC(1000 * work_context->params.period));
     } else {
         k_timer_stop(&work_context->timer_handle);
     }
@@ -230,11 +489,92 @@ mender_scheduler_work_delete(void *handle) {
     /* Get work context */
     mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
 
+    /* Remove the work from the works list */
+    k_mutex_lock(&mender_scheduler_works_mutex, K_FOREVER);
+    mender_scheduler_work_context_t **link = &mender_scheduler_works;
+    while ((NULL != *link) && (work_context != *link)) {
+        link = &(*link)->next;
+    }
+    if (NULL != *link) {
+        *link = work_context->next;
+    }
+    k_mutex_unlock(&mender_scheduler_works_mutex);
+
+    /* Stop the timer, it is still running if the work has not been deactivated */
+    k_timer_stop(&work_context->timer_handle);
+
     /* Release memory */
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_static_works_used[work_context - mender_scheduler_static_works] = false;
+#else
     if (NULL != work_context->params.name) {
-        free(work_context->params.name);
+        mender_utils_free(work_context->params.name);
+    }
+    mender_utils_free(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_work_get_statistics(void *handle, mender_scheduler_work_statistics_t *statistics) {
+
+    assert(NULL != handle);
+    assert(NULL != statistics);
+
+    /* Get work context */
+    mender_scheduler_work_context_t *work_context = (mender_scheduler_work_context_t *)handle;
+
+    /* Compute statistics from the work counters, they are updated by the work queue threads without lock and may be slightly inconsistent */
+    mender_scheduler_work_counters_t counters = work_context->counters;
+    memset(statistics, 0, sizeof(mender_scheduler_work_statistics_t));
+    statistics->executions = counters.executions;
+    statistics->overruns   = counters.overruns;
+    if (counters.executions > 0) {
+        statistics->latency_avg  = (uint32_t)(counters.latency_total / counters.executions);
+        statistics->latency_max  = counters.latency_max;
+        statistics->duration_min = counters.duration_min;
+        statistics->duration_avg = (uint32_t)(counters.duration_total / counters.executions);
+        statistics->duration_max = counters.duration_max;
     }
-    free(work_context);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_get_work_queue_stack_space(size_t *space) {
+
+    assert(NULL != space);
+
+#if defined(CONFIG_INIT_STACKS) && defined(CONFIG_THREAD_STACK_INFO)
+    /* Get the minimum unused stack space of the work queue threads */
+    *space = SIZE_MAX;
+    for (size_t index = 0; index < CONFIG_MENDER_SCHEDULER_WORK_QUEUE_WORKERS; index++) {
+        size_t unused;
+        if (0 != k_thread_stack_space_get(&mender_scheduler_work_queue_thread_handles[index], &unused)) {
+            mender_log_error("Unable to get work queue thread stack space");
+            return MENDER_FAIL;
+        }
+        if (unused < *space) {
+            *space = unused;
+        }
+    }
+
+    return MENDER_OK;
+#else
+    /* Stack usage is tracked only with CONFIG_INIT_STACKS and CONFIG_THREAD_STACK_INFO */
+    return MENDER_NOT_IMPLEMENTED;
+#endif /* defined(CONFIG_INIT_STACKS) && defined(CONFIG_THREAD_STACK_INFO) */
+}
+
+mender_err_t
+mender_scheduler_set_batch_callbacks(mender_err_t (*begin)(MENDER_SCHEDULER_WORK_ARG), mender_err_t (*end)(MENDER_SCHEDULER_WORK_ARG)) {
+
+    /* Set batch callbacks */
+    k_mutex_lock(&mender_scheduler_works_mutex, K_FOREVER);
+    mender_scheduler_batch_begin = begin;
+    mender_scheduler_batch_end   = end;
+    k_mutex_unlock(&mender_scheduler_works_mutex);
 
     return MENDER_OK;
 }
@@ -245,14 +585,28 @@ mender_scheduler_mutex_create(void **handle) {
     assert(NULL != handle);
 
     /* Create mutex */
-    if (NULL == (*handle = malloc(sizeof(struct k_mutex)))) {
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    size_t index = mender_scheduler_pool_take(mender_scheduler_static_mutexes_used, CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES);
+    if (CONFIG_MENDER_SCHEDULER_STATIC_MUTEXES == index) {
+        mender_log_error("Unable to allocate mutex, the static pool is exhausted");
         return MENDER_FAIL;
     }
+    *handle = (void *)&mender_scheduler_static_mutexes[index];
     if (0 != k_mutex_init((struct k_mutex *)(*handle))) {
-        free(*handle);
+        mender_scheduler_static_mutexes_used[index] = false;
+        *handle                                     = NULL;
+        return MENDER_FAIL;
+    }
+#else
+    if (NULL == (*handle = mender_utils_malloc(sizeof(struct k_mutex)))) {
+        return MENDER_FAIL;
+    }
+    if (0 != k_mutex_init((struct k_mutex *)(*handle))) {
+        mender_utils_free(*handle);
         *handle = NULL;
         return MENDER_FAIL;
     }
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
 
     return MENDER_OK;
 }
@@ -289,7 +643,194 @@ mender_scheduler_mutex_delete(void *handle) {
     assert(NULL != handle);
 
     /* Release memory */
-    free(handle);
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+    mender_scheduler_static_mutexes_used[(struct k_mutex *)handle - mender_scheduler_static_mutexes] = false;
+#else
+    mender_utils_free(handle);
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_task_create(mender_scheduler_task_params_t *task_params, void **handle) {
+
+    assert(NULL != task_params);
+    assert(NULL != task_params->function);
+    assert(NULL != task_params->name);
+    assert(NULL != handle);
+
+    /* Check if the task stack is available */
+    if (true == mender_scheduler_task_stack_used) {
+        mender_log_error("Unable to create task '%s', another task is running", task_params->name);
+        return MENDER_FAIL;
+    }
+
+    /* Create task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)mender_utils_malloc(sizeof(mender_scheduler_task_context_t));
+    if (NULL == task_context) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+    memset(task_context, 0, sizeof(mender_scheduler_task_context_t));
+
+    /* Copy task parameters */
+    task_context->params.function = task_params->function;
+    task_context->params.arg      = task_params->arg;
+    if (NULL == (task_context->params.name = mender_utils_strdup(task_params->name))) {
+        mender_log_error("Unable to allocate memory");
+        goto FAIL;
+    }
+
+    /* Create and start task thread */
+    k_thread_create(&task_context->thread_handle,
+                    mender_scheduler_task_stack,
+                    K_THREAD_STACK_SIZEOF(mender_scheduler_task_stack),
+                    mender_scheduler_task_thread,
+                    task_context,
+                    NULL,
+                    NULL,
+                    CONFIG_MENDER_SCHEDULER_TASK_PRIORITY,
+                    0,
+                    K_NO_WAIT);
+    k_thread_name_set(&task_context->thread_handle, task_context->params.name);
+    mender_scheduler_task_stack_used = true;
+
+    /* Return handle to the new task context */
+    *handle = (void *)task_context;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    if (NULL != task_context) {
+        if (NULL != task_context->params.name) {
+            mender_utils_free(task_context->params.name);
+        }
+        mender_utils_free(task_context);
+    }
+    *handle = NULL;
+
+    return MENDER_FAIL;
+}
+
+mender_err_t
+mender_scheduler_task_join(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)handle;
+
+    /* Wait end of execution of the task thread */
+    if (0 != k_thread_join(&task_context->thread_handle, K_FOREVER)) {
+        mender_log_error("Unable to join task '%s'", task_context->params.name);
+        return MENDER_FAIL;
+    }
+    mender_scheduler_task_stack_used = false;
+
+    /* Release memory */
+    mender_utils_free(task_context->params.name);
+    mender_utils_free(task_context);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_create(size_t length, size_t item_size, void **handle) {
+
+    assert(0 != length);
+    assert(0 != item_size);
+    assert(NULL != handle);
+
+    /* Create queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)mender_utils_malloc(sizeof(mender_scheduler_queue_context_t));
+    if (NULL == queue_context) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (NULL == (queue_context->buffer = (char *)mender_utils_malloc(length * item_size))) {
+        mender_log_error("Unable to allocate memory");
+        mender_utils_free(queue_context);
+        return MENDER_FAIL;
+    }
+
+    /* Create message queue */
+    k_msgq_init(&queue_context->msgq_handle, queue_context->buffer, item_size, length);
+
+    /* Return handle to the new queue context */
+    *handle = (void *)queue_context;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_send(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Send item */
+    if (0 != k_msgq_put(&queue_context->msgq_handle, item, (delay_ms >= 0) ? K_MSEC(delay_ms) : K_FOREVER)) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_receive(void *handle, void *item, int32_t delay_ms) {
+
+    assert(NULL != handle);
+    assert(NULL != item);
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Receive item */
+    if (0 != k_msgq_get(&queue_context->msgq_handle, item, (delay_ms >= 0) ? K_MSEC(delay_ms) : K_FOREVER)) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_queue_delete(void *handle) {
+
+    assert(NULL != handle);
+
+    /* Get queue context */
+    mender_scheduler_queue_context_t *queue_context = (mender_scheduler_queue_context_t *)handle;
+
+    /* Release memory */
+    k_msgq_purge(&queue_context->msgq_handle);
+    mender_utils_free(queue_context->buffer);
+    mender_utils_free(queue_context);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_get_uptime(uint64_t *uptime) {
+
+    assert(NULL != uptime);
+
+    /* Get uptime */
+    *uptime = (uint64_t)k_uptime_get();
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_scheduler_delay(uint32_t delay_ms) {
+
+    /* Suspend the thread */
+    k_msleep((int32_t)delay_ms);
 
     return MENDER_OK;
 }
@@ -297,7 +838,9 @@ mender_scheduler_mutex_delete(void *handle) {
 mender_err_t
 mender_scheduler_exit(void) {
 
-    /* Nothing to do */
+    /* End the batch which was executing (if any) */
+    mender_scheduler_batch_close();
+
     return MENDER_OK;
 }
 
@@ -313,32 +856,218 @@ mender_scheduler_timer_callback(struct k_timer *handle) {
     /* Exit if the work is already pending or executing */
     if (0 != k_sem_take(&work_context->sem_handle, K_NO_WAIT)) {
         mender_log_debug("Work '%s' is not activated, already pending or executing", work_context->params.name);
+        if (true == work_context->activated) {
+            work_context->counters.overruns++;
+        }
         return;
     }
+    work_context->submitted = k_uptime_get_32();
 
     /* Submit the work to the work queue */
-    if (k_work_submit_to_queue(&mender_scheduler_work_queue_handle, &work_context->work_handle) < 0) {
+    if (0 != mender_scheduler_work_queue_send(work_context)) {
         mender_log_warning("Unable to submit work '%s' to the work queue", work_context->params.name);
         k_sem_give(&work_context->sem_handle);
     }
 }
 
 static void
-mender_scheduler_work_handler(struct k_work *handle) {
+mender_scheduler_work_queue_thread(void *p1, void *p2, void *p3) {
+
+    (void)p1;
+    (void)p2;
+    (void)p3;
+    mender_scheduler_work_context_t *work_context = NULL;
+
+    /* Handle work to be executed */
+    while (0 == mender_scheduler_work_queue_receive(&work_context)) {
+        assert(NULL != work_context);
+
+#if CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0
+        /* Gather the works which timers expire soon */
+        mender_scheduler_work_gather(work_context);
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0 */
+
+        /* Begin a batch if other works are pending, they are executed back-to-back */
+        mender_scheduler_batch_open(work_context);
+
+        /* Call work function */
+        uint32_t     start = k_uptime_get_32();
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+        mender_err_t ret   = work_context->params.function(work_context->params.arg);
+#else
+        mender_err_t ret   = work_context->params.function();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+        mender_scheduler_work_count(&work_context->counters, start - work_context->submitted, k_uptime_get_32() - start);
+        if (MENDER_DONE == ret) {
+
+            /* Work is done, stop timer used to execute the work periodically */
+            k_timer_stop(&work_context->timer_handle);
+        }
 
-    assert(NULL != handle);
+        /* Release semaphore used to protect the work function */
+        k_sem_give(&work_context->sem_handle);
+
+        /* End the batch if no other work is pending */
+        mender_scheduler_batch_close();
+    }
+}
+
+#if CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0
+
+static void
+mender_scheduler_work_gather(mender_scheduler_work_context_t *work_context) {
 
-    /* Get work context */
-    mender_scheduler_work_context_t *work_context = CONTAINER_OF(handle, mender_scheduler_work_context_t, work_handle);
     assert(NULL != work_context);
 
-    /* Call work function */
-    if (MENDER_DONE == work_context->params.function()) {
+    /* Submit the works which timers expire within the slack, their timers are restarted */
+    k_mutex_lock(&mender_scheduler_works_mutex, K_FOREVER);
+    for (mender_scheduler_work_context_t *other = mender_scheduler_works; NULL != other; other = other->next) {
+        uint32_t remaining = k_timer_remaining_get(&other->timer_handle);
+        if ((other != work_context) && (true == other->activated) && (remaining > 0) && (remaining <= 1000 * CONFIG_MENDER_SCHEDULER_WORK_SLACK)) {
+            k_timer_start(&other->timer_handle, K_MSEC(1000 * other->params.period), K_MSEC(1000 * other->params.period));
+            mender_scheduler_timer_callback(&other->timer_handle);
+        }
+    }
+    k_mutex_unlock(&mender_scheduler_works_mutex);
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_WORK_SLACK > 0 */
 
-        /* Work is done, stop timer used to execute the work periodically */
-        k_timer_stop(&work_context->timer_handle);
+static int
+mender_scheduler_work_queue_send(mender_scheduler_work_context_t *work_context) {
+
+    assert(NULL != work_context);
+    int ret;
+
+    /* Submit the work to the work queue of its priority, then count it */
+    if (0 != (ret = k_msgq_put(&mender_scheduler_work_queue_handles[work_context->params.priority], &work_context, K_NO_WAIT))) {
+        return ret;
     }
+    k_sem_give(&mender_scheduler_work_queue_count_handle);
 
-    /* Release semaphore used to protect the work function */
-    k_sem_give(&work_context->sem_handle);
+    return 0;
+}
+
+static int
+mender_scheduler_work_queue_receive(mender_scheduler_work_context_t **work_context) {
+
+    assert(NULL != work_context);
+    int ret;
+
+    /* Wait a work, then receive it from the work queue with the highest priority */
+    if (0 != (ret = k_sem_take(&mender_scheduler_work_queue_count_handle, K_FOREVER))) {
+        return ret;
+    }
+    for (size_t priority = MENDER_SCHEDULER_WORK_PRIORITIES; priority > 0; priority--) {
+        if (0 == k_msgq_get(&mender_scheduler_work_queue_handles[priority - 1], work_context, K_NO_WAIT)) {
+            return 0;
+        }
+    }
+
+    return -ENOMSG;
+}
+
+static void
+mender_scheduler_work_count(mender_scheduler_work_counters_t *counters, uint32_t latency, uint32_t duration) {
+
+    assert(NULL != counters);
+
+    /* Update the work counters */
+    counters->latency_total += latency;
+    if (latency > counters->latency_max) {
+        counters->latency_max = latency;
+    }
+    counters->duration_total += duration;
+    if ((0 == counters->executions) || (duration < counters->duration_min)) {
+        counters->duration_min = duration;
+    }
+    if (duration > counters->duration_max) {
+        counters->duration_max = duration;
+    }
+    counters->executions++;
+}
+
+static void
+mender_scheduler_batch_open(mender_scheduler_work_context_t *work_context) {
+
+    assert(NULL != work_context);
+#ifndef CONFIG_MENDER_CLIENT_CONTEXTS
+    (void)work_context;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    /* Begin a batch if works are pending and no batch is executing */
+    k_mutex_lock(&mender_scheduler_works_mutex, K_FOREVER);
+    if ((true != mender_scheduler_batch) && (k_sem_count_get(&mender_scheduler_work_queue_count_handle) > 0)) {
+        mender_scheduler_batch = true;
+        if (NULL != mender_scheduler_batch_begin) {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+            if (MENDER_OK == mender_scheduler_batch_begin(work_context->params.arg)) {
+                mender_scheduler_batch_opened = true;
+                mender_scheduler_batch_arg    = work_context->params.arg;
+#else
+            if (MENDER_OK == mender_scheduler_batch_begin()) {
+                mender_scheduler_batch_opened = true;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+            } else {
+                mender_log_warning("Unable to begin batch of works");
+            }
+        }
+    }
+    k_mutex_unlock(&mender_scheduler_works_mutex);
+}
+
+static void
+mender_scheduler_batch_close(void) {
+
+    /* End the batch if it is executing and no work is pending */
+    k_mutex_lock(&mender_scheduler_works_mutex, K_FOREVER);
+    if ((true == mender_scheduler_batch) && (0 == k_sem_count_get(&mender_scheduler_work_queue_count_handle))) {
+        if ((true == mender_scheduler_batch_opened) && (NULL != mender_scheduler_batch_end)) {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+            mender_scheduler_batch_end(mender_scheduler_batch_arg);
+#else
+            mender_scheduler_batch_end();
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+        }
+        mender_scheduler_batch        = false;
+        mender_scheduler_batch_opened = false;
+    }
+    k_mutex_unlock(&mender_scheduler_works_mutex);
+}
+
+static void
+mender_scheduler_task_thread(void *p1, void *p2, void *p3) {
+
+    assert(NULL != p1);
+    (void)p2;
+    (void)p3;
+
+    /* Get task context */
+    mender_scheduler_task_context_t *task_context = (mender_scheduler_task_context_t *)p1;
+
+    /* Call task function */
+    task_context->params.function(task_context->params.arg);
 }
+
+#ifdef CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION
+
+static size_t
+mender_scheduler_pool_take(bool *used, size_t count) {
+
+    assert(NULL != used);
+    size_t index;
+
+    /* Take the first free slot of the pool */
+    k_spinlock_key_t key = k_spin_lock(&mender_scheduler_static_lock);
+    for (index = 0; index < count; index++) {
+        if (true != used[index]) {
+            used[index] = true;
+            break;
+        }
+    }
+    k_spin_unlock(&mender_scheduler_static_lock, key);
+
+    return index;
+}
+
+#endif /* CONFIG_MENDER_SCHEDULER_STATIC_ALLOCATION */
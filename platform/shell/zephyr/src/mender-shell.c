@@ -17,6 +17,11 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_TROUBLESHOOT
+
 #include <zephyr/init.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
@@ -61,12 +66,24 @@
 #endif /* CONFIG_MENDER_SHELL_TX_WORK_QUEUE_PRIORITY */
 
 /**
- * @brief Default tx work delay (milliseconds)
+ * @brief Default tx work delay (milliseconds), maximum time the output is held before it is sent
  */
 #ifndef CONFIG_MENDER_SHELL_TX_WORK_DELAY
 #define CONFIG_MENDER_SHELL_TX_WORK_DELAY (100)
 #endif /* CONFIG_MENDER_SHELL_TX_WORK_DELAY */
 
+/**
+ * @brief Default tx frame size (bytes), maximum length of the output sent in one message
+ */
+#ifndef CONFIG_MENDER_SHELL_TX_FRAME_SIZE
+#define CONFIG_MENDER_SHELL_TX_FRAME_SIZE (512)
+#endif /* CONFIG_MENDER_SHELL_TX_FRAME_SIZE */
+
+/**
+ * @brief Tx frame size (bytes), the output is sent as soon as a frame is full so it can not be larger than the tx ring buffer
+ */
+#define MENDER_SHELL_TX_FRAME_SIZE MIN(CONFIG_MENDER_SHELL_TX_FRAME_SIZE, CONFIG_MENDER_SHELL_TX_RING_BUFFER_SIZE)
+
 /**
  * @brief Default log backend level (no logs)
  */
@@ -116,20 +133,18 @@ static void
 mender_shell_tx_work_handler(struct k_work *work) {
 
     (void)work;
-    uint8_t *buffer;
-    size_t   length;
-
-    /* Retrieve length of data available in the tx ring buffer */
-    if ((length = ring_buf_size_get(&mender_shell_context.tx_ringbuf)) > 0) {
-
-        /* Send data to the shell on the mender server */
-        if (NULL == (buffer = malloc(length))) {
-            mender_log_error("Unable to allocate memory");
-        } else {
-            ring_buf_get(&mender_shell_context.tx_ringbuf, buffer, (uint32_t)length);
-            mender_troubleshoot_shell_print(buffer, length);
-            free(buffer);
-        }
+    uint8_t *data;
+    uint32_t length;
+
+    /* Send the data available in the tx ring buffer to the shell on the mender server, the output is coalesced in frames sent from the ring buffer memory */
+    while ((length = ring_buf_get_claim(&mender_shell_context.tx_ringbuf, &data, MENDER_SHELL_TX_FRAME_SIZE)) > 0) {
+        mender_troubleshoot_shell_print(data, length);
+        ring_buf_get_finish(&mender_shell_context.tx_ringbuf, length);
+    }
+
+    /* Invoke event handler to signal the tx ring buffer can be written again */
+    if (NULL != mender_shell_context.evt_handler) {
+        mender_shell_context.evt_handler(SHELL_TRANSPORT_EVT_TX_RDY, mender_shell_context.context);
     }
 }
 
@@ -199,41 +214,21 @@ mender_shell_transport_api_write(const struct shell_transport *transport, const
     assert(NULL != data);
     assert(NULL != cnt);
     mender_shell_context_t *ctx = (mender_shell_context_t *)transport->ctx;
-    uint8_t                *buffer;
 
-    /* Cancel pending tx work */
-    k_work_cancel_delayable(&ctx->tx_work_handle);
+    /* Add data to the tx ring buffer, the shell waits for the tx work to signal it is ready if the ring buffer is full */
+    *cnt = ring_buf_put(&ctx->tx_ringbuf, data, (uint32_t)length);
 
-    /* Add data to the tx ring buffer */
-    if (length != ring_buf_put(&ctx->tx_ringbuf, data, (uint32_t)length)) {
-        mender_log_error("Unable to write data to the shell");
-        *cnt = 0;
-        goto END;
-    }
-    *cnt = length;
-
-    /* Retrieve length of data available in the tx ring buffer */
-    if ((length = ring_buf_size_get(&mender_shell_context.tx_ringbuf)) > CONFIG_MENDER_SHELL_TX_RING_BUFFER_SIZE / 4) {
-
-        /* Send data to the shell on the mender server */
-        if (NULL == (buffer = malloc(length))) {
-            mender_log_error("Unable to allocate memory");
-        } else {
-            ring_buf_get(&ctx->tx_ringbuf, buffer, (uint32_t)length);
-            mender_troubleshoot_shell_print(buffer, length);
-            free(buffer);
-        }
-    }
-
-    /* If tx ring buffer is not empty, schedule delayed tx work to flush the ring buffer */
-    if (!ring_buf_is_empty(&ctx->tx_ringbuf)) {
-        k_work_reschedule_for_queue(&ctx->tx_work_queue_handle, &ctx->tx_work_handle, K_MSEC(CONFIG_MENDER_SHELL_TX_WORK_DELAY));
+    /* Send the data immediately if a frame is full, otherwise they are held until the delay expires so that the following writes are sent in the same frame */
+    if (ring_buf_size_get(&ctx->tx_ringbuf) >= MENDER_SHELL_TX_FRAME_SIZE) {
+        k_work_reschedule_for_queue(&ctx->tx_work_queue_handle, &ctx->tx_work_handle, K_NO_WAIT);
+    } else if (!ring_buf_is_empty(&ctx->tx_ringbuf)) {
+        k_work_schedule_for_queue(&ctx->tx_work_queue_handle, &ctx->tx_work_handle, K_MSEC(CONFIG_MENDER_SHELL_TX_WORK_DELAY));
     }
 
     /* Invoke event handler to signal data have been written */
-    ctx->evt_handler(SHELL_TRANSPORT_EVT_TX_RDY, ctx->context);
-
-END:
+    if (0 != *cnt) {
+        ctx->evt_handler(SHELL_TRANSPORT_EVT_TX_RDY, ctx->context);
+    }
 
     return 0;
 }
@@ -328,7 +323,7 @@ mender_shell_write(uint8_t *data, size_t length) {
         goto END;
     }
 
-    /* Copy data to the rx ring buffer */
+    /* Copy data to the rx ring buffer, this is the only copy of the input before the shell reads it */
     if (length != ring_buf_put(&mender_shell_context.rx_ringbuf, data, (uint32_t)length)) {
         mender_log_error("Unable to write data to the shell");
         ret = MENDER_FAIL;
@@ -20,6 +20,9 @@
 #include <nvs_flash.h>
 #include "mender-log.h"
 #include "mender-storage.h"
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+#include "mender-tls.h"
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
 
 /**
  * @brief NVS keys
@@ -29,11 +32,89 @@
 #define MENDER_STORAGE_NVS_DEPLOYMENT_DATA "deployment-data.json"
 #define MENDER_STORAGE_NVS_DEVICE_CONFIG   "config.json"
 
+/**
+ * @brief Items of the storage
+ */
+typedef enum {
+    MENDER_STORAGE_ITEM_PRIVATE_KEY = 0, /**< Private key */
+    MENDER_STORAGE_ITEM_PUBLIC_KEY,      /**< Public key */
+    MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, /**< Deployment data */
+    MENDER_STORAGE_ITEM_DEVICE_CONFIG,   /**< Device configuration */
+    MENDER_STORAGE_ITEMS                 /**< Number of items */
+} mender_storage_item_t;
+
 /**
  * @brief NVS storage handle
  */
 static nvs_handle_t mender_storage_nvs_handle;
 
+/**
+ * @brief Storage statistics
+ */
+static mender_storage_statistics_t mender_storage_statistics;
+
+/**
+ * @brief Depth of the transactions, the NVS is committed when the outermost transaction is committed
+ */
+static size_t mender_storage_transaction = 0;
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+
+/**
+ * @brief Digest of the items
+ */
+typedef struct {
+    bool    known;                                   /**< Digest is known, the item has been read or written */
+    uint8_t digest[MENDER_TLS_SHA256_DIGEST_LENGTH]; /**< Digest of the item stored */
+} mender_storage_digest_t;
+
+/**
+ * @brief Digests of the items, writes of items identical to the ones stored are skipped
+ */
+static mender_storage_digest_t mender_storage_digests[MENDER_STORAGE_ITEMS];
+
+/**
+ * @brief Compute digest of an item
+ * @param data Data of the item
+ * @param length Length of the data
+ * @param digest Digest of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_digest(const void *data, size_t length, uint8_t *digest);
+
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
+/**
+ * @brief Write an item, the write is skipped if the item stored is identical
+ * @param item Item
+ * @param key NVS key of the item
+ * @param data Data of the item
+ * @param length Length of the data, including the null terminator of strings
+ * @param string Item is a string
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_write(mender_storage_item_t item, const char *key, const void *data, size_t length, bool string);
+
+/**
+ * @brief Remember the digest of an item read
+ * @param item Item
+ * @param data Data of the item
+ * @param length Length of the data
+ */
+static void mender_storage_learn(mender_storage_item_t item, const void *data, size_t length);
+
+/**
+ * @brief Forget the digest of an item deleted
+ * @param item Item
+ */
+static void mender_storage_forget(mender_storage_item_t item);
+
+/**
+ * @brief Commit the NVS, the commit is deferred until the outermost transaction is committed
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_sync(void);
+
 mender_err_t
 mender_storage_init(void) {
 
@@ -53,12 +134,12 @@ mender_storage_set_authentication_keys(unsigned char *private_key, size_t privat
     assert(NULL != public_key);
 
     /* Write keys */
-    if ((ESP_OK != nvs_set_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, private_key, private_key_length))
-        || (ESP_OK != nvs_set_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, public_key, public_key_length))) {
+    if ((MENDER_OK != mender_storage_write(MENDER_STORAGE_ITEM_PRIVATE_KEY, MENDER_STORAGE_NVS_PRIVATE_KEY, private_key, private_key_length, false))
+        || (MENDER_OK != mender_storage_write(MENDER_STORAGE_ITEM_PUBLIC_KEY, MENDER_STORAGE_NVS_PUBLIC_KEY, public_key, public_key_length, false))) {
         mender_log_error("Unable to write authentication keys");
         return MENDER_FAIL;
     }
-    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
+    if (MENDER_OK != mender_storage_sync()) {
         mender_log_error("Unable to write authentication keys");
         return MENDER_FAIL;
     }
@@ -83,13 +164,13 @@ mender_storage_get_authentication_keys(unsigned char **private_key, size_t *priv
     }
 
     /* Allocate memory to copy keys */
-    if (NULL == (*private_key = (unsigned char *)malloc(*private_key_length))) {
+    if (NULL == (*private_key = (unsigned char *)mender_utils_malloc(*private_key_length))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
-    if (NULL == (*public_key = (unsigned char *)malloc(*public_key_length))) {
+    if (NULL == (*public_key = (unsigned char *)mender_utils_malloc(*public_key_length))) {
         mender_log_error("Unable to allocate memory");
-        free(*private_key);
+        mender_utils_free(*private_key);
         *private_key = NULL;
         return MENDER_FAIL;
     }
@@ -98,12 +179,14 @@ mender_storage_get_authentication_keys(unsigned char **private_key, size_t *priv
     if ((ESP_OK != nvs_get_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, *private_key, private_key_length))
         || (ESP_OK != nvs_get_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, *public_key, public_key_length))) {
         mender_log_error("Unable to read authentication keys");
-        free(*private_key);
+        mender_utils_free(*private_key);
         *private_key = NULL;
-        free(*public_key);
+        mender_utils_free(*public_key);
         *public_key = NULL;
         return MENDER_FAIL;
     }
+    mender_storage_learn(MENDER_STORAGE_ITEM_PRIVATE_KEY, *private_key, *private_key_length);
+    mender_storage_learn(MENDER_STORAGE_ITEM_PUBLIC_KEY, *public_key, *public_key_length);
 
     return MENDER_OK;
 }
@@ -112,12 +195,14 @@ mender_err_t
 mender_storage_delete_authentication_keys(void) {
 
     /* Erase keys */
+    mender_storage_forget(MENDER_STORAGE_ITEM_PRIVATE_KEY);
+    mender_storage_forget(MENDER_STORAGE_ITEM_PUBLIC_KEY);
     if ((ESP_OK != nvs_erase_key(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY))
         || (ESP_OK != nvs_erase_key(mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY))) {
         mender_log_error("Unable to erase authentication keys");
         return MENDER_FAIL;
     }
-    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
+    if (MENDER_OK != mender_storage_sync()) {
         mender_log_error("Unable to erase authentication keys");
         return MENDER_FAIL;
     }
@@ -126,16 +211,17 @@ mender_storage_delete_authentication_keys(void) {
 }
 
 mender_err_t
-mender_storage_set_deployment_data(char *deployment_data) {
+mender_storage_set_deployment_data(const void *deployment_data, size_t deployment_data_length) {
 
     assert(NULL != deployment_data);
 
     /* Write deployment data */
-    if (ESP_OK != nvs_set_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, deployment_data)) {
+    if (MENDER_OK
+        != mender_storage_write(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, deployment_data, deployment_data_length, false)) {
         mender_log_error("Unable to write deployment data");
         return MENDER_FAIL;
     }
-    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
+    if (MENDER_OK != mender_storage_sync()) {
         mender_log_error("Unable to write deployment data");
         return MENDER_FAIL;
     }
@@ -144,31 +230,44 @@ mender_storage_set_deployment_data(char *deployment_data) {
 }
 
 mender_err_t
-mender_storage_get_deployment_data(char **deployment_data) {
+mender_storage_get_deployment_data(void **deployment_data, size_t *deployment_data_length) {
 
     assert(NULL != deployment_data);
-    size_t deployment_data_length = 0;
-
-    /* Retrieve length of the deployment data */
-    nvs_get_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, NULL, &deployment_data_length);
-    if (0 == deployment_data_length) {
+    assert(NULL != deployment_data_length);
+    bool text = false;
+
+    /* Retrieve length of the deployment data, deployment data written by previous versions of the client is a string */
+    *deployment_data_length = 0;
+    nvs_get_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, NULL, deployment_data_length);
+    if (0 == *deployment_data_length) {
+        nvs_get_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, NULL, deployment_data_length);
+        text = true;
+    }
+    if (0 == *deployment_data_length) {
         mender_log_info("Deployment data not available");
         return MENDER_NOT_FOUND;
     }
 
     /* Allocate memory to copy deployment data */
-    if (NULL == (*deployment_data = (char *)malloc(deployment_data_length + 1))) {
+    if (NULL == (*deployment_data = mender_utils_malloc(*deployment_data_length))) {
         mender_log_error("Unable to allocate memory");
+        *deployment_data_length = 0;
         return MENDER_FAIL;
     }
 
     /* Read deployment data */
-    if (ESP_OK != nvs_get_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, *deployment_data, &deployment_data_length)) {
+    if (ESP_OK
+        != ((true == text) ? nvs_get_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, *deployment_data, deployment_data_length)
+                           : nvs_get_blob(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, *deployment_data, deployment_data_length))) {
         mender_log_error("Unable to read deployment data");
-        free(*deployment_data);
-        *deployment_data = NULL;
+        mender_utils_free(*deployment_data);
+        *deployment_data        = NULL;
+        *deployment_data_length = 0;
         return MENDER_FAIL;
     }
+    if (false == text) {
+        mender_storage_learn(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA, *deployment_data, *deployment_data_length);
+    }
 
     return MENDER_OK;
 }
@@ -177,10 +276,15 @@ mender_err_t
 mender_storage_delete_deployment_data(void) {
 
     /* Delete deployment data */
+    mender_storage_forget(MENDER_STORAGE_ITEM_DEPLOYMENT_DATA);
     if (ESP_OK != nvs_erase_key(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA)) {
         mender_log_error("Unable to delete deployment data");
         return MENDER_FAIL;
     }
+    if (MENDER_OK != mender_storage_sync()) {
+        mender_log_error("Unable to delete deployment data");
+        return MENDER_FAIL;
+    }
 
     return MENDER_OK;
 }
@@ -194,11 +298,12 @@ mender_storage_set_device_config(char *device_config) {
     assert(NULL != device_config);
 
     /* Write device configuration */
-    if (ESP_OK != nvs_set_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, device_config)) {
+    if (MENDER_OK
+        != mender_storage_write(MENDER_STORAGE_ITEM_DEVICE_CONFIG, MENDER_STORAGE_NVS_DEVICE_CONFIG, device_config, strlen(device_config) + 1, true)) {
         mender_log_error("Unable to write device configuration");
         return MENDER_FAIL;
     }
-    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
+    if (MENDER_OK != mender_storage_sync()) {
         mender_log_error("Unable to write device configuration");
         return MENDER_FAIL;
     }
@@ -220,7 +325,7 @@ mender_storage_get_device_config(char **device_config) {
     }
 
     /* Allocate memory to copy device configuration */
-    if (NULL == (*device_config = (char *)malloc(device_config_length + 1))) {
+    if (NULL == (*device_config = (char *)mender_utils_malloc(device_config_length + 1))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
@@ -228,10 +333,11 @@ mender_storage_get_device_config(char **device_config) {
     /* Read device configuration */
     if (ESP_OK != nvs_get_str(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, *device_config, &device_config_length)) {
         mender_log_error("Unable to read device configuration");
-        free(*device_config);
+        mender_utils_free(*device_config);
         *device_config = NULL;
         return MENDER_FAIL;
     }
+    mender_storage_learn(MENDER_STORAGE_ITEM_DEVICE_CONFIG, *device_config, device_config_length);
 
     return MENDER_OK;
 }
@@ -240,10 +346,15 @@ mender_err_t
 mender_storage_delete_device_config(void) {
 
     /* Delete device configuration */
+    mender_storage_forget(MENDER_STORAGE_ITEM_DEVICE_CONFIG);
     if (ESP_OK != nvs_erase_key(mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG)) {
         mender_log_error("Unable to delete device configuration");
         return MENDER_FAIL;
     }
+    if (MENDER_OK != mender_storage_sync()) {
+        mender_log_error("Unable to delete device configuration");
+        return MENDER_FAIL;
+    }
 
     return MENDER_OK;
 }
@@ -251,11 +362,149 @@ mender_storage_delete_device_config(void) {
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
 
+mender_err_t
+mender_storage_get_statistics(mender_storage_statistics_t *statistics) {
+
+    assert(NULL != statistics);
+
+    /* Copy statistics */
+    memcpy(statistics, &mender_storage_statistics, sizeof(mender_storage_statistics_t));
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_begin(void) {
+
+    /* Defer the commit of the NVS */
+    mender_storage_transaction++;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_commit(void) {
+
+    assert(0 < mender_storage_transaction);
+
+    /* Commit the NVS when the outermost transaction is committed */
+    if (0 < --mender_storage_transaction) {
+        return MENDER_OK;
+    }
+    if (ESP_OK != nvs_commit(mender_storage_nvs_handle)) {
+        mender_log_error("Unable to commit NVS storage");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
 mender_err_t
 mender_storage_exit(void) {
 
     /* Close NVS storage */
     nvs_close(mender_storage_nvs_handle);
 
+    /* Release statistics and digests, the storage may be initialized again */
+    memset(&mender_storage_statistics, 0, sizeof(mender_storage_statistics));
+    mender_storage_transaction = 0;
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    memset(mender_storage_digests, 0, sizeof(mender_storage_digests));
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+
+static mender_err_t
+mender_storage_digest(const void *data, size_t length, uint8_t *digest) {
+
+    void        *handle = NULL;
+    mender_err_t ret;
+
+    /* Compute SHA-256 of the data */
+    if (MENDER_OK != (ret = mender_tls_sha256_begin(&handle))) {
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_tls_sha256_update(handle, data, length))) {
+        mender_tls_sha256_end(handle, NULL);
+        return ret;
+    }
+
+    return mender_tls_sha256_end(handle, digest);
+}
+
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
+static mender_err_t
+mender_storage_write(mender_storage_item_t item, const char *key, const void *data, size_t length, bool string) {
+
+    assert(NULL != key);
+    assert(NULL != data);
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    /* Skip the write if the item stored is identical, the digest is forgotten until the write succeeds */
+    uint8_t digest[MENDER_TLS_SHA256_DIGEST_LENGTH];
+    bool    digest_valid = (MENDER_OK == mender_storage_digest(data, length, digest));
+    if ((true == digest_valid) && (true == mender_storage_digests[item].known) && (0 == memcmp(mender_storage_digests[item].digest, digest, sizeof(digest)))) {
+        mender_storage_statistics.skipped++;
+        return MENDER_OK;
+    }
+    mender_storage_digests[item].known = false;
+#else
+    (void)item;
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
+    /* Write data */
+    if (ESP_OK
+        != ((true == string) ? nvs_set_str(mender_storage_nvs_handle, key, (const char *)data) : nvs_set_blob(mender_storage_nvs_handle, key, data, length))) {
+        return MENDER_FAIL;
+    }
+    mender_storage_statistics.writes++;
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    /* Remember the digest of the item stored */
+    if (true == digest_valid) {
+        memcpy(mender_storage_digests[item].digest, digest, sizeof(digest));
+        mender_storage_digests[item].known = true;
+    }
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
+    return MENDER_OK;
+}
+
+static void
+mender_storage_learn(mender_storage_item_t item, const void *data, size_t length) {
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    /* Remember the digest of the item stored, so that writing it again after startup is skipped */
+    mender_storage_digests[item].known = (MENDER_OK == mender_storage_digest(data, length, mender_storage_digests[item].digest));
+#else
+    (void)item;
+    (void)data;
+    (void)length;
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+}
+
+static void
+mender_storage_forget(mender_storage_item_t item) {
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    /* Forget the digest of the item */
+    mender_storage_digests[item].known = false;
+#else
+    (void)item;
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+}
+
+static mender_err_t
+mender_storage_sync(void) {
+
+    /* Commit the NVS, unless a transaction is in progress */
+    if ((0 == mender_storage_transaction) && (ESP_OK != nvs_commit(mender_storage_nvs_handle))) {
+        return MENDER_FAIL;
+    }
+
     return MENDER_OK;
 }
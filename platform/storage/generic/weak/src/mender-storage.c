@@ -59,18 +59,20 @@ mender_storage_delete_authentication_keys(void) {
 }
 
 __attribute__((weak)) mender_err_t
-mender_storage_set_deployment_data(char *deployment_data) {
+mender_storage_set_deployment_data(const void *deployment_data, size_t deployment_data_length) {
 
     (void)deployment_data;
+    (void)deployment_data_length;
 
     /* Nothing to do */
     return MENDER_NOT_IMPLEMENTED;
 }
 
 __attribute__((weak)) mender_err_t
-mender_storage_get_deployment_data(char **deployment_data) {
+mender_storage_get_deployment_data(void **deployment_data, size_t *deployment_data_length) {
 
     (void)deployment_data;
+    (void)deployment_data_length;
 
     /* Nothing to do */
     return MENDER_NOT_IMPLEMENTED;
@@ -114,6 +116,29 @@ mender_storage_delete_device_config(void) {
 #endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
 #endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
 
+__attribute__((weak)) mender_err_t
+mender_storage_get_statistics(mender_storage_statistics_t *statistics) {
+
+    (void)statistics;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_storage_begin(void) {
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_storage_commit(void) {
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 __attribute__((weak)) mender_err_t
 mender_storage_exit(void) {
 
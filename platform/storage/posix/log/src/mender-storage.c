@@ -0,0 +1,985 @@
+/**
+ * @file      mender-storage.c
+ * @brief     Mender storage interface for Posix platform, all the items are kept in a single append-only log file compacted periodically
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef CONFIG_MENDER_STORAGE_MMAP
+#include <sys/mman.h>
+#endif /* CONFIG_MENDER_STORAGE_MMAP */
+#include <unistd.h>
+#include "mender-log.h"
+#include "mender-storage.h"
+
+/**
+ * @brief Default storage path (working directory)
+ */
+#ifndef CONFIG_MENDER_STORAGE_PATH
+#define CONFIG_MENDER_STORAGE_PATH ""
+#endif /* CONFIG_MENDER_STORAGE_PATH */
+
+/**
+ * @brief Default size of the log file above which it is compacted when less than half of it is still used (bytes)
+ */
+#ifndef CONFIG_MENDER_STORAGE_LOG_COMPACT_SIZE
+#define CONFIG_MENDER_STORAGE_LOG_COMPACT_SIZE (65536)
+#endif /* CONFIG_MENDER_STORAGE_LOG_COMPACT_SIZE */
+
+/**
+ * @brief Log files, the temporary file is renamed over the log file when the compaction is completed
+ */
+#define MENDER_STORAGE_LOG_FILE           CONFIG_MENDER_STORAGE_PATH "mender-storage.log"
+#define MENDER_STORAGE_LOG_COMPACTED_FILE CONFIG_MENDER_STORAGE_PATH "mender-storage.log.tmp"
+
+/**
+ * @brief Magic number of the entries of the log file
+ */
+#define MENDER_STORAGE_LOG_MAGIC (0x474F4C4DUL)
+
+/**
+ * @brief Entry flag set when the item is deleted
+ */
+#define MENDER_STORAGE_LOG_FLAG_DELETED (1 << 0)
+
+/**
+ * @brief Entry flag of the commit record which ends a group, the entries of the group are applied once it is written, it has no item and no data
+ */
+#define MENDER_STORAGE_LOG_FLAG_COMMIT (1 << 1)
+
+/**
+ * @brief Items of the log file
+ */
+typedef enum {
+    MENDER_STORAGE_LOG_PRIVATE_KEY = 0, /**< Private key */
+    MENDER_STORAGE_LOG_PUBLIC_KEY,      /**< Public key */
+    MENDER_STORAGE_LOG_DEPLOYMENT_DATA, /**< Deployment data */
+    MENDER_STORAGE_LOG_DEVICE_CONFIG,   /**< Device configuration */
+    MENDER_STORAGE_LOG_PROVIDES,        /**< Provides */
+    MENDER_STORAGE_LOG_ITEMS            /**< Number of items */
+} mender_storage_log_item_t;
+
+/**
+ * @brief Header of the entries of the log file, the data of the item follow
+ */
+typedef struct {
+    uint32_t magic;  /**< Magic number */
+    uint16_t item;   /**< Item */
+    uint16_t flags;  /**< Flags */
+    uint32_t group;  /**< Group of the entry, the entries written at once and their commit record share it */
+    uint32_t length; /**< Length of the data of the item */
+    uint32_t crc;    /**< CRC-32 of the header, with this field set to 0, and of the data */
+} mender_storage_log_header_t;
+
+/**
+ * @brief Location of the last version of the items in the log file
+ */
+typedef struct {
+    bool   found;  /**< Item is found */
+    off_t  offset; /**< Offset of the data of the item */
+    size_t length; /**< Length of the data of the item */
+} mender_storage_log_index_t;
+
+/**
+ * @brief Log file descriptor, -1 when the storage is not initialized
+ */
+static int mender_storage_log_fd = -1;
+
+/**
+ * @brief Size of the log file, entries are appended at the end, it includes the entries of the group not committed yet
+ */
+static off_t mender_storage_log_size = 0;
+
+/**
+ * @brief Size of the log file up to the last commit record, the log file is truncated to it if committing the group fails
+ */
+static off_t mender_storage_log_committed = 0;
+
+/**
+ * @brief Index of the items
+ */
+static mender_storage_log_index_t mender_storage_log_index[MENDER_STORAGE_LOG_ITEMS];
+
+/**
+ * @brief Mutex used to protect access to the log file, items are read and written from different works
+ */
+static pthread_mutex_t mender_storage_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Depth of the transactions, the log file is synchronized when the outermost transaction is committed
+ */
+static size_t mender_storage_log_transaction = 0;
+
+/**
+ * @brief Group of the entries written, incremented when the group is committed
+ */
+static uint32_t mender_storage_log_group = 0;
+
+/**
+ * @brief Entries of the group have been written during the transaction in progress, its commit record is written when it is committed
+ */
+static bool mender_storage_log_pending = false;
+
+#ifdef CONFIG_MENDER_STORAGE_MMAP
+
+/**
+ * @brief Mapping of the log file used to read the items, NULL if not mapped yet
+ */
+static uint8_t *mender_storage_log_map = NULL;
+
+/**
+ * @brief Size of the mapping, the log file is mapped again when it grows above
+ */
+static size_t mender_storage_log_map_size = 0;
+
+#endif /* CONFIG_MENDER_STORAGE_MMAP */
+
+/**
+ * @brief Compute CRC of an entry
+ * @param header Header of the entry
+ * @param data Data of the item
+ * @return CRC of the entry
+ */
+static uint32_t mender_storage_log_crc(mender_storage_log_header_t *header, const void *data);
+
+/**
+ * @brief Write data to a file at the given offset, partial writes are completed
+ * @param fd File descriptor
+ * @param data Data to be written
+ * @param offset Offset in the file
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_log_pwrite(int fd, const void *data, off_t offset, size_t length);
+
+/**
+ * @brief Read data from a file at the given offset, partial reads are completed
+ * @param fd File descriptor
+ * @param data Data read
+ * @param offset Offset in the file
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the end of the file is reached, error code otherwise
+ */
+static mender_err_t mender_storage_log_pread(int fd, void *data, off_t offset, size_t length);
+
+/**
+ * @brief Append an entry to a log file
+ * @param fd File descriptor
+ * @param size Size of the log file, updated
+ * @param index Index of the items, updated, NULL for the commit record
+ * @param item Item
+ * @param flags Flags of the entry
+ * @param group Group of the entry
+ * @param data Data of the item, NULL if the item is deleted
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_log_append(int                         fd,
+                                              off_t                      *size,
+                                              mender_storage_log_index_t *index,
+                                              mender_storage_log_item_t   item,
+                                              uint16_t                    flags,
+                                              uint32_t                    group,
+                                              const void                 *data,
+                                              size_t                      length);
+
+/**
+ * @brief Load the index of the items from the log file, the entries at the end of the log file which are truncated, corrupted or not committed are discarded
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_log_load(void);
+
+/**
+ * @brief Write the commit record of the group of the entries written and synchronize the log file, the next entries belong to a new group
+ * @note The entries of the group are dropped on failure, the index of the items is then loaded again from the log file
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_log_commit(void);
+
+/**
+ * @brief Write items to the log file and commit them, unless a transaction is in progress, the log file is compacted if required
+ * @param items Items to be written
+ * @param data Data of the items, NULL to delete the items
+ * @param lengths Length of the data of the items
+ * @param count Number of items
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_log_write(const mender_storage_log_item_t *items, const void **data, const size_t *lengths, size_t count);
+
+/**
+ * @brief Read an item from the log file
+ * @param item Item
+ * @param data Data of the item, null terminated
+ * @param length Length of the data of the item
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_FOUND if the item is not found, error code otherwise
+ */
+static mender_err_t mender_storage_log_read(mender_storage_log_item_t item, void **data, size_t *length);
+
+/**
+ * @brief Compact the log file, the last version of the items is written to a new log file renamed over the log file
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_storage_log_compact(void);
+
+/**
+ * @brief Compact the log file when it is large and mostly outdated, keep using the current log file on failure
+ */
+static void mender_storage_log_compact_check(void);
+
+mender_err_t
+mender_storage_init(void) {
+
+    mender_err_t ret;
+
+    pthread_mutex_lock(&mender_storage_log_mutex);
+
+    /* Open log file, a compaction interrupted before the rename is discarded */
+    unlink(MENDER_STORAGE_LOG_COMPACTED_FILE);
+    if (-1 == (mender_storage_log_fd = open(MENDER_STORAGE_LOG_FILE, O_RDWR | O_CREAT, 0600))) {
+        mender_log_error("Unable to open file %s (%d)", MENDER_STORAGE_LOG_FILE, errno);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Load index of the items */
+    if (MENDER_OK != (ret = mender_storage_log_load())) {
+        mender_log_error("Unable to load file %s", MENDER_STORAGE_LOG_FILE);
+        close(mender_storage_log_fd);
+        mender_storage_log_fd = -1;
+    }
+
+END:
+
+    pthread_mutex_unlock(&mender_storage_log_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_set_authentication_keys(unsigned char *private_key, size_t private_key_length, unsigned char *public_key, size_t public_key_length) {
+
+    assert(NULL != private_key);
+    assert(NULL != public_key);
+
+    /* Write keys */
+    mender_storage_log_item_t items[]   = { MENDER_STORAGE_LOG_PRIVATE_KEY, MENDER_STORAGE_LOG_PUBLIC_KEY };
+    const void               *data[]    = { private_key, public_key };
+    size_t                    lengths[] = { private_key_length, public_key_length };
+    if (MENDER_OK != mender_storage_log_write(items, data, lengths, 2)) {
+        mender_log_error("Unable to write authentication keys");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_get_authentication_keys(unsigned char **private_key, size_t *private_key_length, unsigned char **public_key, size_t *public_key_length) {
+
+    assert(NULL != private_key);
+    assert(NULL != private_key_length);
+    assert(NULL != public_key);
+    assert(NULL != public_key_length);
+    mender_err_t ret;
+
+    /* Read keys */
+    if (MENDER_OK != (ret = mender_storage_log_read(MENDER_STORAGE_LOG_PRIVATE_KEY, (void **)private_key, private_key_length))) {
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_storage_log_read(MENDER_STORAGE_LOG_PUBLIC_KEY, (void **)public_key, public_key_length))) {
+        mender_utils_free(*private_key);
+        *private_key        = NULL;
+        *private_key_length = 0;
+        return ret;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_delete_authentication_keys(void) {
+
+    /* Erase keys */
+    mender_storage_log_item_t items[]   = { MENDER_STORAGE_LOG_PRIVATE_KEY, MENDER_STORAGE_LOG_PUBLIC_KEY };
+    const void               *data[]    = { NULL, NULL };
+    size_t                    lengths[] = { 0, 0 };
+    if (MENDER_OK != mender_storage_log_write(items, data, lengths, 2)) {
+        mender_log_error("Unable to erase authentication keys");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_set_deployment_data(const void *deployment_data, size_t deployment_data_length) {
+
+    assert(NULL != deployment_data);
+
+    /* Write deployment data */
+    mender_storage_log_item_t item = MENDER_STORAGE_LOG_DEPLOYMENT_DATA;
+    if (MENDER_OK != mender_storage_log_write(&item, &deployment_data, &deployment_data_length, 1)) {
+        mender_log_error("Unable to write deployment data");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_get_deployment_data(void **deployment_data, size_t *deployment_data_length) {
+
+    assert(NULL != deployment_data);
+    assert(NULL != deployment_data_length);
+
+    /* Read deployment data */
+    return mender_storage_log_read(MENDER_STORAGE_LOG_DEPLOYMENT_DATA, deployment_data, deployment_data_length);
+}
+
+mender_err_t
+mender_storage_delete_deployment_data(void) {
+
+    /* Delete deployment data */
+    mender_storage_log_item_t item   = MENDER_STORAGE_LOG_DEPLOYMENT_DATA;
+    const void               *data   = NULL;
+    size_t                    length = 0;
+    if (MENDER_OK != mender_storage_log_write(&item, &data, &length, 1)) {
+        mender_log_error("Unable to delete deployment data");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE
+#ifdef CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE
+
+mender_err_t
+mender_storage_set_device_config(char *device_config) {
+
+    assert(NULL != device_config);
+
+    /* Write device configuration */
+    mender_storage_log_item_t item   = MENDER_STORAGE_LOG_DEVICE_CONFIG;
+    const void               *data   = device_config;
+    size_t                    length = strlen(device_config);
+    if (MENDER_OK != mender_storage_log_write(&item, &data, &length, 1)) {
+        mender_log_error("Unable to write device configuration");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_get_device_config(char **device_config) {
+
+    assert(NULL != device_config);
+    size_t device_config_length;
+
+    /* Read device configuration */
+    return mender_storage_log_read(MENDER_STORAGE_LOG_DEVICE_CONFIG, (void **)device_config, &device_config_length);
+}
+
+mender_err_t
+mender_storage_delete_device_config(void) {
+
+    /* Delete device configuration */
+    mender_storage_log_item_t item   = MENDER_STORAGE_LOG_DEVICE_CONFIG;
+    const void               *data   = NULL;
+    size_t                    length = 0;
+    if (MENDER_OK != mender_storage_log_write(&item, &data, &length, 1)) {
+        mender_log_error("Unable to delete device configuration");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONFIGURE_STORAGE */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_CONFIGURE */
+
+#ifdef CONFIG_MENDER_FULL_PARSE_ARTIFACT
+#ifdef CONFIG_MENDER_PROVIDES_DEPENDS
+
+mender_err_t
+mender_storage_set_provides(mender_utils_kv_table_t *provides) {
+
+    assert(NULL != provides);
+
+    mender_utils_record_t record;
+    if (MENDER_OK != mender_utils_kv_table_to_record(provides, &record)) {
+        return MENDER_FAIL;
+    }
+
+    /* Write provides */
+    mender_storage_log_item_t item = MENDER_STORAGE_LOG_PROVIDES;
+    const void               *data = record.data;
+    if (MENDER_OK != mender_storage_log_write(&item, &data, &record.length, 1)) {
+        mender_log_error("Unable to write provides");
+        mender_utils_record_release(&record);
+        return MENDER_FAIL;
+    }
+
+    mender_utils_record_release(&record);
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_get_provides(mender_utils_kv_table_t *provides) {
+
+    assert(NULL != provides);
+    void        *provides_data = NULL;
+    size_t       provides_length;
+    mender_err_t ret;
+
+    /* Read provides */
+    if (MENDER_OK != (ret = mender_storage_log_read(MENDER_STORAGE_LOG_PROVIDES, &provides_data, &provides_length))) {
+        return ret;
+    }
+    if (MENDER_OK != mender_utils_record_to_kv_table(provides_data, provides_length, provides)) {
+        mender_log_error("Unable to parse provides");
+        mender_utils_free(provides_data);
+        return MENDER_FAIL;
+    }
+
+    mender_utils_free(provides_data);
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_delete_provides(void) {
+
+    /* Delete provides */
+    mender_storage_log_item_t item   = MENDER_STORAGE_LOG_PROVIDES;
+    const void               *data   = NULL;
+    size_t                    length = 0;
+    if (MENDER_OK != mender_storage_log_write(&item, &data, &length, 1)) {
+        mender_log_error("Unable to delete provides");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_PROVIDES_DEPENDS */
+#endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
+
+mender_err_t
+mender_storage_get_statistics(mender_storage_statistics_t *statistics) {
+
+    (void)statistics;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_storage_begin(void) {
+
+    pthread_mutex_lock(&mender_storage_log_mutex);
+
+    /* Defer the synchronization of the log file */
+    mender_storage_log_transaction++;
+
+    pthread_mutex_unlock(&mender_storage_log_mutex);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_commit(void) {
+
+    mender_err_t ret = MENDER_OK;
+
+    pthread_mutex_lock(&mender_storage_log_mutex);
+
+    /* Write the commit record of the entries of the transaction when the outermost transaction is committed */
+    assert(0 < mender_storage_log_transaction);
+    if ((0 < --mender_storage_log_transaction) || (-1 == mender_storage_log_fd)) {
+        goto END;
+    }
+    if (true == mender_storage_log_pending) {
+        mender_storage_log_pending = false;
+        if (MENDER_OK != (ret = mender_storage_log_commit())) {
+            goto END;
+        }
+    }
+    mender_storage_log_compact_check();
+
+END:
+
+    pthread_mutex_unlock(&mender_storage_log_mutex);
+
+    return ret;
+}
+
+mender_err_t
+mender_storage_exit(void) {
+
+    pthread_mutex_lock(&mender_storage_log_mutex);
+
+    /* Release memory */
+#ifdef CONFIG_MENDER_STORAGE_MMAP
+    if (NULL != mender_storage_log_map) {
+        munmap(mender_storage_log_map, mender_storage_log_map_size);
+        mender_storage_log_map      = NULL;
+        mender_storage_log_map_size = 0;
+    }
+#endif /* CONFIG_MENDER_STORAGE_MMAP */
+    if (-1 != mender_storage_log_fd) {
+        close(mender_storage_log_fd);
+        mender_storage_log_fd = -1;
+    }
+    mender_storage_log_size        = 0;
+    mender_storage_log_committed   = 0;
+    mender_storage_log_transaction = 0;
+    mender_storage_log_group       = 0;
+    mender_storage_log_pending     = false;
+    memset(mender_storage_log_index, 0, sizeof(mender_storage_log_index));
+
+    pthread_mutex_unlock(&mender_storage_log_mutex);
+
+    return MENDER_OK;
+}
+
+static uint32_t
+mender_storage_log_crc(mender_storage_log_header_t *header, const void *data) {
+
+    assert(NULL != header);
+
+    /* Compute CRC of the header with the CRC field set to 0, then of the data */
+    uint32_t crc = header->crc;
+    header->crc  = 0;
+    uint32_t ret = mender_utils_crc32(0, header, sizeof(mender_storage_log_header_t));
+    header->crc  = crc;
+
+    return mender_utils_crc32(ret, data, header->length);
+}
+
+static mender_err_t
+mender_storage_log_pwrite(int fd, const void *data, off_t offset, size_t length) {
+
+    assert((NULL != data) || (0 == length));
+    ssize_t written;
+
+    /* Write data, partial writes are completed */
+    while (length > 0) {
+        if (-1 == (written = pwrite(fd, data, length, offset))) {
+            if (EINTR == errno) {
+                continue;
+            }
+            mender_log_error("pwrite failed (%d)", errno);
+            return MENDER_FAIL;
+        }
+        data = (const uint8_t *)data + written;
+        offset += (off_t)written;
+        length -= (size_t)written;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_log_pread(int fd, void *data, off_t offset, size_t length) {
+
+    assert((NULL != data) || (0 == length));
+    ssize_t count;
+
+    /* Read data, partial reads are completed */
+    while (length > 0) {
+        if (-1 == (count = pread(fd, data, length, offset))) {
+            if (EINTR == errno) {
+                continue;
+            }
+            mender_log_error("pread failed (%d)", errno);
+            return MENDER_FAIL;
+        }
+        if (0 == count) {
+            return MENDER_NOT_FOUND;
+        }
+        data = (uint8_t *)data + count;
+        offset += (off_t)count;
+        length -= (size_t)count;
+    }
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_log_append(int                         fd,
+                          off_t                      *size,
+                          mender_storage_log_index_t *index,
+                          mender_storage_log_item_t   item,
+                          uint16_t                    flags,
+                          uint32_t                    group,
+                          const void                 *data,
+                          size_t                      length) {
+
+    assert(NULL != size);
+    assert((NULL != index) || (0 != (flags & MENDER_STORAGE_LOG_FLAG_COMMIT)));
+
+    /* Write the header and the data of the entry */
+    mender_storage_log_header_t header
+        = { .magic = MENDER_STORAGE_LOG_MAGIC, .item = (uint16_t)item, .flags = flags, .group = group, .length = (uint32_t)length };
+    header.crc = mender_storage_log_crc(&header, data);
+    if ((MENDER_OK != mender_storage_log_pwrite(fd, &header, *size, sizeof(mender_storage_log_header_t)))
+        || (MENDER_OK != mender_storage_log_pwrite(fd, data, *size + (off_t)sizeof(mender_storage_log_header_t), length))) {
+        return MENDER_FAIL;
+    }
+
+    /* Update the index, the commit record has no item */
+    if (NULL != index) {
+        index[item].found  = (0 == (flags & MENDER_STORAGE_LOG_FLAG_DELETED));
+        index[item].offset = *size + (off_t)sizeof(mender_storage_log_header_t);
+        index[item].length = length;
+    }
+    *size += (off_t)(sizeof(mender_storage_log_header_t) + length);
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_storage_log_load(void) {
+
+    struct stat                 st;
+    mender_storage_log_header_t header;
+    mender_storage_log_index_t  index[MENDER_STORAGE_LOG_ITEMS];
+    off_t                       size = 0;
+    uint8_t                    *data = NULL;
+    mender_err_t                ret;
+
+    /* Retrieve size of the log file */
+    if (0 != fstat(mender_storage_log_fd, &st)) {
+        mender_log_error("fstat failed (%d)", errno);
+        return MENDER_FAIL;
+    }
+
+    /* Parse the entries, the last version of each item is kept, the entries of a group are applied when its commit record is found */
+    memset(mender_storage_log_index, 0, sizeof(mender_storage_log_index));
+    memset(index, 0, sizeof(index));
+    mender_storage_log_size  = 0;
+    mender_storage_log_group = 0;
+    while (size + (off_t)sizeof(mender_storage_log_header_t) <= st.st_size) {
+        if (MENDER_OK != (ret = mender_storage_log_pread(mender_storage_log_fd, &header, size, sizeof(mender_storage_log_header_t)))) {
+            goto END;
+        }
+        off_t offset = size + (off_t)sizeof(mender_storage_log_header_t);
+        if (0 == size) {
+            mender_storage_log_group = header.group;
+        }
+        if ((MENDER_STORAGE_LOG_MAGIC != header.magic) || (header.item >= MENDER_STORAGE_LOG_ITEMS) || (header.group != mender_storage_log_group)
+            || ((off_t)header.length > st.st_size - offset)) {
+            break;
+        }
+        uint8_t *tmp;
+        if (NULL == (tmp = (uint8_t *)mender_utils_realloc(data, (0 != header.length) ? header.length : 1))) {
+            mender_log_error("Unable to allocate memory");
+            ret = MENDER_FAIL;
+            goto END;
+        }
+        data = tmp;
+        if (MENDER_OK != (ret = mender_storage_log_pread(mender_storage_log_fd, data, offset, header.length))) {
+            goto END;
+        }
+        if (header.crc != mender_storage_log_crc(&header, data)) {
+            break;
+        }
+        size = offset + (off_t)header.length;
+        if (0 != (header.flags & MENDER_STORAGE_LOG_FLAG_COMMIT)) {
+            memcpy(mender_storage_log_index, index, sizeof(mender_storage_log_index));
+            mender_storage_log_size = size;
+            mender_storage_log_group++;
+        } else {
+            index[header.item].found  = (0 == (header.flags & MENDER_STORAGE_LOG_FLAG_DELETED));
+            index[header.item].offset = offset;
+            index[header.item].length = header.length;
+        }
+    }
+
+    /* Discard the group that was being written when the application stopped, the previous version of its items is used */
+    mender_storage_log_committed = mender_storage_log_size;
+    mender_storage_log_pending   = false;
+    if (mender_storage_log_size != st.st_size) {
+        mender_log_warning("Discarding %ld bytes at the end of file %s", (long)(st.st_size - mender_storage_log_size), MENDER_STORAGE_LOG_FILE);
+        if (0 != ftruncate(mender_storage_log_fd, mender_storage_log_size)) {
+            mender_log_error("ftruncate failed (%d)", errno);
+            ret = MENDER_FAIL;
+            goto END;
+        }
+    }
+    ret = MENDER_OK;
+
+END:
+
+    /* Release memory */
+    mender_utils_free(data);
+
+    return ret;
+}
+
+static mender_err_t
+mender_storage_log_commit(void) {
+
+    off_t size = mender_storage_log_size;
+
+    /* Write the commit record, the entries of the group are valid once it is on the disk */
+    if (MENDER_OK
+        != mender_storage_log_append(mender_storage_log_fd, &size, NULL, 0, MENDER_STORAGE_LOG_FLAG_COMMIT, mender_storage_log_group, NULL, 0)) {
+        goto FAIL;
+    }
+    if (0 != fdatasync(mender_storage_log_fd)) {
+        mender_log_error("fdatasync failed (%d)", errno);
+        goto FAIL;
+    }
+    mender_storage_log_size      = size;
+    mender_storage_log_committed = size;
+    mender_storage_log_group++;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Drop the entries of the group, the index of the items is restored as it is loaded on next startup */
+    if (0 != ftruncate(mender_storage_log_fd, mender_storage_log_committed)) {
+        mender_log_error("ftruncate failed (%d)", errno);
+    }
+    if (MENDER_OK != mender_storage_log_load()) {
+        mender_log_error("Unable to load file %s", MENDER_STORAGE_LOG_FILE);
+    }
+
+    return MENDER_FAIL;
+}
+
+static mender_err_t
+mender_storage_log_write(const mender_storage_log_item_t *items, const void **data, const size_t *lengths, size_t count) {
+
+    assert(NULL != items);
+    assert(NULL != data);
+    assert(NULL != lengths);
+    mender_err_t ret = MENDER_OK;
+
+    pthread_mutex_lock(&mender_storage_log_mutex);
+
+    /* Check if the storage is initialized */
+    if (-1 == mender_storage_log_fd) {
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Append the entries, the index is restored if writing fails so that the log file is loaded the same way on next startup */
+    mender_storage_log_index_t index[MENDER_STORAGE_LOG_ITEMS];
+    off_t                      size = mender_storage_log_size;
+    memcpy(index, mender_storage_log_index, sizeof(mender_storage_log_index));
+    for (size_t item_index = 0; item_index < count; item_index++) {
+        uint16_t flags = (NULL == data[item_index]) ? MENDER_STORAGE_LOG_FLAG_DELETED : 0;
+        if (MENDER_OK
+            != (ret = mender_storage_log_append(
+                    mender_storage_log_fd, &size, index, items[item_index], flags, mender_storage_log_group, data[item_index], lengths[item_index]))) {
+            if (0 != ftruncate(mender_storage_log_fd, mender_storage_log_size)) {
+                mender_log_error("ftruncate failed (%d)", errno);
+            }
+            goto END;
+        }
+    }
+    memcpy(mender_storage_log_index, index, sizeof(mender_storage_log_index));
+    mender_storage_log_size = size;
+
+    /* Commit the entries, they are loaded on next startup only if the commit record is on the disk, the commit is deferred during a transaction */
+    if (0 < mender_storage_log_transaction) {
+        mender_storage_log_pending = true;
+        goto END;
+    }
+    if (MENDER_OK != (ret = mender_storage_log_commit())) {
+        goto END;
+    }
+
+    /* Compact the log file, the compaction is deferred until the transaction is committed */
+    mender_storage_log_compact_check();
+
+END:
+
+    pthread_mutex_unlock(&mender_storage_log_mutex);
+
+    return ret;
+}
+
+static mender_err_t
+mender_storage_log_read(mender_storage_log_item_t item, void **data, size_t *length) {
+
+    assert(NULL != data);
+    assert(NULL != length);
+    mender_err_t ret;
+
+    pthread_mutex_lock(&mender_storage_log_mutex);
+
+    /* Check if the item is found */
+    *data   = NULL;
+    *length = 0;
+    if ((-1 == mender_storage_log_fd) || (false == mender_storage_log_index[item].found)) {
+        ret = MENDER_NOT_FOUND;
+        goto END;
+    }
+
+    /* Allocate memory, the data are null terminated */
+    if (NULL == (*data = mender_utils_malloc(mender_storage_log_index[item].length + 1))) {
+        mender_log_error("Unable to allocate memory");
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    ((uint8_t *)*data)[mender_storage_log_index[item].length] = '\0';
+
+#ifdef CONFIG_MENDER_STORAGE_MMAP
+    /* Map the log file again if it has grown, there is no system call when reading items already mapped */
+    if ((size_t)mender_storage_log_size > mender_storage_log_map_size) {
+        if (NULL != mender_storage_log_map) {
+            munmap(mender_storage_log_map, mender_storage_log_map_size);
+            mender_storage_log_map      = NULL;
+            mender_storage_log_map_size = 0;
+        }
+        void *map = mmap(NULL, (size_t)mender_storage_log_size, PROT_READ, MAP_SHARED, mender_storage_log_fd, 0);
+        if (MAP_FAILED != map) {
+            mender_storage_log_map      = (uint8_t *)map;
+            mender_storage_log_map_size = (size_t)mender_storage_log_size;
+        } else {
+            mender_log_warning("mmap failed (%d), using pread", errno);
+        }
+    }
+    if (NULL != mender_storage_log_map) {
+        memcpy(*data, &mender_storage_log_map[mender_storage_log_index[item].offset], mender_storage_log_index[item].length);
+        *length = mender_storage_log_index[item].length;
+        ret     = MENDER_OK;
+        goto END;
+    }
+#endif /* CONFIG_MENDER_STORAGE_MMAP */
+
+    /* Read the data */
+    if (MENDER_OK
+        != (ret = mender_storage_log_pread(mender_storage_log_fd, *data, mender_storage_log_index[item].offset, mender_storage_log_index[item].length))) {
+        mender_log_error("Unable to read file %s", MENDER_STORAGE_LOG_FILE);
+        mender_utils_free(*data);
+        *data = NULL;
+        ret   = MENDER_FAIL;
+        goto END;
+    }
+    *length = mender_storage_log_index[item].length;
+
+END:
+
+    pthread_mutex_unlock(&mender_storage_log_mutex);
+
+    return ret;
+}
+
+static mender_err_t
+mender_storage_log_compact(void) {
+
+    mender_storage_log_index_t index[MENDER_STORAGE_LOG_ITEMS];
+    off_t                      size = 0;
+    uint8_t                   *data = NULL;
+    int                        fd;
+    mender_err_t               ret = MENDER_FAIL;
+
+    /* Create the compacted log file */
+    memset(index, 0, sizeof(index));
+    if (-1 == (fd = open(MENDER_STORAGE_LOG_COMPACTED_FILE, O_RDWR | O_CREAT | O_TRUNC, 0600))) {
+        mender_log_error("Unable to open file %s (%d)", MENDER_STORAGE_LOG_COMPACTED_FILE, errno);
+        return MENDER_FAIL;
+    }
+
+    /* Copy the last version of the items */
+    for (size_t item = 0; item < MENDER_STORAGE_LOG_ITEMS; item++) {
+        if (false == mender_storage_log_index[item].found) {
+            continue;
+        }
+        uint8_t *tmp;
+        if (NULL == (tmp = (uint8_t *)mender_utils_realloc(data, (0 != mender_storage_log_index[item].length) ? mender_storage_log_index[item].length : 1))) {
+            mender_log_error("Unable to allocate memory");
+            goto END;
+        }
+        data = tmp;
+        if ((MENDER_OK
+             != mender_storage_log_pread(mender_storage_log_fd, data, mender_storage_log_index[item].offset, mender_storage_log_index[item].length))
+            || (MENDER_OK
+                != mender_storage_log_append(
+                    fd, &size, index, (mender_storage_log_item_t)item, 0, mender_storage_log_group, data, mender_storage_log_index[item].length))) {
+            goto END;
+        }
+    }
+
+    /* Commit the items copied, they form a single group */
+    if (MENDER_OK != mender_storage_log_append(fd, &size, NULL, 0, MENDER_STORAGE_LOG_FLAG_COMMIT, mender_storage_log_group, NULL, 0)) {
+        goto END;
+    }
+
+    /* Replace the log file, the rename is atomic and the compacted log file must be on the disk before */
+    if (0 != fdatasync(fd)) {
+        mender_log_error("fdatasync failed (%d)", errno);
+        goto END;
+    }
+    if (0 != rename(MENDER_STORAGE_LOG_COMPACTED_FILE, MENDER_STORAGE_LOG_FILE)) {
+        mender_log_error("Unable to rename file %s (%d)", MENDER_STORAGE_LOG_COMPACTED_FILE, errno);
+        goto END;
+    }
+#ifdef CONFIG_MENDER_STORAGE_MMAP
+    if (NULL != mender_storage_log_map) {
+        munmap(mender_storage_log_map, mender_storage_log_map_size);
+        mender_storage_log_map      = NULL;
+        mender_storage_log_map_size = 0;
+    }
+#endif /* CONFIG_MENDER_STORAGE_MMAP */
+    close(mender_storage_log_fd);
+    mender_storage_log_fd        = fd;
+    mender_storage_log_size      = size;
+    mender_storage_log_committed = size;
+    memcpy(mender_storage_log_index, index, sizeof(mender_storage_log_index));
+    mender_storage_log_group++;
+    fd  = -1;
+    ret = MENDER_OK;
+
+END:
+
+    /* Release memory */
+    if (-1 != fd) {
+        close(fd);
+        unlink(MENDER_STORAGE_LOG_COMPACTED_FILE);
+    }
+    mender_utils_free(data);
+
+    return ret;
+}
+
+static void
+mender_storage_log_compact_check(void) {
+
+    /* Compute the size of the last version of the items */
+    size_t used = 0;
+    for (size_t item_index = 0; item_index < MENDER_STORAGE_LOG_ITEMS; item_index++) {
+        if (true == mender_storage_log_index[item_index].found) {
+            used += sizeof(mender_storage_log_header_t) + mender_storage_log_index[item_index].length;
+        }
+    }
+
+    /* Compact the log file when it is large and mostly outdated, keep using the current log file on failure */
+    if ((mender_storage_log_size >= CONFIG_MENDER_STORAGE_LOG_COMPACT_SIZE) && (2 * used < (size_t)mender_storage_log_size)) {
+        if (MENDER_OK != mender_storage_log_compact()) {
+            mender_log_warning("Unable to compact file %s", MENDER_STORAGE_LOG_FILE);
+        }
+    }
+}
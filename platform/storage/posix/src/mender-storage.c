@@ -33,9 +33,9 @@
  */
 #define MENDER_STORAGE_NVS_PRIVATE_KEY     CONFIG_MENDER_STORAGE_PATH "key.der"
 #define MENDER_STORAGE_NVS_PUBLIC_KEY      CONFIG_MENDER_STORAGE_PATH "pubkey.der"
-#define MENDER_STORAGE_NVS_DEPLOYMENT_DATA CONFIG_MENDER_STORAGE_PATH "deployment-data.json"
+#define MENDER_STORAGE_NVS_DEPLOYMENT_DATA CONFIG_MENDER_STORAGE_PATH "deployment-data.bin"
 #define MENDER_STORAGE_NVS_DEVICE_CONFIG   CONFIG_MENDER_STORAGE_PATH "config.json"
-#define MENDER_STORAGE_NVS_PROVIDES        CONFIG_MENDER_STORAGE_PATH "provides.txt"
+#define MENDER_STORAGE_NVS_PROVIDES        CONFIG_MENDER_STORAGE_PATH "provides.bin"
 
 mender_err_t
 mender_storage_init(void) {
@@ -84,7 +84,7 @@ mender_storage_read_file(const char *file_path, void **data, size_t *data_length
     }
     *data_length = (size_t)length;
     fseek(f, 0, SEEK_SET);
-    *data = malloc(*data_length + 1);
+    *data = mender_utils_malloc(*data_length + 1);
     if (NULL == *data) {
         mender_log_error("Unable to allocate memory");
         fclose(f);
@@ -94,7 +94,7 @@ mender_storage_read_file(const char *file_path, void **data, size_t *data_length
     ((unsigned char *)*data)[*data_length] = '\0';
     if (fread(*data, sizeof(unsigned char), *data_length, f) != *data_length) {
         mender_log_error("Unable to read data from file %s", file_path);
-        free(*data);
+        mender_utils_free(*data);
         fclose(f);
         return MENDER_FAIL;
     }
@@ -129,7 +129,7 @@ mender_storage_get_authentication_keys(unsigned char **private_key, size_t *priv
         return MENDER_NOT_FOUND;
     }
     if (MENDER_OK != mender_storage_read_file(MENDER_STORAGE_NVS_PUBLIC_KEY, (void **)public_key, public_key_length)) {
-        free(*private_key);
+        mender_utils_free(*private_key);
         *private_key        = NULL;
         *private_key_length = 0;
         return MENDER_NOT_FOUND;
@@ -150,9 +150,8 @@ mender_storage_delete_authentication_keys(void) {
 }
 
 mender_err_t
-mender_storage_set_deployment_data(char *deployment_data) {
+mender_storage_set_deployment_data(const void *deployment_data, size_t deployment_data_length) {
     assert(NULL != deployment_data);
-    size_t deployment_data_length = strlen(deployment_data);
 
     if (MENDER_OK != mender_storage_write_file(MENDER_STORAGE_NVS_DEPLOYMENT_DATA, deployment_data, deployment_data_length)) {
         return MENDER_FAIL;
@@ -161,11 +160,11 @@ mender_storage_set_deployment_data(char *deployment_data) {
 }
 
 mender_err_t
-mender_storage_get_deployment_data(char **deployment_data) {
+mender_storage_get_deployment_data(void **deployment_data, size_t *deployment_data_length) {
     assert(NULL != deployment_data);
+    assert(NULL != deployment_data_length);
 
-    size_t deployment_data_length;
-    if (MENDER_OK != mender_storage_read_file(MENDER_STORAGE_NVS_DEPLOYMENT_DATA, (void **)deployment_data, &deployment_data_length)) {
+    if (MENDER_OK != mender_storage_read_file(MENDER_STORAGE_NVS_DEPLOYMENT_DATA, deployment_data, deployment_data_length)) {
         return MENDER_NOT_FOUND;
     }
     return MENDER_OK;
@@ -229,41 +228,40 @@ mender_storage_delete_device_config(void) {
 #ifdef CONFIG_MENDER_PROVIDES_DEPENDS
 
 mender_err_t
-mender_storage_set_provides(mender_key_value_list_t *provides) {
+mender_storage_set_provides(mender_utils_kv_table_t *provides) {
 
     assert(NULL != provides);
 
-    char *provides_str = NULL;
-    if (MENDER_OK != mender_utils_key_value_list_to_string(provides, &provides_str)) {
+    mender_utils_record_t record;
+    if (MENDER_OK != mender_utils_kv_table_to_record(provides, &record)) {
         return MENDER_FAIL;
     }
-    size_t provides_str_length = strlen(provides_str);
 
-    if (MENDER_OK != mender_storage_write_file(MENDER_STORAGE_NVS_PROVIDES, provides_str, provides_str_length)) {
-        free(provides_str);
+    if (MENDER_OK != mender_storage_write_file(MENDER_STORAGE_NVS_PROVIDES, record.data, record.length)) {
+        mender_utils_record_release(&record);
         return MENDER_FAIL;
     }
-    free(provides_str);
+    mender_utils_record_release(&record);
     return MENDER_OK;
 }
 
 mender_err_t
-mender_storage_get_provides(mender_key_value_list_t **provides) {
+mender_storage_get_provides(mender_utils_kv_table_t *provides) {
 
     assert(NULL != provides);
 
-    char  *provides_str = NULL;
+    void  *provides_data = NULL;
     size_t provides_length;
-    if (MENDER_OK != mender_storage_read_file(MENDER_STORAGE_NVS_PROVIDES, (void **)&provides_str, &provides_length)) {
+    if (MENDER_OK != mender_storage_read_file(MENDER_STORAGE_NVS_PROVIDES, &provides_data, &provides_length)) {
         return MENDER_NOT_FOUND;
     }
-    if (MENDER_OK != mender_utils_string_to_key_value_list(provides_str, provides)) {
+    if (MENDER_OK != mender_utils_record_to_kv_table(provides_data, provides_length, provides)) {
         mender_log_error("Unable to parse provides");
-        free(provides_str);
+        mender_utils_free(provides_data);
         return MENDER_FAIL;
     }
 
-    free(provides_str);
+    mender_utils_free(provides_data);
     return MENDER_OK;
 }
 
@@ -282,6 +280,29 @@ mender_storage_delete_provides(void) {
 #endif /*CONFIG_MENDER_FULL_PARSE_ARTIFACT*/
 #endif /*CONFIG_MENDER_PROVIDES_DEPENDS*/
 
+mender_err_t
+mender_storage_get_statistics(mender_storage_statistics_t *statistics) {
+
+    (void)statistics;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_storage_begin(void) {
+
+    /* Nothing to do, the items are written immediately */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_storage_commit(void) {
+
+    /* Nothing to do, the items are written immediately */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 mender_err_t
 mender_storage_exit(void) {
 
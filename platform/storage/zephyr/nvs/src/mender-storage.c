@@ -23,6 +23,9 @@
 #include <zephyr/storage/flash_map.h>
 #include "mender-log.h"
 #include "mender-storage.h"
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+#include "mender-tls.h"
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
 
 /**
  * @brief NVS storage
@@ -39,12 +42,103 @@
 #define MENDER_STORAGE_NVS_DEPLOYMENT_DATA 3
 #define MENDER_STORAGE_NVS_DEVICE_CONFIG   4
 #define MENDER_STORAGE_NVS_PROVIDES        5
+#define MENDER_STORAGE_NVS_ITEMS           6
 
 /**
  * @brief NVS storage handle
  */
 static struct nvs_fs mender_storage_nvs_handle;
 
+/**
+ * @brief Storage statistics
+ */
+static mender_storage_statistics_t mender_storage_statistics;
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+
+/**
+ * @brief Digest of the items
+ */
+typedef struct {
+    bool    known;                                   /**< Digest is known, the item has been read or written */
+    uint8_t digest[MENDER_TLS_SHA256_DIGEST_LENGTH]; /**< Digest of the item stored */
+} mender_storage_digest_t;
+
+/**
+ * @brief Digests of the items, writes of items identical to the ones stored are skipped
+ */
+static mender_storage_digest_t mender_storage_digests[MENDER_STORAGE_NVS_ITEMS];
+
+/**
+ * @brief Compute digest of an item
+ * @param data Data of the item
+ * @param length Length of the data
+ * @param digest Digest of the item
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+mender_storage_digest(const void *data, size_t length, uint8_t *digest) {
+
+    void        *handle = NULL;
+    mender_err_t ret;
+
+    /* Compute SHA-256 of the data */
+    if (MENDER_OK != (ret = mender_tls_sha256_begin(&handle))) {
+        return ret;
+    }
+    if (MENDER_OK != (ret = mender_tls_sha256_update(handle, data, length))) {
+        mender_tls_sha256_end(handle, NULL);
+        return ret;
+    }
+
+    return mender_tls_sha256_end(handle, digest);
+}
+
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
+static mender_err_t
+nvs_write_dedup(struct nvs_fs *nvs, uint16_t id, const void *data, size_t length) {
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    /* Skip the write if the item stored is identical, the digest is forgotten until the write succeeds */
+    uint8_t digest[MENDER_TLS_SHA256_DIGEST_LENGTH];
+    bool    digest_valid = (MENDER_OK == mender_storage_digest(data, length, digest));
+    if ((true == digest_valid) && (true == mender_storage_digests[id].known) && (0 == memcmp(mender_storage_digests[id].digest, digest, sizeof(digest)))) {
+        mender_storage_statistics.skipped++;
+        return MENDER_OK;
+    }
+    mender_storage_digests[id].known = false;
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
+    /* Write data */
+    if (nvs_write(nvs, id, data, length) < 0) {
+        return MENDER_FAIL;
+    }
+    mender_storage_statistics.writes++;
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    /* Remember the digest of the item stored */
+    if (true == digest_valid) {
+        memcpy(mender_storage_digests[id].digest, digest, sizeof(digest));
+        mender_storage_digests[id].known = true;
+    }
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+nvs_delete_dedup(struct nvs_fs *nvs, uint16_t id) {
+
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    /* Forget the digest of the item */
+    mender_storage_digests[id].known = false;
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
+    /* Delete data */
+    return (0 == nvs_delete(nvs, id)) ? MENDER_OK : MENDER_FAIL;
+}
+
 static mender_err_t
 nvs_read_alloc(struct nvs_fs *nvs, uint16_t id, void **data, size_t *length) {
     ssize_t ret;
@@ -57,7 +151,7 @@ nvs_read_alloc(struct nvs_fs *nvs, uint16_t id, void **data, size_t *length) {
     *length = (size_t)ret;
 
     /* Allocate memory */
-    *data = malloc(*length);
+    *data = mender_utils_malloc(*length);
     if (NULL == *data) {
         mender_log_error("Unable to allocate memory for: %d", id);
         return MENDER_FAIL;
@@ -66,11 +160,16 @@ nvs_read_alloc(struct nvs_fs *nvs, uint16_t id, void **data, size_t *length) {
     /* Read data */
     ret = nvs_read(nvs, id, *data, *length);
     if (ret < 0) {
-        free(*data);
+        mender_utils_free(*data);
         *data = NULL;
         return MENDER_FAIL;
     }
 
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    /* Remember the digest of the item stored, so that writing it again after startup is skipped */
+    mender_storage_digests[id].known = (MENDER_OK == mender_storage_digest(*data, *length, mender_storage_digests[id].digest));
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
     return MENDER_OK;
 }
 
@@ -110,8 +209,8 @@ mender_storage_set_authentication_keys(unsigned char *private_key, size_t privat
     assert(NULL != public_key);
 
     /* Write keys */
-    if ((nvs_write(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, private_key, private_key_length) < 0)
-        || (nvs_write(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, public_key, public_key_length) < 0)) {
+    if ((MENDER_OK != nvs_write_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY, private_key, private_key_length))
+        || (MENDER_OK != nvs_write_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY, public_key, public_key_length))) {
         mender_log_error("Unable to write authentication keys");
         return MENDER_FAIL;
     }
@@ -146,7 +245,7 @@ mender_storage_get_authentication_keys(unsigned char **private_key, size_t *priv
         } else {
             mender_log_error("Unable to read public key");
         }
-        free(*private_key);
+        mender_utils_free(*private_key);
         *private_key = NULL;
         return ret;
     }
@@ -158,8 +257,8 @@ mender_err_t
 mender_storage_delete_authentication_keys(void) {
 
     /* Erase keys */
-    if ((0 != nvs_delete(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY))
-        || (0 != nvs_delete(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY))) {
+    if ((MENDER_OK != nvs_delete_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PRIVATE_KEY))
+        || (MENDER_OK != nvs_delete_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PUBLIC_KEY))) {
         mender_log_error("Unable to erase authentication keys");
         return MENDER_FAIL;
     }
@@ -168,12 +267,12 @@ mender_storage_delete_authentication_keys(void) {
 }
 
 mender_err_t
-mender_storage_set_deployment_data(char *deployment_data) {
+mender_storage_set_deployment_data(const void *deployment_data, size_t deployment_data_length) {
 
     assert(NULL != deployment_data);
 
     /* Write deployment data */
-    if (nvs_write(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, deployment_data, strlen(deployment_data) + 1) < 0) {
+    if (MENDER_OK != nvs_write_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, deployment_data, deployment_data_length)) {
         mender_log_error("Unable to write deployment data");
         return MENDER_FAIL;
     }
@@ -182,13 +281,13 @@ mender_storage_set_deployment_data(char *deployment_data) {
 }
 
 mender_err_t
-mender_storage_get_deployment_data(char **deployment_data) {
+mender_storage_get_deployment_data(void **deployment_data, size_t *deployment_data_length) {
 
     assert(NULL != deployment_data);
-    size_t deployment_data_length = 0;
+    assert(NULL != deployment_data_length);
 
     /* Read deployment data */
-    mender_err_t ret = nvs_read_alloc(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, (void **)deployment_data, &deployment_data_length);
+    mender_err_t ret = nvs_read_alloc(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA, deployment_data, deployment_data_length);
     if (MENDER_OK != ret) {
         if (MENDER_NOT_FOUND == ret) {
             mender_log_info("Deployment data not available");
@@ -205,7 +304,7 @@ mender_err_t
 mender_storage_delete_deployment_data(void) {
 
     /* Delete deployment data */
-    if (0 != nvs_delete(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA)) {
+    if (MENDER_OK != nvs_delete_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEPLOYMENT_DATA)) {
         mender_log_error("Unable to delete deployment data");
         return MENDER_FAIL;
     }
@@ -222,7 +321,7 @@ mender_storage_set_device_config(char *device_config) {
     assert(NULL != device_config);
 
     /* Write device configuration */
-    if (nvs_write(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, device_config, strlen(device_config) + 1) < 0) {
+    if (MENDER_OK != nvs_write_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG, device_config, strlen(device_config) + 1)) {
         mender_log_error("Unable to write device configuration");
         return MENDER_FAIL;
     }
@@ -260,7 +359,7 @@ mender_err_t
 mender_storage_delete_device_config(void) {
 
     /* Delete device configuration */
-    if (0 != nvs_delete(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG)) {
+    if (MENDER_OK != nvs_delete_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_DEVICE_CONFIG)) {
         mender_log_error("Unable to delete device configuration");
         return MENDER_FAIL;
     }
@@ -269,35 +368,35 @@ mender_storage_delete_device_config(void) {
 }
 
 mender_err_t
-mender_storage_set_provides(mender_key_value_list_t *provides) {
+mender_storage_set_provides(mender_utils_kv_table_t *provides) {
 
     assert(NULL != provides);
 
-    char *provides_str = NULL;
-    if (MENDER_OK != mender_utils_key_value_list_to_string(provides, &provides_str)) {
+    mender_utils_record_t record;
+    if (MENDER_OK != mender_utils_kv_table_to_record(provides, &record)) {
         return MENDER_FAIL;
     }
 
     /* Write provides */
-    if (nvs_write(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PROVIDES, provides_str, strlen(provides_str) + 1) < 0) {
+    if (MENDER_OK != nvs_write_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PROVIDES, record.data, record.length)) {
         mender_log_error("Unable to write provides");
-        free(provides_str);
+        mender_utils_record_release(&record);
         return MENDER_FAIL;
     }
 
-    free(provides_str);
+    mender_utils_record_release(&record);
     return MENDER_OK;
 }
 
 mender_err_t
-mender_storage_get_provides(mender_key_value_list_t **provides) {
+mender_storage_get_provides(mender_utils_kv_table_t *provides) {
 
     assert(NULL != provides);
     size_t provides_length = 0;
 
-    char *provides_str = NULL;
+    char *provides_data = NULL;
     /* Read provides */
-    mender_err_t ret = nvs_read_alloc(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PROVIDES, (void **)&provides_str, &provides_length);
+    mender_err_t ret = nvs_read_alloc(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PROVIDES, (void **)&provides_data, &provides_length);
     if (MENDER_OK != ret) {
         if (MENDER_NOT_FOUND == ret) {
             mender_log_info("Provides not available");
@@ -307,10 +406,21 @@ mender_storage_get_provides(mender_key_value_list_t **provides) {
         return ret;
     }
 
-    /* Convert str to key-value list */
-    if (MENDER_OK != mender_utils_string_to_key_value_list(provides_str, provides)) {
-        return MENDER_FAIL;
+    /* Convert record to key-value table, provides written by previous versions of the client are null terminated text parsed in place */
+    if (MENDER_OK != mender_utils_record_to_kv_table(provides_data, provides_length, provides)) {
+        mender_key_value_list_t *list = NULL;
+        if (('\0' != provides_data[provides_length - 1]) || (MENDER_OK != mender_utils_string_to_key_value_list_in_place(provides_data, &list))
+            || (MENDER_OK != mender_utils_kv_table_set_list(provides, list))) {
+            mender_log_error("Unable to parse provides");
+            mender_utils_free(list);
+            mender_utils_kv_table_release(provides);
+            mender_utils_free(provides_data);
+            return MENDER_FAIL;
+        }
+        mender_utils_free(list);
     }
+
+    mender_utils_free(provides_data);
     return MENDER_OK;
 }
 
@@ -318,7 +428,7 @@ mender_err_t
 mender_storage_delete_provides(void) {
 
     /* Delete provides */
-    if (0 != nvs_delete(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PROVIDES)) {
+    if (MENDER_OK != nvs_delete_dedup(&mender_storage_nvs_handle, MENDER_STORAGE_NVS_PROVIDES)) {
         mender_log_error("Unable to delete provides");
         return MENDER_FAIL;
     }
@@ -328,9 +438,39 @@ mender_storage_delete_provides(void) {
 #endif /* CONFIG_MENDER_PROVIDES_DEPENDS */
 #endif /* CONFIG_MENDER_FULL_PARSE_ARTIFACT */
 
+mender_err_t
+mender_storage_get_statistics(mender_storage_statistics_t *statistics) {
+
+    assert(NULL != statistics);
+
+    /* Copy statistics */
+    memcpy(statistics, &mender_storage_statistics, sizeof(mender_storage_statistics_t));
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_storage_begin(void) {
+
+    /* Nothing to do, the items are written immediately */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+mender_err_t
+mender_storage_commit(void) {
+
+    /* Nothing to do, the items are written immediately */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
 mender_err_t
 mender_storage_exit(void) {
 
-    /* Nothing to do */
+    /* Release statistics and digests, the storage may be initialized again */
+    memset(&mender_storage_statistics, 0, sizeof(mender_storage_statistics));
+#ifdef CONFIG_MENDER_STORAGE_WRITE_DEDUP
+    memset(mender_storage_digests, 0, sizeof(mender_storage_digests));
+#endif /* CONFIG_MENDER_STORAGE_WRITE_DEDUP */
+
     return MENDER_OK;
 }
@@ -17,10 +17,25 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_TLS
+
 #include <cryptoauthlib.h>
+#ifdef CONFIG_MENDER_TLS_SOFTWARE_SHA256
+#include <crypto/atca_crypto_sw_sha2.h>
+#endif /* CONFIG_MENDER_TLS_SOFTWARE_SHA256 */
 #include "mender-log.h"
 #include "mender-tls.h"
 
+/**
+ * @brief Check client contexts, the secure element holds the authentication key of a single device
+ */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+#error "CONFIG_MENDER_CLIENT_CONTEXTS is not compatible with the cryptoauthlib TLS implementation"
+#endif
+
 /**
  * @brief Default private key ID
  */
@@ -45,6 +60,11 @@ static const uint8_t mender_tls_public_key_x509_header[] = { 0x30, 0x59, 0x30, 0
 static unsigned char *mender_tls_public_key        = NULL;
 static size_t         mender_tls_public_key_length = 0;
 
+/**
+ * @brief Public key of the device in PEM format, computed once and copied to the callers
+ */
+static char *mender_tls_public_key_pem = NULL;
+
 /**
  * @brief Write a buffer of PEM information from a DER encoded buffer
  * @note This function is derived from mbedtls_pem_write_buffer with const header and footer
@@ -112,10 +132,12 @@ mender_tls_init_authentication_keys(bool recommissioning) {
 
     /* Release memory */
     if (NULL != mender_tls_public_key) {
-        free(mender_tls_public_key);
+        mender_utils_free(mender_tls_public_key);
         mender_tls_public_key = NULL;
     }
     mender_tls_public_key_length = 0;
+    mender_utils_free(mender_tls_public_key_pem);
+    mender_tls_public_key_pem = NULL;
 
     /* Check if recommissioning is forced */
     if (true == recommissioning) {
@@ -123,13 +145,13 @@ mender_tls_init_authentication_keys(bool recommissioning) {
     }
 
     /* Retrieve public key */
-    if (NULL == (mender_tls_public_key = (unsigned char *)malloc(ATCA_PUB_KEY_SIZE))) {
+    if (NULL == (mender_tls_public_key = (unsigned char *)mender_utils_malloc(ATCA_PUB_KEY_SIZE))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
     if (ATCA_SUCCESS != atcab_get_pubkey(CONFIG_MENDER_TLS_PRIVATE_KEY_ID, (uint8_t *)mender_tls_public_key)) {
         mender_log_error("Unable to get public key");
-        free(mender_tls_public_key);
+        mender_utils_free(mender_tls_public_key);
         mender_tls_public_key = NULL;
         return MENDER_FAIL;
     }
@@ -143,25 +165,38 @@ mender_tls_get_public_key_pem(char **public_key) {
 
     assert(NULL != public_key);
     mender_err_t ret;
-
-    /* Compute size of the public key */
-    size_t olen = 0;
-    mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, NULL, 0, &olen);
-    if (0 == olen) {
-        mender_log_error("Unable to compute public key size");
-        return MENDER_FAIL;
+    char        *pem;
+
+    /* Convert public key from DER to PEM format the first time only, the public key does not change until the keys are initialized again */
+    if (NULL == mender_tls_public_key_pem) {
+
+        /* Compute size of the public key */
+        size_t olen = 0;
+        mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, NULL, 0, &olen);
+        if (0 == olen) {
+            mender_log_error("Unable to compute public key size");
+            return MENDER_FAIL;
+        }
+        if (NULL == (pem = (char *)mender_utils_malloc(olen))) {
+            mender_log_error("Unable to allocate memory");
+            return MENDER_FAIL;
+        }
+
+        /* Convert public key from DER to PEM format */
+        if (MENDER_OK != (ret = mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, pem, olen, &olen))) {
+            mender_log_error("Unable to convert public key");
+            mender_utils_free(pem);
+            return ret;
+        }
+        mender_tls_public_key_pem = pem;
     }
-    if (NULL == (*public_key = (char *)malloc(olen))) {
+
+    /* Copy the public key to the caller */
+    if (NULL == (*public_key = mender_utils_strdup(mender_tls_public_key_pem))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
 
-    /* Convert public key from DER to PEM format */
-    if (MENDER_OK != (ret = mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, *public_key, olen, &olen))) {
-        mender_log_error("Unable to convert public key");
-        return ret;
-    }
-
     return MENDER_OK;
 }
 
@@ -179,8 +214,12 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     size_t   index = 0;
     char    *tmp;
 
-    /* Compute digest (sha256) of the payload */
+    /* Compute digest (sha256) of the payload, on the host if enabled to save the I2C transactions with the secure element */
+#ifdef CONFIG_MENDER_TLS_SOFTWARE_SHA256
+    if (ATCA_SUCCESS != atcac_sw_sha2_256((const uint8_t *)payload, strlen(payload), digest)) {
+#else
     if (ATCA_SUCCESS != atcab_hw_sha2_256(payload, strlen(payload), digest)) {
+#endif /* CONFIG_MENDER_TLS_SOFTWARE_SHA256 */
         mender_log_error("Unable to compute digest of the payload");
         return MENDER_FAIL;
     }
@@ -218,7 +257,7 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     index += 32;
 
     /* Encode signature to base64 */
-    if (NULL == (*signature = malloc(2 * index + 1))) {
+    if (NULL == (*signature = mender_utils_malloc(2 * index + 1))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
@@ -226,13 +265,13 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     *signature_length = 2 * index;
     if (ATCA_SUCCESS != atcab_base64encode_(asn1, index, *signature, signature_length, mender_tls_atcab_b64rules)) {
         mender_log_error("Unable to convert signature to base64 format");
-        free(*signature);
+        mender_utils_free(*signature);
         *signature = NULL;
         return MENDER_FAIL;
     }
-    if (NULL == (tmp = realloc(*signature, *signature_length + 1))) {
+    if (NULL == (tmp = mender_utils_realloc(*signature, *signature_length + 1))) {
         mender_log_error("Unable to allocate memory");
-        free(*signature);
+        mender_utils_free(*signature);
         *signature = NULL;
         return MENDER_FAIL;
     }
@@ -241,15 +280,115 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     return MENDER_OK;
 }
 
+mender_err_t
+mender_tls_verify_signature(const char *public_key, const uint8_t *digest, const char *signature, size_t signature_length) {
+
+    assert(NULL != public_key);
+    assert(NULL != digest);
+    assert(NULL != signature);
+    uint8_t key[sizeof(mender_tls_public_key_x509_header) + ATCA_ECCP256_PUBKEY_SIZE];
+    uint8_t sign[ATCA_ECCP256_SIG_SIZE];
+    size_t  length;
+    bool    verified = false;
+
+    /* Decode public key, only ECDSA P-256 keys are supported by the device */
+    const char *begin = strstr(public_key, "-----BEGIN PUBLIC KEY-----");
+    const char *end   = strstr(public_key, "-----END PUBLIC KEY-----");
+    if ((NULL == begin) || (NULL == end) || (end < begin)) {
+        mender_log_error("Invalid public key");
+        return MENDER_FAIL;
+    }
+    begin += strlen("-----BEGIN PUBLIC KEY-----");
+    length = sizeof(key);
+    if ((ATCA_SUCCESS != atcab_base64decode_(begin, (size_t)(end - begin), key, &length, mender_tls_atcab_b64rules)) || (sizeof(key) != length)
+        || (0 != memcmp(key, mender_tls_public_key_x509_header, sizeof(mender_tls_public_key_x509_header)))) {
+        mender_log_error("Invalid public key, only ECDSA P-256 keys are supported");
+        return MENDER_FAIL;
+    }
+
+    /* Decode signature, r and s are expected concatenated */
+    length = sizeof(sign);
+    if ((ATCA_SUCCESS != atcab_base64decode_(signature, signature_length, sign, &length, mender_tls_atcab_b64rules)) || (sizeof(sign) != length)) {
+        mender_log_error("Invalid signature");
+        return MENDER_FAIL;
+    }
+
+    /* Verify signature of the digest value */
+    if ((ATCA_SUCCESS != atcab_verify_extern(digest, sign, &key[sizeof(mender_tls_public_key_x509_header)], &verified)) || (true != verified)) {
+        mender_log_error("Invalid signature");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_begin(void **handle) {
+
+    assert(NULL != handle);
+    atca_sha256_ctx_t *sha256_ctx;
+
+    /* Initialize digest context */
+    if (NULL == (sha256_ctx = (atca_sha256_ctx_t *)mender_utils_malloc(sizeof(atca_sha256_ctx_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (ATCA_SUCCESS != atcab_hw_sha2_256_init(sha256_ctx)) {
+        mender_log_error("Unable to start digest computation");
+        mender_utils_free(sha256_ctx);
+        return MENDER_FAIL;
+    }
+
+    *handle = sha256_ctx;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_update(void *handle, const void *data, size_t length) {
+
+    assert(NULL != handle);
+
+    /* Update digest */
+    if (ATCA_SUCCESS != atcab_hw_sha2_256_update((atca_sha256_ctx_t *)handle, (const uint8_t *)data, length)) {
+        mender_log_error("Unable to update digest");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_end(void *handle, uint8_t *digest) {
+
+    assert(NULL != handle);
+    mender_err_t ret = MENDER_OK;
+
+    /* Compute digest */
+    if (NULL != digest) {
+        if (ATCA_SUCCESS != atcab_hw_sha2_256_finish((atca_sha256_ctx_t *)handle, digest)) {
+            mender_log_error("Unable to compute digest");
+            ret = MENDER_FAIL;
+        }
+    }
+
+    /* Release memory */
+    mender_utils_free(handle);
+
+    return ret;
+}
+
 mender_err_t
 mender_tls_exit(void) {
 
     /* Release memory */
     if (NULL != mender_tls_public_key) {
-        free(mender_tls_public_key);
+        mender_utils_free(mender_tls_public_key);
         mender_tls_public_key = NULL;
     }
     mender_tls_public_key_length = 0;
+    mender_utils_free(mender_tls_public_key_pem);
+    mender_tls_public_key_pem = NULL;
 
     return MENDER_OK;
 }
@@ -284,7 +423,7 @@ mender_tls_pem_write_buffer(const unsigned char *der_data, size_t der_len, char
     }
 
     /* Allocate memory to store PEM data */
-    if (NULL == (encode_buf = (unsigned char *)malloc(use_len))) {
+    if (NULL == (encode_buf = (unsigned char *)mender_utils_malloc(use_len))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -331,7 +470,7 @@ END:
 
     /* Release memory */
     if (NULL != encode_buf) {
-        free(encode_buf);
+        mender_utils_free(encode_buf);
     }
 
     return ret;
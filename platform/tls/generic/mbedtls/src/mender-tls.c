@@ -18,18 +18,27 @@
  * limitations under the License.
  */
 
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_TLS
+
 #include <mbedtls/base64.h>
 #include <mbedtls/bignum.h>
 #include <mbedtls/ctr_drbg.h>
+#ifdef CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA
+#include <mbedtls/ecp.h>
+#endif /* CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA */
 #include <mbedtls/entropy.h>
 #ifdef MBEDTLS_ERROR_C
 #include <mbedtls/error.h>
 #endif /* MBEDTLS_ERROR_C */
+#include <mbedtls/md.h>
 #include <mbedtls/pk.h>
 #include <mbedtls/rsa.h>
 #include <mbedtls/x509.h>
 #include "mender-log.h"
-#include "mender-storage.h"
+#include "mender-storage-cache.h"
 #include "mender-tls.h"
 
 /**
@@ -63,12 +72,49 @@
 #endif /* MBEDTLS_ERROR_C */
 
 /**
- * @brief Private and public keys of the device
+ * @brief Context of the authentication keys of a device
+ */
+struct mender_tls_ctx_s {
+    const unsigned char      *private_key;           /**< Private key, view on the storage cache or on the key generated or provided by the user */
+    size_t                    private_key_length;    /**< Length of the private key */
+    const unsigned char      *public_key;            /**< Public key, view on the storage cache or on the key generated or provided by the user */
+    size_t                    public_key_length;     /**< Length of the public key */
+    unsigned char            *allocated_private_key; /**< Private key generated or provided by the user, NULL when the key is a view on the storage cache */
+    unsigned char            *allocated_public_key;  /**< Public key generated or provided by the user, NULL when the key is a view on the storage cache */
+    mbedtls_pk_context       *pk_context;            /**< Parsed private key, kept so that a signature only costs the sign operation */
+    mbedtls_ctr_drbg_context *ctr_drbg;              /**< Seeded CTR DRBG used to sign the payloads */
+    mbedtls_entropy_context  *entropy;               /**< Entropy source of the CTR DRBG */
+};
+
+/**
+ * @brief Context of the authentication keys recorded in the storage
  */
-static unsigned char *mender_tls_private_key        = NULL;
-static size_t         mender_tls_private_key_length = 0;
-static unsigned char *mender_tls_public_key         = NULL;
-static size_t         mender_tls_public_key_length  = 0;
+static mender_tls_ctx_t mender_tls_default_ctx;
+
+/**
+ * @brief Context of the authentication keys of the calling thread
+ */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+static __thread mender_tls_ctx_t *mender_tls_ctx = &mender_tls_default_ctx;
+#else
+static mender_tls_ctx_t *const mender_tls_ctx = &mender_tls_default_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+/**
+ * @brief Parse the private key and seed the CTR DRBG used to sign the payloads
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_tls_load_signing_context(void);
+
+/**
+ * @brief Release the private key and the CTR DRBG used to sign the payloads
+ */
+static void mender_tls_release_signing_context(void);
+
+/**
+ * @brief Release the private and public keys of the device
+ */
+static void mender_tls_release_authentication_keys(void);
 
 /**
  * @brief Generate authentication keys
@@ -105,6 +151,15 @@ static mender_err_t mender_tls_get_authentication_keys(unsigned char **private_k
                                                        const char     *user_provided_key,
                                                        size_t          user_provided_key_length);
 
+/**
+ * @brief Convert an ECDSA signature from r and s concatenated to ASN.1 DER format
+ * @param raw Signature, r and s concatenated
+ * @param raw_length Length of the signature
+ * @param der Buffer to write to, at least raw_length + 8 bytes
+ * @return Length of the signature in ASN.1 DER format
+ */
+static size_t mender_tls_ecdsa_raw_to_der(const unsigned char *raw, size_t raw_length, unsigned char *der);
+
 /**
  * @brief Write a buffer of PEM information from a DER encoded buffer
  * @note This function is derived from mbedtls_pem_write_buffer with const header and footer
@@ -128,25 +183,18 @@ mender_err_t
 mender_tls_init_authentication_keys(mender_err_t (*get_user_provided_keys)(char **user_provided_key, size_t *user_provided_key_length), bool recommissioning) {
 
     mender_err_t ret;
+    bool         recorded = (&mender_tls_default_ctx == mender_tls_ctx);
 
     /* Release memory */
-    if (NULL != mender_tls_private_key) {
-        free(mender_tls_private_key);
-        mender_tls_private_key = NULL;
-    }
-    mender_tls_private_key_length = 0;
-    if (NULL != mender_tls_public_key) {
-        free(mender_tls_public_key);
-        mender_tls_public_key = NULL;
-    }
-    mender_tls_public_key_length = 0;
+    mender_tls_release_signing_context();
+    mender_tls_release_authentication_keys();
 
-    /* Check if recommissioning is forced */
-    if (true == recommissioning) {
+    /* Check if recommissioning is forced, the keys of the additional devices are not recorded */
+    if ((true == recommissioning) && (true == recorded)) {
 
         /* Erase authentication keys */
         mender_log_info("Delete authentication keys...");
-        if (MENDER_OK != mender_storage_delete_authentication_keys()) {
+        if (MENDER_OK != mender_storage_cache_delete_authentication_keys()) {
             mender_log_warning("Unable to delete authentication keys");
         }
     }
@@ -162,40 +210,60 @@ mender_tls_init_authentication_keys(mender_err_t (*get_user_provided_keys)(char
     if (NULL != user_provided_key) {
         mender_log_info("Getting authentication key...");
         if (MENDER_OK
-            != (ret = mender_tls_get_authentication_keys(&mender_tls_private_key,
-                                                         &mender_tls_private_key_length,
-                                                         &mender_tls_public_key,
-                                                         &mender_tls_public_key_length,
+            != (ret = mender_tls_get_authentication_keys(&mender_tls_ctx->allocated_private_key,
+                                                         &mender_tls_ctx->private_key_length,
+                                                         &mender_tls_ctx->allocated_public_key,
+                                                         &mender_tls_ctx->public_key_length,
                                                          user_provided_key,
                                                          user_provided_key_length))) {
             mender_log_error("Unable to get user provided authentication key");
             goto END;
         }
+        mender_tls_ctx->private_key = mender_tls_ctx->allocated_private_key;
+        mender_tls_ctx->public_key  = mender_tls_ctx->allocated_public_key;
         /* Retrieve or generate private and public keys */
-    } else if (MENDER_OK
-               != (ret = mender_storage_get_authentication_keys(
-                       &mender_tls_private_key, &mender_tls_private_key_length, &mender_tls_public_key, &mender_tls_public_key_length))) {
+    } else if ((true != recorded)
+               || (MENDER_OK
+                   != (ret = mender_storage_cache_get_authentication_keys(&mender_tls_ctx->private_key,
+                                                                          &mender_tls_ctx->private_key_length,
+                                                                          &mender_tls_ctx->public_key,
+                                                                          &mender_tls_ctx->public_key_length)))) {
         /* Generate authentication keys */
         mender_log_info("Generating authentication keys...");
         if (MENDER_OK
-            != (ret = mender_tls_get_authentication_keys(
-                    &mender_tls_private_key, &mender_tls_private_key_length, &mender_tls_public_key, &mender_tls_public_key_length, NULL, 0))) {
+            != (ret = mender_tls_get_authentication_keys(&mender_tls_ctx->allocated_private_key,
+                                                         &mender_tls_ctx->private_key_length,
+                                                         &mender_tls_ctx->allocated_public_key,
+                                                         &mender_tls_ctx->public_key_length,
+                                                         NULL,
+                                                         0))) {
             mender_log_error("Unable to generate authentication keys");
             goto END;
         }
+        mender_tls_ctx->private_key = mender_tls_ctx->allocated_private_key;
+        mender_tls_ctx->public_key  = mender_tls_ctx->allocated_public_key;
 
         /* Record keys */
-        if (MENDER_OK
-            != (ret = mender_storage_set_authentication_keys(
-                    mender_tls_private_key, mender_tls_private_key_length, mender_tls_public_key, mender_tls_public_key_length))) {
+        if ((true == recorded)
+            && (MENDER_OK
+                != (ret = mender_storage_cache_set_authentication_keys(mender_tls_ctx->allocated_private_key,
+                                                                       mender_tls_ctx->private_key_length,
+                                                                       mender_tls_ctx->allocated_public_key,
+                                                                       mender_tls_ctx->public_key_length)))) {
             mender_log_error("Unable to record authentication keys");
             goto END;
         }
     }
 
+    /* Parse the private key once, it is used for all the signatures */
+    if (MENDER_OK != (ret = mender_tls_load_signing_context())) {
+        mender_log_error("Unable to load private key");
+        goto END;
+    }
+
 END:
     /* Release memory */
-    free(user_provided_key);
+    mender_utils_free(user_provided_key);
 
     return (0 != ret) ? MENDER_FAIL : MENDER_OK;
 }
@@ -208,18 +276,18 @@ mender_tls_get_public_key_pem(char **public_key) {
 
     /* Compute size of the public key */
     size_t olen = 0;
-    mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, NULL, 0, &olen);
+    mender_tls_pem_write_buffer(mender_tls_ctx->public_key, mender_tls_ctx->public_key_length, NULL, 0, &olen);
     if (0 == olen) {
         mender_log_error("Unable to compute public key size");
         return MENDER_FAIL;
     }
-    if (NULL == (*public_key = (char *)malloc(olen))) {
+    if (NULL == (*public_key = (char *)mender_utils_malloc(olen))) {
         mender_log_error("Unable to allocate memory");
         return MENDER_FAIL;
     }
 
     /* Convert public key from DER to PEM format */
-    if (MENDER_OK != (ret = mender_tls_pem_write_buffer(mender_tls_public_key, mender_tls_public_key_length, *public_key, olen, &olen))) {
+    if (MENDER_OK != (ret = mender_tls_pem_write_buffer(mender_tls_ctx->public_key, mender_tls_ctx->public_key_length, *public_key, olen, &olen))) {
         mender_log_error("Unable to convert public key");
         return ret;
     }
@@ -233,48 +301,15 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     assert(NULL != payload);
     assert(NULL != signature);
     assert(NULL != signature_length);
-    int                       ret;
-    mbedtls_pk_context       *pk_context = NULL;
-    mbedtls_ctr_drbg_context *ctr_drbg   = NULL;
-    mbedtls_entropy_context  *entropy    = NULL;
-    unsigned char            *sig        = NULL;
-    size_t                    sig_length;
+    int            ret;
+    unsigned char *sig = NULL;
+    size_t         sig_length;
     MBEDTLS_ERR_BUF;
 
-    /* Initialize mbedtls */
-    if (NULL == (pk_context = (mbedtls_pk_context *)malloc(sizeof(mbedtls_pk_context)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = -1;
-        goto END;
-    }
-    mbedtls_pk_init(pk_context);
-    if (NULL == (ctr_drbg = (mbedtls_ctr_drbg_context *)malloc(sizeof(mbedtls_ctr_drbg_context)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = -1;
-        goto END;
-    }
-    mbedtls_ctr_drbg_init(ctr_drbg);
-    if (NULL == (entropy = (mbedtls_entropy_context *)malloc(sizeof(mbedtls_entropy_context)))) {
-        mender_log_error("Unable to allocate memory");
-        ret = -1;
-        goto END;
-    }
-    mbedtls_entropy_init(entropy);
-
-    /* Setup CRT DRBG */
-    if (0 != (ret = mbedtls_ctr_drbg_seed(ctr_drbg, mbedtls_entropy_func, entropy, (const unsigned char *)"mender", strlen("mender")))) {
-        LOG_MBEDTLS_ERROR("Unable to initialize ctr drbg", ret);
-        goto END;
-    }
-
-    /* Parse private key (IMPORTANT NOTE: length must include the ending \0 character) */
-#if MBEDTLS_VERSION_NUMBER >= 0x03000000
-    if (0 != (ret = mbedtls_pk_parse_key(pk_context, mender_tls_private_key, mender_tls_private_key_length, NULL, 0, mbedtls_ctr_drbg_random, ctr_drbg))) {
-#else
-    if (0 != (ret = mbedtls_pk_parse_key(pk_context, mender_tls_private_key, mender_tls_private_key_length, NULL, 0))) {
-#endif /* MBEDTLS_VERSION_NUMBER >= 0x03000000 */
-        LOG_MBEDTLS_ERROR("Unable to parse private key", ret);
-        goto END;
+    /* Check if the private key is loaded */
+    if (NULL == mender_tls_ctx->pk_context) {
+        mender_log_error("Private key is not loaded");
+        return MENDER_FAIL;
     }
 
     /* Generate digest */
@@ -285,23 +320,40 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     }
 
     /* Compute signature */
-    if (NULL == (sig = (unsigned char *)malloc(MBEDTLS_PK_SIGNATURE_MAX_SIZE))) {
+    if (NULL == (sig = (unsigned char *)mender_utils_malloc(MBEDTLS_PK_SIGNATURE_MAX_SIZE))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
     }
     sig_length = MBEDTLS_PK_SIGNATURE_MAX_SIZE;
 #if MBEDTLS_VERSION_NUMBER >= 0x03000000
-    if (0 != (ret = mbedtls_pk_sign(pk_context, MBEDTLS_MD_SHA256, digest, sizeof(digest), sig, sig_length, &sig_length, mbedtls_ctr_drbg_random, ctr_drbg))) {
+    if (0
+        != (ret = mbedtls_pk_sign(mender_tls_ctx->pk_context,
+                                  MBEDTLS_MD_SHA256,
+                                  digest,
+                                  sizeof(digest),
+                                  sig,
+                                  sig_length,
+                                  &sig_length,
+                                  mbedtls_ctr_drbg_random,
+                                  mender_tls_ctx->ctr_drbg))) {
 #else
-    if (0 != (ret = mbedtls_pk_sign(pk_context, MBEDTLS_MD_SHA256, digest, sizeof(digest), sig, &sig_length, mbedtls_ctr_drbg_random, ctr_drbg))) {
+    if (0
+        != (ret = mbedtls_pk_sign(mender_tls_ctx->pk_context,
+                                  MBEDTLS_MD_SHA256,
+                                  digest,
+                                  sizeof(digest),
+                                  sig,
+                                  &sig_length,
+                                  mbedtls_ctr_drbg_random,
+                                  mender_tls_ctx->ctr_drbg))) {
 #endif /* MBEDTLS_VERSION_NUMBER >= 0x03000000 */
         LOG_MBEDTLS_ERROR("Unable to compute signature", ret);
         goto END;
     }
 
     /* Encode signature to base64 (1 extra byte for the NUL character) */
-    if (NULL == (*signature = (char *)malloc(MENDER_TLS_SIGNATURE_LENGTH + 1))) {
+    if (NULL == (*signature = (char *)mender_utils_malloc(MENDER_TLS_SIGNATURE_LENGTH + 1))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
@@ -312,7 +364,7 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
         if (MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL == ret) {
             mender_log_error("This is a bug, please report it");
         }
-        free(*signature);
+        mender_utils_free(*signature);
         *signature        = NULL;
         *signature_length = 0;
         goto END;
@@ -320,44 +372,299 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
 
 END:
 
-    /* Release mbedtls */
-    if (NULL != entropy) {
-        mbedtls_entropy_free(entropy);
-        free(entropy);
+    /* Release memory */
+    if (NULL != sig) {
+        mender_utils_free(sig);
     }
-    if (NULL != ctr_drbg) {
-        mbedtls_ctr_drbg_free(ctr_drbg);
-        free(ctr_drbg);
+
+    return (0 != ret) ? MENDER_FAIL : MENDER_OK;
+}
+
+mender_err_t
+mender_tls_verify_signature(const char *public_key, const uint8_t *digest, const char *signature, size_t signature_length) {
+
+    assert(NULL != public_key);
+    assert(NULL != digest);
+    assert(NULL != signature);
+    mbedtls_pk_context *pk_context = NULL;
+    unsigned char      *sig        = NULL;
+    size_t              sig_length = 0;
+    int                 ret;
+    MBEDTLS_ERR_BUF;
+
+    /* Parse public key (IMPORTANT NOTE: length must include the ending \0 character) */
+    if (NULL == (pk_context = (mbedtls_pk_context *)mender_utils_malloc(sizeof(mbedtls_pk_context)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = -1;
+        goto END;
     }
+    mbedtls_pk_init(pk_context);
+    if (0 != (ret = mbedtls_pk_parse_public_key(pk_context, (const unsigned char *)public_key, strlen(public_key) + 1))) {
+        LOG_MBEDTLS_ERROR("Unable to parse public key", ret);
+        goto END;
+    }
+
+    /* Decode signature, extra bytes are allocated to convert ECDSA signatures */
+    mbedtls_base64_decode(NULL, 0, &sig_length, (const unsigned char *)signature, signature_length);
+    if (NULL == (sig = (unsigned char *)mender_utils_malloc(2 * sig_length + 8))) {
+        mender_log_error("Unable to allocate memory");
+        ret = -1;
+        goto END;
+    }
+    if (0 != (ret = mbedtls_base64_decode(sig, sig_length, &sig_length, (const unsigned char *)signature, signature_length))) {
+        LOG_MBEDTLS_ERROR("Unable to decode signature", ret);
+        goto END;
+    }
+    if (MBEDTLS_PK_ECKEY == mbedtls_pk_get_type(pk_context)) {
+        size_t der_length = mender_tls_ecdsa_raw_to_der(sig, sig_length, sig + sig_length);
+        memmove(sig, sig + sig_length, der_length);
+        sig_length = der_length;
+    }
+
+    /* Verify signature */
+    if (0 != (ret = mbedtls_pk_verify(pk_context, MBEDTLS_MD_SHA256, digest, MENDER_TLS_SHA256_DIGEST_LENGTH, sig, sig_length))) {
+        LOG_MBEDTLS_ERROR("Invalid signature", ret);
+        goto END;
+    }
+
+END:
+
+    /* Release memory */
     if (NULL != pk_context) {
         mbedtls_pk_free(pk_context);
-        free(pk_context);
+        mender_utils_free(pk_context);
+    }
+    mender_utils_free(sig);
+
+    return (0 != ret) ? MENDER_FAIL : MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_begin(void **handle) {
+
+    assert(NULL != handle);
+    mbedtls_md_context_t *md_context;
+    int                   ret;
+    MBEDTLS_ERR_BUF;
+
+    /* Initialize digest context */
+    if (NULL == (md_context = (mbedtls_md_context_t *)mender_utils_malloc(sizeof(mbedtls_md_context_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    mbedtls_md_init(md_context);
+    if (0 != (ret = mbedtls_md_setup(md_context, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 0))) {
+        LOG_MBEDTLS_ERROR("Unable to setup digest context", ret);
+        goto FAIL;
+    }
+    if (0 != (ret = mbedtls_md_starts(md_context))) {
+        LOG_MBEDTLS_ERROR("Unable to start digest computation", ret);
+        goto FAIL;
+    }
+
+    *handle = md_context;
+
+    return MENDER_OK;
+
+FAIL:
+
+    /* Release memory */
+    mbedtls_md_free(md_context);
+    mender_utils_free(md_context);
+
+    return MENDER_FAIL;
+}
+
+mender_err_t
+mender_tls_sha256_update(void *handle, const void *data, size_t length) {
+
+    assert(NULL != handle);
+    int ret;
+    MBEDTLS_ERR_BUF;
+
+    /* Update digest */
+    if (0 != (ret = mbedtls_md_update((mbedtls_md_context_t *)handle, (const unsigned char *)data, length))) {
+        LOG_MBEDTLS_ERROR("Unable to update digest", ret);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_end(void *handle, uint8_t *digest) {
+
+    assert(NULL != handle);
+    mender_err_t ret = MENDER_OK;
+    int          err;
+    MBEDTLS_ERR_BUF;
+
+    /* Compute digest */
+    if (NULL != digest) {
+        if (0 != (err = mbedtls_md_finish((mbedtls_md_context_t *)handle, digest))) {
+            LOG_MBEDTLS_ERROR("Unable to compute digest", err);
+            ret = MENDER_FAIL;
+        }
     }
 
     /* Release memory */
-    if (NULL != sig) {
-        free(sig);
+    mbedtls_md_free((mbedtls_md_context_t *)handle);
+    mender_utils_free(handle);
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+mender_tls_ctx_t *
+mender_tls_create_ctx(void) {
+
+    mender_tls_ctx_t *ctx;
+
+    /* Create the context, the keys are initialized with mender_tls_init_authentication_keys */
+    if (NULL == (ctx = (mender_tls_ctx_t *)mender_utils_calloc(1, sizeof(mender_tls_ctx_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return NULL;
     }
 
-    return (0 != ret) ? MENDER_FAIL : MENDER_OK;
+    return ctx;
+}
+
+mender_tls_ctx_t *
+mender_tls_select_ctx(mender_tls_ctx_t *ctx) {
+
+    mender_tls_ctx_t *previous = mender_tls_ctx;
+
+    /* Select the context of the calling thread */
+    mender_tls_ctx = (NULL != ctx) ? ctx : &mender_tls_default_ctx;
+
+    return (&mender_tls_default_ctx != previous) ? previous : NULL;
+}
+
+void
+mender_tls_release_ctx(mender_tls_ctx_t *ctx) {
+
+    /* Release memory, the context of the keys recorded in the storage is released by mender_tls_exit */
+    if ((NULL != ctx) && (&mender_tls_default_ctx != ctx)) {
+        assert(mender_tls_ctx != ctx);
+        mender_tls_ctx_t *previous = mender_tls_select_ctx(ctx);
+        mender_tls_release_signing_context();
+        mender_tls_release_authentication_keys();
+        mender_tls_select_ctx(previous);
+        mender_utils_free(ctx);
+    }
 }
 
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
 mender_err_t
 mender_tls_exit(void) {
 
     /* Release memory */
-    if (NULL != mender_tls_private_key) {
-        free(mender_tls_private_key);
-        mender_tls_private_key = NULL;
+    mender_tls_release_signing_context();
+    mender_tls_release_authentication_keys();
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_tls_load_signing_context(void) {
+
+    int ret;
+    MBEDTLS_ERR_BUF;
+
+    /* Initialize mbedtls */
+    if (NULL == (mender_tls_ctx->pk_context = (mbedtls_pk_context *)mender_utils_malloc(sizeof(mbedtls_pk_context)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = -1;
+        goto END;
+    }
+    mbedtls_pk_init(mender_tls_ctx->pk_context);
+    if (NULL == (mender_tls_ctx->ctr_drbg = (mbedtls_ctr_drbg_context *)mender_utils_malloc(sizeof(mbedtls_ctr_drbg_context)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = -1;
+        goto END;
     }
-    mender_tls_private_key_length = 0;
-    if (NULL != mender_tls_public_key) {
-        free(mender_tls_public_key);
-        mender_tls_public_key = NULL;
+    mbedtls_ctr_drbg_init(mender_tls_ctx->ctr_drbg);
+    if (NULL == (mender_tls_ctx->entropy = (mbedtls_entropy_context *)mender_utils_malloc(sizeof(mbedtls_entropy_context)))) {
+        mender_log_error("Unable to allocate memory");
+        ret = -1;
+        goto END;
     }
-    mender_tls_public_key_length = 0;
+    mbedtls_entropy_init(mender_tls_ctx->entropy);
 
-    return MENDER_OK;
+    /* Setup CRT DRBG, it is reseeded automatically by mbedtls */
+    if (0
+        != (ret = mbedtls_ctr_drbg_seed(
+                mender_tls_ctx->ctr_drbg, mbedtls_entropy_func, mender_tls_ctx->entropy, (const unsigned char *)"mender", strlen("mender")))) {
+        LOG_MBEDTLS_ERROR("Unable to initialize ctr drbg", ret);
+        goto END;
+    }
+
+    /* Parse private key (IMPORTANT NOTE: length must include the ending \0 character) */
+#if MBEDTLS_VERSION_NUMBER >= 0x03000000
+    if (0
+        != (ret = mbedtls_pk_parse_key(mender_tls_ctx->pk_context,
+                                       mender_tls_ctx->private_key,
+                                       mender_tls_ctx->private_key_length,
+                                       NULL,
+                                       0,
+                                       mbedtls_ctr_drbg_random,
+                                       mender_tls_ctx->ctr_drbg))) {
+#else
+    if (0 != (ret = mbedtls_pk_parse_key(mender_tls_ctx->pk_context, mender_tls_ctx->private_key, mender_tls_ctx->private_key_length, NULL, 0))) {
+#endif /* MBEDTLS_VERSION_NUMBER >= 0x03000000 */
+        LOG_MBEDTLS_ERROR("Unable to parse private key", ret);
+        goto END;
+    }
+
+END:
+
+    /* Release mbedtls if an error occurred */
+    if (0 != ret) {
+        mender_tls_release_signing_context();
+    }
+
+    return (0 != ret) ? MENDER_FAIL : MENDER_OK;
+}
+
+static void
+mender_tls_release_signing_context(void) {
+
+    /* Release mbedtls */
+    if (NULL != mender_tls_ctx->entropy) {
+        mbedtls_entropy_free(mender_tls_ctx->entropy);
+        mender_utils_free(mender_tls_ctx->entropy);
+        mender_tls_ctx->entropy = NULL;
+    }
+    if (NULL != mender_tls_ctx->ctr_drbg) {
+        mbedtls_ctr_drbg_free(mender_tls_ctx->ctr_drbg);
+        mender_utils_free(mender_tls_ctx->ctr_drbg);
+        mender_tls_ctx->ctr_drbg = NULL;
+    }
+    if (NULL != mender_tls_ctx->pk_context) {
+        mbedtls_pk_free(mender_tls_ctx->pk_context);
+        mender_utils_free(mender_tls_ctx->pk_context);
+        mender_tls_ctx->pk_context = NULL;
+    }
+}
+
+static void
+mender_tls_release_authentication_keys(void) {
+
+    /* Release memory, the views on the storage cache are released with the cache */
+    if (NULL != mender_tls_ctx->allocated_private_key) {
+        mender_utils_free(mender_tls_ctx->allocated_private_key);
+        mender_tls_ctx->allocated_private_key = NULL;
+    }
+    if (NULL != mender_tls_ctx->allocated_public_key) {
+        mender_utils_free(mender_tls_ctx->allocated_public_key);
+        mender_tls_ctx->allocated_public_key = NULL;
+    }
+    mender_tls_ctx->private_key        = NULL;
+    mender_tls_ctx->private_key_length = 0;
+    mender_tls_ctx->public_key         = NULL;
+    mender_tls_ctx->public_key_length  = 0;
 }
 
 static mender_err_t
@@ -368,13 +675,13 @@ mender_tls_generate_authentication_keys(mbedtls_pk_context *pk_context) {
     int                       ret;
     MBEDTLS_ERR_BUF;
 
-    if (NULL == (ctr_drbg = (mbedtls_ctr_drbg_context *)malloc(sizeof(mbedtls_ctr_drbg_context)))) {
+    if (NULL == (ctr_drbg = (mbedtls_ctr_drbg_context *)mender_utils_malloc(sizeof(mbedtls_ctr_drbg_context)))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
     }
     mbedtls_ctr_drbg_init(ctr_drbg);
-    if (NULL == (entropy = (mbedtls_entropy_context *)malloc(sizeof(mbedtls_entropy_context)))) {
+    if (NULL == (entropy = (mbedtls_entropy_context *)mender_utils_malloc(sizeof(mbedtls_entropy_context)))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
@@ -387,6 +694,22 @@ mender_tls_generate_authentication_keys(mbedtls_pk_context *pk_context) {
         goto END;
     }
 
+#ifdef CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA
+
+    /* PK setup */
+    if (0 != (ret = mbedtls_pk_setup(pk_context, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY)))) {
+        LOG_MBEDTLS_ERROR("Unable to setup pk", ret);
+        goto END;
+    }
+
+    /* Generate key pair, the signatures are computed with ECDSA and encoded in ASN.1 DER format as expected by the server */
+    if (0 != (ret = mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(*pk_context), mbedtls_ctr_drbg_random, ctr_drbg))) {
+        LOG_MBEDTLS_ERROR("Unable to generate key", ret);
+        goto END;
+    }
+
+#else
+
     /* PK setup */
     if (0 != (ret = mbedtls_pk_setup(pk_context, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA)))) {
         LOG_MBEDTLS_ERROR("Unable to setup pk", ret);
@@ -399,15 +722,17 @@ mender_tls_generate_authentication_keys(mbedtls_pk_context *pk_context) {
         goto END;
     }
 
+#endif /* CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA */
+
 END:
     /* Release mbedtls */
     if (NULL != entropy) {
         mbedtls_entropy_free(entropy);
-        free(entropy);
+        mender_utils_free(entropy);
     }
     if (NULL != ctr_drbg) {
         mbedtls_ctr_drbg_free(ctr_drbg);
-        free(ctr_drbg);
+        mender_utils_free(ctr_drbg);
     }
 
     return (0 != ret) ? MENDER_FAIL : MENDER_OK;
@@ -424,13 +749,13 @@ mender_tls_user_provided_authentication_keys(mbedtls_pk_context *pk_context, con
     int                       ret;
     MBEDTLS_ERR_BUF;
 
-    if (NULL == (ctr_drbg = (mbedtls_ctr_drbg_context *)malloc(sizeof(mbedtls_ctr_drbg_context)))) {
+    if (NULL == (ctr_drbg = (mbedtls_ctr_drbg_context *)mender_utils_malloc(sizeof(mbedtls_ctr_drbg_context)))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
     }
     mbedtls_ctr_drbg_init(ctr_drbg);
-    if (NULL == (entropy = (mbedtls_entropy_context *)malloc(sizeof(mbedtls_entropy_context)))) {
+    if (NULL == (entropy = (mbedtls_entropy_context *)mender_utils_malloc(sizeof(mbedtls_entropy_context)))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
@@ -457,11 +782,11 @@ END:
     /* Release mbedtls */
     if (NULL != entropy) {
         mbedtls_entropy_free(entropy);
-        free(entropy);
+        mender_utils_free(entropy);
     }
     if (NULL != ctr_drbg) {
         mbedtls_ctr_drbg_free(ctr_drbg);
-        free(ctr_drbg);
+        mender_utils_free(ctr_drbg);
     }
 
     return (0 != ret) ? MENDER_FAIL : MENDER_OK;
@@ -486,7 +811,7 @@ mender_tls_get_authentication_keys(unsigned char **private_key,
     MBEDTLS_ERR_BUF;
 
     /* Initialize mbedtls */
-    if (NULL == (pk_context = (mbedtls_pk_context *)malloc(sizeof(mbedtls_pk_context)))) {
+    if (NULL == (pk_context = (mbedtls_pk_context *)mender_utils_malloc(sizeof(mbedtls_pk_context)))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
@@ -507,22 +832,22 @@ mender_tls_get_authentication_keys(unsigned char **private_key,
     }
 
     /* Export private key */
-    if (NULL == (*private_key = (unsigned char *)malloc(MENDER_TLS_PRIVATE_KEY_LENGTH))) {
+    if (NULL == (*private_key = (unsigned char *)mender_utils_malloc(MENDER_TLS_PRIVATE_KEY_LENGTH))) {
         mender_log_error("Unable to allocate memory");
         ret = -1;
         goto END;
     }
     if ((ret = mbedtls_pk_write_key_der(pk_context, *private_key, MENDER_TLS_PRIVATE_KEY_LENGTH)) < 0) {
         LOG_MBEDTLS_ERROR("Unable to write private key to PEM format", ret);
-        free(*private_key);
+        mender_utils_free(*private_key);
         *private_key = NULL;
         goto END;
     }
     *private_key_length = (size_t)ret;
     memcpy(*private_key, *private_key + MENDER_TLS_PRIVATE_KEY_LENGTH - *private_key_length, *private_key_length);
-    if (NULL == (tmp = realloc(*private_key, *private_key_length))) {
+    if (NULL == (tmp = mender_utils_realloc(*private_key, *private_key_length))) {
         mender_log_error("Unable to allocate memory");
-        free(*private_key);
+        mender_utils_free(*private_key);
         *private_key = NULL;
         ret          = -1;
         goto END;
@@ -530,28 +855,28 @@ mender_tls_get_authentication_keys(unsigned char **private_key,
     *private_key = tmp;
 
     /* Export public key */
-    if (NULL == (*public_key = (unsigned char *)malloc(MENDER_TLS_PUBLIC_KEY_LENGTH))) {
+    if (NULL == (*public_key = (unsigned char *)mender_utils_malloc(MENDER_TLS_PUBLIC_KEY_LENGTH))) {
         mender_log_error("Unable to allocate memory");
-        free(*private_key);
+        mender_utils_free(*private_key);
         *private_key = NULL;
         ret          = -1;
         goto END;
     }
     if ((ret = mbedtls_pk_write_pubkey_der(pk_context, *public_key, MENDER_TLS_PUBLIC_KEY_LENGTH)) < 0) {
         LOG_MBEDTLS_ERROR("Unable to write public key to PEM format", ret);
-        free(*private_key);
+        mender_utils_free(*private_key);
         *private_key = NULL;
-        free(*public_key);
+        mender_utils_free(*public_key);
         *public_key = NULL;
         goto END;
     }
     *public_key_length = (size_t)ret;
     memcpy(*public_key, *public_key + MENDER_TLS_PUBLIC_KEY_LENGTH - *public_key_length, *public_key_length);
-    if (NULL == (tmp = realloc(*public_key, *public_key_length))) {
+    if (NULL == (tmp = mender_utils_realloc(*public_key, *public_key_length))) {
         mender_log_error("Unable to allocate memory");
-        free(*private_key);
+        mender_utils_free(*private_key);
         *private_key = NULL;
-        free(*public_key);
+        mender_utils_free(*public_key);
         *public_key = NULL;
         ret         = -1;
         goto END;
@@ -564,12 +889,41 @@ END:
     /* Release mbedtls */
     if (NULL != pk_context) {
         mbedtls_pk_free(pk_context);
-        free(pk_context);
+        mender_utils_free(pk_context);
     }
 
     return (0 != ret) ? MENDER_FAIL : MENDER_OK;
 }
 
+static size_t
+mender_tls_ecdsa_raw_to_der(const unsigned char *raw, size_t raw_length, unsigned char *der) {
+
+    assert(NULL != raw);
+    assert(NULL != der);
+    size_t length = 2;
+
+    /* SEQUENCE { INTEGER r, INTEGER s }, leading zeros are removed and one is added if the integer would be negative */
+    for (size_t index = 0; index < 2; index++) {
+        const unsigned char *p    = raw + index * (raw_length / 2);
+        size_t               size = raw_length / 2;
+        while ((size > 1) && (0x00 == p[0])) {
+            p++;
+            size--;
+        }
+        der[length++] = 0x02;
+        der[length++] = (unsigned char)(size + ((0 != (p[0] & 0x80)) ? 1 : 0));
+        if (0 != (p[0] & 0x80)) {
+            der[length++] = 0x00;
+        }
+        memcpy(der + length, p, size);
+        length += size;
+    }
+    der[0] = 0x30;
+    der[1] = (unsigned char)(length - 2);
+
+    return length;
+}
+
 static mender_err_t
 mender_tls_pem_write_buffer(const unsigned char *der_data, size_t der_len, char *buf, size_t buf_len, size_t *olen) {
 
@@ -606,7 +960,7 @@ mender_tls_pem_write_buffer(const unsigned char *der_data, size_t der_len, char
     }
 
     /* Allocate memory to store PEM data */
-    if (NULL == (encode_buf = (unsigned char *)malloc(use_len))) {
+    if (NULL == (encode_buf = (unsigned char *)mender_utils_malloc(use_len))) {
         mender_log_error("Unable to allocate memory");
         ret = MENDER_FAIL;
         goto END;
@@ -650,7 +1004,7 @@ END:
 
     /* Release memory */
     if (NULL != encode_buf) {
-        free(encode_buf);
+        mender_utils_free(encode_buf);
     }
 
     return ret;
@@ -0,0 +1,731 @@
+/**
+ * @file      mender-tls.c
+ * @brief     Mender TLS interface for PSA Crypto platform, keys are stored and used in the PSA key store so that accelerators and secure storage are used
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @brief Module to which the allocations of this file are accounted
+ */
+#define MENDER_UTILS_HEAP_MODULE MENDER_UTILS_HEAP_MODULE_TLS
+
+#include <psa/crypto.h>
+#include "mender-log.h"
+#include "mender-tls.h"
+
+/**
+ * @brief Default identifier of the authentication key in the PSA key store
+ */
+#ifndef CONFIG_MENDER_TLS_PSA_KEY_ID
+#define CONFIG_MENDER_TLS_PSA_KEY_ID (0x4D454E44)
+#endif /* CONFIG_MENDER_TLS_PSA_KEY_ID */
+
+/**
+ * @brief Algorithm identifiers of the SubjectPublicKeyInfo, OID and parameters
+ */
+#define MENDER_TLS_ALGORITHM_ID_RSA        "\x06\x09\x2A\x86\x48\x86\xF7\x0D\x01\x01\x01\x05\x00"
+#define MENDER_TLS_ALGORITHM_ID_ECDSA_P256 "\x06\x07\x2A\x86\x48\xCE\x3D\x02\x01\x06\x08\x2A\x86\x48\xCE\x3D\x03\x01\x07"
+
+/**
+ * @brief Authentication key type, size and signature algorithm
+ */
+#ifdef CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA
+#define MENDER_TLS_KEY_TYPE       PSA_KEY_TYPE_ECC_KEY_PAIR(PSA_ECC_FAMILY_SECP_R1)
+#define MENDER_TLS_KEY_BITS       (256)
+#define MENDER_TLS_KEY_ALGORITHM  PSA_ALG_ECDSA(PSA_ALG_SHA_256)
+#define MENDER_TLS_PUBLIC_KEY_OID MENDER_TLS_ALGORITHM_ID_ECDSA_P256
+#else
+#define MENDER_TLS_KEY_TYPE       PSA_KEY_TYPE_RSA_KEY_PAIR
+#define MENDER_TLS_KEY_BITS       (3072)
+#define MENDER_TLS_KEY_ALGORITHM  PSA_ALG_RSA_PKCS1V15_SIGN(PSA_ALG_SHA_256)
+#define MENDER_TLS_PUBLIC_KEY_OID MENDER_TLS_ALGORITHM_ID_RSA
+#endif /* CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA */
+
+/**
+ * @brief Maximum length of the public key exported from the PSA key store, and of the DER encoded SubjectPublicKeyInfo
+ */
+#define MENDER_TLS_PUBLIC_KEY_LENGTH PSA_EXPORT_PUBLIC_KEY_OUTPUT_SIZE(MENDER_TLS_KEY_TYPE, MENDER_TLS_KEY_BITS)
+#define MENDER_TLS_SPKI_LENGTH       (MENDER_TLS_PUBLIC_KEY_LENGTH + 32)
+
+/**
+ * @brief Maximum length of the signature, the ECDSA signature is converted from raw format to ASN.1 DER format as expected by the server
+ */
+#define MENDER_TLS_SIGNATURE_MAX_LENGTH (PSA_SIGN_OUTPUT_SIZE(MENDER_TLS_KEY_TYPE, MENDER_TLS_KEY_BITS) + 16)
+
+/**
+ * @brief PEM header and footer of the public key
+ */
+#define MENDER_TLS_PEM_BEGIN_PUBLIC_KEY "-----BEGIN PUBLIC KEY-----\n"
+#define MENDER_TLS_PEM_END_PUBLIC_KEY   "-----END PUBLIC KEY-----\n"
+
+/**
+ * @brief Context of the authentication keys of a device
+ */
+struct mender_tls_ctx_s {
+    psa_key_id_t key_id; /**< Authentication key identifier, 0 if the key is not available */
+};
+
+/**
+ * @brief Context of the authentication keys recorded in the storage, the key is persistent
+ */
+static mender_tls_ctx_t mender_tls_default_ctx;
+
+/**
+ * @brief Context of the authentication keys of the calling thread, the keys of the additional devices are volatile
+ */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+static __thread mender_tls_ctx_t *mender_tls_ctx = &mender_tls_default_ctx;
+#else
+static mender_tls_ctx_t *const mender_tls_ctx = &mender_tls_default_ctx;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+/**
+ * @brief Generate authentication key in the PSA key store
+ * @param persistent Generate the persistent key of the device, a volatile key is generated otherwise
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_tls_generate_authentication_key(bool persistent);
+
+/**
+ * @brief Write DER tag and length
+ * @param buf Buffer to write to
+ * @param tag Tag
+ * @param length Length of the content
+ * @return Number of bytes written
+ */
+static size_t mender_tls_der_write_header(uint8_t *buf, uint8_t tag, size_t length);
+
+/**
+ * @brief Write DER encoded SubjectPublicKeyInfo of the public key exported from the PSA key store
+ * @param public_key Public key
+ * @param public_key_length Length of the public key
+ * @param buf Buffer to write to, at least MENDER_TLS_SPKI_LENGTH bytes
+ * @return Length of the SubjectPublicKeyInfo
+ */
+static size_t mender_tls_der_write_public_key(const uint8_t *public_key, size_t public_key_length, uint8_t *buf);
+
+#ifdef CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA
+/**
+ * @brief Write DER encoded INTEGER from a big endian unsigned number
+ * @param buf Buffer to write to
+ * @param data Number
+ * @param length Length of the number
+ * @return Number of bytes written
+ */
+static size_t mender_tls_der_write_integer(uint8_t *buf, const uint8_t *data, size_t length);
+#endif /* CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA */
+
+/**
+ * @brief Encode data to base64
+ * @param data Data to encode
+ * @param length Length of the data
+ * @param buf Buffer to write to, at least ((length + 2) / 3) * 4 + 1 bytes, null terminated
+ * @param line_length Maximum length of the lines (multiple of 4), 0 to write a single line
+ * @return Number of bytes written, without the null terminator
+ */
+static size_t mender_tls_base64_encode(const uint8_t *data, size_t length, char *buf, size_t line_length);
+
+/**
+ * @brief Decode data encoded in base64, characters out of the alphabet such as line breaks are ignored
+ * @param data Data to decode
+ * @param length Length of the data
+ * @param buf Buffer to write to, at least (length / 4) * 3 + 3 bytes
+ * @return Number of bytes written
+ */
+static size_t mender_tls_base64_decode(const char *data, size_t length, uint8_t *buf);
+
+/**
+ * @brief Read DER tag and length
+ * @param p Pointer to the current position, updated to the content
+ * @param end End of the data
+ * @param tag Expected tag
+ * @param length Length of the content
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t mender_tls_der_read_header(const uint8_t **p, const uint8_t *end, uint8_t tag, size_t *length);
+
+mender_err_t
+mender_tls_init(void) {
+
+    psa_status_t status;
+
+    /* Initialize PSA Crypto, it may have already been initialized by the application */
+    if (PSA_SUCCESS != (status = psa_crypto_init())) {
+        mender_log_error("Unable to initialize PSA Crypto (%d)", (int)status);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_init_authentication_keys(mender_err_t (*get_user_provided_keys)(char **user_provided_key, size_t *user_provided_key_length), bool recommissioning) {
+
+    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
+    psa_key_id_t         key_id     = (psa_key_id_t)CONFIG_MENDER_TLS_PSA_KEY_ID;
+    mender_err_t         ret;
+    psa_status_t         status;
+
+    /* Destroy the volatile key of an additional device, the persistent key remains in the PSA key store */
+    if ((&mender_tls_default_ctx != mender_tls_ctx) && (0 != mender_tls_ctx->key_id)) {
+        psa_destroy_key(mender_tls_ctx->key_id);
+    }
+    mender_tls_ctx->key_id = 0;
+
+    /* User-provided keys can not be imported, they must be provisioned in the PSA key store with the identifier of the authentication key */
+    if (NULL != get_user_provided_keys) {
+        char  *user_provided_key        = NULL;
+        size_t user_provided_key_length = 0;
+        if (MENDER_OK != (ret = get_user_provided_keys(&user_provided_key, &user_provided_key_length))) {
+            mender_log_error("Unable to get user provided key");
+            return ret;
+        }
+        if (NULL != user_provided_key) {
+            mender_log_error("User provided key is not supported, provision it in the PSA key store with identifier 0x%08x", (unsigned int)key_id);
+            mender_utils_free(user_provided_key);
+            return MENDER_FAIL;
+        }
+    }
+
+    /* The keys of the additional devices are volatile, they are generated again each time they are initialized */
+    if (&mender_tls_default_ctx != mender_tls_ctx) {
+        mender_log_info("Generating authentication keys...");
+        if (MENDER_OK != (ret = mender_tls_generate_authentication_key(false))) {
+            mender_log_error("Unable to generate authentication keys");
+            return ret;
+        }
+        return MENDER_OK;
+    }
+
+    /* Check if recommissioning is forced */
+    if (true == recommissioning) {
+
+        /* Erase authentication key */
+        mender_log_info("Delete authentication keys...");
+        if ((PSA_SUCCESS != (status = psa_destroy_key(key_id))) && (PSA_ERROR_INVALID_HANDLE != status) && (PSA_ERROR_DOES_NOT_EXIST != status)) {
+            mender_log_warning("Unable to delete authentication keys (%d)", (int)status);
+        }
+    }
+
+    /* Retrieve or generate authentication key, the private key never leaves the PSA key store */
+    if (PSA_SUCCESS == (status = psa_get_key_attributes(key_id, &attributes))) {
+        if ((MENDER_TLS_KEY_TYPE != psa_get_key_type(&attributes)) || (0 == (psa_get_key_usage_flags(&attributes) & PSA_KEY_USAGE_SIGN_MESSAGE))) {
+            mender_log_error("Authentication key 0x%08x has unexpected type or usage", (unsigned int)key_id);
+            psa_reset_key_attributes(&attributes);
+            return MENDER_FAIL;
+        }
+        psa_reset_key_attributes(&attributes);
+        mender_tls_ctx->key_id = key_id;
+    } else if ((PSA_ERROR_INVALID_HANDLE == status) || (PSA_ERROR_DOES_NOT_EXIST == status)) {
+        mender_log_info("Generating authentication keys...");
+        if (MENDER_OK != (ret = mender_tls_generate_authentication_key(true))) {
+            mender_log_error("Unable to generate authentication keys");
+            return ret;
+        }
+    } else {
+        mender_log_error("Unable to get authentication keys (%d)", (int)status);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_get_public_key_pem(char **public_key) {
+
+    assert(NULL != public_key);
+    uint8_t     *buf = NULL;
+    size_t       length;
+    psa_status_t status;
+
+    *public_key = NULL;
+
+    /* Check if the authentication key is available */
+    if (0 == mender_tls_ctx->key_id) {
+        mender_log_error("Authentication keys are not available");
+        return MENDER_FAIL;
+    }
+
+    /* Export public key and convert it to SubjectPublicKeyInfo */
+    if (NULL == (buf = (uint8_t *)mender_utils_malloc(MENDER_TLS_PUBLIC_KEY_LENGTH + MENDER_TLS_SPKI_LENGTH))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (PSA_SUCCESS != (status = psa_export_public_key(mender_tls_ctx->key_id, buf, MENDER_TLS_PUBLIC_KEY_LENGTH, &length))) {
+        mender_log_error("Unable to export public key (%d)", (int)status);
+        mender_utils_free(buf);
+        return MENDER_FAIL;
+    }
+    length = mender_tls_der_write_public_key(buf, length, buf + MENDER_TLS_PUBLIC_KEY_LENGTH);
+
+    /* Convert public key from DER to PEM format, lines of 64 characters */
+    size_t base64_length = ((length + 2) / 3) * 4;
+    size_t pem_length    = strlen(MENDER_TLS_PEM_BEGIN_PUBLIC_KEY) + base64_length + (base64_length + 63) / 64 + strlen(MENDER_TLS_PEM_END_PUBLIC_KEY) + 1;
+    if (NULL == (*public_key = (char *)mender_utils_malloc(pem_length))) {
+        mender_log_error("Unable to allocate memory");
+        mender_utils_free(buf);
+        return MENDER_FAIL;
+    }
+    char *p = *public_key;
+    strcpy(p, MENDER_TLS_PEM_BEGIN_PUBLIC_KEY);
+    p += strlen(MENDER_TLS_PEM_BEGIN_PUBLIC_KEY);
+    p += mender_tls_base64_encode(buf + MENDER_TLS_PUBLIC_KEY_LENGTH, length, p, 64);
+    *p++ = '\n';
+    strcpy(p, MENDER_TLS_PEM_END_PUBLIC_KEY);
+
+    /* Release memory */
+    mender_utils_free(buf);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sign_payload(char *payload, char **signature, size_t *signature_length) {
+
+    assert(NULL != payload);
+    assert(NULL != signature);
+    assert(NULL != signature_length);
+    uint8_t     *sig;
+    size_t       sig_length;
+    psa_status_t status;
+
+    /* Check if the authentication key is available */
+    if (0 == mender_tls_ctx->key_id) {
+        mender_log_error("Authentication keys are not available");
+        return MENDER_FAIL;
+    }
+
+    /* Compute signature, the payload is hashed by the PSA implementation so that accelerators are used */
+    if (NULL == (sig = (uint8_t *)mender_utils_malloc(MENDER_TLS_SIGNATURE_MAX_LENGTH))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    if (PSA_SUCCESS
+        != (status = psa_sign_message(
+                mender_tls_ctx->key_id, MENDER_TLS_KEY_ALGORITHM, (const uint8_t *)payload, strlen(payload), sig, MENDER_TLS_SIGNATURE_MAX_LENGTH, &sig_length))) {
+        mender_log_error("Unable to compute signature (%d)", (int)status);
+        mender_utils_free(sig);
+        return MENDER_FAIL;
+    }
+
+#ifdef CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA
+
+    /* Convert signature from raw format r || s to ASN.1 DER format */
+    uint8_t der[MENDER_TLS_SIGNATURE_MAX_LENGTH];
+    size_t  der_length = mender_tls_der_write_integer(der + 2, sig, sig_length / 2);
+    der_length += mender_tls_der_write_integer(der + 2 + der_length, sig + sig_length / 2, sig_length / 2);
+    der[0] = 0x30;
+    der[1] = (uint8_t)der_length;
+    memcpy(sig, der, der_length + 2);
+    sig_length = der_length + 2;
+
+#endif /* CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA */
+
+    /* Encode signature to base64 (1 extra byte for the NUL character) */
+    if (NULL == (*signature = (char *)mender_utils_malloc(((sig_length + 2) / 3) * 4 + 1))) {
+        mender_log_error("Unable to allocate memory");
+        mender_utils_free(sig);
+        return MENDER_FAIL;
+    }
+    *signature_length = mender_tls_base64_encode(sig, sig_length, *signature, 0);
+
+    /* Release memory */
+    mender_utils_free(sig);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_verify_signature(const char *public_key, const uint8_t *digest, const char *signature, size_t signature_length) {
+
+    assert(NULL != public_key);
+    assert(NULL != digest);
+    assert(NULL != signature);
+    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
+    psa_key_id_t         key_id     = 0;
+    mender_err_t         ret        = MENDER_FAIL;
+    uint8_t             *spki       = NULL;
+    uint8_t             *sig        = NULL;
+    size_t               length;
+    psa_status_t         status;
+
+    /* Decode public key, only the base64 data between the header and the footer is kept */
+    const char *begin = strstr(public_key, "-----BEGIN PUBLIC KEY-----");
+    const char *end   = strstr(public_key, "-----END PUBLIC KEY-----");
+    if ((NULL == begin) || (NULL == end) || (end < begin)) {
+        mender_log_error("Invalid public key");
+        goto END;
+    }
+    begin += strlen("-----BEGIN PUBLIC KEY-----");
+    if (NULL == (spki = (uint8_t *)mender_utils_malloc(((size_t)(end - begin) / 4) * 3 + 3))) {
+        mender_log_error("Unable to allocate memory");
+        goto END;
+    }
+    length = mender_tls_base64_decode(begin, (size_t)(end - begin), spki);
+
+    /* Parse SubjectPublicKeyInfo, SEQUENCE { SEQUENCE { algorithm OID, parameters }, BIT STRING { 0 unused bits, public key } } */
+    const uint8_t  *p        = spki;
+    const uint8_t  *spki_end = spki + length;
+    psa_algorithm_t algorithm;
+    if ((MENDER_OK != mender_tls_der_read_header(&p, spki_end, 0x30, &length)) || (MENDER_OK != mender_tls_der_read_header(&p, spki_end, 0x30, &length))) {
+        mender_log_error("Invalid public key");
+        goto END;
+    }
+    if ((sizeof(MENDER_TLS_ALGORITHM_ID_RSA) - 1 == length) && (0 == memcmp(p, MENDER_TLS_ALGORITHM_ID_RSA, length))) {
+        psa_set_key_type(&attributes, PSA_KEY_TYPE_RSA_PUBLIC_KEY);
+        algorithm = PSA_ALG_RSA_PKCS1V15_SIGN(PSA_ALG_SHA_256);
+    } else if ((sizeof(MENDER_TLS_ALGORITHM_ID_ECDSA_P256) - 1 == length) && (0 == memcmp(p, MENDER_TLS_ALGORITHM_ID_ECDSA_P256, length))) {
+        psa_set_key_type(&attributes, PSA_KEY_TYPE_ECC_PUBLIC_KEY(PSA_ECC_FAMILY_SECP_R1));
+        algorithm = PSA_ALG_ECDSA(PSA_ALG_SHA_256);
+    } else {
+        mender_log_error("Invalid public key, algorithm is not supported");
+        goto END;
+    }
+    p += length;
+    if ((MENDER_OK != mender_tls_der_read_header(&p, spki_end, 0x03, &length)) || (length < 2) || (0x00 != p[0])) {
+        mender_log_error("Invalid public key");
+        goto END;
+    }
+
+    /* Import public key as a volatile key */
+    psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_VERIFY_HASH);
+    psa_set_key_algorithm(&attributes, algorithm);
+    if (PSA_SUCCESS != (status = psa_import_key(&attributes, p + 1, length - 1, &key_id))) {
+        mender_log_error("Unable to import public key (%d)", (int)status);
+        goto END;
+    }
+
+    /* Decode signature and verify it, ECDSA signatures are expected with r and s concatenated */
+    if (NULL == (sig = (uint8_t *)mender_utils_malloc((signature_length / 4) * 3 + 3))) {
+        mender_log_error("Unable to allocate memory");
+        goto END;
+    }
+    length = mender_tls_base64_decode(signature, signature_length, sig);
+    if (PSA_SUCCESS != (status = psa_verify_hash(key_id, algorithm, digest, MENDER_TLS_SHA256_DIGEST_LENGTH, sig, length))) {
+        mender_log_error("Invalid signature (%d)", (int)status);
+        goto END;
+    }
+    ret = MENDER_OK;
+
+END:
+
+    /* Release memory */
+    if (0 != key_id) {
+        psa_destroy_key(key_id);
+    }
+    psa_reset_key_attributes(&attributes);
+    mender_utils_free(spki);
+    mender_utils_free(sig);
+
+    return ret;
+}
+
+mender_err_t
+mender_tls_sha256_begin(void **handle) {
+
+    assert(NULL != handle);
+    psa_hash_operation_t *operation;
+    psa_status_t          status;
+
+    /* Initialize hash operation */
+    if (NULL == (operation = (psa_hash_operation_t *)mender_utils_malloc(sizeof(psa_hash_operation_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return MENDER_FAIL;
+    }
+    *operation = psa_hash_operation_init();
+    if (PSA_SUCCESS != (status = psa_hash_setup(operation, PSA_ALG_SHA_256))) {
+        mender_log_error("Unable to start digest computation (%d)", (int)status);
+        mender_utils_free(operation);
+        return MENDER_FAIL;
+    }
+
+    *handle = operation;
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_update(void *handle, const void *data, size_t length) {
+
+    assert(NULL != handle);
+    psa_status_t status;
+
+    /* Update digest */
+    if (PSA_SUCCESS != (status = psa_hash_update((psa_hash_operation_t *)handle, (const uint8_t *)data, length))) {
+        mender_log_error("Unable to update digest (%d)", (int)status);
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+mender_err_t
+mender_tls_sha256_end(void *handle, uint8_t *digest) {
+
+    assert(NULL != handle);
+    mender_err_t ret = MENDER_OK;
+    size_t       length;
+    psa_status_t status;
+
+    /* Compute digest */
+    if (NULL != digest) {
+        if (PSA_SUCCESS != (status = psa_hash_finish((psa_hash_operation_t *)handle, digest, MENDER_TLS_SHA256_DIGEST_LENGTH, &length))) {
+            mender_log_error("Unable to compute digest (%d)", (int)status);
+            ret = MENDER_FAIL;
+        }
+    }
+
+    /* Release memory, aborting a finished operation has no effect */
+    psa_hash_abort((psa_hash_operation_t *)handle);
+    mender_utils_free(handle);
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+mender_tls_ctx_t *
+mender_tls_create_ctx(void) {
+
+    mender_tls_ctx_t *ctx;
+
+    /* Create the context, the key is generated by mender_tls_init_authentication_keys */
+    if (NULL == (ctx = (mender_tls_ctx_t *)mender_utils_calloc(1, sizeof(mender_tls_ctx_t)))) {
+        mender_log_error("Unable to allocate memory");
+        return NULL;
+    }
+
+    return ctx;
+}
+
+mender_tls_ctx_t *
+mender_tls_select_ctx(mender_tls_ctx_t *ctx) {
+
+    mender_tls_ctx_t *previous = mender_tls_ctx;
+
+    /* Select the context of the calling thread */
+    mender_tls_ctx = (NULL != ctx) ? ctx : &mender_tls_default_ctx;
+
+    return (&mender_tls_default_ctx != previous) ? previous : NULL;
+}
+
+void
+mender_tls_release_ctx(mender_tls_ctx_t *ctx) {
+
+    /* Destroy the volatile key and release memory, the context of the persistent key is released by mender_tls_exit */
+    if ((NULL != ctx) && (&mender_tls_default_ctx != ctx)) {
+        assert(mender_tls_ctx != ctx);
+        if (0 != ctx->key_id) {
+            psa_destroy_key(ctx->key_id);
+        }
+        mender_utils_free(ctx);
+    }
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+mender_err_t
+mender_tls_exit(void) {
+
+    /* The authentication key is persistent, only forget its identifier */
+    mender_tls_ctx->key_id = 0;
+
+    return MENDER_OK;
+}
+
+static mender_err_t
+mender_tls_generate_authentication_key(bool persistent) {
+
+    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
+    psa_key_id_t         key_id;
+    psa_status_t         status;
+
+    /* Generate key pair, it can not be exported */
+    if (true == persistent) {
+        psa_set_key_id(&attributes, (psa_key_id_t)CONFIG_MENDER_TLS_PSA_KEY_ID);
+        psa_set_key_lifetime(&attributes, PSA_KEY_LIFETIME_PERSISTENT);
+    }
+    psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_SIGN_MESSAGE | PSA_KEY_USAGE_SIGN_HASH);
+    psa_set_key_algorithm(&attributes, MENDER_TLS_KEY_ALGORITHM);
+    psa_set_key_type(&attributes, MENDER_TLS_KEY_TYPE);
+    psa_set_key_bits(&attributes, MENDER_TLS_KEY_BITS);
+    status = psa_generate_key(&attributes, &key_id);
+    psa_reset_key_attributes(&attributes);
+    if (PSA_SUCCESS != status) {
+        mender_log_error("Unable to generate key (%d)", (int)status);
+        return MENDER_FAIL;
+    }
+    mender_tls_ctx->key_id = key_id;
+
+    return MENDER_OK;
+}
+
+static size_t
+mender_tls_der_write_header(uint8_t *buf, uint8_t tag, size_t length) {
+
+    assert(NULL != buf);
+
+    /* Definite form of the length, at most 2 bytes are required for the keys */
+    buf[0] = tag;
+    if (length < 0x80) {
+        buf[1] = (uint8_t)length;
+        return 2;
+    } else if (length < 0x100) {
+        buf[1] = 0x81;
+        buf[2] = (uint8_t)length;
+        return 3;
+    }
+    buf[1] = 0x82;
+    buf[2] = (uint8_t)(length >> 8);
+    buf[3] = (uint8_t)length;
+
+    return 4;
+}
+
+static size_t
+mender_tls_der_write_public_key(const uint8_t *public_key, size_t public_key_length, uint8_t *buf) {
+
+    assert(NULL != public_key);
+    assert(NULL != buf);
+    uint8_t header[4];
+    size_t  oid_length = sizeof(MENDER_TLS_PUBLIC_KEY_OID) - 1;
+
+    /* SEQUENCE { SEQUENCE { algorithm OID, parameters }, BIT STRING { 0 unused bits, public key } } */
+    size_t bit_string_length = mender_tls_der_write_header(header, 0x03, public_key_length + 1) + public_key_length + 1;
+    size_t algorithm_length  = mender_tls_der_write_header(header, 0x30, oid_length) + oid_length;
+    size_t length            = mender_tls_der_write_header(buf, 0x30, algorithm_length + bit_string_length);
+    length += mender_tls_der_write_header(buf + length, 0x30, oid_length);
+    memcpy(buf + length, MENDER_TLS_PUBLIC_KEY_OID, oid_length);
+    length += oid_length;
+    length += mender_tls_der_write_header(buf + length, 0x03, public_key_length + 1);
+    buf[length++] = 0x00;
+    memcpy(buf + length, public_key, public_key_length);
+    length += public_key_length;
+
+    return length;
+}
+
+#ifdef CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA
+static size_t
+mender_tls_der_write_integer(uint8_t *buf, const uint8_t *data, size_t length) {
+
+    assert(NULL != buf);
+    assert(NULL != data);
+
+    /* Remove leading zeros and add one if the number would be negative */
+    while ((length > 1) && (0x00 == data[0])) {
+        data++;
+        length--;
+    }
+    bool   pad    = (0 != (data[0] & 0x80));
+    size_t offset = mender_tls_der_write_header(buf, 0x02, length + (pad ? 1 : 0));
+    if (true == pad) {
+        buf[offset++] = 0x00;
+    }
+    memcpy(buf + offset, data, length);
+
+    return offset + length;
+}
+#endif /* CONFIG_MENDER_TLS_AUTHENTICATION_KEY_ECDSA */
+
+static size_t
+mender_tls_base64_encode(const uint8_t *data, size_t length, char *buf, size_t line_length) {
+
+    assert(NULL != data);
+    assert(NULL != buf);
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t            count      = 0;
+
+    for (size_t index = 0; index < length; index += 3) {
+        if ((0 != line_length) && (0 != index) && (0 == (index / 3 * 4) % line_length)) {
+            buf[count++] = '\n';
+        }
+        uint32_t value = (uint32_t)data[index] << 16;
+        if (index + 1 < length) {
+            value |= (uint32_t)data[index + 1] << 8;
+        }
+        if (index + 2 < length) {
+            value |= (uint32_t)data[index + 2];
+        }
+        buf[count++] = alphabet[(value >> 18) & 0x3F];
+        buf[count++] = alphabet[(value >> 12) & 0x3F];
+        buf[count++] = (index + 1 < length) ? alphabet[(value >> 6) & 0x3F] : '=';
+        buf[count++] = (index + 2 < length) ? alphabet[value & 0x3F] : '=';
+    }
+    buf[count] = '\0';
+
+    return count;
+}
+
+static size_t
+mender_tls_base64_decode(const char *data, size_t length, uint8_t *buf) {
+
+    assert(NULL != data);
+    assert(NULL != buf);
+    uint32_t value = 0;
+    size_t   bits  = 0;
+    size_t   count = 0;
+
+    for (size_t index = 0; index < length; index++) {
+        char c = data[index];
+        if ('=' == c) {
+            break;
+        }
+        const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        const char *position = ('\0' != c) ? strchr(alphabet, c) : NULL;
+        if (NULL == position) {
+            continue;
+        }
+        value = (value << 6) | (uint32_t)(position - alphabet);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            buf[count++] = (uint8_t)(value >> bits);
+        }
+    }
+
+    return count;
+}
+
+static mender_err_t
+mender_tls_der_read_header(const uint8_t **p, const uint8_t *end, uint8_t tag, size_t *length) {
+
+    assert(NULL != p);
+    assert(NULL != end);
+    assert(NULL != length);
+
+    /* Check tag, definite form of the length with at most 2 bytes */
+    if ((end - *p < 2) || (tag != (*p)[0])) {
+        return MENDER_FAIL;
+    }
+    if ((*p)[1] < 0x80) {
+        *length = (*p)[1];
+        *p += 2;
+    } else if ((0x81 == (*p)[1]) && (end - *p >= 3)) {
+        *length = (*p)[2];
+        *p += 3;
+    } else if ((0x82 == (*p)[1]) && (end - *p >= 4)) {
+        *length = ((size_t)(*p)[2] << 8) | (*p)[3];
+        *p += 4;
+    } else {
+        return MENDER_FAIL;
+    }
+    if ((size_t)(end - *p) < *length) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
@@ -55,6 +55,74 @@ mender_tls_sign_payload(char *payload, char **signature, size_t *signature_lengt
     return MENDER_NOT_IMPLEMENTED;
 }
 
+__attribute__((weak)) mender_err_t
+mender_tls_verify_signature(const char *public_key, const uint8_t *digest, const char *signature, size_t signature_length) {
+
+    (void)public_key;
+    (void)digest;
+    (void)signature;
+    (void)signature_length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_tls_sha256_begin(void **handle) {
+
+    (void)handle;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_tls_sha256_update(void *handle, const void *data, size_t length) {
+
+    (void)handle;
+    (void)data;
+    (void)length;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+__attribute__((weak)) mender_err_t
+mender_tls_sha256_end(void *handle, uint8_t *digest) {
+
+    (void)handle;
+    (void)digest;
+
+    /* Nothing to do */
+    return MENDER_NOT_IMPLEMENTED;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+
+__attribute__((weak)) mender_tls_ctx_t *
+mender_tls_create_ctx(void) {
+
+    /* Nothing to do */
+    return NULL;
+}
+
+__attribute__((weak)) mender_tls_ctx_t *
+mender_tls_select_ctx(mender_tls_ctx_t *ctx) {
+
+    /* Nothing to do */
+    (void)ctx;
+    return NULL;
+}
+
+__attribute__((weak)) void
+mender_tls_release_ctx(mender_tls_ctx_t *ctx) {
+
+    /* Nothing to do */
+    (void)ctx;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
 __attribute__((weak)) mender_err_t
 mender_tls_exit(void) {
 
@@ -0,0 +1,355 @@
+/**
+ * @file      main.c
+ * @brief     Benchmark application used to measure the throughput of the artifact parser
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <time.h>
+#include "mender-artifact.h"
+#include "mender-log.h"
+
+/**
+ * @brief Maximum number of fragment sizes
+ */
+#define BENCHMARK_FRAGMENT_SIZES_MAX (16)
+
+/**
+ * @brief Default fragment sizes, Zephyr and ESP-IDF HTTP receive buffer, curl maximum write size
+ */
+static const size_t benchmark_default_fragment_sizes[] = { 512, 16384 };
+
+/**
+ * @brief Benchmark options
+ */
+static const struct option benchmark_options[]
+    = { { "help", 0, NULL, 'h' }, { "fragment_size", 1, NULL, 'f' }, { "repeat", 1, NULL, 'r' }, { NULL, 0, NULL, 0 } };
+
+/**
+ * @brief Heap statistics, updated by the allocation wrappers
+ */
+static struct {
+    bool   enabled;     /**< Statistics are collected */
+    size_t allocations; /**< Number of allocations */
+    size_t current;     /**< Current heap usage (bytes) */
+    size_t peak;        /**< Peak heap usage (bytes) */
+} benchmark_heap;
+
+/**
+ * @brief Callback statistics
+ */
+static struct {
+    size_t calls;  /**< Number of callback invocations */
+    size_t length; /**< Length of the payload data received (bytes) */
+} benchmark_callback;
+
+/**
+ * @brief Allocation functions, the benchmark is linked with --wrap options
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void  __real_free(void *ptr);
+
+/**
+ * @brief Account an allocation
+ * @param ptr Memory allocated, NULL if the allocation failed
+ */
+static void
+benchmark_heap_alloc(void *ptr) {
+
+    if ((true == benchmark_heap.enabled) && (NULL != ptr)) {
+        benchmark_heap.allocations++;
+        benchmark_heap.current += malloc_usable_size(ptr);
+        if (benchmark_heap.current > benchmark_heap.peak) {
+            benchmark_heap.peak = benchmark_heap.current;
+        }
+    }
+}
+
+/**
+ * @brief Account a release
+ * @param ptr Memory released
+ */
+static void
+benchmark_heap_free(void *ptr) {
+
+    if ((true == benchmark_heap.enabled) && (NULL != ptr)) {
+        size_t size            = malloc_usable_size(ptr);
+        benchmark_heap.current = (benchmark_heap.current > size) ? (benchmark_heap.current - size) : 0;
+    }
+}
+
+void *
+__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    benchmark_heap_alloc(ptr);
+    return ptr;
+}
+
+void *
+__wrap_calloc(size_t nmemb, size_t size) {
+    void *ptr = __real_calloc(nmemb, size);
+    benchmark_heap_alloc(ptr);
+    return ptr;
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size) {
+    benchmark_heap_free(ptr);
+    void *tmp = __real_realloc(ptr, size);
+    benchmark_heap_alloc((NULL != tmp) ? tmp : ptr);
+    return tmp;
+}
+
+void
+__wrap_free(void *ptr) {
+    benchmark_heap_free(ptr);
+    __real_free(ptr);
+}
+
+char *
+__wrap_strdup(const char *s) {
+    size_t length = strlen(s) + 1;
+    char  *tmp    = __wrap_malloc(length);
+    if (NULL != tmp) {
+        memcpy(tmp, s, length);
+    }
+    return tmp;
+}
+
+/**
+ * @brief Artifact type callback, only counts the invocations and the data received
+ * @param type Type from header-info payloads
+ * @param meta_data Meta-data from header tarball
+ * @param filename Artifact filename
+ * @param size Artifact file size
+ * @param data Artifact data
+ * @param index Artifact data index
+ * @param length Artifact data length
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_artifact_callback(char *type, mender_meta_data_t *meta_data, char *filename, size_t size, void *data, size_t index, size_t length) {
+
+    (void)type;
+    (void)meta_data;
+    (void)filename;
+    (void)size;
+    (void)data;
+    (void)index;
+
+    /* Count invocations and data */
+    benchmark_callback.calls++;
+    benchmark_callback.length += length;
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Read artifact file
+ * @param path Path of the artifact
+ * @param length Length of the artifact
+ * @return Content of the artifact if the function succeeds, NULL otherwise
+ */
+static uint8_t *
+benchmark_read_artifact(char *path, size_t *length) {
+
+    assert(NULL != path);
+    assert(NULL != length);
+    FILE    *f;
+    uint8_t *data = NULL;
+    long     size;
+
+    /* Read the whole file, the benchmark must not depend on the file system */
+    if (NULL == (f = fopen(path, "rb"))) {
+        printf("Unable to open '%s'\n", path);
+        return NULL;
+    }
+    if ((0 != fseek(f, 0, SEEK_END)) || ((size = ftell(f)) <= 0) || (0 != fseek(f, 0, SEEK_SET))) {
+        printf("Unable to get size of '%s'\n", path);
+        goto END;
+    }
+    if (NULL == (data = (uint8_t *)malloc((size_t)size))) {
+        printf("Unable to allocate memory\n");
+        goto END;
+    }
+    if ((size_t)size != fread(data, 1, (size_t)size, f)) {
+        printf("Unable to read '%s'\n", path);
+        free(data);
+        data = NULL;
+        goto END;
+    }
+    *length = (size_t)size;
+
+END:
+
+    fclose(f);
+
+    return data;
+}
+
+/**
+ * @brief Parse an artifact fragment by fragment and print statistics
+ * @param path Path of the artifact
+ * @param data Content of the artifact
+ * @param length Length of the artifact
+ * @param fragment_size Size of the fragments given to the parser, mimics the receive buffer of the HTTP clients
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_parse_artifact(char *path, uint8_t *data, size_t length, size_t fragment_size) {
+
+    assert(NULL != path);
+    assert(NULL != data);
+    mender_artifact_ctx_t *ctx;
+    struct timespec        begin, end;
+    mender_err_t           ret = MENDER_OK;
+
+    /* Reset statistics */
+    memset(&benchmark_callback, 0, sizeof(benchmark_callback));
+    memset(&benchmark_heap, 0, sizeof(benchmark_heap));
+    benchmark_heap.enabled = true;
+
+    /* Parse the artifact */
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    if (NULL == (ctx = mender_artifact_create_ctx())) {
+        printf("Unable to create artifact context\n");
+        benchmark_heap.enabled = false;
+        return MENDER_FAIL;
+    }
+    for (size_t index = 0; (MENDER_OK == ret) && (index < length); index += fragment_size) {
+        size_t fragment_length = ((length - index) > fragment_size) ? fragment_size : (length - index);
+        ret                    = mender_artifact_process_data(ctx, data + index, fragment_length, benchmark_artifact_callback);
+    }
+    mender_artifact_release_ctx(ctx);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    benchmark_heap.enabled = false;
+
+    /* Print statistics */
+    if (MENDER_OK != ret) {
+        printf("Unable to parse '%s' with fragment size %zu\n", path, fragment_size);
+        return ret;
+    }
+    double duration = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+    printf("%-40s %12zu %10zu %10.2f %10zu %12zu %12zu %10zu\n",
+           path,
+           length,
+           fragment_size,
+           (duration > 0) ? ((double)length / duration / 1e6) : 0.0,
+           benchmark_callback.calls,
+           benchmark_callback.length,
+           benchmark_heap.peak,
+           benchmark_heap.allocations);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Print usage
+ * @param argv0 Name of the binary (first argument)
+ */
+static void
+print_usage(const char *argv0) {
+    printf("usage: %s [options] artifact...\n", (strrchr(argv0, '/') ? strrchr(argv0, '/') + 1 : argv0));
+    printf("\t--help, -h: Print this help\n");
+    printf("\t--fragment_size, -f: Size of the fragments given to the parser, can be repeated (default 512 and 16384)\n");
+    printf("\t--repeat, -r: Number of times each artifact is parsed (default 1)\n");
+    printf("Artifacts are generated beforehand, for example with 'mender-artifact write module-image'\n");
+    printf("Configure with -DCONFIG_MENDER_LOG_LEVEL=warning to keep the output readable\n");
+}
+
+/**
+ * @brief Main function
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return EXIT_SUCCESS if the program succeeds, EXIT_FAILURE otherwise
+ */
+int
+main(int argc, char **argv) {
+
+    int    ret = EXIT_SUCCESS;
+    size_t fragment_sizes[BENCHMARK_FRAGMENT_SIZES_MAX];
+    size_t fragment_sizes_count = 0;
+    long   repeat               = 1;
+
+    /* Parse options */
+    int opt;
+    while (-1 != (opt = getopt_long(argc, argv, "hf:r:", benchmark_options, NULL))) {
+        switch (opt) {
+            case 'h':
+                /* Help */
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+            case 'f':
+                /* Fragment size */
+                if ((fragment_sizes_count >= BENCHMARK_FRAGMENT_SIZES_MAX) || (0 == (fragment_sizes[fragment_sizes_count++] = strtoul(optarg, NULL, 0)))) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+                /* Repeat */
+                if ((repeat = strtol(optarg, NULL, 0)) <= 0) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                /* Unknown option */
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        printf("Missing artifact\n");
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (0 == fragment_sizes_count) {
+        fragment_sizes_count = sizeof(benchmark_default_fragment_sizes) / sizeof(benchmark_default_fragment_sizes[0]);
+        memcpy(fragment_sizes, benchmark_default_fragment_sizes, sizeof(benchmark_default_fragment_sizes));
+    }
+
+    /* Initialize log */
+    mender_log_init();
+
+    /* Parse artifacts */
+    printf("%-40s %12s %10s %10s %10s %12s %12s %10s\n", "artifact", "size", "fragment", "MB/s", "callbacks", "data", "peak heap", "allocs");
+    for (int index = optind; index < argc; index++) {
+        size_t   length;
+        uint8_t *data;
+        if (NULL == (data = benchmark_read_artifact(argv[index], &length))) {
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        for (size_t i = 0; i < fragment_sizes_count; i++) {
+            for (long r = 0; r < repeat; r++) {
+                if (MENDER_OK != benchmark_parse_artifact(argv[index], data, length, fragment_sizes[i])) {
+                    ret = EXIT_FAILURE;
+                }
+            }
+        }
+        free(data);
+    }
+
+    /* Release log */
+    mender_log_exit();
+
+    return ret;
+}
@@ -0,0 +1,813 @@
+/**
+ * @file      micro.c
+ * @brief     Benchmark application used to measure the time spent by the core utilities and encoders
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <time.h>
+#include "mender-json.h"
+#include "mender-log.h"
+#include "mender-storage.h"
+#include "mender-tls.h"
+#include "mender-utils.h"
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+#include <msgpack.h>
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+
+/**
+ * @brief Maximum number of samples of a benchmark
+ */
+#define BENCHMARK_SAMPLES_MAX (101)
+
+/**
+ * @brief Number of items of the key-stores and key-value lists, a typical inventory
+ */
+#define BENCHMARK_ITEMS_COUNT (8)
+
+/**
+ * @brief Length of the buffer the key-value lists are written to and parsed from in place (bytes)
+ */
+#define BENCHMARK_LIST_BUFFER_LENGTH (512)
+
+/**
+ * @brief Length of the data of the shell messages packed and unpacked (bytes)
+ */
+#define BENCHMARK_SHELL_DATA_LENGTH (256)
+
+/**
+ * @brief Benchmark options
+ */
+static const struct option benchmark_options[] = { { "help", 0, NULL, 'h' },   { "filter", 1, NULL, 'b' }, { "iterations", 1, NULL, 'i' },
+                                                   { "min_time", 1, NULL, 't' }, { "samples", 1, NULL, 'r' }, { "format", 1, NULL, 'o' },
+                                                   { NULL, 0, NULL, 0 } };
+
+/**
+ * @brief Output formats
+ */
+typedef enum {
+    BENCHMARK_FORMAT_TABLE, /**< Human readable table */
+    BENCHMARK_FORMAT_CSV,   /**< CSV, one line per benchmark with a header line */
+    BENCHMARK_FORMAT_JSON   /**< JSON lines, one object per benchmark */
+} benchmark_format_t;
+
+/**
+ * @brief Benchmark
+ */
+typedef struct {
+    const char *name;           /**< Name of the benchmark */
+    mender_err_t (*setup)(void); /**< Function invoked before the samples, NULL if not required */
+    mender_err_t (*run)(void);   /**< Function measured, invoked once per iteration */
+    void (*teardown)(void);      /**< Function invoked after the samples, NULL if not required */
+} benchmark_t;
+
+/**
+ * @brief Result of a benchmark
+ */
+typedef struct {
+    size_t iterations; /**< Number of iterations of each sample */
+    size_t samples;    /**< Number of samples */
+    double min;        /**< Fastest sample (nanoseconds per iteration) */
+    double median;     /**< Median sample (nanoseconds per iteration) */
+    double max;        /**< Slowest sample (nanoseconds per iteration) */
+} benchmark_result_t;
+
+/**
+ * @brief Data shared by the benchmarks, prepared by the setup functions
+ */
+static struct {
+    mender_keystore_t       *keystore;                                  /**< Key-store */
+    cJSON                   *json;                                      /**< Key-store as JSON */
+    mender_key_value_list_t *list;                                      /**< Key-value list */
+    char                    *list_string;                               /**< Key-value list as string */
+    char                     list_buffer[BENCHMARK_LIST_BUFFER_LENGTH]; /**< Buffer of the key-value list string */
+    char                    *payload;                                   /**< Authentication request payload */
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+    msgpack_sbuffer sbuffer;                           /**< Shell message packed */
+    msgpack_zone    zone;                              /**< Zone used to unpack the shell message, reused by the iterations */
+    uint8_t         data[BENCHMARK_SHELL_DATA_LENGTH]; /**< Data of the shell message */
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+} benchmark_data;
+
+/**
+ * @brief Sink of the results of the benchmarks, it prevents the compiler from discarding the measured code
+ */
+static volatile size_t benchmark_sink;
+
+/**
+ * @brief Get monotonic time
+ * @return Time (nanoseconds)
+ */
+static uint64_t
+benchmark_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Setup the key-store benchmarks
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_keystore_setup(void) {
+
+    char name[32], value[32];
+
+    /* Create key-store */
+    if (NULL == (benchmark_data.keystore = mender_utils_keystore_new(BENCHMARK_ITEMS_COUNT))) {
+        return MENDER_FAIL;
+    }
+    for (size_t index = 0; index < BENCHMARK_ITEMS_COUNT; index++) {
+        snprintf(name, sizeof(name), "inventory-key-%zu", index);
+        snprintf(value, sizeof(value), "inventory-value-%zu", index);
+        if (MENDER_OK != mender_utils_keystore_set_item(benchmark_data.keystore, index, name, value)) {
+            return MENDER_FAIL;
+        }
+    }
+
+    /* Convert it to JSON */
+    return mender_utils_keystore_to_json(benchmark_data.keystore, &benchmark_data.json);
+}
+
+/**
+ * @brief Teardown the key-store benchmarks
+ */
+static void
+benchmark_keystore_teardown(void) {
+    cJSON_Delete(benchmark_data.json);
+    benchmark_data.json = NULL;
+    mender_utils_keystore_delete(benchmark_data.keystore);
+    benchmark_data.keystore = NULL;
+}
+
+/**
+ * @brief Copy and release a key-store
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_keystore_copy(void) {
+
+    mender_keystore_t *keystore = NULL;
+
+    if (MENDER_OK != mender_utils_keystore_copy(&keystore, benchmark_data.keystore)) {
+        return MENDER_FAIL;
+    }
+    benchmark_sink += mender_utils_keystore_length(keystore);
+    mender_utils_keystore_delete(keystore);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Convert a key-store to JSON
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_keystore_to_json(void) {
+
+    cJSON *json = NULL;
+
+    if (MENDER_OK != mender_utils_keystore_to_json(benchmark_data.keystore, &json)) {
+        return MENDER_FAIL;
+    }
+    benchmark_sink += (size_t)cJSON_GetArraySize(json);
+    cJSON_Delete(json);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Convert JSON to a key-store
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_keystore_from_json(void) {
+
+    mender_keystore_t *keystore = NULL;
+
+    if (MENDER_OK != mender_utils_keystore_from_json(&keystore, benchmark_data.json)) {
+        return MENDER_FAIL;
+    }
+    benchmark_sink += mender_utils_keystore_length(keystore);
+    mender_utils_keystore_delete(keystore);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Create a key-value list of the benchmarks
+ * @param list Key-value list
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_key_value_list_create(mender_key_value_list_t **list) {
+
+    mender_key_value_list_t *item;
+    char                     key[32], value[32];
+
+    /* Create the nodes and append them one after the other, the same way the platform inventory is built */
+    for (size_t index = 0; index < BENCHMARK_ITEMS_COUNT; index++) {
+        item = NULL;
+        snprintf(key, sizeof(key), "inventory-key-%zu", index);
+        snprintf(value, sizeof(value), "inventory-value-%zu", index);
+        if ((MENDER_OK != mender_utils_create_key_value_node(key, value, &item)) || (MENDER_OK != mender_utils_append_list(list, &item))) {
+            mender_utils_free_linked_list(item);
+            return MENDER_FAIL;
+        }
+    }
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Setup the key-value list benchmarks
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_key_value_list_setup(void) {
+
+    if (MENDER_OK != benchmark_key_value_list_create(&benchmark_data.list)) {
+        return MENDER_FAIL;
+    }
+
+    return mender_utils_key_value_list_to_string(benchmark_data.list, &benchmark_data.list_string);
+}
+
+/**
+ * @brief Teardown the key-value list benchmarks
+ */
+static void
+benchmark_key_value_list_teardown(void) {
+    mender_utils_free(benchmark_data.list_string);
+    benchmark_data.list_string = NULL;
+    mender_utils_free_linked_list(benchmark_data.list);
+    benchmark_data.list = NULL;
+}
+
+/**
+ * @brief Create and release a key-value list
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_key_value_list_build(void) {
+
+    mender_key_value_list_t *list = NULL;
+    mender_err_t             ret  = benchmark_key_value_list_create(&list);
+
+    benchmark_sink += (NULL != list) ? 1 : 0;
+    mender_utils_free_linked_list(list);
+
+    return ret;
+}
+
+/**
+ * @brief Convert a key-value list to string
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_key_value_list_to_string(void) {
+
+    char *str = NULL;
+
+    if (MENDER_OK != mender_utils_key_value_list_to_string(benchmark_data.list, &str)) {
+        return MENDER_FAIL;
+    }
+    benchmark_sink += strlen(str);
+    mender_utils_free(str);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Convert a string to key-value list
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_string_to_key_value_list(void) {
+
+    mender_key_value_list_t *list = NULL;
+
+    if (MENDER_OK != mender_utils_string_to_key_value_list(benchmark_data.list_string, &list)) {
+        return MENDER_FAIL;
+    }
+    benchmark_sink += (NULL != list) ? 1 : 0;
+    mender_utils_free_linked_list(list);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Write a key-value list to a preallocated buffer, the length is measured first
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_key_value_list_to_buffer(void) {
+
+    size_t length = mender_utils_key_value_list_to_buffer(benchmark_data.list, NULL, 0);
+
+    if (length >= sizeof(benchmark_data.list_buffer)) {
+        return MENDER_FAIL;
+    }
+    benchmark_sink += mender_utils_key_value_list_to_buffer(benchmark_data.list, benchmark_data.list_buffer, sizeof(benchmark_data.list_buffer));
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Convert a string to key-value list in place, the string is copied to the buffer first because it is modified
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_string_to_key_value_list_in_place(void) {
+
+    mender_key_value_list_t *list   = NULL;
+    size_t                   length = strlen(benchmark_data.list_string);
+
+    if (length >= sizeof(benchmark_data.list_buffer)) {
+        return MENDER_FAIL;
+    }
+    memcpy(benchmark_data.list_buffer, benchmark_data.list_string, length + 1);
+    if (MENDER_OK != mender_utils_string_to_key_value_list_in_place(benchmark_data.list_buffer, &list)) {
+        return MENDER_FAIL;
+    }
+    benchmark_sink += (NULL != list) ? 1 : 0;
+    mender_utils_free(list);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Format a deployment status payload in a static buffer, the same way the API does
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_json_deployment_status(void) {
+
+    char                 payload[256];
+    mender_json_writer_t writer;
+    mender_err_t         ret;
+
+    mender_json_writer_init(&writer, payload, sizeof(payload));
+    mender_json_writer_begin_object(&writer, NULL);
+    mender_json_writer_add_string(&writer, "status", "downloading");
+    mender_json_writer_add_string(&writer, "substate", "Downloading artifact");
+    mender_json_writer_end_object(&writer);
+    ret = mender_json_writer_end(&writer);
+    benchmark_sink += writer.length;
+    mender_json_writer_release(&writer);
+
+    return ret;
+}
+
+/**
+ * @brief Format an inventory payload in a buffer allocated from the heap, the same way the API does
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_json_inventory(void) {
+
+    mender_json_writer_t writer;
+    mender_err_t         ret;
+
+    mender_json_writer_init(&writer, NULL, 0);
+    mender_json_writer_begin_array(&writer, NULL);
+    for (size_t index = 0; index < BENCHMARK_ITEMS_COUNT; index++) {
+        mender_json_writer_begin_object(&writer, NULL);
+        mender_json_writer_add_string(&writer, "name", benchmark_data.keystore[index].name);
+        mender_json_writer_add_string(&writer, "value", benchmark_data.keystore[index].value);
+        mender_json_writer_end_object(&writer);
+    }
+    mender_json_writer_end_array(&writer);
+    ret = mender_json_writer_end(&writer);
+    benchmark_sink += writer.length;
+    mender_json_writer_release(&writer);
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+
+/**
+ * @brief Pack a shell message, same layout as the one sent by the troubleshoot add-on
+ * @param sbuffer Buffer
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_msgpack_pack_shell(msgpack_sbuffer *sbuffer) {
+
+    msgpack_packer packer;
+
+    msgpack_packer_init(&packer, sbuffer, msgpack_sbuffer_write);
+    if ((0 != msgpack_pack_map(&packer, 2)) || (0 != msgpack_pack_str_with_body(&packer, "hdr", 3)) || (0 != msgpack_pack_map(&packer, 4))
+        || (0 != msgpack_pack_str_with_body(&packer, "proto", 5)) || (0 != msgpack_pack_uint16(&packer, 1))
+        || (0 != msgpack_pack_str_with_body(&packer, "typ", 3)) || (0 != msgpack_pack_str_with_body(&packer, "shell", 5))
+        || (0 != msgpack_pack_str_with_body(&packer, "sid", 3)) || (0 != msgpack_pack_str_with_body(&packer, "4c0fdc7b-c1c3-4b8a-9e4f-9d4a5e3a2b1c", 36))
+        || (0 != msgpack_pack_str_with_body(&packer, "props", 5)) || (0 != msgpack_pack_map(&packer, 1))
+        || (0 != msgpack_pack_str_with_body(&packer, "status", 6)) || (0 != msgpack_pack_uint16(&packer, 1))
+        || (0 != msgpack_pack_str_with_body(&packer, "body", 4))
+        || (0 != msgpack_pack_bin_with_body(&packer, benchmark_data.data, sizeof(benchmark_data.data)))) {
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Setup the msgpack benchmarks
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_msgpack_setup(void) {
+
+    memset(benchmark_data.data, 'x', sizeof(benchmark_data.data));
+    msgpack_sbuffer_init(&benchmark_data.sbuffer);
+    if (true != msgpack_zone_init(&benchmark_data.zone, MSGPACK_ZONE_CHUNK_SIZE)) {
+        return MENDER_FAIL;
+    }
+
+    return benchmark_msgpack_pack_shell(&benchmark_data.sbuffer);
+}
+
+/**
+ * @brief Teardown the msgpack benchmarks
+ */
+static void
+benchmark_msgpack_teardown(void) {
+    msgpack_zone_destroy(&benchmark_data.zone);
+    msgpack_sbuffer_destroy(&benchmark_data.sbuffer);
+}
+
+/**
+ * @brief Pack a shell message
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_msgpack_pack(void) {
+
+    msgpack_sbuffer sbuffer;
+    mender_err_t    ret;
+
+    msgpack_sbuffer_init(&sbuffer);
+    ret = benchmark_msgpack_pack_shell(&sbuffer);
+    benchmark_sink += sbuffer.size;
+    msgpack_sbuffer_destroy(&sbuffer);
+
+    return ret;
+}
+
+/**
+ * @brief Unpack a shell message in the zone reused by the iterations, the same way the troubleshoot add-on does
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_msgpack_unpack(void) {
+
+    msgpack_object object;
+
+    if (MSGPACK_UNPACK_SUCCESS != msgpack_unpack(benchmark_data.sbuffer.data, benchmark_data.sbuffer.size, NULL, &benchmark_data.zone, &object)) {
+        return MENDER_FAIL;
+    }
+    benchmark_sink += object.via.map.size;
+    msgpack_zone_clear(&benchmark_data.zone);
+
+    return MENDER_OK;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+
+/**
+ * @brief Setup the TLS benchmarks, the authentication keys are loaded from the storage or generated
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_tls_setup(void) {
+
+    char *public_key = NULL;
+
+    if ((MENDER_OK != mender_storage_init()) || (MENDER_OK != mender_tls_init()) || (MENDER_OK != mender_tls_init_authentication_keys(NULL, false))
+        || (MENDER_OK != mender_tls_get_public_key_pem(&public_key))) {
+        return MENDER_FAIL;
+    }
+
+    /* Format an authentication request payload, it is the payload signed by the client */
+    size_t length = strlen(public_key) + 256;
+    if (NULL == (benchmark_data.payload = (char *)mender_utils_malloc(length))) {
+        mender_utils_free(public_key);
+        return MENDER_FAIL;
+    }
+    snprintf(benchmark_data.payload, length, "{\"id_data\":\"{\\\"mac\\\":\\\"00:11:22:33:44:55\\\"}\",\"pubkey\":\"%s\"}", public_key);
+    mender_utils_free(public_key);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Teardown the TLS benchmarks
+ */
+static void
+benchmark_tls_teardown(void) {
+    mender_utils_free(benchmark_data.payload);
+    benchmark_data.payload = NULL;
+    mender_tls_exit();
+    mender_storage_exit();
+}
+
+/**
+ * @brief Sign an authentication request payload
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_tls_sign(void) {
+
+    char  *signature        = NULL;
+    size_t signature_length = 0;
+
+    if (MENDER_OK != mender_tls_sign_payload(benchmark_data.payload, &signature, &signature_length)) {
+        return MENDER_FAIL;
+    }
+    benchmark_sink += signature_length;
+    mender_utils_free(signature);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Benchmarks
+ */
+static const benchmark_t benchmarks[] = {
+    { "keystore_copy", benchmark_keystore_setup, benchmark_keystore_copy, benchmark_keystore_teardown },
+    { "keystore_to_json", benchmark_keystore_setup, benchmark_keystore_to_json, benchmark_keystore_teardown },
+    { "keystore_from_json", benchmark_keystore_setup, benchmark_keystore_from_json, benchmark_keystore_teardown },
+    { "key_value_list_build", NULL, benchmark_key_value_list_build, NULL },
+    { "key_value_list_to_string", benchmark_key_value_list_setup, benchmark_key_value_list_to_string, benchmark_key_value_list_teardown },
+    { "string_to_key_value_list", benchmark_key_value_list_setup, benchmark_string_to_key_value_list, benchmark_key_value_list_teardown },
+    { "key_value_list_to_buffer", benchmark_key_value_list_setup, benchmark_key_value_list_to_buffer, benchmark_key_value_list_teardown },
+    { "string_to_key_value_list_in_place", benchmark_key_value_list_setup, benchmark_string_to_key_value_list_in_place, benchmark_key_value_list_teardown },
+    { "json_deployment_status", NULL, benchmark_json_deployment_status, NULL },
+    { "json_inventory", benchmark_keystore_setup, benchmark_json_inventory, benchmark_keystore_teardown },
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+    { "msgpack_pack_shell", benchmark_msgpack_setup, benchmark_msgpack_pack, benchmark_msgpack_teardown },
+    { "msgpack_unpack_shell", benchmark_msgpack_setup, benchmark_msgpack_unpack, benchmark_msgpack_teardown },
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+    { "tls_sign", benchmark_tls_setup, benchmark_tls_sign, benchmark_tls_teardown },
+};
+
+/**
+ * @brief Compare two samples
+ * @param a First sample
+ * @param b Second sample
+ * @return Negative, zero or positive value if the first sample is lower, equal or greater than the second one
+ */
+static int
+benchmark_compare(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Run the iterations of a sample
+ * @param benchmark Benchmark
+ * @param iterations Number of iterations
+ * @param elapsed Time elapsed (nanoseconds)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_sample(const benchmark_t *benchmark, size_t iterations, uint64_t *elapsed) {
+
+    uint64_t begin = benchmark_now();
+
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        if (MENDER_OK != benchmark->run()) {
+            return MENDER_FAIL;
+        }
+    }
+    *elapsed = benchmark_now() - begin;
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Run a benchmark, the number of iterations of the samples is calibrated so that a sample lasts at least the minimum time unless it is fixed
+ * @param benchmark Benchmark
+ * @param iterations Number of iterations of each sample, 0 to calibrate it
+ * @param min_time Minimum duration of a sample when the number of iterations is calibrated (milliseconds)
+ * @param samples Number of samples
+ * @param result Result
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_run(const benchmark_t *benchmark, size_t iterations, uint32_t min_time, size_t samples, benchmark_result_t *result) {
+
+    mender_err_t ret = MENDER_OK;
+    double       values[BENCHMARK_SAMPLES_MAX];
+    uint64_t     elapsed;
+
+    /* Setup */
+    if ((NULL != benchmark->setup) && (MENDER_OK != benchmark->setup())) {
+        printf("Unable to setup benchmark '%s'\n", benchmark->name);
+        ret = MENDER_FAIL;
+        goto END;
+    }
+
+    /* Calibrate the number of iterations, the calibration also warms up the caches and the allocator */
+    if (0 == iterations) {
+        iterations = 1;
+        while (true) {
+            if (MENDER_OK != (ret = benchmark_sample(benchmark, iterations, &elapsed))) {
+                goto FAIL;
+            }
+            if (elapsed >= (uint64_t)min_time * 1000000ULL) {
+                break;
+            }
+            iterations *= (elapsed < (uint64_t)min_time * 100000ULL) ? 10 : 2;
+        }
+    } else if (MENDER_OK != (ret = benchmark_sample(benchmark, iterations, &elapsed))) {
+        goto FAIL;
+    }
+
+    /* Run the samples */
+    for (size_t sample = 0; sample < samples; sample++) {
+        if (MENDER_OK != (ret = benchmark_sample(benchmark, iterations, &elapsed))) {
+            goto FAIL;
+        }
+        values[sample] = (double)elapsed / (double)iterations;
+    }
+
+    /* Compute the result, the median is robust to the samples disturbed by the system */
+    qsort(values, samples, sizeof(double), benchmark_compare);
+    result->iterations = iterations;
+    result->samples    = samples;
+    result->min        = values[0];
+    result->median     = (0 != samples % 2) ? values[samples / 2] : (values[samples / 2 - 1] + values[samples / 2]) / 2;
+    result->max        = values[samples - 1];
+
+FAIL:
+
+    /* Teardown */
+    if (MENDER_OK != ret) {
+        printf("Benchmark '%s' failed\n", benchmark->name);
+    }
+    if (NULL != benchmark->teardown) {
+        benchmark->teardown();
+    }
+
+END:
+
+    return ret;
+}
+
+/**
+ * @brief Print the result of a benchmark
+ * @param format Output format
+ * @param name Name of the benchmark
+ * @param result Result
+ */
+static void
+benchmark_print(benchmark_format_t format, const char *name, benchmark_result_t *result) {
+    switch (format) {
+        case BENCHMARK_FORMAT_CSV:
+            printf("%s,%zu,%zu,%.1f,%.1f,%.1f\n", name, result->iterations, result->samples, result->min, result->median, result->max);
+            break;
+        case BENCHMARK_FORMAT_JSON:
+            printf("{\"name\":\"%s\",\"iterations\":%zu,\"samples\":%zu,\"min_ns\":%.1f,\"median_ns\":%.1f,\"max_ns\":%.1f}\n",
+                   name,
+                   result->iterations,
+                   result->samples,
+                   result->min,
+                   result->median,
+                   result->max);
+            break;
+        default:
+            printf("%-28s %12zu %8zu %14.1f %14.1f %14.1f\n", name, result->iterations, result->samples, result->min, result->median, result->max);
+            break;
+    }
+}
+
+/**
+ * @brief Print usage
+ * @param argv0 Name of the binary (first argument)
+ */
+static void
+print_usage(const char *argv0) {
+    printf("usage: %s [options]\n", (strrchr(argv0, '/') ? strrchr(argv0, '/') + 1 : argv0));
+    printf("\t--help, -h: Print this help\n");
+    printf("\t--filter, -b: Run the benchmarks matching the glob pattern only (default all)\n");
+    printf("\t--iterations, -i: Number of iterations of each sample, 0 to calibrate it (default 0)\n");
+    printf("\t--min_time, -t: Minimum duration of a sample when the number of iterations is calibrated in milliseconds (default 100)\n");
+    printf("\t--samples, -r: Number of samples, up to %d (default 5)\n", BENCHMARK_SAMPLES_MAX);
+    printf("\t--format, -o: Output format, table, csv or json (default table)\n");
+    printf("The results are the time per iteration in nanoseconds, the authentication keys are stored in the current directory\n");
+}
+
+/**
+ * @brief Main function
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return EXIT_SUCCESS if the program succeeds, EXIT_FAILURE otherwise
+ */
+int
+main(int argc, char **argv) {
+
+    int                ret        = EXIT_SUCCESS;
+    const char        *filter     = "*";
+    size_t             iterations = 0;
+    uint32_t           min_time   = 100;
+    size_t             samples    = 5;
+    benchmark_format_t format     = BENCHMARK_FORMAT_TABLE;
+    benchmark_result_t result;
+    char              *end;
+
+    /* Parse options */
+    int opt;
+    while (-1 != (opt = getopt_long(argc, argv, "hb:i:t:r:o:", benchmark_options, NULL))) {
+        switch (opt) {
+            case 'h':
+                /* Help */
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+            case 'b':
+                /* Filter */
+                filter = optarg;
+                break;
+            case 'i':
+                /* Iterations */
+                iterations = strtoul(optarg, &end, 0);
+                if ((end == optarg) || ('\0' != *end)) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                /* Minimum time */
+                min_time = (uint32_t)strtoul(optarg, &end, 0);
+                if ((end == optarg) || ('\0' != *end) || (0 == min_time)) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+                /* Samples */
+                samples = strtoul(optarg, &end, 0);
+                if ((end == optarg) || ('\0' != *end) || (0 == samples) || (samples > BENCHMARK_SAMPLES_MAX)) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'o':
+                /* Format */
+                if (!strcmp(optarg, "table")) {
+                    format = BENCHMARK_FORMAT_TABLE;
+                } else if (!strcmp(optarg, "csv")) {
+                    format = BENCHMARK_FORMAT_CSV;
+                } else if (!strcmp(optarg, "json")) {
+                    format = BENCHMARK_FORMAT_JSON;
+                } else {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                /* Unknown option */
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* Print header */
+    if (BENCHMARK_FORMAT_CSV == format) {
+        printf("name,iterations,samples,min_ns,median_ns,max_ns\n");
+    } else if (BENCHMARK_FORMAT_TABLE == format) {
+        printf("%-28s %12s %8s %14s %14s %14s\n", "name", "iterations", "samples", "min (ns)", "median (ns)", "max (ns)");
+    }
+
+    /* Run the benchmarks */
+    for (size_t index = 0; index < sizeof(benchmarks) / sizeof(benchmarks[0]); index++) {
+        if (true != mender_utils_glob_match(filter, benchmarks[index].name)) {
+            continue;
+        }
+        if (MENDER_OK != benchmark_run(&benchmarks[index], iterations, min_time, samples, &result)) {
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        benchmark_print(format, benchmarks[index].name, &result);
+    }
+
+    return ret;
+}
@@ -0,0 +1,546 @@
+/**
+ * @file      ota.c
+ * @brief     Benchmark application used to measure the end-to-end throughput of an update with the client running against a mock Mender server
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include "mender-client.h"
+#include "mender-flash.h"
+#include "mender-log.h"
+#include "mender-storage-cache.h"
+#include "server.h"
+
+/**
+ * @brief Maximum number of values of each swept parameter
+ */
+#define BENCHMARK_SWEEP_MAX (16)
+
+/**
+ * @brief Timeout of an update (seconds)
+ */
+#define BENCHMARK_UPDATE_TIMEOUT (600)
+
+/**
+ * @brief Timeout of the release of the connections once the client has been released (seconds)
+ */
+#define BENCHMARK_RELEASE_TIMEOUT (10)
+
+/**
+ * @brief Default artifact payload sizes (bytes)
+ */
+static const size_t benchmark_default_sizes[] = { 1048576, 16777216 };
+
+/**
+ * @brief Default fragment sizes, Zephyr and ESP-IDF HTTP receive buffer, curl maximum write size
+ */
+static const size_t benchmark_default_fragment_sizes[] = { 512, 16384 };
+
+/**
+ * @brief Benchmark options
+ */
+static const struct option benchmark_options[] = { { "help", 0, NULL, 'h' },    { "size", 1, NULL, 's' },      { "fragment_size", 1, NULL, 'f' },
+                                                   { "latency", 1, NULL, 'l' }, { "bandwidth", 1, NULL, 'b' }, { "writes", 1, NULL, 'w' },
+                                                   { NULL, 0, NULL, 0 } };
+
+/**
+ * @brief Path of the file to which the writes of the simulated flash are appended, NULL if the writes are not saved
+ */
+static const char *benchmark_writes_path = NULL;
+
+/**
+ * @brief Timestamps of the update, set by the client callbacks
+ */
+static struct {
+    struct timespec start;         /**< Client activated */
+    struct timespec authenticated; /**< Client authenticated */
+    struct timespec downloading;   /**< Download started */
+    struct timespec installing;    /**< Download done, installation started */
+    struct timespec restarted;     /**< Installation done, restart requested */
+    bool            authentication;/**< Client authenticated */
+    bool            done;          /**< Update done */
+    bool            failed;        /**< Update failed */
+    pthread_mutex_t mutex;         /**< Mutex used to protect access to the timestamps */
+    pthread_cond_t  cond;          /**< Condition signaled when the update is done */
+} benchmark_update;
+
+/**
+ * @brief Mender client identity
+ */
+static mender_identity_t benchmark_identity = { .name = "mac", .value = "00:11:22:33:44:55" };
+
+/**
+ * @brief Get time elapsed between two timestamps
+ * @param begin Beginning
+ * @param end End
+ * @return Time elapsed (seconds)
+ */
+static double
+benchmark_elapsed(struct timespec *begin, struct timespec *end) {
+    return (double)(end->tv_sec - begin->tv_sec) + (double)(end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Get CPU time of a clock
+ * @param clock Clock, CLOCK_PROCESS_CPUTIME_ID or CLOCK_THREAD_CPUTIME_ID
+ * @return CPU time (seconds)
+ */
+static double
+benchmark_cpu(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Signal the end of the update
+ * @param failed Update failed
+ */
+static void
+benchmark_update_done(bool failed) {
+
+    pthread_mutex_lock(&benchmark_update.mutex);
+    clock_gettime(CLOCK_MONOTONIC, &benchmark_update.restarted);
+    benchmark_update.failed = failed;
+    benchmark_update.done   = true;
+    pthread_cond_signal(&benchmark_update.cond);
+    pthread_mutex_unlock(&benchmark_update.mutex);
+}
+
+/**
+ * @brief Network connnect callback, the mock server is always reachable
+ * @return MENDER_OK
+ */
+static mender_err_t
+network_connect_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Network release callback
+ * @return MENDER_OK
+ */
+static mender_err_t
+network_release_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Authentication success callback, the end of the authentication phase is recorded
+ * @return MENDER_OK
+ */
+static mender_err_t
+authentication_success_cb(void) {
+
+    pthread_mutex_lock(&benchmark_update.mutex);
+    if (false == benchmark_update.authentication) {
+        clock_gettime(CLOCK_MONOTONIC, &benchmark_update.authenticated);
+        benchmark_update.authentication = true;
+    }
+    pthread_mutex_unlock(&benchmark_update.mutex);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Authentication failure callback
+ * @return MENDER_OK
+ */
+static mender_err_t
+authentication_failure_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Deployment status callback, the transitions between the phases are recorded
+ * @param status Deployment status value
+ * @param desc Deployment status description as string
+ * @return MENDER_OK
+ */
+static mender_err_t
+deployment_status_cb(mender_deployment_status_t status, char *desc) {
+
+    (void)desc;
+
+    /* Record the phases */
+    switch (status) {
+        case MENDER_DEPLOYMENT_STATUS_DOWNLOADING:
+            pthread_mutex_lock(&benchmark_update.mutex);
+            clock_gettime(CLOCK_MONOTONIC, &benchmark_update.downloading);
+            pthread_mutex_unlock(&benchmark_update.mutex);
+            break;
+        case MENDER_DEPLOYMENT_STATUS_INSTALLING:
+            pthread_mutex_lock(&benchmark_update.mutex);
+            clock_gettime(CLOCK_MONOTONIC, &benchmark_update.installing);
+            pthread_mutex_unlock(&benchmark_update.mutex);
+            break;
+        case MENDER_DEPLOYMENT_STATUS_FAILURE:
+        case MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED:
+            benchmark_update_done(true);
+            break;
+        default:
+            break;
+    }
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Restart callback, the update is done
+ * @return MENDER_OK
+ */
+static mender_err_t
+restart_cb(void) {
+
+    benchmark_update_done(false);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Get identity callback
+ * @param identity Identity
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+get_identity_cb(mender_identity_t **identity) {
+    if (NULL != identity) {
+        *identity = &benchmark_identity;
+        return MENDER_OK;
+    }
+    return MENDER_FAIL;
+}
+
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+
+/**
+ * @brief Append the writes of the simulated flash to the writes file, one line per write
+ * @param report Report of the simulated flash
+ * @param size Size of the payload of the artifact
+ * @param fragment_size Size of the receive buffer of the HTTP client
+ */
+static void
+benchmark_save_writes(mender_flash_simulation_report_t *report, size_t size, size_t fragment_size) {
+
+    FILE *file;
+
+    /* Append the writes, the file is created with a header line */
+    if (NULL == (file = fopen(benchmark_writes_path, "a"))) {
+        printf("Unable to open file %s\n", benchmark_writes_path);
+        return;
+    }
+    if (0 == ftell(file)) {
+        fprintf(file, "size,fragment,offset,length,aligned\n");
+    }
+    for (size_t index = 0; index < report->count; index++) {
+        fprintf(file, "%zu,%zu,%zu,%zu,%d\n", size, fragment_size, report->writes[index].offset, report->writes[index].length, report->writes[index].aligned);
+    }
+    fclose(file);
+}
+
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+
+/**
+ * @brief Run an update from the activation of the client to the restart request and print statistics
+ * @param artifact Artifact served
+ * @param length Length of the artifact
+ * @param size Size of the payload of the artifact
+ * @param fragment_size Size of the receive buffer of the HTTP client
+ * @param latency Latency added before each response (milliseconds)
+ * @param bandwidth Bandwidth of the responses (bytes per second), 0 if not limited
+ * @param print Print statistics, the first update is used to generate the authentication keys and is not printed
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_run_update(uint8_t *artifact, size_t length, size_t size, size_t fragment_size, uint32_t latency, uint32_t bandwidth, bool print) {
+
+    mender_err_t    ret = MENDER_OK;
+    char            host[64];
+    struct timespec deadline;
+    double          cpu_begin, cpu_end, server_begin, server_end;
+
+    /* Configure the mock server */
+    benchmark_server_set_artifact(artifact, length);
+    benchmark_server_set_shaping(latency, bandwidth);
+    server_begin = benchmark_server_get_cpu();
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+    mender_flash_simulation_reset();
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+
+    /* Reset timestamps */
+    pthread_mutex_lock(&benchmark_update.mutex);
+    benchmark_update.authentication = false;
+    benchmark_update.done           = false;
+    benchmark_update.failed         = false;
+    pthread_mutex_unlock(&benchmark_update.mutex);
+
+    /* Initialize and activate the client */
+    snprintf(host, sizeof(host), "http://127.0.0.1:%u", (unsigned int)benchmark_server_get_port());
+    mender_client_config_t    mender_client_config    = { .artifact_name                = BENCHMARK_RUNNING_ARTIFACT_NAME,
+                                                          .device_type                  = BENCHMARK_DEVICE_TYPE,
+                                                          .host                         = host,
+                                                          .tenant_token                 = NULL,
+                                                          .authentication_poll_interval = 0,
+                                                          .update_poll_interval         = 0,
+                                                          .recommissioning              = false,
+                                                          .http_recv_buf_length         = fragment_size };
+    mender_client_callbacks_t mender_client_callbacks = { .network_connect        = network_connect_cb,
+                                                          .network_release        = network_release_cb,
+                                                          .authentication_success = authentication_success_cb,
+                                                          .authentication_failure = authentication_failure_cb,
+                                                          .deployment_status      = deployment_status_cb,
+                                                          .restart                = restart_cb,
+                                                          .get_identity           = get_identity_cb };
+    cpu_begin                                         = benchmark_cpu(CLOCK_PROCESS_CPUTIME_ID);
+    clock_gettime(CLOCK_MONOTONIC, &benchmark_update.start);
+    if (MENDER_OK != mender_client_init(&mender_client_config, &mender_client_callbacks)) {
+        printf("Unable to initialize mender-client\n");
+        return MENDER_FAIL;
+    }
+    if (MENDER_OK != mender_client_activate()) {
+        printf("Unable to activate mender-client\n");
+        ret = MENDER_FAIL;
+        goto RELEASE;
+    }
+
+    /* Wait for the end of the update */
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += BENCHMARK_UPDATE_TIMEOUT;
+    pthread_mutex_lock(&benchmark_update.mutex);
+    while ((false == benchmark_update.done) && (0 == pthread_cond_timedwait(&benchmark_update.cond, &benchmark_update.mutex, &deadline))) {
+        /* Nothing to do */
+    }
+    if ((false == benchmark_update.done) || (true == benchmark_update.failed)) {
+        printf("Update of %zu bytes with fragment size %zu %s\n", size, fragment_size, (false == benchmark_update.done) ? "timed out" : "failed");
+        ret = MENDER_FAIL;
+    }
+    pthread_mutex_unlock(&benchmark_update.mutex);
+
+    /* Forget the deployment and the pending image, the next update starts from the same state */
+    mender_client_deactivate();
+    mender_storage_cache_delete_deployment_data();
+    mender_flash_confirm_image();
+
+RELEASE:
+
+    /* Release the client and wait for the connections to be closed so that their CPU time is accounted */
+    mender_client_exit();
+    benchmark_server_set_artifact(NULL, 0);
+    benchmark_server_wait_release(BENCHMARK_RELEASE_TIMEOUT);
+    server_end = benchmark_server_get_cpu();
+    cpu_end = benchmark_cpu(CLOCK_PROCESS_CPUTIME_ID);
+
+    /* Print statistics, the CPU time of the mock server is excluded */
+    if ((MENDER_OK == ret) && (true == print)) {
+        double download = benchmark_elapsed(&benchmark_update.downloading, &benchmark_update.installing);
+        printf("%12zu %10zu %8u %10u %8.3f %8.3f %10.3f %8.3f %10.2f %8.3f",
+               size,
+               fragment_size,
+               (unsigned int)latency,
+               (unsigned int)(bandwidth / 1024),
+               benchmark_elapsed(&benchmark_update.start, &benchmark_update.authenticated),
+               benchmark_elapsed(&benchmark_update.authenticated, &benchmark_update.downloading),
+               download,
+               benchmark_elapsed(&benchmark_update.installing, &benchmark_update.restarted),
+               (download > 0) ? ((double)size / download / 1e6) : 0.0,
+               (cpu_end - cpu_begin) - (server_end - server_begin));
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+        /* Print the time on flash and the time on network, the remaining of the download, they overlap when the flash pipeline is used */
+        mender_flash_simulation_report_t report;
+        mender_flash_simulation_get_report(&report);
+        double flash = (double)report.time / 1e6;
+        printf(" %8.3f %8.3f %8zu %9zu", flash, (download > flash) ? (download - flash) : 0.0, report.count, report.unaligned);
+        if (NULL != benchmark_writes_path) {
+            benchmark_save_writes(&report, size, fragment_size);
+        }
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+        printf("\n");
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Parse a list option value
+ * @param values Values of the option
+ * @param count Number of values
+ * @param arg Argument of the option
+ * @param zero Null value allowed
+ * @return true if the value is valid, false otherwise
+ */
+static bool
+benchmark_parse_value(size_t *values, size_t *count, char *arg, bool zero) {
+
+    char *end;
+
+    /* Parse the value, it can't be null unless allowed */
+    if (*count >= BENCHMARK_SWEEP_MAX) {
+        return false;
+    }
+    values[*count] = strtoul(arg, &end, 0);
+    if ((end == arg) || ('\0' != *end) || ((false == zero) && (0 == values[*count]))) {
+        return false;
+    }
+    (*count)++;
+
+    return true;
+}
+
+/**
+ * @brief Print usage
+ * @param argv0 Name of the binary (first argument)
+ */
+static void
+print_usage(const char *argv0) {
+    printf("usage: %s [options]\n", (strrchr(argv0, '/') ? strrchr(argv0, '/') + 1 : argv0));
+    printf("\t--help, -h: Print this help\n");
+    printf("\t--size, -s: Size of the payload of the artifact in bytes, can be repeated (default 1048576 and 16777216)\n");
+    printf("\t--fragment_size, -f: Size of the receive buffer of the HTTP client in bytes, can be repeated (default 512 and 16384)\n");
+    printf("\t--latency, -l: Latency added before each response of the mock server in milliseconds, can be repeated (default 0)\n");
+    printf("\t--bandwidth, -b: Bandwidth of the mock server in KiB/s, 0 if not limited, can be repeated (default 0)\n");
+    printf("\t--writes, -w: File to which the writes of the simulated flash are appended (requires CONFIG_MENDER_FLASH_SIMULATION)\n");
+    printf("The flash and storage files are written to the current directory\n");
+    printf("Configure with -DCONFIG_MENDER_LOG_LEVEL=warning to keep the output readable\n");
+}
+
+/**
+ * @brief Main function
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return EXIT_SUCCESS if the program succeeds, EXIT_FAILURE otherwise
+ */
+int
+main(int argc, char **argv) {
+
+    int    ret = EXIT_SUCCESS;
+    size_t sizes[BENCHMARK_SWEEP_MAX];
+    size_t sizes_count = 0;
+    size_t fragment_sizes[BENCHMARK_SWEEP_MAX];
+    size_t fragment_sizes_count = 0;
+    size_t latencies[BENCHMARK_SWEEP_MAX];
+    size_t latencies_count = 0;
+    size_t bandwidths[BENCHMARK_SWEEP_MAX];
+    size_t bandwidths_count = 0;
+
+    /* Parse options */
+    int opt;
+    while (-1 != (opt = getopt_long(argc, argv, "hs:f:l:b:w:", benchmark_options, NULL))) {
+        bool valid;
+        switch (opt) {
+            case 'h':
+                /* Help */
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+            case 's':
+                /* Size */
+                valid = benchmark_parse_value(sizes, &sizes_count, optarg, false);
+                break;
+            case 'f':
+                /* Fragment size */
+                valid = benchmark_parse_value(fragment_sizes, &fragment_sizes_count, optarg, false);
+                break;
+            case 'l':
+                /* Latency */
+                valid = benchmark_parse_value(latencies, &latencies_count, optarg, true);
+                break;
+            case 'b':
+                /* Bandwidth */
+                valid = benchmark_parse_value(bandwidths, &bandwidths_count, optarg, true);
+                break;
+            case 'w':
+                /* Writes file */
+                benchmark_writes_path = optarg;
+                valid                 = true;
+                break;
+            default:
+                /* Unknown option */
+                valid = false;
+                break;
+        }
+        if (false == valid) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (0 == sizes_count) {
+        sizes_count = sizeof(benchmark_default_sizes) / sizeof(benchmark_default_sizes[0]);
+        memcpy(sizes, benchmark_default_sizes, sizeof(benchmark_default_sizes));
+    }
+    if (0 == fragment_sizes_count) {
+        fragment_sizes_count = sizeof(benchmark_default_fragment_sizes) / sizeof(benchmark_default_fragment_sizes[0]);
+        memcpy(fragment_sizes, benchmark_default_fragment_sizes, sizeof(benchmark_default_fragment_sizes));
+    }
+    if (0 == latencies_count) {
+        latencies[latencies_count++] = 0;
+    }
+    if (0 == bandwidths_count) {
+        bandwidths[bandwidths_count++] = 0;
+    }
+
+    /* Initialize update events */
+    pthread_mutex_init(&benchmark_update.mutex, NULL);
+    pthread_cond_init(&benchmark_update.cond, NULL);
+
+    /* Start the mock server */
+    if (MENDER_OK != benchmark_server_start()) {
+        ret = EXIT_FAILURE;
+        goto END;
+    }
+
+    /* Run the updates, a first update generates the authentication keys so that their generation is not measured */
+    printf("%12s %10s %8s %10s %8s %8s %10s %8s %10s %8s", "size", "fragment", "latency", "bandwidth", "auth", "check", "download", "install", "MB/s", "cpu");
+#ifdef CONFIG_MENDER_FLASH_SIMULATION
+    printf(" %8s %8s %8s %9s", "flash", "network", "writes", "unaligned");
+#endif /* CONFIG_MENDER_FLASH_SIMULATION */
+    printf("\n");
+    for (size_t s = 0; s < sizes_count; s++) {
+        uint8_t *artifact;
+        size_t   length;
+        if (MENDER_OK != benchmark_generate_artifact(sizes[s], &artifact, &length)) {
+            printf("Unable to generate artifact of %zu bytes\n", sizes[s]);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        if (0 == s) {
+            benchmark_run_update(artifact, length, sizes[s], fragment_sizes[0], 0, 0, false);
+        }
+        for (size_t f = 0; f < fragment_sizes_count; f++) {
+            for (size_t l = 0; l < latencies_count; l++) {
+                for (size_t b = 0; b < bandwidths_count; b++) {
+                    if (MENDER_OK != benchmark_run_update(
+                            artifact, length, sizes[s], fragment_sizes[f], (uint32_t)latencies[l], (uint32_t)(bandwidths[b] * 1024), true)) {
+                        ret = EXIT_FAILURE;
+                    }
+                }
+            }
+        }
+        free(artifact);
+    }
+
+    /* Stop the mock server */
+    benchmark_server_stop();
+
+END:
+
+    /* Release update events */
+    pthread_cond_destroy(&benchmark_update.cond);
+    pthread_mutex_destroy(&benchmark_update.mutex);
+
+    return ret;
+}
@@ -0,0 +1,604 @@
+/**
+ * @file      replay.c
+ * @brief     Benchmark application used to replay the fragments of a download recorded on a device, the artifact is served by a mock Mender server
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include "mender-client.h"
+#include "mender-flash.h"
+#include "mender-log.h"
+#include "mender-storage-cache.h"
+#include "server.h"
+
+#ifndef CONFIG_MENDER_API_DOWNLOAD_CAPTURE
+#error "The replay benchmark requires CONFIG_MENDER_API_DOWNLOAD_CAPTURE"
+#endif /* CONFIG_MENDER_API_DOWNLOAD_CAPTURE */
+
+/**
+ * @brief Timeout of an update (seconds)
+ */
+#define BENCHMARK_UPDATE_TIMEOUT (600)
+
+/**
+ * @brief Timeout of the release of the connections once the client has been released (seconds)
+ */
+#define BENCHMARK_RELEASE_TIMEOUT (10)
+
+/**
+ * @brief Default artifact payload size, used when the artifact is generated (bytes)
+ */
+#define BENCHMARK_DEFAULT_SIZE (1048576)
+
+/**
+ * @brief Default fragment size, curl maximum write size (bytes)
+ */
+#define BENCHMARK_DEFAULT_FRAGMENT_SIZE (16384)
+
+/**
+ * @brief Benchmark options
+ */
+static const struct option benchmark_options[] = { { "help", 0, NULL, 'h' },          { "artifact", 1, NULL, 'a' }, { "size", 1, NULL, 's' },
+                                                   { "fragment_size", 1, NULL, 'f' }, { "replay", 1, NULL, 'r' },   { "capture", 1, NULL, 'c' },
+                                                   { "latency", 1, NULL, 'l' },       { "bandwidth", 1, NULL, 'b' }, { NULL, 0, NULL, 0 } };
+
+/**
+ * @brief Timestamps of the update, set by the client callbacks
+ */
+static struct {
+    struct timespec downloading; /**< Download started */
+    struct timespec installing;  /**< Download done, installation started */
+    bool            done;        /**< Update done */
+    bool            failed;      /**< Update failed */
+    pthread_mutex_t mutex;       /**< Mutex used to protect access to the timestamps */
+    pthread_cond_t  cond;        /**< Condition signaled when the update is done */
+} benchmark_update;
+
+/**
+ * @brief Capture of the download, the fragments are appended to the file
+ */
+static struct {
+    FILE  *file;  /**< Capture file, NULL if the download is not captured */
+    size_t count; /**< Number of fragments recorded */
+} benchmark_capture;
+
+/**
+ * @brief Mender client identity
+ */
+static mender_identity_t benchmark_identity = { .name = "mac", .value = "00:11:22:33:44:55" };
+
+/**
+ * @brief Get time elapsed between two timestamps
+ * @param begin Beginning
+ * @param end End
+ * @return Time elapsed (seconds)
+ */
+static double
+benchmark_elapsed(struct timespec *begin, struct timespec *end) {
+    return (double)(end->tv_sec - begin->tv_sec) + (double)(end->tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Signal the end of the update
+ * @param failed Update failed
+ */
+static void
+benchmark_update_done(bool failed) {
+
+    pthread_mutex_lock(&benchmark_update.mutex);
+    benchmark_update.failed = failed;
+    benchmark_update.done   = true;
+    pthread_cond_signal(&benchmark_update.cond);
+    pthread_mutex_unlock(&benchmark_update.mutex);
+}
+
+/**
+ * @brief Network connnect callback, the mock server is always reachable
+ * @return MENDER_OK
+ */
+static mender_err_t
+network_connect_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Network release callback
+ * @return MENDER_OK
+ */
+static mender_err_t
+network_release_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Authentication success callback
+ * @return MENDER_OK
+ */
+static mender_err_t
+authentication_success_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Authentication failure callback
+ * @return MENDER_OK
+ */
+static mender_err_t
+authentication_failure_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Deployment status callback, the beginning and the end of the download are recorded
+ * @param status Deployment status value
+ * @param desc Deployment status description as string
+ * @return MENDER_OK
+ */
+static mender_err_t
+deployment_status_cb(mender_deployment_status_t status, char *desc) {
+
+    (void)desc;
+
+    /* Record the download */
+    switch (status) {
+        case MENDER_DEPLOYMENT_STATUS_DOWNLOADING:
+            pthread_mutex_lock(&benchmark_update.mutex);
+            clock_gettime(CLOCK_MONOTONIC, &benchmark_update.downloading);
+            pthread_mutex_unlock(&benchmark_update.mutex);
+            break;
+        case MENDER_DEPLOYMENT_STATUS_INSTALLING:
+            pthread_mutex_lock(&benchmark_update.mutex);
+            clock_gettime(CLOCK_MONOTONIC, &benchmark_update.installing);
+            pthread_mutex_unlock(&benchmark_update.mutex);
+            break;
+        case MENDER_DEPLOYMENT_STATUS_FAILURE:
+        case MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED:
+            benchmark_update_done(true);
+            break;
+        default:
+            break;
+    }
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Restart callback, the update is done
+ * @return MENDER_OK
+ */
+static mender_err_t
+restart_cb(void) {
+
+    benchmark_update_done(false);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Get identity callback
+ * @param identity Identity
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+get_identity_cb(mender_identity_t **identity) {
+    if (NULL != identity) {
+        *identity = &benchmark_identity;
+        return MENDER_OK;
+    }
+    return MENDER_FAIL;
+}
+
+/**
+ * @brief Download capture callback, the fragment is appended to the capture file
+ * @param fragment Fragment received
+ * @param params Callback parameters
+ */
+static void
+download_capture_cb(mender_api_download_fragment_t *fragment, void *params) {
+
+    (void)params;
+
+    /* Append the fragment, one line per fragment */
+    fprintf(benchmark_capture.file, "%u %zu\n", (unsigned int)fragment->delay, fragment->length);
+    benchmark_capture.count++;
+}
+
+/**
+ * @brief Load a file to memory
+ * @param path Path of the file
+ * @param data Data of the file, to be released with free
+ * @param length Length of the file
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_load_file(const char *path, uint8_t **data, size_t *length) {
+
+    mender_err_t ret = MENDER_FAIL;
+    FILE        *file;
+    long         size;
+
+    /* Read the file at once */
+    if (NULL == (file = fopen(path, "rb"))) {
+        printf("Unable to open file %s\n", path);
+        return MENDER_FAIL;
+    }
+    if ((0 != fseek(file, 0, SEEK_END)) || ((size = ftell(file)) <= 0) || (0 != fseek(file, 0, SEEK_SET))) {
+        printf("Unable to get size of file %s\n", path);
+        goto END;
+    }
+    if (NULL == (*data = (uint8_t *)malloc((size_t)size))) {
+        printf("Unable to allocate memory\n");
+        goto END;
+    }
+    if ((size_t)size != fread(*data, 1, (size_t)size, file)) {
+        printf("Unable to read file %s\n", path);
+        free(*data);
+        *data = NULL;
+        goto END;
+    }
+    *length = (size_t)size;
+    ret     = MENDER_OK;
+
+END:
+
+    fclose(file);
+
+    return ret;
+}
+
+/**
+ * @brief Load the fragments recorded, one line "<delay> <length>" per fragment, the empty lines and the lines beginning with '#' are ignored
+ * @param path Path of the capture file
+ * @param fragments Fragments, to be released with free
+ * @param count Number of fragments
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_load_fragments(const char *path, mender_api_download_fragment_t **fragments, size_t *count) {
+
+    mender_err_t ret      = MENDER_OK;
+    size_t       capacity = 0;
+    size_t       line     = 0;
+    char         buffer[64];
+    FILE        *file;
+
+    /* Parse the lines of the file */
+    if (NULL == (file = fopen(path, "r"))) {
+        printf("Unable to open file %s\n", path);
+        return MENDER_FAIL;
+    }
+    *fragments = NULL;
+    *count     = 0;
+    while (NULL != fgets(buffer, sizeof(buffer), file)) {
+        unsigned int delay;
+        size_t       length;
+        line++;
+        if (('#' == buffer[0]) || ('\n' == buffer[0])) {
+            continue;
+        }
+        if ((2 != sscanf(buffer, "%u %zu", &delay, &length)) || (0 == length)) {
+            printf("Invalid fragment at line %zu of file %s\n", line, path);
+            ret = MENDER_FAIL;
+            break;
+        }
+        if (*count == capacity) {
+            mender_api_download_fragment_t *tmp;
+            capacity = (0 == capacity) ? 1024 : (capacity * 2);
+            if (NULL == (tmp = (mender_api_download_fragment_t *)realloc(*fragments, capacity * sizeof(mender_api_download_fragment_t)))) {
+                printf("Unable to allocate memory\n");
+                ret = MENDER_FAIL;
+                break;
+            }
+            *fragments = tmp;
+        }
+        (*fragments)[*count].delay  = (uint32_t)delay;
+        (*fragments)[*count].length = length;
+        (*count)++;
+    }
+    fclose(file);
+    if ((MENDER_OK == ret) && (0 == *count)) {
+        printf("No fragment in file %s\n", path);
+        ret = MENDER_FAIL;
+    }
+    if (MENDER_OK != ret) {
+        free(*fragments);
+        *fragments = NULL;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Run an update from the activation of the client to the restart request
+ * @param artifact Artifact served
+ * @param length Length of the artifact
+ * @param fragment_size Size of the receive buffer of the HTTP client
+ * @param latency Latency added before each response (milliseconds)
+ * @param bandwidth Bandwidth of the responses (bytes per second), 0 if not limited
+ * @param download Duration of the download (seconds)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+benchmark_run_update(uint8_t *artifact, size_t length, size_t fragment_size, uint32_t latency, uint32_t bandwidth, double *download) {
+
+    mender_err_t    ret = MENDER_OK;
+    char            host[64];
+    struct timespec deadline;
+
+    /* Configure the mock server */
+    benchmark_server_set_artifact(artifact, length);
+    benchmark_server_set_shaping(latency, bandwidth);
+
+    /* Reset timestamps */
+    pthread_mutex_lock(&benchmark_update.mutex);
+    benchmark_update.done   = false;
+    benchmark_update.failed = false;
+    pthread_mutex_unlock(&benchmark_update.mutex);
+
+    /* Initialize and activate the client */
+    snprintf(host, sizeof(host), "http://127.0.0.1:%u", (unsigned int)benchmark_server_get_port());
+    mender_client_config_t    mender_client_config    = { .artifact_name                = BENCHMARK_RUNNING_ARTIFACT_NAME,
+                                                          .device_type                  = BENCHMARK_DEVICE_TYPE,
+                                                          .host                         = host,
+                                                          .tenant_token                 = NULL,
+                                                          .authentication_poll_interval = 0,
+                                                          .update_poll_interval         = 0,
+                                                          .recommissioning              = false,
+                                                          .http_recv_buf_length         = fragment_size };
+    mender_client_callbacks_t mender_client_callbacks = { .network_connect        = network_connect_cb,
+                                                          .network_release        = network_release_cb,
+                                                          .authentication_success = authentication_success_cb,
+                                                          .authentication_failure = authentication_failure_cb,
+                                                          .deployment_status      = deployment_status_cb,
+                                                          .restart                = restart_cb,
+                                                          .get_identity           = get_identity_cb };
+    if (MENDER_OK != mender_client_init(&mender_client_config, &mender_client_callbacks)) {
+        printf("Unable to initialize mender-client\n");
+        return MENDER_FAIL;
+    }
+    if (MENDER_OK != mender_client_activate()) {
+        printf("Unable to activate mender-client\n");
+        ret = MENDER_FAIL;
+        goto RELEASE;
+    }
+
+    /* Wait for the end of the update */
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += BENCHMARK_UPDATE_TIMEOUT;
+    pthread_mutex_lock(&benchmark_update.mutex);
+    while ((false == benchmark_update.done) && (0 == pthread_cond_timedwait(&benchmark_update.cond, &benchmark_update.mutex, &deadline))) {
+        /* Nothing to do */
+    }
+    if ((false == benchmark_update.done) || (true == benchmark_update.failed)) {
+        printf("Update of %zu bytes artifact %s\n", length, (false == benchmark_update.done) ? "timed out" : "failed");
+        ret = MENDER_FAIL;
+    }
+    *download = benchmark_elapsed(&benchmark_update.downloading, &benchmark_update.installing);
+    pthread_mutex_unlock(&benchmark_update.mutex);
+
+    /* Forget the deployment and the pending image, the next update starts from the same state */
+    mender_client_deactivate();
+    mender_storage_cache_delete_deployment_data();
+    mender_flash_confirm_image();
+
+RELEASE:
+
+    /* Release the client and wait for the connections to be closed */
+    mender_client_exit();
+    benchmark_server_set_artifact(NULL, 0);
+    benchmark_server_wait_release(BENCHMARK_RELEASE_TIMEOUT);
+
+    return ret;
+}
+
+/**
+ * @brief Parse an option value
+ * @param value Value of the option
+ * @param arg Argument of the option
+ * @param zero Null value allowed
+ * @return true if the value is valid, false otherwise
+ */
+static bool
+benchmark_parse_value(size_t *value, char *arg, bool zero) {
+
+    char *end;
+
+    /* Parse the value, it can't be null unless allowed */
+    *value = strtoul(arg, &end, 0);
+    if ((end == arg) || ('\0' != *end) || ((false == zero) && (0 == *value))) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Print usage
+ * @param argv0 Name of the binary (first argument)
+ */
+static void
+print_usage(const char *argv0) {
+    printf("usage: %s [options]\n", (strrchr(argv0, '/') ? strrchr(argv0, '/') + 1 : argv0));
+    printf("\t--help, -h: Print this help\n");
+    printf("\t--artifact, -a: Artifact served, its device type must be '%s' (default generated rootfs-image artifact)\n", BENCHMARK_DEVICE_TYPE);
+    printf("\t--size, -s: Size of the payload of the artifact generated in bytes (default %d)\n", BENCHMARK_DEFAULT_SIZE);
+    printf("\t--fragment_size, -f: Size of the receive buffer of the HTTP client in bytes (default %d)\n", BENCHMARK_DEFAULT_FRAGMENT_SIZE);
+    printf("\t--replay, -r: File of the fragments replayed, one line '<delay in milliseconds> <length in bytes>' per fragment\n");
+    printf("\t--capture, -c: File to which the fragments received are written, in the format of the replay file\n");
+    printf("\t--latency, -l: Latency added before each response of the mock server in milliseconds (default 0)\n");
+    printf("\t--bandwidth, -b: Bandwidth of the mock server in KiB/s, 0 if not limited (default 0)\n");
+    printf("The fragments are recorded on a device with mender_client_set_download_capture, a replay without shaping measures the device pattern\n");
+    printf("The flash and storage files are written to the current directory\n");
+    printf("Configure with -DCONFIG_MENDER_LOG_LEVEL=warning to keep the output readable\n");
+}
+
+/**
+ * @brief Main function
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return EXIT_SUCCESS if the program succeeds, EXIT_FAILURE otherwise
+ */
+int
+main(int argc, char **argv) {
+
+    int                             ret           = EXIT_SUCCESS;
+    const char                     *artifact_path = NULL;
+    const char                     *replay_path   = NULL;
+    const char                     *capture_path  = NULL;
+    size_t                          size          = BENCHMARK_DEFAULT_SIZE;
+    size_t                          fragment_size = BENCHMARK_DEFAULT_FRAGMENT_SIZE;
+    size_t                          latency       = 0;
+    size_t                          bandwidth     = 0;
+    uint8_t                        *artifact      = NULL;
+    size_t                          length        = 0;
+    mender_api_download_fragment_t *fragments     = NULL;
+    size_t                          count         = 0;
+    double                          download      = 0;
+
+    /* Parse options */
+    int opt;
+    while (-1 != (opt = getopt_long(argc, argv, "ha:s:f:r:c:l:b:", benchmark_options, NULL))) {
+        bool valid = true;
+        switch (opt) {
+            case 'h':
+                /* Help */
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+            case 'a':
+                /* Artifact file */
+                artifact_path = optarg;
+                break;
+            case 's':
+                /* Size */
+                valid = benchmark_parse_value(&size, optarg, false);
+                break;
+            case 'f':
+                /* Fragment size */
+                valid = benchmark_parse_value(&fragment_size, optarg, false);
+                break;
+            case 'r':
+                /* Replay file */
+                replay_path = optarg;
+                break;
+            case 'c':
+                /* Capture file */
+                capture_path = optarg;
+                break;
+            case 'l':
+                /* Latency */
+                valid = benchmark_parse_value(&latency, optarg, true);
+                break;
+            case 'b':
+                /* Bandwidth */
+                valid = benchmark_parse_value(&bandwidth, optarg, true);
+                break;
+            default:
+                /* Unknown option */
+                valid = false;
+                break;
+        }
+        if (false == valid) {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* Load the artifact, or generate it */
+    if (NULL != artifact_path) {
+        if (MENDER_OK != benchmark_load_file(artifact_path, &artifact, &length)) {
+            return EXIT_FAILURE;
+        }
+    } else if (MENDER_OK != benchmark_generate_artifact(size, &artifact, &length)) {
+        printf("Unable to generate artifact of %zu bytes\n", size);
+        return EXIT_FAILURE;
+    }
+
+    /* Load the fragments replayed */
+    if ((NULL != replay_path) && (MENDER_OK != benchmark_load_fragments(replay_path, &fragments, &count))) {
+        free(artifact);
+        return EXIT_FAILURE;
+    }
+
+    /* Initialize update events */
+    pthread_mutex_init(&benchmark_update.mutex, NULL);
+    pthread_cond_init(&benchmark_update.cond, NULL);
+
+    /* Start the mock server */
+    if (MENDER_OK != benchmark_server_start()) {
+        ret = EXIT_FAILURE;
+        goto END;
+    }
+
+    /* A first update generates the authentication keys so that their generation is not measured, it is neither replayed nor captured */
+    if (MENDER_OK != benchmark_run_update(artifact, length, fragment_size, 0, 0, &download)) {
+        ret = EXIT_FAILURE;
+        goto STOP;
+    }
+
+    /* Set the replay and the capture */
+    if ((NULL != fragments) && (MENDER_OK != mender_client_set_download_replay(fragments, count))) {
+        ret = EXIT_FAILURE;
+        goto STOP;
+    }
+    if (NULL != capture_path) {
+        if (NULL == (benchmark_capture.file = fopen(capture_path, "w"))) {
+            printf("Unable to open file %s\n", capture_path);
+            ret = EXIT_FAILURE;
+            goto STOP;
+        }
+        fprintf(benchmark_capture.file, "# delay (milliseconds) length (bytes)\n");
+        mender_client_set_download_capture(download_capture_cb, NULL);
+    }
+
+    /* Run the update and print statistics */
+    if (MENDER_OK != benchmark_run_update(artifact, length, fragment_size, (uint32_t)latency, (uint32_t)(bandwidth * 1024), &download)) {
+        ret = EXIT_FAILURE;
+    } else {
+        printf("%12s %10s %10s %10s %10s %10s\n", "length", "fragment", "replayed", "captured", "download", "MB/s");
+        printf("%12zu %10zu %10zu %10zu %10.3f %10.2f\n",
+               length,
+               fragment_size,
+               count,
+               benchmark_capture.count,
+               download,
+               (download > 0) ? ((double)length / download / 1e6) : 0.0);
+    }
+
+    /* Stop the replay and the capture */
+    mender_client_set_download_replay(NULL, 0);
+    mender_client_set_download_capture(NULL, NULL);
+    if (NULL != benchmark_capture.file) {
+        fclose(benchmark_capture.file);
+    }
+
+STOP:
+
+    /* Stop the mock server */
+    benchmark_server_stop();
+
+END:
+
+    /* Release memory */
+    pthread_cond_destroy(&benchmark_update.cond);
+    pthread_mutex_destroy(&benchmark_update.mutex);
+    free(fragments);
+    free(artifact);
+
+    return ret;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file      server.h
+ * @brief     Mock Mender server used by the benchmarks, it serves the client on the loopback interface
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "mender-utils.h"
+
+/**
+ * @brief Artifact names and device type, the names differ so that the deployment is never considered as already installed
+ */
+#define BENCHMARK_ARTIFACT_NAME         "benchmark-update"
+#define BENCHMARK_RUNNING_ARTIFACT_NAME "benchmark-base"
+#define BENCHMARK_DEVICE_TYPE           "benchmark"
+
+/**
+ * @brief Requests counted by the mock server
+ */
+typedef enum {
+    BENCHMARK_SERVER_REQUEST_AUTHENTICATION = 0, /**< Authentication request */
+    BENCHMARK_SERVER_REQUEST_DEPLOYMENT,         /**< Next deployment request */
+    BENCHMARK_SERVER_REQUEST_ARTIFACT,           /**< Artifact download */
+    BENCHMARK_SERVER_REQUEST_STATUS,             /**< Deployment status publication */
+    BENCHMARK_SERVER_REQUEST_INVENTORY,          /**< Inventory publication */
+    BENCHMARK_SERVER_REQUEST_CONNECT,            /**< Websocket connection of the troubleshoot add-on */
+    BENCHMARK_SERVER_REQUEST_MESSAGE,            /**< Websocket message received */
+    BENCHMARK_SERVER_REQUEST_OTHER,              /**< Other requests */
+    BENCHMARK_SERVER_REQUEST_COUNT               /**< Number of requests counted, not a request */
+} benchmark_server_request_t;
+
+/**
+ * @brief Generate a rootfs-image artifact with a pseudo-random payload, the tarballs are not compressed
+ * @param size Size of the payload
+ * @param artifact Artifact, to be released with free
+ * @param length Length of the artifact
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t benchmark_generate_artifact(size_t size, uint8_t **artifact, size_t *length);
+
+/**
+ * @brief Start the mock server on the loopback interface, the port is chosen by the system
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t benchmark_server_start(void);
+
+/**
+ * @brief Get the port of the mock server
+ * @return Port
+ */
+uint16_t benchmark_server_get_port(void);
+
+/**
+ * @brief Set the artifact served, a deployment is pending until it is downloaded
+ * @param artifact Artifact, NULL to remove the pending deployment
+ * @param length Length of the artifact
+ */
+void benchmark_server_set_artifact(uint8_t *artifact, size_t length);
+
+/**
+ * @brief Set the shaping of the responses
+ * @param latency Latency added before each response (milliseconds)
+ * @param bandwidth Bandwidth of the responses (bytes per second), 0 if not limited
+ */
+void benchmark_server_set_shaping(uint32_t latency, uint32_t bandwidth);
+
+/**
+ * @brief Get the number of requests received since the mock server has been started
+ * @param request Request
+ * @return Number of requests
+ */
+size_t benchmark_server_get_requests(benchmark_server_request_t request);
+
+/**
+ * @brief Wait for the number of requests received to reach a value
+ * @param request Request
+ * @param count Number of requests
+ * @param timeout Timeout (seconds)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t benchmark_server_wait_requests(benchmark_server_request_t request, size_t count, uint32_t timeout);
+
+/**
+ * @brief Wait for all the connections to be closed
+ * @param timeout Timeout (seconds)
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t benchmark_server_wait_release(uint32_t timeout);
+
+/**
+ * @brief Get the CPU time of the connections closed
+ * @return CPU time (seconds)
+ */
+double benchmark_server_get_cpu(void);
+
+/**
+ * @brief Send a binary message to the websocket connection of the troubleshoot add-on
+ * @param data Data
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+mender_err_t benchmark_server_websocket_send(const void *data, size_t length);
+
+/**
+ * @brief Stop the mock server
+ */
+void benchmark_server_stop(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __SERVER_H__ */
@@ -0,0 +1,1158 @@
+/**
+ * @file      main.c
+ * @brief     Heap regression test, scripted scenarios are run against a mock Mender server and their heap usage is checked against budgets
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <getopt.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include "mender-client.h"
+#include "mender-flash.h"
+#include "mender-inventory.h"
+#include "mender-log.h"
+#include "mender-storage-cache.h"
+#include "mender-troubleshoot.h"
+#include "server.h"
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+#include <curl/curl.h>
+#include <msgpack.h>
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+
+/**
+ * @brief Default path of the budgets
+ */
+#ifndef HEAP_BUDGETS_PATH
+#define HEAP_BUDGETS_PATH "budgets.txt"
+#endif /* HEAP_BUDGETS_PATH */
+
+/**
+ * @brief Timeout of the steps of the scenarios (seconds)
+ */
+#define HEAP_TIMEOUT (60)
+
+/**
+ * @brief Size of the payload of the artifact of the deployment scenario (bytes)
+ */
+#define HEAP_ARTIFACT_SIZE (1048576)
+
+/**
+ * @brief Number of cycles of the inventory and troubleshoot scenarios
+ */
+#define HEAP_CYCLES (10)
+
+/**
+ * @brief Margin applied to the measured values when the budgets are updated (percent)
+ * @note The margin absorbs the variations between the runs, up to 13% on the number of blocks of the troubleshoot scenario depending on the scheduling of
+ * the threads, the retained bytes are saved without margin because a scenario must not leak
+ */
+#define HEAP_BUDGETS_MARGIN (20)
+
+/**
+ * @brief Margin added to the fragmentation measured when the budgets are updated (percentage points)
+ * @note The fragmentation is already a percentage and varies by one point between the runs, a relative margin would not absorb it
+ */
+#define HEAP_BUDGETS_FRAGMENTATION_MARGIN (5)
+
+/**
+ * @brief Heap options
+ */
+static const struct option heap_options[]
+    = { { "help", 0, NULL, 'h' }, { "budgets", 1, NULL, 'b' }, { "scenario", 1, NULL, 's' }, { "update", 0, NULL, 'u' }, { NULL, 0, NULL, 0 } };
+
+/**
+ * @brief Heap usage of a scenario, the values are checked against the budget of the scenario
+ */
+typedef struct {
+    size_t peak;          /**< Peak of the memory allocated by the client (bytes) */
+    size_t allocations;   /**< Number of allocations */
+    size_t blocks;        /**< Peak of the number of blocks allocated by the client */
+    size_t retained;      /**< Memory still allocated by the client once it has been released (bytes) */
+    size_t fragmentation; /**< Memory of the free blocks held in the arena at the end of the scenario (percent of the arena used) */
+} heap_usage_t;
+
+/**
+ * @brief Scenario
+ */
+typedef struct {
+    const char *name;                  /**< Name of the scenario */
+    mender_err_t (*run)(heap_usage_t *); /**< Function running the scenario, MENDER_NOT_IMPLEMENTED if it can't be run on this host */
+} heap_scenario_t;
+
+/**
+ * @brief Size of the arena of the counting allocator (bytes)
+ * @note The client allocations are served from a dedicated arena so that its fragmentation is not mixed with the allocations of libc, curl and mbedtls
+ */
+#define HEAP_ARENA_SIZE (16 * 1024 * 1024)
+
+/**
+ * @brief Alignment of the blocks of the arena (bytes)
+ */
+#define HEAP_ARENA_ALIGN (16)
+
+/**
+ * @brief Block of the arena, the header is followed by the memory of the block
+ */
+typedef struct heap_block_s {
+    size_t               size; /**< Size of the block, header included (bytes) */
+    struct heap_block_s *next; /**< Next free block, sorted by address, only used when the block is free */
+} heap_block_t;
+
+/**
+ * @brief Size of the header of the blocks (bytes)
+ */
+#define HEAP_BLOCK_HEADER ((sizeof(heap_block_t) + HEAP_ARENA_ALIGN - 1) & ~(size_t)(HEAP_ARENA_ALIGN - 1))
+
+/**
+ * @brief Arena of the counting allocator
+ */
+static uint8_t heap_arena[HEAP_ARENA_SIZE] __attribute__((aligned(HEAP_ARENA_ALIGN)));
+
+/**
+ * @brief Counting allocator statistics, updated by the allocator installed in the client
+ */
+static struct {
+    size_t          current;     /**< Memory currently allocated (bytes) */
+    size_t          peak;        /**< Peak of the memory allocated (bytes) */
+    size_t          allocations; /**< Number of allocations */
+    size_t          blocks;      /**< Number of blocks currently allocated */
+    size_t          peak_blocks; /**< Peak of the number of blocks allocated */
+    size_t          top;         /**< Top of the arena, the memory above it has never been allocated or has been given back (bytes) */
+    size_t          released;    /**< Memory of the free blocks below the top of the arena (bytes) */
+    heap_block_t   *free;        /**< Free blocks below the top of the arena, sorted by address */
+    pthread_mutex_t mutex;       /**< Mutex used to protect access to the statistics and to the arena */
+} heap_stats = { .mutex = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * @brief Prototypes of the counting allocator
+ */
+static void *heap_malloc(size_t size);
+static void *heap_realloc(void *ptr, size_t size);
+static void  heap_free(void *ptr);
+
+/**
+ * @brief Counting allocator, installed in the client by mender_client_init
+ */
+static mender_utils_allocator_t heap_allocator = { .malloc_fn = heap_malloc, .realloc_fn = heap_realloc, .free_fn = heap_free };
+
+/**
+ * @brief Events of the client, set by the callbacks
+ */
+static struct {
+    bool            authenticated; /**< Client authenticated */
+    bool            restarted;     /**< Restart requested */
+    bool            failed;        /**< Deployment failed */
+    bool            shell;         /**< Shell session opened */
+    size_t          written;       /**< Number of shell messages received */
+    bool            troubleshoot;  /**< Troubleshoot add-on activated once authenticated */
+    pthread_mutex_t mutex;         /**< Mutex used to protect access to the events */
+    pthread_cond_t  cond;          /**< Condition signaled when an event is set */
+} heap_events = { .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+/**
+ * @brief Mender client identity
+ */
+static mender_identity_t heap_identity = { .name = "mac", .value = "00:11:22:33:44:55" };
+
+/**
+ * @brief Check if memory belongs to the arena, the memory allocated before the counting allocator has been installed does not
+ * @param ptr Pointer to the memory
+ * @return true if the memory belongs to the arena, false otherwise
+ */
+static bool
+heap_arena_owns(void *ptr) {
+    return ((uint8_t *)ptr >= heap_arena) && ((uint8_t *)ptr < heap_arena + HEAP_ARENA_SIZE);
+}
+
+/**
+ * @brief Allocate a block in the arena, the first free block large enough is used, the top of the arena is raised otherwise
+ * @param size Size of the memory (bytes)
+ * @return Block, NULL if the arena is exhausted
+ * @note The mutex of the statistics must be locked by the caller
+ */
+static heap_block_t *
+heap_arena_alloc(size_t size) {
+
+    heap_block_t **link;
+    heap_block_t  *block;
+
+    /* Compute the size of the block */
+    size = HEAP_BLOCK_HEADER + ((size + HEAP_ARENA_ALIGN - 1) & ~(size_t)(HEAP_ARENA_ALIGN - 1));
+
+    /* Search a free block, it is split if the remaining memory can hold another block */
+    for (link = &heap_stats.free; NULL != *link; link = &(*link)->next) {
+        block = *link;
+        if (block->size >= size) {
+            if (block->size - size > HEAP_BLOCK_HEADER) {
+                heap_block_t *remaining = (heap_block_t *)((uint8_t *)block + size);
+                remaining->size         = block->size - size;
+                remaining->next         = block->next;
+                *link                   = remaining;
+                block->size             = size;
+            } else {
+                *link = block->next;
+            }
+            heap_stats.released -= block->size;
+            return block;
+        }
+    }
+
+    /* Raise the top of the arena */
+    if (size > HEAP_ARENA_SIZE - heap_stats.top) {
+        return NULL;
+    }
+    block       = (heap_block_t *)&heap_arena[heap_stats.top];
+    block->size = size;
+    heap_stats.top += size;
+
+    return block;
+}
+
+/**
+ * @brief Release a block of the arena, it is merged with the adjacent free blocks and the top of the arena is lowered if possible
+ * @param block Block
+ * @note The mutex of the statistics must be locked by the caller
+ */
+static void
+heap_arena_free(heap_block_t *block) {
+
+    heap_block_t **link;
+    heap_block_t  *previous = NULL;
+
+    /* Insert the block in the free blocks */
+    for (link = &heap_stats.free; (NULL != *link) && (*link < block); link = &(*link)->next) {
+        previous = *link;
+    }
+    block->next = *link;
+    *link       = block;
+    heap_stats.released += block->size;
+
+    /* Merge with the next and the previous blocks */
+    if ((NULL != block->next) && ((uint8_t *)block + block->size == (uint8_t *)block->next)) {
+        block->size += block->next->size;
+        block->next = block->next->next;
+    }
+    if ((NULL != previous) && ((uint8_t *)previous + previous->size == (uint8_t *)block)) {
+        previous->size += block->size;
+        previous->next = block->next;
+        block          = previous;
+    }
+
+    /* Lower the top of the arena if the block is the last one */
+    if ((uint8_t *)block + block->size == &heap_arena[heap_stats.top]) {
+        for (link = &heap_stats.free; *link != block; link = &(*link)->next) {
+            ;
+        }
+        *link = NULL;
+        heap_stats.top -= block->size;
+        heap_stats.released -= block->size;
+    }
+}
+
+/**
+ * @brief Allocate memory, the block is accounted
+ * @param size Size of the memory (bytes)
+ * @return Pointer to the memory, NULL if an error occurred
+ */
+static void *
+heap_malloc(size_t size) {
+
+    heap_block_t *block;
+
+    pthread_mutex_lock(&heap_stats.mutex);
+    if (NULL != (block = heap_arena_alloc(size))) {
+        heap_stats.allocations++;
+        heap_stats.current += block->size - HEAP_BLOCK_HEADER;
+        heap_stats.blocks++;
+        if (heap_stats.current > heap_stats.peak) {
+            heap_stats.peak = heap_stats.current;
+        }
+        if (heap_stats.blocks > heap_stats.peak_blocks) {
+            heap_stats.peak_blocks = heap_stats.blocks;
+        }
+    }
+    pthread_mutex_unlock(&heap_stats.mutex);
+
+    return (NULL != block) ? (uint8_t *)block + HEAP_BLOCK_HEADER : NULL;
+}
+
+/**
+ * @brief Release memory, the block is accounted
+ * @param ptr Pointer to the memory, the memory which does not belong to the arena is released to libc without being accounted
+ */
+static void
+heap_free(void *ptr) {
+
+    heap_block_t *block = (heap_block_t *)((uint8_t *)ptr - HEAP_BLOCK_HEADER);
+
+    if (NULL == ptr) {
+        return;
+    }
+    if (true != heap_arena_owns(ptr)) {
+        free(ptr);
+        return;
+    }
+    pthread_mutex_lock(&heap_stats.mutex);
+    heap_stats.current -= block->size - HEAP_BLOCK_HEADER;
+    heap_stats.blocks--;
+    heap_arena_free(block);
+    pthread_mutex_unlock(&heap_stats.mutex);
+}
+
+/**
+ * @brief Resize memory, the block is accounted as released and allocated again
+ * @param ptr Pointer to the memory, NULL to allocate it
+ * @param size Size of the memory (bytes)
+ * @return Pointer to the memory, NULL if an error occurred
+ */
+static void *
+heap_realloc(void *ptr, size_t size) {
+
+    void  *tmp;
+    size_t previous;
+
+    /* Release the memory if the new size is null */
+    if (0 == size) {
+        heap_free(ptr);
+        return NULL;
+    }
+
+    /* Allocate a new block and copy the content of the previous one, the block is left unchanged on failure */
+    if (NULL == (tmp = heap_malloc(size))) {
+        return NULL;
+    }
+    if (NULL != ptr) {
+        previous
+            = (true == heap_arena_owns(ptr)) ? (((heap_block_t *)((uint8_t *)ptr - HEAP_BLOCK_HEADER))->size - HEAP_BLOCK_HEADER) : malloc_usable_size(ptr);
+        memcpy(tmp, ptr, (previous < size) ? previous : size);
+        heap_free(ptr);
+    }
+
+    return tmp;
+}
+
+/**
+ * @brief Reset the peaks and the number of allocations at the beginning of a scenario
+ * @param current Memory currently allocated (bytes)
+ */
+static void
+heap_reset(size_t *current) {
+
+    pthread_mutex_lock(&heap_stats.mutex);
+    heap_stats.peak        = heap_stats.current;
+    heap_stats.allocations = 0;
+    heap_stats.peak_blocks = heap_stats.blocks;
+    *current               = heap_stats.current;
+    pthread_mutex_unlock(&heap_stats.mutex);
+}
+
+/**
+ * @brief Retrieve the heap usage at the end of a scenario
+ * @param usage Heap usage, updated with the peaks and the number of allocations
+ */
+static void
+heap_collect(heap_usage_t *usage) {
+
+    pthread_mutex_lock(&heap_stats.mutex);
+    usage->peak        = heap_stats.peak;
+    usage->allocations = heap_stats.allocations;
+    usage->blocks      = heap_stats.peak_blocks;
+    pthread_mutex_unlock(&heap_stats.mutex);
+}
+
+/**
+ * @brief Measure the fragmentation of the arena, the memory of the free blocks below its top relatively to the size used
+ * @return Fragmentation (percent)
+ */
+static size_t
+heap_fragmentation(void) {
+
+    size_t fragmentation;
+
+    pthread_mutex_lock(&heap_stats.mutex);
+    fragmentation = (0 != heap_stats.top) ? (heap_stats.released * 100 / heap_stats.top) : 0;
+    pthread_mutex_unlock(&heap_stats.mutex);
+
+    return fragmentation;
+}
+
+/**
+ * @brief Set an event of the client
+ * @param event Event
+ */
+static void
+heap_event_set(bool *event) {
+
+    pthread_mutex_lock(&heap_events.mutex);
+    *event = true;
+    pthread_cond_broadcast(&heap_events.cond);
+    pthread_mutex_unlock(&heap_events.mutex);
+}
+
+/**
+ * @brief Wait for an event of the client
+ * @param event Event
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+heap_event_wait(bool *event) {
+
+    mender_err_t    ret = MENDER_OK;
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += HEAP_TIMEOUT;
+    pthread_mutex_lock(&heap_events.mutex);
+    while ((false == *event) && (false == heap_events.failed)) {
+        if (0 != pthread_cond_timedwait(&heap_events.cond, &heap_events.mutex, &deadline)) {
+            break;
+        }
+    }
+    if (false == *event) {
+        ret = MENDER_FAIL;
+    }
+    pthread_mutex_unlock(&heap_events.mutex);
+
+    return ret;
+}
+
+/**
+ * @brief Network connnect callback, the mock server is always reachable
+ * @return MENDER_OK
+ */
+static mender_err_t
+network_connect_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Network release callback
+ * @return MENDER_OK
+ */
+static mender_err_t
+network_release_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Authentication success callback
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+authentication_success_cb(void) {
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+    /* Activate troubleshoot add-on, the websocket connection is opened by the healthcheck work */
+    if ((true == heap_events.troubleshoot) && (MENDER_OK != mender_troubleshoot_activate())) {
+        printf("Unable to activate troubleshoot add-on\n");
+        return MENDER_FAIL;
+    }
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+    heap_event_set(&heap_events.authenticated);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Authentication failure callback
+ * @return MENDER_OK
+ */
+static mender_err_t
+authentication_failure_cb(void) {
+    return MENDER_OK;
+}
+
+/**
+ * @brief Deployment status callback
+ * @param status Deployment status value
+ * @param desc Deployment status description as string
+ * @return MENDER_OK
+ */
+static mender_err_t
+deployment_status_cb(mender_deployment_status_t status, char *desc) {
+
+    (void)desc;
+    if ((MENDER_DEPLOYMENT_STATUS_FAILURE == status) || (MENDER_DEPLOYMENT_STATUS_ALREADY_INSTALLED == status)) {
+        heap_event_set(&heap_events.failed);
+    }
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Restart callback
+ * @return MENDER_OK
+ */
+static mender_err_t
+restart_cb(void) {
+
+    heap_event_set(&heap_events.restarted);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Get identity callback
+ * @param identity Identity
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+get_identity_cb(mender_identity_t **identity) {
+    if (NULL != identity) {
+        *identity = &heap_identity;
+        return MENDER_OK;
+    }
+    return MENDER_FAIL;
+}
+
+/**
+ * @brief Get user-provided keys callback, the keys are generated by the client
+ * @param user_provided_key Buffer of user provided key, left unchanged
+ * @param user_provided_key_length Length of buffer of user provided key, left unchanged
+ * @return MENDER_OK
+ */
+static mender_err_t
+get_user_provided_keys_cb(char **user_provided_key, size_t *user_provided_key_length) {
+
+    (void)user_provided_key;
+    (void)user_provided_key_length;
+
+    return MENDER_OK;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+
+/**
+ * @brief Shell begin callback
+ * @param terminal_width Terminal width
+ * @param terminal_height Terminal height
+ * @return MENDER_OK
+ */
+static mender_err_t
+shell_begin_cb(uint16_t terminal_width, uint16_t terminal_height) {
+
+    (void)terminal_width;
+    (void)terminal_height;
+    heap_event_set(&heap_events.shell);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Shell write data callback, the data is echoed back as the shell output
+ * @param data Shell data received
+ * @param length Length of the data
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+shell_write_cb(uint8_t *data, size_t length) {
+
+    mender_err_t ret = mender_troubleshoot_shell_print(data, length);
+
+    pthread_mutex_lock(&heap_events.mutex);
+    heap_events.written++;
+    pthread_cond_broadcast(&heap_events.cond);
+    pthread_mutex_unlock(&heap_events.mutex);
+
+    return ret;
+}
+
+/**
+ * @brief Shell end callback
+ * @return MENDER_OK
+ */
+static mender_err_t
+shell_end_cb(void) {
+
+    pthread_mutex_lock(&heap_events.mutex);
+    heap_events.shell = false;
+    pthread_cond_broadcast(&heap_events.cond);
+    pthread_mutex_unlock(&heap_events.mutex);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Send a shell message to the client, same layout as the messages of the Mender server
+ * @param typ Message type
+ * @param body Body, NULL if none
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+heap_send_shell_message(const char *typ, const char *body) {
+
+    mender_err_t    ret = MENDER_FAIL;
+    msgpack_sbuffer sbuffer;
+    msgpack_packer  packer;
+
+    /* Pack the message */
+    msgpack_sbuffer_init(&sbuffer);
+    msgpack_packer_init(&packer, &sbuffer, msgpack_sbuffer_write);
+    if ((0 != msgpack_pack_map(&packer, (NULL != body) ? 2 : 1)) || (0 != msgpack_pack_str_with_body(&packer, "hdr", 3))
+        || (0 != msgpack_pack_map(&packer, 4)) || (0 != msgpack_pack_str_with_body(&packer, "proto", 5)) || (0 != msgpack_pack_uint16(&packer, 1))
+        || (0 != msgpack_pack_str_with_body(&packer, "typ", 3)) || (0 != msgpack_pack_str_with_body(&packer, typ, strlen(typ)))
+        || (0 != msgpack_pack_str_with_body(&packer, "sid", 3)) || (0 != msgpack_pack_str_with_body(&packer, "heap", 4))
+        || (0 != msgpack_pack_str_with_body(&packer, "props", 5)) || (0 != msgpack_pack_map(&packer, 2))
+        || (0 != msgpack_pack_str_with_body(&packer, "terminal_width", 14)) || (0 != msgpack_pack_uint16(&packer, 80))
+        || (0 != msgpack_pack_str_with_body(&packer, "terminal_height", 15)) || (0 != msgpack_pack_uint16(&packer, 24))) {
+        goto END;
+    }
+    if ((NULL != body)
+        && ((0 != msgpack_pack_str_with_body(&packer, "body", 4)) || (0 != msgpack_pack_bin_with_body(&packer, body, strlen(body))))) {
+        goto END;
+    }
+
+    /* Send the message */
+    ret = benchmark_server_websocket_send(sbuffer.data, sbuffer.size);
+
+END:
+
+    /* Release memory */
+    msgpack_sbuffer_destroy(&sbuffer);
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+
+/**
+ * @brief Initialize and activate the client, the add-ons are registered on request
+ * @param inventory Register the inventory add-on
+ * @param troubleshoot Register the troubleshoot add-on
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+heap_client_start(bool inventory, bool troubleshoot) {
+
+    char host[64];
+
+    /* Reset events */
+    pthread_mutex_lock(&heap_events.mutex);
+    heap_events.authenticated = false;
+    heap_events.restarted     = false;
+    heap_events.failed        = false;
+    heap_events.shell         = false;
+    heap_events.written       = 0;
+    heap_events.troubleshoot  = troubleshoot;
+    pthread_mutex_unlock(&heap_events.mutex);
+
+    /* Initialize the client */
+    snprintf(host, sizeof(host), "http://127.0.0.1:%u", (unsigned int)benchmark_server_get_port());
+    mender_client_config_t    mender_client_config    = { .artifact_name                = BENCHMARK_RUNNING_ARTIFACT_NAME,
+                                                          .device_type                  = BENCHMARK_DEVICE_TYPE,
+                                                          .host                         = host,
+                                                          .tenant_token                 = NULL,
+                                                          .authentication_poll_interval = 0,
+                                                          .update_poll_interval         = 0,
+                                                          .recommissioning              = false,
+                                                          .allocator                    = &heap_allocator };
+    mender_client_callbacks_t mender_client_callbacks = { .network_connect        = network_connect_cb,
+                                                          .network_release        = network_release_cb,
+                                                          .authentication_success = authentication_success_cb,
+                                                          .authentication_failure = authentication_failure_cb,
+                                                          .deployment_status      = deployment_status_cb,
+                                                          .restart                = restart_cb,
+                                                          .get_identity           = get_identity_cb,
+                                                          .get_user_provided_keys = get_user_provided_keys_cb };
+    if (MENDER_OK != mender_client_init(&mender_client_config, &mender_client_callbacks)) {
+        printf("Unable to initialize mender-client\n");
+        return MENDER_FAIL;
+    }
+
+    /* Register the add-ons */
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY
+    if (true == inventory) {
+        mender_inventory_config_t mender_inventory_config = { .refresh_interval = -1 };
+        if (MENDER_OK != mender_client_register_addon((mender_addon_instance_t *)&mender_inventory_addon_instance, (void *)&mender_inventory_config, NULL)) {
+            printf("Unable to register mender-inventory add-on\n");
+            return MENDER_FAIL;
+        }
+    }
+#else
+    (void)inventory;
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+    if (true == troubleshoot) {
+        mender_troubleshoot_config_t    mender_troubleshoot_config = { .healthcheck_interval = 1 };
+        mender_troubleshoot_callbacks_t mender_troubleshoot_callbacks
+            = { .shell_begin = shell_begin_cb, .shell_resize = NULL, .shell_write = shell_write_cb, .shell_end = shell_end_cb };
+        if (MENDER_OK
+            != mender_client_register_addon(
+                (mender_addon_instance_t *)&mender_troubleshoot_addon_instance, (void *)&mender_troubleshoot_config, (void *)&mender_troubleshoot_callbacks)) {
+            printf("Unable to register mender-troubleshoot add-on\n");
+            return MENDER_FAIL;
+        }
+    }
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+
+    /* Activate the client and wait for the authentication */
+    if (MENDER_OK != mender_client_activate()) {
+        printf("Unable to activate mender-client\n");
+        return MENDER_FAIL;
+    }
+    if (MENDER_OK != heap_event_wait(&heap_events.authenticated)) {
+        printf("Authentication timed out\n");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Release the client, the fragmentation is measured before and the retained memory after
+ * @param current Memory allocated before the client has been initialized (bytes)
+ * @param usage Heap usage
+ */
+static void
+heap_client_stop(size_t current, heap_usage_t *usage) {
+
+    usage->fragmentation = heap_fragmentation();
+    mender_client_deactivate();
+    mender_storage_cache_delete_deployment_data();
+    mender_flash_confirm_image();
+    mender_client_exit();
+    benchmark_server_set_artifact(NULL, 0);
+    benchmark_server_wait_release(HEAP_TIMEOUT);
+    heap_collect(usage);
+    pthread_mutex_lock(&heap_stats.mutex);
+    usage->retained = (heap_stats.current > current) ? (heap_stats.current - current) : 0;
+    pthread_mutex_unlock(&heap_stats.mutex);
+}
+
+/**
+ * @brief Authentication scenario, the client is authenticated and checks for a deployment
+ * @param usage Heap usage
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+heap_scenario_auth(heap_usage_t *usage) {
+
+    mender_err_t ret;
+    size_t       current;
+    size_t       count = benchmark_server_get_requests(BENCHMARK_SERVER_REQUEST_DEPLOYMENT);
+
+    heap_reset(&current);
+    if (MENDER_OK == (ret = heap_client_start(false, false))) {
+        ret = benchmark_server_wait_requests(BENCHMARK_SERVER_REQUEST_DEPLOYMENT, count + 1, HEAP_TIMEOUT);
+    }
+    heap_client_stop(current, usage);
+
+    return ret;
+}
+
+/**
+ * @brief Deployment scenario, an artifact is downloaded and installed until the restart is requested
+ * @param usage Heap usage
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+heap_scenario_deployment(heap_usage_t *usage) {
+
+    mender_err_t ret;
+    size_t       current;
+    uint8_t     *artifact;
+    size_t       length;
+
+    if (MENDER_OK != benchmark_generate_artifact(HEAP_ARTIFACT_SIZE, &artifact, &length)) {
+        printf("Unable to generate artifact\n");
+        return MENDER_FAIL;
+    }
+    benchmark_server_set_artifact(artifact, length);
+    heap_reset(&current);
+    if ((MENDER_OK == (ret = heap_client_start(false, false))) && (MENDER_OK != (ret = heap_event_wait(&heap_events.restarted)))) {
+        printf("Deployment %s\n", (true == heap_events.failed) ? "failed" : "timed out");
+    }
+    heap_client_stop(current, usage);
+    free(artifact);
+
+    return ret;
+}
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY
+
+/**
+ * @brief Inventory scenario, the inventory is published several times
+ * @param usage Heap usage
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+heap_scenario_inventory(heap_usage_t *usage) {
+
+    mender_err_t       ret;
+    size_t             current;
+    mender_keystore_t *inventory = NULL;
+    char               name[32], value[32];
+
+    heap_reset(&current);
+    if (MENDER_OK != (ret = heap_client_start(true, false))) {
+        goto END;
+    }
+
+    /* Build the inventory */
+    if (NULL == (inventory = mender_utils_keystore_new(8))) {
+        ret = MENDER_FAIL;
+        goto END;
+    }
+    for (size_t index = 0; index < 8; index++) {
+        snprintf(name, sizeof(name), "inventory-key-%zu", index);
+        snprintf(value, sizeof(value), "inventory-value-%zu", index);
+        if (MENDER_OK != (ret = mender_utils_keystore_set_item(inventory, index, name, value))) {
+            goto END;
+        }
+    }
+
+    /* Publish the inventory, the first item is changed at each cycle because the add-on skips the publication of an unchanged inventory */
+    for (size_t cycle = 0; (MENDER_OK == ret) && (cycle < HEAP_CYCLES); cycle++) {
+        size_t count = benchmark_server_get_requests(BENCHMARK_SERVER_REQUEST_INVENTORY);
+        snprintf(value, sizeof(value), "inventory-cycle-%zu", cycle);
+        if ((MENDER_OK != (ret = mender_utils_keystore_set_item(inventory, 0, "inventory-key-0", value)))
+            || (MENDER_OK != (ret = mender_inventory_set(inventory)))) {
+            goto END;
+        }
+
+        /* The work is triggered again until the publication is received, a trigger is dropped while the previous publication is still executing */
+        ret = MENDER_FAIL;
+        for (size_t attempt = 0; (MENDER_OK != ret) && (attempt < HEAP_TIMEOUT); attempt++) {
+            if (MENDER_OK != mender_inventory_execute()) {
+                break;
+            }
+            ret = benchmark_server_wait_requests(BENCHMARK_SERVER_REQUEST_INVENTORY, count + 1, 1);
+        }
+    }
+
+END:
+
+    mender_utils_keystore_delete(inventory);
+    heap_client_stop(current, usage);
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
+
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+
+/**
+ * @brief Troubleshoot scenario, a shell session is opened, data is exchanged and the session is closed
+ * @param usage Heap usage
+ * @return MENDER_OK if the function succeeds, MENDER_NOT_IMPLEMENTED if libcurl has no websocket support, error code otherwise
+ */
+static mender_err_t
+heap_scenario_troubleshoot(heap_usage_t *usage) {
+
+    mender_err_t    ret;
+    size_t          current;
+    size_t          count = benchmark_server_get_requests(BENCHMARK_SERVER_REQUEST_CONNECT);
+    struct timespec deadline;
+
+    /* Check websocket support, it is not built in all the distributions of libcurl */
+    curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+    bool                    ws   = false;
+    for (size_t index = 0; (NULL != info->protocols) && (NULL != info->protocols[index]); index++) {
+        ws |= !strcmp(info->protocols[index], "ws");
+    }
+    if (true != ws) {
+        return MENDER_NOT_IMPLEMENTED;
+    }
+
+    heap_reset(&current);
+    if ((MENDER_OK != (ret = heap_client_start(false, true)))
+        || (MENDER_OK != (ret = benchmark_server_wait_requests(BENCHMARK_SERVER_REQUEST_CONNECT, count + 1, HEAP_TIMEOUT)))) {
+        goto END;
+    }
+
+    /* Open the shell session */
+    if ((MENDER_OK != (ret = heap_send_shell_message("new", NULL))) || (MENDER_OK != (ret = heap_event_wait(&heap_events.shell)))) {
+        printf("Shell session not opened\n");
+        goto END;
+    }
+
+    /* Exchange data, the client echoes each message */
+    for (size_t cycle = 0; (MENDER_OK == ret) && (cycle < HEAP_CYCLES); cycle++) {
+        ret = heap_send_shell_message("shell", "ls -la /var/lib/mender\n");
+    }
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += HEAP_TIMEOUT;
+    pthread_mutex_lock(&heap_events.mutex);
+    while ((MENDER_OK == ret) && (heap_events.written < HEAP_CYCLES)) {
+        if (0 != pthread_cond_timedwait(&heap_events.cond, &heap_events.mutex, &deadline)) {
+            printf("Shell data not received\n");
+            ret = MENDER_FAIL;
+        }
+    }
+    pthread_mutex_unlock(&heap_events.mutex);
+
+    /* Close the shell session */
+    if ((MENDER_OK == ret) && (MENDER_OK == (ret = heap_send_shell_message("stop", NULL)))) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += HEAP_TIMEOUT;
+        pthread_mutex_lock(&heap_events.mutex);
+        while ((MENDER_OK == ret) && (true == heap_events.shell)) {
+            if (0 != pthread_cond_timedwait(&heap_events.cond, &heap_events.mutex, &deadline)) {
+                printf("Shell session not closed\n");
+                ret = MENDER_FAIL;
+            }
+        }
+        pthread_mutex_unlock(&heap_events.mutex);
+    }
+
+END:
+
+    heap_client_stop(current, usage);
+
+    return ret;
+}
+
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+
+/**
+ * @brief Scenarios
+ */
+static const heap_scenario_t heap_scenarios[] = {
+    { "auth", heap_scenario_auth },
+    { "deployment", heap_scenario_deployment },
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY
+    { "inventory", heap_scenario_inventory },
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_INVENTORY */
+#ifdef CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT
+    { "troubleshoot", heap_scenario_troubleshoot },
+#endif /* CONFIG_MENDER_CLIENT_ADD_ON_TROUBLESHOOT */
+};
+
+/**
+ * @brief Number of scenarios
+ */
+#define HEAP_SCENARIOS_COUNT (sizeof(heap_scenarios) / sizeof(heap_scenarios[0]))
+
+/**
+ * @brief Load the budgets, each line holds the name of a scenario and its budget, the lines beginning with '#' are comments
+ * @param path Path of the budgets
+ * @param budgets Budgets of the scenarios, the scenarios without budget are left unchanged
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+heap_budgets_load(const char *path, heap_usage_t *budgets) {
+
+    FILE        *file;
+    char         line[256];
+    char         name[64];
+    heap_usage_t budget;
+
+    /* Open the budgets */
+    if (NULL == (file = fopen(path, "r"))) {
+        printf("Unable to open budgets '%s'\n", path);
+        return MENDER_FAIL;
+    }
+
+    /* Parse the lines */
+    while (NULL != fgets(line, sizeof(line), file)) {
+        if (('#' == line[0]) || ('\n' == line[0])) {
+            continue;
+        }
+        if (6
+            != sscanf(line,
+                      "%63s %zu %zu %zu %zu %zu",
+                      name,
+                      &budget.peak,
+                      &budget.allocations,
+                      &budget.blocks,
+                      &budget.retained,
+                      &budget.fragmentation)) {
+            printf("Invalid budget '%s'", line);
+            fclose(file);
+            return MENDER_FAIL;
+        }
+        for (size_t index = 0; index < HEAP_SCENARIOS_COUNT; index++) {
+            if (!strcmp(name, heap_scenarios[index].name)) {
+                budgets[index] = budget;
+            }
+        }
+    }
+    fclose(file);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Save the budgets, the margins are applied to the heap usage measured
+ * @param path Path of the budgets
+ * @param usages Heap usage of the scenarios
+ * @param done Scenarios run, the budgets of the other ones are saved unchanged
+ * @param budgets Budgets of the scenarios
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+heap_budgets_save(const char *path, heap_usage_t *usages, bool *done, heap_usage_t *budgets) {
+
+    FILE *file;
+
+    /* Open the budgets */
+    if (NULL == (file = fopen(path, "w"))) {
+        printf("Unable to open budgets '%s'\n", path);
+        return MENDER_FAIL;
+    }
+
+    /* Write the budgets */
+    fprintf(file, "# Heap budgets of the scenarios of the heap regression test, updated with --update\n");
+    fprintf(file,
+            "# The measured values are increased by a margin of %d%%, the fragmentation by %d points, the retained bytes are saved as measured\n",
+            HEAP_BUDGETS_MARGIN,
+            HEAP_BUDGETS_FRAGMENTATION_MARGIN);
+    fprintf(file, "# scenario peak_bytes allocations peak_blocks retained_bytes fragmentation_percent\n");
+    for (size_t index = 0; index < HEAP_SCENARIOS_COUNT; index++) {
+        heap_usage_t *usage         = (true == done[index]) ? &usages[index] : &budgets[index];
+        size_t        scale         = (true == done[index]) ? (100 + HEAP_BUDGETS_MARGIN) : 100;
+        size_t        fragmentation = usage->fragmentation + ((true == done[index]) ? HEAP_BUDGETS_FRAGMENTATION_MARGIN : 0);
+        fprintf(file,
+                "%s %zu %zu %zu %zu %zu\n",
+                heap_scenarios[index].name,
+                usage->peak * scale / 100,
+                usage->allocations * scale / 100,
+                usage->blocks * scale / 100,
+                usage->retained,
+                (fragmentation > 100) ? 100 : fragmentation);
+    }
+    fclose(file);
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Print usage
+ * @param argv0 Name of the binary (first argument)
+ */
+static void
+print_usage(const char *argv0) {
+    printf("usage: %s [options]\n", (strrchr(argv0, '/') ? strrchr(argv0, '/') + 1 : argv0));
+    printf("\t--help, -h: Print this help\n");
+    printf("\t--budgets, -b: Path of the budgets (default %s)\n", HEAP_BUDGETS_PATH);
+    printf("\t--scenario, -s: Run the scenarios matching the glob pattern only (default all)\n");
+    printf("\t--update, -u: Update the budgets with the heap usage measured instead of checking it\n");
+    printf("The flash and storage files are written to the current directory\n");
+}
+
+/**
+ * @brief Main function
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return EXIT_SUCCESS if the program succeeds, EXIT_FAILURE otherwise
+ */
+int
+main(int argc, char **argv) {
+
+    int          ret    = EXIT_SUCCESS;
+    const char  *path   = HEAP_BUDGETS_PATH;
+    const char  *filter = "*";
+    bool         update = false;
+    heap_usage_t budgets[HEAP_SCENARIOS_COUNT];
+    heap_usage_t usages[HEAP_SCENARIOS_COUNT];
+    bool         done[HEAP_SCENARIOS_COUNT] = { false };
+
+    /* Parse options */
+    int opt;
+    while (-1 != (opt = getopt_long(argc, argv, "hb:s:u", heap_options, NULL))) {
+        switch (opt) {
+            case 'h':
+                /* Help */
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+            case 'b':
+                /* Budgets */
+                path = optarg;
+                break;
+            case 's':
+                /* Scenario */
+                filter = optarg;
+                break;
+            case 'u':
+                /* Update */
+                update = true;
+                break;
+            default:
+                /* Unknown option */
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* Load the budgets, the scenarios without budget are not limited */
+    memset(budgets, 0xFF, sizeof(budgets));
+    if ((false == update) && (MENDER_OK != heap_budgets_load(path, budgets))) {
+        return EXIT_FAILURE;
+    }
+
+    /* Install the counting allocator before any allocation of the client */
+    if (MENDER_OK != mender_utils_set_allocator(&heap_allocator)) {
+        printf("Unable to set allocator\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Start the mock server */
+    if (MENDER_OK != benchmark_server_start()) {
+        return EXIT_FAILURE;
+    }
+
+    /* Run the scenarios, the authentication keys are generated by the first one and kept in the storage */
+    printf("%-14s %12s %12s %8s %10s %6s %s\n", "scenario", "peak", "allocations", "blocks", "retained", "frag", "result");
+    for (size_t index = 0; index < HEAP_SCENARIOS_COUNT; index++) {
+        if (true != mender_utils_glob_match(filter, heap_scenarios[index].name)) {
+            continue;
+        }
+        memset(&usages[index], 0, sizeof(heap_usage_t));
+        mender_err_t result = heap_scenarios[index].run(&usages[index]);
+        if (MENDER_NOT_IMPLEMENTED == result) {
+            printf("%-14s skipped\n", heap_scenarios[index].name);
+            continue;
+        } else if (MENDER_OK != result) {
+            printf("%-14s failed\n", heap_scenarios[index].name);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        done[index]         = true;
+        heap_usage_t *usage = &usages[index];
+        heap_usage_t *limit = &budgets[index];
+        bool          ok    = (true == update)
+                      || ((usage->peak <= limit->peak) && (usage->allocations <= limit->allocations) && (usage->blocks <= limit->blocks)
+                          && (usage->retained <= limit->retained) && (usage->fragmentation <= limit->fragmentation));
+        printf("%-14s %12zu %12zu %8zu %10zu %5zu%% %s\n",
+               heap_scenarios[index].name,
+               usage->peak,
+               usage->allocations,
+               usage->blocks,
+               usage->retained,
+               usage->fragmentation,
+               (true == ok) ? "ok" : "over budget");
+        if (true != ok) {
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    /* Stop the mock server */
+    benchmark_server_stop();
+
+    /* Update the budgets */
+    if ((true == update) && (EXIT_SUCCESS == ret)) {
+        heap_budgets_load(path, budgets);
+        if (MENDER_OK != heap_budgets_save(path, usages, done, budgets)) {
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    return ret;
+}
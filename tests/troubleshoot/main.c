@@ -0,0 +1,958 @@
+/**
+ * @file      main.c
+ * @brief     Troubleshoot tests, the file downloads, the port forward sessions and the outbox are run against a fake send queue which returns MENDER_BUSY when it is full
+ *
+ * Copyright joelguittet and mender-mcu-client contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <msgpack.h>
+#include "mender-api.h"
+#include "mender-client.h"
+#include "mender-log.h"
+#include "mender-scheduler.h"
+#include "mender-troubleshoot.h"
+
+/**
+ * @brief File transfer chunk size and window, the defaults of the troubleshoot add-on
+ */
+#define TEST_CHUNK_SIZE (1024)
+#define TEST_WINDOW     (8)
+
+/**
+ * @brief Room taken in the send queue by a chunk besides its data, as documented for CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_LENGTH (bytes)
+ */
+#define TEST_CHUNK_OVERHEAD (128)
+
+/**
+ * @brief Size of the file downloaded, several windows and a partial chunk at the end (bytes)
+ */
+#define TEST_FILE_SIZE (5 * TEST_WINDOW * TEST_CHUNK_SIZE + 123)
+
+/**
+ * @brief Length of the port forward data, several frames of the port forward buffer (bytes)
+ */
+#define TEST_PORT_FORWARD_LENGTH (2500)
+
+/**
+ * @brief Interval at which the fake send queue is flushed, the default of CONFIG_MENDER_WEBSOCKET_SEND_QUEUE_INTERVAL (milliseconds)
+ */
+#define TEST_FLUSH_INTERVAL (20)
+
+/**
+ * @brief Timeout of the steps of the tests (seconds)
+ */
+#define TEST_TIMEOUT (30)
+
+/**
+ * @brief Duration after which the outbox work of the troubleshoot add-on stops retrying while the send queue is full (milliseconds)
+ */
+#define TEST_OUTBOX_RETRY_TIMEOUT (10000)
+
+/**
+ * @brief Healthcheck interval of the backstop test, the healthcheck work executes the outbox work again (seconds)
+ */
+#define TEST_HEALTHCHECK_INTERVAL (1)
+
+/**
+ * @brief Session and connection IDs
+ */
+#define TEST_SID           "e7ba2ad0-2d1c-4b85-8a2b-3c5f1a0e5a11"
+#define TEST_CONNECTION_ID "7e0a4ad1-5c47-4e6b-9a54-0f4b5e1f3c22"
+
+/**
+ * @brief Message queued, sent by the client or injected by the test
+ */
+typedef struct test_message {
+    uint8_t             *data;   /**< Message */
+    size_t               length; /**< Length of the message */
+    struct test_message *next;   /**< Next message */
+} test_message_t;
+
+/**
+ * @brief Fake connection, the send queue accounts the messages like the websocket send queue of the Zephyr platform and the server flushes it periodically
+ */
+static struct {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    mender_err_t (*callback)(void *, size_t, void *); /**< Data received callback of the troubleshoot add-on */
+    void           *arg;                              /**< Argument of the data received callback */
+#else
+    mender_err_t (*callback)(void *, size_t);         /**< Data received callback of the troubleshoot add-on */
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    bool            connected;                        /**< Connection established */
+    bool            exit;                             /**< Server thread exit request */
+    size_t          capacity;                         /**< Length of the send queue (bytes) */
+    size_t          used;                             /**< Length of the send queue used (bytes) */
+    int32_t         accepted;                         /**< Number of messages accepted before the queue is reported full, negative if not limited */
+    size_t          busy;                             /**< Number of MENDER_BUSY returned */
+    test_message_t *queue;                            /**< Messages sent by the client, waiting to be flushed */
+    test_message_t *inbox;                            /**< Messages injected by the test, delivered to the client by the server thread */
+    pthread_mutex_t mutex;                            /**< Mutex used to protect access to the connection */
+    pthread_cond_t  cond;                             /**< Condition signaled when the server has received messages */
+} test_connection = { .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+/**
+ * @brief Messages received by the server
+ */
+static struct {
+    uint8_t file[TEST_FILE_SIZE];                     /**< Data of the file downloaded */
+    size_t  offset;                                   /**< Offset of the next chunk expected */
+    bool    downloaded;                               /**< End of the file received */
+    size_t  errors;                                   /**< Number of file transfer errors or unexpected chunks received */
+    size_t  opened;                                   /**< Number of port forward sessions acknowledged */
+    size_t  acks;                                     /**< Number of port forward data acknowledged */
+    uint8_t forward[2 * TEST_PORT_FORWARD_LENGTH];    /**< Port forward data */
+    size_t  forwarded;                                /**< Length of the port forward data */
+    char    sequence[64];                             /**< Port forward messages received in order, 'n' new, 'a' ack, 's' stop, 'f' forward */
+} test_server;
+
+/**
+ * @brief Connection and client functions, the references of the troubleshoot add-on are wrapped at link time
+ */
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+mender_err_t __wrap_mender_api_troubleshoot_connect(mender_err_t (*callback)(void *, size_t, void *), void *arg, void **handle);
+#else
+mender_err_t __wrap_mender_api_troubleshoot_connect(mender_err_t (*callback)(void *, size_t), void **handle);
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+mender_err_t __wrap_mender_api_troubleshoot_send_v(void *handle, mender_websocket_segment_t *segments, size_t count);
+mender_err_t __wrap_mender_api_troubleshoot_send(void *handle, void *payload, size_t length);
+mender_err_t __wrap_mender_api_troubleshoot_disconnect(void *handle);
+mender_err_t __wrap_mender_client_network_connect(void);
+mender_err_t __wrap_mender_client_network_release(void);
+mender_err_t __wrap_mender_client_execute(void);
+mender_err_t __wrap_mender_client_publish_deployment_logs(char *id);
+
+/**
+ * @brief Offset of the file read by the client
+ */
+static size_t test_file_offset;
+
+/**
+ * @brief Value of the byte of the file at the offset
+ * @param offset Offset
+ * @return Byte
+ */
+static uint8_t
+test_file_byte(size_t offset) {
+    return (uint8_t)((offset * 31) ^ (offset >> 8));
+}
+
+/**
+ * @brief Append a copy of a message made of several segments to a list
+ * @param list List
+ * @param segments Segments
+ * @param count Number of segments
+ * @return Length of the message
+ */
+static size_t
+test_message_append(test_message_t **list, mender_websocket_segment_t *segments, size_t count) {
+
+    test_message_t *message;
+    size_t          length = 0;
+
+    for (size_t index = 0; index < count; index++) {
+        length += segments[index].length;
+    }
+    message         = (test_message_t *)malloc(sizeof(test_message_t) + length);
+    message->data   = (uint8_t *)(message + 1);
+    message->length = 0;
+    message->next   = NULL;
+    for (size_t index = 0; index < count; index++) {
+        memcpy(&message->data[message->length], segments[index].data, segments[index].length);
+        message->length += segments[index].length;
+    }
+    while (NULL != *list) {
+        list = &(*list)->next;
+    }
+    *list = message;
+
+    return length;
+}
+
+mender_err_t
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+__wrap_mender_api_troubleshoot_connect(mender_err_t (*callback)(void *, size_t, void *), void *arg, void **handle) {
+#else
+__wrap_mender_api_troubleshoot_connect(mender_err_t (*callback)(void *, size_t), void **handle) {
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+
+    pthread_mutex_lock(&test_connection.mutex);
+    test_connection.callback = callback;
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+    test_connection.arg = arg;
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+    test_connection.connected = true;
+    *handle                   = &test_connection;
+    pthread_cond_broadcast(&test_connection.cond);
+    pthread_mutex_unlock(&test_connection.mutex);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+__wrap_mender_api_troubleshoot_send_v(void *handle, mender_websocket_segment_t *segments, size_t count) {
+
+    mender_err_t ret    = MENDER_OK;
+    size_t       length = 0;
+
+    (void)handle;
+    for (size_t index = 0; index < count; index++) {
+        length += segments[index].length;
+    }
+
+    /* Append the message to the send queue, it is preceded by its length */
+    pthread_mutex_lock(&test_connection.mutex);
+    if (sizeof(size_t) + length > test_connection.capacity) {
+        ret = MENDER_FAIL;
+    } else if ((0 == test_connection.accepted) || (test_connection.used + sizeof(size_t) + length > test_connection.capacity)) {
+        test_connection.busy++;
+        ret = MENDER_BUSY;
+    } else {
+        test_connection.used += sizeof(size_t) + test_message_append(&test_connection.queue, segments, count);
+        if (test_connection.accepted > 0) {
+            test_connection.accepted--;
+        }
+    }
+    pthread_mutex_unlock(&test_connection.mutex);
+
+    return ret;
+}
+
+mender_err_t
+__wrap_mender_api_troubleshoot_send(void *handle, void *payload, size_t length) {
+
+    mender_websocket_segment_t segment = { .data = payload, .length = length };
+
+    return __wrap_mender_api_troubleshoot_send_v(handle, &segment, 1);
+}
+
+mender_err_t
+__wrap_mender_api_troubleshoot_disconnect(void *handle) {
+
+    (void)handle;
+    pthread_mutex_lock(&test_connection.mutex);
+    test_connection.connected = false;
+    pthread_mutex_unlock(&test_connection.mutex);
+
+    return MENDER_OK;
+}
+
+mender_err_t
+__wrap_mender_client_network_connect(void) {
+    return MENDER_OK;
+}
+
+mender_err_t
+__wrap_mender_client_network_release(void) {
+    return MENDER_OK;
+}
+
+mender_err_t
+__wrap_mender_client_execute(void) {
+    return MENDER_OK;
+}
+
+mender_err_t
+__wrap_mender_client_publish_deployment_logs(char *id) {
+    (void)id;
+    return MENDER_OK;
+}
+
+/**
+ * @brief File callbacks, the file is generated
+ */
+static mender_err_t
+test_file_open(char *path, bool upload, void **handle) {
+    (void)path;
+    if (true == upload) {
+        return MENDER_FAIL;
+    }
+    test_file_offset = 0;
+    *handle          = &test_file_offset;
+    return MENDER_OK;
+}
+
+static mender_err_t
+test_file_read(void *handle, uint8_t *data, size_t length, size_t *read) {
+    (void)handle;
+    *read = (TEST_FILE_SIZE - test_file_offset < length) ? TEST_FILE_SIZE - test_file_offset : length;
+    for (size_t index = 0; index < *read; index++) {
+        data[index] = test_file_byte(test_file_offset + index);
+    }
+    test_file_offset += *read;
+    return MENDER_OK;
+}
+
+static mender_err_t
+test_file_close(void *handle) {
+    (void)handle;
+    return MENDER_OK;
+}
+
+/**
+ * @brief Port forward callbacks, the local service accepts all the data
+ */
+static mender_err_t
+test_port_forward_connect(char *host, uint16_t port, bool udp, void **handle) {
+    (void)host;
+    (void)port;
+    (void)udp;
+    *handle = &test_server;
+    return MENDER_OK;
+}
+
+static mender_err_t
+test_port_forward_write(void *handle, uint8_t *data, size_t length) {
+    (void)handle;
+    (void)data;
+    (void)length;
+    return MENDER_OK;
+}
+
+static mender_err_t
+test_port_forward_close(void *handle) {
+    (void)handle;
+    return MENDER_OK;
+}
+
+/**
+ * @brief Retrieve a value of a msgpack map
+ * @param object Map
+ * @param key Key
+ * @return Value, NULL if not found
+ */
+static msgpack_object *
+test_map_get(msgpack_object *object, const char *key) {
+
+    if ((NULL == object) || (MSGPACK_OBJECT_MAP != object->type)) {
+        return NULL;
+    }
+    for (msgpack_object_kv *p = object->via.map.ptr; p < object->via.map.ptr + object->via.map.size; ++p) {
+        if ((MSGPACK_OBJECT_STR == p->key.type) && (strlen(key) == p->key.via.str.size) && (!strncmp(p->key.via.str.ptr, key, p->key.via.str.size))) {
+            return &p->val;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Inject a message to be delivered to the client
+ * @param proto Proto type
+ * @param typ Message type
+ * @param offset Offset property, negative if the property is not sent
+ * @param body Body, NULL if the body is not sent
+ * @param length Length of the body
+ */
+static void
+test_inject(uint16_t proto, const char *typ, int64_t offset, const uint8_t *body, size_t length) {
+
+    msgpack_sbuffer sbuffer;
+    msgpack_packer  packer;
+
+    msgpack_sbuffer_init(&sbuffer);
+    msgpack_packer_init(&packer, &sbuffer, msgpack_sbuffer_write);
+    msgpack_pack_map(&packer, (NULL != body) ? 2 : 1);
+    msgpack_pack_str_with_body(&packer, "hdr", strlen("hdr"));
+    msgpack_pack_map(&packer, 4);
+    msgpack_pack_str_with_body(&packer, "proto", strlen("proto"));
+    msgpack_pack_uint16(&packer, proto);
+    msgpack_pack_str_with_body(&packer, "typ", strlen("typ"));
+    msgpack_pack_str_with_body(&packer, typ, strlen(typ));
+    msgpack_pack_str_with_body(&packer, "sid", strlen("sid"));
+    msgpack_pack_str_with_body(&packer, TEST_SID, strlen(TEST_SID));
+    msgpack_pack_str_with_body(&packer, "props", strlen("props"));
+    msgpack_pack_map(&packer, (offset >= 0) ? 2 : 1);
+    msgpack_pack_str_with_body(&packer, "connection_id", strlen("connection_id"));
+    msgpack_pack_str_with_body(&packer, TEST_CONNECTION_ID, strlen(TEST_CONNECTION_ID));
+    if (offset >= 0) {
+        msgpack_pack_str_with_body(&packer, "offset", strlen("offset"));
+        msgpack_pack_int64(&packer, offset);
+    }
+    if (NULL != body) {
+        msgpack_pack_str_with_body(&packer, "body", strlen("body"));
+        msgpack_pack_bin_with_body(&packer, body, length);
+    }
+
+    /* Append the message to the inbox, it is delivered by the server thread so that the client handles one message at a time */
+    mender_websocket_segment_t segment = { .data = sbuffer.data, .length = sbuffer.size };
+    pthread_mutex_lock(&test_connection.mutex);
+    test_message_append(&test_connection.inbox, &segment, 1);
+    pthread_mutex_unlock(&test_connection.mutex);
+    msgpack_sbuffer_destroy(&sbuffer);
+}
+
+/**
+ * @brief Record a port forward message received by the server
+ * @param kind Kind of the message
+ */
+static void
+test_server_record(char kind) {
+
+    size_t length = strlen(test_server.sequence);
+
+    if (length + 1 < sizeof(test_server.sequence)) {
+        test_server.sequence[length] = kind;
+    }
+}
+
+/**
+ * @brief Handle a message sent by the client
+ * @param message Message
+ * @return Offset to be acknowledged if a chunk of the file is received, negative otherwise
+ */
+static int64_t
+test_server_handle(test_message_t *message) {
+
+    msgpack_unpacked unpacked;
+    msgpack_object  *hdr, *typ, *props, *offset, *body;
+    int64_t          ack = -1;
+
+    msgpack_unpacked_init(&unpacked);
+    if (MSGPACK_UNPACK_SUCCESS != msgpack_unpack_next(&unpacked, (const char *)message->data, message->length, NULL)) {
+        test_server.errors++;
+        goto END;
+    }
+    hdr    = test_map_get(&unpacked.data, "hdr");
+    typ    = test_map_get(hdr, "typ");
+    props  = test_map_get(hdr, "props");
+    offset = test_map_get(props, "offset");
+    body   = test_map_get(&unpacked.data, "body");
+    if ((NULL == typ) || (MSGPACK_OBJECT_STR != typ->type)) {
+        test_server.errors++;
+        goto END;
+    }
+
+    if ((strlen("file_chunk") == typ->via.str.size) && (!strncmp(typ->via.str.ptr, "file_chunk", typ->via.str.size))) {
+
+        /* The chunks must be received in order, an empty chunk indicates the end of the file */
+        if ((NULL == offset) || ((size_t)offset->via.i64 != test_server.offset)) {
+            test_server.errors++;
+        } else if ((NULL == body) || (MSGPACK_OBJECT_BIN != body->type) || (0 == body->via.bin.size)) {
+            test_server.downloaded = true;
+        } else if (test_server.offset + body->via.bin.size > TEST_FILE_SIZE) {
+            test_server.errors++;
+        } else {
+            memcpy(&test_server.file[test_server.offset], body->via.bin.ptr, body->via.bin.size);
+            test_server.offset += body->via.bin.size;
+            ack = (int64_t)test_server.offset;
+        }
+
+    } else if ((strlen("error") == typ->via.str.size) && (!strncmp(typ->via.str.ptr, "error", typ->via.str.size))) {
+
+        test_server.errors++;
+
+    } else if ((strlen("new") == typ->via.str.size) && (!strncmp(typ->via.str.ptr, "new", typ->via.str.size))) {
+
+        test_server.opened++;
+        test_server_record('n');
+
+    } else if ((strlen("ack") == typ->via.str.size) && (!strncmp(typ->via.str.ptr, "ack", typ->via.str.size))) {
+
+        test_server.acks++;
+        test_server_record('a');
+
+    } else if ((strlen("stop") == typ->via.str.size) && (!strncmp(typ->via.str.ptr, "stop", typ->via.str.size))) {
+
+        test_server_record('s');
+
+    } else if ((strlen("forward") == typ->via.str.size) && (!strncmp(typ->via.str.ptr, "forward", typ->via.str.size))) {
+
+        if ((NULL == body) || (MSGPACK_OBJECT_BIN != body->type) || (test_server.forwarded + body->via.bin.size > sizeof(test_server.forward))) {
+            test_server.errors++;
+        } else {
+            memcpy(&test_server.forward[test_server.forwarded], body->via.bin.ptr, body->via.bin.size);
+            test_server.forwarded += body->via.bin.size;
+        }
+        test_server_record('f');
+    }
+
+END:
+
+    msgpack_unpacked_destroy(&unpacked);
+
+    return ack;
+}
+
+/**
+ * @brief Server thread, the send queue is flushed and the messages injected are delivered between the flushes like the websocket thread does
+ * @param arg Unused
+ * @return NULL
+ */
+static void *
+test_server_thread(void *arg) {
+
+    test_message_t *queue;
+    test_message_t *inbox;
+    test_message_t *message;
+    int64_t         ack;
+
+    (void)arg;
+    while (true) {
+        usleep(TEST_FLUSH_INTERVAL * 1000);
+
+        /* Flush the send queue */
+        pthread_mutex_lock(&test_connection.mutex);
+        if (true == test_connection.exit) {
+            pthread_mutex_unlock(&test_connection.mutex);
+            break;
+        }
+        queue                 = test_connection.queue;
+        test_connection.queue = NULL;
+        test_connection.used  = 0;
+        ack                   = -1;
+        while (NULL != (message = queue)) {
+            int64_t offset = test_server_handle(message);
+            if (offset >= 0) {
+                ack = offset;
+            }
+            queue = message->next;
+            free(message);
+        }
+        pthread_cond_broadcast(&test_connection.cond);
+        pthread_mutex_unlock(&test_connection.mutex);
+
+        /* Acknowledge the chunks received, then deliver the messages injected */
+        if (ack >= 0) {
+            test_inject(0x0002, "ack", ack, NULL, 0);
+        }
+        pthread_mutex_lock(&test_connection.mutex);
+        inbox                 = test_connection.inbox;
+        test_connection.inbox = NULL;
+        pthread_mutex_unlock(&test_connection.mutex);
+        while (NULL != (message = inbox)) {
+#ifdef CONFIG_MENDER_CLIENT_CONTEXTS
+            if ((NULL != test_connection.callback) && (MENDER_OK != test_connection.callback(message->data, message->length, test_connection.arg))) {
+#else
+            if ((NULL != test_connection.callback) && (MENDER_OK != test_connection.callback(message->data, message->length))) {
+#endif /* CONFIG_MENDER_CLIENT_CONTEXTS */
+                pthread_mutex_lock(&test_connection.mutex);
+                test_server.errors++;
+                pthread_mutex_unlock(&test_connection.mutex);
+            }
+            inbox = message->next;
+            free(message);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Wait for a condition on the server state
+ * @param condition Function checking the condition, invoked with the mutex taken
+ * @return true if the condition is met, false if the timeout is reached
+ */
+static bool
+test_wait(bool (*condition)(void)) {
+
+    struct timespec deadline;
+    bool            met;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += TEST_TIMEOUT;
+    pthread_mutex_lock(&test_connection.mutex);
+    while ((false == (met = condition())) && (0 == pthread_cond_timedwait(&test_connection.cond, &test_connection.mutex, &deadline))) {
+    }
+    pthread_mutex_unlock(&test_connection.mutex);
+
+    return met;
+}
+
+static bool
+test_is_connected(void) {
+    return test_connection.connected;
+}
+
+static bool
+test_is_downloaded(void) {
+    return (true == test_server.downloaded) || (0 != test_server.errors);
+}
+
+static bool
+test_is_opened(void) {
+    return (0 != test_server.opened) || (0 != test_server.errors);
+}
+
+static bool
+test_is_acked(void) {
+    return (0 != test_server.acks) || (0 != test_server.errors);
+}
+
+static bool
+test_is_forwarded(void) {
+    return (test_server.forwarded >= TEST_PORT_FORWARD_LENGTH) || (0 != test_server.errors);
+}
+
+static bool
+test_is_forwarded_twice(void) {
+    return (test_server.forwarded >= 2 * TEST_PORT_FORWARD_LENGTH) || (0 != test_server.errors);
+}
+
+static bool
+test_is_stopped(void) {
+    return (NULL != strchr(test_server.sequence, 's')) || (0 != test_server.errors);
+}
+
+/**
+ * @brief Connect the troubleshoot add-on to the fake server
+ * @param capacity Length of the send queue (bytes)
+ * @param healthcheck_interval Healthcheck interval (seconds), 0 to use the default
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+test_setup(size_t capacity, int32_t healthcheck_interval) {
+
+    mender_troubleshoot_config_t    config    = { .healthcheck_interval = healthcheck_interval, .healthcheck_max_interval = 0 };
+    mender_troubleshoot_callbacks_t callbacks = { .file_open            = test_file_open,
+                                                  .file_read            = test_file_read,
+                                                  .file_close           = test_file_close,
+                                                  .port_forward_connect = test_port_forward_connect,
+                                                  .port_forward_write   = test_port_forward_write,
+                                                  .port_forward_close   = test_port_forward_close };
+
+    memset(&test_server, 0, sizeof(test_server));
+    pthread_mutex_lock(&test_connection.mutex);
+    test_connection.capacity = capacity;
+    test_connection.used     = 0;
+    test_connection.accepted = -1;
+    test_connection.busy     = 0;
+    pthread_mutex_unlock(&test_connection.mutex);
+    if ((MENDER_OK != mender_troubleshoot_init(&config, &callbacks)) || (MENDER_OK != mender_troubleshoot_activate())) {
+        printf("Unable to initialize the troubleshoot add-on\n");
+        return MENDER_FAIL;
+    }
+    if (true != test_wait(test_is_connected)) {
+        printf("Troubleshoot add-on not connected\n");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Disconnect and release the troubleshoot add-on
+ */
+static void
+test_teardown(void) {
+
+    mender_troubleshoot_deactivate();
+    mender_troubleshoot_exit();
+}
+
+/**
+ * @brief Download a file through a send queue of the given length
+ * @param capacity Length of the send queue (bytes)
+ * @param throttled The send queue is expected to be full during the download
+ * @return MENDER_OK if the test succeeds, error code otherwise
+ */
+static mender_err_t
+test_download(size_t capacity, bool throttled) {
+
+    mender_err_t    ret = MENDER_FAIL;
+    msgpack_sbuffer sbuffer;
+    msgpack_packer  packer;
+    size_t          busy;
+
+    if (MENDER_OK != test_setup(capacity, 0)) {
+        goto END;
+    }
+
+    /* Request the file */
+    msgpack_sbuffer_init(&sbuffer);
+    msgpack_packer_init(&packer, &sbuffer, msgpack_sbuffer_write);
+    msgpack_pack_map(&packer, 1);
+    msgpack_pack_str_with_body(&packer, "path", strlen("path"));
+    msgpack_pack_str_with_body(&packer, "/file", strlen("/file"));
+    test_inject(0x0002, "get_file", -1, (uint8_t *)sbuffer.data, sbuffer.size);
+    msgpack_sbuffer_destroy(&sbuffer);
+
+    /* Wait for the end of the file, the chunks must be received once, in order and with the expected data */
+    if (true != test_wait(test_is_downloaded)) {
+        printf("File not downloaded, %zu bytes received\n", test_server.offset);
+        goto END;
+    }
+    if ((0 != test_server.errors) || (TEST_FILE_SIZE != test_server.offset)) {
+        printf("File download failed, %zu errors, %zu bytes received\n", test_server.errors, test_server.offset);
+        goto END;
+    }
+    for (size_t index = 0; index < TEST_FILE_SIZE; index++) {
+        if (test_file_byte(index) != test_server.file[index]) {
+            printf("Unexpected data received at offset %zu\n", index);
+            goto END;
+        }
+    }
+
+    /* A send queue holding a full window never reports MENDER_BUSY, a smaller one throttles the download */
+    pthread_mutex_lock(&test_connection.mutex);
+    busy = test_connection.busy;
+    pthread_mutex_unlock(&test_connection.mutex);
+    if ((true == throttled) ? (0 == busy) : (0 != busy)) {
+        printf("Unexpected send queue full %zu times\n", busy);
+        goto END;
+    }
+    ret = MENDER_OK;
+
+END:
+
+    test_teardown();
+
+    return ret;
+}
+
+/**
+ * @brief Download a file through a send queue holding a full window of chunks, as documented
+ * @return MENDER_OK if the test succeeds, error code otherwise
+ */
+static mender_err_t
+test_download_window(void) {
+    return test_download(TEST_WINDOW * (TEST_CHUNK_SIZE + TEST_CHUNK_OVERHEAD), false);
+}
+
+/**
+ * @brief Download a file through a send queue holding a few chunks, the download is resumed each time the queue is flushed
+ * @return MENDER_OK if the test succeeds, error code otherwise
+ */
+static mender_err_t
+test_download_throttled(void) {
+    return test_download(3 * (TEST_CHUNK_SIZE + TEST_CHUNK_OVERHEAD), true);
+}
+
+/**
+ * @brief Open a port forward session and wait for its acknowledgment
+ * @return MENDER_OK if the function succeeds, error code otherwise
+ */
+static mender_err_t
+test_port_forward_open(void) {
+
+    msgpack_sbuffer sbuffer;
+    msgpack_packer  packer;
+
+    msgpack_sbuffer_init(&sbuffer);
+    msgpack_packer_init(&packer, &sbuffer, msgpack_sbuffer_write);
+    msgpack_pack_map(&packer, 3);
+    msgpack_pack_str_with_body(&packer, "remote_host", strlen("remote_host"));
+    msgpack_pack_str_with_body(&packer, "localhost", strlen("localhost"));
+    msgpack_pack_str_with_body(&packer, "remote_port", strlen("remote_port"));
+    msgpack_pack_uint16(&packer, 22);
+    msgpack_pack_str_with_body(&packer, "protocol", strlen("protocol"));
+    msgpack_pack_str_with_body(&packer, "tcp", strlen("tcp"));
+    test_inject(0x0003, "new", -1, (uint8_t *)sbuffer.data, sbuffer.size);
+    msgpack_sbuffer_destroy(&sbuffer);
+    if ((true != test_wait(test_is_opened)) || (0 != test_server.errors)) {
+        printf("Port forward session not opened\n");
+        return MENDER_FAIL;
+    }
+
+    return MENDER_OK;
+}
+
+/**
+ * @brief Port forward session, the data is sent entirely or not at all and the acknowledgments are not lost while the send queue is full
+ * @return MENDER_OK if the test succeeds, error code otherwise
+ */
+static mender_err_t
+test_port_forward(void) {
+
+    mender_err_t ret = MENDER_FAIL;
+    uint8_t      data[TEST_PORT_FORWARD_LENGTH];
+
+    if (MENDER_OK != test_setup(8192, 0)) {
+        goto END;
+    }
+    for (size_t index = 0; index < sizeof(data); index++) {
+        data[index] = test_file_byte(index);
+    }
+
+    /* Open the session */
+    if (MENDER_OK != test_port_forward_open()) {
+        goto END;
+    }
+
+    /* The send queue is full, none of the data is sent and the acknowledgment of the data received is kept until the queue has room */
+    pthread_mutex_lock(&test_connection.mutex);
+    test_connection.accepted = 0;
+    pthread_mutex_unlock(&test_connection.mutex);
+    if (MENDER_BUSY != mender_troubleshoot_port_forward_send(&test_server, data, sizeof(data))) {
+        printf("Port forward data sent while the send queue is full\n");
+        goto END;
+    }
+    test_inject(0x0003, "forward", -1, data, 16);
+    usleep(10 * TEST_FLUSH_INTERVAL * 1000);
+    pthread_mutex_lock(&test_connection.mutex);
+    test_connection.accepted = -1;
+    pthread_mutex_unlock(&test_connection.mutex);
+    if ((true != test_wait(test_is_acked)) || (0 != test_server.errors) || (0 != test_server.forwarded)) {
+        printf("Port forward acknowledgment lost, %zu bytes received\n", test_server.forwarded);
+        goto END;
+    }
+
+    /* The send queue is full after the first frame, the next frames are kept until the queue has room */
+    pthread_mutex_lock(&test_connection.mutex);
+    test_connection.accepted = 1;
+    pthread_mutex_unlock(&test_connection.mutex);
+    if (MENDER_OK != mender_troubleshoot_port_forward_send(&test_server, data, sizeof(data))) {
+        printf("Unable to send port forward data\n");
+        goto END;
+    }
+    usleep(10 * TEST_FLUSH_INTERVAL * 1000);
+    pthread_mutex_lock(&test_connection.mutex);
+    test_connection.accepted = -1;
+    pthread_mutex_unlock(&test_connection.mutex);
+    if ((true != test_wait(test_is_forwarded)) || (0 != test_server.errors) || (TEST_PORT_FORWARD_LENGTH != test_server.forwarded)) {
+        printf("Port forward data lost, %zu bytes received\n", test_server.forwarded);
+        goto END;
+    }
+
+    /* The data is sent directly once the queue has room */
+    if (MENDER_OK != mender_troubleshoot_port_forward_send(&test_server, data, sizeof(data))) {
+        printf("Unable to send port forward data\n");
+        goto END;
+    }
+    if ((true != test_wait(test_is_forwarded_twice)) || (0 != test_server.errors) || (2 * TEST_PORT_FORWARD_LENGTH != test_server.forwarded)
+        || (0 != memcmp(test_server.forward, data, sizeof(data))) || (0 != memcmp(&test_server.forward[sizeof(data)], data, sizeof(data)))) {
+        printf("Unexpected port forward data received\n");
+        goto END;
+    }
+    ret = MENDER_OK;
+
+END:
+
+    test_teardown();
+
+    return ret;
+}
+
+/**
+ * @brief Keep control messages in the outbox while the send queue is full, then check they are sent in order once the queue has room
+ * @param duration Duration during which the send queue is full (milliseconds)
+ * @param healthcheck_interval Healthcheck interval (seconds), 0 to use the default
+ * @return MENDER_OK if the test succeeds, error code otherwise
+ */
+static mender_err_t
+test_outbox(uint32_t duration, int32_t healthcheck_interval) {
+
+    mender_err_t ret = MENDER_FAIL;
+    uint8_t      data[16];
+
+    if ((MENDER_OK != test_setup(8192, healthcheck_interval)) || (MENDER_OK != test_port_forward_open())) {
+        goto END;
+    }
+    for (size_t index = 0; index < sizeof(data); index++) {
+        data[index] = test_file_byte(index);
+    }
+
+    /* The send queue is full, the acknowledgment of the data received and the response to the stop request are kept in the outbox */
+    pthread_mutex_lock(&test_connection.mutex);
+    test_connection.accepted = 0;
+    pthread_mutex_unlock(&test_connection.mutex);
+    test_inject(0x0003, "forward", -1, data, sizeof(data));
+    test_inject(0x0003, "stop", -1, NULL, 0);
+    usleep(duration * 1000);
+
+    /* The send queue has room, no other message is sent by the client so the outbox must be flushed by the outbox or the healthcheck work */
+    pthread_mutex_lock(&test_connection.mutex);
+    if (0 == test_connection.busy) {
+        pthread_mutex_unlock(&test_connection.mutex);
+        printf("Send queue never reported full\n");
+        goto END;
+    }
+    test_connection.accepted = -1;
+    pthread_mutex_unlock(&test_connection.mutex);
+    if ((true != test_wait(test_is_stopped)) || (0 != test_server.errors) || (0 != strcmp(test_server.sequence, "nas"))) {
+        printf("Outbox not flushed in order, messages received '%s'\n", test_server.sequence);
+        goto END;
+    }
+    ret = MENDER_OK;
+
+END:
+
+    test_teardown();
+
+    return ret;
+}
+
+/**
+ * @brief Outbox retried by the outbox work, the send queue has room again before the work stops retrying
+ * @return MENDER_OK if the test succeeds, error code otherwise
+ */
+static mender_err_t
+test_outbox_retry(void) {
+    return test_outbox(10 * TEST_FLUSH_INTERVAL, 0);
+}
+
+/**
+ * @brief Outbox retried by the healthcheck work, the send queue is full for longer than the outbox work retries
+ * @return MENDER_OK if the test succeeds, error code otherwise
+ */
+static mender_err_t
+test_outbox_backstop(void) {
+    return test_outbox(TEST_OUTBOX_RETRY_TIMEOUT + 1000, TEST_HEALTHCHECK_INTERVAL);
+}
+
+/**
+ * @brief Tests
+ */
+static const struct {
+    const char *name;          /**< Name of the test */
+    mender_err_t (*run)(void); /**< Function running the test */
+} tests[] = { { "download_window", test_download_window },
+              { "download_throttled", test_download_throttled },
+              { "port_forward", test_port_forward },
+              { "outbox_retry", test_outbox_retry },
+              { "outbox_backstop", test_outbox_backstop } };
+
+int
+main(int argc, char **argv) {
+
+    pthread_t thread;
+    int       failed = 0;
+
+    (void)argc;
+    (void)argv;
+
+    /* Initialize the log and the scheduler, then start the server */
+    if ((MENDER_OK != mender_log_init()) || (MENDER_OK != mender_scheduler_init())) {
+        printf("Unable to initialize the scheduler\n");
+        return EXIT_FAILURE;
+    }
+    if (0 != pthread_create(&thread, NULL, test_server_thread, NULL)) {
+        printf("Unable to start the server\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Run the tests */
+    for (size_t index = 0; index < sizeof(tests) / sizeof(tests[0]); index++) {
+        if (MENDER_OK == tests[index].run()) {
+            printf("%-20s PASSED\n", tests[index].name);
+        } else {
+            printf("%-20s FAILED\n", tests[index].name);
+            failed++;
+        }
+    }
+
+    /* Stop the server */
+    pthread_mutex_lock(&test_connection.mutex);
+    test_connection.exit = true;
+    pthread_mutex_unlock(&test_connection.mutex);
+    pthread_join(thread, NULL);
+    mender_scheduler_exit();
+    mender_log_exit();
+
+    return (0 == failed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}